@@ -0,0 +1,77 @@
+/**
+ * Fast Fibonacci computation engine with arbitrary precision.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#ifndef FIB_ENGINE_HPP
+#define FIB_ENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Arbitrary-precision unsigned integer, with just what the engine needs.
+ */
+class BigUint
+{
+public:
+  BigUint(uint64_t value = 0);
+
+  BigUint operator+(const BigUint & other) const;
+  BigUint operator-(const BigUint & other) const; //! Requires other <= *this
+  BigUint operator*(const BigUint & other) const;
+
+  //! Decimal representation
+  std::string str() const;
+
+private:
+  //! Base 10^9 digits, least significant first, no leading zeros
+  std::vector<uint32_t> limbs_;
+
+  void trim();
+};
+
+/**
+ * Computes Fibonacci numbers by fast doubling, in O(log n) big multiplications.
+ *
+ * The pairs (F(k), F(k+1)) met along the way are memoized in a table shared by
+ * all goals: lookups only take a shared lock, so concurrent goals only contend
+ * when they add new entries.
+ */
+class FibonacciEngine
+{
+public:
+  //! Process-wide engine, to share the table across goals
+  static FibonacciEngine & shared();
+
+  explicit FibonacciEngine(size_t max_entries = 4096);
+
+  FibonacciEngine(const FibonacciEngine &) = delete;
+  FibonacciEngine & operator=(const FibonacciEngine &) = delete;
+
+  //! Computes F(n)
+  BigUint compute(uint64_t n);
+
+  //! Number of memoized pairs
+  size_t cached() const;
+
+private:
+  using Pair = std::shared_ptr<const std::pair<BigUint, BigUint>>;
+
+  Pair pair(uint64_t n);
+
+  std::unordered_map<uint64_t, Pair> table_;
+  size_t max_entries_;
+  mutable std::shared_mutex table_lock_;
+};
+
+#endif
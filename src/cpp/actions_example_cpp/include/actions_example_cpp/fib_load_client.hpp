@@ -0,0 +1,116 @@
+/**
+ * Fibonacci computation action load-generating client.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#ifndef FIB_LOAD_CLIENT_HPP
+#define FIB_LOAD_CLIENT_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp_action/rclcpp_action.hpp>
+
+#include <ros2_examples_interfaces/action/fibonacci.hpp>
+
+/**
+ * Latency histogram with power of two bins, from 1 us to about half an hour.
+ */
+class LatencyHistogram
+{
+public:
+  //! Adds a sample
+  void add(std::chrono::steady_clock::duration latency);
+
+  //! Number of samples
+  uint64_t count() const {return count_;}
+
+  //! Writes count, mean, percentiles and the non-empty bins
+  std::string str(const std::string & name) const;
+
+private:
+  static constexpr size_t BINS = 32;
+
+  //! Upper bound of the samples below a quantile, from the bins
+  double quantile(double q) const;
+
+  std::array<uint64_t, BINS> bins_{}; //! Bin i holds [2^(i-1), 2^i) us, the last one the rest
+  uint64_t count_ = 0;
+  double sum_ = 0.0;  //! [us]
+  double min_ = 0.0;  //! [us]
+  double max_ = 0.0;  //! [us]
+};
+
+/**
+ * Sends many goals to the Fibonacci server, keeping some of them in flight,
+ * and measures how long the server takes to answer them.
+ *
+ * For each goal it records the time from the request to:
+ * - the goal response, be it acceptance or rejection;
+ * - the first feedback message;
+ * - the result.
+ * Callbacks all run on the executor thread, so no locking is needed.
+ */
+class FibonacciLoadClient : public rclcpp::Node
+{
+public:
+  using Fibonacci = ros2_examples_interfaces::action::Fibonacci;
+  using GoalHandle = rclcpp_action::ClientGoalHandle<Fibonacci>;
+
+  FibonacciLoadClient(int order, size_t goals, size_t in_flight);
+
+  //! Sends the first goals, the returned future is set once all are done
+  std::shared_future<void> start();
+
+  //! Writes the run statistics
+  std::string report() const;
+
+private:
+  /* Timestamps of a goal */
+  struct GoalTiming
+  {
+    std::chrono::steady_clock::time_point sent;
+    bool got_feedback = false;
+  };
+
+  void send_next();
+  void goal_done();
+
+  void goal_response_clbk(size_t index, GoalHandle::SharedPtr goal_handle);
+  void feedback_clbk(size_t index);
+  void result_clbk(size_t index, const GoalHandle::WrappedResult & result);
+
+  rclcpp_action::Client<Fibonacci>::SharedPtr client_;
+
+  int order_;
+  size_t goals_;
+  size_t max_in_flight_;
+
+  std::vector<GoalTiming> timings_;
+  size_t in_flight_ = 0;
+  size_t completed_ = 0;
+  size_t rejected_ = 0;
+  size_t succeeded_ = 0;
+  size_t failed_ = 0;
+  std::chrono::steady_clock::time_point started_;
+  std::chrono::steady_clock::time_point finished_;
+
+  LatencyHistogram accept_latency_;
+  LatencyHistogram feedback_latency_;
+  LatencyHistogram result_latency_;
+
+  std::promise<void> done_;
+  std::shared_future<void> done_future_;
+};
+
+#endif
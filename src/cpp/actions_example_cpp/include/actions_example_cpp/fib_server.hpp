@@ -12,13 +12,24 @@
 //! Required to handle all the following shared pointers
 #include <memory>
 
-//! Required to handle thread generation when accepting goals
+//! Required to run and queue goals on a fixed set of worker threads
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 #include <rclcpp_action/rclcpp_action.hpp> //! Required when handling actions
 #include <ros2_examples_interfaces/action/fibonacci.hpp> //! Fibonacci action definition
 
+#include <ros2_examples_headers/feedback_throttle/feedback_throttle.hpp> //! Rate-limited feedback
+#include <actions_example_cpp/fib_engine.hpp> //! Fast computation engine
+
 //! Action-related types can get quite long, so let's simplify
 using Fibonacci = ros2_examples_interfaces::action::Fibonacci;
 using FibonacciGoalHandle = rclcpp_action::ServerGoalHandle<Fibonacci>;
@@ -26,6 +37,7 @@ using FibonacciGoalHandle = rclcpp_action::ServerGoalHandle<Fibonacci>;
 //! Define these manually to enforce const here and in the following
 using FibonacciGoalSharedPtr = std::shared_ptr<const Fibonacci::Goal>;
 using FibonacciGoalHandleSharedPtr = std::shared_ptr<FibonacciGoalHandle>;
+using FeedbackThrottle = ROS2FeedbackThrottle::FeedbackThrottle<Fibonacci>;
 
 //! Pay attention to the types hell...
 
@@ -36,11 +48,43 @@ class FibonacciComputer : public rclcpp::Node
 {
 public:
   FibonacciComputer();
+  ~FibonacciComputer();
+
+  //! Stops accepting goals and waits for the admitted ones, up to a deadline
+  void drain(std::chrono::steady_clock::time_point deadline);
 
 private:
   //! Action server (like for services)
   rclcpp_action::Server<Fibonacci>::SharedPtr fib_server_;
 
+  //! Goal execution pool: accepted goals wait in a bounded queue and are
+  //! run by a fixed number of worker threads, lower orders first since they
+  //! complete sooner, and goals of the same order in acceptance order
+  using GoalQueue = std::map<std::pair<int32_t, uint64_t>, FibonacciGoalHandleSharedPtr>;
+  std::vector<std::thread> workers_;
+  GoalQueue goal_queue_; //! Keyed by goal order and acceptance ticket
+  uint64_t next_ticket_ = 0;
+  size_t max_queued_goals_;
+  size_t admitted_goals_ = 0; //! Goals accepted and not yet completed
+  bool stopped_ = false;
+  bool draining_ = false;
+
+  //! Period of a computation step, at which running goals check for stops
+  static constexpr std::chrono::milliseconds STEP_PERIOD{1000};
+
+  //! Time reserved before the drain deadline for aborted goals to stop:
+  //! one step, plus some margin to publish their results
+  static constexpr std::chrono::milliseconds ABORT_SLACK =
+    STEP_PERIOD + std::chrono::milliseconds(500);
+
+  std::mutex queue_lock_;
+  std::condition_variable queue_cv_;
+  std::condition_variable idle_cv_; //! Notified when an admitted goal completes
+
+  //! Worker thread routine
+  void worker_routine();
+  bool stopping();
+
   //! Following 3 routines are required by the API, first 2 return from enums
   //! Goal request handler routine
   rclcpp_action::GoalResponse handle_goal(
@@ -53,8 +97,19 @@ private:
   //! Goal acceptance handler routine
   void handle_accepted(const FibonacciGoalHandleSharedPtr goal_handle);
 
+  //! Feedback throttling parameters
+  double feedback_max_rate_;
+  bool feedback_delta_;
+
+  //! Computation mode: step by step with feedback, or with the fast engine
+  bool use_engine_;
+  int max_order_;
+
   //! Computation routine
   void compute(const FibonacciGoalHandleSharedPtr goal_handle);
+
+  //! Fast computation routine, with arbitrary precision and no feedback
+  void compute_engine(const FibonacciGoalHandleSharedPtr goal_handle);
 };
 
 #endif
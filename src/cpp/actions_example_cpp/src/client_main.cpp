@@ -9,11 +9,14 @@
 #include <iostream>
 #include <cstdlib>
 #include <future>
+#include <string>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 #include <rclcpp_action/rclcpp_action.hpp>
 
 #include <actions_example_cpp/fib_client.hpp>
+#include <actions_example_cpp/fib_load_client.hpp>
 
 /**
  * @brief Wraps a goal cancellation request routine.
@@ -43,17 +46,55 @@ void cancel_goal(
   //! The callback will do the rest of the job
 }
 
+/**
+ * @brief Sends many goals, keeping some in flight, and prints latency statistics.
+ *
+ * @param order Order of all goals.
+ * @param goals Number of goals to send.
+ * @param in_flight Number of goals sent and not completed at any time.
+ * @return Process exit code.
+ */
+int run_load(int order, size_t goals, size_t in_flight)
+{
+  auto load_node = std::make_shared<FibonacciLoadClient>(order, goals, in_flight);
+
+  //! All goals are sent asynchronously from the callbacks, so it's enough to
+  //! spin until the last one is completed
+  std::shared_future<void> done = load_node->start();
+  if (rclcpp::spin_until_future_complete(load_node, done) !=
+    rclcpp::FutureReturnCode::SUCCESS)
+  {
+    std::cerr << "Interrupted while waiting for goals" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << load_node->report();
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char ** argv)
 {
+  // Initialize ROS 2 back-end
+  //! ROS arguments (--ros-args ...) are stripped here, so that only
+  //! positional ones are left to parse
+  std::vector<std::string> args = rclcpp::init_and_remove_ros_arguments(argc, argv);
+
   // Parse input arguments
-  if (argc < 2) {
-    std::cerr << "Usage:\n\tfib_client ORDER" << std::endl;
+  if (args.size() != 2 && args.size() != 4) {
+    std::cerr << "Usage:\n\tfib_client ORDER\n\tfib_client ORDER GOALS IN_FLIGHT" << std::endl;
+    rclcpp::shutdown();
     exit(EXIT_FAILURE);
   }
-  int order = atoi(argv[1]);
+  int order = atoi(args[1].c_str());
 
-  // Initialize ROS 2 back-end
-  rclcpp::init(argc, argv);
+  //! Load-generating mode, as a benchmark for the server
+  if (args.size() == 4) {
+    int code = run_load(
+      order,
+      size_t(atol(args[2].c_str())),
+      size_t(atol(args[3].c_str())));
+    rclcpp::shutdown();
+    exit(code);
+  }
   auto client_node = std::make_shared<FibonacciClient>();
 
   //! From async_send_goal documentation:
@@ -0,0 +1,214 @@
+/**
+ * Fast Fibonacci computation engine source code.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+#include <actions_example_cpp/fib_engine.hpp>
+
+//! Base of the digits of big integers
+static constexpr uint64_t BIG_BASE = 1000000000ULL;
+
+/**
+ * @brief Creates a big integer from a machine one.
+ *
+ * @param value Initial value.
+ */
+BigUint::BigUint(uint64_t value)
+{
+  while (value > 0) {
+    limbs_.push_back(uint32_t(value % BIG_BASE));
+    value /= BIG_BASE;
+  }
+}
+
+/**
+ * @brief Drops leading zero digits.
+ */
+void BigUint::trim()
+{
+  while (!limbs_.empty() && limbs_.back() == 0) {
+    limbs_.pop_back();
+  }
+}
+
+/**
+ * @brief Adds two big integers.
+ *
+ * @param other Second addend.
+ * @return Sum.
+ */
+BigUint BigUint::operator+(const BigUint & other) const
+{
+  BigUint sum;
+  size_t n = std::max(limbs_.size(), other.limbs_.size());
+  sum.limbs_.resize(n + 1);
+  uint64_t carry = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t digit = carry;
+    digit += i < limbs_.size() ? limbs_[i] : 0;
+    digit += i < other.limbs_.size() ? other.limbs_[i] : 0;
+    sum.limbs_[i] = uint32_t(digit % BIG_BASE);
+    carry = digit / BIG_BASE;
+  }
+  sum.limbs_[n] = uint32_t(carry);
+  sum.trim();
+  return sum;
+}
+
+/**
+ * @brief Subtracts a big integer not greater than this one.
+ *
+ * @param other Subtrahend.
+ * @return Difference.
+ */
+BigUint BigUint::operator-(const BigUint & other) const
+{
+  BigUint difference = *this;
+  int64_t borrow = 0;
+  for (size_t i = 0; i < difference.limbs_.size(); i++) {
+    int64_t digit = int64_t(difference.limbs_[i]) - borrow;
+    digit -= i < other.limbs_.size() ? other.limbs_[i] : 0;
+    borrow = digit < 0 ? 1 : 0;
+    difference.limbs_[i] = uint32_t(digit + borrow * int64_t(BIG_BASE));
+  }
+  difference.trim();
+  return difference;
+}
+
+/**
+ * @brief Multiplies two big integers.
+ *
+ * @param other Second factor.
+ * @return Product.
+ */
+BigUint BigUint::operator*(const BigUint & other) const
+{
+  BigUint product;
+  if (limbs_.empty() || other.limbs_.empty()) {
+    return product;
+  }
+  //! Products of two digits fit 60 bits, so carries are propagated
+  //! once per row and columns never overflow
+  std::vector<uint64_t> columns(limbs_.size() + other.limbs_.size(), 0);
+  for (size_t i = 0; i < limbs_.size(); i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < other.limbs_.size(); j++) {
+      uint64_t digit = columns[i + j] + uint64_t(limbs_[i]) * other.limbs_[j] + carry;
+      columns[i + j] = digit % BIG_BASE;
+      carry = digit / BIG_BASE;
+    }
+    columns[i + other.limbs_.size()] += carry;
+  }
+  product.limbs_.assign(columns.begin(), columns.end());
+  product.trim();
+  return product;
+}
+
+/**
+ * @brief Converts to decimal.
+ *
+ * @return Decimal representation.
+ */
+std::string BigUint::str() const
+{
+  if (limbs_.empty()) {
+    return "0";
+  }
+  std::string digits = std::to_string(limbs_.back());
+  char buffer[16];
+  for (size_t i = limbs_.size() - 1; i-- > 0; ) {
+    std::snprintf(buffer, sizeof(buffer), "%09u", limbs_[i]);
+    digits += buffer;
+  }
+  return digits;
+}
+
+/**
+ * @brief Gets the process-wide engine.
+ *
+ * @return Shared engine.
+ */
+FibonacciEngine & FibonacciEngine::shared()
+{
+  static FibonacciEngine engine;
+  return engine;
+}
+
+/**
+ * @brief Creates an engine.
+ *
+ * @param max_entries Maximum number of memoized pairs, later ones are not kept.
+ */
+FibonacciEngine::FibonacciEngine(size_t max_entries)
+: max_entries_(max_entries)
+{}
+
+/**
+ * @brief Computes F(n).
+ *
+ * @param n Index in the sequence.
+ * @return F(n).
+ */
+BigUint FibonacciEngine::compute(uint64_t n)
+{
+  return pair(n)->first;
+}
+
+/**
+ * @brief Gets the number of memoized pairs.
+ *
+ * @return Table size.
+ */
+size_t FibonacciEngine::cached() const
+{
+  std::shared_lock<std::shared_mutex> lock(table_lock_);
+  return table_.size();
+}
+
+/**
+ * @brief Computes (F(n), F(n+1)) by fast doubling, memoizing the result.
+ *
+ * With k = n / 2:
+ * - F(2k) = F(k) * (2 F(k+1) - F(k))
+ * - F(2k+1) = F(k)^2 + F(k+1)^2
+ *
+ * @param n Index in the sequence.
+ * @return Pair of consecutive Fibonacci numbers.
+ */
+FibonacciEngine::Pair FibonacciEngine::pair(uint64_t n)
+{
+  if (n == 0) {
+    static const Pair base = std::make_shared<const std::pair<BigUint, BigUint>>(0, 1);
+    return base;
+  }
+  {
+    std::shared_lock<std::shared_mutex> lock(table_lock_);
+    auto it = table_.find(n);
+    if (it != table_.end()) {
+      return it->second;
+    }
+  }
+
+  //! Computed without holding the lock, concurrent goals may duplicate work
+  Pair half = pair(n / 2);
+  const BigUint & a = half->first;
+  const BigUint & b = half->second;
+  BigUint even = a * (b + b - a);
+  BigUint odd = a * a + b * b;
+  Pair result = (n % 2 == 0) ?
+    std::make_shared<const std::pair<BigUint, BigUint>>(std::move(even), odd) :
+    std::make_shared<const std::pair<BigUint, BigUint>>(odd, even + odd);
+
+  std::unique_lock<std::shared_mutex> lock(table_lock_);
+  if (table_.size() < max_entries_) {
+    table_.emplace(n, result);
+  }
+  return result;
+}
@@ -0,0 +1,241 @@
+/**
+ * Fibonacci computation action load-generating client source code.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include <actions_example_cpp/fib_load_client.hpp>
+
+/**
+ * @brief Adds a sample to the histogram.
+ *
+ * @param latency Measured latency.
+ */
+void LatencyHistogram::add(std::chrono::steady_clock::duration latency)
+{
+  double us = std::chrono::duration<double, std::micro>(latency).count();
+  size_t bin = 0;
+  while (bin < BINS - 1 && us >= double(uint64_t(1) << bin)) {
+    bin++;
+  }
+  bins_[bin]++;
+  min_ = count_ == 0 ? us : std::min(min_, us);
+  max_ = count_ == 0 ? us : std::max(max_, us);
+  sum_ += us;
+  count_++;
+}
+
+/**
+ * @brief Computes an upper bound of a quantile from the bins.
+ *
+ * @param q Quantile, in [0, 1].
+ * @return Upper bound of the bin holding the quantile [us].
+ */
+double LatencyHistogram::quantile(double q) const
+{
+  uint64_t rank = uint64_t(std::ceil(q * double(count_)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BINS; i++) {
+    seen += bins_[i];
+    if (seen >= rank && seen > 0) {
+      return std::min(double(uint64_t(1) << i), max_);
+    }
+  }
+  return max_;
+}
+
+/**
+ * @brief Writes count, mean, percentiles and the non-empty bins.
+ *
+ * @param name Name of the measured latency.
+ * @return Multiline report.
+ */
+std::string LatencyHistogram::str(const std::string & name) const
+{
+  std::stringstream ss("");
+  ss << name << ": " << count_ << " samples";
+  if (count_ == 0) {
+    ss << "\n";
+    return ss.str();
+  }
+  ss << ", min " << min_ / 1000.0 << " ms"
+     << ", mean " << sum_ / double(count_) / 1000.0 << " ms"
+     << ", p50 <= " << quantile(0.5) / 1000.0 << " ms"
+     << ", p90 <= " << quantile(0.9) / 1000.0 << " ms"
+     << ", p99 <= " << quantile(0.99) / 1000.0 << " ms"
+     << ", max " << max_ / 1000.0 << " ms\n";
+  for (size_t i = 0; i < BINS; i++) {
+    if (bins_[i] == 0) {
+      continue;
+    }
+    double low = i == 0 ? 0.0 : double(uint64_t(1) << (i - 1));
+    ss << "  [" << low / 1000.0 << ", " << double(uint64_t(1) << i) / 1000.0 << ") ms: "
+       << bins_[i] << "\n";
+  }
+  return ss.str();
+}
+
+/**
+ * @brief Creates a new FibonacciLoadClient node.
+ *
+ * @param order Order of all goals.
+ * @param goals Number of goals to send.
+ * @param in_flight Number of goals sent and not completed at any time.
+ */
+FibonacciLoadClient::FibonacciLoadClient(int order, size_t goals, size_t in_flight)
+: Node("fibonacci_load_client"),
+  order_(order),
+  goals_(goals),
+  max_in_flight_(std::max<size_t>(in_flight, 1))
+{
+  client_ = rclcpp_action::create_client<Fibonacci>(
+    this,
+    "/fibonacci_computer/fibonacci");
+  timings_.reserve(goals_);
+  done_future_ = done_.get_future().share();
+
+  RCLCPP_INFO(this->get_logger(), "Node initialized");
+}
+
+/**
+ * @brief Waits for the server, then sends the first goals.
+ *
+ * @return Future set once all goals are completed.
+ */
+std::shared_future<void> FibonacciLoadClient::start()
+{
+  while (!client_->wait_for_action_server(std::chrono::seconds(1))) {
+    RCLCPP_WARN(this->get_logger(), "Server not available...");
+    if (!rclcpp::ok()) {
+      throw std::runtime_error("Middleware crashed");
+    }
+  }
+
+  started_ = std::chrono::steady_clock::now();
+  if (goals_ == 0) {
+    finished_ = started_;
+    done_.set_value();
+  }
+  while (in_flight_ < max_in_flight_ && timings_.size() < goals_) {
+    send_next();
+  }
+  return done_future_;
+}
+
+/**
+ * @brief Sends the next goal, with callbacks that know its index.
+ */
+void FibonacciLoadClient::send_next()
+{
+  size_t index = timings_.size();
+  timings_.push_back(GoalTiming{std::chrono::steady_clock::now()});
+  in_flight_++;
+
+  Fibonacci::Goal goal_request{};
+  goal_request.set__order(order_);
+
+  rclcpp_action::Client<Fibonacci>::SendGoalOptions opts;
+  opts.goal_response_callback =
+    [this, index](GoalHandle::SharedPtr goal_handle) {
+      goal_response_clbk(index, goal_handle);
+    };
+  opts.feedback_callback =
+    [this, index](GoalHandle::SharedPtr, const std::shared_ptr<const Fibonacci::Feedback>) {
+      feedback_clbk(index);
+    };
+  opts.result_callback =
+    [this, index](const GoalHandle::WrappedResult & result) {
+      result_clbk(index, result);
+    };
+  client_->async_send_goal(goal_request, opts);
+}
+
+/**
+ * @brief Frees the place of a completed goal, sending the next one.
+ */
+void FibonacciLoadClient::goal_done()
+{
+  in_flight_--;
+  completed_++;
+  if (timings_.size() < goals_) {
+    send_next();
+  } else if (completed_ == goals_) {
+    finished_ = std::chrono::steady_clock::now();
+    done_.set_value();
+  }
+}
+
+/**
+ * @brief Records the goal response latency.
+ *
+ * @param index Goal index.
+ * @param goal_handle Goal handle pointer, null if the goal was rejected.
+ */
+void FibonacciLoadClient::goal_response_clbk(size_t index, GoalHandle::SharedPtr goal_handle)
+{
+  accept_latency_.add(std::chrono::steady_clock::now() - timings_[index].sent);
+  if (goal_handle == nullptr) {
+    rejected_++;
+    goal_done();
+  }
+}
+
+/**
+ * @brief Records the first feedback latency.
+ *
+ * @param index Goal index.
+ */
+void FibonacciLoadClient::feedback_clbk(size_t index)
+{
+  GoalTiming & timing = timings_[index];
+  if (!timing.got_feedback) {
+    timing.got_feedback = true;
+    feedback_latency_.add(std::chrono::steady_clock::now() - timing.sent);
+  }
+}
+
+/**
+ * @brief Records the result latency.
+ *
+ * @param index Goal index.
+ * @param result Wrapped result object.
+ */
+void FibonacciLoadClient::result_clbk(size_t index, const GoalHandle::WrappedResult & result)
+{
+  result_latency_.add(std::chrono::steady_clock::now() - timings_[index].sent);
+  if (result.code == rclcpp_action::ResultCode::SUCCEEDED) {
+    succeeded_++;
+  } else {
+    failed_++;
+  }
+  goal_done();
+}
+
+/**
+ * @brief Writes the run statistics.
+ *
+ * @return Multiline report.
+ */
+std::string FibonacciLoadClient::report() const
+{
+  double elapsed = std::chrono::duration<double>(finished_ - started_).count();
+  std::stringstream ss("");
+  ss << completed_ << " goals of order " << order_ << " with up to " << max_in_flight_
+     << " in flight in " << elapsed << " s";
+  if (elapsed > 0.0) {
+    ss << " (" << double(completed_) / elapsed << " goals/s)";
+  }
+  ss << "\n"
+     << "succeeded " << succeeded_ << ", failed " << failed_ << ", rejected " << rejected_ << "\n"
+     << accept_latency_.str("Goal response")
+     << feedback_latency_.str("First feedback")
+     << result_latency_.str("Result");
+  return ss.str();
+}
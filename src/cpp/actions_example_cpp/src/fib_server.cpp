@@ -6,7 +6,10 @@
  * January 10, 2022
  */
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <string>
 
 #include <actions_example_cpp/fib_server.hpp>
 
@@ -40,9 +43,63 @@ FibonacciComputer::FibonacciComputer()
       this,
       std::placeholders::_1));
 
+  //! Feedback throttling: max rate [Hz] (0 for no limit), and whether to
+  //! send only the elements computed since the previous feedback
+  feedback_max_rate_ = this->declare_parameter("feedback_max_rate", 10.0);
+  feedback_delta_ = this->declare_parameter("feedback_delta", false);
+
+  //! Computation mode, either:
+  //! - simulated: one element per second, with feedback, up to order 46
+  //!   since elements are int32
+  //! - engine: O(log n) fast doubling with a table shared across goals and
+  //!   arbitrary precision, to load test the server at high orders
+  std::string compute_mode = this->declare_parameter("compute_mode", std::string("simulated"));
+  use_engine_ = compute_mode == "engine";
+  if (!use_engine_ && compute_mode != "simulated") {
+    RCLCPP_ERROR(
+      this->get_logger(),
+      "Invalid compute mode %s, using simulated",
+      compute_mode.c_str());
+  }
+  max_order_ = this->declare_parameter("max_order", 20);
+  if (!use_engine_) {
+    max_order_ = std::min(max_order_, 46);
+  }
+
+  //! Size the goal execution pool: goals beyond the workers wait in a
+  //! bounded queue, and new requests are rejected once it is full
+  int workers = this->declare_parameter("workers", 2);
+  int max_queued_goals = this->declare_parameter("max_queued_goals", 4);
+  max_queued_goals_ = max_queued_goals > 0 ? size_t(max_queued_goals) : 0;
+  for (int i = 0; i < std::max(workers, 1); i++) {
+    workers_.emplace_back(&FibonacciComputer::worker_routine, this);
+  }
+
   RCLCPP_INFO(this->get_logger(), "Node initialized");
 }
 
+/**
+ * @brief Stops the goal execution pool, aborting queued goals.
+ */
+FibonacciComputer::~FibonacciComputer()
+{
+  GoalQueue queued;
+  {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    stopped_ = true;
+    queued.swap(goal_queue_);
+  }
+  queue_cv_.notify_all();
+
+  //! Running goals check the stop flag at each step, so this returns quickly
+  for (std::thread & worker : workers_) {
+    worker.join();
+  }
+  for (auto & entry : queued) {
+    entry.second->abort(std::make_shared<Fibonacci::Result>());
+  }
+}
+
 /**
  * @brief Handles a new goal request.
  *
@@ -54,8 +111,8 @@ rclcpp_action::GoalResponse FibonacciComputer::handle_goal(
   const rclcpp_action::GoalUUID & uuid,
   FibonacciGoalSharedPtr goal)
 {
-  //! This server accepts requests up to order 20
-  if (goal->order > 20) {
+  //! This server accepts requests up to the order it is configured for
+  if (goal->order > max_order_) {
     RCLCPP_ERROR(
       this->get_logger(),
       "Received invalid request (%s) of order %d REJECTED",
@@ -63,6 +120,21 @@ rclcpp_action::GoalResponse FibonacciComputer::handle_goal(
       goal->order);
     return rclcpp_action::GoalResponse::REJECT;
   }
+
+  //! Apply backpressure: reserve a place in the pool or reject the goal,
+  //! so that a burst of requests cannot pile up without bounds
+  {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    if (stopped_ || draining_ || admitted_goals_ >= workers_.size() + max_queued_goals_) {
+      RCLCPP_ERROR(
+        this->get_logger(),
+        "Received request (%s) of order %d REJECTED: server saturated",
+        rclcpp_action::to_string(uuid).c_str(),
+        goal->order);
+      return rclcpp_action::GoalResponse::REJECT;
+    }
+    admitted_goals_++;
+  }
   RCLCPP_INFO(
     this->get_logger(),
     "Received request (%s) of order %d ACCEPTED",
@@ -113,14 +185,102 @@ void FibonacciComputer::handle_accepted(
 {
   //! Here we're inside a service: the callback should return ASAP
   //! in order not to starve the (by default single-threaded) executor
-  //! This is why we only start a new thread (detached from the C++
-  //! object to let it run freely until done or killed)
-  std::thread{
-    std::bind(
-      &FibonacciComputer::compute,
-      this,
-      std::placeholders::_1),
-    goal_handle}.detach(); //! Detaching is necessary since this is spawned by the executor's thread!
+  //! This is why we only queue the goal for the worker threads, which are
+  //! owned by the node and joined when it is destroyed
+  {
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    //! Place reserved in handle_goal
+    goal_queue_.emplace(
+      std::make_pair(goal_handle->get_goal()->order, next_ticket_++),
+      goal_handle);
+  }
+  queue_cv_.notify_one();
+}
+
+/**
+ * @brief Runs queued goals, lowest order first, until the node is destroyed.
+ */
+void FibonacciComputer::worker_routine()
+{
+  while (true) {
+    FibonacciGoalHandleSharedPtr goal_handle;
+    {
+      std::unique_lock<std::mutex> lock(queue_lock_);
+      queue_cv_.wait(lock, [this] {return stopped_ || !goal_queue_.empty();});
+      if (stopped_) {
+        return;
+      }
+      goal_handle = goal_queue_.begin()->second;
+      goal_queue_.erase(goal_queue_.begin());
+    }
+
+    if (use_engine_) {
+      compute_engine(goal_handle);
+    } else {
+      compute(goal_handle);
+    }
+
+    //! Free the place of this goal for new requests
+    std::lock_guard<std::mutex> lock(queue_lock_);
+    admitted_goals_--;
+    idle_cv_.notify_all();
+  }
+}
+
+/**
+ * @brief Stops accepting goals and waits for the admitted ones to complete.
+ *
+ * Goals still queued or running ABORT_SLACK before the deadline are aborted:
+ * running ones stop at their next step, which this waits for until the deadline.
+ *
+ * @param deadline Time by which to return.
+ */
+void FibonacciComputer::drain(std::chrono::steady_clock::time_point deadline)
+{
+  GoalQueue queued;
+  {
+    std::unique_lock<std::mutex> lock(queue_lock_);
+    draining_ = true;
+    if (idle_cv_.wait_until(
+        lock, deadline - ABORT_SLACK,
+        [this] {return admitted_goals_ == 0;}))
+    {
+      RCLCPP_INFO(this->get_logger(), "All goals completed");
+      return;
+    }
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Aborting %zu goals before drain deadline",
+      admitted_goals_);
+    stopped_ = true;
+    queued.swap(goal_queue_);
+    admitted_goals_ -= queued.size();
+  }
+  queue_cv_.notify_all();
+  for (auto & entry : queued) {
+    entry.second->abort(std::make_shared<Fibonacci::Result>());
+  }
+
+  //! Running goals abort themselves at their next step, which comes within
+  //! a step period: wait for them, so that none is left without a result
+  std::unique_lock<std::mutex> lock(queue_lock_);
+  if (!idle_cv_.wait_until(lock, deadline, [this] {return admitted_goals_ == 0;})) {
+    RCLCPP_ERROR(
+      this->get_logger(),
+      "%zu goals still running after drain deadline",
+      admitted_goals_);
+  }
+}
+
+/**
+ * @brief Tells whether the goal execution pool is being stopped.
+ *
+ * @return True when running goals should stop.
+ */
+bool FibonacciComputer::stopping()
+{
+  std::lock_guard<std::mutex> lock(queue_lock_);
+  return stopped_;
 }
 
 /**
@@ -137,16 +297,16 @@ void FibonacciComputer::compute(
     rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
 
   //! This object helps us to define sleep times (in real time)
-  rclcpp::WallRate loop_rate(1s);
+  rclcpp::WallRate loop_rate(STEP_PERIOD);
 
-  //! Feedback publishing API requires a shared_ptr
-  auto feedback = std::make_shared<Fibonacci::Feedback>();
+  //! Feedback is rate limited, and optionally sent as deltas
+  FeedbackThrottle feedback(goal_handle, feedback_max_rate_, feedback_delta_);
 
-  //! Same holds for the result message
+  //! Result publishing API requires a shared_ptr
   auto result = std::make_shared<Fibonacci::Result>();
 
   //! This is for us
-  std::vector<int> & sequence = feedback->partial_sequence;
+  std::vector<int> sequence;
   const auto goal = goal_handle->get_goal();
   int order = goal->order;
 
@@ -168,9 +328,21 @@ void FibonacciComputer::compute(
   //! Always check if rclcpp::ok while computing since you need it to
   //! interact with the middleware!
   for (int i = 1; (i < order) && rclcpp::ok(); i++) {
+    //! The node is being destroyed, so leave now
+    if (stopping()) {
+      feedback.flush(sequence);
+      goal_handle->abort(result); //! Terminal API to call
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Computation (%s) ABORTED: server stopping",
+        rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+      return;
+    }
+
     //! Check if there is a cancel request, and in case mark the goal as such
     if (goal_handle->is_canceling()) {
       // Publish what has been computed so far
+      feedback.flush(sequence);
       result->set__sequence(sequence);
       goal_handle->canceled(result); //! Terminal API to call
       RCLCPP_WARN(
@@ -183,12 +355,13 @@ void FibonacciComputer::compute(
     // Update sequence
     sequence.push_back(sequence[i] + sequence[i - 1]);
 
-    //! Publish feedback (that we're building upon)
-    goal_handle->publish_feedback(feedback);
-    RCLCPP_INFO(
-      this->get_logger(),
-      "Published feedback for goal (%s)",
-      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    //! Publish feedback, unless the last one is too recent
+    if (feedback.update(sequence)) {
+      RCLCPP_DEBUG(
+        this->get_logger(),
+        "Published feedback for goal (%s)",
+        rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    }
 
     //! This simulates computational overhead
     loop_rate.sleep();
@@ -197,7 +370,61 @@ void FibonacciComputer::compute(
   // Publish result
   //! ALWAYS check if the middelware is ok!
   if (rclcpp::ok()) {
+    feedback.flush(sequence);
     result->set__sequence(sequence);
+    result->set__value(std::to_string(sequence.back()));
+    goal_handle->succeed(result); //! Terminal API to call
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Goal (%s) completed",
+      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+  }
+}
+
+/**
+ * @brief Computes a Fibonacci number with the fast engine.
+ *
+ * @param goal_handle Handle to the goal object.
+ */
+void FibonacciComputer::compute_engine(
+  const FibonacciGoalHandleSharedPtr goal_handle)
+{
+  auto result = std::make_shared<Fibonacci::Result>();
+  int order = goal_handle->get_goal()->order;
+
+  //! This implementation refuses order 0, like the simulated one
+  if (order <= 0) {
+    goal_handle->abort(result); //! Terminal API to call
+    RCLCPP_ERROR(
+      this->get_logger(),
+      "Request (%s) has invalid order ABORTED",
+      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    return;
+  }
+  if (goal_handle->is_canceling()) {
+    goal_handle->canceled(result); //! Terminal API to call
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Computation (%s) CANCELED",
+      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    return;
+  }
+
+  BigUint value = FibonacciEngine::shared().compute(uint64_t(order));
+
+  //! The sequence keeps the elements that fit int32, up to F(46)
+  std::vector<int> & sequence = result->sequence;
+  int64_t previous = 0, current = 1;
+  sequence.push_back(0);
+  for (int i = 1; i <= std::min(order, 46); i++) {
+    sequence.push_back(int(current));
+    int64_t next = previous + current;
+    previous = current;
+    current = next;
+  }
+  result->set__value(value.str());
+
+  if (rclcpp::ok()) {
     goal_handle->succeed(result); //! Terminal API to call
     RCLCPP_INFO(
       this->get_logger(),
@@ -6,17 +6,48 @@
  * January 10, 2022
  */
 
+#include <chrono>
+#include <csignal>
 #include <iostream>
 
 #include <rclcpp/rclcpp.hpp>
 #include <actions_example_cpp/fib_server.hpp>
 
+#include <ros2_examples_headers/signal_handler/signal_handler.hpp>
+
+using namespace std::chrono_literals;
+
 int main(int argc, char ** argv)
 {
   std::cout << "Starting Fibonacci Computer action server..." << std::endl;
-  rclcpp::init(argc, argv);
+
+  //! Signals are handled by our handler, which lets goals complete before
+  //! shutting down the context
+  rclcpp::init(argc, argv, rclcpp::InitOptions(), rclcpp::SignalHandlerOptions::None);
   auto server_node = std::make_shared<FibonacciComputer>();
+
+  ROS2SignalHandler::SignalHandler & signal_handler =
+    ROS2SignalHandler::SignalHandler::get_global_signal_handler();
+  signal_handler.init(
+    rclcpp::contexts::get_global_default_context(),
+    "fib_server_signal_handler");
+  signal_handler.set_shutdown_deadline(5s);
+  std::weak_ptr<FibonacciComputer> weak_node = server_node;
+  signal_handler.add_shutdown_hook(
+    0,
+    "fibonacci_computer",
+    [weak_node](std::chrono::steady_clock::time_point deadline) {
+      if (auto node = weak_node.lock()) {
+        node->drain(deadline);
+      }
+    });
+  signal_handler.install(SIGINT);
+  signal_handler.install(SIGTERM);
+
   rclcpp::spin(server_node);
+
+  signal_handler.fini();
+  server_node.reset();
   rclcpp::shutdown();
   exit(EXIT_SUCCESS);
 }
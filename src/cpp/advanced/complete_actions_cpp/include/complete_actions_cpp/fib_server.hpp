@@ -12,13 +12,17 @@
 //! Required to handle all the following shared pointers
 #include <memory>
 
-//! Required to handle thread generation when accepting goals
-#include <thread>
+//! Required to signal preemption to running goals
+#include <atomic>
 
 #include <rclcpp/rclcpp.hpp>
 #include <rclcpp_action/rclcpp_action.hpp> //! Required when handling actions
 #include <ros2_examples_interfaces/action/fibonacci.hpp> //! Fibonacci action definition
 
+#include <ros2_examples_headers/feedback_throttle/feedback_throttle.hpp> //! Rate-limited feedback
+
+#include <complete_actions_cpp/goal_scheduler.hpp> //! Deferred goal execution
+
 //! Action-related types can get quite long, so let's simplify
 using Fibonacci = ros2_examples_interfaces::action::Fibonacci;
 using FibonacciGoalHandle = rclcpp_action::ServerGoalHandle<Fibonacci>;
@@ -26,6 +30,7 @@ using FibonacciGoalHandle = rclcpp_action::ServerGoalHandle<Fibonacci>;
 //! Define these manually to enforce const here and in the following
 using FibonacciGoalSharedPtr = std::shared_ptr<const Fibonacci::Goal>;
 using FibonacciGoalHandleSharedPtr = std::shared_ptr<FibonacciGoalHandle>;
+using FeedbackThrottle = ROS2FeedbackThrottle::FeedbackThrottle<Fibonacci>;
 
 //! Pay attention to the types hell...
 
@@ -43,9 +48,10 @@ private:
 
   rclcpp::CallbackGroup::SharedPtr server_clbk_group_;
   rcl_action_server_options_t server_opts_{};
-  rclcpp::TimerBase::SharedPtr work_timer_;
-  void work_activation_clbk();
-  FibonacciGoalHandleSharedPtr new_goal_ = nullptr;
+
+  //! Deferred goals wait here until a worker is free
+  //! Declared after the server: it is destroyed first, terminating its goals
+  std::unique_ptr<GoalScheduler<Fibonacci>> scheduler_;
 
   //! Following 3 routines are required by the API, first 2 return from enums
   //! Goal request handler routine
@@ -59,8 +65,14 @@ private:
   //! Goal acceptance handler routine
   void handle_accepted(const FibonacciGoalHandleSharedPtr goal_handle);
 
-  //! Computation routine
-  void compute(const FibonacciGoalHandleSharedPtr goal_handle);
+  //! Feedback throttling parameters
+  double feedback_max_rate_;
+  bool feedback_delta_;
+
+  //! Computation routine, returning early if the goal is preempted
+  void compute(
+    const FibonacciGoalHandleSharedPtr goal_handle,
+    const std::atomic<bool> & preempted);
 };
 
 #endif
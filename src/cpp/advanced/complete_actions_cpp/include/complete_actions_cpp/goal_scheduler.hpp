@@ -0,0 +1,411 @@
+/**
+ * Deferred goal scheduler for action servers.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#ifndef GOAL_SCHEDULER_HPP
+#define GOAL_SCHEDULER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rclcpp_action/rclcpp_action.hpp>
+
+/**
+ * How queued goals are ordered, and what happens when the server is full.
+ */
+enum class SchedulingPolicy
+{
+  FIFO,         //! Oldest goal first, requests rejected when the queue is full
+  NEWEST_WINS,  //! Newest goal first, displacing the oldest queued or running ones
+  PRIORITY      //! Highest priority first, displacing lower priority goals
+};
+
+/**
+ * Parses a policy name: "fifo", "newest_wins" or "priority".
+ *
+ * @param name Policy name.
+ * @param policy Parsed policy, untouched on failure.
+ * @return True if the name is valid.
+ */
+inline bool parse_scheduling_policy(const std::string & name, SchedulingPolicy & policy)
+{
+  if (name == "fifo") {
+    policy = SchedulingPolicy::FIFO;
+  } else if (name == "newest_wins") {
+    policy = SchedulingPolicy::NEWEST_WINS;
+  } else if (name == "priority") {
+    policy = SchedulingPolicy::PRIORITY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Runs the goals accepted with ACCEPT_AND_DEFER on a fixed number of threads.
+ *
+ * Goals go through three stages:
+ * - admission, from the goal request handler, reserves a place or rejects;
+ * - submission, from the goal acceptance handler, queues the goal handle;
+ * - execution, on a worker thread, once the goal is picked from the queue.
+ * Goals that lose their place to another one are aborted if they were still
+ * queued, or asked to stop through their preemption flag if they were running.
+ */
+template<typename ActionT>
+class GoalScheduler
+{
+public:
+  using GoalHandleSharedPtr = std::shared_ptr<rclcpp_action::ServerGoalHandle<ActionT>>;
+  using GoalSharedPtr = std::shared_ptr<const typename ActionT::Goal>;
+
+  //! Goal execution routine, which must return soon after the flag is raised
+  using Routine = std::function<void(const GoalHandleSharedPtr &, const std::atomic<bool> &)>;
+
+  //! Goal priority, higher values run first
+  using Priority = std::function<int (const typename ActionT::Goal &)>;
+
+  /**
+   * @brief Starts the worker threads.
+   *
+   * @param routine Goal execution routine.
+   * @param policy Scheduling policy.
+   * @param max_concurrent Number of goals run at the same time.
+   * @param max_queued Number of goals waiting to be run.
+   * @param priority Goal priority, only used by the PRIORITY policy.
+   */
+  GoalScheduler(
+    Routine && routine,
+    SchedulingPolicy policy,
+    size_t max_concurrent,
+    size_t max_queued,
+    Priority && priority = nullptr)
+  : routine_(std::move(routine)),
+    priority_(std::move(priority)),
+    policy_(policy),
+    max_concurrent_(std::max<size_t>(max_concurrent, 1)),
+    max_queued_(max_queued)
+  {
+    for (size_t i = 0; i < max_concurrent_; i++) {
+      workers_.emplace_back(&GoalScheduler::worker_routine, this);
+    }
+  }
+
+  /**
+   * @brief Stops running goals, aborts queued ones and joins the workers.
+   */
+  ~GoalScheduler()
+  {
+    std::vector<GoalHandleSharedPtr> dropped;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stopped_ = true;
+      for (Running & running : running_) {
+        running.preempt->store(true);
+      }
+      for (Entry & entry : queue_) {
+        dropped.push_back(entry.goal_handle);
+      }
+      queue_.clear();
+    }
+    cv_.notify_all();
+    for (std::thread & worker : workers_) {
+      worker.join();
+    }
+    for (auto & goal_handle : dropped) {
+      terminate(goal_handle);
+    }
+  }
+
+  GoalScheduler(const GoalScheduler &) = delete;
+  GoalScheduler & operator=(const GoalScheduler &) = delete;
+
+  /**
+   * @brief Admission control, to be called from the goal request handler.
+   *
+   * @param goal Requested goal.
+   * @return True if the goal has a place, that submit() must then take.
+   */
+  bool admit(const typename ActionT::Goal & goal)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (stopped_) {
+      return false;
+    }
+    bool admitted = false;
+    if (queue_.size() + reserved_ < max_queued_ ||
+      running_.size() + queue_.size() + reserved_ < max_concurrent_)
+    {
+      admitted = true;
+    } else if (policy_ == SchedulingPolicy::NEWEST_WINS) {
+      //! Room is made for the newest goal at submission
+      admitted = true;
+    } else if (policy_ == SchedulingPolicy::PRIORITY) {
+      //! Admit only what would outrank a goal it can displace
+      int priority = priority_of(goal);
+      for (const Entry & entry : queue_) {
+        admitted = admitted || priority > entry.priority;
+      }
+      for (const Running & running : running_) {
+        admitted = admitted || priority > running.priority;
+      }
+    }
+    if (admitted) {
+      reserved_++;
+    }
+    return admitted;
+  }
+
+  /**
+   * @brief Queues an admitted goal, to be called from the goal acceptance handler.
+   *
+   * @param goal_handle Handle of the accepted goal.
+   */
+  void submit(const GoalHandleSharedPtr & goal_handle)
+  {
+    std::vector<GoalHandleSharedPtr> dropped;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (reserved_ > 0) {
+        reserved_--;
+      }
+      if (stopped_) {
+        dropped.push_back(goal_handle);
+      } else {
+        queue_.push_back(Entry{goal_handle, priority_of(*goal_handle->get_goal()), next_ticket_++});
+        enforce_limits(dropped);
+      }
+    }
+    cv_.notify_one();
+    for (auto & goal_handle : dropped) {
+      terminate(goal_handle);
+    }
+  }
+
+  /**
+   * @brief Gets the number of goals waiting to be run.
+   *
+   * @return Number of queued goals.
+   */
+  size_t queued() const
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return queue_.size();
+  }
+
+  /**
+   * @brief Gets the number of goals being run.
+   *
+   * @return Number of running goals.
+   */
+  size_t running() const
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return running_.size();
+  }
+
+private:
+  /* Queued goal */
+  struct Entry
+  {
+    GoalHandleSharedPtr goal_handle;
+    int priority;
+    uint64_t ticket;
+  };
+
+  /* Running goal */
+  struct Running
+  {
+    GoalHandleSharedPtr goal_handle;
+    int priority;
+    uint64_t ticket;
+    std::shared_ptr<std::atomic<bool>> preempt;
+  };
+
+  /**
+   * @brief Computes the priority of a goal.
+   *
+   * @param goal Goal to rank.
+   * @return Goal priority, 0 if the scheduler has no priority routine.
+   */
+  int priority_of(const typename ActionT::Goal & goal) const
+  {
+    return priority_ ? priority_(goal) : 0;
+  }
+
+  /**
+   * @brief Tells whether a goal should run before another, according to the policy.
+   */
+  bool before(int priority_a, uint64_t ticket_a, int priority_b, uint64_t ticket_b) const
+  {
+    switch (policy_) {
+      case SchedulingPolicy::NEWEST_WINS:
+        return ticket_a > ticket_b;
+      case SchedulingPolicy::PRIORITY:
+        if (priority_a != priority_b) {
+          return priority_a > priority_b;
+        }
+        return ticket_a < ticket_b;
+      default:
+        return ticket_a < ticket_b;
+    }
+  }
+
+  /**
+   * @brief Drops the worst queued goals beyond the queue size, and raises the
+   * preemption flag of a running goal if a queued one outranks it.
+   *
+   * @param dropped Goals to terminate once the lock is released.
+   */
+  void enforce_limits(std::vector<GoalHandleSharedPtr> & dropped)
+  {
+    //! Free workers take queued goals themselves, anything else is over the limit
+    size_t idle = max_concurrent_ - std::min(max_concurrent_, running_.size());
+    while (queue_.size() > max_queued_ + idle) {
+      auto worst = std::max_element(
+        queue_.begin(), queue_.end(),
+        [this](const Entry & a, const Entry & b) {
+          return before(a.priority, a.ticket, b.priority, b.ticket);
+        });
+      dropped.push_back(worst->goal_handle);
+      queue_.erase(worst);
+    }
+
+    //! A single running goal is preempted at a time, until its worker is free
+    if (policy_ == SchedulingPolicy::FIFO || idle > 0 || queue_.empty()) {
+      return;
+    }
+    for (const Running & running : running_) {
+      if (running.preempt->load()) {
+        return;
+      }
+    }
+    auto best = std::min_element(
+      queue_.begin(), queue_.end(),
+      [this](const Entry & a, const Entry & b) {
+        return before(a.priority, a.ticket, b.priority, b.ticket);
+      });
+    auto victim = std::max_element(
+      running_.begin(), running_.end(),
+      [this](const Running & a, const Running & b) {
+        return before(a.priority, a.ticket, b.priority, b.ticket);
+      });
+    if (victim != running_.end() &&
+      before(best->priority, best->ticket, victim->priority, victim->ticket))
+    {
+      victim->preempt->store(true);
+    }
+  }
+
+  /**
+   * @brief Terminates a goal that will not be run.
+   *
+   * @param goal_handle Handle of the goal to drop.
+   */
+  void terminate(const GoalHandleSharedPtr & goal_handle)
+  {
+    auto result = std::make_shared<typename ActionT::Result>();
+    if (goal_handle->is_canceling()) {
+      goal_handle->canceled(result);
+      return;
+    }
+    //! Accepted goals can only be aborted once executing
+    goal_handle->execute();
+    goal_handle->abort(result);
+  }
+
+  /**
+   * @brief Runs queued goals according to the policy, until stopped.
+   */
+  void worker_routine()
+  {
+    while (true) {
+      Running current;
+      std::vector<GoalHandleSharedPtr> canceled;
+      {
+        std::unique_lock<std::mutex> lock(lock_);
+        cv_.wait(lock, [this] {return stopped_ || !queue_.empty();});
+        if (stopped_) {
+          return;
+        }
+
+        //! Goals canceled while waiting never run
+        auto it = std::remove_if(
+          queue_.begin(), queue_.end(),
+          [&canceled](const Entry & entry) {
+            if (entry.goal_handle->is_canceling()) {
+              canceled.push_back(entry.goal_handle);
+              return true;
+            }
+            return false;
+          });
+        queue_.erase(it, queue_.end());
+
+        if (!queue_.empty()) {
+          auto best = std::min_element(
+            queue_.begin(), queue_.end(),
+            [this](const Entry & a, const Entry & b) {
+              return before(a.priority, a.ticket, b.priority, b.ticket);
+            });
+          current = Running{best->goal_handle, best->priority, best->ticket,
+            std::make_shared<std::atomic<bool>>(false)};
+          queue_.erase(best);
+          running_.push_back(current);
+        }
+      }
+      for (auto & goal_handle : canceled) {
+        terminate(goal_handle);
+      }
+      if (current.goal_handle == nullptr) {
+        continue;
+      }
+
+      current.goal_handle->execute(); //! Update internal goal state
+      routine_(current.goal_handle, *current.preempt);
+
+      std::vector<GoalHandleSharedPtr> dropped;
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        running_.erase(
+          std::find_if(
+            running_.begin(), running_.end(),
+            [&current](const Running & running) {return running.ticket == current.ticket;}));
+        if (!stopped_) {
+          enforce_limits(dropped);
+        }
+      }
+      for (auto & goal_handle : dropped) {
+        terminate(goal_handle);
+      }
+    }
+  }
+
+  Routine routine_;
+  Priority priority_;
+  SchedulingPolicy policy_;
+  size_t max_concurrent_;
+  size_t max_queued_;
+
+  std::vector<Entry> queue_;
+  std::vector<Running> running_;
+  size_t reserved_ = 0;  //! Admitted goals not submitted yet
+  uint64_t next_ticket_ = 0;
+  bool stopped_ = false;
+  mutable std::mutex lock_;
+  std::condition_variable cv_;
+  std::vector<std::thread> workers_;
+};
+
+#endif
@@ -10,22 +10,14 @@
 #include <sstream>
 #include <stdexcept>
 
+#include <ros2_examples_headers/qos/qos_profiles.hpp>
+
 #include <complete_actions_cpp/fib_client.hpp>
 
 #define UNUSED(arg) (void)(arg)
 
 //! Status topic (hidden) has transient local durability!
-static const rmw_qos_profile_t status_qos_profile = {
-  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
-  5,
-  RMW_QOS_POLICY_RELIABILITY_RELIABLE,
-  RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL,
-  RMW_QOS_DEADLINE_DEFAULT,
-  RMW_QOS_LIFESPAN_DEFAULT,
-  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
-  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
-  false
-};
+static const rmw_qos_profile_t & status_qos_profile = ROS2QoS::latched_state_qos_profile;
 
 /**
  * @brief Creates a new FibonacciClient node.
@@ -6,24 +6,18 @@
  * January 10, 2022
  */
 
+#include <algorithm>
 #include <chrono>
+#include <string>
+
+#include <ros2_examples_headers/qos/qos_profiles.hpp>
 
 #include <complete_actions_cpp/fib_server.hpp>
 
 using namespace std::chrono_literals;
 
 //! Status topic must have transient local durability
-static const rmw_qos_profile_t status_qos_profile = {
-  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
-  5,
-  RMW_QOS_POLICY_RELIABILITY_RELIABLE,
-  RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL,
-  RMW_QOS_DEADLINE_DEFAULT,
-  RMW_QOS_LIFESPAN_DEFAULT,
-  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
-  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
-  false
-};
+static const rmw_qos_profile_t & status_qos_profile = ROS2QoS::latched_state_qos_profile;
 
 /**
  * @brief Creates a new FibonacciComputer node.
@@ -41,12 +35,36 @@ FibonacciComputer::FibonacciComputer()
   server_opts_.feedback_topic_qos = rmw_qos_profile_default;
   server_clbk_group_ = this->create_callback_group(
     rclcpp::CallbackGroupType::MutuallyExclusive);
-  //! Works will be queried for and executed every 10 seconds
-  work_timer_ = this->create_wall_timer(
-    10s,
+
+  //! Feedback throttling: max rate [Hz] (0 for no limit), and whether to
+  //! send only the elements computed since the previous feedback
+  feedback_max_rate_ = this->declare_parameter("feedback_max_rate", 10.0);
+  feedback_delta_ = this->declare_parameter("feedback_delta", false);
+
+  //! Deferred goals are run by a scheduler, configured by:
+  //! - max_concurrent_goals: goals computed at the same time
+  //! - max_queued_goals: goals waiting for a free worker
+  //! - scheduling_policy: fifo, newest_wins or priority (shorter sequences first)
+  int max_concurrent = this->declare_parameter("max_concurrent_goals", 1);
+  int max_queued = this->declare_parameter("max_queued_goals", 4);
+  std::string policy_name = this->declare_parameter("scheduling_policy", std::string("fifo"));
+  SchedulingPolicy policy = SchedulingPolicy::FIFO;
+  if (!parse_scheduling_policy(policy_name, policy)) {
+    RCLCPP_ERROR(
+      this->get_logger(),
+      "Invalid scheduling policy %s, using fifo",
+      policy_name.c_str());
+  }
+  scheduler_ = std::make_unique<GoalScheduler<Fibonacci>>(
     std::bind(
-      &FibonacciComputer::work_activation_clbk,
-      this));
+      &FibonacciComputer::compute,
+      this,
+      std::placeholders::_1,
+      std::placeholders::_2),
+    policy,
+    size_t(std::max(max_concurrent, 1)),
+    size_t(std::max(max_queued, 0)),
+    [](const Fibonacci::Goal & goal) {return -goal.order;});
 
   //! Create the action server by specifying the node that handles it,
   //! and the three handler routines for the three computation stages
@@ -95,14 +113,24 @@ rclcpp_action::GoalResponse FibonacciComputer::handle_goal(
       goal->order);
     return rclcpp_action::GoalResponse::REJECT;
   }
+
+  //! Reserve a place in the scheduler, or reject the request under load
+  if (!scheduler_->admit(*goal)) {
+    RCLCPP_ERROR(
+      this->get_logger(),
+      "Received request (%s) of order %d REJECTED: server saturated",
+      rclcpp_action::to_string(uuid).c_str(),
+      goal->order);
+    return rclcpp_action::GoalResponse::REJECT;
+  }
   RCLCPP_INFO(
     this->get_logger(),
     "Received request (%s) of order %d ACCEPTED",
     rclcpp_action::to_string(uuid).c_str(),
     goal->order);
-  //! Returning the following code will force the middleware to
-  //! immediately move the goal to the executing state
-  //! Here we decide when to execute each goal
+  //! Returning the following code lets us decide when to execute each goal
+  //! instead of forcing the middleware to immediately move it to the
+  //! executing state: the scheduler does it once a worker picks the goal
   return rclcpp_action::GoalResponse::ACCEPT_AND_DEFER;
 }
 
@@ -124,8 +152,6 @@ rclcpp_action::CancelResponse FibonacciComputer::handle_cancel(
     return rclcpp_action::CancelResponse::REJECT;
   }
 
-  new_goal_ = nullptr;
-
   //! Note that this will tell the middleware to only ATTEMPT cancellation
   //! since the scheme is deferred: a flag will be raised and will have to be
   //! checked by every worker routine (not handled by the middleware)
@@ -144,17 +170,19 @@ rclcpp_action::CancelResponse FibonacciComputer::handle_cancel(
 void FibonacciComputer::handle_accepted(
   const FibonacciGoalHandleSharedPtr goal_handle)
 {
-  //! Here you could place the handle pointer in a queue to be processed later
-  new_goal_ = goal_handle;
+  //! Place the handle pointer in the queue to be processed later
+  scheduler_->submit(goal_handle);
 }
 
 /**
  * @brief Computes the Fibonacci sequence up to a given order.
  *
  * @param goal_handle Handle to the goal object.
+ * @param preempted Raised when another goal takes the place of this one.
  */
 void FibonacciComputer::compute(
-  const FibonacciGoalHandleSharedPtr goal_handle)
+  const FibonacciGoalHandleSharedPtr goal_handle,
+  const std::atomic<bool> & preempted)
 {
   RCLCPP_INFO(
     this->get_logger(),
@@ -164,13 +192,13 @@ void FibonacciComputer::compute(
   //! This object helps us to define sleep times (in real time)
   rclcpp::WallRate loop_rate(1s);
 
-  //! Feedback publishing API requires a shared_ptr
-  auto feedback = std::make_shared<Fibonacci::Feedback>();
-  auto & sequence = feedback->partial_sequence;
+  //! Feedback is rate limited, and optionally sent as deltas
+  FeedbackThrottle feedback(goal_handle, feedback_max_rate_, feedback_delta_);
 
-  //! Same holds for the result message
+  //! Result publishing API requires a shared_ptr
   auto result = std::make_shared<Fibonacci::Result>();
 
+  std::vector<int> sequence;
   const auto goal = goal_handle->get_goal();
   int order = goal->order;
 
@@ -192,9 +220,22 @@ void FibonacciComputer::compute(
   //! Always check if rclcpp::ok while computing since you need it to
   //! interact with the middleware!
   for (int i = 1; (i < order) && rclcpp::ok(); i++) {
+    //! Another goal took our place, so give up with what we have
+    if (preempted) {
+      feedback.flush(sequence);
+      result->set__sequence(sequence);
+      goal_handle->abort(result); //! Terminal API to call
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Computation (%s) PREEMPTED",
+        rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+      return;
+    }
+
     //! Check if there is a cancel request, and in case mark the goal as such
     if (goal_handle->is_canceling()) {
       // Publish what has been computed so far
+      feedback.flush(sequence);
       result->set__sequence(sequence);
       goal_handle->canceled(result); //! Terminal API to call
       RCLCPP_WARN(
@@ -207,12 +248,13 @@ void FibonacciComputer::compute(
     // Update sequence
     sequence.push_back(sequence[i] + sequence[i - 1]);
 
-    //! Publish feedback (that we're building upon)
-    goal_handle->publish_feedback(feedback);
-    RCLCPP_INFO(
-      this->get_logger(),
-      "Published feedback for goal (%s)",
-      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    //! Publish feedback, unless the last one is too recent
+    if (feedback.update(sequence)) {
+      RCLCPP_DEBUG(
+        this->get_logger(),
+        "Published feedback for goal (%s)",
+        rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
+    }
 
     //! This simulates computational overhead
     loop_rate.sleep();
@@ -221,6 +263,7 @@ void FibonacciComputer::compute(
   // Publish result
   //! ALWAYS check if the middelware is ok!
   if (rclcpp::ok()) {
+    feedback.flush(sequence);
     result->set__sequence(sequence);
     goal_handle->succeed(result); //! Terminal API to call
     RCLCPP_INFO(
@@ -229,26 +272,3 @@ void FibonacciComputer::compute(
       rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
   }
 }
-
-/**
- * @brief Starts queued jobs.
- */
-void FibonacciComputer::work_activation_clbk()
-{
-  if (new_goal_ != nullptr) {
-    FibonacciGoalHandleSharedPtr goal_handle = new_goal_;
-    new_goal_ = nullptr;
-    RCLCPP_WARN(
-      this->get_logger(),
-      "Starting execution of goal (%s)",
-      rclcpp_action::to_string(goal_handle->get_goal_id()).c_str());
-    goal_handle->execute(); //! Update internal goal state
-    std::thread{
-      std::bind(
-        &FibonacciComputer::compute,
-        this,
-        std::placeholders::_1),
-      goal_handle
-    }.detach();
-  }
-}
@@ -0,0 +1,374 @@
+/**
+ * Executor launcher with thread count, CPU affinity and real-time priority control.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 26, 2021
+ */
+
+#ifndef EXECUTOR_LAUNCHER_HPP
+#define EXECUTOR_LAUNCHER_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <rclcpp/rclcpp.hpp>
+
+namespace ROS2ExecutorLauncher
+{
+
+/**
+ * Scheduling attributes of an executor thread.
+ */
+struct ThreadAttributes
+{
+  /* Name to be visualized in rclcpp log prints and system tools. */
+  std::string name = "executor";
+
+  /* CPUs the thread may run on, any if empty. */
+  std::vector<int> cpus{};
+
+  /* SCHED_FIFO priority, 0 for normal scheduling. */
+  int priority = 0;
+};
+
+/**
+ * @brief Parses a CPU list like "0-2,5".
+ *
+ * @param list CPU list.
+ * @return CPU indexes.
+ *
+ * @throws InvalidArgument
+ */
+inline std::vector<int> parse_cpu_list(const std::string & list)
+{
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    size_t dash = item.find('-');
+    try {
+      int first = std::stoi(item.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+      if (first < 0 || last < first) {
+        throw std::invalid_argument(item);
+      }
+      for (int cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::logic_error &) {
+      throw std::invalid_argument("parse_cpu_list: invalid CPU range (" + item + ")");
+    }
+  }
+  return cpus;
+}
+
+/**
+ * @brief Applies scheduling attributes to the calling thread.
+ *
+ * Failures, e.g. for lack of privileges, are logged and leave the thread as it is.
+ *
+ * @param attributes Attributes to apply.
+ * @return True if all attributes were applied.
+ */
+inline bool apply_thread_attributes(const ThreadAttributes & attributes)
+{
+  rclcpp::Logger logger = rclcpp::get_logger("executor_launcher");
+  bool ok = true;
+  pthread_setname_np(pthread_self(), attributes.name.substr(0, 15).c_str());
+
+  if (attributes.priority > 0) {
+    struct sched_param param;
+    param.sched_priority = attributes.priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) {
+      RCLCPP_WARN(
+        logger,
+        "Failed to set %s thread SCHED_FIFO priority %d: %s",
+        attributes.name.c_str(),
+        attributes.priority,
+        strerror(ret));
+      ok = false;
+    }
+  }
+
+  if (!attributes.cpus.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : attributes.cpus) {
+      CPU_SET(cpu, &cpus);
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    if (ret) {
+      RCLCPP_WARN(
+        logger,
+        "Failed to set %s thread CPU affinity: %s",
+        attributes.name.c_str(),
+        strerror(ret));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+/**
+ * Multithreaded executor whose threads each get their own scheduling attributes.
+ *
+ * Threads take executables one at a time under a common lock, like the
+ * MultiThreadedExecutor, but are created by this class so that affinity and
+ * priority are set before they execute anything.
+ */
+class PinnedMultiThreadedExecutor : public rclcpp::Executor
+{
+public:
+  /**
+   * @brief Creates an executor with one thread per attributes entry.
+   *
+   * @param threads Attributes of each thread, at least one.
+   * @param options Common executor options.
+   *
+   * @throws InvalidArgument
+   */
+  explicit PinnedMultiThreadedExecutor(
+    const std::vector<ThreadAttributes> & threads,
+    const rclcpp::ExecutorOptions & options = rclcpp::ExecutorOptions())
+  : rclcpp::Executor(options),
+    threads_(threads)
+  {
+    if (threads_.empty()) {
+      throw std::invalid_argument("PinnedMultiThreadedExecutor: no threads");
+    }
+  }
+
+  /**
+   * @brief Spins on all threads until canceled or the context is shut down.
+   *
+   * @throws RuntimeError if already spinning.
+   */
+  void spin() override
+  {
+    if (spinning.exchange(true)) {
+      throw std::runtime_error("spin() called while already spinning");
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threads_.size(); i++) {
+      threads.emplace_back(&PinnedMultiThreadedExecutor::run, this, i);
+    }
+    run(0);
+    for (auto & thread : threads) {
+      thread.join();
+    }
+    spinning.store(false);
+  }
+
+  /**
+   * @brief Returns the number of threads.
+   *
+   * @return Number of threads.
+   */
+  size_t get_number_of_threads() const
+  {
+    return threads_.size();
+  }
+
+private:
+  /* Attributes of each thread. */
+  std::vector<ThreadAttributes> threads_;
+
+  /* Held by the thread that takes the next executable. */
+  std::mutex wait_mutex_;
+
+  /* Timers taken and not executed yet, so that no two threads run the same one. */
+  std::set<rclcpp::TimerBase::SharedPtr> scheduled_timers_;
+
+  /**
+   * @brief Thread routine.
+   *
+   * @param index Thread index.
+   */
+  void run(size_t index)
+  {
+    apply_thread_attributes(threads_[index]);
+    while (rclcpp::ok(this->context_) && spinning.load()) {
+      rclcpp::AnyExecutable any_exec;
+      {
+        std::lock_guard<std::mutex> wait_lock(wait_mutex_);
+        if (!rclcpp::ok(this->context_) || !spinning.load()) {
+          return;
+        }
+        if (!get_next_executable(any_exec)) {
+          continue;
+        }
+        if (any_exec.timer) {
+          // Guard against multiple threads getting the same timer
+          if (!scheduled_timers_.insert(any_exec.timer).second) {
+            if (any_exec.callback_group) {
+              any_exec.callback_group->can_be_taken_from().store(true);
+            }
+            continue;
+          }
+        }
+      }
+      execute_any_executable(any_exec);
+      if (any_exec.timer) {
+        std::lock_guard<std::mutex> wait_lock(wait_mutex_);
+        scheduled_timers_.erase(any_exec.timer);
+      }
+      any_exec.callback_group.reset();
+    }
+  }
+};
+
+/**
+ * Runs nodes on a pool of pinned threads, and selected callback groups on
+ * dedicated pinned threads of their own.
+ *
+ * Callback groups must be assigned before their node is added, so that the
+ * pool doesn't take them too.
+ */
+class ExecutorLauncher
+{
+public:
+  /**
+   * @brief Creates a launcher.
+   *
+   * @param pool_threads Attributes of each thread of the shared pool.
+   */
+  explicit ExecutorLauncher(const std::vector<ThreadAttributes> & pool_threads)
+  : pool_(std::make_shared<PinnedMultiThreadedExecutor>(pool_threads))
+  {}
+
+  /**
+   * @brief Creates a launcher with a pool of unpinned threads.
+   *
+   * @param threads Number of pool threads, as many as the cores if zero.
+   */
+  explicit ExecutorLauncher(size_t threads = 0)
+  : ExecutorLauncher(default_pool(threads))
+  {}
+
+  ExecutorLauncher(const ExecutorLauncher &) = delete;
+  ExecutorLauncher & operator=(const ExecutorLauncher &) = delete;
+
+  ~ExecutorLauncher()
+  {
+    cancel();
+  }
+
+  /**
+   * @brief Adds a node to the shared pool.
+   *
+   * @param node Node to add, its assigned callback groups excluded.
+   */
+  void add_node(rclcpp::node_interfaces::NodeBaseInterface::SharedPtr node)
+  {
+    pool_->add_node(node);
+  }
+
+  void add_node(rclcpp::Node::SharedPtr node)
+  {
+    add_node(node->get_node_base_interface());
+  }
+
+  /**
+   * @brief Runs a callback group on a dedicated thread.
+   *
+   * @param group Callback group to run.
+   * @param node Node the group belongs to.
+   * @param attributes Attributes of the dedicated thread.
+   */
+  void add_callback_group(
+    rclcpp::CallbackGroup::SharedPtr group,
+    rclcpp::node_interfaces::NodeBaseInterface::SharedPtr node,
+    const ThreadAttributes & attributes)
+  {
+    Dedicated dedicated;
+    dedicated.executor = std::make_shared<rclcpp::executors::SingleThreadedExecutor>();
+    dedicated.executor->add_callback_group(group, node);
+    dedicated.attributes = attributes;
+    dedicated_.push_back(std::move(dedicated));
+  }
+
+  /**
+   * @brief Spins all executors until canceled or the context is shut down.
+   *
+   * The pool spins on the calling thread too, after applying the attributes
+   * of its first thread.
+   */
+  void spin()
+  {
+    std::vector<std::thread> threads;
+    for (Dedicated & dedicated : dedicated_) {
+      threads.emplace_back(
+        [&dedicated]() {
+          apply_thread_attributes(dedicated.attributes);
+          dedicated.executor->spin();
+        });
+    }
+    pool_->spin();
+    for (Dedicated & dedicated : dedicated_) {
+      dedicated.executor->cancel();
+    }
+    for (auto & thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * @brief Stops all executors.
+   */
+  void cancel()
+  {
+    pool_->cancel();
+    for (Dedicated & dedicated : dedicated_) {
+      dedicated.executor->cancel();
+    }
+  }
+
+private:
+  /* Callback group on a dedicated thread. */
+  struct Dedicated
+  {
+    std::shared_ptr<rclcpp::executors::SingleThreadedExecutor> executor;
+    ThreadAttributes attributes;
+  };
+
+  /**
+   * @brief Builds the attributes of a pool of unpinned threads.
+   *
+   * @param threads Number of threads, as many as the cores if zero.
+   * @return Attributes of each thread.
+   */
+  static std::vector<ThreadAttributes> default_pool(size_t threads)
+  {
+    if (threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    std::vector<ThreadAttributes> pool(threads);
+    for (size_t i = 0; i < threads; i++) {
+      pool[i].name = "pool_" + std::to_string(i);
+    }
+    return pool;
+  }
+
+  std::shared_ptr<PinnedMultiThreadedExecutor> pool_;
+  std::vector<Dedicated> dedicated_;
+};
+
+} // namespace ROS2ExecutorLauncher
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Rate-limited action feedback.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 10, 2022
+ */
+
+#ifndef FEEDBACK_THROTTLE_HPP
+#define FEEDBACK_THROTTLE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+#include <rclcpp_action/rclcpp_action.hpp>
+
+namespace ROS2FeedbackThrottle
+{
+
+/**
+ * Publishes the feedback of a goal at most at a given rate.
+ *
+ * The action feedback must carry a partial_sequence, e.g. the Fibonacci one.
+ * Updates that come faster are not sent: the next one the rate allows carries
+ * the latest sequence, and flush() sends the last one before the goal terminates.
+ * In delta mode each feedback only holds the elements added since the previous
+ * one, so the total amount of data sent grows linearly with the sequence.
+ */
+template<typename ActionT>
+class FeedbackThrottle
+{
+public:
+  using Feedback = typename ActionT::Feedback;
+  using Sequence = decltype(Feedback::partial_sequence);
+  using GoalHandleSharedPtr = std::shared_ptr<rclcpp_action::ServerGoalHandle<ActionT>>;
+
+  /**
+   * @brief Creates a throttle for a goal.
+   *
+   * @param goal_handle Handle to the goal object.
+   * @param max_rate Maximum feedback rate [Hz], unlimited if not positive.
+   * @param delta Send only the new elements of the sequence.
+   */
+  FeedbackThrottle(const GoalHandleSharedPtr & goal_handle, double max_rate, bool delta)
+  : goal_handle_(goal_handle),
+    feedback_(std::make_shared<Feedback>()),
+    delta_(delta)
+  {
+    if (max_rate > 0.0) {
+      period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / max_rate));
+    }
+  }
+
+  /**
+   * @brief Publishes the latest sequence if the rate allows it.
+   *
+   * @param sequence Sequence computed so far.
+   * @return True if a feedback message was published.
+   */
+  bool update(const Sequence & sequence)
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (published_ && now - last_ < period_) {
+      return false;
+    }
+    publish(sequence, now);
+    return true;
+  }
+
+  /**
+   * @brief Publishes the latest sequence if an update was not sent, regardless of the rate.
+   *
+   * Call this before the terminal API of the goal.
+   *
+   * @param sequence Sequence computed so far.
+   * @return True if a feedback message was published.
+   */
+  bool flush(const Sequence & sequence)
+  {
+    if (sequence.size() == sent_) {
+      return false;
+    }
+    publish(sequence, std::chrono::steady_clock::now());
+    return true;
+  }
+
+private:
+  void publish(const Sequence & sequence, std::chrono::steady_clock::time_point now)
+  {
+    size_t first = delta_ ? sent_ : 0;
+    feedback_->partial_sequence.assign(sequence.begin() + first, sequence.end());
+    goal_handle_->publish_feedback(feedback_);
+    sent_ = sequence.size();
+    last_ = now;
+    published_ = true;
+  }
+
+  GoalHandleSharedPtr goal_handle_;
+  std::shared_ptr<Feedback> feedback_;
+  std::chrono::steady_clock::duration period_{0};
+  std::chrono::steady_clock::time_point last_;
+  size_t sent_ = 0; //! Elements already sent
+  bool published_ = false;
+  bool delta_;
+};
+
+} // namespace ROS2FeedbackThrottle
+
+#endif
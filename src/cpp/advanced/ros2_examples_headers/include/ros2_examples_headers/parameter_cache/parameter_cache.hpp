@@ -0,0 +1,286 @@
+/**
+ * Typed node parameters cache with lock-free reads.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * December 3, 2021
+ */
+
+#ifndef PARAMETER_CACHE_HPP
+#define PARAMETER_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+namespace ROS2ParameterCache
+{
+
+/**
+ * Base class of cache slots, holding the value of a single parameter.
+ */
+class SlotBase
+{
+public:
+  virtual ~SlotBase() = default;
+
+  /**
+   * @brief Checks whether a new value can be stored in this slot.
+   *
+   * @param value New value.
+   * @return True if the value has the slot type.
+   */
+  virtual bool accepts(const rclcpp::ParameterValue & value) const = 0;
+
+  /**
+   * @brief Stores a new value and notifies observers.
+   *
+   * @param value New value, which must be accepted.
+   */
+  virtual void store(const rclcpp::ParameterValue & value) = 0;
+};
+
+/**
+ * Slot holding the value of a parameter of type T.
+ *
+ * Scalars are kept in atomics. Strings and arrays are kept as immutable
+ * copies, RCU-style: readers take a reference to the current copy, which
+ * updates replace as a whole and which lives on until the last reader drops it.
+ */
+template<typename T>
+class Slot : public SlotBase
+{
+public:
+  static constexpr bool is_scalar =
+    std::is_same_v<T, bool> || std::is_same_v<T, int64_t> || std::is_same_v<T, double>;
+
+  /* What reads return: a copy of scalars, a shared reference to the rest. */
+  using ReadType = std::conditional_t<is_scalar, T, std::shared_ptr<const T>>;
+
+  explicit Slot(const rclcpp::ParameterValue & value)
+  {
+    if (!accepts(value)) {
+      throw rclcpp::exceptions::InvalidParameterTypeException(
+              "ParameterCache", "type does not match the cached one");
+    }
+    write(value.get<T>());
+  }
+
+  ReadType get() const
+  {
+    if constexpr (is_scalar) {
+      return value_.load(std::memory_order_acquire);
+    } else {
+      return std::atomic_load_explicit(&value_, std::memory_order_acquire);
+    }
+  }
+
+  void on_change(std::function<void(const T &)> && observer)
+  {
+    observers_.push_back(std::move(observer));
+  }
+
+  bool accepts(const rclcpp::ParameterValue & value) const override
+  {
+    return value.get_type() == rclcpp::ParameterValue(T{}).get_type();
+  }
+
+  void store(const rclcpp::ParameterValue & value) override
+  {
+    const T & new_value = value.get<T>();
+    write(new_value);
+    for (const auto & observer : observers_) {
+      observer(new_value);
+    }
+  }
+
+private:
+  std::conditional_t<is_scalar, std::atomic<T>, std::shared_ptr<const T>> value_{};
+  std::vector<std::function<void(const T &)>> observers_;
+
+  void write(const T & value)
+  {
+    if constexpr (is_scalar) {
+      value_.store(value, std::memory_order_release);
+    } else {
+      std::atomic_store_explicit(
+        &value_,
+        std::shared_ptr<const T>(std::make_shared<T>(value)),
+        std::memory_order_release);
+    }
+  }
+};
+
+/**
+ * Handle to a cached parameter: reads through it cost an atomic load, with
+ * no locks nor name lookups.
+ */
+template<typename T>
+class ParameterHandle
+{
+public:
+  ParameterHandle() = default;
+
+  /**
+   * @brief Returns the latest value accepted for the parameter.
+   *
+   * @return Parameter value, or a shared reference to it for strings and arrays.
+   */
+  typename Slot<T>::ReadType get() const
+  {
+    return slot_->get();
+  }
+
+  explicit operator bool() const
+  {
+    return slot_ != nullptr;
+  }
+
+private:
+  friend class ParameterCache;
+
+  explicit ParameterHandle(Slot<T> * slot)
+  : slot_(slot)
+  {}
+
+  Slot<T> * slot_ = nullptr;
+};
+
+/**
+ * Cache of node parameters, updated as they are set.
+ *
+ * Hot paths read parameters through typed handles, obtained once by name, from
+ * any thread and without synchronizing with the parameter services.
+ *
+ * The cache must be created before any other set parameters callback is added:
+ * since those run in reverse order of registration, this makes its own run
+ * last, and commit only values that all the others accepted. Parameters must
+ * be added to the cache, after their declaration, before spinning the node.
+ * Observers are called from the parameter services with the new value, before
+ * it is actually set, so they must not query the node for it.
+ */
+class ParameterCache
+{
+public:
+  /**
+   * @brief Creates a cache for a node.
+   *
+   * @param node Node whose parameters to cache.
+   */
+  explicit ParameterCache(rclcpp::Node * node)
+  : node_(node)
+  {
+    clbk_handle_ = node_->add_on_set_parameters_callback(
+      std::bind(&ParameterCache::param_clbk, this, std::placeholders::_1));
+  }
+
+  ParameterCache(const ParameterCache &) = delete;
+  ParameterCache & operator=(const ParameterCache &) = delete;
+
+  ~ParameterCache()
+  {
+    node_->remove_on_set_parameters_callback(clbk_handle_.get());
+  }
+
+  /**
+   * @brief Adds a declared parameter to the cache.
+   *
+   * @param name Parameter name.
+   * @return Handle to the parameter.
+   *
+   * @throws ParameterNotDeclaredException
+   * @throws InvalidParameterTypeException if T is not the parameter type.
+   * @throws InvalidArgument if the parameter was already added.
+   */
+  template<typename T>
+  ParameterHandle<T> add(const std::string & name)
+  {
+    if (slots_.count(name)) {
+      throw std::invalid_argument("ParameterCache::add: " + name + " already cached");
+    }
+    auto slot = std::make_unique<Slot<T>>(node_->get_parameter(name).get_parameter_value());
+    ParameterHandle<T> handle(slot.get());
+    slots_.emplace(name, std::move(slot));
+    return handle;
+  }
+
+  /**
+   * @brief Registers an observer of a cached parameter.
+   *
+   * @param handle Parameter handle.
+   * @param observer Function called with each new value.
+   */
+  template<typename T>
+  void on_change(const ParameterHandle<T> & handle, std::function<void(const T &)> observer)
+  {
+    handle.slot_->on_change(std::move(observer));
+  }
+
+  /**
+   * @brief Returns the number of updates so far, so that loops can cheaply
+   *        notice that something changed since their last iteration.
+   *
+   * @return Updates counter.
+   */
+  uint64_t get_version() const
+  {
+    return version_.load(std::memory_order_acquire);
+  }
+
+private:
+  rclcpp::Node * node_;
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr clbk_handle_;
+
+  /* Slots by parameter name, looked up only upon updates. */
+  std::unordered_map<std::string, std::unique_ptr<SlotBase>> slots_;
+
+  std::atomic<uint64_t> version_{0};
+
+  /**
+   * @brief Stores the new values of cached parameters.
+   *
+   * @param params Parameters being set.
+   * @return Failure if a cached parameter would change type.
+   */
+  rcl_interfaces::msg::SetParametersResult param_clbk(const std::vector<rclcpp::Parameter> & params)
+  {
+    rcl_interfaces::msg::SetParametersResult res{};
+    res.set__successful(true);
+
+    //! Check everything first, so that updates are all or nothing
+    std::vector<std::pair<SlotBase *, const rclcpp::Parameter *>> updates;
+    for (const rclcpp::Parameter & p : params) {
+      auto it = slots_.find(p.get_name());
+      if (it == slots_.end()) {
+        continue;
+      }
+      if (!it->second->accepts(p.get_parameter_value())) {
+        res.set__successful(false);
+        res.set__reason("Parameter " + p.get_name() + " is cached with a different type");
+        return res;
+      }
+      updates.emplace_back(it->second.get(), &p);
+    }
+
+    for (auto & update : updates) {
+      update.first->store(update.second->get_parameter_value());
+    }
+    if (!updates.empty()) {
+      version_.fetch_add(1, std::memory_order_acq_rel);
+    }
+    return res;
+  }
+};
+
+} // namespace ROS2ParameterCache
+
+#endif
@@ -0,0 +1,590 @@
+/**
+ * Table-driven node parameters declaration and update dispatch.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 17, 2022
+ */
+
+#ifndef PARAMETER_TABLE_HPP
+#define PARAMETER_TABLE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <rcl_interfaces/msg/floating_point_range.hpp>
+#include <rcl_interfaces/msg/integer_range.hpp>
+#include <rcl_interfaces/msg/parameter_descriptor.hpp>
+#include <rcl_interfaces/msg/parameter_type.hpp>
+#include <rcl_interfaces/msg/set_parameters_result.hpp>
+
+namespace ROS2ParameterTable
+{
+
+/**
+ * Parameters of an update, to check values that depend on each other.
+ */
+class ParameterBatch
+{
+public:
+  /**
+   * @brief Wraps the parameters of an update.
+   *
+   * @param params Parameters for which a change has been requested.
+   */
+  explicit ParameterBatch(const std::vector<rclcpp::Parameter> & params)
+  : params_(params)
+  {}
+
+  /**
+   * @brief Looks up a parameter in the update.
+   *
+   * @param name Parameter name.
+   * @return Pointer to the new parameter, nullptr if the update does not include it.
+   */
+  const rclcpp::Parameter * find(const std::string & name) const
+  {
+    for (const rclcpp::Parameter & p : params_) {
+      if (p.get_name() == name) {
+        return &p;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Gets the value a parameter will have after the update.
+   *
+   * @param name Parameter name.
+   * @param current Current value, kept if the update does not include the parameter.
+   * @return New value, or the current one.
+   */
+  template<typename T>
+  T value_or(const std::string & name, const T & current) const
+  {
+    const rclcpp::Parameter * p = find(name);
+    return p != nullptr ? p->get_value<T>() : current;
+  }
+
+private:
+  const std::vector<rclcpp::Parameter> & params_;
+};
+
+/**
+ * Description of a node parameter: its declaration, plus what to check and do
+ * upon each update.
+ */
+struct ParameterSpec
+{
+  /* Checks a new value: returns an empty string if valid, the reason otherwise. */
+  using Validator = std::function<std::string(const rclcpp::Parameter &)>;
+
+  /* Checks a new value against the other ones of the same update, e.g. range bounds. */
+  using BatchValidator = std::function<std::string(const rclcpp::Parameter &, const ParameterBatch &)>;
+
+  /* Applies a new value: returns an empty string on success, the reason otherwise. */
+  using Handler = std::function<std::string(const rclcpp::Parameter &)>;
+
+  std::string name;
+  rclcpp::ParameterValue default_value;
+  rcl_interfaces::msg::ParameterDescriptor descriptor;
+
+  /* Measurement unit appended to update logs, if any. */
+  std::string unit;
+
+  Validator validator;
+  BatchValidator batch_validator;
+  Handler handler;
+
+  /* Whether the handler may fail, so that it must be applied before the others. */
+  bool fallible = false;
+
+  /* Batch actions to run once after an update that includes this. */
+  std::vector<size_t> actions;
+
+  /**
+   * @brief Adds a validity check, run before any value of the update is applied.
+   *
+   * @param check Validator.
+   * @return This specification.
+   */
+  ParameterSpec & validate(Validator && check)
+  {
+    validator = std::move(check);
+    return *this;
+  }
+
+  /**
+   * @brief Adds a validity check that may depend on other parameters.
+   *
+   * Other parameters of the same update are checked against their new values,
+   * and the rest against their current ones, so that related bounds can be
+   * moved together in any order.
+   *
+   * @param check Validator, given the whole update.
+   * @return This specification.
+   */
+  ParameterSpec & validate_batch(BatchValidator && check)
+  {
+    batch_validator = std::move(check);
+    return *this;
+  }
+
+  /**
+   * @brief Sets what to do with new values.
+   *
+   * @param apply Update routine, which cannot fail.
+   * @return This specification.
+   */
+  ParameterSpec & on_update(std::function<void(const rclcpp::Parameter &)> && apply)
+  {
+    handler = [apply = std::move(apply)](const rclcpp::Parameter & p) -> std::string {
+        apply(p);
+        return "";
+      };
+    fallible = false;
+    return *this;
+  }
+
+  /**
+   * @brief Sets what to do with new values, if that may fail.
+   *
+   * Such handlers run before all others of an update; if one fails, those that
+   * already ran are given back their current values, so that none is applied.
+   *
+   * @param apply Update routine, which must succeed with the current value.
+   * @return This specification.
+   */
+  ParameterSpec & on_update_checked(Handler && apply)
+  {
+    handler = std::move(apply);
+    fallible = true;
+    return *this;
+  }
+
+  /**
+   * @brief Runs a batch action after each update that includes this parameter.
+   *
+   * @param action Batch action ID.
+   * @return This specification.
+   */
+  ParameterSpec & then(size_t action)
+  {
+    actions.push_back(action);
+    return *this;
+  }
+
+  /**
+   * @brief Sets the measurement unit shown in update logs.
+   *
+   * @param unit_name Unit name.
+   * @return This specification.
+   */
+  ParameterSpec & with_unit(std::string && unit_name)
+  {
+    unit = std::move(unit_name);
+    return *this;
+  }
+};
+
+/**
+ * @brief Builds the common part of a parameter specification.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param type Parameter type.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec make_spec(
+  std::string && name,
+  rclcpp::ParameterValue && default_val,
+  uint8_t type,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  ParameterSpec spec;
+  spec.descriptor.set__name(name);
+  spec.descriptor.set__type(type);
+  spec.descriptor.set__description(desc);
+  spec.descriptor.set__additional_constraints(constraints);
+  spec.descriptor.set__read_only(read_only);
+  spec.descriptor.set__dynamic_typing(false);
+  spec.name = std::move(name);
+  spec.default_value = std::move(default_val);
+  return spec;
+}
+
+/**
+ * @brief Specifies a boolean node parameter.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec bool_parameter(
+  std::string && name,
+  bool default_val,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  return make_spec(
+    std::move(name),
+    rclcpp::ParameterValue(default_val),
+    rcl_interfaces::msg::ParameterType::PARAMETER_BOOL,
+    std::move(desc), std::move(constraints),
+    read_only);
+}
+
+/**
+ * @brief Specifies a 64-bit floating point node parameter.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param from Floating point range initial value.
+ * @param to Floating point range final value.
+ * @param step Floating point range step.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec double_parameter(
+  std::string && name,
+  double default_val, double from, double to, double step,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  ParameterSpec spec = make_spec(
+    std::move(name),
+    rclcpp::ParameterValue(default_val),
+    rcl_interfaces::msg::ParameterType::PARAMETER_DOUBLE,
+    std::move(desc), std::move(constraints),
+    read_only);
+  rcl_interfaces::msg::FloatingPointRange param_range{};
+  param_range.set__from_value(from);
+  param_range.set__to_value(to);
+  param_range.set__step(step);
+  spec.descriptor.set__floating_point_range({param_range});
+  return spec;
+}
+
+/**
+ * @brief Specifies an integer node parameter.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param from Integer range initial value.
+ * @param to Integer range final value.
+ * @param step Integer range step.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec int_parameter(
+  std::string && name,
+  int64_t default_val, int64_t from, int64_t to, int64_t step,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  ParameterSpec spec = make_spec(
+    std::move(name),
+    rclcpp::ParameterValue(default_val),
+    rcl_interfaces::msg::ParameterType::PARAMETER_INTEGER,
+    std::move(desc), std::move(constraints),
+    read_only);
+  rcl_interfaces::msg::IntegerRange param_range{};
+  param_range.set__from_value(from);
+  param_range.set__to_value(to);
+  param_range.set__step(uint64_t(step));
+  spec.descriptor.set__integer_range({param_range});
+  return spec;
+}
+
+/**
+ * @brief Specifies an integer array node parameter.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param from Integer range initial value.
+ * @param to Integer range final value.
+ * @param step Integer range step.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec int_array_parameter(
+  std::string && name,
+  std::vector<int64_t> && default_val, int64_t from, int64_t to, int64_t step,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  ParameterSpec spec = make_spec(
+    std::move(name),
+    rclcpp::ParameterValue(default_val),
+    rcl_interfaces::msg::ParameterType::PARAMETER_INTEGER_ARRAY,
+    std::move(desc), std::move(constraints),
+    read_only);
+  rcl_interfaces::msg::IntegerRange param_range{};
+  param_range.set__from_value(from);
+  param_range.set__to_value(to);
+  param_range.set__step(uint64_t(step));
+  spec.descriptor.set__integer_range({param_range});
+  return spec;
+}
+
+/**
+ * @brief Specifies a string node parameter.
+ *
+ * @param name Parameter name.
+ * @param default_val Default value.
+ * @param desc Parameter description.
+ * @param constraints Additional value constraints.
+ * @param read_only Read-only internal flag.
+ * @return Parameter specification.
+ */
+inline ParameterSpec string_parameter(
+  std::string && name,
+  std::string && default_val,
+  std::string && desc, std::string && constraints,
+  bool read_only)
+{
+  return make_spec(
+    std::move(name),
+    rclcpp::ParameterValue(default_val),
+    rcl_interfaces::msg::ParameterType::PARAMETER_STRING,
+    std::move(desc), std::move(constraints),
+    read_only);
+}
+
+/**
+ * Table of the parameters of a node.
+ *
+ * All parameters are declared at once, and updates are dispatched to their
+ * specifications through a hash map built beforehand, so that each one costs
+ * a single lookup whatever the number of parameters. Types are checked against
+ * the descriptors, ranges by rclcpp itself, and custom constraints by the
+ * specification validators, all before any value of an update is applied;
+ * batch validators see the whole update, so that values that depend on each
+ * other are checked against their new counterparts. Handlers that may fail run
+ * first, and are rolled back if one does, so that updates apply entirely or not
+ * at all.
+ * Actions that several parameters require, like rebuilding an object that
+ * depends on them, run once per update after all values are applied.
+ */
+class ParameterTable
+{
+public:
+  /**
+   * @brief Creates an empty table.
+   *
+   * @param node Node that owns the parameters.
+   */
+  explicit ParameterTable(rclcpp::Node * node)
+  : node_(node)
+  {}
+
+  ParameterTable(const ParameterTable &) = delete;
+  ParameterTable & operator=(const ParameterTable &) = delete;
+
+  /**
+   * @brief Adds a parameter to the table.
+   *
+   * @param spec Parameter specification.
+   *
+   * @throws InvalidArgument if a parameter with the same name was already added.
+   */
+  void add(ParameterSpec spec)
+  {
+    if (index_.count(spec.name)) {
+      throw std::invalid_argument("ParameterTable::add: duplicate parameter " + spec.name);
+    }
+    index_.emplace(spec.name, specs_.size());
+    specs_.push_back(std::move(spec));
+  }
+
+  /**
+   * @brief Adds an action to run once after updates that require it.
+   *
+   * @param action Action routine.
+   * @return Action ID, to be passed to ParameterSpec::then.
+   */
+  size_t add_batch_action(std::function<void()> && action)
+  {
+    actions_.push_back(std::move(action));
+    return actions_.size() - 1;
+  }
+
+  /**
+   * @brief Registers the updates callback, then declares all parameters.
+   *
+   * Handlers already run for initial values, in name order.
+   */
+  void declare()
+  {
+    clbk_handle_ = node_->add_on_set_parameters_callback(
+      std::bind(&ParameterTable::param_clbk, this, std::placeholders::_1));
+
+    std::map<std::string, std::pair<rclcpp::ParameterValue, rcl_interfaces::msg::ParameterDescriptor>>
+    params;
+    for (const ParameterSpec & spec : specs_) {
+      params.emplace(spec.name, std::make_pair(spec.default_value, spec.descriptor));
+    }
+    node_->declare_parameters("", params);
+  }
+
+private:
+  rclcpp::Node * node_;
+  std::vector<ParameterSpec> specs_;
+  std::vector<std::function<void()>> actions_;
+
+  /* Specifications by parameter name, i.e. the dispatch table. */
+  std::unordered_map<std::string, size_t> index_;
+
+  rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr clbk_handle_;
+
+  /**
+   * @brief Gives the current values back to the fallible handlers that already ran.
+   *
+   * @param updates Specifications of the update parameters.
+   * @param failed Index of the parameter whose handler failed.
+   */
+  void rollback(const std::vector<const ParameterSpec *> & updates, size_t failed)
+  {
+    for (size_t i = failed; i-- > 0; ) {
+      const ParameterSpec * spec = updates[i];
+      if (spec == nullptr || !spec->fallible || !spec->handler) {
+        continue;
+      }
+      //! The node still holds the current values until the callback accepts the update,
+      //! and has none for parameters being declared
+      rclcpp::Parameter current;
+      if (!node_->get_parameter(spec->name, current)) {
+        continue;
+      }
+      std::string reason = spec->handler(current);
+      if (!reason.empty()) {
+        RCLCPP_ERROR(
+          node_->get_logger(),
+          "Failed to restore %s: %s",
+          spec->name.c_str(),
+          reason.c_str());
+      }
+    }
+  }
+
+  /**
+   * @brief Parameters update callback.
+   *
+   * @param params Vector of parameters for which a change has been requested.
+   * @return Operation result in SetParametersResult message.
+   */
+  rcl_interfaces::msg::SetParametersResult param_clbk(const std::vector<rclcpp::Parameter> & params)
+  {
+    rcl_interfaces::msg::SetParametersResult res{};
+    res.set__successful(true);
+    res.set__reason("");
+
+    // First, check the types of all values, which batch validators rely upon
+    std::vector<const ParameterSpec *> updates(params.size(), nullptr);
+    for (size_t i = 0; i < params.size(); i++) {
+      const rclcpp::Parameter & p = params[i];
+      auto it = index_.find(p.get_name());
+      if (it == index_.end()) {
+        continue;
+      }
+      const ParameterSpec & spec = specs_[it->second];
+      if (p.get_type() != rclcpp::ParameterType(spec.descriptor.type)) {
+        res.set__successful(false);
+        res.set__reason("Invalid parameter type for " + spec.name);
+        return res;
+      }
+      updates[i] = &spec;
+    }
+
+    // Then, check if each update is feasible
+    ParameterBatch batch(params);
+    for (size_t i = 0; i < params.size(); i++) {
+      const ParameterSpec * spec = updates[i];
+      if (spec == nullptr) {
+        continue;
+      }
+      std::string reason;
+      if (spec->validator) {
+        reason = spec->validator(params[i]);
+      }
+      if (reason.empty() && spec->batch_validator) {
+        reason = spec->batch_validator(params[i], batch);
+      }
+      if (!reason.empty()) {
+        res.set__successful(false);
+        res.set__reason(reason);
+        return res;
+      }
+    }
+
+    // Then, apply the values that may still fail, restoring the current ones if any does
+    for (size_t i = 0; i < params.size(); i++) {
+      const ParameterSpec * spec = updates[i];
+      if (spec == nullptr || !spec->fallible || !spec->handler) {
+        continue;
+      }
+      std::string reason = spec->handler(params[i]);
+      if (!reason.empty()) {
+        rollback(updates, i);
+        res.set__successful(false);
+        res.set__reason(reason);
+        return res;
+      }
+    }
+
+    // Finally, apply the others and collect the batch actions they all require
+    std::vector<bool> triggered(actions_.size(), false);
+    for (size_t i = 0; i < params.size(); i++) {
+      const ParameterSpec * spec = updates[i];
+      if (spec == nullptr) {
+        continue;
+      }
+      if (!spec->fallible && spec->handler) {
+        spec->handler(params[i]);
+      }
+      for (size_t action : spec->actions) {
+        triggered[action] = true;
+      }
+      RCLCPP_INFO(
+        node_->get_logger(),
+        "%s: %s%s%s",
+        spec->name.c_str(),
+        rclcpp::to_string(params[i].get_parameter_value()).c_str(),
+        spec->unit.empty() ? "" : " ",
+        spec->unit.c_str());
+    }
+
+    // Run each required action only once
+    for (size_t action = 0; action < actions_.size(); action++) {
+      if (triggered[action]) {
+        actions_[action]();
+      }
+    }
+    return res;
+  }
+};
+
+} // namespace ROS2ParameterTable
+
+#endif
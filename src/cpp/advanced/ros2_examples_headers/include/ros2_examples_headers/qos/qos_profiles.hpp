@@ -0,0 +1,157 @@
+/**
+ * Shared QoS profile presets.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#ifndef QOS_PROFILES_HPP
+#define QOS_PROFILES_HPP
+
+#include <chrono>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rmw/qos_profiles.h>
+
+namespace ROS2QoS
+{
+
+/**
+ * Sensor streams (images, IMU, point clouds): only the newest sample matters,
+ * so a stale one is never retransmitted nor queued behind a new one.
+ */
+static const rmw_qos_profile_t sensor_stream_qos_profile = {
+  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
+  1,
+  RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT,
+  RMW_QOS_POLICY_DURABILITY_VOLATILE,
+  RMW_QOS_DEADLINE_DEFAULT,
+  RMW_QOS_LIFESPAN_DEFAULT,
+  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
+  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
+  false
+};
+
+/**
+ * Control setpoints and commands: the newest sample must arrive, but older
+ * ones are superseded by it, so the history holds just one.
+ */
+static const rmw_qos_profile_t latest_only_qos_profile = {
+  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
+  1,
+  RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+  RMW_QOS_POLICY_DURABILITY_VOLATILE,
+  RMW_QOS_DEADLINE_DEFAULT,
+  RMW_QOS_LIFESPAN_DEFAULT,
+  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
+  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
+  false
+};
+
+/**
+ * Bulk data (logs, batched samples, maps): every sample must arrive, and the
+ * history is a ring deep enough to absorb bursts while the reader catches up.
+ */
+static const rmw_qos_profile_t bulk_batch_qos_profile = {
+  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
+  100,
+  RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+  RMW_QOS_POLICY_DURABILITY_VOLATILE,
+  RMW_QOS_DEADLINE_DEFAULT,
+  RMW_QOS_LIFESPAN_DEFAULT,
+  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
+  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
+  false
+};
+
+/**
+ * Latched state (status, configuration): late joiners get the last samples.
+ */
+static const rmw_qos_profile_t latched_state_qos_profile = {
+  RMW_QOS_POLICY_HISTORY_KEEP_LAST,
+  5,
+  RMW_QOS_POLICY_RELIABILITY_RELIABLE,
+  RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL,
+  RMW_QOS_DEADLINE_DEFAULT,
+  RMW_QOS_LIFESPAN_DEFAULT,
+  RMW_QOS_POLICY_LIVELINESS_SYSTEM_DEFAULT,
+  RMW_QOS_LIVELINESS_LEASE_DURATION_DEFAULT,
+  false
+};
+
+/**
+ * @brief Builds a sensor stream QoS for a given rate.
+ *
+ * The deadline notifies both ends when two periods pass without samples, and
+ * the lifespan drops samples older than that, should they ever be queued.
+ *
+ * @param rate Nominal publishing rate [Hz], no deadline nor lifespan if zero.
+ * @return QoS object.
+ */
+inline rclcpp::QoS sensor_stream_qos(double rate = 0.0)
+{
+  rclcpp::QoS qos(rclcpp::QoSInitialization::from_rmw(sensor_stream_qos_profile));
+  qos.get_rmw_qos_profile() = sensor_stream_qos_profile;
+  if (rate > 0.0) {
+    auto periods = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(2.0 / rate));
+    qos.deadline(periods);
+    qos.lifespan(periods);
+  }
+  return qos;
+}
+
+/**
+ * @brief Builds a latest-only control QoS for a given rate.
+ *
+ * The lifespan drops a command once the next one is due, so that a reader
+ * that was late never acts on a superseded sample.
+ *
+ * @param rate Nominal publishing rate [Hz], no deadline nor lifespan if zero.
+ * @return QoS object.
+ */
+inline rclcpp::QoS latest_only_qos(double rate = 0.0)
+{
+  rclcpp::QoS qos(rclcpp::QoSInitialization::from_rmw(latest_only_qos_profile));
+  qos.get_rmw_qos_profile() = latest_only_qos_profile;
+  if (rate > 0.0) {
+    auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(1.0 / rate));
+    qos.deadline(2 * period);
+    qos.lifespan(period);
+  }
+  return qos;
+}
+
+/**
+ * @brief Builds a bulk batch QoS.
+ *
+ * @param depth History depth, the default one if zero.
+ * @return QoS object.
+ */
+inline rclcpp::QoS bulk_batch_qos(size_t depth = 0)
+{
+  rclcpp::QoS qos(rclcpp::QoSInitialization::from_rmw(bulk_batch_qos_profile));
+  qos.get_rmw_qos_profile() = bulk_batch_qos_profile;
+  if (depth > 0) {
+    qos.keep_last(depth);
+  }
+  return qos;
+}
+
+/**
+ * @brief Builds a latched state QoS.
+ *
+ * @return QoS object.
+ */
+inline rclcpp::QoS latched_state_qos()
+{
+  rclcpp::QoS qos(rclcpp::QoSInitialization::from_rmw(latched_state_qos_profile));
+  qos.get_rmw_qos_profile() = latched_state_qos_profile;
+  return qos;
+}
+
+} // namespace ROS2QoS
+
+#endif
@@ -12,6 +12,15 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <pthread.h>
 #include <semaphore.h>
 #include <stdexcept>
 #include <vector>
@@ -25,6 +34,14 @@ namespace ROS2SignalHandler
 
 /**
  * Global singleton signal handler object.
+ *
+ * Signals are queued with their siginfo_t in a lock-free ring, and handled
+ * by a dedicated thread. The signal context never blocks nor takes locks:
+ * when the ring is full, signals are dropped and counted instead.
+ *
+ * Before the context is shut down, registered shutdown hooks are run in
+ * order, all within a common deadline, so that components can drain their
+ * work and persist their state.
  */
 class SignalHandler final
 {
@@ -47,6 +64,8 @@ public:
    * @param logger_name Name to be visualized in rclcpp log prints.
    * @param deferred_handler Signal handler to be called alongside main thread.
    * @param system_handler System signal handler to be called while tracing.
+   * @param deferred_info_handler Signal handler to be called alongside main thread,
+   *                              with the information of the queued signal.
    *
    * @throws InvalidArgument
    */
@@ -54,7 +73,8 @@ public:
     std::shared_ptr<rclcpp::Context> context,
     std::string && logger_name = std::string("signal_handler"),
     std::function<void(int, std::string &)> && deferred_handler = nullptr,
-    std::function<void(int, siginfo_t *, void *)> && system_handler = nullptr
+    std::function<void(int, siginfo_t *, void *)> && system_handler = nullptr,
+    std::function<void(const siginfo_t &, std::string &)> && deferred_info_handler = nullptr
   )
   {
     // Check if provided context is valid
@@ -70,22 +90,29 @@ public:
       throw std::runtime_error("SignalHandler::init: called on valid object");
     }
 
-    // Initialize semaphores
-    if (sem_init(&sig_prod_, 0, 0) || sem_init(&sig_cons_, 0, 1)) {
+    // Initialize semaphore
+    if (sem_init(&sig_prod_, 0, 0)) {
       std::perror("sem_init");
-      throw std::runtime_error("SignalHandler::init: failed to initialize sempahores");
+      throw std::runtime_error("SignalHandler::init: failed to initialize sempahore");
     }
 
     // Initialize pointers
     context_ = context;
     deferred_handler_ = deferred_handler;
+    deferred_info_handler_ = deferred_info_handler;
     system_handler_ = system_handler;
 
     // Initialize rclcpp logger name
     logger_name_ = logger_name;
 
-    // Initialize local signal value
-    sig_ = 0;
+    // Initialize signal queue
+    for (uint64_t i = 0; i < SIG_QUEUE_SIZE; i++) {
+      sig_queue_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    sig_enqueue_.store(0, std::memory_order_relaxed);
+    sig_dequeue_ = 0;
+    sig_dropped_.store(0, std::memory_order_relaxed);
+    terminate_.store(false, std::memory_order_relaxed);
 
     // Initialize validity flag (this also acts as a barrier, validating data above)
     valid_.store(true, std::memory_order_release);
@@ -189,6 +216,56 @@ public:
     );
   }
 
+  /**
+   * @brief Registers a shutdown hook, run before the context is shut down.
+   *
+   * Hooks run on the handler thread, lowest order first, and receive the
+   * deadline by which they all must return: they should stop waiting for
+   * their work at that point. Hooks left when the deadline expires are skipped.
+   *
+   * @param order Position of the hook, lower values run first.
+   * @param name Name to be visualized in rclcpp log prints.
+   * @param hook Hook routine.
+   * @return Hook ID, to remove it.
+   */
+  unsigned int add_shutdown_hook(
+    int order,
+    std::string && name,
+    std::function<void(std::chrono::steady_clock::time_point)> && hook)
+  {
+    std::scoped_lock<std::mutex> hooks_lock(hooks_lock_);
+    unsigned int id = next_hook_id_++;
+    hooks_.emplace(std::make_pair(order, id), ShutdownHook{std::move(name), std::move(hook)});
+    return id;
+  }
+
+  /**
+   * @brief Removes a shutdown hook.
+   *
+   * @param id Hook ID.
+   */
+  void remove_shutdown_hook(unsigned int id)
+  {
+    std::scoped_lock<std::mutex> hooks_lock(hooks_lock_);
+    for (auto it = hooks_.begin(); it != hooks_.end(); it++) {
+      if (it->first.second == id) {
+        hooks_.erase(it);
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Sets the time shutdown hooks have to complete, from the signal.
+   *
+   * @param deadline Time budget of all hooks.
+   */
+  void set_shutdown_deadline(std::chrono::steady_clock::duration deadline)
+  {
+    std::scoped_lock<std::mutex> hooks_lock(hooks_lock_);
+    shutdown_deadline_ = deadline;
+  }
+
   /**
    * @brief Reinitializes this signal handler.
    *
@@ -213,28 +290,32 @@ public:
     // Reset validity flag
     valid_ = false;
 
-    // Terminate and join handler thread
-    sem_wait_(&sig_cons_);
-    sig_ = -1;
+    // Terminate and join handler thread, after it handled queued signals
+    terminate_.store(true, std::memory_order_release);
     sem_post_(&sig_prod_);
     handler_thread_.join();
 
+    // Erase shutdown hooks
+    {
+      std::scoped_lock<std::mutex> hooks_lock(hooks_lock_);
+      hooks_.clear();
+      hooks_ran_ = false;
+    }
+
     // Erase pointers
     context_.reset();
     deferred_handler_ = nullptr;
+    deferred_info_handler_ = nullptr;
     system_handler_ = nullptr;
 
     // Erase logger name
     logger_name_ = std::string("");
 
-    // Destroy semaphores
-    if (sem_destroy(&sig_prod_) || sem_destroy(&sig_cons_)) {
+    // Destroy semaphore
+    if (sem_destroy(&sig_prod_)) {
       std::perror("sem_destroy");
-      throw std::runtime_error("SignalHandler::fini: failed to destroy semaphores");
+      throw std::runtime_error("SignalHandler::fini: failed to destroy semaphore");
     }
-
-    // Erase local signal value
-    sig_ = 0;
   }
 
   /* Singleton: no copy constructor. */
@@ -256,6 +337,9 @@ private:
   /* Deferred signal handler. */
   std::function<void(int, std::string &)> deferred_handler_ = nullptr;
 
+  /* Deferred signal handler, with signal information. */
+  std::function<void(const siginfo_t &, std::string &)> deferred_info_handler_ = nullptr;
+
   /* System signal handler. */
   inline static std::function<void(int, siginfo_t *, void *)> system_handler_ = nullptr;
 
@@ -265,14 +349,55 @@ private:
   /* Signal handler object installation mutex. */
   inline static std::mutex install_lock_;
 
-  /* Delivered signal, also used to notify termination. */
-  inline static int sig_ = 0;
+  /* Queued signal slot, published when its sequence number is one past its index. */
+  struct SignalSlot
+  {
+    std::atomic<uint64_t> seq;
+    siginfo_t info;
+  };
+
+  /* Size of the signal queue, a power of two. */
+  static constexpr uint64_t SIG_QUEUE_SIZE = 64;
 
-  /* Delivered signal PRODUCED semaphore. */
+  /* Bounded multi-producer queue of delivered signals. */
+  inline static SignalSlot sig_queue_[SIG_QUEUE_SIZE];
+
+  /* Next queue index to write, claimed by signal handlers. */
+  inline static std::atomic<uint64_t> sig_enqueue_ = 0;
+
+  /* Next queue index to read, by the handler thread only. */
+  inline static uint64_t sig_dequeue_ = 0;
+
+  /* Signals dropped while the queue was full. */
+  inline static std::atomic<uint64_t> sig_dropped_ = 0;
+
+  /* Termination request for the handler thread. */
+  inline static std::atomic_bool terminate_ = false;
+
+  /* Delivered signal PRODUCED semaphore, posted once per queued signal. */
   inline static sem_t sig_prod_;
 
-  /* Delivered signal CONSUMED semaphore. */
-  inline static sem_t sig_cons_;
+  /* Shutdown hook entry. */
+  struct ShutdownHook
+  {
+    std::string name;
+    std::function<void(std::chrono::steady_clock::time_point)> routine;
+  };
+
+  /* Shutdown hooks, by order then registration. */
+  std::map<std::pair<int, unsigned int>, ShutdownHook> hooks_{};
+
+  /* Next shutdown hook ID. */
+  unsigned int next_hook_id_ = 0;
+
+  /* Time budget of all shutdown hooks. */
+  std::chrono::steady_clock::duration shutdown_deadline_ = std::chrono::seconds(5);
+
+  /* Shutdown hooks already run flag. */
+  bool hooks_ran_ = false;
+
+  /* Shutdown hooks mutex, never taken in signal context. */
+  std::mutex hooks_lock_;
 
   /* List of traced signals. */
   std::vector<int> installed_{};
@@ -294,18 +419,73 @@ private:
   }
 
   /**
-   * @brief Wraps the call to sem_wait.
+   * @brief Wraps the call to sem_wait, retrying if interrupted.
    *
    * @throws RuntimeError
    */
   static void sem_wait_(sem_t * sem)
   {
-    if (sem_wait(sem)) {
-      std::perror("sem_wait");
-      throw std::runtime_error("SignalHandler::sem_wait_: failed to wait sempahore");
+    while (sem_wait(sem)) {
+      if (errno != EINTR) {
+        std::perror("sem_wait");
+        throw std::runtime_error("SignalHandler::sem_wait_: failed to wait sempahore");
+      }
     }
   }
 
+  /**
+   * @brief Queues a delivered signal, from signal context.
+   *
+   * Only uses lock-free atomics and sem_post, which are async-signal-safe.
+   *
+   * @param info Signal information.
+   * @return False if the queue was full and the signal was dropped.
+   */
+  static bool enqueue_signal(const siginfo_t & info)
+  {
+    uint64_t pos = sig_enqueue_.load(std::memory_order_relaxed);
+    SignalSlot * slot;
+    while (true) {
+      slot = &sig_queue_[pos & (SIG_QUEUE_SIZE - 1)];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      int64_t diff = int64_t(seq) - int64_t(pos);
+      if (diff == 0) {
+        // Slot is free: claim it, or retry with the index another handler left
+        if (sig_enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // Slot still holds a signal that wasn't handled yet: queue is full
+        sig_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = sig_enqueue_.load(std::memory_order_relaxed);
+      }
+    }
+    std::memcpy(&slot->info, &info, sizeof(siginfo_t));
+    slot->seq.store(pos + 1, std::memory_order_release);
+    sem_post(&sig_prod_);
+    return true;
+  }
+
+  /**
+   * @brief Dequeues the oldest delivered signal, from the handler thread.
+   *
+   * @param info Signal information.
+   * @return False if no signal is ready.
+   */
+  static bool dequeue_signal(siginfo_t & info)
+  {
+    SignalSlot & slot = sig_queue_[sig_dequeue_ & (SIG_QUEUE_SIZE - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != sig_dequeue_ + 1) {
+      return false;
+    }
+    std::memcpy(&info, &slot.info, sizeof(siginfo_t));
+    slot.seq.store(sig_dequeue_ + SIG_QUEUE_SIZE, std::memory_order_release);
+    sig_dequeue_++;
+    return true;
+  }
+
   /**
    * @brief Uninstalls the signal handler for a given signal.
    *
@@ -364,62 +544,151 @@ private:
    */
   void handler_thread_routine()
   {
-    int local_sig;
+    // Keep signals away from this thread, so that handlers never interrupt it
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
     RCLCPP_INFO(rclcpp::get_logger(logger_name_), "Signal handler started");
 
+    siginfo_t info;
     while (true) {
       // Wait for external wakeup call
       sem_wait_(&sig_prod_);
-      local_sig = sig_;
-      sem_post_(&sig_cons_);
+
+      // Handle all queued signals, in delivery order
+      while (dequeue_signal(info)) {
+        handle_signal(info);
+      }
+
+      uint64_t dropped = sig_dropped_.exchange(0, std::memory_order_relaxed);
+      if (dropped > 0) {
+        RCLCPP_ERROR(
+          rclcpp::get_logger(logger_name_),
+          "Dropped %lu signals, queue full",
+          static_cast<unsigned long>(dropped));
+      }
 
       // Check if termination is due
-      if (local_sig == -1) {
+      if (terminate_.load(std::memory_order_acquire)) {
         RCLCPP_INFO(rclcpp::get_logger(logger_name_), "Signal handler terminated");
         return;
       }
+    }
+  }
+
+  /**
+   * @brief Handles a queued signal.
+   *
+   * @param info Signal information.
+   */
+  void handle_signal(siginfo_t & info)
+  {
+    int sig = info.si_signo;
+    RCLCPP_INFO(
+      rclcpp::get_logger(logger_name_),
+      "Got signal (%d) from process (%d)",
+      sig,
+      static_cast<int>(info.si_pid));
+
+    // Call custom handlers, if present
+    if (deferred_handler_) {
+      deferred_handler_(sig, logger_name_);
+    }
+    if (deferred_info_handler_) {
+      deferred_info_handler_(info, logger_name_);
+    }
 
-      RCLCPP_INFO(rclcpp::get_logger(logger_name_), "Got signal (%d)", local_sig);
+    // Shut down context if requested, after draining components
+    if (context_->is_valid() && context_->get_init_options().shutdown_on_sigint) {
+      run_shutdown_hooks();
+      RCLCPP_WARN(rclcpp::get_logger(logger_name_), "Shutting down context");
+      context_->shutdown("signal (" + std::to_string(sig) + ")");
+    }
+  }
 
-      // Call custom handler, if present
-      if (deferred_handler_) {
-        deferred_handler_(local_sig, logger_name_);
+  /**
+   * @brief Runs the shutdown hooks in order, once, within the deadline.
+   */
+  void run_shutdown_hooks()
+  {
+    std::vector<ShutdownHook> hooks;
+    std::chrono::steady_clock::time_point deadline;
+    {
+      std::scoped_lock<std::mutex> hooks_lock(hooks_lock_);
+      if (hooks_ran_) {
+        return;
+      }
+      hooks_ran_ = true;
+      for (auto & entry : hooks_) {
+        hooks.push_back(entry.second);
       }
+      deadline = std::chrono::steady_clock::now() + shutdown_deadline_;
+    }
 
-      // Shut down context if requested
-      if (context_->is_valid() && context_->get_init_options().shutdown_on_sigint) {
-        RCLCPP_WARN(rclcpp::get_logger(logger_name_), "Shutting down context");
-        context_->shutdown("signal (" + std::to_string(sig_) + ")");
+    for (auto & hook : hooks) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        RCLCPP_ERROR(
+          rclcpp::get_logger(logger_name_),
+          "Skipping shutdown hook %s: deadline expired",
+          hook.name.c_str());
+        continue;
       }
+      RCLCPP_INFO(
+        rclcpp::get_logger(logger_name_),
+        "Running shutdown hook %s",
+        hook.name.c_str());
+      try {
+        hook.routine(deadline);
+      } catch (const std::exception & e) {
+        RCLCPP_ERROR(
+          rclcpp::get_logger(logger_name_),
+          "Shutdown hook %s failed: %s",
+          hook.name.c_str(),
+          e.what());
+      }
+    }
+    if (std::chrono::steady_clock::now() > deadline) {
+      RCLCPP_WARN(rclcpp::get_logger(logger_name_), "Shutdown hooks overran their deadline");
     }
   }
 
   /**
    * @brief Common signal handler installed for all signals.
    *
+   * Runs in signal context, so it never blocks: the signal is queued for the
+   * handler thread, or dropped if the queue is full.
+   *
    * @param sig Traced signal.
    * @param info Additional trace information.
    * @param ucontext Additional context information provided by the kernel.
    */
   static void common_handler(int sig, siginfo_t * info, void * ucontext)
   {
-    // Acquire signal handler lock
-    std::scoped_lock<std::mutex> common_handler_lock(install_lock_);
+    // Preserve errno for the interrupted code
+    int saved_errno = errno;
+
+    // Check if signal handler is currently valid
+    if (!valid_.load(std::memory_order_acquire)) {
+      errno = saved_errno;
+      return;
+    }
 
     // Call system handler, if present, bypassing the rest of the system
     if (system_handler_) {
       system_handler_(sig, info, ucontext);
     }
 
-    // Check if signal handler is currently valid
-    if (!valid_) {
-      return;
+    // Queue signal for the handler thread
+    siginfo_t local_info;
+    if (info != nullptr) {
+      local_info = *info;
+    } else {
+      std::memset(&local_info, 0, sizeof(siginfo_t));
+      local_info.si_signo = sig;
     }
-
-    // Notify handler thread
-    sem_wait_(&sig_cons_);
-    sig_ = sig;
-    sem_post_(&sig_prod_);
+    enqueue_signal(local_info);
+    errno = saved_errno;
   }
 }; // class SignalHandler
 
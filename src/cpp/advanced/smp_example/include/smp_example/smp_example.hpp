@@ -9,9 +9,16 @@
 #ifndef SMP_EXAMPLE_HPP
 #define SMP_EXAMPLE_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/u_int64.hpp>
 
+#include <ros2_examples_interfaces/msg/benchmark_sample.hpp>
+
 /**
  * Simple node with two subscribers, which callbacks will be executed on
  * different threads.
@@ -21,6 +28,10 @@ class SMPNode : public rclcpp::Node
 public:
   SMPNode();
 
+  //! Groups to be assigned to dedicated threads, before adding this node
+  rclcpp::CallbackGroup::SharedPtr get_clbk_group_1();
+  rclcpp::CallbackGroup::SharedPtr get_clbk_group_2();
+
 private:
   //! The main difference is the necessity to create callback groups,
   //! intended as separate queues from which call
@@ -34,6 +45,42 @@ private:
   void sub_2_clbk(const std_msgs::msg::UInt64::SharedPtr msg);
 };
 
+/**
+ * Benchmark variant of SMPNode: both subscribers record the latency of each
+ * sample, from its publication, instead of logging it.
+ */
+class SMPBenchNode : public rclcpp::Node
+{
+public:
+  SMPBenchNode(std::chrono::microseconds work);
+
+  //! Latencies are only recorded between these calls, to skip the warm-up
+  void start_measure();
+  void stop_measure();
+
+  //! Recorded latencies [ns], to be read after stop_measure
+  std::vector<int64_t> latencies() const;
+
+private:
+  rclcpp::CallbackGroup::SharedPtr clbk_group_1_;
+  rclcpp::CallbackGroup::SharedPtr clbk_group_2_;
+
+  rclcpp::Subscription<ros2_examples_interfaces::msg::BenchmarkSample>::SharedPtr sub_1_;
+  rclcpp::Subscription<ros2_examples_interfaces::msg::BenchmarkSample>::SharedPtr sub_2_;
+
+  //! Each group runs one callback at a time, so each list has a single writer
+  std::vector<int64_t> latencies_1_;
+  std::vector<int64_t> latencies_2_;
+  std::atomic<bool> measuring_;
+
+  //! Simulated processing time of each callback
+  std::chrono::microseconds work_;
+
+  void record(
+    const ros2_examples_interfaces::msg::BenchmarkSample & msg,
+    std::vector<int64_t> & latencies);
+};
+
 /**
  * Publisher node for this example.
  */
@@ -42,14 +89,24 @@ class PubNode : public rclcpp::Node
 public:
   PubNode(unsigned int period);
 
+  //! Benchmark variant: publishes stamped samples at the given period and size
+  PubNode(std::chrono::nanoseconds period, size_t payload_size);
+
+  //! Number of messages published so far
+  uint64_t count() const;
+
 private:
   rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr count_pub_;
+  rclcpp::Publisher<ros2_examples_interfaces::msg::BenchmarkSample>::SharedPtr sample_pub_;
 
   rclcpp::TimerBase::SharedPtr pub_timer_;
 
   void timer_clbk_(void);
+  void sample_timer_clbk_(void);
+
+  ros2_examples_interfaces::msg::BenchmarkSample sample_;
 
-  unsigned long int count_;
+  std::atomic<unsigned long int> count_;
 };
 
 #endif
@@ -0,0 +1,75 @@
+/**
+ * Work-stealing executor for this example.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 26, 2021
+ */
+
+#ifndef WORK_STEALING_EXECUTOR_HPP
+#define WORK_STEALING_EXECUTOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+/**
+ * Multithreaded executor in which threads keep their own queue of ready
+ * executables, and steal from the others when theirs is empty.
+ *
+ * The MultiThreadedExecutor takes one executable at a time under a single lock,
+ * so threads contend on it at every callback. Here the thread that waits on
+ * the wait set takes all the executables that are ready at once, queues them
+ * for itself, and idle threads steal from the back of that queue.
+ * Callback groups are still honored: a MutuallyExclusive group cannot be taken
+ * again until its callback has been executed.
+ */
+class WorkStealingExecutor : public rclcpp::Executor
+{
+public:
+  explicit WorkStealingExecutor(
+    const rclcpp::ExecutorOptions & options = rclcpp::ExecutorOptions(),
+    size_t number_of_threads = 0,
+    std::chrono::nanoseconds next_exec_timeout = std::chrono::nanoseconds(-1));
+
+  void spin() override;
+
+  size_t get_number_of_threads() const;
+
+private:
+  /* Ready executables of a thread, taken from the front by it and stolen from the back. */
+  struct WorkQueue
+  {
+    std::mutex lock;
+    std::deque<rclcpp::AnyExecutable> executables;
+  };
+
+  void run(size_t index);
+  bool pop(size_t index, rclcpp::AnyExecutable & any_exec);
+  bool steal(size_t index, rclcpp::AnyExecutable & any_exec);
+  bool schedule(rclcpp::AnyExecutable & any_exec);
+
+  size_t number_of_threads_;
+  std::chrono::nanoseconds next_exec_timeout_;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+
+  //! Held by the thread waiting on the wait set
+  std::mutex wait_mutex_;
+
+  //! Timers taken and not executed yet, so that no two threads run the same one
+  std::set<rclcpp::TimerBase::SharedPtr> scheduled_timers_;
+  std::mutex scheduled_timers_lock_;
+
+  //! Wakes idle threads when new executables are queued
+  std::mutex idle_lock_;
+  std::condition_variable idle_cv_;
+};
+
+#endif
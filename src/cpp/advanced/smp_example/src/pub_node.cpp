@@ -33,6 +33,41 @@ PubNode::PubNode(unsigned int period)
   RCLCPP_INFO(this->get_logger(), "Node initialized");
 }
 
+/**
+ * @brief Creates a PubNode that publishes benchmark samples.
+ *
+ * @param period Publishing timer time period.
+ * @param payload_size Size of the dummy data of each sample [bytes].
+ */
+PubNode::PubNode(std::chrono::nanoseconds period, size_t payload_size)
+: Node("pub_node"),
+  count_(0)
+{
+  sample_pub_ = this->create_publisher<ros2_examples_interfaces::msg::BenchmarkSample>(
+    "/ros2_examples/smp_bench_topic",
+    rclcpp::QoS(10)
+  );
+  sample_.payload.resize(payload_size);
+  pub_timer_ = this->create_wall_timer(
+    period,
+    std::bind(
+      &PubNode::sample_timer_clbk_,
+      this
+    )
+  );
+  RCLCPP_INFO(this->get_logger(), "Node initialized");
+}
+
+/**
+ * @brief Returns the number of messages published so far.
+ *
+ * @return Message count.
+ */
+uint64_t PubNode::count() const
+{
+  return count_.load();
+}
+
 /**
  * @brief Publishes a new message.
  */
@@ -43,3 +78,15 @@ void PubNode::timer_clbk_(void)
   new_msg.set__data(count_);
   count_pub_->publish(new_msg);
 }
+
+/**
+ * @brief Publishes a new benchmark sample, stamped right before publication.
+ */
+void PubNode::sample_timer_clbk_(void)
+{
+  sample_.set__seq(++count_);
+  sample_.set__stamp(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  sample_pub_->publish(sample_);
+}
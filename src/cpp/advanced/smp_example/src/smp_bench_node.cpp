@@ -0,0 +1,98 @@
+/**
+ * Multithreaded benchmark node code.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 26, 2021
+ */
+
+#include <chrono>
+
+#include "../include/smp_example/smp_example.hpp"
+
+/**
+ * @brief Creates an SMPBenchNode.
+ *
+ * @param work Simulated processing time of each callback.
+ */
+SMPBenchNode::SMPBenchNode(std::chrono::microseconds work)
+: Node("smp_bench_node"),
+  measuring_(false),
+  work_(work)
+{
+  //! Same layout as SMPNode: one MutuallyExclusive group per subscriber
+  clbk_group_1_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  clbk_group_2_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+
+  rclcpp::SubscriptionOptions sub_opts_1, sub_opts_2;
+  sub_opts_1.callback_group = clbk_group_1_;
+  sub_opts_2.callback_group = clbk_group_2_;
+
+  sub_1_ = this->create_subscription<ros2_examples_interfaces::msg::BenchmarkSample>(
+    "/ros2_examples/smp_bench_topic",
+    rclcpp::QoS(10),
+    [this](const ros2_examples_interfaces::msg::BenchmarkSample::SharedPtr msg) {
+      record(*msg, latencies_1_);
+    },
+    sub_opts_1
+  );
+  sub_2_ = this->create_subscription<ros2_examples_interfaces::msg::BenchmarkSample>(
+    "/ros2_examples/smp_bench_topic",
+    rclcpp::QoS(10),
+    [this](const ros2_examples_interfaces::msg::BenchmarkSample::SharedPtr msg) {
+      record(*msg, latencies_2_);
+    },
+    sub_opts_2
+  );
+
+  RCLCPP_INFO(this->get_logger(), "Node initialized");
+}
+
+/**
+ * @brief Starts recording latencies.
+ */
+void SMPBenchNode::start_measure()
+{
+  measuring_.store(true);
+}
+
+/**
+ * @brief Stops recording latencies.
+ */
+void SMPBenchNode::stop_measure()
+{
+  measuring_.store(false);
+}
+
+/**
+ * @brief Returns the latencies recorded by both subscribers.
+ *
+ * @return Latencies [ns].
+ */
+std::vector<int64_t> SMPBenchNode::latencies() const
+{
+  std::vector<int64_t> all = latencies_1_;
+  all.insert(all.end(), latencies_2_.begin(), latencies_2_.end());
+  return all;
+}
+
+/**
+ * @brief Records the latency of a sample, then simulates its processing.
+ *
+ * @param msg Sample received.
+ * @param latencies List to record into.
+ */
+void SMPBenchNode::record(
+  const ros2_examples_interfaces::msg::BenchmarkSample & msg,
+  std::vector<int64_t> & latencies)
+{
+  auto now = std::chrono::steady_clock::now();
+  if (measuring_.load(std::memory_order_relaxed)) {
+    latencies.push_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count() -
+      msg.stamp);
+  }
+
+  //! Busy wait, to keep the thread as a real workload would
+  while (std::chrono::steady_clock::now() - now < work_) {}
+}
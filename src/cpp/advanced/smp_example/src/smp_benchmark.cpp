@@ -0,0 +1,233 @@
+/**
+ * Executors benchmark.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 26, 2021
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include "../include/smp_example/smp_example.hpp"
+#include "../include/smp_example/work_stealing_executor.hpp"
+
+/* Benchmark configuration, from the command line. */
+struct BenchConfig
+{
+  std::vector<std::string> executors{"single", "static", "multi", "work_stealing"};
+  std::vector<double> rates{100.0, 1000.0};         // [Hz]
+  std::vector<size_t> payloads{64, 65536};          // [bytes]
+  size_t threads = 0;                               // 0: as many as the cores
+  double duration = 5.0;                            // [s]
+  double warmup = 1.0;                              // [s]
+  std::chrono::microseconds work{0};                // Per callback
+};
+
+/* Results of a single run. */
+struct BenchResult
+{
+  double sent_rate;     // [Hz]
+  double recv_rate;     // Subscriber callbacks [Hz], twice the rate if none is lost
+  double cpu;           // Process CPU use [%], 100 for a whole core
+  double p50;           // Latencies [us]
+  double p99;
+  double max;
+};
+
+/**
+ * @brief Parses a comma-separated list.
+ *
+ * @param arg List to parse.
+ * @return List elements.
+ */
+static std::vector<std::string> split(const char * arg)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/**
+ * @brief Creates an executor by name.
+ *
+ * @param name Executor name.
+ * @param threads Number of threads of multithreaded executors.
+ * @return New executor, null if the name is unknown.
+ */
+static std::unique_ptr<rclcpp::Executor> make_executor(const std::string & name, size_t threads)
+{
+  if (name == "single") {
+    return std::make_unique<rclcpp::executors::SingleThreadedExecutor>();
+  }
+  if (name == "static") {
+    return std::make_unique<rclcpp::executors::StaticSingleThreadedExecutor>();
+  }
+  if (name == "multi") {
+    return std::make_unique<rclcpp::executors::MultiThreadedExecutor>(
+      rclcpp::ExecutorOptions(), threads);
+  }
+  if (name == "work_stealing") {
+    return std::make_unique<WorkStealingExecutor>(rclcpp::ExecutorOptions(), threads);
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Gets the CPU time used by this process.
+ *
+ * @return User and system time [s].
+ */
+static double cpu_time()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+/**
+ * @brief Runs the example nodes on an executor and measures it.
+ *
+ * @param executor Executor to measure.
+ * @param rate Publishing rate [Hz].
+ * @param payload Sample size [bytes].
+ * @param config Benchmark configuration.
+ * @return Measurements.
+ */
+static BenchResult run(
+  rclcpp::Executor & executor,
+  double rate,
+  size_t payload,
+  const BenchConfig & config)
+{
+  auto pub_node = std::make_shared<PubNode>(
+    std::chrono::nanoseconds(int64_t(1e9 / rate)),
+    payload);
+  auto smp_node = std::make_shared<SMPBenchNode>(config.work);
+  executor.add_node(smp_node);
+  executor.add_node(pub_node);
+
+  std::thread spinner([&executor]() {executor.spin();});
+
+  //! Let discovery complete and queues settle before measuring
+  std::this_thread::sleep_for(std::chrono::duration<double>(config.warmup));
+  uint64_t sent_start = pub_node->count();
+  double cpu_start = cpu_time();
+  auto start = std::chrono::steady_clock::now();
+  smp_node->start_measure();
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(config.duration));
+
+  smp_node->stop_measure();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpu = cpu_time() - cpu_start;
+  uint64_t sent = pub_node->count() - sent_start;
+
+  executor.cancel();
+  spinner.join();
+  executor.remove_node(pub_node);
+  executor.remove_node(smp_node);
+
+  std::vector<int64_t> latencies = smp_node->latencies();
+  std::sort(latencies.begin(), latencies.end());
+  BenchResult result{};
+  result.sent_rate = double(sent) / elapsed;
+  result.recv_rate = double(latencies.size()) / elapsed;
+  result.cpu = 100.0 * cpu / elapsed;
+  if (!latencies.empty()) {
+    result.p50 = double(latencies[latencies.size() / 2]) * 1e-3;
+    result.p99 = double(latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)]) *
+      1e-3;
+    result.max = double(latencies.back()) * 1e-3;
+  }
+  return result;
+}
+
+int main(int argc, char ** argv)
+{
+  BenchConfig config;
+  for (int i = 1; i < argc; i++) {
+    //! ROS arguments are left to rclcpp
+    if (!std::strcmp(argv[i], "--ros-args")) {
+      break;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << argv[i] << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const char * value = argv[++i];
+    if (!std::strcmp(argv[i - 1], "--executors")) {
+      config.executors = split(value);
+    } else if (!std::strcmp(argv[i - 1], "--rates")) {
+      config.rates.clear();
+      for (auto & item : split(value)) {
+        config.rates.push_back(std::stod(item));
+      }
+    } else if (!std::strcmp(argv[i - 1], "--payloads")) {
+      config.payloads.clear();
+      for (auto & item : split(value)) {
+        config.payloads.push_back(std::stoul(item));
+      }
+    } else if (!std::strcmp(argv[i - 1], "--threads")) {
+      config.threads = std::stoul(value);
+    } else if (!std::strcmp(argv[i - 1], "--duration")) {
+      config.duration = std::stod(value);
+    } else if (!std::strcmp(argv[i - 1], "--work")) {
+      config.work = std::chrono::microseconds(std::stol(value));
+    } else {
+      std::cerr << "Usage:\n\tsmp_benchmark [--executors single,static,multi,work_stealing]"
+        " [--rates HZ,...] [--payloads BYTES,...] [--threads N] [--duration S]"
+        " [--work US]" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  rclcpp::init(argc, argv);
+
+  std::printf(
+    "%-14s %10s %10s %10s %10s %8s %10s %10s %10s\n",
+    "executor", "rate[Hz]", "size[B]", "sent[Hz]", "clbk[Hz]", "cpu[%]",
+    "p50[us]", "p99[us]", "max[us]");
+  for (const std::string & name : config.executors) {
+    for (double rate : config.rates) {
+      for (size_t payload : config.payloads) {
+        if (!rclcpp::ok()) {
+          break;
+        }
+        std::unique_ptr<rclcpp::Executor> executor = make_executor(name, config.threads);
+        if (!executor) {
+          std::cerr << "Unknown executor: " << name << std::endl;
+          break;
+        }
+        BenchResult result = run(*executor, rate, payload, config);
+        std::printf(
+          "%-14s %10.0f %10zu %10.1f %10.1f %8.1f %10.1f %10.1f %10.1f\n",
+          name.c_str(), rate, payload, result.sent_rate, result.recv_rate, result.cpu,
+          result.p50, result.p99, result.max);
+        std::fflush(stdout);
+      }
+    }
+  }
+
+  rclcpp::shutdown();
+  exit(EXIT_SUCCESS);
+}
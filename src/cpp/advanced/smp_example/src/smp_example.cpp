@@ -6,34 +6,113 @@
  * November 26, 2021
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 
+#include <ros2_examples_headers/executor_launcher/executor_launcher.hpp>
+
 #include "../include/smp_example/smp_example.hpp"
 
+using namespace ROS2ExecutorLauncher;
+
+static void usage()
+{
+  std::cerr << "Usage:\n\tsmp_example PERIOD[ms] [--threads N] [--pool-cpus LIST]"
+    " [--sub-cpus CPU1,CPU2] [--priority P]" << std::endl;
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char ** argv)
 {
   if (argc < 2) {
-    std::cerr << "Usage:\n\tsmp_example PERIOD[ms]" << std::endl;
-    exit(EXIT_FAILURE);
+    usage();
   }
   unsigned int T = std::atoi(argv[1]);
 
+  //! Threads configuration: by default, a pool as large as the cores, unpinned
+  size_t threads = 0;
+  std::vector<int> pool_cpus, sub_cpus;
+  int priority = 0;
+  try {
+    for (int i = 2; i < argc; i++) {
+      if (!std::strcmp(argv[i], "--ros-args")) {
+        break;
+      }
+      if (i + 1 >= argc) {
+        usage();
+      }
+      const char * value = argv[++i];
+      if (!std::strcmp(argv[i - 1], "--threads")) {
+        threads = std::stoul(value);
+      } else if (!std::strcmp(argv[i - 1], "--pool-cpus")) {
+        pool_cpus = parse_cpu_list(value);
+      } else if (!std::strcmp(argv[i - 1], "--sub-cpus")) {
+        sub_cpus = parse_cpu_list(value);
+        if (sub_cpus.size() != 2) {
+          usage();
+        }
+      } else if (!std::strcmp(argv[i - 1], "--priority")) {
+        priority = std::stoi(value);
+      } else {
+        usage();
+      }
+    }
+  } catch (const std::logic_error & e) {
+    std::cerr << e.what() << std::endl;
+    usage();
+  }
+
   rclcpp::init(argc, argv);
 
+  //! Each pool thread is pinned to one of the pool CPUs, in turn
+  if (threads == 0) {
+    threads = pool_cpus.empty() ?
+      std::max(std::thread::hardware_concurrency(), 1u) : pool_cpus.size();
+  }
+  std::vector<ThreadAttributes> pool(threads);
+  for (size_t i = 0; i < threads; i++) {
+    pool[i].name = "smp_pool_" + std::to_string(i);
+    if (!pool_cpus.empty()) {
+      pool[i].cpus = {pool_cpus[i % pool_cpus.size()]};
+    }
+    pool[i].priority = priority;
+  }
+
   //! This type of executor is needed to handle multithreaded workloads
   //! coming from nodes
-  rclcpp::executors::MultiThreadedExecutor smp_executor;
+  ExecutorLauncher launcher(pool);
 
-  //! So we explicitly need to add nodes to it
   auto smp_node = std::make_shared<SMPNode>();
   auto pub_node = std::make_shared<PubNode>(T);
-  smp_executor.add_node(smp_node);
-  smp_executor.add_node(pub_node);
+
+  //! Callback groups can also get a thread of their own, isolated on a CPU,
+  //! as long as this happens before their node is added
+  if (!sub_cpus.empty()) {
+    ThreadAttributes sub_1{"smp_sub_1", {sub_cpus[0]}, priority};
+    ThreadAttributes sub_2{"smp_sub_2", {sub_cpus[1]}, priority};
+    launcher.add_callback_group(
+      smp_node->get_clbk_group_1(),
+      smp_node->get_node_base_interface(),
+      sub_1);
+    launcher.add_callback_group(
+      smp_node->get_clbk_group_2(),
+      smp_node->get_node_base_interface(),
+      sub_2);
+  }
+
+  //! So we explicitly need to add nodes to it
+  launcher.add_node(smp_node);
+  launcher.add_node(pub_node);
 
   //! And then call its spin method directly
-  smp_executor.spin();
+  launcher.spin();
 
   rclcpp::shutdown();
   exit(EXIT_SUCCESS);
@@ -59,6 +59,26 @@ SMPNode::SMPNode()
   RCLCPP_INFO(this->get_logger(), "Node initialized");
 }
 
+/**
+ * @brief Returns the callback group of the first subscriber.
+ *
+ * @return First callback group.
+ */
+rclcpp::CallbackGroup::SharedPtr SMPNode::get_clbk_group_1()
+{
+  return clbk_group_1_;
+}
+
+/**
+ * @brief Returns the callback group of the second subscriber.
+ *
+ * @return Second callback group.
+ */
+rclcpp::CallbackGroup::SharedPtr SMPNode::get_clbk_group_2()
+{
+  return clbk_group_2_;
+}
+
 //! Notice below the usage of the RCLCPP_*_STREAM macros, to directly
 //! access the underlying logging output stream.
 /**
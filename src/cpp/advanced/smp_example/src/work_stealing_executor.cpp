@@ -0,0 +1,194 @@
+/**
+ * Work-stealing executor for this example.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 26, 2021
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "../include/smp_example/work_stealing_executor.hpp"
+
+/**
+ * @brief Creates a WorkStealingExecutor.
+ *
+ * @param options Common executor options.
+ * @param number_of_threads Number of threads, as many as the cores if zero.
+ * @param next_exec_timeout Maximum time to wait for new work.
+ */
+WorkStealingExecutor::WorkStealingExecutor(
+  const rclcpp::ExecutorOptions & options,
+  size_t number_of_threads,
+  std::chrono::nanoseconds next_exec_timeout)
+: rclcpp::Executor(options),
+  number_of_threads_(number_of_threads),
+  next_exec_timeout_(next_exec_timeout)
+{
+  if (number_of_threads_ == 0) {
+    number_of_threads_ = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (size_t i = 0; i < number_of_threads_; i++) {
+    queues_.push_back(std::make_unique<WorkQueue>());
+  }
+}
+
+/**
+ * @brief Spins on all threads until canceled or the context is shut down.
+ *
+ * @throws RuntimeError if already spinning.
+ */
+void WorkStealingExecutor::spin()
+{
+  if (spinning.exchange(true)) {
+    throw std::runtime_error("spin() called while already spinning");
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < number_of_threads_; i++) {
+    threads.emplace_back(&WorkStealingExecutor::run, this, i);
+  }
+  run(0);
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  //! Executables left in the queues were taken but not run, so release their groups
+  for (auto & queue : queues_) {
+    for (auto & any_exec : queue->executables) {
+      if (any_exec.callback_group) {
+        any_exec.callback_group->can_be_taken_from().store(true);
+      }
+    }
+    queue->executables.clear();
+  }
+  spinning.store(false);
+}
+
+/**
+ * @brief Returns the number of threads.
+ *
+ * @return Number of threads.
+ */
+size_t WorkStealingExecutor::get_number_of_threads() const
+{
+  return number_of_threads_;
+}
+
+/**
+ * @brief Takes the oldest executable of a thread queue.
+ *
+ * @param index Thread index.
+ * @param any_exec Executable taken.
+ * @return True if one was taken.
+ */
+bool WorkStealingExecutor::pop(size_t index, rclcpp::AnyExecutable & any_exec)
+{
+  WorkQueue & queue = *queues_[index];
+  std::lock_guard<std::mutex> lock(queue.lock);
+  if (queue.executables.empty()) {
+    return false;
+  }
+  any_exec = std::move(queue.executables.front());
+  queue.executables.pop_front();
+  return true;
+}
+
+/**
+ * @brief Takes the newest executable of another thread queue.
+ *
+ * @param index Index of the stealing thread.
+ * @param any_exec Executable taken.
+ * @return True if one was taken.
+ */
+bool WorkStealingExecutor::steal(size_t index, rclcpp::AnyExecutable & any_exec)
+{
+  for (size_t i = 1; i < number_of_threads_; i++) {
+    WorkQueue & queue = *queues_[(index + i) % number_of_threads_];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (!queue.executables.empty()) {
+      any_exec = std::move(queue.executables.back());
+      queue.executables.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Guards against a timer being taken again before it is executed.
+ *
+ * @param any_exec Executable just taken.
+ * @return False if it must be dropped, its callback group being released.
+ */
+bool WorkStealingExecutor::schedule(rclcpp::AnyExecutable & any_exec)
+{
+  if (!any_exec.timer) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(scheduled_timers_lock_);
+  if (!scheduled_timers_.insert(any_exec.timer).second) {
+    if (any_exec.callback_group) {
+      any_exec.callback_group->can_be_taken_from().store(true);
+    }
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Thread routine: runs queued work, steals, or waits for new work.
+ *
+ * @param index Thread index.
+ */
+void WorkStealingExecutor::run(size_t index)
+{
+  while (rclcpp::ok(this->context_) && spinning.load()) {
+    rclcpp::AnyExecutable any_exec;
+    if (!pop(index, any_exec) && !steal(index, any_exec)) {
+      std::unique_lock<std::mutex> wait_lock(wait_mutex_, std::try_to_lock);
+      if (!wait_lock.owns_lock()) {
+        //! Another thread is waiting on the wait set, and will wake us up
+        //! when it queues work; the timeout only bounds cancellation latency
+        std::unique_lock<std::mutex> lock(idle_lock_);
+        idle_cv_.wait_for(lock, std::chrono::milliseconds(10));
+        continue;
+      }
+      if (!rclcpp::ok(this->context_) || !spinning.load()) {
+        return;
+      }
+      if (!get_next_executable(any_exec, next_exec_timeout_)) {
+        continue;
+      }
+      if (!schedule(any_exec)) {
+        continue;
+      }
+
+      //! Take everything else that is ready, for the idle threads to steal
+      size_t queued = 0;
+      rclcpp::AnyExecutable more;
+      while (get_next_ready_executable(more)) {
+        if (!schedule(more)) {
+          more = rclcpp::AnyExecutable();
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(queues_[index]->lock);
+        queues_[index]->executables.push_back(std::move(more));
+        more = rclcpp::AnyExecutable();
+        queued++;
+      }
+      wait_lock.unlock();
+      if (queued > 0) {
+        idle_cv_.notify_all();
+      }
+    }
+    execute_any_executable(any_exec);
+    if (any_exec.timer) {
+      std::lock_guard<std::mutex> lock(scheduled_timers_lock_);
+      scheduled_timers_.erase(any_exec.timer);
+    }
+    any_exec.callback_group.reset();
+  }
+}
@@ -0,0 +1,213 @@
+/**
+ * In-node fallback for content filters on String messages.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * November 22, 2021
+ */
+
+#ifndef STRING_FILTER_HPP
+#define STRING_FILTER_HPP
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+
+/**
+ * Evaluates the content filter expressions that make sense for our String
+ * message directly on serialized samples, so that those not matching are never
+ * deserialized. Used when the middleware has no content filtered topics.
+ *
+ * Supported expressions, where the operand is either a quoted string or a %N
+ * parameter reference: data = OPERAND, data <> OPERAND, data LIKE OPERAND.
+ * LIKE patterns accept the SQL wildcards % (any sequence) and _ (any character).
+ */
+class StringFilter
+{
+public:
+  /**
+   * @brief Parses a filter expression.
+   *
+   * @param expression Filter expression.
+   * @param parameters Values of %N references, as quoted strings.
+   * @return False if the expression is not supported.
+   */
+  bool parse(const std::string & expression, const std::vector<std::string> & parameters)
+  {
+    size_t pos = 0;
+    std::string field = token(expression, pos);
+    std::string op = token(expression, pos);
+    std::string operand = token(expression, pos);
+    if (field != "data" || operand.empty() || !token(expression, pos).empty()) {
+      return false;
+    }
+    for (char & c : op) {
+      c = char(std::toupper(c));
+    }
+    if (op == "=") {
+      op_ = Op::EQUAL;
+    } else if (op == "<>" || op == "!=") {
+      op_ = Op::NOT_EQUAL;
+    } else if (op == "LIKE") {
+      op_ = Op::LIKE;
+    } else {
+      return false;
+    }
+
+    if (operand[0] == '%') {
+      size_t index;
+      try {
+        index = std::stoul(operand.substr(1));
+      } catch (const std::logic_error &) {
+        return false;
+      }
+      if (index >= parameters.size()) {
+        return false;
+      }
+      operand = parameters[index];
+    }
+    return unquote(operand, value_);
+  }
+
+  /**
+   * @brief Tests a serialized String message.
+   *
+   * @param msg Serialized message, in CDR.
+   * @return True if it matches, or cannot be parsed.
+   */
+  bool matches(const rclcpp::SerializedMessage & msg) const
+  {
+    // CDR: 4-byte encapsulation header, 4-byte length including the terminator, characters
+    const rcl_serialized_message_t & raw = msg.get_rcl_serialized_message();
+    if (raw.buffer_length < 8) {
+      return true;
+    }
+    uint32_t length;
+    std::memcpy(&length, raw.buffer + 4, sizeof(length));
+    if (raw.buffer[1] == 0) {
+      length = __builtin_bswap32(length);
+    }
+    if (length == 0 || size_t(length) > raw.buffer_length - 8) {
+      return true;
+    }
+    const char * data = reinterpret_cast<const char *>(raw.buffer + 8);
+    size_t size = length - 1;
+
+    switch (op_) {
+      case Op::EQUAL:
+        return size == value_.size() && std::memcmp(data, value_.data(), size) == 0;
+      case Op::NOT_EQUAL:
+        return size != value_.size() || std::memcmp(data, value_.data(), size) != 0;
+      case Op::LIKE:
+        return like(data, size);
+    }
+    return true;
+  }
+
+private:
+  enum class Op
+  {
+    EQUAL,
+    NOT_EQUAL,
+    LIKE
+  };
+
+  Op op_ = Op::EQUAL;
+  std::string value_;
+
+  /**
+   * @brief Extracts the next token of an expression.
+   *
+   * @param expression Expression.
+   * @param pos Position to start from, updated.
+   * @return Next token, empty at the end.
+   */
+  static std::string token(const std::string & expression, size_t & pos)
+  {
+    while (pos < expression.size() && std::isspace(static_cast<unsigned char>(expression[pos]))) {
+      pos++;
+    }
+    size_t start = pos;
+    if (pos < expression.size() && expression[pos] == '\'') {
+      // Quoted strings end at the next unescaped quote
+      pos++;
+      while (pos < expression.size()) {
+        if (expression[pos] == '\'') {
+          if (pos + 1 < expression.size() && expression[pos + 1] == '\'') {
+            pos += 2;
+            continue;
+          }
+          pos++;
+          break;
+        }
+        pos++;
+      }
+    } else {
+      while (pos < expression.size() && !std::isspace(static_cast<unsigned char>(expression[pos]))) {
+        pos++;
+      }
+    }
+    return expression.substr(start, pos - start);
+  }
+
+  /**
+   * @brief Removes quotes from a string literal.
+   *
+   * @param literal Quoted literal, with doubled quotes inside.
+   * @param value Literal value.
+   * @return False if the literal is not quoted.
+   */
+  static bool unquote(const std::string & literal, std::string & value)
+  {
+    if (literal.size() < 2 || literal.front() != '\'' || literal.back() != '\'') {
+      return false;
+    }
+    value.clear();
+    for (size_t i = 1; i + 1 < literal.size(); i++) {
+      value.push_back(literal[i]);
+      if (literal[i] == '\'') {
+        i++;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Matches a string against the LIKE pattern.
+   *
+   * @param data String to match.
+   * @param size String length.
+   * @return True if it matches.
+   */
+  bool like(const char * data, size_t size) const
+  {
+    // Greedy wildcard matching with backtracking to the last %
+    size_t s = 0, p = 0;
+    size_t star = std::string::npos, mark = 0;
+    while (s < size) {
+      if (p < value_.size() && value_[p] == '%') {
+        star = p++;
+        mark = s;
+      } else if (p < value_.size() && (value_[p] == '_' || value_[p] == data[s])) {
+        s++;
+        p++;
+      } else if (star != std::string::npos) {
+        p = star + 1;
+        s = ++mark;
+      } else {
+        return false;
+      }
+    }
+    while (p < value_.size() && value_[p] == '%') {
+      p++;
+    }
+    return p == value_.size();
+  }
+};
+
+#endif
@@ -13,6 +13,8 @@
 
 #include <ros2_examples_interfaces/msg/string.hpp> //! This time we use our own
 
+#include <custom_topic_cpp/string_filter.hpp>
+
 /**
  * Simple subscriber node: receives and prints strings transmitted on a topic.
  */
@@ -33,6 +35,12 @@ private:
   rclcpp::Subscription<ros2_examples_interfaces::msg::String>::SharedPtr subscriber_;
   void msg_callback(const ros2_examples_interfaces::msg::String::SharedPtr msg);
 
+  //! Content filtering, done by the middleware if it can, or here otherwise
+  //! on serialized samples, deserializing only those that match
+  StringFilter filter_;
+  rclcpp::Serialization<ros2_examples_interfaces::msg::String> serialization_;
+  void serialized_msg_callback(const std::shared_ptr<rclcpp::SerializedMessage> msg);
+
   //! Nothing else is necessary to receive messages
 };
 
@@ -7,6 +7,9 @@
  */
 
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <custom_topic_cpp/sub.hpp>
 
@@ -33,13 +36,50 @@ Sub::Sub()
   //!   CALLBACK_WRAPPER (with captures and argument placeholders)
   //!   (...)
   //! );
+  //! Content filters are expressed in the DDS SQL subset, e.g.:
+  //!   ros2 run custom_topic_cpp sub --ros-args
+  //!     -p filter_expression:="data LIKE %0" -p filter_parameters:="['''Hello 1%''']"
+  std::string filter_expression = this->declare_parameter("filter_expression", std::string(""));
+  std::vector<std::string> filter_parameters = this->declare_parameter(
+    "filter_parameters",
+    std::vector<std::string>{});
+
+  rclcpp::SubscriptionOptions sub_opts;
+  sub_opts.content_filter_options.filter_expression = filter_expression;
+  sub_opts.content_filter_options.expression_parameters = filter_parameters;
   subscriber_ = this->create_subscription<ros2_examples_interfaces::msg::String>(
     "/publisher_node/examples/test_topic",
     topic_qos,
     std::bind(
       &Sub::msg_callback,
       this,
-      std::placeholders::_1));
+      std::placeholders::_1),
+    sub_opts);
+
+  if (!filter_expression.empty()) {
+    if (subscriber_->is_cft_enabled()) {
+      RCLCPP_INFO(this->get_logger(), "Content filter: %s", filter_expression.c_str());
+    } else if (filter_.parse(filter_expression, filter_parameters)) {
+      //! The middleware can't filter, so we take samples serialized and test them here
+      subscriber_.reset();
+      subscriber_ = this->create_subscription<ros2_examples_interfaces::msg::String>(
+        "/publisher_node/examples/test_topic",
+        topic_qos,
+        std::bind(
+          &Sub::serialized_msg_callback,
+          this,
+          std::placeholders::_1));
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Content filtered topics not supported, filtering here: %s",
+        filter_expression.c_str());
+    } else {
+      RCLCPP_ERROR(
+        this->get_logger(),
+        "Content filtered topics not supported, and filter not supported here: %s",
+        filter_expression.c_str());
+    }
+  }
 
   //! Logging macro used to deliver a message to the logging subsystem, INFO level
   RCLCPP_INFO(this->get_logger(), "Subscriber initialized");
@@ -56,6 +96,21 @@ void Sub::msg_callback(const ros2_examples_interfaces::msg::String::SharedPtr ms
   RCLCPP_INFO(this->get_logger(), msg->data.c_str());
 }
 
+/**
+ * @brief Tests a serialized message against the filter, then echoes it if it matches.
+ *
+ * @param msg New serialized message.
+ */
+void Sub::serialized_msg_callback(const std::shared_ptr<rclcpp::SerializedMessage> msg)
+{
+  if (!filter_.matches(*msg)) {
+    return;
+  }
+  auto new_msg = std::make_shared<ros2_examples_interfaces::msg::String>();
+  serialization_.deserialize_message(msg.get(), new_msg.get());
+  msg_callback(new_msg);
+}
+
 int main(int argc, char ** argv)
 {
   //! This automatically creates the global context->DDS participant for this application
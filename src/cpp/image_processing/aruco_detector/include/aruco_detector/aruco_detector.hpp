@@ -27,34 +27,77 @@
 #ifndef STANIS_ARUCO_DETECTOR_HPP
 #define STANIS_ARUCO_DETECTOR_HPP
 
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <opencv2/aruco.hpp>
 #ifdef ARUCO_API_OLD
 #include <opencv2/aruco/dictionary.hpp>
 #endif
+#include <opencv2/calib3d.hpp>
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+
+#ifdef WITH_CUDA
+#include <opencv2/core/cuda.hpp>
+#include <opencv2/cudaimgproc.hpp>
+#endif
 #include <pthread.h>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include <geometry_msgs/msg/pose.hpp>
+#include <geometry_msgs/msg/pose_stamped.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <rmw/qos_profiles.h>
 
 #include <sensor_msgs/image_encodings.hpp>
+#include <sensor_msgs/msg/camera_info.hpp>
 #include <sensor_msgs/msg/image.hpp>
 //#include <stanis_interfaces/msg/pose.hpp>
 //#include <stanis_interfaces/msg/target.hpp>
+#include <std_msgs/msg/bool.hpp>
 #include <std_msgs/msg/empty.hpp>
+#include <std_msgs/msg/int32.hpp>
 
 #include <std_srvs/srv/set_bool.hpp>
 
+#include <image_transport/camera_common.hpp>
 #include <image_transport/image_transport.hpp>
 #include <image_transport/subscriber.hpp>
 
+#include <ros2_examples_interfaces/msg/detector_status.hpp>
+#include <ros2_examples_interfaces/msg/target.hpp>
+#include <ros2_examples_interfaces/msg/target_array.hpp>
+#include <ros2_usb_camera/msg/frame_trace.hpp>
+#include <ros2_usb_camera/msg/shm_frame.hpp>
+#include <usb_camera_driver/huge_page_allocator.hpp>
+#include <usb_camera_driver/shm_ring.hpp>
+
+#ifdef WITH_CUDA
+#include <usb_camera_driver/gpu_frame_hub.hpp>
+#endif
+
+#include <ros2_examples_headers/parameter_table/parameter_table.hpp>
+
+#include <aruco_detector/budget_scheduler.hpp>
+#include <aruco_detector/detector_pool.hpp>
+#include <aruco_detector/marker_map.hpp>
+#include <aruco_detector/target_batch.hpp>
+#include <aruco_detector/target_tracker.hpp>
+
 //#include <stanis_qos/aruco_detector_qos.hpp>
 //#include <stanis_qos/flight_control_qos.hpp>
 
 using namespace rcl_interfaces::msg;
+using namespace ros2_examples_interfaces::msg;
+using namespace ros2_usb_camera::msg;
 using namespace sensor_msgs::msg;
 //using namespace stanis_interfaces::msg;
 using namespace std_msgs::msg;
@@ -86,6 +129,186 @@ struct DronePose
   {}
 };
 
+/**
+ * Timestamped drone poses history, with a single writer and lock-free readers.
+ *
+ * Each entry is guarded by a sequence number, odd while it is being written, that
+ * also tells which write it holds: readers never block and detect entries
+ * overwritten while they were reading them.
+ */
+class PoseHistory
+{
+public:
+  static constexpr uint64_t capacity = 64;
+
+  /**
+   * @brief Adds a new pose, writer only.
+   *
+   * @param stamp_ns Pose timestamp, in nanoseconds, not older than the last one.
+   * @param pose New pose.
+   */
+  void push(int64_t stamp_ns, const DronePose & pose)
+  {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Entry & e = entries_[head % capacity];
+    uint64_t seq = e.seq.load(std::memory_order_relaxed);
+    e.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.stamp.store(stamp_ns, std::memory_order_relaxed);
+    const float values[6] = {pose.x, pose.y, pose.z, pose.roll, pose.pitch, pose.yaw};
+    for (int i = 0; i < 6; i++) {
+      e.values[i].store(values[i], std::memory_order_relaxed);
+    }
+    e.seq.store(seq + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Gets the pose at a given time, interpolating between the closest ones.
+   *
+   * Times outside the history get the closest pose available.
+   *
+   * @param stamp_ns Time of interest, in nanoseconds.
+   * @param pose Pose to populate.
+   * @return True if a pose was available, false otherwise.
+   */
+  bool at(int64_t stamp_ns, DronePose & pose) const
+  {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t oldest = head > capacity ? head - capacity : 0;
+    int64_t newer_stamp;
+    DronePose newer;
+    while (true) {
+      if (head == oldest) {
+        return false;
+      }
+      if (read(head - 1, newer_stamp, newer)) {
+        break;
+      }
+      head--;
+    }
+    if (stamp_ns >= newer_stamp) {
+      pose = newer;
+      return true;
+    }
+    for (uint64_t i = head - 1; i > oldest; i--) {
+      int64_t older_stamp;
+      DronePose older;
+      if (!read(i - 1, older_stamp, older)) {
+        break;
+      }
+      if (older_stamp <= stamp_ns) {
+        float t = newer_stamp > older_stamp ?
+          float(double(stamp_ns - older_stamp) / double(newer_stamp - older_stamp)) : 0.0f;
+        pose.x = older.x + t * (newer.x - older.x);
+        pose.y = older.y + t * (newer.y - older.y);
+        pose.z = older.z + t * (newer.z - older.z);
+        pose.roll = lerp_angle(older.roll, newer.roll, t);
+        pose.pitch = lerp_angle(older.pitch, newer.pitch, t);
+        pose.yaw = lerp_angle(older.yaw, newer.yaw, t);
+        return true;
+      }
+      newer_stamp = older_stamp;
+      newer = older;
+    }
+    pose = newer;
+    return true;
+  }
+
+private:
+  /* History entry */
+  struct Entry
+  {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<int64_t> stamp{0};
+    std::atomic<float> values[6]{};
+  };
+
+  /**
+   * @brief Reads an entry, checking that it still holds the requested write.
+   */
+  bool read(uint64_t index, int64_t & stamp, DronePose & pose) const
+  {
+    const Entry & e = entries_[index % capacity];
+    uint64_t expected = 2 * (index / capacity + 1);
+    for (int attempt = 0; attempt < 4; attempt++) {
+      uint64_t seq = e.seq.load(std::memory_order_acquire);
+      if (seq != expected) {
+        if (seq > expected) {
+          return false;
+        }
+        continue;
+      }
+      stamp = e.stamp.load(std::memory_order_relaxed);
+      pose.x = e.values[0].load(std::memory_order_relaxed);
+      pose.y = e.values[1].load(std::memory_order_relaxed);
+      pose.z = e.values[2].load(std::memory_order_relaxed);
+      pose.roll = e.values[3].load(std::memory_order_relaxed);
+      pose.pitch = e.values[4].load(std::memory_order_relaxed);
+      pose.yaw = e.values[5].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (e.seq.load(std::memory_order_relaxed) == seq) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Interpolates angles in [-PI +PI] along the shortest arc.
+   */
+  static float lerp_angle(float from, float to, float t)
+  {
+    float diff = std::remainder(to - from, 2.0f * float(M_PI));
+    return std::remainder(from + t * diff, 2.0f * float(M_PI));
+  }
+
+  Entry entries_[capacity];
+  std::atomic<uint64_t> head_{0};
+};
+
+/**
+ * Marker detector, built from node parameters.
+ */
+struct MarkerDetector
+{
+#ifdef ARUCO_API_OLD
+  cv::Ptr<cv::aruco::Dictionary> dictionary;
+  cv::Ptr<cv::aruco::DetectorParameters> parameters;
+#else
+  cv::aruco::ArucoDetector detector;
+#endif
+};
+
+/**
+ * Target tracked across frames.
+ */
+struct TrackedMarker
+{
+  int id = 0;
+  std::vector<cv::Point2f> corners;
+  cv::Point2f velocity{0.0f, 0.0f}; // pixels/frame
+};
+
+/**
+ * Camera intrinsics, from the driver's CameraInfo.
+ */
+struct CameraIntrinsics
+{
+  cv::Matx33d K;
+  cv::Mat D;
+};
+
+/**
+ * Last pose estimated for a marker, used to warm-start the next solve.
+ */
+struct MarkerPose
+{
+  cv::Vec3d rvec;
+  cv::Vec3d tvec;
+  uint64_t frame = 0;
+};
+
 /**
  * Main target detection node.
  */
@@ -96,6 +319,9 @@ public:
   virtual ~ArucoDetectorNode();
 
 private:
+  /* Benchmark harness, that drives processing stages directly */
+  friend struct PipelineBenchmark;
+
   /* Node initialization routines */
   void init_sync_primitives();
   void init_cgroups();
@@ -103,23 +329,87 @@ private:
   void init_subscriptions();
   void init_publishers();
   void init_services();
+  void init_large_buffers();
+
+  /* Deferred initialization and startup timing */
+  std::chrono::steady_clock::time_point init_time_;
+  std::thread warmup_thread_;
+  std::atomic<bool> ready_{false};
+  bool first_frame_processed_ = false;
+  void warmup_routine();
 
   /* Topic subscriptions callback groups */
   rclcpp::CallbackGroup::SharedPtr pose_cgroup_;
+  rclcpp::CallbackGroup::SharedPtr image_cgroup_;
+
+  /* Callback groups executors and threads, if this node runs its own */
+  rclcpp::executors::SingleThreadedExecutor::SharedPtr image_executor_;
+  rclcpp::executors::SingleThreadedExecutor::SharedPtr enable_executor_;
+  std::thread image_thread_;
+  std::thread enable_thread_;
+  std::atomic<bool> stop_cgroup_threads_{false};
+  void start_cgroup_threads();
+  void stop_cgroup_threads();
+  void cgroup_thread_routine(
+    rclcpp::Executor & executor,
+    const char * name,
+    int64_t cpu,
+    int64_t priority);
 
   /* Topic subscriptions */
   //rclcpp::Subscription<Pose>::SharedPtr pose_sub_;
+  rclcpp::Subscription<ShmFrame>::SharedPtr shm_camera_sub_;
+  rclcpp::Subscription<CameraInfo>::SharedPtr camera_info_sub_;
 
   /* image_transport subscriptions */
   image_transport::Subscriber camera_sub_;
 
   /* Topic subscriptions callbacks */
   void camera_callback(const Image::ConstSharedPtr & msg);
+  void shm_camera_callback(const ShmFrame::ConstSharedPtr & msg);
+  void camera_info_callback(const CameraInfo::ConstSharedPtr & msg);
+  void update_handoff_latency(const rclcpp::Time & stamp, const rclcpp::Time & receive_time);
+#ifdef WITH_CUDA
+  void gpu_frame_callback(const cv::cuda::GpuMat & frame, const rclcpp::Time & timestamp);
+#endif
+
+  /* Frame processing routines */
+  void process_image(const Image::ConstSharedPtr & msg);
+  void process_shm_frame(const ShmFrame::ConstSharedPtr & msg);
+
+  /* Detector thread or pool, and latest frame mailbox */
+  std::thread detector_thread_;
+  std::mutex mailbox_lock_;
+  std::condition_variable mailbox_cv_;
+  Image::ConstSharedPtr mailbox_image_;
+  ShmFrame::ConstSharedPtr mailbox_shm_;
+  rclcpp::Time mailbox_receive_time_;
+  bool stop_detector_ = false;
+  uint64_t dropped_frames_ = 0;
+  std::shared_ptr<DetectorPool> detector_pool_;
+  unsigned int detector_job_ = 0;
+  void detector_routine();
+  void detector_job_routine();
+  void set_worker_thread_attributes();
+  void set_thread_attributes(const char * name, int64_t cpu, int64_t priority);
+  void start_detector_thread();
+  void stop_detector_thread();
   //void pose_callback(const Pose::SharedPtr msg);
 
   /* Topic publishers */
   rclcpp::Publisher<Empty>::SharedPtr camera_rate_pub_;
-  //rclcpp::Publisher<Target>::SharedPtr target_pub_;
+  rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr map_pose_pub_;
+  rclcpp::Publisher<DetectorStatus>::SharedPtr status_pub_;
+  rclcpp::Publisher<Bool>::SharedPtr ready_pub_;
+  rclcpp::Publisher<TargetArray>::SharedPtr target_pub_;
+  rclcpp::Publisher<Int32>::SharedPtr target_img_rotation_pub_;
+  rclcpp::Publisher<ros2_usb_camera::msg::FrameTrace>::SharedPtr trace_pub_;
+
+  /* Pipeline latency tracing */
+  rclcpp::Time receive_time_;
+  void publish_trace(
+    const builtin_interfaces::msg::Time & stamp,
+    const rclcpp::Time & detected_time);
 
   /* image_transport publishers */
   image_transport::Publisher target_img_pub_;
@@ -137,74 +427,184 @@ private:
 
   /* Data buffers */
   cv::Mat camera_frame_;
+  cv::Mat gray_frame_;
+  cv::Mat hud_frame_;
+  cv::Mat pyramid_frame_;
+  cv::Mat refine_patch_;
+  USBCameraDriver::ShmRing shm_ring_;
+  USBCameraDriver::HugePageAllocator * large_buffer_allocator_ = nullptr;
+#ifdef WITH_CUDA
+  cv::cuda::GpuMat gpu_gray_frame_;
+  unsigned int gpu_consumer_ = 0;
+#endif
   std::vector<cv::Point> aruco_centers_;
+  TargetArray targets_msg_;
+  TargetBatch target_batch_;
+  std::vector<int> target_batch_indexes_;
+  std::vector<TrackedMarker> tracked_markers_;
+  int64_t frames_since_full_search_ = 0;
+  TargetTracker target_tracker_;
+  uint64_t predicted_frames_ = 0;
+  std::chrono::steady_clock::time_point last_hud_time_;
+  int32_t hud_rotation_ = -1; // deg, last one published
+
+  /* Detection time budget adaptation */
+  BudgetScheduler budget_scheduler_;
+  std::atomic<double> handoff_latency_{0.0}; // ms
+  std::chrono::steady_clock::time_point last_status_time_;
+
+  /* Marker detector */
+  std::shared_ptr<MarkerDetector> detector_;
+
+  /* Marker pose estimation */
+  std::shared_ptr<const CameraIntrinsics> intrinsics_;
+  std::unordered_map<int, MarkerPose> marker_poses_;
+  uint64_t pose_frame_count_ = 0;
+
+  /* Marker map localization, the map is guarded by the intrinsics lock */
+  std::shared_ptr<const MarkerMap> marker_map_;
+  MarkerPose map_pose_;
+  std::vector<uint8_t> map_inliers_;
 
   /* Internal state variables */
   uint8_t camera_id_ = 0;
   bool is_on_ = false;
-  DronePose pose_{};
+  PoseHistory pose_history_;
 
   /* Node parameters */
-  double aruco_side_ = 0.0;
-  double camera_offset_ = 0.0;
+  int64_t adaptive_thresh_win_size_max_ = 23;
+  int64_t adaptive_thresh_win_size_min_ = 3;
+  int64_t adaptive_thresh_win_size_step_ = 10;
+  std::string aruco_dictionary_ = "DICT_ARUCO_ORIGINAL";
+  bool camera_info_latched_ = false;
   std::string camera_topic_ = "";
+  bool cgroup_threads_ = false;
   int64_t centering_width_ = 0;
   bool compute_position_ = false;
+  std::string corner_refinement_ = "NONE";
+  bool deferred_init_ = false;
+  int64_t detector_pool_size_ = 0;
+  int64_t detector_priority_ = 0;
   double error_min_ = 0.0;
+  bool gpu_frames_ = false;
   int focal_length_ = 0;
+  int64_t image_thread_cpu_ = -1;
+  int64_t image_thread_priority_ = 0;
+  std::string marker_map_file_ = "";
+  double max_marker_perimeter_rate_ = 4.0;
+  double min_marker_perimeter_rate_ = 0.03;
+  double polygonal_approx_accuracy_rate_ = 0.03;
   bool rotate_image_ = false;
+  bool worker_thread_ = false;
+  int64_t worker_thread_cpu_ = -1;
+  int64_t worker_thread_priority_ = 0;
   std::vector<int64_t> target_ids_ = {};
+  std::bitset<1024> target_ids_filter_;
+  bool trace_ = false;
   std::string transport_ = "";
 
-  /* Node parameters descriptors */
-  ParameterDescriptor aruco_side_descriptor_;
-  ParameterDescriptor camera_offset_descriptor_;
-  ParameterDescriptor camera_topic_descriptor_;
-  ParameterDescriptor centering_width_descriptor_;
-  ParameterDescriptor compute_position_descriptor_;
-  ParameterDescriptor error_min_descriptor_;
-  ParameterDescriptor rotate_image_descriptor_;
-  ParameterDescriptor target_ids_descriptor_;
-  ParameterDescriptor transport_descriptor_;
-  ParameterDescriptor focal_length_descriptor_;
+  /* Detection parameters that can be changed at run time */
+  struct DetectionParams
+  {
+    double aruco_side = 0.0;
+    double camera_offset = 0.0;
+    double hud_rate = 0.0;
+    bool hud_rotation_hint = false;
+    double latency_budget = 0.0;
+    double map_max_error = 2.0;
+    bool pose_estimation = false;
+    double pyramid_scale = 1.0;
+    int64_t roi_full_search_period = 10;
+    double roi_padding = 0.5;
+    bool roi_tracking = false;
+    bool target_tracking = false;
+    double tracking_acceleration = 300.0;
+    double tracking_detection_rate = 10.0;
+    double tracking_max_uncertainty = 4.0;
+  };
+
+  /* Detection may run outside of the executor, so each frame works on a snapshot of these
+   * taken before it is processed, while updates are staged and then published as a whole */
+  DetectionParams staged_params_;
+  std::shared_ptr<const DetectionParams> detection_params_ = std::make_shared<const DetectionParams>();
+  std::shared_ptr<const DetectionParams> frame_params_ = detection_params_;
+
+  /* Node parameters table */
+  ROS2ParameterTable::ParameterTable params_table_;
 
   /* Synchronization primitives */
-  pthread_spinlock_t pose_lock_;
-
-  /* Parameters callback */
-  OnSetParametersCallbackHandle::SharedPtr on_set_params_chandle_;
-  SetParametersResult on_set_parameters_callback(
-    const std::vector<rclcpp::Parameter> & params);
+  pthread_spinlock_t detector_lock_;
+  pthread_spinlock_t intrinsics_lock_;
+  pthread_spinlock_t params_lock_;
 
   /* Utility routines */
+  bool async_detection() const;
+  std::shared_ptr<const DetectionParams> detection_params();
+  bool is_target(int id) const;
+  void init_detector();
+  void run_detector(
+    const MarkerDetector & detector,
+    const cv::Mat & image,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners);
+  void detect_targets(
+    const cv::Mat & frame,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners);
+  void publish_targets(
+    const cv::Size & frame_size,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners,
+    const builtin_interfaces::msg::Time & stamp);
+  bool estimate_target_pose(
+    int id,
+    const std::vector<cv::Point2f> & corners,
+    const CameraIntrinsics & intrinsics,
+    geometry_msgs::msg::Pose & pose);
+  bool estimate_map_pose(
+    const std::vector<int> & ids,
+    const std::vector<std::vector<cv::Point2f>> & corners,
+    const CameraIntrinsics & intrinsics,
+    const MarkerMap & map);
+  int refine_map_pose(
+    const std::vector<cv::Point3f> & object_points,
+    const std::vector<cv::Point2f> & image_points,
+    const CameraIntrinsics & intrinsics,
+    cv::Vec3d & rvec,
+    cv::Vec3d & tvec,
+    std::vector<uint8_t> & inliers,
+    double & error);
+  bool predict_targets(
+    int64_t stamp,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners);
+  void track_targets(
+    int64_t stamp,
+    const std::vector<int> & ids,
+    const std::vector<std::vector<cv::Point2f>> & corners);
+  void update_budget_scheduler(double detection_time);
+  bool hud_required();
+  void publish_hud(
+    cv::Mat & new_frame,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners,
+    const builtin_interfaces::msg::Time & stamp);
+  bool wrap_frame(
+    const std::string & encoding,
+    uint32_t height,
+    uint32_t width,
+    uint32_t step,
+    const uint8_t * data,
+    cv::Mat & frame);
+  void copy_hud_frame(const cv::Mat & frame);
   Image::SharedPtr frame_to_msg(cv::Mat & frame);
   float round_angle(float num, float prec);
-  float round_space(float num, float prec);
-  void declare_bool_parameter(
-    std::string && name,
-    bool default_val,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_double_parameter(
-    std::string && name,
-    double default_val, double from, double to, double step,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_int_parameter(
-    std::string && name,
-    int64_t default_val, int64_t from, int64_t to, int64_t step,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_int_array_parameter(
-    std::string && name,
-    std::vector<int64_t> && default_val, int64_t from, int64_t to, int64_t step,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_string_parameter(
-    std::string && name,
-    std::string && default_val,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
+  static void pose_to_msg(
+    const cv::Vec3d & rvec,
+    const cv::Vec3d & tvec,
+    geometry_msgs::msg::Pose & pose);
+  static bool is_aruco_dictionary(const std::string & name);
+  static bool is_corner_refinement_method(const std::string & name);
 };
 
 } // namespace ArucoDetector
@@ -0,0 +1,146 @@
+/**
+ * Aruco Detector detection time budget scheduler.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STANIS_ARUCO_DETECTOR_BUDGET_SCHEDULER_HPP
+#define STANIS_ARUCO_DETECTOR_BUDGET_SCHEDULER_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+namespace ArucoDetector
+{
+
+/**
+ * Degrades and restores detection quality to keep detection time in budget.
+ *
+ * Quality levels are: full detection, ROI search, downscaled ROI search, then
+ * downscaled ROI search on one frame every 2, 3, ... up to max_decimation. When
+ * frames are decimated, the budget grows with the frames skipped. Levels are held
+ * for a while after each change, and restored only when there is ample margin.
+ */
+struct BudgetScheduler
+{
+  enum Mode : uint8_t
+  {
+    FULL = 0,
+    ROI = 1,
+    DOWNSCALED = 2,
+    DECIMATED = 3
+  };
+
+  static constexpr unsigned int max_decimation = 8;
+  static constexpr unsigned int max_level = DECIMATED + max_decimation - 2;
+  static constexpr unsigned int degrade_hold = 10;  // frames
+  static constexpr unsigned int restore_hold = 30;  // frames
+  static constexpr double restore_margin = 0.5;
+  static constexpr double avg_gain = 0.2;
+  static constexpr double downscale = 0.5; // Maximum pyramid scale when downscaled
+
+  double budget = 0.0;   // ms, 0 disables the scheduler
+  double avg_time = 0.0; // ms
+  unsigned int level = 0;
+  unsigned int hold = 0;
+  unsigned int skipped = 0;
+
+  /**
+   * @brief Returns the active detection mode.
+   */
+  Mode mode() const
+  {
+    return Mode(std::min(level, unsigned(DECIMATED)));
+  }
+
+  /**
+   * @brief Returns the decimation factor: one frame out of this many is processed.
+   */
+  unsigned int decimation() const
+  {
+    return level < DECIMATED ? 1 : level - DECIMATED + 2;
+  }
+
+  /**
+   * @brief Checks whether the next frame should be processed.
+   */
+  bool admit()
+  {
+    if (++skipped >= decimation()) {
+      skipped = 0;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Resets the scheduler to full detection.
+   */
+  void reset()
+  {
+    avg_time = 0.0;
+    level = 0;
+    hold = 0;
+    skipped = 0;
+  }
+
+  /**
+   * @brief Accounts for a new detection time, adapting the level if needed.
+   *
+   * @param time Detection time of the last frame [ms].
+   * @return True if the level changed.
+   */
+  bool update(double time)
+  {
+    if (budget <= 0.0) {
+      if (level != 0) {
+        reset();
+        return true;
+      }
+      return false;
+    }
+    avg_time = avg_time == 0.0 ? time : avg_time + avg_gain * (time - avg_time);
+    if (hold > 0) {
+      hold--;
+      return false;
+    }
+    if (avg_time > budget * double(decimation()) && level < max_level) {
+      level++;
+      hold = degrade_hold;
+      return true;
+    }
+    if (level > 0) {
+      unsigned int restored_decimation = level - 1 < DECIMATED ? 1 : level - 1 - DECIMATED + 2;
+      if (avg_time < restore_margin * budget * double(restored_decimation)) {
+        level--;
+        hold = restore_hold;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+} // namespace ArucoDetector
+
+#endif // STANIS_ARUCO_DETECTOR_BUDGET_SCHEDULER_HPP
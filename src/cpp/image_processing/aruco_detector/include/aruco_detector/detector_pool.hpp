@@ -0,0 +1,92 @@
+/**
+ * Aruco Detector shared detection worker pool.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STANIS_ARUCO_DETECTOR_DETECTOR_POOL_HPP
+#define STANIS_ARUCO_DETECTOR_DETECTOR_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ArucoDetector
+{
+
+/**
+ * Process-wide pool of threads that run detection for many cameras.
+ *
+ * Each camera is a job that is posted whenever a new frame is available, and
+ * run by at most one worker at a time, so that detectors need no locking of
+ * their own. Pending jobs are picked by priority, then in posting order.
+ */
+class DetectorPool
+{
+public:
+  ~DetectorPool();
+
+  DetectorPool(const DetectorPool &) = delete;
+  DetectorPool & operator=(const DetectorPool &) = delete;
+
+  static std::shared_ptr<DetectorPool> get(size_t workers);
+
+  unsigned int add(int priority, std::function<void()> && routine);
+  void remove(unsigned int id);
+  void post(unsigned int id);
+
+  size_t workers() const;
+
+private:
+  explicit DetectorPool(size_t workers);
+
+  /* Camera job entry */
+  struct Entry
+  {
+    std::function<void()> routine;
+    int priority = 0;
+    uint64_t ticket = 0;
+    bool pending = false;
+    bool running = false;
+  };
+
+  void worker_routine();
+
+  std::vector<std::thread> workers_;
+  std::map<unsigned int, Entry> entries_;
+  unsigned int next_id_ = 0;
+  uint64_t next_ticket_ = 0;
+  bool stopped_ = false;
+  std::mutex lock_;
+  std::condition_variable cv_;
+};
+
+} // namespace ArucoDetector
+
+#endif // STANIS_ARUCO_DETECTOR_DETECTOR_POOL_HPP
@@ -0,0 +1,167 @@
+/**
+ * Aruco Detector marker map, from a layout file.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STANIS_ARUCO_DETECTOR_MARKER_MAP_HPP
+#define STANIS_ARUCO_DETECTOR_MARKER_MAP_HPP
+
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <opencv2/core.hpp>
+
+namespace ArucoDetector
+{
+
+/**
+ * Markers with known poses in a common map frame, e.g. a board or a field.
+ *
+ * Layout files list one marker per line, as
+ *
+ *   id side x y z roll pitch yaw
+ *
+ * with the side length and the position of the marker center in meters, and its
+ * orientation w.r.t. the map frame in radians (Z-Y-X Euler angles). Markers lie
+ * in their own XY plane, facing their Z axis. Empty lines and lines starting with
+ * '#' are skipped.
+ */
+struct MarkerMap
+{
+  /* Mapped marker */
+  struct Marker
+  {
+    double side = 0.0; // m
+    cv::Matx33d R;     // Orientation w.r.t. the map frame
+    cv::Vec3d t;       // m, center position in the map frame
+    std::array<cv::Point3f, 4> corners; // m, in the detector corner order, map frame
+  };
+
+  std::unordered_map<int, Marker> markers;
+
+  /**
+   * @brief Marker corners in the marker frame, in the order detected corners have.
+   *
+   * @param side Marker side length.
+   * @return Marker corners.
+   */
+  static std::array<cv::Point3f, 4> marker_corners(double side)
+  {
+    float h = float(side / 2.0);
+    return {cv::Point3f(-h, h, 0.0f), cv::Point3f(h, h, 0.0f),
+      cv::Point3f(h, -h, 0.0f), cv::Point3f(-h, -h, 0.0f)};
+  }
+
+  /**
+   * @brief Loads a layout file, replacing the current map.
+   *
+   * @param path Layout file path.
+   * @param error Description of the first error found.
+   * @return False if the file cannot be read or is malformed.
+   */
+  bool load(const std::string & path, std::string & error)
+  {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+      error = "cannot open " + path;
+      return false;
+    }
+
+    markers.clear();
+    std::string line;
+    for (int line_no = 1; std::getline(file, line); line_no++) {
+      std::istringstream fields(line);
+      std::string first;
+      if (!(fields >> first) || first[0] == '#') {
+        continue;
+      }
+
+      int id = 0;
+      double side, x, y, z, roll, pitch, yaw;
+      std::istringstream id_field(first);
+      if (!(id_field >> id) || !(fields >> side >> x >> y >> z >> roll >> pitch >> yaw) ||
+        side <= 0.0)
+      {
+        error = path + ":" + std::to_string(line_no) + ": malformed marker";
+        markers.clear();
+        return false;
+      }
+      if (markers.count(id)) {
+        error = path + ":" + std::to_string(line_no) + ": duplicate marker " + std::to_string(id);
+        markers.clear();
+        return false;
+      }
+
+      Marker & marker = markers[id];
+      marker.side = side;
+      marker.R = rotation(roll, pitch, yaw);
+      marker.t = cv::Vec3d(x, y, z);
+      std::array<cv::Point3f, 4> local = marker_corners(side);
+      for (int i = 0; i < 4; i++) {
+        cv::Vec3d corner = marker.R * cv::Vec3d(local[i].x, local[i].y, local[i].z) + marker.t;
+        marker.corners[i] = cv::Point3f(float(corner[0]), float(corner[1]), float(corner[2]));
+      }
+    }
+    if (markers.empty()) {
+      error = path + ": no markers";
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Looks up a marker.
+   *
+   * @param id Marker ID.
+   * @return Pointer to the marker, or nullptr if it is not mapped.
+   */
+  const Marker * find(int id) const
+  {
+    auto it = markers.find(id);
+    return it != markers.end() ? &(it->second) : nullptr;
+  }
+
+private:
+  /**
+   * @brief Builds a rotation matrix from Z-Y-X Euler angles.
+   */
+  static cv::Matx33d rotation(double roll, double pitch, double yaw)
+  {
+    double cr = std::cos(roll), sr = std::sin(roll);
+    double cp = std::cos(pitch), sp = std::sin(pitch);
+    double cy = std::cos(yaw), sy = std::sin(yaw);
+    return cv::Matx33d(
+      cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr,
+      sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr,
+      -sp, cp * sr, cp * cr);
+  }
+};
+
+} // namespace ArucoDetector
+
+#endif // STANIS_ARUCO_DETECTOR_MARKER_MAP_HPP
@@ -0,0 +1,182 @@
+/**
+ * Aruco Detector batched target geometry computations.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STANIS_ARUCO_DETECTOR_TARGET_BATCH_HPP
+#define STANIS_ARUCO_DETECTOR_TARGET_BATCH_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace ArucoDetector
+{
+
+/**
+ * Geometry of the targets detected in a frame, in structure-of-arrays layout.
+ *
+ * Kernels process all targets at once with branch-free single-precision loops,
+ * which compilers vectorize.
+ */
+struct TargetBatch
+{
+  size_t size = 0;
+
+  /* Marker corners [pixels] */
+  std::vector<float> x1, y1, x2, y2, x3, y3, x4, y4;
+
+  /* Horizontal center offset w.r.t. the marker diagonal length */
+  std::vector<float> offset_gain;
+
+  /* Marker centers [pixels], and whether they could be computed */
+  std::vector<float> xc, yc;
+  std::vector<uint8_t> valid;
+
+  /* Position errors w.r.t. the world NED reference frame [m] */
+  std::vector<float> err_x, err_y;
+
+  /**
+   * @brief Empties the batch, keeping its storage.
+   */
+  void clear()
+  {
+    size = 0;
+  }
+
+  /**
+   * @brief Adds a new target.
+   *
+   * @param corners Marker corners, clockwise from the top-left one.
+   * @param gain Horizontal center offset w.r.t. the marker diagonal length.
+   */
+  void push(const std::vector<cv::Point2f> & corners, float gain)
+  {
+    if (x1.size() <= size) {
+      size_t capacity = size + 1;
+      for (std::vector<float> * v :
+        {&x1, &y1, &x2, &y2, &x3, &y3, &x4, &y4, &offset_gain, &xc, &yc, &err_x, &err_y})
+      {
+        v->resize(capacity);
+      }
+      valid.resize(capacity);
+    }
+    x1[size] = corners[0].x;
+    y1[size] = corners[0].y;
+    x2[size] = corners[1].x;
+    y2[size] = corners[1].y;
+    x3[size] = corners[2].x;
+    y3[size] = corners[2].y;
+    x4[size] = corners[3].x;
+    y4[size] = corners[3].y;
+    offset_gain[size] = gain;
+    size++;
+  }
+};
+
+/**
+ * @brief Computes target centers as the intersections of marker diagonals.
+ *
+ * Diagonals are intersected relative to the first corner, so that single
+ * precision is enough at any image resolution.
+ *
+ * @param b Targets batch.
+ */
+inline void compute_target_centers(TargetBatch & b)
+{
+  const size_t n = b.size;
+  const float * x1 = b.x1.data();
+  const float * y1 = b.y1.data();
+  const float * x2 = b.x2.data();
+  const float * y2 = b.y2.data();
+  const float * x3 = b.x3.data();
+  const float * y3 = b.y3.data();
+  const float * x4 = b.x4.data();
+  const float * y4 = b.y4.data();
+  const float * gain = b.offset_gain.data();
+  float * xc = b.xc.data();
+  float * yc = b.yc.data();
+  uint8_t * valid = b.valid.data();
+
+  for (size_t i = 0; i < n; i++) {
+    float d1x = x3[i] - x1[i];
+    float d1y = y3[i] - y1[i];
+    float d2x = x4[i] - x2[i];
+    float d2y = y4[i] - y2[i];
+    float den = d1x * d2y - d1y * d2x;
+    bool ok = std::fabs(den) >= 1e-5f;
+    float t = ((x2[i] - x1[i]) * d2y - (y2[i] - y1[i]) * d2x) / (ok ? den : 1.0f);
+    float diag = std::sqrt((d1x * d1x + d1y * d1y) * 0.5f);
+    xc[i] = x1[i] + t * d1x + diag * gain[i];
+    yc[i] = y1[i] + t * d1y;
+    valid[i] = ok ? 1 : 0;
+  }
+}
+
+/**
+ * @brief Computes target position errors w.r.t. the world NED reference frame.
+ *
+ * Errors below the minimum are zeroed, and all are rounded down to centimeters
+ * to cut out numerical noise.
+ *
+ * @param b Targets batch, with centers already computed.
+ * @param cx Image center horizontal coordinate [pixels].
+ * @param cy Image center vertical coordinate [pixels].
+ * @param altitude Drone altitude [m].
+ * @param focal_length Camera focal length [pixels].
+ * @param error_min Minimum relevant error [m].
+ * @param yaw Drone yaw [rad].
+ */
+inline void compute_target_positions(
+  TargetBatch & b,
+  float cx, float cy,
+  float altitude, float focal_length, float error_min, float yaw)
+{
+  const size_t n = b.size;
+  const float * xc = b.xc.data();
+  const float * yc = b.yc.data();
+  float * err_x = b.err_x.data();
+  float * err_y = b.err_y.data();
+  const float k = -altitude / focal_length;
+  const float min2 = error_min * error_min;
+  const float c = std::cos(yaw);
+  const float s = std::sin(yaw);
+
+  for (size_t i = 0; i < n; i++) {
+    float ex = k * (xc[i] - cx);
+    float ey = k * (yc[i] - cy);
+    float keep = (ex * ex + ey * ey) <= min2 ? 0.0f : 1.0f;
+    ex *= keep;
+    ey *= keep;
+    err_x[i] = std::floor((ex * c - ey * s) * 100.0f) / 100.0f;
+    err_y[i] = std::floor((ex * s + ey * c) * 100.0f) / 100.0f;
+  }
+}
+
+} // namespace ArucoDetector
+
+#endif // STANIS_ARUCO_DETECTOR_TARGET_BATCH_HPP
@@ -0,0 +1,216 @@
+/**
+ * Aruco Detector predictive target tracker.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef STANIS_ARUCO_DETECTOR_TARGET_TRACKER_HPP
+#define STANIS_ARUCO_DETECTOR_TARGET_TRACKER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace ArucoDetector
+{
+
+/**
+ * Predicts marker corners between detections, with a constant-velocity Kalman
+ * filter per marker.
+ *
+ * All corner coordinates of a marker share the same motion and measurement
+ * models, hence the same covariance: each filter keeps a single 2x2 covariance
+ * and applies the same gain to every coordinate. Acceleration is modeled as
+ * white noise. Markers missing from a detection are dropped.
+ */
+struct TargetTracker
+{
+  static constexpr double measurement_noise = 1.0;       // px, corner detection accuracy
+  static constexpr double initial_velocity_noise = 1000.0; // px/s
+
+  /* Tracked marker */
+  struct Track
+  {
+    int id = 0;
+    std::array<cv::Point2f, 4> corners;  // px
+    std::array<cv::Point2f, 4> velocity; // px/s
+    int64_t stamp = 0; // ns
+    double p00 = 0.0;  // px^2
+    double p01 = 0.0;  // px^2/s
+    double p11 = 0.0;  // px^2/s^2
+  };
+
+  double acceleration = 300.0; // px/s^2, expected target acceleration in the image
+  std::vector<Track> tracks;
+  int64_t last_detection = 0; // ns
+
+  /**
+   * @brief Drops all tracks.
+   */
+  void reset()
+  {
+    tracks.clear();
+    last_detection = 0;
+  }
+
+  /**
+   * @brief Returns the largest corner position standard deviation predicted at a given time.
+   *
+   * @param stamp Time of interest [ns].
+   * @return Position uncertainty [px].
+   */
+  double uncertainty(int64_t stamp) const
+  {
+    double variance = 0.0;
+    for (const Track & track : tracks) {
+      double p00, p01, p11;
+      propagate(track, stamp, p00, p01, p11);
+      variance = std::max(variance, p00);
+    }
+    return std::sqrt(variance);
+  }
+
+  /**
+   * @brief Checks whether markers must be detected at a given time, or can be predicted.
+   *
+   * @param stamp Time of interest [ns].
+   * @param rate Detection rate [Hz].
+   * @param max_uncertainty Position uncertainty that triggers a detection [px].
+   * @return True if a detection is due.
+   */
+  bool detection_due(int64_t stamp, double rate, double max_uncertainty) const
+  {
+    return tracks.empty() ||
+      double(stamp - last_detection) * rate >= 1000000000.0 ||
+      uncertainty(stamp) > max_uncertainty;
+  }
+
+  /**
+   * @brief Updates tracks with new detections, starting new ones and dropping missing ones.
+   *
+   * @param stamp Detection time [ns].
+   * @param ids Marker IDs.
+   * @param corners Marker corners.
+   * @param tracked Predicate that selects the IDs to track.
+   */
+  template<typename Predicate>
+  void update(
+    int64_t stamp,
+    const std::vector<int> & ids,
+    const std::vector<std::vector<cv::Point2f>> & corners,
+    Predicate tracked)
+  {
+    std::vector<Track> updated;
+    for (size_t k = 0; k < ids.size(); k++) {
+      if (!tracked(ids[k]) || corners[k].size() != 4) {
+        continue;
+      }
+      auto duplicate = std::find_if(
+        updated.begin(), updated.end(),
+        [&](const Track & t) -> bool {return t.id == ids[k];});
+      if (duplicate != updated.end()) {
+        continue;
+      }
+      auto old = std::find_if(
+        tracks.begin(), tracks.end(),
+        [&](const Track & t) -> bool {return t.id == ids[k];});
+      Track track;
+      if (old == tracks.end()) {
+        // Position is measured, velocity unknown
+        track.id = ids[k];
+        std::copy(corners[k].begin(), corners[k].end(), track.corners.begin());
+        track.velocity.fill(cv::Point2f(0.0f, 0.0f));
+        track.p00 = measurement_noise * measurement_noise;
+        track.p11 = initial_velocity_noise * initial_velocity_noise;
+      } else {
+        // Predict, then correct with the measured corners
+        track = *old;
+        float dt = float(std::max(stamp - track.stamp, int64_t(0))) * 1e-9f;
+        double p00, p01, p11;
+        propagate(track, stamp, p00, p01, p11);
+        double s = p00 + measurement_noise * measurement_noise;
+        float k0 = float(p00 / s);
+        float k1 = float(p01 / s);
+        for (int i = 0; i < 4; i++) {
+          cv::Point2f predicted = track.corners[i] + track.velocity[i] * dt;
+          cv::Point2f innovation = corners[k][i] - predicted;
+          track.corners[i] = predicted + innovation * k0;
+          track.velocity[i] += innovation * k1;
+        }
+        track.p00 = (1.0 - double(k0)) * p00;
+        track.p01 = (1.0 - double(k0)) * p01;
+        track.p11 = p11 - double(k1) * p01;
+      }
+      track.stamp = stamp;
+      updated.push_back(track);
+    }
+    tracks = std::move(updated);
+    last_detection = stamp;
+  }
+
+  /**
+   * @brief Predicts the corners of all tracked markers at a given time.
+   *
+   * @param stamp Time of interest [ns].
+   * @param ids Marker IDs to populate.
+   * @param corners Marker corners to populate.
+   */
+  void predict(
+    int64_t stamp,
+    std::vector<int> & ids,
+    std::vector<std::vector<cv::Point2f>> & corners) const
+  {
+    ids.clear();
+    corners.clear();
+    for (const Track & track : tracks) {
+      float dt = float(std::max(stamp - track.stamp, int64_t(0))) * 1e-9f;
+      std::vector<cv::Point2f> predicted(4);
+      for (int i = 0; i < 4; i++) {
+        predicted[i] = track.corners[i] + track.velocity[i] * dt;
+      }
+      ids.push_back(track.id);
+      corners.push_back(std::move(predicted));
+    }
+  }
+
+private:
+  /**
+   * @brief Propagates the covariance of a track to a given time.
+   */
+  void propagate(const Track & track, int64_t stamp, double & p00, double & p01, double & p11) const
+  {
+    double dt = double(std::max(stamp - track.stamp, int64_t(0))) * 1e-9;
+    double q = acceleration * acceleration;
+    p00 = track.p00 + 2.0 * dt * track.p01 + dt * dt * track.p11 + q * dt * dt * dt * dt / 4.0;
+    p01 = track.p01 + dt * track.p11 + q * dt * dt * dt / 2.0;
+    p11 = track.p11 + q * dt * dt;
+  }
+};
+
+} // namespace ArucoDetector
+
+#endif // STANIS_ARUCO_DETECTOR_TARGET_TRACKER_HPP
@@ -0,0 +1,72 @@
+"""
+Multi-camera Aruco Detector launch file.
+
+Roberto Masocco <robmasocco@gmail.com>
+Lorenzo Bianchi <lnz.bnc@gmail.com>
+Intelligent Systems Lab <isl.torvergata@gmail.com>
+
+August 18, 2022
+"""
+
+import os
+from ament_index_python.packages import get_package_share_directory
+
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+
+
+def generate_launch_description():
+    """Builds a LaunchDescription for all Detectors, sharing a single detector pool"""
+    ld = LaunchDescription()
+
+    # Detectors, with their camera-specific parameters and pool priorities
+    detectors = [
+        ('bottom_detector', {
+            'camera_topic': '/usb_camera_driver/camera/image_color',
+            'focal_length': 500}, 2),
+        ('front_detector', {
+            'camera_topic': '/zed_mini_driver/left/image_rect_color'}, 1),
+        ('tilted_detector', {
+            'camera_topic': '/tilted_camera_driver/camera/image_rect_color'}, 0),
+    ]
+
+    # Create node descriptions
+    nodes = []
+    for name, camera_params, priority in detectors:
+        config_file = os.path.join(
+            get_package_share_directory('aruco_detector'),
+            'config',
+            name + '.yaml'
+        )
+        nodes.append(
+            ComposableNode(
+                package='aruco_detector',
+                plugin='ArucoDetector::ArucoDetectorNode',
+                name=name,
+                parameters=[
+                    config_file,
+                    camera_params,
+                    {
+                        'detector_pool_size': 3,
+                        'detector_priority': priority
+                    }
+                ]
+            )
+        )
+
+    # Create container launch description
+    container = ComposableNodeContainer(
+        name='aruco_detectors',
+        namespace='',
+        package='rclcpp_components',
+        executable='component_container_mt',
+        composable_node_descriptions=nodes,
+        emulate_tty=True,
+        output='both',
+        log_cmd=True
+    )
+
+    ld.add_action(container)
+
+    return ld
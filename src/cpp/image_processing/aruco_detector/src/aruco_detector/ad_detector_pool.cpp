@@ -0,0 +1,184 @@
+/**
+ * Aruco Detector shared detection worker pool.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <aruco_detector/detector_pool.hpp>
+
+namespace ArucoDetector
+{
+
+/**
+ * @brief Gets the process-wide detector pool, creating it if necessary.
+ *
+ * @param workers Number of worker threads, used only when the pool is created.
+ * @return Shared pointer to the pool, which lives as long as someone holds it.
+ */
+std::shared_ptr<DetectorPool> DetectorPool::get(size_t workers)
+{
+  static std::mutex instance_lock;
+  static std::weak_ptr<DetectorPool> instance;
+
+  std::lock_guard<std::mutex> lock(instance_lock);
+  std::shared_ptr<DetectorPool> pool = instance.lock();
+  if (pool == nullptr) {
+    pool = std::shared_ptr<DetectorPool>(new DetectorPool(workers));
+    instance = pool;
+  }
+  return pool;
+}
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param workers Number of worker threads.
+ */
+DetectorPool::DetectorPool(size_t workers)
+{
+  if (workers == 0) {
+    workers = 1;
+  }
+  for (size_t i = 0; i < workers; i++) {
+    workers_.emplace_back(&DetectorPool::worker_routine, this);
+  }
+}
+
+/**
+ * @brief Stops and joins the worker threads.
+ */
+DetectorPool::~DetectorPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread & worker : workers_) {
+    worker.join();
+  }
+}
+
+/**
+ * @brief Adds a new camera job.
+ *
+ * @param priority Job priority, higher values are served first.
+ * @param routine Job routine, processing the latest frame of a camera.
+ * @return Job ID.
+ */
+unsigned int DetectorPool::add(int priority, std::function<void()> && routine)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  Entry entry;
+  entry.routine = std::move(routine);
+  entry.priority = priority;
+  unsigned int id = next_id_++;
+  entries_.emplace(id, std::move(entry));
+  return id;
+}
+
+/**
+ * @brief Removes a job, waiting for it to complete if it is running.
+ *
+ * @param id Job ID.
+ */
+void DetectorPool::remove(unsigned int id)
+{
+  std::unique_lock<std::mutex> lock(lock_);
+  if (entries_.find(id) == entries_.end()) {
+    return;
+  }
+  cv_.wait(lock, [this, id] {return !entries_.at(id).running;});
+  entries_.erase(id);
+}
+
+/**
+ * @brief Marks a job as pending, i.e. a new frame is available for it.
+ *
+ * Posting an already pending job does nothing: it will run once, on the
+ * latest frame.
+ *
+ * @param id Job ID.
+ */
+void DetectorPool::post(unsigned int id)
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(id);
+    if (it == entries_.end() || it->second.pending) {
+      return;
+    }
+    it->second.pending = true;
+    it->second.ticket = next_ticket_++;
+  }
+  cv_.notify_one();
+}
+
+/**
+ * @brief Returns the number of worker threads.
+ *
+ * @return Pool size.
+ */
+size_t DetectorPool::workers() const
+{
+  return workers_.size();
+}
+
+/**
+ * @brief Runs pending jobs, by priority, until the pool is destroyed.
+ */
+void DetectorPool::worker_routine()
+{
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopped_) {
+    // Look for the pending job with the highest priority, posted first
+    Entry * next = nullptr;
+    for (auto & e : entries_) {
+      Entry & entry = e.second;
+      if (!entry.pending || entry.running) {
+        continue;
+      }
+      if (next == nullptr ||
+        entry.priority > next->priority ||
+        (entry.priority == next->priority && entry.ticket < next->ticket))
+      {
+        next = &entry;
+      }
+    }
+    if (next == nullptr) {
+      cv_.wait(lock);
+      continue;
+    }
+
+    // Run the job outside the lock, it might be posted again in the meantime
+    next->pending = false;
+    next->running = true;
+    lock.unlock();
+    next->routine();
+    lock.lock();
+    next->running = false;
+    cv_.notify_all();
+  }
+}
+
+} // namespace ArucoDetector
@@ -41,15 +41,63 @@ void ArucoDetectorNode::enable_callback(
 {
   if (req->data) {
     if (!is_on_) {
-      camera_sub_ = image_transport::create_subscription(
-        this,
-        camera_topic_,
+      target_tracker_.reset();
+      predicted_frames_ = 0;
+      if (async_detection()) {
+        start_detector_thread();
+      }
+      // Image callbacks run in their own group, if this node has a thread for it
+      rclcpp::SubscriptionOptions image_sub_opts;
+      image_sub_opts.callback_group = image_cgroup_;
+      // Camera intrinsics, for marker pose estimation (latched ones reach late joiners)
+      camera_info_sub_ = this->create_subscription<CameraInfo>(
+        image_transport::getCameraInfoTopic(camera_topic_),
+        camera_info_latched_ ?
+        rclcpp::QoS(1).reliable().transient_local() :
+        rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(rmw_qos_profile_sensor_data)),
         std::bind(
-          &ArucoDetectorNode::camera_callback,
+          &ArucoDetectorNode::camera_info_callback,
           this,
           std::placeholders::_1),
-        transport_,
-        rmw_qos_profile_sensor_data);
+        image_sub_opts);
+#ifdef WITH_CUDA
+      if (gpu_frames_) {
+        // Frames come from a camera driver in this process, and never leave the GPU
+        gpu_consumer_ = USBCameraDriver::GpuFrameHub::instance().subscribe(
+          this->get_node_topics_interface()->resolve_topic_name(camera_topic_),
+          std::bind(
+            &ArucoDetectorNode::gpu_frame_callback,
+            this,
+            std::placeholders::_1,
+            std::placeholders::_2));
+      } else if (transport_ == "shm") {
+#else
+      if (gpu_frames_) {
+        RCLCPP_ERROR(this->get_logger(), "gpu_frames requires a CUDA build, ignored");
+      }
+      if (transport_ == "shm") {
+#endif
+        // Frames come from a camera driver in another process through shared memory
+        shm_camera_sub_ = this->create_subscription<ShmFrame>(
+          camera_topic_ + "/shm",
+          rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(rmw_qos_profile_sensor_data)),
+          std::bind(
+            &ArucoDetectorNode::shm_camera_callback,
+            this,
+            std::placeholders::_1),
+          image_sub_opts);
+      } else {
+        camera_sub_ = image_transport::create_subscription(
+          this,
+          camera_topic_,
+          std::bind(
+            &ArucoDetectorNode::camera_callback,
+            this,
+            std::placeholders::_1),
+          transport_,
+          rmw_qos_profile_sensor_data,
+          image_sub_opts);
+      }
       is_on_ = true;
       RCLCPP_WARN(this->get_logger(), "Detector ACTIVATED");
     }
@@ -58,8 +106,22 @@ void ArucoDetectorNode::enable_callback(
   } else {
     if (is_on_) {
       camera_sub_.shutdown();
+      shm_camera_sub_.reset();
+      camera_info_sub_.reset();
+#ifdef WITH_CUDA
+      if (gpu_frames_) {
+        USBCameraDriver::GpuFrameHub::instance().unsubscribe(gpu_consumer_);
+      }
+#endif
+      if (async_detection()) {
+        stop_detector_thread();
+      }
+      shm_ring_.close();
       is_on_ = false;
       RCLCPP_WARN(this->get_logger(), "Detector DEACTIVATED");
+      if (detection_params()->target_tracking) {
+        RCLCPP_INFO(this->get_logger(), "Targets predicted in %lu frames", predicted_frames_);
+      }
     }
     resp->set__success(true);
     resp->set__message("");
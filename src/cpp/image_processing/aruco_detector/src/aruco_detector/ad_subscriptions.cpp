@@ -24,149 +24,1021 @@
  * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
 #include <aruco_detector/aruco_detector.hpp>
 
 namespace ArucoDetector
 {
 
 /**
- * @brief Searches targets in a new image.
+ * @brief Searches targets in a new image, or hands it to the detector thread or pool.
  *
  * @param msg Image message to parse.
  */
 void ArucoDetectorNode::camera_callback(const Image::ConstSharedPtr & msg)
 {
-  // Get current drone pose
-  pthread_spin_lock(&(this->pose_lock_));
-  DronePose current_pose = pose_;
-  pthread_spin_unlock(&(this->pose_lock_));
-  double altitude = current_pose.z;
-  double yaw = current_pose.yaw;
+  rclcpp::Time receive_time = this->get_clock()->now();
+  update_handoff_latency(msg->header.stamp, receive_time);
+  if (async_detection()) {
+    {
+      std::lock_guard<std::mutex> lock(mailbox_lock_);
+      if (mailbox_image_ != nullptr || mailbox_shm_ != nullptr) {
+        dropped_frames_++;
+      }
+      mailbox_receive_time_ = receive_time;
+      mailbox_image_ = msg;
+      mailbox_shm_.reset();
+      mailbox_cv_.notify_one();
+    }
+    if (detector_pool_ != nullptr) {
+      detector_pool_->post(detector_job_);
+    }
+    return;
+  }
+  receive_time_ = receive_time;
+  process_image(msg);
+}
+
+/**
+ * @brief Searches targets in a new shared memory frame, or hands it to the detector thread or pool.
+ *
+ * @param msg Shared memory frame descriptor to parse.
+ */
+void ArucoDetectorNode::shm_camera_callback(const ShmFrame::ConstSharedPtr & msg)
+{
+  rclcpp::Time receive_time = this->get_clock()->now();
+  update_handoff_latency(msg->header.stamp, receive_time);
+  if (async_detection()) {
+    {
+      std::lock_guard<std::mutex> lock(mailbox_lock_);
+      if (mailbox_image_ != nullptr || mailbox_shm_ != nullptr) {
+        dropped_frames_++;
+      }
+      mailbox_receive_time_ = receive_time;
+      mailbox_shm_ = msg;
+      mailbox_image_.reset();
+      mailbox_cv_.notify_one();
+    }
+    if (detector_pool_ != nullptr) {
+      detector_pool_->post(detector_job_);
+    }
+    return;
+  }
+  receive_time_ = receive_time;
+  process_shm_frame(msg);
+}
+
+#ifdef WITH_CUDA
+/**
+ * @brief Converts a GPU-resident frame to grayscale, then searches targets in it.
+ *
+ * Only the grayscale frame is downloaded, which is all detection needs, then it
+ * goes through the same path as frames received from topics. This runs in the
+ * camera sampling thread, so detection should be moved out of it with
+ * worker_thread or detector_pool_size.
+ *
+ * @param frame Rectified frame, valid only during this call.
+ * @param timestamp Capture timestamp.
+ */
+void ArucoDetectorNode::gpu_frame_callback(
+  const cv::cuda::GpuMat & frame,
+  const rclcpp::Time & timestamp)
+{
+  auto msg = std::make_shared<Image>();
+  msg->header.set__stamp(timestamp);
+  msg->set__width(frame.cols);
+  msg->set__height(frame.rows);
+  msg->set__encoding(sensor_msgs::image_encodings::MONO8);
+  msg->set__step(frame.cols);
+  msg->set__is_bigendian(false);
+  msg->data.resize(size_t(msg->step) * size_t(frame.rows));
+  cv::Mat gray_view(frame.rows, frame.cols, CV_8UC1, msg->data.data());
+  if (frame.channels() == 1) {
+    frame.download(gray_view);
+  } else {
+    cv::cuda::cvtColor(frame, gpu_gray_frame_, cv::COLOR_BGR2GRAY);
+    gpu_gray_frame_.download(gray_view);
+  }
+  camera_callback(msg);
+}
+#endif
+
+/**
+ * @brief Updates camera intrinsics used for marker pose estimation.
+ *
+ * Rectified images come with no distortion, since the driver rectifies them
+ * keeping the original camera matrix.
+ *
+ * @param msg CameraInfo message to parse.
+ */
+void ArucoDetectorNode::camera_info_callback(const CameraInfo::ConstSharedPtr & msg)
+{
+  cv::Matx33d K(msg->k.data());
+  bool rectified = camera_topic_.find("image_rect") != std::string::npos;
+
+  // Skip the update if nothing changed, which is almost always the case
+  pthread_spin_lock(&(this->intrinsics_lock_));
+  std::shared_ptr<const CameraIntrinsics> current = intrinsics_;
+  pthread_spin_unlock(&(this->intrinsics_lock_));
+  if (current != nullptr && current->K == K &&
+    (rectified || (size_t(current->D.total()) == msg->d.size() &&
+    std::equal(msg->d.begin(), msg->d.end(), current->D.ptr<double>()))))
+  {
+    return;
+  }
+
+  auto intrinsics = std::make_shared<CameraIntrinsics>();
+  intrinsics->K = K;
+  if (!rectified && !msg->d.empty()) {
+    intrinsics->D = cv::Mat(msg->d, true).reshape(1, 1);
+  }
+  pthread_spin_lock(&(this->intrinsics_lock_));
+  intrinsics_ = intrinsics;
+  pthread_spin_unlock(&(this->intrinsics_lock_));
+  RCLCPP_INFO(this->get_logger(), "Camera intrinsics updated");
+}
+
+/**
+ * @brief Updates the average delay between frame capture and its reception here.
+ *
+ * @param stamp Capture timestamp of the frame just received.
+ * @param receive_time Time the frame was received at.
+ */
+void ArucoDetectorNode::update_handoff_latency(
+  const rclcpp::Time & stamp,
+  const rclcpp::Time & receive_time)
+{
+  double latency = (receive_time - stamp).seconds() * 1000.0;
+  if (latency < 0.0 || latency > 1000.0) {
+    // Stamps from another clock, or simulated ones
+    return;
+  }
+  double avg = handoff_latency_.load();
+  handoff_latency_.store(avg == 0.0 ? latency : avg + 0.1 * (latency - avg));
+}
+
+/**
+ * @brief Sets scheduling policy, priority and CPU affinity of the calling detector thread.
+ */
+void ArucoDetectorNode::set_worker_thread_attributes()
+{
+  set_thread_attributes("Detector", worker_thread_cpu_, worker_thread_priority_);
+}
+
+/**
+ * @brief Sets scheduling policy, priority and CPU affinity of the calling thread.
+ *
+ * @param name Thread name, for log messages.
+ * @param cpu CPU to run on, -1 for any.
+ * @param priority SCHED_FIFO priority, 0 for normal scheduling.
+ */
+void ArucoDetectorNode::set_thread_attributes(const char * name, int64_t cpu, int64_t priority)
+{
+  if (priority > 0) {
+    struct sched_param param;
+    param.sched_priority = int(priority);
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Failed to set %s thread SCHED_FIFO priority %ld: %s",
+        name,
+        priority,
+        strerror(ret));
+    } else {
+      RCLCPP_INFO(
+        this->get_logger(),
+        "%s thread priority: SCHED_FIFO %ld",
+        name,
+        priority);
+    }
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(int(cpu), &cpus);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    if (ret) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Failed to set %s thread affinity to CPU %ld: %s",
+        name,
+        cpu,
+        strerror(ret));
+    } else {
+      RCLCPP_INFO(this->get_logger(), "%s thread affinity: CPU %ld", name, cpu);
+    }
+  }
+}
+
+/**
+ * @brief Spawns the threads that run image and enable service callbacks.
+ *
+ * Each group gets its own executor, so image processing never waits for
+ * service calls, and neither waits for the executor this node was added to.
+ * The pose group goes with the image one, since it feeds it.
+ */
+void ArucoDetectorNode::start_cgroup_threads()
+{
+  stop_cgroup_threads_.store(false);
+
+  image_executor_ = std::make_shared<rclcpp::executors::SingleThreadedExecutor>();
+  image_executor_->add_callback_group(image_cgroup_, this->get_node_base_interface());
+  image_executor_->add_callback_group(pose_cgroup_, this->get_node_base_interface());
+  image_thread_ = std::thread(
+    &ArucoDetectorNode::cgroup_thread_routine,
+    this,
+    std::ref(*image_executor_),
+    "Image",
+    image_thread_cpu_,
+    image_thread_priority_);
+
+  enable_executor_ = std::make_shared<rclcpp::executors::SingleThreadedExecutor>();
+  enable_executor_->add_callback_group(enable_cgroup_, this->get_node_base_interface());
+  enable_thread_ = std::thread(
+    &ArucoDetectorNode::cgroup_thread_routine,
+    this,
+    std::ref(*enable_executor_),
+    "Enable",
+    int64_t(-1),
+    int64_t(0));
+}
+
+/**
+ * @brief Stops the callback groups threads, waiting for running callbacks.
+ */
+void ArucoDetectorNode::stop_cgroup_threads()
+{
+  stop_cgroup_threads_.store(true);
+  if (image_executor_ != nullptr) {
+    image_executor_->cancel();
+  }
+  if (enable_executor_ != nullptr) {
+    enable_executor_->cancel();
+  }
+  if (image_thread_.joinable()) {
+    image_thread_.join();
+  }
+  if (enable_thread_.joinable()) {
+    enable_thread_.join();
+  }
+  image_executor_.reset();
+  enable_executor_.reset();
+}
+
+/**
+ * @brief Callback group thread routine: spins its executor until stopped.
+ *
+ * Spinning one event at a time, instead of calling spin, makes stopping safe
+ * even before the thread gets to wait for the first one.
+ *
+ * @param executor Executor to spin.
+ * @param name Thread name, for log messages.
+ * @param cpu CPU to run on, -1 for any.
+ * @param priority SCHED_FIFO priority, 0 for normal scheduling.
+ */
+void ArucoDetectorNode::cgroup_thread_routine(
+  rclcpp::Executor & executor,
+  const char * name,
+  int64_t cpu,
+  int64_t priority)
+{
+  set_thread_attributes(name, cpu, priority);
+  while (rclcpp::ok() && !stop_cgroup_threads_.load()) {
+    executor.spin_once(std::chrono::milliseconds(100));
+  }
+}
+
+/**
+ * @brief Detector thread routine: processes only the latest frame received.
+ */
+void ArucoDetectorNode::detector_routine()
+{
+  set_worker_thread_attributes();
+  while (true) {
+    Image::ConstSharedPtr image_msg;
+    ShmFrame::ConstSharedPtr shm_msg;
+    {
+      std::unique_lock<std::mutex> lock(mailbox_lock_);
+      mailbox_cv_.wait(
+        lock,
+        [this]() {
+          return stop_detector_ || mailbox_image_ != nullptr || mailbox_shm_ != nullptr;
+        });
+      if (stop_detector_) {
+        break;
+      }
+      image_msg.swap(mailbox_image_);
+      shm_msg.swap(mailbox_shm_);
+      receive_time_ = mailbox_receive_time_;
+    }
+    if (image_msg != nullptr) {
+      process_image(image_msg);
+    } else {
+      process_shm_frame(shm_msg);
+    }
+  }
+}
+
+/**
+ * @brief Detector pool job: processes the latest frame received, if any.
+ */
+void ArucoDetectorNode::detector_job_routine()
+{
+  Image::ConstSharedPtr image_msg;
+  ShmFrame::ConstSharedPtr shm_msg;
+  {
+    std::lock_guard<std::mutex> lock(mailbox_lock_);
+    image_msg.swap(mailbox_image_);
+    shm_msg.swap(mailbox_shm_);
+    receive_time_ = mailbox_receive_time_;
+  }
+  if (image_msg != nullptr) {
+    process_image(image_msg);
+  } else if (shm_msg != nullptr) {
+    process_shm_frame(shm_msg);
+  }
+}
+
+/**
+ * @brief Spawns the detector thread, or joins the process-wide detector pool.
+ */
+void ArucoDetectorNode::start_detector_thread()
+{
+  stop_detector_ = false;
+  dropped_frames_ = 0;
+  if (detector_pool_size_ > 0) {
+    detector_pool_ = DetectorPool::get(size_t(detector_pool_size_));
+    detector_job_ = detector_pool_->add(
+      int(detector_priority_),
+      std::bind(&ArucoDetectorNode::detector_job_routine, this));
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Joined detector pool (%lu workers, priority %ld)",
+      detector_pool_->workers(),
+      detector_priority_);
+    return;
+  }
+  detector_thread_ = std::thread(&ArucoDetectorNode::detector_routine, this);
+}
+
+/**
+ * @brief Stops the detector thread or leaves the detector pool, discarding any pending frame.
+ */
+void ArucoDetectorNode::stop_detector_thread()
+{
+  {
+    std::lock_guard<std::mutex> lock(mailbox_lock_);
+    stop_detector_ = true;
+    mailbox_image_.reset();
+    mailbox_shm_.reset();
+    mailbox_cv_.notify_one();
+  }
+  if (detector_pool_ != nullptr) {
+    detector_pool_->remove(detector_job_);
+    detector_pool_.reset();
+  } else {
+    detector_thread_.join();
+  }
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Detector thread stopped (%lu stale frames dropped)",
+    dropped_frames_);
+}
+
+/**
+ * @brief Searches targets in a new image.
+ *
+ * @param msg Image message to parse.
+ */
+void ArucoDetectorNode::process_image(const Image::ConstSharedPtr & msg)
+{
+  frame_params_ = detection_params();
+
+  // Frames are dropped until the marker detector is ready
+  if (!ready_.load(std::memory_order_acquire) || !budget_scheduler_.admit()) {
+    return;
+  }
 
   // Look for targets in the image
-  cv::Mat new_frame(
-    msg->height,
-    msg->width,
-    CV_8UC3,
-    (void *)(msg->data.data()));
+  cv::Mat new_frame;
+  if (!wrap_frame(msg->encoding, msg->height, msg->width, msg->step, msg->data.data(), new_frame)) {
+    return;
+  }
 
-  // Detect targets
   std::vector<int> ids;
   std::vector<std::vector<cv::Point2f>> corners;
-  cv::aruco::detectMarkers(
-    new_frame,
+  int64_t stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+  if (!predict_targets(stamp, ids, corners)) {
+    detect_targets(new_frame, ids, corners);
+    track_targets(stamp, ids, corners);
+  }
+  publish_targets(new_frame.size(), ids, corners, msg->header.stamp);
+
+  // Draw the HUD on a private copy, since the message buffer is shared
+  if (hud_required()) {
+    copy_hud_frame(new_frame);
+    publish_hud(hud_frame_, ids, corners, msg->header.stamp);
+  }
+}
+
+/**
+ * @brief Searches targets in a new image stored in shared memory.
+ *
+ * Detection runs on the frame in place; results are discarded if the camera
+ * driver overwrote it in the meantime. The frame is copied only to draw the HUD.
+ *
+ * @param msg Shared memory frame descriptor to parse.
+ */
+void ArucoDetectorNode::process_shm_frame(const ShmFrame::ConstSharedPtr & msg)
+{
+  frame_params_ = detection_params();
+
+  // Frames are dropped until the marker detector is ready
+  if (!ready_.load(std::memory_order_acquire) || !budget_scheduler_.admit()) {
+    return;
+  }
+
+  // Predicted targets need no pixels, unless the HUD is drawn
+  std::vector<int> ids;
+  std::vector<std::vector<cv::Point2f>> corners;
+  int64_t stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+  bool predicted = predict_targets(stamp, ids, corners);
+  bool hud = hud_required();
+  if (predicted && !hud) {
+    publish_targets(cv::Size(int(msg->width), int(msg->height)), ids, corners, msg->header.stamp);
+    return;
+  }
+
+  // Map the frames ring, again if the driver has recreated it
+  if (shm_ring_.name() != msg->segment && !shm_ring_.open(msg->segment)) {
+    RCLCPP_ERROR_THROTTLE(
+      this->get_logger(),
+      *this->get_clock(),
+      1000,
+      "Failed to open shared memory segment %s",
+      msg->segment.c_str());
+    return;
+  }
+  const uint8_t * data = shm_ring_.read(
+    msg->slot,
+    msg->seq,
+    size_t(msg->step) * size_t(msg->height));
+  if (data == nullptr) {
+    return;
+  }
+
+  // Look for targets in the image
+  cv::Mat shm_view;
+  if (!wrap_frame(msg->encoding, msg->height, msg->width, msg->step, data, shm_view)) {
+    return;
+  }
+
+  if (!predicted) {
+    detect_targets(shm_view, ids, corners);
+  }
+  if (hud) {
+    copy_hud_frame(shm_view);
+  }
+  if (!shm_ring_.valid(msg->slot, msg->seq)) {
+    RCLCPP_WARN_THROTTLE(
+      this->get_logger(),
+      *this->get_clock(),
+      1000,
+      "Shared memory frame overwritten while in use, dropped");
+    return;
+  }
+  if (!predicted) {
+    track_targets(stamp, ids, corners);
+  }
+  publish_targets(shm_view.size(), ids, corners, msg->header.stamp);
+  if (hud) {
+    publish_hud(hud_frame_, ids, corners, msg->header.stamp);
+  }
+}
+
+/**
+ * @brief Runs a marker detector on an image.
+ *
+ * In coarse-to-fine mode, candidates are detected on a downscaled copy of the
+ * image, then their corners are refined with sub-pixel accuracy only on small
+ * full-resolution patches around them.
+ *
+ * @param detector Marker detector to use.
+ * @param image Image to search.
+ * @param ids Marker IDs to populate.
+ * @param corners Marker corners to populate.
+ */
+void ArucoDetectorNode::run_detector(
+  const MarkerDetector & detector,
+  const cv::Mat & image,
+  std::vector<int> & ids,
+  std::vector<std::vector<cv::Point2f>> & corners)
+{
+  const cv::Mat * search_image = &image;
+  double scale = frame_params_->pyramid_scale;
+  if (budget_scheduler_.mode() >= BudgetScheduler::DOWNSCALED) {
+    scale = std::min(scale, BudgetScheduler::downscale);
+  }
+  bool coarse = scale < 1.0;
+  if (coarse) {
+    cv::resize(image, pyramid_frame_, cv::Size(), scale, scale, cv::INTER_AREA);
+    search_image = &pyramid_frame_;
+  }
+
 #ifdef ARUCO_API_OLD
-    cv::aruco::getPredefinedDictionary(cv::aruco::DICT_ARUCO_ORIGINAL),
+  cv::aruco::detectMarkers(
+    *search_image,
+    detector.dictionary,
+    corners,
+    ids,
+    detector.parameters);
 #else
-    std::make_shared<cv::aruco::Dictionary>(
-      cv::aruco::getPredefinedDictionary(
-        cv::aruco::PredefinedDictionaryType::DICT_ARUCO_ORIGINAL)),
+  detector.detector.detectMarkers(*search_image, corners, ids);
 #endif
-    corners,
-    ids);
+  if (!coarse) {
+    return;
+  }
 
-  // Publish information about detected targets
-  aruco_centers_.clear();
-  for (int k = 0; k < int(ids.size()); k++) {
-    if (std::find(target_ids_.begin(), target_ids_.end(), ids[k]) == target_ids_.end()) {
+  // Bring corners back to full resolution, then refine them locally
+  float inv_scale = float(1.0 / scale);
+  int win = int(std::ceil(inv_scale)) + 2;
+  cv::Rect image_rect(0, 0, image.cols, image.rows);
+  for (size_t k = 0; k < corners.size(); k++) {
+    std::vector<cv::Point2f> & marker_corners = corners[k];
+    for (cv::Point2f & c : marker_corners) {
+      c = (c + cv::Point2f(0.5f, 0.5f)) * inv_scale - cv::Point2f(0.5f, 0.5f);
+    }
+    if (!is_target(ids[k])) {
+      // Not worth refining
       continue;
     }
+    cv::Rect box = cv::boundingRect(marker_corners);
+    cv::Rect patch_rect =
+      cv::Rect(box.x - 2 * win, box.y - 2 * win, box.width + 4 * win, box.height + 4 * win) &
+      image_rect;
+    if (patch_rect.area() == 0) {
+      continue;
+    }
+    if (image.channels() == 1) {
+      image(patch_rect).copyTo(refine_patch_);
+    } else {
+      cv::cvtColor(image(patch_rect), refine_patch_, cv::COLOR_BGR2GRAY);
+    }
+    cv::Point2f offset(float(patch_rect.x), float(patch_rect.y));
+    for (cv::Point2f & c : marker_corners) {
+      c -= offset;
+    }
+    cv::cornerSubPix(
+      refine_patch_,
+      marker_corners,
+      cv::Size(win, win),
+      cv::Size(-1, -1),
+      cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01));
+    for (cv::Point2f & c : marker_corners) {
+      c += offset;
+    }
+  }
+}
+
+/**
+ * @brief Detects markers in an image.
+ *
+ * In tracking mode, the search is restricted to padded regions around the
+ * targets found in the previous frame, shifted by their last motion. The whole
+ * frame is searched periodically, and whenever a tracked target is lost.
+ *
+ * @param frame Image to search.
+ * @param ids Marker IDs to populate.
+ * @param corners Marker corners to populate.
+ */
+void ArucoDetectorNode::detect_targets(
+  const cv::Mat & frame,
+  std::vector<int> & ids,
+  std::vector<std::vector<cv::Point2f>> & corners)
+{
+  auto detection_start = std::chrono::steady_clock::now();
+
+  // Get current marker detector
+  pthread_spin_lock(&(this->detector_lock_));
+  std::shared_ptr<MarkerDetector> detector = detector_;
+  pthread_spin_unlock(&(this->detector_lock_));
+
+  ids.clear();
+  corners.clear();
+  bool roi_tracking = frame_params_->roi_tracking || budget_scheduler_.mode() >= BudgetScheduler::ROI;
+  bool full_search = !roi_tracking || tracked_markers_.empty() ||
+    frames_since_full_search_ >= frame_params_->roi_full_search_period;
+  if (!full_search) {
+    // Predict the regions of interest, merging the overlapping ones
+    cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+    std::vector<cv::Rect> rois;
+    for (const TrackedMarker & marker : tracked_markers_) {
+      std::vector<cv::Point2f> predicted;
+      for (const cv::Point2f & c : marker.corners) {
+        predicted.push_back(c + marker.velocity);
+      }
+      cv::Rect box = cv::boundingRect(predicted);
+      int pad = int(frame_params_->roi_padding * double(std::max(box.width, box.height))) + 1;
+      cv::Rect roi = cv::Rect(box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad) &
+        frame_rect;
+      // A grown region may reach the ones checked before it, so merge until it stops growing:
+      // regions stay disjoint, and no marker is detected twice
+      bool grown = true;
+      while (grown) {
+        grown = false;
+        for (auto it = rois.begin(); it != rois.end(); ) {
+          if ((roi & *it).area() > 0) {
+            roi |= *it;
+            it = rois.erase(it);
+            grown = true;
+          } else {
+            it++;
+          }
+        }
+      }
+      if (roi.area() > 0) {
+        rois.push_back(roi);
+      }
+    }
 
-    //Target target_msg{};
-    //target_msg.set__camera(camera_id_);
-    //target_msg.set__id(ids[k]);
+    // Search each region, bringing corners back to frame coordinates
+    for (const cv::Rect & roi : rois) {
+      std::vector<int> roi_ids;
+      std::vector<std::vector<cv::Point2f>> roi_corners;
+      run_detector(*detector, frame(roi), roi_ids, roi_corners);
+      for (size_t k = 0; k < roi_ids.size(); k++) {
+        for (cv::Point2f & c : roi_corners[k]) {
+          c += cv::Point2f(float(roi.x), float(roi.y));
+        }
+        ids.push_back(roi_ids[k]);
+        corners.push_back(roi_corners[k]);
+      }
+    }
 
-    // Detect target center
-    double x1 = corners[k][0].x;
-    double y1 = corners[k][0].y;
+    // Fall back to a full search if any tracked target went missing
+    for (const TrackedMarker & marker : tracked_markers_) {
+      if (std::find(ids.begin(), ids.end(), marker.id) == ids.end()) {
+        full_search = true;
+        break;
+      }
+    }
+    frames_since_full_search_++;
+  }
+  if (full_search) {
+    ids.clear();
+    corners.clear();
+    run_detector(*detector, frame, ids, corners);
+    frames_since_full_search_ = 0;
+  }
 
-    double x2 = corners[k][1].x;
-    double y2 = corners[k][1].y;
+  // Update tracked targets
+  if (roi_tracking) {
+    std::vector<TrackedMarker> tracked;
+    for (size_t k = 0; k < ids.size(); k++) {
+      if (!is_target(ids[k])) {
+        continue;
+      }
+      TrackedMarker marker;
+      marker.id = ids[k];
+      marker.corners = corners[k];
+      for (const TrackedMarker & old_marker : tracked_markers_) {
+        if (old_marker.id == marker.id) {
+          marker.velocity = (marker.corners[0] - old_marker.corners[0] +
+            marker.corners[2] - old_marker.corners[2]) * 0.5f;
+          break;
+        }
+      }
+      tracked.push_back(marker);
+    }
+    tracked_markers_ = std::move(tracked);
+  } else {
+    tracked_markers_.clear();
+  }
 
-    double x3 = corners[k][2].x;
-    double y3 = corners[k][2].y;
+  update_budget_scheduler(
+    std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - detection_start).count());
 
-    double x4 = corners[k][3].x;
-    double y4 = corners[k][3].y;
+  if (!first_frame_processed_) {
+    first_frame_processed_ = true;
+    RCLCPP_INFO(
+      this->get_logger(),
+      "First frame processed %.1f ms after node construction",
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - init_time_).count());
+  }
+}
 
-    double xc_den = (-((x2 - x4) * (y1 - y3)) + (x1 - x3) * (y2 - y4));
-    double yc_den = (-((x2 - x4) * (y1 - y3)) + (x1 - x3) * (y2 - y4));
+/**
+ * @brief Predicts targets from their tracks, if no detection is due for a frame.
+ *
+ * In tracking mode, markers are detected at a reduced rate, or as soon as the
+ * predicted position of any of them is too uncertain, and predicted in between.
+ *
+ * @param stamp Timestamp of the frame [ns].
+ * @param ids Marker IDs to populate.
+ * @param corners Marker corners to populate.
+ * @return True if targets were predicted, false if they must be detected.
+ */
+bool ArucoDetectorNode::predict_targets(
+  int64_t stamp,
+  std::vector<int> & ids,
+  std::vector<std::vector<cv::Point2f>> & corners)
+{
+  if (!frame_params_->target_tracking) {
+    target_tracker_.reset();
+    return false;
+  }
+  target_tracker_.acceleration = frame_params_->tracking_acceleration;
+  if (target_tracker_.detection_due(stamp, frame_params_->tracking_detection_rate, frame_params_->tracking_max_uncertainty)) {
+    return false;
+  }
+  target_tracker_.predict(stamp, ids, corners);
+  predicted_frames_++;
+  return true;
+}
 
-    if ((abs(xc_den) < 1e-5) || (abs(yc_den) < 1e-5)) {
-      // Do not divide by zero! Just discard this sample
+/**
+ * @brief Updates target tracks with new detections, in tracking mode.
+ *
+ * @param stamp Timestamp of the frame [ns].
+ * @param ids Marker IDs.
+ * @param corners Marker corners.
+ */
+void ArucoDetectorNode::track_targets(
+  int64_t stamp,
+  const std::vector<int> & ids,
+  const std::vector<std::vector<cv::Point2f>> & corners)
+{
+  if (!frame_params_->target_tracking) {
+    return;
+  }
+  target_tracker_.update(
+    stamp, ids, corners,
+    [this](int id) -> bool {
+      return is_target(id);
+    });
+}
+
+/**
+ * @brief Adapts detection to its time budget, and publishes the scheduler status.
+ *
+ * The status is published upon every change, and once per second anyway.
+ *
+ * @param detection_time Detection time of the last frame [ms].
+ */
+void ArucoDetectorNode::update_budget_scheduler(double detection_time)
+{
+  budget_scheduler_.budget = frame_params_->latency_budget;
+  bool changed = budget_scheduler_.update(detection_time);
+  if (changed) {
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Detection mode %u, decimation %u (%.2f ms average detection time, %.2f ms budget)",
+      unsigned(budget_scheduler_.mode()),
+      budget_scheduler_.decimation(),
+      budget_scheduler_.avg_time,
+      budget_scheduler_.budget);
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (!changed && now - last_status_time_ < std::chrono::seconds(1)) {
+    return;
+  }
+  last_status_time_ = now;
+  DetectorStatus status_msg{};
+  status_msg.header.set__stamp(this->get_clock()->now());
+  status_msg.set__mode(budget_scheduler_.mode());
+  status_msg.set__decimation(budget_scheduler_.decimation());
+  status_msg.set__detection_time(float(budget_scheduler_.avg_time));
+  status_msg.set__latency_budget(float(budget_scheduler_.budget));
+  status_msg.set__handoff_latency(float(handoff_latency_.load()));
+  status_pub_->publish(status_msg);
+}
+
+/**
+ * @brief Publishes detected targets.
+ *
+ * @param frame_size Size of the image the targets were detected in.
+ * @param ids Marker IDs.
+ * @param corners Marker corners.
+ * @param stamp Timestamp of the image.
+ */
+void ArucoDetectorNode::publish_targets(
+  const cv::Size & frame_size,
+  std::vector<int> & ids,
+  std::vector<std::vector<cv::Point2f>> & corners,
+  const builtin_interfaces::msg::Time & stamp)
+{
+  rclcpp::Time detected_time = trace_ ? this->get_clock()->now() : rclcpp::Time();
+
+  // Get drone pose at the time the frame was captured
+  DronePose current_pose{};
+  pose_history_.at(rclcpp::Time(stamp).nanoseconds(), current_pose);
+  double altitude = current_pose.z;
+  double yaw = current_pose.yaw;
+
+  // Collect targets geometry, then compute centers and positions in batch
+  target_batch_.clear();
+  target_batch_indexes_.clear();
+  for (int k = 0; k < int(ids.size()); k++) {
+    if (!is_target(ids[k])) {
       continue;
     }
 
-    int xc =
-      (x3 * x4 * (y1 - y2) + x1 * x4 * (y2 - y3) + x1 * x2 * (y3 - y4) + x2 * x3 * (-y1 + y4)) /
-      xc_den;
-    int yc =
-      (x4 * y2 * (y1 - y3) + x1 * y2 * y3 - x2 * y1 * y4 - x1 * y3 * y4 + x2 * y3 * y4 + x3 * y1 *
-      (-y2 + y4)) / yc_den;
+    // If precise centering is required (e.g. for landing), apply camera offset
+    float gain = 0.0f;
+    if (camera_id_ == Target::BOTTOM_CAMERA && ids[k] == 1) {
+      gain = float(frame_params_->camera_offset / frame_params_->aruco_side);
+    }
+    target_batch_.push(corners[k], gain);
+    target_batch_indexes_.push_back(k);
+  }
+  compute_target_centers(target_batch_);
+
+  // Get camera intrinsics, if marker poses are required
+  std::shared_ptr<const CameraIntrinsics> intrinsics;
+  std::shared_ptr<const MarkerMap> marker_map;
+  if (frame_params_->pose_estimation) {
+    pthread_spin_lock(&(this->intrinsics_lock_));
+    intrinsics = intrinsics_;
+    marker_map = marker_map_;
+    pthread_spin_unlock(&(this->intrinsics_lock_));
+    pose_frame_count_++;
+  }
+
+  // Localize the marker map from all its markers in view, with a single solve
+  bool map_valid = intrinsics != nullptr && marker_map != nullptr &&
+    estimate_map_pose(ids, corners, *intrinsics, *marker_map);
+  cv::Matx33d map_R;
+  if (map_valid) {
+    cv::Rodrigues(map_pose_.rvec, map_R);
+  }
+  if (compute_position_) {
+    compute_target_positions(
+      target_batch_,
+      float(frame_size.width / 2),
+      float(frame_size.height / 2),
+      float(altitude),
+      float(focal_length_),
+      float(error_min_),
+      float(yaw));
+  }
 
-    //if (camera_id_ == Target::BOTTOM_CAMERA && ids[k] == 1) {
-    //  // If precise centering is required (e.g. for landing), apply camera offset
-    //  xc += sqrt((pow(x1 - x3, 2) + pow(y1 - y3, 2)) / 2) * camera_offset_ / aruco_side_;
-    //}
+  // Publish information about detected targets
+  // (all in a single message, the storage of which is reused across frames)
+  aruco_centers_.clear();
+  targets_msg_.header.set__stamp(stamp);
+  targets_msg_.header.set__frame_id("map");
+  targets_msg_.set__camera(camera_id_);
+  targets_msg_.targets.clear();
+  for (size_t k = 0; k < target_batch_.size; k++) {
+    if (!target_batch_.valid[k]) {
+      // Degenerate corners, just discard this sample
+      continue;
+    }
 
+    int idx = target_batch_indexes_[k];
+    Target target_msg{};
+    target_msg.set__camera(camera_id_);
+    target_msg.set__id(ids[idx]);
+
+    int xc = int(target_batch_.xc[k]);
+    int yc = int(target_batch_.yc[k]);
     aruco_centers_.push_back(cv::Point(xc, yc));
 
     // Detect in which side of the image the target lies
     if (rotate_image_) {
-      if (yc < (new_frame.size().height / 2) - (centering_width_ / 2)) {
-        //target_msg.set__centering(Target::LEFT);
-      } else if (yc > (new_frame.size().height / 2) + (centering_width_ / 2)) {
-        //target_msg.set__centering(Target::RIGHT);
+      if (yc < (frame_size.height / 2) - (centering_width_ / 2)) {
+        target_msg.set__centering(Target::LEFT);
+      } else if (yc > (frame_size.height / 2) + (centering_width_ / 2)) {
+        target_msg.set__centering(Target::RIGHT);
       } else {
-        //target_msg.set__centering(Target::CENTER);
+        target_msg.set__centering(Target::CENTER);
       }
     } else {
-      if (xc < (new_frame.size().width / 2) - (centering_width_ / 2)) {
-        //target_msg.set__centering(Target::LEFT);
-      } else if (xc > (new_frame.size().width / 2) + (centering_width_ / 2)) {
-        //target_msg.set__centering(Target::RIGHT);
+      if (xc < (frame_size.width / 2) - (centering_width_ / 2)) {
+        target_msg.set__centering(Target::LEFT);
+      } else if (xc > (frame_size.width / 2) + (centering_width_ / 2)) {
+        target_msg.set__centering(Target::RIGHT);
       } else {
-        //target_msg.set__centering(Target::CENTER);
+        target_msg.set__centering(Target::CENTER);
       }
     }
 
-    // Compute target position w.r.t. the world NED reference frame
+    // Set target position w.r.t. the world NED reference frame
     if (compute_position_) {
-      double ex_pixels = xc - (new_frame.size().width / 2);
-      double ey_pixels = yc - (new_frame.size().height / 2);
-
-      double err_x = -(altitude * ex_pixels) / focal_length_;
-      double err_y = -(altitude * ey_pixels) / focal_length_;
+      float new_x = current_pose.x + target_batch_.err_x[k];
+      float new_y = current_pose.y + target_batch_.err_y[k];
+      target_msg.set__position({new_x, new_y});
+    } else {
+      target_msg.set__position({NAN, NAN});
+    }
 
-      // If error is too low, zero it to avoid numerical noise
-      if (sqrt(pow(err_x, 2) + pow(err_y, 2)) <= error_min_) {
-        err_x = 0.0;
-        err_y = 0.0;
-      }
+    // Estimate full marker pose w.r.t. the camera, from the map pose if it is mapped
+    if (map_valid && map_inliers_[idx]) {
+      const MarkerMap::Marker & marker = *marker_map->find(ids[idx]);
+      cv::Vec3d rvec;
+      cv::Rodrigues(map_R * marker.R, rvec);
+      pose_to_msg(rvec, map_R * marker.t + map_pose_.tvec, target_msg.pose);
+      target_msg.set__pose_valid(true);
+    } else if (intrinsics != nullptr) {
+      target_msg.set__pose_valid(
+        estimate_target_pose(ids[idx], corners[idx], *intrinsics, target_msg.pose));
+    }
 
-      double cy = cos(yaw);
-      double sy = sin(yaw);
+    targets_msg_.targets.push_back(target_msg);
+  }
 
-      double x_err = err_x * cy - err_y * sy;
-      double y_err = err_x * sy + err_y * cy;
+  // Forget markers that were not seen in this frame
+  if (intrinsics != nullptr) {
+    for (auto it = marker_poses_.begin(); it != marker_poses_.end(); ) {
+      if (it->second.frame != pose_frame_count_) {
+        it = marker_poses_.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+  target_pub_->publish(targets_msg_);
 
-      // Round errors to centimeters to cut out numerical noise
-      x_err = round_space(x_err, 100.0f);
-      y_err = round_space(y_err, 100.0f);
+  // Publish the camera pose w.r.t. the marker map
+  if (map_valid) {
+    geometry_msgs::msg::PoseStamped map_pose_msg{};
+    map_pose_msg.header.set__stamp(stamp);
+    map_pose_msg.header.set__frame_id("marker_map");
+    pose_to_msg(-map_pose_.rvec, -(map_R.t() * map_pose_.tvec), map_pose_msg.pose);
+    map_pose_pub_->publish(map_pose_msg);
+  }
+  if (trace_) {
+    publish_trace(stamp, detected_time);
+  }
 
-      //float new_x = current_pose.x + x_err;
-      //float new_y = current_pose.y + y_err;
+  // Publish rate message
+  Empty rate_msg{};
+  camera_rate_pub_->publish(rate_msg);
+}
 
-      //target_msg.set__position({new_x, new_y});
+/**
+ * @brief Publishes the pipeline trace of a frame whose targets were just published.
+ *
+ * @param stamp Capture timestamp of the frame, that identifies it in traces.
+ * @param detected_time Time marker detection ended at.
+ */
+void ArucoDetectorNode::publish_trace(
+  const builtin_interfaces::msg::Time & stamp,
+  const rclcpp::Time & detected_time)
+{
+  ros2_usb_camera::msg::FrameTrace trace_msg{};
+  trace_msg.header.set__stamp(stamp);
+  trace_msg.stages.push_back(ros2_usb_camera::msg::FrameTrace::RECEIVE);
+  trace_msg.times.push_back(receive_time_);
+  trace_msg.stages.push_back(ros2_usb_camera::msg::FrameTrace::DETECTED);
+  trace_msg.times.push_back(detected_time);
+  trace_msg.stages.push_back(ros2_usb_camera::msg::FrameTrace::TARGETS_PUBLISH);
+  trace_msg.times.push_back(this->get_clock()->now());
+  trace_pub_->publish(trace_msg);
+}
 
-    } else {
-      //target_msg.set__position({NAN, NAN});
+/**
+ * @brief Checks whether the HUD image must be drawn for the current frame.
+ *
+ * @return True if someone subscribed to the HUD image and it is due.
+ */
+bool ArucoDetectorNode::hud_required()
+{
+  if (target_img_pub_.getNumSubscribers() == 0) {
+    return false;
+  }
+  if (frame_params_->hud_rate > 0.0) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_hud_time_ < std::chrono::duration<double>(1.0 / frame_params_->hud_rate)) {
+      return false;
     }
-
-    //target_pub_->publish(target_msg);
+    last_hud_time_ = now;
   }
+  return true;
+}
 
-  // Draw search output, ROI and HUD in another image
+/**
+ * @brief Draws search output, ROI and HUD on an image and publishes it.
+ *
+ * @param new_frame Private copy of the image the targets were detected in.
+ * @param ids Marker IDs.
+ * @param corners Marker corners.
+ * @param stamp Timestamp of the image.
+ */
+void ArucoDetectorNode::publish_hud(
+  cv::Mat & new_frame,
+  std::vector<int> & ids,
+  std::vector<std::vector<cv::Point2f>> & corners,
+  const builtin_interfaces::msg::Time & stamp)
+{
   cv::aruco::drawDetectedMarkers(new_frame, corners, ids);
   for (auto center : aruco_centers_) {
     cv::drawMarker(
@@ -177,8 +1049,11 @@ void ArucoDetectorNode::camera_callback(const Image::ConstSharedPtr & msg)
       20,
       3);
   }
+  // With the rotation hint, the viewer rotates the frame 90 degrees counterclockwise:
+  // the centering zone, vertical in its view, is horizontal here
+  bool rotation_hint = rotate_image_ && frame_params_->hud_rotation_hint;
   camera_frame_ = new_frame; // Doesn't copy image data, but sets data type...
-  if (rotate_image_) {
+  if (rotate_image_ && !rotation_hint) {
     // ... Which must be properly set here
     cv::rotate(new_frame, camera_frame_, cv::ROTATE_90_COUNTERCLOCKWISE);
   }
@@ -194,6 +1069,16 @@ void ArucoDetectorNode::camera_callback(const Image::ConstSharedPtr & msg)
   cv::Point line_right_bottom(
     (camera_frame_.size().width / 2) + (centering_width_ / 2),
     camera_frame_.size().height - 1);
+  if (rotation_hint) {
+    line_left_top = cv::Point(0, (camera_frame_.size().height / 2) - (centering_width_ / 2));
+    line_left_bottom = cv::Point(
+      camera_frame_.size().width - 1,
+      (camera_frame_.size().height / 2) - (centering_width_ / 2));
+    line_right_top = cv::Point(0, (camera_frame_.size().height / 2) + (centering_width_ / 2));
+    line_right_bottom = cv::Point(
+      camera_frame_.size().width - 1,
+      (camera_frame_.size().height / 2) + (centering_width_ / 2));
+  }
   cv::Point rect_p1(
     (camera_frame_.size().width / 2) - (centering_width_ / 2),
     (camera_frame_.size().height / 2) - (centering_width_ / 2));
@@ -229,17 +1114,24 @@ void ArucoDetectorNode::camera_callback(const Image::ConstSharedPtr & msg)
     15,
     3);
 
-  // Publish rate message and processed image
-  Empty rate_msg{};
-  camera_rate_pub_->publish(rate_msg);
+  // Tell viewers how to rotate the image, clockwise, whenever that changes
+  int32_t hud_rotation = rotation_hint ? 270 : 0;
+  if (hud_rotation != hud_rotation_) {
+    Int32 rotation_msg;
+    rotation_msg.set__data(hud_rotation);
+    target_img_rotation_pub_->publish(rotation_msg);
+    hud_rotation_ = hud_rotation;
+  }
+
+  // Publish processed image
   Image::SharedPtr processed_image_msg = frame_to_msg(camera_frame_);
-  processed_image_msg->header.set__stamp(this->get_clock()->now());
+  processed_image_msg->header.set__stamp(stamp);
   processed_image_msg->header.set__frame_id("map");
   target_img_pub_.publish(processed_image_msg);
 }
 
 /**
- * @brief Stores the latest drone pose.
+ * @brief Adds the latest drone pose to the history.
  *
  * @param msg Pose message to parse.
  */
@@ -252,9 +1144,7 @@ void ArucoDetectorNode::camera_callback(const Image::ConstSharedPtr & msg)
     msg->roll,
     msg->pitch,
     msg->yaw);
-  pthread_spin_lock(&(this->pose_lock_));
-  pose_ = new_pose;
-  pthread_spin_unlock(&(this->pose_lock_));
+  pose_history_.push(this->get_clock()->now().nanoseconds(), new_pose);
 }*/
 
 } // namespace ArucoDetector
@@ -24,449 +24,596 @@
  * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <array>
+#include <cmath>
+#include <map>
+#include <string>
+
 #include <aruco_detector/aruco_detector.hpp>
 
 namespace ArucoDetector
 {
 
 /**
- * @brief Converts a frame into an Image message.
- *
- * @param frame cv::Mat storing the frame.
- * @return Shared pointer to a new Image message.
+ * OpenCV predefined ArUco dictionaries, by name.
  */
-Image::SharedPtr ArucoDetectorNode::frame_to_msg(cv::Mat & frame)
-{
-  auto ros_image = std::make_shared<Image>();
-
-  // Set frame-relevant image contents
-  ros_image->set__width(frame.cols);
-  ros_image->set__height(frame.rows);
-  ros_image->set__encoding(sensor_msgs::image_encodings::BGR8);
-  ros_image->set__step(frame.cols * frame.elemSize());
-
-  // Check data endianness
-  ros_image->set__is_bigendian(false);
-
-  // Copy frame data (this avoids the obsolete cv_bridge)
-  size_t size = ros_image->step * frame.rows;
-  ros_image->data.resize(size);
-  memcpy(ros_image->data.data(), frame.data, size);
-
-  return ros_image;
-}
+static const std::map<std::string, int> aruco_dictionaries = {
+  {"DICT_4X4_50", cv::aruco::DICT_4X4_50},
+  {"DICT_4X4_100", cv::aruco::DICT_4X4_100},
+  {"DICT_4X4_250", cv::aruco::DICT_4X4_250},
+  {"DICT_4X4_1000", cv::aruco::DICT_4X4_1000},
+  {"DICT_5X5_50", cv::aruco::DICT_5X5_50},
+  {"DICT_5X5_100", cv::aruco::DICT_5X5_100},
+  {"DICT_5X5_250", cv::aruco::DICT_5X5_250},
+  {"DICT_5X5_1000", cv::aruco::DICT_5X5_1000},
+  {"DICT_6X6_50", cv::aruco::DICT_6X6_50},
+  {"DICT_6X6_100", cv::aruco::DICT_6X6_100},
+  {"DICT_6X6_250", cv::aruco::DICT_6X6_250},
+  {"DICT_6X6_1000", cv::aruco::DICT_6X6_1000},
+  {"DICT_7X7_50", cv::aruco::DICT_7X7_50},
+  {"DICT_7X7_100", cv::aruco::DICT_7X7_100},
+  {"DICT_7X7_250", cv::aruco::DICT_7X7_250},
+  {"DICT_7X7_1000", cv::aruco::DICT_7X7_1000},
+  {"DICT_ARUCO_ORIGINAL", cv::aruco::DICT_ARUCO_ORIGINAL},
+  {"DICT_APRILTAG_16h5", cv::aruco::DICT_APRILTAG_16h5},
+  {"DICT_APRILTAG_25h9", cv::aruco::DICT_APRILTAG_25h9},
+  {"DICT_APRILTAG_36h10", cv::aruco::DICT_APRILTAG_36h10},
+  {"DICT_APRILTAG_36h11", cv::aruco::DICT_APRILTAG_36h11}
+};
 
 /**
- * @brief Function to round spatial measure to a fixed precision.
- *
- * @param num Value to round.
- * @param prec 100 -> centimeter, 1000 -> mm
- * @return Rounded value.
+ * Marker corners refinement methods, by name.
  */
-float ArucoDetectorNode::round_space(float num, float prec)
-{
-  num *= prec;
-  num = floor(num);
-  num /= prec;
-
-  return num;
-}
+static const std::map<std::string, int> corner_refinement_methods = {
+  {"NONE", cv::aruco::CORNER_REFINE_NONE},
+  {"SUBPIX", cv::aruco::CORNER_REFINE_SUBPIX},
+  {"CONTOUR", cv::aruco::CORNER_REFINE_CONTOUR},
+  {"APRILTAG", cv::aruco::CORNER_REFINE_APRILTAG}
+};
 
 /**
- * @brief Function to round angular measure to a fixed precision.
+ * @brief Builds a new marker detector from the current node parameters.
  *
- * @param num Value to round.
- * @param prec 10 -> tenth of a degree
- * @return Rounded value.
+ * The new detector replaces the current one atomically, so that the image
+ * callback keeps using the old one until it is done with the current frame.
  */
-float ArucoDetectorNode::round_angle(float num, float prec)
+void ArucoDetectorNode::init_detector()
 {
-  num = num * 180.0 / M_PIf32;
-
-  num *= prec;
-  num = floor(num);
-  num /= prec;
-
-  return num * M_PIf32 / 180.0;
+  auto detector = std::make_shared<MarkerDetector>();
+
+#ifdef ARUCO_API_OLD
+  detector->dictionary = cv::aruco::getPredefinedDictionary(
+    aruco_dictionaries.at(aruco_dictionary_));
+  detector->parameters = cv::aruco::DetectorParameters::create();
+  cv::aruco::DetectorParameters & params = *detector->parameters;
+#else
+  cv::aruco::DetectorParameters params;
+#endif
+  params.adaptiveThreshWinSizeMin = int(adaptive_thresh_win_size_min_);
+  params.adaptiveThreshWinSizeMax = int(adaptive_thresh_win_size_max_);
+  params.adaptiveThreshWinSizeStep = int(adaptive_thresh_win_size_step_);
+  params.minMarkerPerimeterRate = min_marker_perimeter_rate_;
+  params.maxMarkerPerimeterRate = max_marker_perimeter_rate_;
+  params.polygonalApproxAccuracyRate = polygonal_approx_accuracy_rate_;
+  params.cornerRefinementMethod = corner_refinement_methods.at(corner_refinement_);
+#ifndef ARUCO_API_OLD
+  detector->detector = cv::aruco::ArucoDetector(
+    cv::aruco::getPredefinedDictionary(aruco_dictionaries.at(aruco_dictionary_)),
+    params);
+#endif
+
+  pthread_spin_lock(&(this->detector_lock_));
+  detector_ = detector;
+  pthread_spin_unlock(&(this->detector_lock_));
 }
 
 /**
- * @brief Routine to declare a boolean node parameter.
+ * @brief Builds the marker detector, then signals that the node is ready.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * Dictionaries are the heaviest part of node initialization: with deferred_init,
+ * this runs in the background while the container loads other nodes.
  */
-void ArucoDetectorNode::declare_bool_parameter(
-  std::string && name,
-  bool default_val,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+void ArucoDetectorNode::warmup_routine()
 {
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_BOOL);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  this->declare_parameter(name, default_val, descriptor);
+  auto warmup_start = std::chrono::steady_clock::now();
+  init_detector();
+  ready_.store(true, std::memory_order_release);
+
+  Bool ready_msg;
+  ready_msg.set__data(true);
+  ready_pub_->publish(ready_msg);
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Warm-up completed in %.1f ms (%.1f ms after node construction)",
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - warmup_start).count(),
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - init_time_).count());
 }
 
 /**
- * @brief Routine to declare a 64-bit floating point node parameter.
+ * @brief Checks whether detection runs outside of subscription callbacks.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param from Floating point range initial value.
- * @param to Floating point range final value.
- * @param step Floating point range step.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @return True if frames go through the latest frame mailbox.
  */
-void ArucoDetectorNode::declare_double_parameter(
-  std::string && name,
-  double default_val, double from, double to, double step,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+bool ArucoDetectorNode::async_detection() const
 {
-  FloatingPointRange param_range{};
-  param_range.set__from_value(from);
-  param_range.set__to_value(to);
-  param_range.set__step(step);
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_DOUBLE);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  descriptor.set__floating_point_range({param_range});
-  this->declare_parameter(name, default_val, descriptor);
+  return worker_thread_ || detector_pool_size_ > 0;
 }
 
 /**
- * @brief Routine to declare an integer node parameter.
+ * @brief Gets the latest detection parameters, which stay the same until the next update.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param from Integer range initial value.
- * @param to Integer range final value.
- * @param step Integer range step.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @return Detection parameters.
  */
-void ArucoDetectorNode::declare_int_parameter(
-  std::string && name,
-  int64_t default_val, int64_t from, int64_t to, int64_t step,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+std::shared_ptr<const ArucoDetectorNode::DetectionParams> ArucoDetectorNode::detection_params()
 {
-  IntegerRange param_range{};
-  param_range.set__from_value(from);
-  param_range.set__to_value(to);
-  param_range.set__step(step);
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_INTEGER);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  descriptor.set__integer_range({param_range});
-  this->declare_parameter(name, default_val, descriptor);
+  pthread_spin_lock(&(this->params_lock_));
+  std::shared_ptr<const DetectionParams> params = detection_params_;
+  pthread_spin_unlock(&(this->params_lock_));
+  return params;
 }
 
 /**
- * @brief Routine to declare an integer array node parameter.
+ * @brief Checks whether a marker is one of the targets.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param from Integer range initial value.
- * @param to Integer range final value.
- * @param step Integer range step.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @param id Marker ID.
+ * @return True if the marker must be considered, false otherwise.
  */
-void ArucoDetectorNode::declare_int_array_parameter(
-  std::string && name,
-  std::vector<int64_t> && default_val, int64_t from, int64_t to, int64_t step,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+bool ArucoDetectorNode::is_target(int id) const
 {
-  IntegerRange param_range{};
-  param_range.set__from_value(from);
-  param_range.set__to_value(to);
-  param_range.set__step(step);
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_INTEGER_ARRAY);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  descriptor.set__integer_range({param_range});
-  this->declare_parameter(name, default_val, descriptor);
+  return id >= 0 && size_t(id) < target_ids_filter_.size() && target_ids_filter_.test(size_t(id));
 }
 
 /**
- * @brief Routine to declare a string node parameter.
+ * @brief Estimates the pose of a target w.r.t. the camera.
+ *
+ * Poses are solved with IPPE-square, unless the marker was also seen in the
+ * previous frame: then its last pose is just refined, which is cheaper and
+ * keeps the solution consistent across frames. Bad refinements fall back to
+ * the full solve.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @param id Marker ID.
+ * @param corners Marker corners.
+ * @param intrinsics Camera intrinsics.
+ * @param pose Pose to populate.
+ * @return True if the pose could be estimated.
  */
-void ArucoDetectorNode::declare_string_parameter(
-  std::string && name,
-  std::string && default_val,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+bool ArucoDetectorNode::estimate_target_pose(
+  int id,
+  const std::vector<cv::Point2f> & corners,
+  const CameraIntrinsics & intrinsics,
+  geometry_msgs::msg::Pose & pose)
 {
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_STRING);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  this->declare_parameter(name, default_val, descriptor);
+  constexpr double max_refine_error = 1.0; // pixels
+
+  if (frame_params_->aruco_side <= 0.0) {
+    return false;
+  }
+
+  // Marker corners in the marker frame, in the order IPPE-square expects
+  float h = float(frame_params_->aruco_side / 2.0);
+  std::vector<cv::Point3f> object_points = {
+    {-h, h, 0.0f},
+    {h, h, 0.0f},
+    {h, -h, 0.0f},
+    {-h, -h, 0.0f}};
+
+  cv::Vec3d rvec, tvec;
+  bool solved = false;
+  MarkerPose & last = marker_poses_[id];
+  if (last.frame != 0 && last.frame + 1 == pose_frame_count_) {
+    rvec = last.rvec;
+    tvec = last.tvec;
+    cv::solvePnPRefineLM(
+      object_points,
+      corners,
+      intrinsics.K,
+      intrinsics.D,
+      rvec,
+      tvec,
+      cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 5, 1e-6));
+
+    std::vector<cv::Point2f> projected;
+    cv::projectPoints(object_points, rvec, tvec, intrinsics.K, intrinsics.D, projected);
+    double error = cv::norm(projected, corners, cv::NORM_L2) / 2.0; // RMS over 4 corners
+    solved = error <= max_refine_error;
+  }
+  if (!solved) {
+    std::vector<cv::Mat> rvecs, tvecs;
+    int solutions = cv::solvePnPGeneric(
+      object_points,
+      corners,
+      intrinsics.K,
+      intrinsics.D,
+      rvecs,
+      tvecs,
+      false,
+      cv::SOLVEPNP_IPPE_SQUARE);
+    if (solutions == 0) {
+      marker_poses_.erase(id);
+      return false;
+    }
+
+    // Solutions are sorted by reprojection error
+    rvec = cv::Vec3d(rvecs[0].ptr<double>());
+    tvec = cv::Vec3d(tvecs[0].ptr<double>());
+  }
+  last.rvec = rvec;
+  last.tvec = tvec;
+  last.frame = pose_frame_count_;
+
+  pose_to_msg(rvec, tvec, pose);
+  return true;
 }
 
 /**
- * @brief Parameters update validation callback.
+ * @brief Estimates the pose of the marker map w.r.t. the camera.
+ *
+ * The corners of all mapped markers in view are solved for at once, starting
+ * from the last map pose if it was estimated in the previous frame, else from
+ * both IPPE-square solutions of the largest mapped marker. Markers that do not
+ * fit the solution are rejected as outliers (e.g. partly occluded ones), and
+ * the candidate that explains the most markers is kept.
+ * The pose is stored in map_pose_, and map_inliers_ flags the detected markers
+ * it was estimated from.
  *
- * @param params Vector of parameters for which a change has been requested.
- * @return Operation result in SetParametersResult message.
+ * @param ids Marker IDs.
+ * @param corners Marker corners.
+ * @param intrinsics Camera intrinsics.
+ * @param map Marker map.
+ * @return True if the pose could be estimated.
  */
-SetParametersResult ArucoDetectorNode::on_set_parameters_callback(
-  const std::vector<rclcpp::Parameter> & params)
+bool ArucoDetectorNode::estimate_map_pose(
+  const std::vector<int> & ids,
+  const std::vector<std::vector<cv::Point2f>> & corners,
+  const CameraIntrinsics & intrinsics,
+  const MarkerMap & map)
 {
-  // Initialize result object
-  SetParametersResult res{};
-  res.set__successful(true);
-  res.set__reason("");
-
-  // First, check if each update is feasible
-  // Initial checks must be added here!
-  for (const rclcpp::Parameter & p : params) {
-    // Aruco side
-    if (p.get_name() == "aruco_side") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for aruco_side");
-        break;
-      }
+  // Collect the corners of all mapped markers in view
+  std::vector<int> mapped;
+  std::vector<cv::Point3f> object_points;
+  std::vector<cv::Point2f> image_points;
+  int largest = -1;
+  double largest_area = 0.0;
+  map_inliers_.assign(ids.size(), 0);
+  for (int k = 0; k < int(ids.size()); k++) {
+    const MarkerMap::Marker * marker = map.find(ids[k]);
+    if (marker == nullptr || corners[k].size() != 4) {
       continue;
     }
-
-    // Camera offset
-    if (p.get_name() == "camera_offset") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for camera_offset");
-        break;
-      }
-      continue;
-    }
-
-    // Camera topic
-    if (p.get_name() == "camera_topic") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for camera_topic");
-        break;
-      }
-      continue;
+    mapped.push_back(k);
+    object_points.insert(object_points.end(), marker->corners.begin(), marker->corners.end());
+    image_points.insert(image_points.end(), corners[k].begin(), corners[k].end());
+
+    double area = std::abs(cv::contourArea(corners[k]));
+    if (area > largest_area) {
+      largest_area = area;
+      largest = k;
     }
+  }
+  if (largest < 0) {
+    map_pose_.frame = 0;
+    return false;
+  }
 
-    // Centering width
-    if (p.get_name() == "centering_width") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for centering_width");
-        break;
+  std::vector<uint8_t> inliers, best_inliers;
+  cv::Vec3d best_rvec, best_tvec;
+  int best_count = 0;
+  double best_error = 0.0;
+  auto try_candidate =
+    [&](cv::Vec3d rvec, cv::Vec3d tvec) -> bool {
+      double error = 0.0;
+      int count = refine_map_pose(
+        object_points, image_points, intrinsics, rvec, tvec, inliers, error);
+      if (count > best_count || (count == best_count && count > 0 && error < best_error)) {
+        best_count = count;
+        best_error = error;
+        best_rvec = rvec;
+        best_tvec = tvec;
+        best_inliers = inliers;
       }
-      continue;
+      return count == int(mapped.size());
+    };
+
+  // The map usually moves little between frames, so the last pose is tried first
+  bool solved = map_pose_.frame != 0 && map_pose_.frame + 1 == pose_frame_count_ &&
+    try_candidate(map_pose_.rvec, map_pose_.tvec);
+  if (!solved) {
+    const MarkerMap::Marker & marker = *map.find(ids[largest]);
+    std::array<cv::Point3f, 4> local = MarkerMap::marker_corners(marker.side);
+    std::vector<cv::Mat> rvecs, tvecs;
+    int solutions = cv::solvePnPGeneric(
+      std::vector<cv::Point3f>(local.begin(), local.end()),
+      corners[largest],
+      intrinsics.K,
+      intrinsics.D,
+      rvecs,
+      tvecs,
+      false,
+      cv::SOLVEPNP_IPPE_SQUARE);
+
+    // Move each marker pose to the map origin
+    for (int i = 0; i < solutions && !solved; i++) {
+      cv::Matx33d R_marker;
+      cv::Rodrigues(cv::Vec3d(rvecs[i].ptr<double>()), R_marker);
+      cv::Matx33d R = R_marker * marker.R.t();
+      cv::Vec3d tvec = cv::Vec3d(tvecs[i].ptr<double>()) - R * marker.t;
+      cv::Vec3d rvec;
+      cv::Rodrigues(R, rvec);
+      solved = try_candidate(rvec, tvec);
     }
+  }
+  if (best_count == 0) {
+    map_pose_.frame = 0;
+    return false;
+  }
 
-    // Compute position flag
-    if (p.get_name() == "compute_position") {
-      if (p.get_type() != ParameterType::PARAMETER_BOOL) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for compute_position");
-        break;
-      }
-      continue;
-    }
+  map_pose_.rvec = best_rvec;
+  map_pose_.tvec = best_tvec;
+  map_pose_.frame = pose_frame_count_;
+  for (size_t i = 0; i < mapped.size(); i++) {
+    map_inliers_[mapped[i]] = best_inliers[i];
+  }
+  return true;
+}
 
-    // Minimum error
-    if (p.get_name() == "error_min") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for error_min");
-        break;
+/**
+ * @brief Refines a marker map pose, and rejects markers that do not fit it.
+ *
+ * Markers whose corners reproject farther than map_max_error are outliers:
+ * if there are any, the pose is refined again without them.
+ *
+ * @param object_points Corners of the mapped markers, four per marker, in the map frame.
+ * @param image_points Detected corners of the mapped markers.
+ * @param intrinsics Camera intrinsics.
+ * @param rvec Initial map orientation, refined in place.
+ * @param tvec Initial map position, refined in place.
+ * @param inliers Inlier flags to populate, one per marker.
+ * @param error RMS reprojection error of the inliers to populate [px].
+ * @return Number of inliers.
+ */
+int ArucoDetectorNode::refine_map_pose(
+  const std::vector<cv::Point3f> & object_points,
+  const std::vector<cv::Point2f> & image_points,
+  const CameraIntrinsics & intrinsics,
+  cv::Vec3d & rvec,
+  cv::Vec3d & tvec,
+  std::vector<uint8_t> & inliers,
+  double & error)
+{
+  const cv::TermCriteria criteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 10, 1e-6);
+  size_t markers = object_points.size() / 4;
+  std::vector<cv::Point2f> projected;
+  auto classify =
+    [&]() -> int {
+      cv::projectPoints(object_points, rvec, tvec, intrinsics.K, intrinsics.D, projected);
+      int count = 0;
+      double sum = 0.0;
+      inliers.assign(markers, 0);
+      for (size_t i = 0; i < markers; i++) {
+        double marker_sum = 0.0;
+        for (size_t j = 4 * i; j < 4 * i + 4; j++) {
+          cv::Point2f d = projected[j] - image_points[j];
+          marker_sum += double(d.x) * d.x + double(d.y) * d.y;
+        }
+        if (std::sqrt(marker_sum / 4.0) <= frame_params_->map_max_error) {
+          inliers[i] = 1;
+          sum += marker_sum;
+          count++;
+        }
       }
-      continue;
-    }
-
-    // Rotate image flag
-    if (p.get_name() == "rotate_image") {
-      if (p.get_type() != ParameterType::PARAMETER_BOOL) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for rotate_image");
-        break;
+      error = count > 0 ? std::sqrt(sum / (4.0 * count)) : 0.0;
+      return count;
+    };
+
+  cv::solvePnPRefineLM(
+    object_points, image_points, intrinsics.K, intrinsics.D, rvec, tvec, criteria);
+  int count = classify();
+  if (count > 0 && count < int(markers)) {
+    std::vector<cv::Point3f> inlier_object_points;
+    std::vector<cv::Point2f> inlier_image_points;
+    for (size_t i = 0; i < markers; i++) {
+      if (inliers[i]) {
+        inlier_object_points.insert(
+          inlier_object_points.end(),
+          object_points.begin() + 4 * i,
+          object_points.begin() + 4 * i + 4);
+        inlier_image_points.insert(
+          inlier_image_points.end(),
+          image_points.begin() + 4 * i,
+          image_points.begin() + 4 * i + 4);
       }
-      continue;
     }
+    cv::solvePnPRefineLM(
+      inlier_object_points, inlier_image_points, intrinsics.K, intrinsics.D, rvec, tvec, criteria);
+    count = classify();
+  }
+  return count;
+}
 
-    // Target IDs
-    if (p.get_name() == "target_ids") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER_ARRAY) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for target_ids");
-        break;
-      }
-      continue;
-    }
+/**
+ * @brief Converts a rotation and translation vector pair into a pose.
+ *
+ * @param rvec Rotation vector.
+ * @param tvec Translation vector.
+ * @param pose Pose to populate.
+ */
+void ArucoDetectorNode::pose_to_msg(
+  const cv::Vec3d & rvec,
+  const cv::Vec3d & tvec,
+  geometry_msgs::msg::Pose & pose)
+{
+  // Convert the rotation vector into a quaternion
+  double angle = cv::norm(rvec);
+  double s = angle > 1e-9 ? std::sin(angle / 2.0) / angle : 0.5;
+  pose.position.set__x(tvec[0]);
+  pose.position.set__y(tvec[1]);
+  pose.position.set__z(tvec[2]);
+  pose.orientation.set__x(rvec[0] * s);
+  pose.orientation.set__y(rvec[1] * s);
+  pose.orientation.set__z(rvec[2] * s);
+  pose.orientation.set__w(std::cos(angle / 2.0));
+}
 
-    // Image transport
-    if (p.get_name() == "transport") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for transport");
-        break;
-      }
-      continue;
-    }
+/**
+ * @brief Sets up the allocator of large image buffers, if huge pages or NUMA binding are requested.
+ *
+ * Buffers are created by the thread that processes frames, which binds them to
+ * its NUMA node.
+ */
+void ArucoDetectorNode::init_large_buffers()
+{
+  using USBCameraDriver::HugePageAllocator;
+  USBCameraDriver::HugePages pages = USBCameraDriver::HugePages::NONE;
+  HugePageAllocator::parse_pages(this->get_parameter("huge_pages").as_string(), pages);
+  large_buffer_allocator_ = HugePageAllocator::get(
+    pages,
+    this->get_parameter("numa_bind").as_bool() ?
+    HugePageAllocator::thread_node : HugePageAllocator::no_node);
+  if (large_buffer_allocator_ == nullptr) {
+    return;
+  }
 
-    // Focal length
-    if (p.get_name() == "focal_length") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for focal_length");
-        break;
-      }
-      continue;
-    }
+  for (cv::Mat * mat : {&gray_frame_, &hud_frame_, &pyramid_frame_}) {
+    mat->allocator = large_buffer_allocator_;
   }
-  if (!res.successful) {
-    return res;
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Large image buffers on %s pages%s",
+    pages == USBCameraDriver::HugePages::EXPLICIT ? "explicit huge" :
+    (pages == USBCameraDriver::HugePages::TRANSPARENT ? "transparent huge" : "regular"),
+    this->get_parameter("numa_bind").as_bool() ? ", bound to the NUMA node of their thread" : "");
+}
+
+/**
+ * @brief Wraps an image buffer into a frame that markers can be detected in.
+ *
+ * Color images are wrapped as they are, grayscale ones and the luma plane of
+ * planar YUV ones are wrapped as gray images, with no copies. Only packed YUV
+ * images need their luma channel extracted.
+ *
+ * @param encoding Image encoding.
+ * @param height Image height.
+ * @param width Image width.
+ * @param step Image row length [bytes].
+ * @param data Image data.
+ * @param frame Frame to populate.
+ * @return False if the encoding is not supported.
+ */
+bool ArucoDetectorNode::wrap_frame(
+  const std::string & encoding,
+  uint32_t height,
+  uint32_t width,
+  uint32_t step,
+  const uint8_t * data,
+  cv::Mat & frame)
+{
+  void * buf = const_cast<uint8_t *>(data);
+  if (encoding == sensor_msgs::image_encodings::BGR8 ||
+    encoding == sensor_msgs::image_encodings::RGB8)
+  {
+    frame = cv::Mat(height, width, CV_8UC3, buf, step);
+  } else if (encoding == sensor_msgs::image_encodings::MONO8 || encoding == "nv12" ||
+    encoding == sensor_msgs::image_encodings::NV21)
+  {
+    // Luma plane comes first in semi-planar formats
+    frame = cv::Mat(height, width, CV_8UC1, buf, step);
+  } else if (encoding == sensor_msgs::image_encodings::YUV422_YUY2 || encoding == "yuyv") {
+    cv::extractChannel(cv::Mat(height, width, CV_8UC2, buf, step), gray_frame_, 0);
+    frame = gray_frame_;
+  } else if (encoding == sensor_msgs::image_encodings::YUV422) {
+    cv::extractChannel(cv::Mat(height, width, CV_8UC2, buf, step), gray_frame_, 1);
+    frame = gray_frame_;
+  } else {
+    RCLCPP_ERROR_THROTTLE(
+      this->get_logger(),
+      *this->get_clock(),
+      1000,
+      "Unsupported image encoding: %s",
+      encoding.c_str());
+    return false;
   }
+  return true;
+}
 
-  // Then, do what is necessary to update each parameter
-  // Ad-hoc update procedures must be added here!
-  for (const rclcpp::Parameter & p : params) {
-    // Aruco side
-    if (p.get_name() == "aruco_side") {
-      aruco_side_ = p.as_double();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "aruco_side: %f m",
-        aruco_side_);
-      continue;
-    }
+/**
+ * @brief Copies a frame into the HUD buffer, which is always in color.
+ *
+ * @param frame Frame to copy.
+ */
+void ArucoDetectorNode::copy_hud_frame(const cv::Mat & frame)
+{
+  if (frame.channels() == 1) {
+    cv::cvtColor(frame, hud_frame_, cv::COLOR_GRAY2BGR);
+  } else {
+    frame.copyTo(hud_frame_);
+  }
+}
 
-    // Camera offset
-    if (p.get_name() == "camera_offset") {
-      camera_offset_ = p.as_double();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "camera_offset: %f m",
-        camera_offset_);
-      continue;
-    }
+/**
+ * @brief Converts a frame into an Image message.
+ *
+ * @param frame cv::Mat storing the frame.
+ * @return Shared pointer to a new Image message.
+ */
+Image::SharedPtr ArucoDetectorNode::frame_to_msg(cv::Mat & frame)
+{
+  auto ros_image = std::make_shared<Image>();
 
-    // Minimum error
-    if (p.get_name() == "error_min") {
-      error_min_ = p.as_double();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "error_min: %f m",
-        error_min_);
-      continue;
-    }
+  // Set frame-relevant image contents
+  ros_image->set__width(frame.cols);
+  ros_image->set__height(frame.rows);
+  ros_image->set__encoding(sensor_msgs::image_encodings::BGR8);
+  ros_image->set__step(frame.cols * frame.elemSize());
 
-    // Camera topic
-    if (p.get_name() == "camera_topic") {
-      camera_topic_ = p.as_string();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "camera_topic: %s",
-        camera_topic_.c_str());
-      continue;
-    }
+  // Check data endianness
+  ros_image->set__is_bigendian(false);
 
-    // Centering width
-    if (p.get_name() == "centering_width") {
-      centering_width_ = p.as_int();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "centering_width: %ld px",
-        centering_width_);
-      continue;
-    }
+  // Copy frame data (this avoids the obsolete cv_bridge)
+  size_t size = ros_image->step * frame.rows;
+  ros_image->data.resize(size);
+  memcpy(ros_image->data.data(), frame.data, size);
 
-    // Compute position flag
-    if (p.get_name() == "compute_position") {
-      compute_position_ = p.as_bool();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "compute_position: %s",
-        compute_position_ ? "true" : "false");
-      continue;
-    }
+  return ros_image;
+}
 
-    // Rotate image flag
-    if (p.get_name() == "rotate_image") {
-      rotate_image_ = p.as_bool();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "rotate_image: %s",
-        rotate_image_ ? "true" : "false");
-      continue;
-    }
+/**
+ * @brief Function to round angular measure to a fixed precision.
+ *
+ * @param num Value to round.
+ * @param prec 10 -> tenth of a degree
+ * @return Rounded value.
+ */
+float ArucoDetectorNode::round_angle(float num, float prec)
+{
+  num = num * 180.0 / M_PIf32;
 
-    // Target IDs
-    if (p.get_name() == "target_ids") {
-      target_ids_ = p.as_integer_array();
-      for (const auto & id : target_ids_) {
-        RCLCPP_INFO(
-          this->get_logger(),
-          "target ID: %ld",
-          id);
-      }
-      continue;
-    }
+  num *= prec;
+  num = floor(num);
+  num /= prec;
 
-    // Image transport
-    if (p.get_name() == "transport") {
-      transport_ = p.as_string();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "transport: %s",
-        transport_.c_str());
-      continue;
-    }
+  return num * M_PIf32 / 180.0;
+}
 
-    // Focal length
-    if (p.get_name() == "focal_length") {
-      focal_length_ = p.as_int();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "focal_length: %d px",
-        focal_length_);
-      continue;
-    }
-  }
+/**
+ * @brief Checks whether a name refers to a predefined ArUco dictionary.
+ *
+ * @param name Dictionary name.
+ * @return True if it is known.
+ */
+bool ArucoDetectorNode::is_aruco_dictionary(const std::string & name)
+{
+  return aruco_dictionaries.count(name) != 0;
+}
 
-  return res;
+/**
+ * @brief Checks whether a name refers to a corner refinement method.
+ *
+ * @param name Method name.
+ * @return True if it is known.
+ */
+bool ArucoDetectorNode::is_corner_refinement_method(const std::string & name)
+{
+  return corner_refinement_methods.count(name) != 0;
 }
 
 } // namespace ArucoDetector
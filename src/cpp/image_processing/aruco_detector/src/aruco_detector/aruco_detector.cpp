@@ -40,17 +40,22 @@ namespace ArucoDetector
  * @throws RuntimeError
  */
 ArucoDetectorNode::ArucoDetectorNode(const rclcpp::NodeOptions & opts)
-: Node("aruco_detector", opts)
+: Node("aruco_detector", opts),
+  init_time_(std::chrono::steady_clock::now()),
+  params_table_(this)
 {
   // Initialize synchronization primitives
   init_sync_primitives();
 
-  // Initialize callback groups
-  init_cgroups();
-
   // Initialize node parameters
   init_parameters();
 
+  // Back large image buffers with huge pages, on the NUMA node they are used on
+  init_large_buffers();
+
+  // Initialize callback groups
+  init_cgroups();
+
   // Initialize topic publishers
   init_publishers();
 
@@ -60,23 +65,37 @@ ArucoDetectorNode::ArucoDetectorNode(const rclcpp::NodeOptions & opts)
   // Initialize services
   init_services();
 
+  // Spawn threads for callback groups, if this node runs its own
+  if (cgroup_threads_) {
+    start_cgroup_threads();
+  }
+
   // Initialize camera ID for this Detector instance
-  //std::string node_name(this->get_name());
-  //if (node_name.find("bottom") != std::string::npos) {
-  //  camera_id_ = Target::BOTTOM_CAMERA;
-  //  RCLCPP_INFO(this->get_logger(), "Detector initializing for BOTTOM camera");
-  //} else if (node_name.find("tilted") != std::string::npos) {
-  //  camera_id_ = Target::TILTED_CAMERA;
-  //  RCLCPP_INFO(this->get_logger(), "Detector initializing for TILTED camera");
-  //} else if (node_name.find("front") != std::string::npos) {
-  //  camera_id_ = Target::FRONT_CAMERA;
-  //  RCLCPP_INFO(this->get_logger(), "Detector initializing for FRONT camera");
-  //} else {
-  //  camera_id_ = Target::UNKNOWN_CAMERA;
-  //  RCLCPP_ERROR(this->get_logger(), "No specific camera set");
-  //}
-
-  RCLCPP_INFO(this->get_logger(), "Node initialized");
+  std::string node_name(this->get_name());
+  if (node_name.find("bottom") != std::string::npos) {
+    camera_id_ = Target::BOTTOM_CAMERA;
+    RCLCPP_INFO(this->get_logger(), "Detector initializing for BOTTOM camera");
+  } else if (node_name.find("tilted") != std::string::npos) {
+    camera_id_ = Target::TILTED_CAMERA;
+    RCLCPP_INFO(this->get_logger(), "Detector initializing for TILTED camera");
+  } else if (node_name.find("front") != std::string::npos) {
+    camera_id_ = Target::FRONT_CAMERA;
+    RCLCPP_INFO(this->get_logger(), "Detector initializing for FRONT camera");
+  } else {
+    camera_id_ = Target::UNKNOWN_CAMERA;
+    RCLCPP_ERROR(this->get_logger(), "No specific camera set");
+  }
+
+  // Initialize marker detector now, or in the background if requested
+  if (deferred_init_) {
+    warmup_thread_ = std::thread{
+      &ArucoDetectorNode::warmup_routine,
+      this};
+    RCLCPP_INFO(this->get_logger(), "Node initialized, warming up");
+  } else {
+    warmup_routine();
+    RCLCPP_INFO(this->get_logger(), "Node initialized");
+  }
 }
 
 /**
@@ -84,15 +103,36 @@ ArucoDetectorNode::ArucoDetectorNode(const rclcpp::NodeOptions & opts)
  */
 ArucoDetectorNode::~ArucoDetectorNode()
 {
+  if (warmup_thread_.joinable()) {
+    warmup_thread_.join();
+  }
+
+  // Stop callback groups threads first, so that no callback runs from now on
+  if (cgroup_threads_) {
+    stop_cgroup_threads();
+  }
+
   // Unsubscribe from image topics
   if (is_on_) {
     camera_sub_.shutdown();
+    shm_camera_sub_.reset();
+    camera_info_sub_.reset();
+#ifdef WITH_CUDA
+    if (gpu_frames_) {
+      USBCameraDriver::GpuFrameHub::instance().unsubscribe(gpu_consumer_);
+    }
+#endif
+    if (async_detection()) {
+      stop_detector_thread();
+    }
     is_on_ = false;
   }
   //target_img_pub_.shutdown();
 
   // Destroy synchronization primitives
-  pthread_spin_destroy(&(this->pose_lock_));
+  pthread_spin_destroy(&(this->detector_lock_));
+  pthread_spin_destroy(&(this->intrinsics_lock_));
+  pthread_spin_destroy(&(this->params_lock_));
 }
 
 /**
@@ -102,18 +142,35 @@ ArucoDetectorNode::~ArucoDetectorNode()
  */
 void ArucoDetectorNode::init_sync_primitives()
 {
-  if (pthread_spin_init(&(this->pose_lock_), PTHREAD_PROCESS_PRIVATE)) {
+  if (pthread_spin_init(&(this->detector_lock_), PTHREAD_PROCESS_PRIVATE) ||
+    pthread_spin_init(&(this->intrinsics_lock_), PTHREAD_PROCESS_PRIVATE) ||
+    pthread_spin_init(&(this->params_lock_), PTHREAD_PROCESS_PRIVATE))
+  {
     throw std::runtime_error("Failed to initialize spinlocks");
   }
 }
 
 /**
  * @brief Routine to initialize callback groups.
+ *
+ * Groups that this node runs on its own threads are not added to the executor
+ * that the node is added to. Without such threads, image callbacks stay in the
+ * default group, to be serialized with parameter updates.
  */
 void ArucoDetectorNode::init_cgroups()
 {
-  pose_cgroup_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
-  enable_cgroup_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  bool add_to_executor = !cgroup_threads_;
+  pose_cgroup_ = this->create_callback_group(
+    rclcpp::CallbackGroupType::MutuallyExclusive,
+    add_to_executor);
+  enable_cgroup_ = this->create_callback_group(
+    rclcpp::CallbackGroupType::MutuallyExclusive,
+    add_to_executor);
+  if (cgroup_threads_) {
+    image_cgroup_ = this->create_callback_group(
+      rclcpp::CallbackGroupType::MutuallyExclusive,
+      false);
+  }
 }
 
 /**
@@ -121,102 +178,753 @@ void ArucoDetectorNode::init_cgroups()
  */
 void ArucoDetectorNode::init_parameters()
 {
-  // Register parameter updates callback
-  on_set_params_chandle_ = this->add_on_set_parameters_callback(
-    std::bind(
-      &ArucoDetectorNode::on_set_parameters_callback,
-      this,
-      std::placeholders::_1));
+  using namespace ROS2ParameterTable;
+
+  //! Detection parameters are published to detection threads once per update
+  size_t publish_detection_params = params_table_.add_batch_action(
+    [this]() -> void {
+      auto params = std::make_shared<const DetectionParams>(staged_params_);
+      pthread_spin_lock(&(this->params_lock_));
+      detection_params_ = params;
+      pthread_spin_unlock(&(this->params_lock_));
+    });
+
+  //! A new marker detector is built only once per update, after initialization
+  //! The deferred warm-up may be setting it concurrently, so it is read under lock
+  size_t rebuild_detector = params_table_.add_batch_action(
+    [this]() -> void {
+      pthread_spin_lock(&(this->detector_lock_));
+      bool initialized = detector_ != nullptr;
+      pthread_spin_unlock(&(this->detector_lock_));
+      if (initialized) {
+        init_detector();
+      }
+    });
+
+  // Adaptive threshold maximum window size
+  params_table_.add(
+    int_parameter(
+      "adaptive_thresh_win_size_max",
+      23, 3, 99, 1,
+      "Maximum window size for adaptive thresholding [pixels].",
+      "Must not be less than adaptive_thresh_win_size_min.",
+      false)
+    .validate_batch(
+      [this](const rclcpp::Parameter & p, const ParameterBatch & batch) -> std::string {
+        int64_t min = batch.value_or("adaptive_thresh_win_size_min", adaptive_thresh_win_size_min_);
+        if (p.as_int() < min) {
+          return "adaptive_thresh_win_size_max cannot be less than adaptive_thresh_win_size_min";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        adaptive_thresh_win_size_max_ = p.as_int();
+      })
+    .then(rebuild_detector)
+    .with_unit("px"));
+
+  // Adaptive threshold minimum window size
+  params_table_.add(
+    int_parameter(
+      "adaptive_thresh_win_size_min",
+      3, 3, 99, 1,
+      "Minimum window size for adaptive thresholding [pixels].",
+      "Must not be greater than adaptive_thresh_win_size_max.",
+      false)
+    .validate_batch(
+      [this](const rclcpp::Parameter & p, const ParameterBatch & batch) -> std::string {
+        int64_t max = batch.value_or("adaptive_thresh_win_size_max", adaptive_thresh_win_size_max_);
+        if (p.as_int() > max) {
+          return "adaptive_thresh_win_size_min cannot be greater than adaptive_thresh_win_size_max";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        adaptive_thresh_win_size_min_ = p.as_int();
+      })
+    .then(rebuild_detector)
+    .with_unit("px"));
+
+  // Adaptive threshold window size step
+  params_table_.add(
+    int_parameter(
+      "adaptive_thresh_win_size_step",
+      10, 1, 99, 1,
+      "Window size increment for adaptive thresholding [pixels].",
+      "Cannot be zero.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        adaptive_thresh_win_size_step_ = p.as_int();
+      })
+    .then(rebuild_detector)
+    .with_unit("px"));
+
+  // ArUco dictionary
+  params_table_.add(
+    string_parameter(
+      "aruco_dictionary",
+      "DICT_ARUCO_ORIGINAL",
+      "Predefined ArUco dictionary to detect markers from.",
+      "Must be the name of an OpenCV predefined dictionary.",
+      false)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        if (!is_aruco_dictionary(p.as_string())) {
+          return "Unknown ArUco dictionary";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        aruco_dictionary_ = p.as_string();
+      })
+    .then(rebuild_detector));
 
   // Aruco side
-  declare_double_parameter(
-    "aruco_side",
-    0.1, 0.1, 1.0, 0.0,
-    "Aruco marker side length.",
-    "Cannot be zero, must be in meters.",
-    false,
-    aruco_side_descriptor_);
+  params_table_.add(
+    double_parameter(
+      "aruco_side",
+      0.1, 0.1, 1.0, 0.0,
+      "Aruco marker side length.",
+      "Cannot be zero, must be in meters.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.aruco_side = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("m"));
+
+  // Latched CameraInfo flag
+  params_table_.add(
+    bool_parameter(
+      "camera_info_latched",
+      false,
+      "Expects CameraInfo published once, transient-local, by the camera driver.",
+      "Must match the driver setting, applied when the detector is enabled.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        camera_info_latched_ = p.as_bool();
+      }));
 
   // Camera offset
-  declare_double_parameter(
-    "camera_offset",
-    0.1, 0.0, 0.5, 0.0,
-    "Distance between camera and drone center.",
-    "Can be zero, must be in meters.",
-    false,
-    camera_offset_descriptor_);
+  params_table_.add(
+    double_parameter(
+      "camera_offset",
+      0.1, 0.0, 0.5, 0.0,
+      "Distance between camera and drone center.",
+      "Can be zero, must be in meters.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.camera_offset = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("m"));
 
   // Camera topic
-  declare_string_parameter(
-    "camera_topic",
-    "/usb_camera_driver/camera/image_color",
-    "Camera base topic name.",
-    "Cannot be changed.",
-    true,
-    camera_topic_descriptor_);
+  params_table_.add(
+    string_parameter(
+      "camera_topic",
+      "/usb_camera_driver/camera/image_color",
+      "Camera base topic name, color or grayscale (e.g. image_mono).",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        camera_topic_ = p.as_string();
+      }));
+
+  // Callback groups threads flag
+  params_table_.add(
+    bool_parameter(
+      "cgroup_threads",
+      false,
+      "Runs image and enable service callbacks on two threads owned by this node, instead of the executor ones.",
+      "Cannot be changed, parameter updates then run concurrently with detection.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        cgroup_threads_ = p.as_bool();
+      }));
 
   // Centering width
-  declare_int_parameter(
-    "centering_width",
-    100, 2, 1000, 2,
-    "Centering zone width [pixels].",
-    "Cannot be changed.",
-    true,
-    centering_width_descriptor_);
+  params_table_.add(
+    int_parameter(
+      "centering_width",
+      100, 2, 1000, 2,
+      "Centering zone width [pixels].",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        centering_width_ = p.as_int();
+      })
+    .with_unit("px"));
 
   // Compute position flag
-  declare_bool_parameter(
-    "compute_position",
-    false,
-    "Enables target position computation.",
-    "Cannot be changed.",
-    true,
-    compute_position_descriptor_);
+  params_table_.add(
+    bool_parameter(
+      "compute_position",
+      false,
+      "Enables target position computation.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        compute_position_ = p.as_bool();
+      }));
+
+  // Corner refinement method
+  params_table_.add(
+    string_parameter(
+      "corner_refinement",
+      "NONE",
+      "Marker corners refinement method.",
+      "Either NONE, SUBPIX, CONTOUR or APRILTAG.",
+      false)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        if (!is_corner_refinement_method(p.as_string())) {
+          return "Unknown corner refinement method";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        corner_refinement_ = p.as_string();
+      })
+    .then(rebuild_detector));
+
+  // Deferred initialization flag
+  params_table_.add(
+    bool_parameter(
+      "deferred_init",
+      false,
+      "Builds the marker detector in the background, after construction.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        deferred_init_ = p.as_bool();
+      }));
+
+  // Detector pool size
+  params_table_.add(
+    int_parameter(
+      "detector_pool_size",
+      0, 0, 64, 1,
+      "Shares this many detection threads among all detectors in the process, 0 disables the pool.",
+      "Cannot be changed, only the first detector to join sets the pool size.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        detector_pool_size_ = p.as_int();
+      }));
+
+  // Detector pool priority
+  params_table_.add(
+    int_parameter(
+      "detector_priority",
+      0, 0, 99, 1,
+      "Priority of this camera in the detector pool, higher values are served first.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        detector_priority_ = p.as_int();
+      }));
 
   // Minimum error
-  declare_double_parameter(
-    "error_min",
-    0.1, 0.0, 1.0, 0.0,
-    "Minimum relevant displacement error. [m]",
-    "Absolute, cannot be changed.",
-    true,
-    error_min_descriptor_);
+  params_table_.add(
+    double_parameter(
+      "error_min",
+      0.1, 0.0, 1.0, 0.0,
+      "Minimum relevant displacement error. [m]",
+      "Absolute, cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        error_min_ = p.as_double();
+      })
+    .with_unit("m"));
+
+  // GPU frames flag
+  params_table_.add(
+    bool_parameter(
+      "gpu_frames",
+      false,
+      "Consumes GPU-resident rectified frames from a camera driver in the same process.",
+      "Cannot be changed, requires CUDA builds and camera_topic set to the rectified topic.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        gpu_frames_ = p.as_bool();
+      }));
+
+  // HUD image rate
+  params_table_.add(
+    double_parameter(
+      "hud_rate",
+      0.0, 0.0, 100.0, 0.0,
+      "Maximum HUD image publishing rate [Hz], 0.0 draws it for every frame.",
+      "HUD images are drawn only if someone subscribed to them.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.hud_rate = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("Hz"));
+
+  // HUD rotation hint flag
+  params_table_.add(
+    bool_parameter(
+      "hud_rotation_hint",
+      false,
+      "With rotate_image, publishes HUD images unrotated, leaving rotation to the viewer.",
+      "Overlays are drawn for the rotated view, the rotation is published on ~/targets/image_rect_color/rotation.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.hud_rotation_hint = p.as_bool();
+      })
+    .then(publish_detection_params));
+
+  // Huge pages mode
+  params_table_.add(
+    string_parameter(
+      "huge_pages",
+      "none",
+      "Pages backing large image buffers: none, transparent or explicit.",
+      "Cannot be changed, explicit huge pages must be reserved (vm.nr_hugepages).",
+      true)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        USBCameraDriver::HugePages pages;
+        if (!USBCameraDriver::HugePageAllocator::parse_pages(p.as_string(), pages)) {
+          return "Unknown huge pages mode";
+        }
+        return "";
+      }));
+
+  // Image thread CPU
+  params_table_.add(
+    int_parameter(
+      "image_thread_cpu",
+      -1, -1, 63, 1,
+      "CPU to run the image callbacks thread on, -1 for any.",
+      "Cannot be changed, requires cgroup_threads.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        image_thread_cpu_ = p.as_int();
+      }));
+
+  // Image thread priority
+  params_table_.add(
+    int_parameter(
+      "image_thread_priority",
+      0, 0, 99, 1,
+      "SCHED_FIFO priority of the image callbacks thread, 0 for normal scheduling.",
+      "Cannot be changed, requires cgroup_threads.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        image_thread_priority_ = p.as_int();
+      }));
+
+  // Detection time budget
+  params_table_.add(
+    double_parameter(
+      "latency_budget",
+      0.0, 0.0, 1000.0, 0.0,
+      "Detection time budget per frame [ms], exceeding which detection is degraded; 0 disables.",
+      "Detection switches to ROI, downscaled, then decimated modes to stay in budget.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.latency_budget = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("ms"));
+
+  // Marker map outlier threshold
+  params_table_.add(
+    double_parameter(
+      "map_max_error",
+      2.0, 0.1, 20.0, 0.0,
+      "Reprojection error beyond which mapped markers are rejected as outliers.",
+      "RMS over the marker corners, must be in pixels.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.map_max_error = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("px"));
+
+  // Marker map layout file
+  params_table_.add(
+    string_parameter(
+      "marker_map_file",
+      "",
+      "Layout of markers with known poses, localized together; empty disables.",
+      "Requires pose_estimation, see config/marker_map.txt for the file format.",
+      false)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        MarkerMap map;
+        std::string error;
+        if (!p.as_string().empty() && !map.load(p.as_string(), error)) {
+          return "Invalid marker map: " + error;
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        marker_map_file_ = p.as_string();
+        std::shared_ptr<MarkerMap> map;
+        std::string error;
+        if (!marker_map_file_.empty()) {
+          map = std::make_shared<MarkerMap>();
+          if (map->load(marker_map_file_, error)) {
+            RCLCPP_INFO(
+              this->get_logger(),
+              "Loaded %zu markers from %s",
+              map->markers.size(),
+              marker_map_file_.c_str());
+          } else {
+            RCLCPP_ERROR(this->get_logger(), "Invalid marker map: %s", error.c_str());
+            map.reset();
+          }
+        }
+        pthread_spin_lock(&(this->intrinsics_lock_));
+        marker_map_ = map;
+        pthread_spin_unlock(&(this->intrinsics_lock_));
+      }));
+
+  // Maximum marker perimeter rate
+  params_table_.add(
+    double_parameter(
+      "max_marker_perimeter_rate",
+      4.0, 0.0, 8.0, 0.0,
+      "Maximum marker perimeter, w.r.t. the largest image dimension.",
+      "Must be greater than min_marker_perimeter_rate.",
+      false)
+    .validate_batch(
+      [this](const rclcpp::Parameter & p, const ParameterBatch & batch) -> std::string {
+        double min = batch.value_or("min_marker_perimeter_rate", min_marker_perimeter_rate_);
+        if (p.as_double() <= min) {
+          return "max_marker_perimeter_rate must be greater than min_marker_perimeter_rate";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        max_marker_perimeter_rate_ = p.as_double();
+      })
+    .then(rebuild_detector));
+
+  // Minimum marker perimeter rate
+  params_table_.add(
+    double_parameter(
+      "min_marker_perimeter_rate",
+      0.03, 0.0, 8.0, 0.0,
+      "Minimum marker perimeter, w.r.t. the largest image dimension.",
+      "Must be less than max_marker_perimeter_rate.",
+      false)
+    .validate_batch(
+      [this](const rclcpp::Parameter & p, const ParameterBatch & batch) -> std::string {
+        double max = batch.value_or("max_marker_perimeter_rate", max_marker_perimeter_rate_);
+        if (p.as_double() >= max) {
+          return "min_marker_perimeter_rate must be less than max_marker_perimeter_rate";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        min_marker_perimeter_rate_ = p.as_double();
+      })
+    .then(rebuild_detector));
+
+  // NUMA binding flag
+  params_table_.add(
+    bool_parameter(
+      "numa_bind",
+      false,
+      "Binds large image buffers to the NUMA node of the thread that processes frames.",
+      "Cannot be changed, pin processing threads for a stable binding.",
+      true));
+
+  // Polygonal approximation accuracy rate
+  params_table_.add(
+    double_parameter(
+      "polygonal_approx_accuracy_rate",
+      0.03, 0.0, 1.0, 0.0,
+      "Contour polygonal approximation accuracy, w.r.t. the contour length.",
+      "Must be a fraction of the contour length.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        polygonal_approx_accuracy_rate_ = p.as_double();
+      })
+    .then(rebuild_detector));
+
+  // Marker pose estimation flag
+  params_table_.add(
+    bool_parameter(
+      "pose_estimation",
+      false,
+      "Estimates full marker poses from camera intrinsics.",
+      "Requires CameraInfo from the camera driver.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.pose_estimation = p.as_bool();
+      })
+    .then(publish_detection_params));
+
+  // Coarse-to-fine detection scale
+  params_table_.add(
+    double_parameter(
+      "pyramid_scale",
+      1.0, 0.1, 1.0, 0.0,
+      "Scale of the image that candidates are detected on, 1.0 disables coarse-to-fine detection.",
+      "Corners are always refined at full resolution.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.pyramid_scale = p.as_double();
+      })
+    .then(publish_detection_params));
+
+  // ROI tracking full search period
+  params_table_.add(
+    int_parameter(
+      "roi_full_search_period",
+      10, 1, 1000, 1,
+      "Frames between full-frame searches in ROI tracking mode.",
+      "Cannot be zero.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.roi_full_search_period = p.as_int();
+      })
+    .then(publish_detection_params)
+    .with_unit("frames"));
+
+  // ROI tracking padding
+  params_table_.add(
+    double_parameter(
+      "roi_padding",
+      0.5, 0.0, 5.0, 0.0,
+      "Padding of tracking regions of interest, w.r.t. the marker size.",
+      "Must account for the target motion between frames.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.roi_padding = p.as_double();
+      })
+    .then(publish_detection_params));
+
+  // ROI tracking flag
+  params_table_.add(
+    bool_parameter(
+      "roi_tracking",
+      false,
+      "Searches targets only around their previous positions, with periodic full-frame searches.",
+      "Falls back to full-frame searches whenever a target is lost.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.roi_tracking = p.as_bool();
+      })
+    .then(publish_detection_params));
 
   // Rotate image flag
-  declare_bool_parameter(
-    "rotate_image",
-    false,
-    "Enables rotation for vertically-mounted cameras.",
-    "Cannot be changed.",
-    true,
-    rotate_image_descriptor_);
+  params_table_.add(
+    bool_parameter(
+      "rotate_image",
+      false,
+      "Enables rotation for vertically-mounted cameras.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        rotate_image_ = p.as_bool();
+      }));
 
   // Target IDs
-  declare_int_array_parameter(
-    "target_ids",
-    {15}, 0, 1023, 1,
-    "IDs of targets to look for.",
-    "Cannot be changed.",
-    true,
-    target_ids_descriptor_);
+  params_table_.add(
+    int_array_parameter(
+      "target_ids",
+      {15}, 0, 1023, 1,
+      "IDs of targets to look for.",
+      "Cannot be changed.",
+      true)
+    .validate(
+      [this](const rclcpp::Parameter & p) -> std::string {
+        for (int64_t id : p.as_integer_array()) {
+          if (id < 0 || id >= int64_t(target_ids_filter_.size())) {
+            return "Invalid target ID";
+          }
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        target_ids_ = p.as_integer_array();
+        target_ids_filter_.reset();
+        for (int64_t id : target_ids_) {
+          target_ids_filter_.set(size_t(id));
+        }
+      }));
+
+  // Target tracking flag
+  params_table_.add(
+    bool_parameter(
+      "target_tracking",
+      false,
+      "Predicts targets between detections, that run at tracking_detection_rate.",
+      "Detection also runs as soon as predictions get too uncertain.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.target_tracking = p.as_bool();
+      })
+    .then(publish_detection_params));
+
+  // Pipeline tracing flag
+  params_table_.add(
+    bool_parameter(
+      "trace",
+      false,
+      "Publishes receive, detection and targets publishing times of every frame, for pipeline latency tracing.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        trace_ = p.as_bool();
+      }));
+
+  // Target tracking acceleration
+  params_table_.add(
+    double_parameter(
+      "tracking_acceleration",
+      300.0, 1.0, 100000.0, 0.0,
+      "Expected target acceleration in the image, that predictions get uncertain with [pixels/s^2].",
+      "Higher values trigger detections more often.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.tracking_acceleration = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("px/s^2"));
+
+  // Target tracking detection rate
+  params_table_.add(
+    double_parameter(
+      "tracking_detection_rate",
+      10.0, 0.1, 1000.0, 0.0,
+      "Minimum marker detection rate in tracking mode [Hz].",
+      "Targets are predicted at the camera rate anyway.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.tracking_detection_rate = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("Hz"));
+
+  // Target tracking maximum uncertainty
+  params_table_.add(
+    double_parameter(
+      "tracking_max_uncertainty",
+      4.0, 0.1, 100.0, 0.0,
+      "Predicted corner position standard deviation that triggers a detection [pixels].",
+      "Lower values trigger detections more often.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        staged_params_.tracking_max_uncertainty = p.as_double();
+      })
+    .then(publish_detection_params)
+    .with_unit("px"));
 
   // Image transport
-  declare_string_parameter(
-    "transport",
-    "compressed",
-    "Image transport to use.",
-    "Cannot be changed.",
-    true,
-    transport_descriptor_);
+  params_table_.add(
+    string_parameter(
+      "transport",
+      "compressed",
+      "Image transport to use, shm for shared memory frames from the camera driver.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        transport_ = p.as_string();
+      }));
 
   // Focal length
-  declare_int_parameter(
-    "focal_length",
-    0, 0, 2047, 1,
-    "Camera focal length.",
-    "Cannot be changed.",
-    true,
-    focal_length_descriptor_);
+  params_table_.add(
+    int_parameter(
+      "focal_length",
+      0, 0, 2047, 1,
+      "Camera focal length.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        focal_length_ = int(p.as_int());
+      })
+    .with_unit("px"));
+
+  // Detector thread flag
+  params_table_.add(
+    bool_parameter(
+      "worker_thread",
+      false,
+      "Runs detection in a separate thread on the latest frame only, dropping stale ones.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        worker_thread_ = p.as_bool();
+      }));
+
+  // Detector thread CPU
+  params_table_.add(
+    int_parameter(
+      "worker_thread_cpu",
+      -1, -1, 63, 1,
+      "CPU to run the detector thread on, -1 for any.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        worker_thread_cpu_ = p.as_int();
+      }));
+
+  // Detector thread priority
+  params_table_.add(
+    int_parameter(
+      "worker_thread_priority",
+      0, 0, 99, 1,
+      "SCHED_FIFO priority of the detector thread, 0 for normal scheduling.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        worker_thread_priority_ = p.as_int();
+      }));
+
+  // Declare them all at once, dispatching updates to the table from now on
+  params_table_.declare();
 }
 
 /**
@@ -247,16 +955,46 @@ void ArucoDetectorNode::init_publishers()
     "~/camera_rate",
     rclcpp::QoS(1));
 
+  // Camera pose w.r.t. the marker map
+  map_pose_pub_ = this->create_publisher<geometry_msgs::msg::PoseStamped>(
+    "~/map_pose",
+    rclcpp::QoS(10));
+
+  // Detection status
+  status_pub_ = this->create_publisher<DetectorStatus>(
+    "~/status",
+    rclcpp::QoS(1).transient_local());
+
+  // Readiness
+  ready_pub_ = this->create_publisher<Bool>(
+    "~/ready",
+    rclcpp::QoS(1).transient_local());
+  Bool ready_msg;
+  ready_msg.set__data(false);
+  ready_pub_->publish(ready_msg);
+
+  // Pipeline trace, if requested
+  if (trace_) {
+    trace_pub_ = this->create_publisher<ros2_usb_camera::msg::FrameTrace>(
+      "~/trace",
+      rclcpp::QoS(100));
+  }
+
   // Target data
-  //target_pub_ = this->create_publisher<Target>(
-  //  "/targets",
-  //  rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(ad_targets_qos_profile)));
+  target_pub_ = this->create_publisher<TargetArray>(
+    "/targets",
+    rclcpp::QoS(10));
 
   // Target images
   target_img_pub_ = image_transport::create_publisher(
     this,
     "~/targets/image_rect_color",
     rmw_qos_profile_sensor_data);
+
+  // Rotation that viewers should apply to target images
+  target_img_rotation_pub_ = this->create_publisher<Int32>(
+    "~/targets/image_rect_color/rotation",
+    rclcpp::QoS(1).transient_local());
 }
 
 /**
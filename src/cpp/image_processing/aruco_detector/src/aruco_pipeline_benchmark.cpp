@@ -0,0 +1,262 @@
+/**
+ * Aruco Detector frame processing pipeline benchmark.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <aruco_detector/aruco_detector.hpp>
+
+/* Heap allocations counter, for the whole process */
+static std::atomic<uint64_t> allocations{0};
+
+void * operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void * p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+  std::free(p);
+}
+
+namespace ArucoDetector
+{
+
+/**
+ * Runs the detector stages on recorded or synthetic frames.
+ */
+struct PipelineBenchmark
+{
+  /* Per-stage accumulated measurements */
+  struct Stage
+  {
+    const char * name;
+    double ns = 0.0;
+    uint64_t allocs = 0;
+  };
+
+  /**
+   * @brief Runs all stages on a set of frames, reporting per-stage averages.
+   *
+   * @param node Detector node.
+   * @param label Frame set label.
+   * @param frames Frames to process.
+   * @param iterations Number of times the set is processed.
+   */
+  static void run(
+    ArucoDetectorNode & node,
+    const std::string & label,
+    const std::vector<cv::Mat> & frames,
+    int iterations)
+  {
+    Stage stages[] = {{"detect"}, {"targets"}, {"hud"}};
+    std::vector<int> ids;
+    std::vector<std::vector<cv::Point2f>> corners;
+    builtin_interfaces::msg::Time stamp;
+    size_t detected = 0;
+
+    // Warm up buffers and the detector, then measure
+    for (int it = -1; it < iterations; it++) {
+      for (const cv::Mat & frame : frames) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t a0 = allocations.load(std::memory_order_relaxed);
+        node.detect_targets(frame, ids, corners);
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t a1 = allocations.load(std::memory_order_relaxed);
+        node.publish_targets(frame.size(), ids, corners, stamp);
+        auto t2 = std::chrono::steady_clock::now();
+        uint64_t a2 = allocations.load(std::memory_order_relaxed);
+        node.copy_hud_frame(frame);
+        node.publish_hud(node.hud_frame_, ids, corners, stamp);
+        auto t3 = std::chrono::steady_clock::now();
+        uint64_t a3 = allocations.load(std::memory_order_relaxed);
+        if (it < 0) {
+          continue;
+        }
+        stages[0].ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        stages[1].ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+        stages[2].ns += std::chrono::duration<double, std::nano>(t3 - t2).count();
+        stages[0].allocs += a1 - a0;
+        stages[1].allocs += a2 - a1;
+        stages[2].allocs += a3 - a2;
+        detected += ids.size();
+      }
+    }
+
+    double n = double(iterations) * double(frames.size());
+    for (const Stage & s : stages) {
+      printf(
+        "BM_%s/%s %14.0f ns/frame %10.1f allocs/frame\n",
+        s.name,
+        label.c_str(),
+        s.ns / n,
+        double(s.allocs) / n);
+    }
+    printf("# %s: %.1f markers/frame detected\n", label.c_str(), double(detected) / n);
+  }
+};
+
+} // namespace ArucoDetector
+
+using namespace ArucoDetector;
+
+/**
+ * @brief Generates frames with markers scattered on a noisy background.
+ *
+ * @param size Frame size.
+ * @param markers Number of markers per frame, with IDs from 0.
+ * @param count Number of frames.
+ * @return Synthetic frames.
+ */
+static std::vector<cv::Mat> synthetic_frames(cv::Size size, int markers, int count)
+{
+  std::mt19937 rng(42);
+#ifdef ARUCO_API_OLD
+  cv::Ptr<cv::aruco::Dictionary> dictionary =
+    cv::aruco::getPredefinedDictionary(cv::aruco::DICT_ARUCO_ORIGINAL);
+#else
+  cv::aruco::Dictionary dictionary =
+    cv::aruco::getPredefinedDictionary(cv::aruco::DICT_ARUCO_ORIGINAL);
+#endif
+
+  // Markers are laid out on a grid, so that they never overlap
+  int cols = int(std::ceil(std::sqrt(double(markers))));
+  int cell = std::min(size.width, size.height) / (cols + 1);
+  int side = cell * 2 / 3;
+  std::vector<cv::Mat> frames;
+  for (int f = 0; f < count; f++) {
+    cv::Mat frame(size, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(96), cv::Scalar::all(160));
+    for (int m = 0; m < markers; m++) {
+      cv::Mat marker, marker_bgr;
+#ifdef ARUCO_API_OLD
+      cv::aruco::drawMarker(dictionary, m, side, marker);
+#else
+      cv::aruco::generateImageMarker(dictionary, m, side, marker);
+#endif
+      cv::copyMakeBorder(marker, marker, side / 8, side / 8, side / 8, side / 8,
+        cv::BORDER_CONSTANT, cv::Scalar(255));
+      cv::cvtColor(marker, marker_bgr, cv::COLOR_GRAY2BGR);
+      int x = (m % cols) * cell + cell / 2 + int(rng() % 8);
+      int y = (m / cols) * cell + cell / 2 + int(rng() % 8);
+      cv::Rect roi(x, y, marker_bgr.cols, marker_bgr.rows);
+      if ((roi & cv::Rect(cv::Point(), size)) == roi) {
+        marker_bgr.copyTo(frame(roi));
+      }
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+/**
+ * @brief Loads recorded frames from a directory.
+ *
+ * @param dir Directory path.
+ * @return Frames, in file name order.
+ */
+static std::vector<cv::Mat> recorded_frames(const std::string & dir)
+{
+  std::vector<cv::String> files;
+  cv::glob(dir + "/*", files, false);
+  std::sort(files.begin(), files.end());
+  std::vector<cv::Mat> frames;
+  for (const cv::String & file : files) {
+    cv::Mat frame = cv::imread(file, cv::IMREAD_COLOR);
+    if (!frame.empty()) {
+      frames.push_back(frame);
+    }
+  }
+  return frames;
+}
+
+int main(int argc, char ** argv)
+{
+  // Usage: aruco_pipeline_benchmark [iterations] [frames directory]
+  int iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+  std::string dir = argc > 2 ? argv[2] : "";
+
+  rclcpp::init(1, argv);
+  std::vector<int64_t> target_ids;
+  for (int64_t id = 0; id < 64; id++) {
+    target_ids.push_back(id);
+  }
+  rclcpp::NodeOptions opts;
+  opts.parameter_overrides(
+  {
+    {"aruco_side", 0.15},
+    {"compute_position", true},
+    {"focal_length", 500},
+    {"target_ids", target_ids}
+  });
+  auto node = std::make_shared<ArucoDetectorNode>(opts);
+
+  if (!dir.empty()) {
+    std::vector<cv::Mat> frames = recorded_frames(dir);
+    if (frames.empty()) {
+      fprintf(stderr, "No frames found in %s\n", dir.c_str());
+      rclcpp::shutdown();
+      exit(EXIT_FAILURE);
+    }
+    PipelineBenchmark::run(*node, "recorded", frames, iterations);
+  } else {
+    const cv::Size sizes[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+    const int markers[] = {1, 4, 16};
+    for (const cv::Size & size : sizes) {
+      for (int m : markers) {
+        std::string label =
+          std::to_string(size.width) + "x" + std::to_string(size.height) + "/" + std::to_string(m);
+        PipelineBenchmark::run(*node, label, synthetic_frames(size, m, 8), iterations);
+      }
+    }
+  }
+
+  node.reset();
+  rclcpp::shutdown();
+  exit(EXIT_SUCCESS);
+}
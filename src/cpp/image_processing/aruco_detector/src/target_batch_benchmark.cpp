@@ -0,0 +1,163 @@
+/**
+ * Aruco Detector batched target geometry microbenchmark.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * August 16, 2022
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <aruco_detector/target_batch.hpp>
+
+using namespace ArucoDetector;
+
+/* Camera and drone state used for all samples */
+static const int width = 1280;
+static const int height = 720;
+static const double altitude = 2.0;
+static const double focal_length = 900.0;
+static const double error_min = 0.01;
+static const double yaw = 0.7;
+
+/**
+ * @brief Per-marker scalar computation, as done before batching.
+ *
+ * @param c Marker corners.
+ * @param xc Marker center horizontal coordinate to populate.
+ * @param yc Marker center vertical coordinate to populate.
+ * @param x_err Position error along x to populate.
+ * @param y_err Position error along y to populate.
+ * @return False if the marker was discarded.
+ */
+static bool scalar_target(
+  const std::vector<cv::Point2f> & c,
+  double & xc, double & yc,
+  double & x_err, double & y_err)
+{
+  double x1 = c[0].x, y1 = c[0].y;
+  double x2 = c[1].x, y2 = c[1].y;
+  double x3 = c[2].x, y3 = c[2].y;
+  double x4 = c[3].x, y4 = c[3].y;
+
+  double den = (-((x2 - x4) * (y1 - y3)) + (x1 - x3) * (y2 - y4));
+  if (std::abs(den) < 1e-5) {
+    return false;
+  }
+  xc = (x3 * x4 * (y1 - y2) + x1 * x4 * (y2 - y3) + x1 * x2 * (y3 - y4) + x2 * x3 * (-y1 + y4)) /
+    den;
+  yc = (x4 * y2 * (y1 - y3) + x1 * y2 * y3 - x2 * y1 * y4 - x1 * y3 * y4 + x2 * y3 * y4 + x3 * y1 *
+    (-y2 + y4)) / den;
+
+  double err_x = -(altitude * (xc - (width / 2))) / focal_length;
+  double err_y = -(altitude * (yc - (height / 2))) / focal_length;
+  if (std::sqrt(std::pow(err_x, 2) + std::pow(err_y, 2)) <= error_min) {
+    err_x = 0.0;
+    err_y = 0.0;
+  }
+  x_err = std::floor((err_x * std::cos(yaw) - err_y * std::sin(yaw)) * 100.0) / 100.0;
+  y_err = std::floor((err_x * std::sin(yaw) + err_y * std::cos(yaw)) * 100.0) / 100.0;
+  return true;
+}
+
+int main(int argc, char ** argv)
+{
+  size_t n_markers = argc > 1 ? size_t(std::atoi(argv[1])) : 16;
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 100000;
+
+  // Generate randomly placed, rotated and scaled markers
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> px(100.0f, float(width - 100));
+  std::uniform_real_distribution<float> py(100.0f, float(height - 100));
+  std::uniform_real_distribution<float> side(10.0f, 80.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 6.28f);
+  std::vector<std::vector<cv::Point2f>> markers(n_markers);
+  for (auto & m : markers) {
+    float cx = px(rng), cy = py(rng), s = side(rng), a = angle(rng);
+    for (int j = 0; j < 4; j++) {
+      float t = a + float(j) * 1.5708f;
+      m.push_back(cv::Point2f(cx + s * std::cos(t), cy + s * std::sin(t)));
+    }
+  }
+
+  // Per-marker path
+  double sink = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < iterations; it++) {
+    for (const auto & m : markers) {
+      double xc, yc, x_err, y_err;
+      if (scalar_target(m, xc, yc, x_err, y_err)) {
+        sink += xc + yc + x_err + y_err;
+      }
+    }
+  }
+  double scalar_ns = std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count();
+
+  // Batched path
+  TargetBatch batch;
+  start = std::chrono::steady_clock::now();
+  for (int it = 0; it < iterations; it++) {
+    batch.clear();
+    for (const auto & m : markers) {
+      batch.push(m, 0.0f);
+    }
+    compute_target_centers(batch);
+    compute_target_positions(
+      batch,
+      float(width / 2), float(height / 2),
+      float(altitude), float(focal_length), float(error_min), float(yaw));
+    for (size_t k = 0; k < batch.size; k++) {
+      sink += batch.xc[k] + batch.yc[k] + batch.err_x[k] + batch.err_y[k];
+    }
+  }
+  double batch_ns = std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count();
+
+  // Check that both paths agree
+  double max_center_diff = 0.0;
+  int position_mismatches = 0;
+  for (size_t k = 0; k < n_markers; k++) {
+    double xc, yc, x_err, y_err;
+    if (!scalar_target(markers[k], xc, yc, x_err, y_err) || !batch.valid[k]) {
+      continue;
+    }
+    max_center_diff = std::max(max_center_diff, std::abs(xc - batch.xc[k]));
+    max_center_diff = std::max(max_center_diff, std::abs(yc - batch.yc[k]));
+    if (std::abs(x_err - batch.err_x[k]) > 0.011 || std::abs(y_err - batch.err_y[k]) > 0.011) {
+      position_mismatches++;
+    }
+  }
+
+  double samples = double(iterations) * double(n_markers);
+  printf("markers: %zu, iterations: %d\n", n_markers, iterations);
+  printf("per-marker: %.2f ns/marker\n", scalar_ns / samples);
+  printf("batched:    %.2f ns/marker\n", batch_ns / samples);
+  printf("max center difference: %.6f px\n", max_center_diff);
+  printf("position mismatches: %d\n", position_mismatches);
+  printf("(checksum %g)\n", sink);
+  return position_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,183 @@
+/**
+ * ROS 2 USB Camera Driver recyclable message buffers pool.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_BUFFER_POOL_HPP
+#define ROS2_USB_CAMERA_BUFFER_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Fixed-size ring of recyclable, shared objects.
+ *
+ * Each object handed out is marked as owned until its last reference, shared or
+ * weak, is gone, i.e. once all subscribers have released it; then it can be
+ * reused without any new heap allocation, since the control block of its
+ * pointer is stored in its own slot too. Objects may outlive the pool. Must be
+ * acquired from by a single thread at a time.
+ */
+template<typename T>
+class BufferPool
+{
+public:
+  /**
+   * @brief Builds a new BufferPool, preallocating all its objects.
+   *
+   * @param size Number of objects in the ring, zero disables the pool.
+   */
+  explicit BufferPool(size_t size)
+  : slots_(new Slot[size]), size_(size)
+  {}
+
+  /**
+   * @brief Gets the next free object, or a new one if the pool is exhausted.
+   *
+   * @return Shared pointer to the object.
+   */
+  std::shared_ptr<T> acquire()
+  {
+    for (size_t i = 0; i < size_; i++) {
+      Slot & slot = slots_[next_];
+      next_ = (next_ + 1) % size_;
+      //! Pairs with the release in SlotAllocator::deallocate, so that the last
+      //! owner's writes to the object happen before it is reused
+      if (!slot.owned.load(std::memory_order_acquire)) {
+        slot.owned.store(true, std::memory_order_relaxed);
+        return std::shared_ptr<T>(
+          &slot.object,
+          [](T *) {},
+          SlotAllocator<T>(std::shared_ptr<Slot>(slots_, &slot)));
+      }
+    }
+    if (size_ > 0) {
+      exhaustions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::make_shared<T>();
+  }
+
+  /**
+   * @brief Returns the number of times a new object had to be allocated.
+   *
+   * @return Pool exhaustions count.
+   */
+  uint64_t exhaustions() const
+  {
+    return exhaustions_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of objects in the ring.
+   *
+   * @return Pool size.
+   */
+  size_t size() const
+  {
+    return size_;
+  }
+
+private:
+  /* Room for the control block of a handed-out pointer, which holds the slot reference. */
+  static constexpr size_t CONTROL_BLOCK_SIZE = 64;
+
+  /**
+   * Pooled object, with its ownership flag and the storage for its control block.
+   */
+  struct Slot
+  {
+    T object;
+    std::atomic<bool> owned{false};
+    alignas(std::max_align_t) unsigned char control_block[CONTROL_BLOCK_SIZE];
+  };
+
+  /**
+   * Allocates the control block of a handed-out pointer in its slot, and frees
+   * the slot when the control block is deallocated, i.e. after the last
+   * reference to the object is gone. Keeps the slots alive until then.
+   */
+  template<typename U>
+  struct SlotAllocator
+  {
+    using value_type = U;
+
+    explicit SlotAllocator(std::shared_ptr<Slot> && s)
+    : slot(std::move(s))
+    {}
+
+    template<typename V>
+    SlotAllocator(const SlotAllocator<V> & other)
+    : slot(other.slot)
+    {}
+
+    U * allocate(size_t n)
+    {
+      if (sizeof(U) * n <= CONTROL_BLOCK_SIZE && alignof(U) <= alignof(std::max_align_t)) {
+        return reinterpret_cast<U *>(slot->control_block);
+      }
+      return std::allocator<U>().allocate(n);
+    }
+
+    void deallocate(U * p, size_t n)
+    {
+      if (reinterpret_cast<unsigned char *>(p) != slot->control_block) {
+        std::allocator<U>().deallocate(p, n);
+      }
+      slot->owned.store(false, std::memory_order_release);
+    }
+
+    template<typename V>
+    bool operator==(const SlotAllocator<V> & other) const
+    {
+      return slot == other.slot;
+    }
+
+    template<typename V>
+    bool operator!=(const SlotAllocator<V> & other) const
+    {
+      return slot != other.slot;
+    }
+
+    std::shared_ptr<Slot> slot;
+  };
+
+  std::shared_ptr<Slot[]> slots_;
+  size_t size_;
+  size_t next_ = 0;
+  std::atomic<uint64_t> exhaustions_{0};
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_BUFFER_POOL_HPP
@@ -0,0 +1,154 @@
+/**
+ * ROS 2 USB Camera Driver black-box frame recorder.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_FRAME_RECORDER_HPP
+#define ROS2_USB_CAMERA_FRAME_RECORDER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Formats of recorded frames.
+ */
+enum class RecordFormat : uint32_t
+{
+  BGR8 = 1, // Color frames, row after row
+  JPEG = 2  // Device JPEG frames, as they came
+};
+
+/**
+ * Black-box recorder that keeps the latest frames in a memory-mapped ring file.
+ *
+ * The file is allocated once, and frames are copied into it one after the
+ * other, each record starting on a page boundary, so writing costs a single
+ * sequential copy and no allocation. When full, the ring wraps and overwrites
+ * the oldest frames. Since the kernel writes mapped pages back by itself, the
+ * ring survives crashes of the process, and is resumed on the next start.
+ *
+ * Frames are exported on demand, which freezes recording meanwhile.
+ */
+class FrameRecorder
+{
+public:
+  FrameRecorder() = default;
+  ~FrameRecorder();
+
+  FrameRecorder(const FrameRecorder &) = delete;
+  FrameRecorder & operator=(const FrameRecorder &) = delete;
+
+  bool open(const std::string & path, size_t size);
+  void close();
+
+  bool write(
+    RecordFormat format,
+    uint32_t width, uint32_t height, uint32_t step,
+    const uint8_t * data, size_t size,
+    int64_t stamp);
+  size_t export_to(const std::string & dir);
+
+  /**
+   * @brief Returns the path of the ring file.
+   */
+  const std::string & path() const
+  {
+    return path_;
+  }
+
+  /**
+   * @brief Returns the number of frames skipped while exporting or too large for the ring.
+   */
+  uint64_t skipped() const
+  {
+    return skipped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /* Ring file header, in the first page */
+  struct RingHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t capacity;  // Bytes available for records
+    uint64_t head;      // Offset of the next record
+    uint64_t seq;       // Sequence number of the next record
+    uint64_t generation; // Tells records of this ring from stale ones
+  };
+
+  /* Record header, at the beginning of a page */
+  struct RecordHeader
+  {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t seq;
+    int64_t stamp;      // Capture time [ns]
+    uint32_t width;
+    uint32_t height;
+    uint32_t step;
+    uint32_t reserved;
+    uint64_t size;      // Payload size
+    uint64_t check;     // Guards against stale or partial headers
+    uint64_t padding;
+  };
+
+  /* Record found in the ring */
+  struct RecordRef
+  {
+    uint64_t offset;
+    uint64_t end;
+    uint64_t seq;
+  };
+
+  uint64_t check(const RecordHeader & header) const;
+  size_t record_size(size_t payload_size) const;
+  RecordHeader * record_at(uint64_t offset) const;
+  std::vector<RecordRef> scan() const;
+
+  std::string path_;
+  int fd_ = -1;
+  uint8_t * map_ = nullptr;
+  size_t map_size_ = 0;
+  size_t page_size_ = 4096;
+  RingHeader * header_ = nullptr;
+  uint8_t * records_ = nullptr;
+  std::atomic<uint64_t> skipped_{0};
+  std::mutex lock_;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_FRAME_RECORDER_HPP
@@ -0,0 +1,146 @@
+/**
+ * ROS 2 USB Camera Driver in-process GPU frames hub.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_GPU_FRAME_HUB_HPP
+#define ROS2_USB_CAMERA_GPU_FRAME_HUB_HPP
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <opencv2/core/cuda.hpp>
+
+#include <rclcpp/rclcpp.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Process-wide hub through which camera drivers hand GPU-resident frames to
+ * nodes composed in the same process, with no host round trip.
+ *
+ * Channels are named after the topic the frames are also published on.
+ * Frames are only valid for the duration of the callbacks, which run in the
+ * camera sampling thread: consumers must copy them or process them
+ * synchronously, and must not subscribe or unsubscribe from the callbacks.
+ */
+class GpuFrameHub
+{
+public:
+  using Callback = std::function<void (const cv::cuda::GpuMat &, const rclcpp::Time &)>;
+
+  /**
+   * @brief Returns the process-wide hub.
+   */
+  static GpuFrameHub & instance()
+  {
+    static GpuFrameHub hub;
+    return hub;
+  }
+
+  /**
+   * @brief Registers a consumer of the frames on a channel.
+   *
+   * @param channel Fully qualified name of the topic frames are published on.
+   * @param callback Routine to call on each new frame.
+   * @return Consumer ID.
+   */
+  unsigned int subscribe(const std::string & channel, Callback && callback)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    unsigned int id = next_id_++;
+    consumers_.emplace(id, Consumer{channel, std::move(callback)});
+    return id;
+  }
+
+  /**
+   * @brief Unregisters a consumer; its callback is not running when this returns.
+   *
+   * @param id Consumer ID.
+   */
+  void unsubscribe(unsigned int id)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    consumers_.erase(id);
+  }
+
+  /**
+   * @brief Checks whether anyone consumes the frames on a channel.
+   *
+   * @param channel Channel name.
+   * @return True if there is at least one consumer.
+   */
+  bool has_consumers(const std::string & channel)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto & c : consumers_) {
+      if (c.second.channel == channel) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Hands a new frame over to the consumers of a channel.
+   *
+   * @param channel Channel name.
+   * @param frame GPU-resident frame.
+   * @param timestamp Capture timestamp.
+   */
+  void publish(const std::string & channel, const cv::cuda::GpuMat & frame, const rclcpp::Time & timestamp)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto & c : consumers_) {
+      if (c.second.channel == channel) {
+        c.second.callback(frame, timestamp);
+      }
+    }
+  }
+
+private:
+  GpuFrameHub() = default;
+
+  /* Frames consumer */
+  struct Consumer
+  {
+    std::string channel;
+    Callback callback;
+  };
+
+  std::mutex lock_;
+  std::map<unsigned int, Consumer> consumers_;
+  unsigned int next_id_ = 0;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_GPU_FRAME_HUB_HPP
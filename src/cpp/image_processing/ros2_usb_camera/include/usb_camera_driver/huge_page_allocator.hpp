@@ -0,0 +1,331 @@
+/**
+ * ROS 2 USB Camera Driver huge page and NUMA-aware image buffers allocator.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_HUGE_PAGE_ALLOCATOR_HPP
+#define ROS2_USB_CAMERA_HUGE_PAGE_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Pages that large image buffers are backed by.
+ */
+enum class HugePages
+{
+  NONE,        // Regular pages
+  TRANSPARENT, // Transparent huge pages, if the kernel grants them
+  EXPLICIT     // Reserved huge pages (vm.nr_hugepages), transparent ones if none are left
+};
+
+/**
+ * cv::Mat allocator for large image buffers, e.g. frames and rectification maps.
+ *
+ * Buffers of at least min_size bytes are mapped on their own, aligned to huge pages,
+ * and optionally bound to a NUMA node before they are first touched; smaller ones
+ * come from the OpenCV allocator. Set it as the allocator of a Mat before the Mat
+ * is first created: OpenCV functions that write to it then allocate from here.
+ * Allocators are never destroyed, since Mats might outlive their users.
+ */
+class HugePageAllocator : public cv::MatAllocator
+{
+public:
+  static constexpr size_t huge_page_size = size_t(2) << 20;
+  static constexpr size_t min_size = size_t(1) << 20;
+  static constexpr int no_node = -2;     // No NUMA binding
+  static constexpr int thread_node = -1; // NUMA node of the allocating thread
+
+  /**
+   * @brief Gets the allocator for a configuration, shared by the whole process.
+   *
+   * @param pages Pages to back buffers with.
+   * @param node NUMA node to bind buffers to, or no_node, or thread_node.
+   * @return Allocator, or nullptr if the default one would do the same.
+   */
+  static HugePageAllocator * get(HugePages pages, int node)
+  {
+    if (pages == HugePages::NONE && node == no_node) {
+      return nullptr;
+    }
+    static std::mutex lock;
+    static std::map<std::pair<HugePages, int>, HugePageAllocator *> allocators;
+    std::lock_guard<std::mutex> guard(lock);
+    HugePageAllocator * & allocator = allocators[{pages, node}];
+    if (allocator == nullptr) {
+      allocator = new HugePageAllocator(pages, node);
+    }
+    return allocator;
+  }
+
+  /**
+   * @brief Parses a huge pages mode name: none, transparent, or explicit.
+   *
+   * @param name Mode name.
+   * @param pages Mode to populate.
+   * @return False if the name is unknown.
+   */
+  static bool parse_pages(const std::string & name, HugePages & pages)
+  {
+    if (name == "none") {
+      pages = HugePages::NONE;
+    } else if (name == "transparent") {
+      pages = HugePages::TRANSPARENT;
+    } else if (name == "explicit") {
+      pages = HugePages::EXPLICIT;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Finds the NUMA node a CPU belongs to.
+   *
+   * @param cpu CPU index.
+   * @return NUMA node, -1 if unknown.
+   */
+  static int cpu_node(int cpu)
+  {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR * dir = opendir(path.c_str());
+    if (dir == nullptr) {
+      return -1;
+    }
+    int node = -1;
+    while (struct dirent * entry = readdir(dir)) {
+      if (std::string(entry->d_name).compare(0, 4, "node") == 0) {
+        node = std::atoi(entry->d_name + 4);
+        break;
+      }
+    }
+    closedir(dir);
+    return node;
+  }
+
+  /**
+   * @brief Finds the NUMA node the calling thread runs on.
+   *
+   * @return NUMA node, -1 if unknown.
+   */
+  static int current_node()
+  {
+    unsigned int cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+      return -1;
+    }
+    return int(node);
+  }
+
+  /**
+   * @brief Returns the number of buffers mapped on reserved huge pages.
+   */
+  uint64_t explicit_buffers() const
+  {
+    return explicit_buffers_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of buffers that reserved huge pages were not available for.
+   */
+  uint64_t explicit_failures() const
+  {
+    return explicit_failures_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of buffers that could not be bound to their NUMA node.
+   */
+  uint64_t bind_failures() const
+  {
+    return bind_failures_.load(std::memory_order_relaxed);
+  }
+
+  cv::UMatData * allocate(
+    int dims,
+    const int * sizes,
+    int type,
+    void * data0,
+    size_t * step,
+    cv::AccessFlag /*flags*/,
+    cv::UMatUsageFlags /*usage_flags*/) const override
+  {
+    // Same layout as the default allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+      if (step != nullptr) {
+        if (data0 != nullptr && step[i] != CV_AUTOSTEP) {
+          total = step[i];
+        } else {
+          step[i] = total;
+        }
+      }
+      total *= size_t(sizes[i]);
+    }
+
+    uchar * data = static_cast<uchar *>(data0);
+    if (data == nullptr) {
+      data = static_cast<uchar *>(total >= min_size ? map(total) : cv::fastMalloc(total));
+      if (data == nullptr) {
+        CV_Error(cv::Error::StsNoMem, "Failed to map image buffer");
+      }
+    }
+    cv::UMatData * u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0 != nullptr) {
+      u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+  }
+
+  bool allocate(
+    cv::UMatData * u,
+    cv::AccessFlag /*flags*/,
+    cv::UMatUsageFlags /*usage_flags*/) const override
+  {
+    return u != nullptr;
+  }
+
+  void deallocate(cv::UMatData * u) const override
+  {
+    if (u == nullptr) {
+      return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+      if (u->size >= min_size) {
+        munmap(u->origdata, round_up(u->size));
+      } else {
+        cv::fastFree(u->origdata);
+      }
+      u->origdata = nullptr;
+    }
+    delete u;
+  }
+
+private:
+  HugePageAllocator(HugePages pages, int node)
+  : pages_(pages), node_(node)
+  {}
+
+  static size_t round_up(size_t size)
+  {
+    return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+  }
+
+  /**
+   * @brief Maps a new buffer, aligned to huge pages and bound to its NUMA node.
+   *
+   * @param size Buffer size [bytes].
+   * @return Buffer, nullptr on failure.
+   */
+  void * map(size_t size) const
+  {
+    size_t length = round_up(size);
+    void * addr = MAP_FAILED;
+    if (pages_ == HugePages::EXPLICIT) {
+      addr = mmap(
+        nullptr, length, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (addr != MAP_FAILED) {
+        explicit_buffers_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        explicit_failures_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (addr == MAP_FAILED) {
+      // Map a huge page more than needed, then trim it to align the buffer start
+      void * raw = mmap(
+        nullptr, length + huge_page_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED) {
+        return nullptr;
+      }
+      uintptr_t start = (uintptr_t(raw) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1);
+      size_t head = start - uintptr_t(raw);
+      if (head > 0) {
+        munmap(raw, head);
+      }
+      munmap(reinterpret_cast<void *>(start + length), huge_page_size - head);
+      addr = reinterpret_cast<void *>(start);
+      if (pages_ != HugePages::NONE) {
+        madvise(addr, length, MADV_HUGEPAGE);
+      }
+    }
+
+    // Pages are placed when first touched, so the policy must be set right now
+    int node = node_ == thread_node ? current_node() : node_;
+    if (node_ != no_node && !bind(addr, length, node)) {
+      bind_failures_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return addr;
+  }
+
+  /**
+   * @brief Makes a memory range prefer a NUMA node.
+   */
+  static bool bind(void * addr, size_t length, int node)
+  {
+    constexpr int mask_bits = 256;
+    if (node < 0 || node >= mask_bits) {
+      return false;
+    }
+    unsigned long mask[mask_bits / (8 * sizeof(unsigned long))] = {};
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(SYS_mbind, addr, length, MPOL_PREFERRED, mask, mask_bits, 0) == 0;
+  }
+
+  HugePages pages_;
+  int node_;
+  mutable std::atomic<uint64_t> explicit_buffers_{0};
+  mutable std::atomic<uint64_t> explicit_failures_{0};
+  mutable std::atomic<uint64_t> bind_failures_{0};
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_HUGE_PAGE_ALLOCATOR_HPP
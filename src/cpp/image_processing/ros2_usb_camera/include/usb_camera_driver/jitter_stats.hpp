@@ -0,0 +1,132 @@
+/**
+ * ROS 2 USB Camera Driver inter-frame jitter statistics.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_JITTER_STATS_HPP
+#define ROS2_USB_CAMERA_JITTER_STATS_HPP
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Running statistics of the interval between consecutive frames.
+ *
+ * Jitter is measured as the deviation of each interval from the nominal period.
+ * Must be updated by a single thread at a time.
+ */
+class JitterStats
+{
+public:
+  /**
+   * @brief Sets the nominal period and clears all statistics.
+   *
+   * @param period Nominal interval between frames.
+   */
+  void reset(std::chrono::nanoseconds period)
+  {
+    period_us_ = double(period.count()) / 1000.0;
+    count_ = 0;
+    mean_us_ = 0.0;
+    m2_us_ = 0.0;
+    max_jitter_us_ = 0.0;
+    started_ = false;
+  }
+
+  /**
+   * @brief Adds a new frame.
+   *
+   * @param t Frame capture time.
+   */
+  void add(std::chrono::steady_clock::time_point t)
+  {
+    if (started_) {
+      double interval_us =
+        double(std::chrono::duration_cast<std::chrono::nanoseconds>(t - last_).count()) / 1000.0;
+      count_++;
+      double delta = interval_us - mean_us_;
+      mean_us_ += delta / double(count_);
+      m2_us_ += delta * (interval_us - mean_us_);
+      double jitter_us = std::fabs(interval_us - period_us_);
+      if (jitter_us > max_jitter_us_) {
+        max_jitter_us_ = jitter_us;
+      }
+    }
+    last_ = t;
+    started_ = true;
+  }
+
+  /**
+   * @brief Returns the number of measured intervals.
+   */
+  uint64_t count() const
+  {
+    return count_;
+  }
+
+  /**
+   * @brief Returns the mean interval between frames, in microseconds.
+   */
+  double mean_us() const
+  {
+    return mean_us_;
+  }
+
+  /**
+   * @brief Returns the standard deviation of the interval between frames, in microseconds.
+   */
+  double stddev_us() const
+  {
+    return count_ > 1 ? std::sqrt(m2_us_ / double(count_ - 1)) : 0.0;
+  }
+
+  /**
+   * @brief Returns the worst deviation from the nominal period, in microseconds.
+   */
+  double max_jitter_us() const
+  {
+    return max_jitter_us_;
+  }
+
+private:
+  std::chrono::steady_clock::time_point last_;
+  double period_us_ = 0.0;
+  uint64_t count_ = 0;
+  double mean_us_ = 0.0;
+  double m2_us_ = 0.0;
+  double max_jitter_us_ = 0.0;
+  bool started_ = false;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_JITTER_STATS_HPP
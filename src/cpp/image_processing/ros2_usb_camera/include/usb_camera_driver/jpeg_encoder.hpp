@@ -0,0 +1,85 @@
+/**
+ * ROS 2 USB Camera Driver JPEG encoders.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_JPEG_ENCODER_HPP
+#define ROS2_USB_CAMERA_JPEG_ENCODER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Encoders that back the compressed stream.
+ */
+enum class EncoderBackend
+{
+  NONE,     // Compressed stream disabled
+  AUTO,     // Device JPEG as is if possible, else hardware, else software
+  SOFTWARE, // OpenCV/libjpeg
+  V4L2_M2M  // V4L2 memory-to-memory hardware encoder
+};
+
+/**
+ * Encodes BGR frames to JPEG.
+ *
+ * Encoders are not thread-safe: each one must be used by a single thread.
+ */
+class JpegEncoder
+{
+public:
+  virtual ~JpegEncoder() = default;
+
+  static std::unique_ptr<JpegEncoder> create(
+    EncoderBackend backend,
+    const std::string & device,
+    int quality);
+  static bool parse_backend(const std::string & backend, EncoderBackend & value);
+
+  /**
+   * @brief Encodes a frame, reusing the output buffer storage.
+   *
+   * @param frame BGR frame to encode.
+   * @param jpeg Buffer to store the JPEG data into.
+   * @return True if the frame was encoded, false otherwise.
+   */
+  virtual bool encode(const cv::Mat & frame, std::vector<uint8_t> & jpeg) = 0;
+
+  virtual std::string description() const = 0;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_JPEG_ENCODER_HPP
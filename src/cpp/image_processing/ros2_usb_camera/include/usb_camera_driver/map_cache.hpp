@@ -0,0 +1,108 @@
+/**
+ * ROS 2 USB Camera Driver on-disk rectification maps cache.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_MAP_CACHE_HPP
+#define ROS2_USB_CAMERA_MAP_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Undistortion and rectification maps, in both fixed-point and floating-point formats.
+ */
+struct MapSet
+{
+  cv::Mat fixed1;  // CV_16SC2
+  cv::Mat fixed2;  // CV_16UC1
+  cv::Mat float1;  // CV_32FC1, x coordinates
+  cv::Mat float2;  // CV_32FC1, y coordinates
+};
+
+/**
+ * Cache of rectification maps in memory-mapped files.
+ *
+ * Files are keyed by a hash of the calibration and geometry they were computed
+ * for. Loaded maps are headers over read-only file mappings, so pages are read
+ * in lazily on first use; mappings live as long as the cache object.
+ */
+class MapCache
+{
+public:
+  explicit MapCache(const std::string & dir);
+  ~MapCache();
+
+  MapCache(const MapCache &) = delete;
+  MapCache & operator=(const MapCache &) = delete;
+
+  static uint64_t key(
+    const cv::Mat & A, const cv::Mat & D,
+    const cv::Size & input_size, const cv::Size & output_size);
+
+  bool load(uint64_t key, const cv::Size & output_size, MapSet & maps);
+  bool store(uint64_t key, const cv::Size & output_size, const MapSet & maps);
+
+private:
+  /* Cache file header */
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+    uint64_t key;
+  };
+
+  /* Read-only file mapping */
+  struct Mapping
+  {
+    void * addr;
+    size_t size;
+  };
+
+  std::string path(uint64_t key) const;
+  static size_t payload_size(const cv::Size & output_size);
+
+  std::string dir_;
+  std::vector<Mapping> mappings_;
+  std::mutex lock_;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_MAP_CACHE_HPP
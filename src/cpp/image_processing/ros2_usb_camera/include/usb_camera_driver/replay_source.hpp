@@ -0,0 +1,125 @@
+/**
+ * ROS 2 USB Camera Driver recorded frames replay sources.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_REPLAY_SOURCE_HPP
+#define ROS2_USB_CAMERA_REPLAY_SOURCE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Pacing of replayed frames.
+ */
+enum class ReplayPacing
+{
+  REALTIME, // As recorded, from source timestamps or frame rate
+  FIXED,    // At the driver frame rate
+  FAST      // As fast as the driver can go
+};
+
+/**
+ * Source of recorded BGR frames, replayed in place of the capture device.
+ *
+ * Sources pace themselves: reads block until the next frame is due.
+ */
+class ReplaySource
+{
+public:
+  virtual ~ReplaySource() = default;
+
+  static std::unique_ptr<ReplaySource> create(const std::string & uri, const std::string & topic);
+  static bool parse_pacing(const std::string & pacing, ReplayPacing & value);
+
+  bool open(ReplayPacing pacing, double fps, bool loop);
+  bool read(cv::Mat & frame);
+
+  /**
+   * @brief Returns the size of the first frame of the source.
+   */
+  cv::Size frame_size() const
+  {
+    return first_frame_.size();
+  }
+
+  /**
+   * @brief Returns the number of frames read so far.
+   */
+  uint64_t frames() const
+  {
+    return frames_;
+  }
+
+  virtual std::string description() const = 0;
+
+protected:
+  /* Opens the recording and goes back to its beginning. */
+  virtual bool rewind() = 0;
+
+  /* Gets the next recorded frame, with its recording time [ns] or -1 if unknown. */
+  virtual bool next(cv::Mat & frame, int64_t & stamp) = 0;
+
+  /* Recording frame rate, 0.0 if unknown. */
+  virtual double source_fps() const
+  {
+    return 0.0;
+  }
+
+private:
+  bool restart();
+  void wait(int64_t stamp);
+
+  ReplayPacing pacing_ = ReplayPacing::REALTIME;
+  std::chrono::nanoseconds period_{0};
+  bool loop_ = false;
+  bool finished_ = false;
+
+  /* First frame, read when opening to know the geometry */
+  cv::Mat first_frame_;
+  int64_t first_stamp_ = -1;
+  bool first_pending_ = false;
+  cv::Mat buffer_;
+
+  /* Pacing state, reset at each pass */
+  std::chrono::steady_clock::time_point start_;
+  int64_t pass_start_stamp_ = -1;
+  uint64_t pass_frames_ = 0;
+  uint64_t frames_ = 0;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_REPLAY_SOURCE_HPP
@@ -0,0 +1,286 @@
+/**
+ * ROS 2 USB Camera Driver shared memory frames ring.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_SHM_RING_HPP
+#define ROS2_USB_CAMERA_SHM_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Ring of frame buffers in a POSIX shared memory segment.
+ *
+ * A single writer fills slots in turn, while readers in other processes map the
+ * segment read-only and access frames in place. Each slot is guarded by a
+ * sequence number, odd while the slot is being written: readers check it before
+ * and after using the data to detect frames overwritten in the meantime.
+ */
+class ShmRing
+{
+public:
+  ShmRing() = default;
+
+  ~ShmRing()
+  {
+    close();
+  }
+
+  ShmRing(const ShmRing &) = delete;
+  ShmRing & operator=(const ShmRing &) = delete;
+
+  /**
+   * @brief Creates a new segment, replacing any other with the same name.
+   *
+   * @param name Segment name, must start with a slash.
+   * @param slots Number of frame slots.
+   * @param slot_size Size of each slot, in bytes.
+   * @return True if the segment was created and mapped, false otherwise.
+   */
+  bool create(const std::string & name, uint32_t slots, size_t slot_size)
+  {
+    close();
+    if (slots == 0 || slot_size == 0) {
+      return false;
+    }
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    slot_size = (slot_size + alignment - 1) / alignment * alignment;
+    size_t size = data_offset(slots) + size_t(slots) * slot_size;
+    if (ftruncate(fd, off_t(size)) < 0) {
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    void * base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return false;
+    }
+
+    // Fresh segments are zero-filled, so all slots start out empty and even
+    base_ = static_cast<uint8_t *>(base);
+    size_ = size;
+    name_ = name;
+    owner_ = true;
+    Header * header = reinterpret_cast<Header *>(base_);
+    header->slots = slots;
+    header->slot_size = slot_size;
+    header->magic = magic;
+    return true;
+  }
+
+  /**
+   * @brief Maps an existing segment read-only.
+   *
+   * @param name Segment name.
+   * @return True if the segment was mapped, false otherwise.
+   */
+  bool open(const std::string & name)
+  {
+    close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    void * base = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+    base_ = static_cast<uint8_t *>(base);
+    size_ = size_t(st.st_size);
+    name_ = name;
+    const Header * header = reinterpret_cast<const Header *>(base_);
+    if (header->magic != magic ||
+      data_offset(header->slots) + size_t(header->slots) * header->slot_size > size_)
+    {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Unmaps the segment, removing it if it was created here.
+   */
+  void close()
+  {
+    if (base_ != nullptr) {
+      munmap(base_, size_);
+      if (owner_) {
+        shm_unlink(name_.c_str());
+      }
+    }
+    base_ = nullptr;
+    size_ = 0;
+    name_.clear();
+    owner_ = false;
+    next_slot_ = 0;
+  }
+
+  bool is_open() const
+  {
+    return base_ != nullptr;
+  }
+
+  const std::string & name() const
+  {
+    return name_;
+  }
+
+  size_t slot_size() const
+  {
+    return base_ != nullptr ? size_t(header()->slot_size) : 0;
+  }
+
+  /**
+   * @brief Marks the next slot as being written, writer only.
+   *
+   * @param slot Index of the slot to populate.
+   * @return Slot data buffer.
+   */
+  uint8_t * begin_write(uint32_t & slot)
+  {
+    slot = next_slot_;
+    std::atomic<uint64_t> & seq = slot_seq(slot);
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot_data(slot);
+  }
+
+  /**
+   * @brief Publishes the slot being written, writer only.
+   *
+   * @param slot Index of the slot.
+   * @return Sequence number that readers must match.
+   */
+  uint64_t end_write(uint32_t slot)
+  {
+    std::atomic<uint64_t> & seq = slot_seq(slot);
+    uint64_t new_seq = seq.load(std::memory_order_relaxed) + 1;
+    seq.store(new_seq, std::memory_order_release);
+    next_slot_ = (slot + 1) % header()->slots;
+    return new_seq;
+  }
+
+  /**
+   * @brief Returns the data of a published frame, if it is still available.
+   *
+   * @param slot Index of the slot.
+   * @param seq Sequence number of the frame.
+   * @param size Frame size, in bytes.
+   * @return Slot data buffer, or nullptr if the frame is gone.
+   */
+  const uint8_t * read(uint32_t slot, uint64_t seq, size_t size) const
+  {
+    if (base_ == nullptr || slot >= header()->slots || size > header()->slot_size ||
+      slot_seq(slot).load(std::memory_order_acquire) != seq)
+    {
+      return nullptr;
+    }
+    return slot_data(slot);
+  }
+
+  /**
+   * @brief Checks whether a frame has not been overwritten since it was read.
+   *
+   * @param slot Index of the slot.
+   * @param seq Sequence number of the frame.
+   * @return True if the frame data that was read is consistent.
+   */
+  bool valid(uint32_t slot, uint64_t seq) const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return base_ != nullptr && slot < header()->slots &&
+           slot_seq(slot).load(std::memory_order_relaxed) == seq;
+  }
+
+private:
+  /* Segment header */
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t slots;
+    uint64_t slot_size;
+  };
+
+  static constexpr uint32_t magic = 0x55434452;  // "UCDR"
+  static constexpr size_t alignment = 64;
+
+  static size_t data_offset(uint32_t slots)
+  {
+    size_t offset = sizeof(Header) + size_t(slots) * sizeof(std::atomic<uint64_t>);
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+
+  const Header * header() const
+  {
+    return reinterpret_cast<const Header *>(base_);
+  }
+
+  std::atomic<uint64_t> & slot_seq(uint32_t slot) const
+  {
+    return reinterpret_cast<std::atomic<uint64_t> *>(base_ + sizeof(Header))[slot];
+  }
+
+  uint8_t * slot_data(uint32_t slot) const
+  {
+    return base_ + data_offset(header()->slots) + size_t(slot) * header()->slot_size;
+  }
+
+  uint8_t * base_ = nullptr;
+  size_t size_ = 0;
+  std::string name_;
+  bool owner_ = false;
+  uint32_t next_slot_ = 0;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_SHM_RING_HPP
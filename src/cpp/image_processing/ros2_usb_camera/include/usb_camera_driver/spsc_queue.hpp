@@ -0,0 +1,220 @@
+/**
+ * ROS 2 USB Camera Driver lock-free pipeline queue.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_SPSC_QUEUE_HPP
+#define ROS2_USB_CAMERA_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+
+#include <semaphore.h>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Bounded, lock-free single-producer single-consumer queue.
+ *
+ * Each cell carries a sequence number, so that the producer can also safely pop
+ * the oldest element to make room for a new one (overwrite-oldest policy).
+ * A semaphore counts pushed elements to let the consumer sleep while the queue
+ * is empty; it is never touched in the lock-free push and pop paths.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+  /**
+   * @brief Builds a new SPSCQueue.
+   *
+   * @param depth Minimum queue capacity, rounded up to the next power of two.
+   *
+   * @throws RuntimeError
+   */
+  explicit SPSCQueue(size_t depth)
+  {
+    size_t capacity = 1;
+    while (capacity < depth) {
+      capacity <<= 1;
+    }
+    mask_ = capacity - 1;
+    cells_.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    if (sem_init(&items_sem_, 0, 0)) {
+      throw std::runtime_error("Failed to initialize queue semaphore");
+    }
+  }
+
+  /**
+   * @brief Destroys the queue semaphore.
+   */
+  ~SPSCQueue()
+  {
+    sem_destroy(&items_sem_);
+  }
+
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue & operator=(const SPSCQueue &) = delete;
+
+  /**
+   * @brief Pushes a new element if there is room for it, never blocks.
+   *
+   * @param item Element to move into the queue.
+   * @return True if the element was pushed, false if the queue is full.
+   */
+  bool try_push(T && item)
+  {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell & cell = cells_[pos & mask_];
+    if (cell.seq.load(std::memory_order_acquire) != pos) {
+      return false;
+    }
+    cell.data = std::move(item);
+    cell.seq.store(pos + 1, std::memory_order_release);
+    enqueue_pos_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief Pops the oldest element, if any, never blocks.
+   *
+   * @param item Element to move out of the queue.
+   * @return True if an element was popped, false if the queue is empty.
+   */
+  bool try_pop(T & item)
+  {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell * cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      intptr_t diff =
+        intptr_t(cell->seq.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+      if (diff == 0) {
+        // The producer might be dropping this very element, so claim it first
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    item = std::move(cell->data);
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Pushes a new element and wakes up the consumer; to be called by the producer.
+   *
+   * @param item Element to move into the queue.
+   * @param overwrite Drops the oldest element if the queue is full, instead of the new one.
+   * @return True if no element had to be dropped, false otherwise.
+   */
+  bool push(T && item, bool overwrite)
+  {
+    bool dropped = false;
+    while (!try_push(std::move(item))) {
+      dropped = true;
+      if (!overwrite) {
+        return false;
+      }
+      T oldest;
+      try_pop(oldest);
+    }
+    sem_post(&items_sem_);
+    return !dropped;
+  }
+
+  /**
+   * @brief Pops the oldest element, waiting for one for a limited time; to be called by the consumer.
+   *
+   * @param item Element to move out of the queue.
+   * @param timeout_ms Maximum wait time, in milliseconds.
+   * @return True if an element was popped, false on timeout or wake up.
+   */
+  bool pop(T & item, long timeout_ms)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while (true) {
+      if (try_pop(item)) {
+        return true;
+      }
+      if (sem_timedwait(&items_sem_, &deadline)) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      return try_pop(item);
+    }
+  }
+
+  /**
+   * @brief Wakes up a consumer waiting on an empty queue.
+   */
+  void wake()
+  {
+    sem_post(&items_sem_);
+  }
+
+private:
+  /* Queue cell */
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  sem_t items_sem_;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_SPSC_QUEUE_HPP
@@ -0,0 +1,208 @@
+/**
+ * ROS 2 USB Camera Driver per-stage processing statistics.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_STAGE_STATS_HPP
+#define ROS2_USB_CAMERA_STAGE_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Frame processing stages.
+ */
+enum class Stage : unsigned int
+{
+  GRAB,     // Frame capture from the device
+  DECODE,   // Native pixel format conversion
+  FLIP,     // Vertical flip
+  REMAP,    // Undistortion and rectification, or fused transforms
+  RESIZE,   // Output geometry resize
+  COPY,     // Frame copies into messages
+  PUBLISH,  // Message publishing
+  LATENCY,  // From capture timestamp to publishing
+  COUNT
+};
+
+/**
+ * Names of the processing stages, as they appear in statistics.
+ */
+static constexpr const char * stage_names[] = {
+  "grab",
+  "decode",
+  "flip",
+  "remap",
+  "resize",
+  "copy",
+  "publish",
+  "latency"
+};
+
+/**
+ * Rolling per-stage timing statistics and frame counters.
+ *
+ * Stages are timed with the monotonic clock and the last window samples of each
+ * are kept, so that percentiles can be computed at a low rate. Safe to update
+ * from many threads.
+ */
+class StageStats
+{
+public:
+  /**
+   * @brief Builds a new StageStats object.
+   *
+   * @param window Number of samples kept for each stage.
+   */
+  explicit StageStats(size_t window)
+  : window_(window > 0 ? window : 1)
+  {
+    for (Samples & s : samples_) {
+      s.ns.resize(window_, 0);
+    }
+  }
+
+  /**
+   * @brief Samples the monotonic clock.
+   *
+   * @return Current time, in nanoseconds.
+   */
+  static int64_t now()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000L + int64_t(t.tv_nsec);
+  }
+
+  /**
+   * @brief Adds a new stage duration sample.
+   *
+   * @param stage Processing stage.
+   * @param ns Stage duration, in nanoseconds.
+   */
+  void add(Stage stage, int64_t ns)
+  {
+    Samples & s = samples_[static_cast<unsigned int>(stage)];
+    std::lock_guard<std::mutex> lock(s.lock);
+    s.ns[s.next] = ns;
+    s.next = (s.next + 1) % window_;
+    if (s.count < window_) {
+      s.count++;
+    }
+  }
+
+  /**
+   * @brief Computes rolling percentiles of a stage duration.
+   *
+   * @param stage Processing stage.
+   * @param p50_us Median to populate, in microseconds.
+   * @param p99_us 99th percentile to populate, in microseconds.
+   * @return Number of samples in the window.
+   */
+  size_t percentiles(Stage stage, double & p50_us, double & p99_us)
+  {
+    Samples & s = samples_[static_cast<unsigned int>(stage)];
+    {
+      std::lock_guard<std::mutex> lock(s.lock);
+      sorted_.assign(s.ns.begin(), s.ns.begin() + s.count);
+    }
+    p50_us = 0.0;
+    p99_us = 0.0;
+    if (sorted_.empty()) {
+      return 0;
+    }
+    std::sort(sorted_.begin(), sorted_.end());
+    p50_us = double(sorted_[(sorted_.size() - 1) / 2]) / 1000.0;
+    p99_us = double(sorted_[(sorted_.size() - 1) * 99 / 100]) / 1000.0;
+    return sorted_.size();
+  }
+
+  /* Frame counters */
+  void add_frame()
+  {
+    frames_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void add_empty()
+  {
+    empty_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void add_dropped()
+  {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void add_bytes(size_t bytes)
+  {
+    bytes_copied_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  uint64_t frames() const
+  {
+    return frames_.load(std::memory_order_relaxed);
+  }
+  uint64_t empty() const
+  {
+    return empty_.load(std::memory_order_relaxed);
+  }
+  uint64_t dropped() const
+  {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+  uint64_t bytes_copied() const
+  {
+    return bytes_copied_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /* Stage samples ring */
+  struct Samples
+  {
+    std::mutex lock;
+    std::vector<int64_t> ns;
+    size_t next = 0;
+    size_t count = 0;
+  };
+
+  size_t window_;
+  Samples samples_[static_cast<unsigned int>(Stage::COUNT)];
+  std::vector<int64_t> sorted_;
+  std::atomic<uint64_t> frames_{0};
+  std::atomic<uint64_t> empty_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> bytes_copied_{0};
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_STAGE_STATS_HPP
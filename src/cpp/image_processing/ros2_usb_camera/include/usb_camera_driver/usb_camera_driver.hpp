@@ -31,26 +31,42 @@
 #ifndef ROS2_USB_CAMERA_USB_CAMERA_DRIVER_HPP
 #define ROS2_USB_CAMERA_USB_CAMERA_DRIVER_HPP
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
+#include <diagnostic_msgs/msg/diagnostic_status.hpp>
+#include <diagnostic_msgs/msg/key_value.hpp>
+
 #include <sensor_msgs/msg/camera_info.hpp>
+#include <sensor_msgs/msg/compressed_image.hpp>
 #include <sensor_msgs/msg/image.hpp>
 #include <sensor_msgs/image_encodings.hpp>
 
+#include <std_msgs/msg/bool.hpp>
+
 #include <std_srvs/srv/set_bool.hpp>
+#include <std_srvs/srv/trigger.hpp>
 
 #include <camera_info_manager/camera_info_manager.hpp>
 
+#include <image_transport/camera_common.hpp>
 #include <image_transport/image_transport.hpp>
 
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
 
@@ -58,10 +74,30 @@
 #include <opencv2/core/cuda.hpp>
 #include <opencv2/cudaarithm.hpp>
 #include <opencv2/cudawarping.hpp>
+
+#include <usb_camera_driver/gpu_frame_hub.hpp>
 #endif
 
 #include <rmw/types.h>
 
+#include <ros2_examples_headers/parameter_table/parameter_table.hpp>
+
+#include <ros2_usb_camera/msg/frame_trace.hpp>
+#include <ros2_usb_camera/msg/shm_frame.hpp>
+
+#include <usb_camera_driver/buffer_pool.hpp>
+#include <usb_camera_driver/frame_recorder.hpp>
+#include <usb_camera_driver/huge_page_allocator.hpp>
+#include <usb_camera_driver/jitter_stats.hpp>
+#include <usb_camera_driver/jpeg_encoder.hpp>
+#include <usb_camera_driver/map_cache.hpp>
+#include <usb_camera_driver/replay_source.hpp>
+#include <usb_camera_driver/shm_ring.hpp>
+#include <usb_camera_driver/spsc_queue.hpp>
+#include <usb_camera_driver/stage_stats.hpp>
+#include <usb_camera_driver/worker_pool.hpp>
+
+using namespace diagnostic_msgs::msg;
 using namespace rcl_interfaces::msg;
 using namespace sensor_msgs::msg;
 using namespace std_srvs::srv;
@@ -99,6 +135,17 @@ static const rmw_qos_profile_t usb_camera_reliable_qos_profile = {
   false
 };
 
+/**
+ * Pixel formats in which frames can be captured.
+ */
+enum class PixelFormat
+{
+  BGR,  // Decoded by OpenCV
+  MJPG, // Native JPEG compressed frames
+  YUYV, // Native YUV 4:2:2 frames
+  GREY  // Native 8-bit grayscale frames
+};
+
 /**
  * Drives USB, V4L-compatible cameras with OpenCV.
  */
@@ -108,90 +155,300 @@ public:
   explicit CameraDriverNode(const rclcpp::NodeOptions & opts = rclcpp::NodeOptions());
   ~CameraDriverNode();
 
+#ifdef WITH_CUDA
+  /* Rectified GPU frames consumers, for nodes in the same process */
+  using GpuFrameCallback = std::function<void (const cv::cuda::GpuMat &, const rclcpp::Time &)>;
+  void set_gpu_frame_callback(GpuFrameCallback && callback);
+#endif
+
 private:
   /* Video capture device and buffers */
   cv::VideoCapture video_cap_;
+  std::unique_ptr<ReplaySource> replay_;
   cv::Mat frame_;
+  cv::Mat native_frame_;
+  cv::Mat mono_frame_;
   cv::Mat flipped_frame_;
+  cv::Mat resized_frame_;
   cv::Mat rectified_frame_;
   cv::Mat A_, D_;
+  std::unique_ptr<MapCache> map_cache_;
   cv::Mat map1_, map2_;
+  cv::Size rect_input_size_;
+  cv::Mat fused_map1_, fused_map2_;
+  cv::Mat fused_rect_map1_, fused_rect_map2_;
+  cv::Size fused_input_size_;
+  bool fused_flipped_ = false;
+  bool fused_identity_ = false;
 
 #ifdef WITH_CUDA
   cv::cuda::GpuMat gpu_frame_;
   cv::cuda::GpuMat gpu_flipped_frame_;
   cv::cuda::GpuMat gpu_rectified_frame_;
   cv::cuda::GpuMat gpu_map1_, gpu_map2_;
+  cv::cuda::GpuMat gpu_fused_map1_, gpu_fused_map2_;
+  cv::cuda::GpuMat gpu_fused_rect_map1_, gpu_fused_rect_map2_;
 #endif
 
   /* Node parameters */
+  bool camera_info_latched_ = false;
+  bool cuda_async_ = false;
+  bool deferred_init_ = false;
   std::string frame_id_;
-  int64_t fps_ = 0;
-  int64_t image_height_ = 0;
-  int64_t image_width_ = 0;
-  bool is_flipped_ = false;
+  std::atomic<int64_t> fps_{0};
+  bool free_running_ = false;
+  bool fused_transform_ = false;
+  std::atomic<int64_t> image_height_{0};
+  std::atomic<int64_t> image_width_{0};
+  std::atomic<bool> is_flipped_{false};
+  std::atomic<bool> lazy_processing_{true};
+  PixelFormat pixel_format_ = PixelFormat::BGR;
+  bool pipeline_ = false;
+  int64_t pipeline_depth_ = 2;
+  bool pipeline_overwrite_ = true;
+  bool shm_transport_ = false;
+  bool trace_ = false;
+  bool worker_pool_ = false;
+  bool zero_copy_ = false;
 
   /* Service servers */
   rclcpp::Service<SetBool>::SharedPtr hw_enable_server_;
+  rclcpp::Service<Trigger>::SharedPtr export_recording_server_;
 
   /* Service callbacks */
   void hw_enable_callback(SetBool::Request::SharedPtr req, SetBool::Response::SharedPtr resp);
+  bool open_device(SetBool::Response::SharedPtr resp);
+  bool open_replay(SetBool::Response::SharedPtr resp);
+  void export_recording_callback(Trigger::Request::SharedPtr req, Trigger::Response::SharedPtr resp);
+
+  /* Node parameters table */
+  ROS2ParameterTable::ParameterTable params_table_;
 
-  /* Node parameters descriptors */
-  ParameterDescriptor base_topic_name_descriptor_;
-  ParameterDescriptor be_qos_descriptor_;
-  ParameterDescriptor camera_calibration_file_descriptor_;
-  ParameterDescriptor camera_id_descriptor_;
-  ParameterDescriptor camera_name_descriptor_;
-  ParameterDescriptor exposure_descriptor_;
-  ParameterDescriptor frame_id_descriptor_;
-  ParameterDescriptor fps_descriptor_;
-  ParameterDescriptor image_height_descriptor_;
-  ParameterDescriptor image_width_descriptor_;
-  ParameterDescriptor is_flipped_descriptor_;
-  ParameterDescriptor wb_temperature_descriptor_;
+  /* Deferred initialization and startup timing */
+  std::chrono::steady_clock::time_point init_time_;
+  std::chrono::steady_clock::time_point enable_time_;
+  std::atomic<bool> first_frame_published_{true};
+  std::thread warmup_thread_;
+  std::mutex warmup_lock_;
+  rclcpp::Publisher<std_msgs::msg::Bool>::SharedPtr ready_pub_;
+  void warmup_routine();
+  void wait_warmup();
+  void publish_ready(bool ready);
+
+  /* Device capture geometry */
+  std::atomic<int> capture_width_{0};
+  std::atomic<int> capture_height_{0};
+
+  /* Live capture mode switching */
+  struct RectMaps
+  {
+    cv::Mat map1, map2;
+    cv::Mat float1, float2;
+#ifdef WITH_CUDA
+    cv::cuda::GpuMat gpu_map1, gpu_map2;
+#endif
+  };
+  std::map<std::array<int, 4>, RectMaps> rect_maps_cache_;
+  std::mutex rect_maps_cache_lock_;
+  std::mutex mode_lock_;
+  int64_t pending_width_ = 0;
+  int64_t pending_height_ = 0;
+  int64_t pending_fps_ = 0;
+  int64_t mode_width_ = 0;
+  int64_t mode_height_ = 0;
+  std::atomic<bool> device_mode_pending_{false};
+  std::atomic<bool> geometry_pending_{false};
+  RectMaps get_rect_maps(const cv::Size & input_size, const cv::Size & output_size);
+  std::chrono::nanoseconds sampling_period() const;
+  cv::Size image_size() const;
+  void request_mode_change();
+  bool apply_device_mode();
+  void apply_geometry(const cv::Size & frame_size);
 
   /* image_transport objects */
   image_transport::CameraPublisher camera_pub_;
+  image_transport::Publisher image_pub_;
   image_transport::Publisher rect_pub_;
+  image_transport::Publisher native_pub_;
+  image_transport::Publisher mono_pub_;
   camera_info_manager::CameraInfo camera_info_;
   std::shared_ptr<camera_info_manager::CameraInfoManager> cinfo_manager_;
 
+  /* Latched CameraInfo publisher, if frames do not carry their own */
+  rclcpp::Publisher<CameraInfo>::SharedPtr camera_info_pub_;
+  std::atomic<uint64_t> camera_info_generation_{1};
+  void publish_camera_info();
+  size_t image_subscribers() const;
+
+  /* Native compressed frames publisher */
+  rclcpp::Publisher<CompressedImage>::SharedPtr native_compressed_pub_;
+  CompressedImage native_compressed_msg_;
+
+  /* Compressed stream encoder stage */
+  struct EncoderJob
+  {
+    Image::SharedPtr image_msg; // Color frame to encode, or null
+    std::vector<uint8_t> jpeg;  // Device JPEG data to pass through
+    rclcpp::Time timestamp;
+  };
+  std::unique_ptr<JpegEncoder> jpeg_encoder_;
+  rclcpp::Publisher<CompressedImage>::SharedPtr encoded_pub_;
+  std::thread encoder_thread_;
+  std::mutex encoder_lock_;
+  std::condition_variable encoder_cv_;
+  EncoderJob encoder_job_;
+  bool encoder_job_ready_ = false;
+  bool encoder_stop_ = false;
+  uint64_t encoder_drops_ = 0;
+  int64_t encoder_period_ = 0;
+  std::atomic<int64_t> encoder_next_due_{0};
+  void init_encoder();
+  void stop_encoder();
+  bool encoder_due();
+  bool encoder_passthrough() const;
+  void submit_encoder_image(const Image::SharedPtr & image_msg, const rclcpp::Time & timestamp);
+  void submit_encoder_jpeg(const cv::Mat & native_frame, const rclcpp::Time & timestamp);
+  void encoder_routine();
+
+  /* Black-box frame recorder */
+  std::unique_ptr<FrameRecorder> frame_recorder_;
+  bool recorder_native_ = false;
+  void init_recorder();
+
+  /* Shared memory frames transport */
+  ShmRing shm_ring_;
+  unsigned int shm_generation_ = 0;
+  rclcpp::Publisher<ros2_usb_camera::msg::ShmFrame>::SharedPtr shm_pub_;
+  void publish_shm_frame(const Image & image_msg);
+
+  /* Large image buffers allocator, if not the default one */
+  HugePageAllocator * large_buffer_allocator_ = nullptr;
+  void init_large_buffers();
+
+  /* Message buffers pools */
+  std::shared_ptr<BufferPool<Image>> image_pool_;
+  struct PooledCameraInfo
+  {
+    CameraInfo msg;
+    uint64_t generation = 0; // camera_info_generation_ msg was filled with
+  };
+  std::shared_ptr<BufferPool<PooledCameraInfo>> camera_info_pool_;
+  uint64_t pool_exhaustions_ = 0;
+
   /* Utility routines */
   Image::SharedPtr frame_to_msg(cv::Mat & frame);
-  void declare_bool_parameter(
-    std::string && name,
-    bool default_val,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_double_parameter(
-    std::string && name,
-    double default_val, double from, double to, double step,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_int_parameter(
-    std::string && name,
-    int64_t default_val, int64_t from, int64_t to, int64_t step,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
-  void declare_string_parameter(
-    std::string && name,
-    std::string && default_val,
-    std::string && desc, std::string && constraints,
-    bool read_only, ParameterDescriptor & descriptor);
+  Image::SharedPtr new_frame_msg(cv::Mat & frame_view);
+  Image::SharedPtr native_to_msg(cv::Mat & frame);
+  void publish_mono_frame(const cv::Mat & native_frame, const rclcpp::Time & timestamp);
+  void init_rect_maps(const cv::Size & input_size);
+  void init_fused_maps(const cv::Size & input_size);
   void init_parameters();
 
-  /* Parameters callback */
-  OnSetParametersCallbackHandle::SharedPtr on_set_params_chandle_;
-  SetParametersResult on_set_parameters_callback(
-    const std::vector<rclcpp::Parameter> & params);
-
   /* Thread objects and routines */
   std::thread camera_sampling_thread_;
   void camera_sampling_routine();
+  void sample_frame(const rclcpp::Time * sync_timestamp);
+  void set_sampling_attributes();
+  void log_jitter_stats();
+  bool grab_frame(cv::Mat & frame, rclcpp::Time & timestamp);
+  bool decode_frame(cv::Mat & native_frame, cv::Mat & frame, const rclcpp::Time & timestamp);
+  bool required_outputs(bool & raw, bool & rect);
+  void process_frame(
+    cv::Mat & frame,
+    Image::SharedPtr & image_msg,
+    Image::SharedPtr & rect_image_msg,
+    bool raw, bool rect);
+  void process_frame_zero_copy(
+    cv::Mat & frame,
+    Image::SharedPtr & image_msg,
+    Image::SharedPtr & rect_image_msg,
+    bool raw, bool rect);
+  void process_frame_fused(
+    cv::Mat & frame,
+    Image::SharedPtr & image_msg,
+    Image::SharedPtr & rect_image_msg,
+    bool raw, bool rect);
+  void publish_frame(
+    Image::SharedPtr & image_msg,
+    Image::SharedPtr & rect_image_msg,
+    const rclcpp::Time & timestamp);
+
+  /* Processing pipeline data */
+  struct CapturedFrame
+  {
+    std::shared_ptr<cv::Mat> frame;
+    rclcpp::Time timestamp;
+  };
+  struct FrameMessages
+  {
+    Image::SharedPtr image_msg;
+    Image::SharedPtr rect_image_msg;
+    rclcpp::Time timestamp;
+  };
+  std::shared_ptr<BufferPool<cv::Mat>> frame_pool_;
+  std::shared_ptr<SPSCQueue<CapturedFrame>> transform_queue_;
+  std::shared_ptr<SPSCQueue<FrameMessages>> publish_queue_;
+  std::atomic<uint64_t> pipeline_drops_{0};
+
+  /* Processing pipeline threads and routines */
+  std::thread camera_transform_thread_;
+  std::thread camera_publish_thread_;
+  void camera_pipeline_routine();
+  void camera_transform_routine();
+  void camera_publish_routine();
+
+#ifdef WITH_CUDA
+  /* CUDA asynchronous processing data */
+  struct PendingFrame
+  {
+    bool valid = false;
+    bool raw = false;
+    bool rect = false;
+    bool gpu_rect = false;
+    rclcpp::Time timestamp;
+  };
+  cv::cuda::Stream cuda_stream_;
+  cv::cuda::HostMem cuda_host_frames_[2];
+  cv::cuda::HostMem cuda_host_image_;
+  cv::cuda::HostMem cuda_host_rect_;
+  cv::cuda::GpuMat gpu_resized_frame_;
+  unsigned int cuda_host_frame_idx_ = 0;
+  PendingFrame cuda_pending_;
+  GpuFrameCallback gpu_frame_callback_;
+  std::mutex gpu_frame_callback_lock_;
+  std::string gpu_frame_channel_;
+
+  /* CUDA asynchronous processing routines */
+  void camera_cuda_routine();
+  void enqueue_frame_async(cv::cuda::HostMem & host_frame, const PendingFrame & pending);
+  void complete_frame_async();
+#endif
+
+  /* Per-stage statistics */
+  std::shared_ptr<StageStats> stage_stats_;
+  rclcpp::Publisher<DiagnosticArray>::SharedPtr stats_pub_;
+  rclcpp::TimerBase::SharedPtr stats_timer_;
+  uint64_t stats_last_frames_ = 0;
+  int64_t stats_last_time_ = 0;
+  int64_t stage_start() const;
+  void stage_end(Stage stage, int64_t start);
+  void stats_timer_callback();
+
+  /* Pipeline latency tracing */
+  rclcpp::Publisher<ros2_usb_camera::msg::FrameTrace>::SharedPtr trace_pub_;
+  void publish_trace(const rclcpp::Time & timestamp);
+
+  /* Inter-frame jitter statistics */
+  JitterStats jitter_stats_;
+
+  /* Shared worker pool job */
+  std::shared_ptr<WorkerPool> sampling_pool_;
+  unsigned int sampling_job_ = 0;
+  void start_sampling_job();
+  void stop_sampling_job();
 
   /* Synchronization primitives */
-  std::atomic<bool> stopped_;
+  std::atomic<bool> stopped_{true};
 };
 
 } // namespace USBCameraDriver
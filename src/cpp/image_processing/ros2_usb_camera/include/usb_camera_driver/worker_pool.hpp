@@ -0,0 +1,148 @@
+/**
+ * ROS 2 USB Camera Driver shared camera sampling worker pool.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ROS2_USB_CAMERA_WORKER_POOL_HPP
+#define ROS2_USB_CAMERA_WORKER_POOL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Shares a single timestamp among cameras released at the same time.
+ */
+class SyncGroup
+{
+public:
+  /**
+   * @brief Returns the timestamp of a release, taking it on first request.
+   *
+   * @param release Release time of the cameras in the group.
+   * @param now Routine that samples the current time, in nanoseconds.
+   * @return Group timestamp for the release, in nanoseconds.
+   */
+  int64_t stamp(
+    std::chrono::steady_clock::time_point release,
+    const std::function<int64_t()> & now)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!valid_ || release != release_) {
+      release_ = release;
+      stamp_ = now();
+      valid_ = true;
+    }
+    return stamp_;
+  }
+
+private:
+  std::mutex lock_;
+  std::chrono::steady_clock::time_point release_;
+  int64_t stamp_ = 0;
+  bool valid_ = false;
+};
+
+/**
+ * Process-wide pool of threads that sample many cameras.
+ *
+ * Each camera is a periodic job, run by at most one worker at a time: due jobs
+ * are picked by priority, and workers take on the scheduling priority and CPU
+ * affinity of the job they run. Jobs in the same sync group are released together.
+ */
+class WorkerPool
+{
+public:
+  /* Job release information */
+  struct Tick
+  {
+    std::chrono::steady_clock::time_point release;
+    SyncGroup * sync = nullptr;
+  };
+
+  /* Camera sampling job */
+  struct Job
+  {
+    std::function<void(const Tick &)> routine;
+    std::chrono::nanoseconds period{0};
+    int priority = 0;   // SCHED_FIFO priority, 0 for normal scheduling
+    int cpu = -1;       // CPU to run on, -1 for any
+    std::string sync_group;
+  };
+
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool & operator=(const WorkerPool &) = delete;
+
+  static std::shared_ptr<WorkerPool> get(size_t workers);
+
+  unsigned int add(Job && job);
+  void remove(unsigned int id);
+  void set_period(unsigned int id, std::chrono::nanoseconds period);
+
+  size_t workers() const;
+
+private:
+  explicit WorkerPool(size_t workers);
+
+  /* Scheduled job entry */
+  struct Entry
+  {
+    Job job;
+    std::chrono::steady_clock::time_point next_release;
+    std::shared_ptr<SyncGroup> sync;
+    bool running = false;
+  };
+
+  void worker_routine();
+  void apply_job_attributes(const Job & job, int & current_priority, int & current_cpu);
+
+  std::vector<std::thread> workers_;
+  std::map<unsigned int, Entry> entries_;
+  std::map<std::string, std::shared_ptr<SyncGroup>> sync_groups_;
+  unsigned int next_id_ = 0;
+  bool stopped_ = false;
+  std::mutex lock_;
+  std::condition_variable cv_;
+};
+
+} // namespace USBCameraDriver
+
+#endif // ROS2_USB_CAMERA_WORKER_POOL_HPP
@@ -0,0 +1,260 @@
+/**
+ * ROS 2 USB Camera Driver node CUDA asynchronous processing.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <usb_camera_driver/usb_camera_driver.hpp>
+
+#ifdef WITH_CUDA
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Registers a consumer of rectified frames that never leave the GPU.
+ *
+ * The frame is only valid for the duration of the callback, which runs in the
+ * camera sampling thread: consumers must copy it or process it synchronously.
+ *
+ * @param callback Routine to call on each new rectified frame, empty to unregister.
+ */
+void CameraDriverNode::set_gpu_frame_callback(GpuFrameCallback && callback)
+{
+  std::lock_guard<std::mutex> lock(gpu_frame_callback_lock_);
+  gpu_frame_callback_ = std::move(callback);
+}
+
+/**
+ * @brief Gets new frames from the camera and processes them on a dedicated CUDA stream.
+ *
+ * Frames are captured into page-locked buffers; upload, processing and download of
+ * each frame run asynchronously while the next frame is captured.
+ */
+void CameraDriverNode::camera_cuda_routine()
+{
+  // High-resolution sleep timer, in nanoseconds
+  auto sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
+
+  RCLCPP_WARN(this->get_logger(), "Camera sampling thread started (CUDA stream)");
+
+  while (true) {
+    // Check if thread cancellation has been requested
+    if (stopped_.load(std::memory_order_acquire)) {
+      break;
+    }
+
+    // Switch capture mode, if requested
+    if (apply_device_mode()) {
+      sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
+    }
+
+    // Check which outputs are required for this frame
+    PendingFrame pending;
+    bool required = required_outputs(pending.raw, pending.rect);
+    {
+      std::lock_guard<std::mutex> lock(gpu_frame_callback_lock_);
+      pending.gpu_rect = cinfo_manager_->isCalibrated() &&
+        (bool(gpu_frame_callback_) || GpuFrameHub::instance().has_consumers(gpu_frame_channel_));
+    }
+    required = required || pending.gpu_rect;
+
+    // Get a new frame from the camera, while the GPU still processes the previous one
+    cv::cuda::HostMem & host_frame = cuda_host_frames_[cuda_host_frame_idx_];
+    cv::Mat frame = host_frame.createMatHeader();
+    bool native = pixel_format_ != PixelFormat::BGR;
+    bool new_frame = grab_frame(native ? native_frame_ : frame, pending.timestamp);
+    bool decoded = new_frame && (!native || decode_frame(native_frame_, frame, pending.timestamp));
+
+    // Publish the previous frame
+    complete_frame_async();
+
+    // Start processing the new frame, from page-locked memory
+    if (decoded && required) {
+      if (frame.data != host_frame.data) {
+        host_frame.create(frame.size(), frame.type());
+        frame.copyTo(host_frame.createMatHeader());
+      }
+      apply_geometry(host_frame.size());
+      enqueue_frame_async(host_frame, pending);
+      cuda_host_frame_idx_ ^= 1;
+    } else if (!new_frame) {
+      RCLCPP_INFO(this->get_logger(), "Empty frame");
+    }
+
+    // In free-running mode the device paces the loop, while replays pace themselves
+    if (!free_running_ && replay_ == nullptr) {
+      sampling_timer->sleep();
+    }
+  }
+
+  // Publish the last frame still on the GPU
+  complete_frame_async();
+
+  // Close video capture device, or replay source
+  video_cap_.release();
+  replay_.reset();
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Camera sampling thread stopped (buffer pools exhaustions: images %lu, camera info %lu)",
+    image_pool_->exhaustions(),
+    camera_info_pool_->exhaustions());
+}
+
+/**
+ * @brief Queues upload, processing and download of a new frame on the CUDA stream.
+ *
+ * @param host_frame Page-locked buffer storing the frame.
+ * @param pending Outputs to produce and capture timestamp.
+ */
+void CameraDriverNode::enqueue_frame_async(
+  cv::cuda::HostMem & host_frame,
+  const PendingFrame & pending)
+{
+  cv::Size output_size = image_size();
+  gpu_frame_.upload(host_frame, cuda_stream_);
+
+  if (fused_transform_) {
+    // Flip, resize and undistort with a single remap per output
+    if (host_frame.size() != fused_input_size_ ||
+      is_flipped_.load(std::memory_order_acquire) != fused_flipped_)
+    {
+      init_fused_maps(host_frame.size());
+    }
+    cv::cuda::GpuMat * image_src = &gpu_frame_;
+    if (pending.raw && !fused_identity_) {
+      cv::cuda::remap(
+        gpu_frame_,
+        gpu_flipped_frame_,
+        gpu_fused_map1_,
+        gpu_fused_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT,
+        cv::Scalar(),
+        cuda_stream_);
+      image_src = &gpu_flipped_frame_;
+    }
+    if (pending.raw) {
+      image_src->download(cuda_host_image_, cuda_stream_);
+    }
+    if (pending.rect || pending.gpu_rect) {
+      cv::cuda::remap(
+        gpu_frame_,
+        gpu_rectified_frame_,
+        gpu_fused_rect_map1_,
+        gpu_fused_rect_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT,
+        cv::Scalar(),
+        cuda_stream_);
+    }
+  } else {
+    // Flip the frame, then resize it and rectify it at capture geometry
+    cv::cuda::GpuMat * src = &gpu_frame_;
+    if (is_flipped_.load(std::memory_order_acquire)) {
+      cv::cuda::flip(*src, gpu_flipped_frame_, 0, cuda_stream_);
+      src = &gpu_flipped_frame_;
+    }
+    if (pending.raw) {
+      if (src->size() != output_size) {
+        cv::cuda::resize(
+          *src,
+          gpu_resized_frame_,
+          output_size,
+          0.0,
+          0.0,
+          cv::InterpolationFlags::INTER_LINEAR,
+          cuda_stream_);
+        gpu_resized_frame_.download(cuda_host_image_, cuda_stream_);
+      } else {
+        src->download(cuda_host_image_, cuda_stream_);
+      }
+    }
+    if (pending.rect || pending.gpu_rect) {
+      cv::cuda::remap(
+        *src,
+        gpu_rectified_frame_,
+        gpu_map1_,
+        gpu_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT,
+        cv::Scalar(),
+        cuda_stream_);
+    }
+  }
+
+  // The rectified frame leaves the GPU only for subscribers
+  if (pending.rect) {
+    gpu_rectified_frame_.download(cuda_host_rect_, cuda_stream_);
+  }
+
+  cuda_pending_ = pending;
+  cuda_pending_.valid = true;
+}
+
+/**
+ * @brief Waits for the frame on the CUDA stream, then publishes it.
+ */
+void CameraDriverNode::complete_frame_async()
+{
+  if (!cuda_pending_.valid) {
+    return;
+  }
+  cuda_pending_.valid = false;
+  cuda_stream_.waitForCompletion();
+
+  // Hand the rectified frame over to GPU consumers
+  if (cuda_pending_.gpu_rect) {
+    std::lock_guard<std::mutex> lock(gpu_frame_callback_lock_);
+    if (gpu_frame_callback_) {
+      gpu_frame_callback_(gpu_rectified_frame_, cuda_pending_.timestamp);
+    }
+    GpuFrameHub::instance().publish(
+      gpu_frame_channel_,
+      gpu_rectified_frame_,
+      cuda_pending_.timestamp);
+  }
+
+  // Copy the results out of page-locked memory, then publish them
+  Image::SharedPtr image_msg = nullptr, rect_image_msg = nullptr;
+  if (cuda_pending_.raw) {
+    cv::Mat host_image = cuda_host_image_.createMatHeader();
+    image_msg = frame_to_msg(host_image);
+  }
+  if (cuda_pending_.rect) {
+    cv::Mat host_rect = cuda_host_rect_.createMatHeader();
+    rect_image_msg = frame_to_msg(host_rect);
+  }
+  if (image_msg != nullptr || rect_image_msg != nullptr) {
+    publish_frame(image_msg, rect_image_msg, cuda_pending_.timestamp);
+  }
+}
+
+} // namespace USBCameraDriver
+
+#endif
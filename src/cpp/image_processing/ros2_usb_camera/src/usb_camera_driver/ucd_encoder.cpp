@@ -0,0 +1,236 @@
+/**
+ * ROS 2 USB Camera Driver node compressed stream encoder stage.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <usb_camera_driver/usb_camera_driver.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Sets up the compressed stream publisher, its encoder and thread, if requested.
+ *
+ * The stream is meant for remote monitoring over slow links: frames are encoded
+ * off the capture and publishing path, at most at the configured rate.
+ */
+void CameraDriverNode::init_encoder()
+{
+  EncoderBackend backend = EncoderBackend::NONE;
+  JpegEncoder::parse_backend(this->get_parameter("encoder").as_string(), backend);
+  if (backend == EncoderBackend::NONE) {
+    return;
+  }
+  jpeg_encoder_ = JpegEncoder::create(
+    backend,
+    this->get_parameter("encoder_device").as_string(),
+    int(this->get_parameter("encoder_quality").as_int()));
+  if (jpeg_encoder_ == nullptr) {
+    RCLCPP_ERROR(this->get_logger(), "No JPEG encoder available: compressed stream disabled");
+    return;
+  }
+
+  double max_rate = this->get_parameter("encoder_max_rate").as_double();
+  encoder_period_ = max_rate > 0.0 ? int64_t(1000000000.0 / max_rate) : 0;
+  encoded_pub_ = this->create_publisher<CompressedImage>(
+    "~/" + this->get_parameter("base_topic_name").as_string() + "/image_encoded/compressed",
+    rclcpp::QoS(
+      rclcpp::QoSInitialization::from_rmw(
+        this->get_parameter("best_effort_qos").as_bool() ?
+        usb_camera_qos_profile : usb_camera_reliable_qos_profile)));
+  encoder_stop_ = false;
+  encoder_thread_ = std::thread{
+    &CameraDriverNode::encoder_routine,
+    this};
+
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Compressed stream encoder: %s%s",
+    jpeg_encoder_->description().c_str(),
+    pixel_format_ == PixelFormat::MJPG ? ", device JPEG passed through when possible" : "");
+}
+
+/**
+ * @brief Stops the compressed stream encoder thread.
+ */
+void CameraDriverNode::stop_encoder()
+{
+  if (!encoder_thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(encoder_lock_);
+    encoder_stop_ = true;
+  }
+  encoder_cv_.notify_one();
+  encoder_thread_.join();
+
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Compressed stream encoder stopped (frames dropped while busy: %lu)",
+    encoder_drops_);
+}
+
+/**
+ * @brief Checks if the compressed stream takes the next frame.
+ *
+ * @return True if someone is listening and the rate cap allows a new frame, false otherwise.
+ */
+bool CameraDriverNode::encoder_due()
+{
+  return encoded_pub_ != nullptr &&
+         encoded_pub_->get_subscription_count() > 0 &&
+         StageStats::now() >= encoder_next_due_.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Checks if device JPEG frames can be streamed as they are.
+ *
+ * This requires they need no flip nor resize.
+ *
+ * @return True if device frames can be passed through, false if they must be encoded.
+ */
+bool CameraDriverNode::encoder_passthrough() const
+{
+  cv::Size capture_size(
+    capture_width_.load(std::memory_order_acquire),
+    capture_height_.load(std::memory_order_acquire));
+  return pixel_format_ == PixelFormat::MJPG &&
+         !is_flipped_.load(std::memory_order_acquire) && capture_size == image_size();
+}
+
+/**
+ * @brief Hands a color frame over to the encoder thread.
+ *
+ * The message buffer is shared, not copied; a frame still waiting is replaced.
+ *
+ * @param image_msg Image message to encode.
+ * @param timestamp Capture timestamp.
+ */
+void CameraDriverNode::submit_encoder_image(
+  const Image::SharedPtr & image_msg,
+  const rclcpp::Time & timestamp)
+{
+  encoder_next_due_.store(StageStats::now() + encoder_period_, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(encoder_lock_);
+    if (encoder_job_ready_) {
+      encoder_drops_++;
+    }
+    encoder_job_.image_msg = image_msg;
+    encoder_job_.timestamp = timestamp;
+    encoder_job_ready_ = true;
+  }
+  encoder_cv_.notify_one();
+}
+
+/**
+ * @brief Hands a device JPEG frame over to the encoder thread, to be published as is.
+ *
+ * A frame still waiting is replaced.
+ *
+ * @param native_frame cv::Mat storing the JPEG data.
+ * @param timestamp Capture timestamp.
+ */
+void CameraDriverNode::submit_encoder_jpeg(
+  const cv::Mat & native_frame,
+  const rclcpp::Time & timestamp)
+{
+  encoder_next_due_.store(StageStats::now() + encoder_period_, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(encoder_lock_);
+    if (encoder_job_ready_) {
+      encoder_drops_++;
+    }
+    encoder_job_.image_msg.reset();
+    encoder_job_.jpeg.assign(
+      native_frame.data,
+      native_frame.data + native_frame.total() * native_frame.elemSize());
+    encoder_job_.timestamp = timestamp;
+    encoder_job_ready_ = true;
+  }
+  encoder_cv_.notify_one();
+}
+
+/**
+ * @brief Encodes and publishes the compressed stream.
+ */
+void CameraDriverNode::encoder_routine()
+{
+  EncoderJob job;
+  CompressedImage encoded_msg;
+  encoded_msg.set__format("jpeg");
+
+  while (true) {
+    // Wait for the latest frame
+    {
+      std::unique_lock<std::mutex> lock(encoder_lock_);
+      encoder_cv_.wait(
+        lock,
+        [this]() -> bool {
+          return encoder_stop_ || encoder_job_ready_;
+        });
+      if (encoder_stop_) {
+        break;
+      }
+      std::swap(job, encoder_job_);
+      encoder_job_ready_ = false;
+    }
+
+    // Encode the frame, or take the device JPEG data as is
+    if (job.image_msg != nullptr) {
+      cv::Mat frame(
+        int(job.image_msg->height),
+        int(job.image_msg->width),
+        CV_8UC3,
+        job.image_msg->data.data(),
+        size_t(job.image_msg->step));
+      bool encoded = jpeg_encoder_->encode(frame, encoded_msg.data);
+
+      // Give the buffer back to the pool as soon as possible
+      job.image_msg.reset();
+      if (!encoded) {
+        RCLCPP_ERROR_THROTTLE(
+          this->get_logger(),
+          *this->get_clock(),
+          1000,
+          "Failed to encode frame (%s)",
+          jpeg_encoder_->description().c_str());
+        continue;
+      }
+    } else {
+      std::swap(encoded_msg.data, job.jpeg);
+    }
+
+    encoded_msg.header.set__stamp(job.timestamp);
+    encoded_msg.header.set__frame_id(frame_id_);
+    encoded_pub_->publish(encoded_msg);
+  }
+}
+
+} // namespace USBCameraDriver
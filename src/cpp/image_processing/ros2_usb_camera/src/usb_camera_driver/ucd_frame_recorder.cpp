@@ -0,0 +1,345 @@
+/**
+ * ROS 2 USB Camera Driver black-box frame recorder.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <usb_camera_driver/frame_recorder.hpp>
+
+#define FRAME_RECORDER_MAGIC "UCDREC1"
+#define FRAME_RECORDER_VERSION 1U
+#define FRAME_RECORD_MAGIC 0x46444355U // "UCDF"
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Unmaps and closes the ring file.
+ */
+FrameRecorder::~FrameRecorder()
+{
+  close();
+}
+
+/**
+ * @brief Opens a ring file, creating it if necessary.
+ *
+ * A ring of the same geometry is resumed after its last record, otherwise the
+ * file is resized and a new ring is started.
+ *
+ * @param path Ring file path.
+ * @param size Ring file size, in bytes, rounded down to a multiple of the page size.
+ * @return True if the ring is ready, false otherwise.
+ */
+bool FrameRecorder::open(const std::string & path, size_t size)
+{
+  close();
+  page_size_ = size_t(sysconf(_SC_PAGESIZE));
+  size -= size % page_size_;
+  if (size < 2 * page_size_) {
+    return false;
+  }
+
+  // Allocate all blocks now, so that writes never fault on a full disk
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 ||
+    (size_t(st.st_size) != size && ftruncate(fd_, off_t(size)) != 0) ||
+    posix_fallocate(fd_, 0, off_t(size)) != 0)
+  {
+    close();
+    return false;
+  }
+  void * addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    close();
+    return false;
+  }
+  map_ = static_cast<uint8_t *>(addr);
+  map_size_ = size;
+  path_ = path;
+  header_ = reinterpret_cast<RingHeader *>(map_);
+  records_ = map_ + page_size_;
+
+  // Start a new ring, unless this one can be resumed
+  uint64_t capacity = uint64_t(size - page_size_);
+  if (std::memcmp(header_->magic, FRAME_RECORDER_MAGIC, sizeof(header_->magic)) != 0 ||
+    header_->version != FRAME_RECORDER_VERSION ||
+    header_->page_size != uint32_t(page_size_) ||
+    header_->capacity != capacity ||
+    header_->head >= capacity)
+  {
+    std::memset(header_, 0, sizeof(RingHeader));
+    std::memcpy(header_->magic, FRAME_RECORDER_MAGIC, sizeof(header_->magic));
+    header_->version = FRAME_RECORDER_VERSION;
+    header_->page_size = uint32_t(page_size_);
+    header_->capacity = capacity;
+    header_->generation = uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
+  }
+  return true;
+}
+
+/**
+ * @brief Unmaps and closes the ring file; the kernel writes it back in the background.
+ */
+void FrameRecorder::close()
+{
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+    header_ = nullptr;
+    records_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+/**
+ * @brief Appends a frame to the ring, overwriting the oldest ones if necessary.
+ *
+ * Frames are skipped while the ring is being exported.
+ *
+ * @param format Frame format.
+ * @param width Frame width.
+ * @param height Frame height.
+ * @param step Row size, in bytes, for color frames.
+ * @param data Frame data.
+ * @param size Frame data size, in bytes.
+ * @param stamp Capture time [ns].
+ * @return True if the frame was recorded, false otherwise.
+ */
+bool FrameRecorder::write(
+  RecordFormat format,
+  uint32_t width, uint32_t height, uint32_t step,
+  const uint8_t * data, size_t size,
+  int64_t stamp)
+{
+  std::unique_lock<std::mutex> lock(lock_, std::try_to_lock);
+  if (!lock.owns_lock() || map_ == nullptr || size == 0 ||
+    record_size(size) > header_->capacity)
+  {
+    skipped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Records never wrap around the end of the ring
+  uint64_t offset = header_->head;
+  uint64_t end = offset + record_size(size);
+  if (end > header_->capacity) {
+    offset = 0;
+    end = record_size(size);
+  }
+
+  // Invalidate the old header first, so that it never describes new data
+  RecordHeader * record = record_at(offset);
+  record->magic = 0;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  std::memcpy(reinterpret_cast<uint8_t *>(record) + sizeof(RecordHeader), data, size);
+  record->format = uint32_t(format);
+  record->seq = header_->seq;
+  record->stamp = stamp;
+  record->width = width;
+  record->height = height;
+  record->step = step;
+  record->reserved = 0;
+  record->size = uint64_t(size);
+  record->check = check(*record);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  record->magic = FRAME_RECORD_MAGIC;
+
+  header_->head = end < header_->capacity ? end : 0;
+  header_->seq++;
+  return true;
+}
+
+/**
+ * @brief Exports all frames in the ring to a directory, oldest first.
+ *
+ * Color frames are stored as PNG and JPEG frames as they are, named after their
+ * sequence numbers, so that the directory can be replayed; index.csv lists their
+ * timestamps. Recording is frozen meanwhile.
+ *
+ * @param dir Directory to export frames into, created if necessary.
+ * @return Number of frames exported.
+ */
+size_t FrameRecorder::export_to(const std::string & dir)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  if (map_ == nullptr || (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)) {
+    return 0;
+  }
+  FILE * index = fopen((dir + "/index.csv").c_str(), "w");
+  if (index == nullptr) {
+    return 0;
+  }
+  fprintf(index, "seq,stamp_ns,width,height,file\n");
+
+  size_t exported = 0;
+  char name[32];
+  for (const RecordRef & ref : scan()) {
+    const RecordHeader * record = record_at(ref.offset);
+    const uint8_t * payload = reinterpret_cast<const uint8_t *>(record) + sizeof(RecordHeader);
+    bool ok = false;
+    if (record->format == uint32_t(RecordFormat::JPEG)) {
+      snprintf(name, sizeof(name), "%012" PRIu64 ".jpg", record->seq);
+      FILE * file = fopen((dir + "/" + name).c_str(), "wb");
+      if (file != nullptr) {
+        ok = fwrite(payload, size_t(record->size), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+      }
+    } else if (record->size >= uint64_t(record->step) * record->height &&
+      record->step >= uint64_t(record->width) * 3)
+    {
+      snprintf(name, sizeof(name), "%012" PRIu64 ".png", record->seq);
+      cv::Mat frame(
+        int(record->height), int(record->width), CV_8UC3,
+        const_cast<uint8_t *>(payload), size_t(record->step));
+      ok = cv::imwrite(dir + "/" + name, frame);
+    }
+    if (ok) {
+      fprintf(
+        index, "%" PRIu64 ",%" PRId64 ",%u,%u,%s\n",
+        record->seq, record->stamp, record->width, record->height, name);
+      exported++;
+    }
+  }
+  fclose(index);
+  return exported;
+}
+
+/**
+ * @brief Computes the check value of a record header.
+ *
+ * @param header Record header.
+ * @return 64-bit FNV-1a hash of all header fields and of the ring generation.
+ */
+uint64_t FrameRecorder::check(const RecordHeader & header) const
+{
+  const uint64_t fields[] = {
+    header.format, header.seq, uint64_t(header.stamp),
+    header.width, header.height, header.step, header.size,
+    header_->generation};
+  uint64_t hash = 14695981039346656037ULL;
+  const uint8_t * bytes = reinterpret_cast<const uint8_t *>(fields);
+  for (size_t i = 0; i < sizeof(fields); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief Returns the space a record takes in the ring.
+ *
+ * @param payload_size Frame data size, in bytes.
+ * @return Record size, in bytes, rounded up to a multiple of the page size.
+ */
+size_t FrameRecorder::record_size(size_t payload_size) const
+{
+  size_t size = sizeof(RecordHeader) + payload_size;
+  return (size + page_size_ - 1) / page_size_ * page_size_;
+}
+
+/**
+ * @brief Returns the header of the record at an offset in the ring.
+ *
+ * @param offset Record offset, page-aligned.
+ * @return Pointer to the record header.
+ */
+FrameRecorder::RecordHeader * FrameRecorder::record_at(uint64_t offset) const
+{
+  return reinterpret_cast<RecordHeader *>(records_ + offset);
+}
+
+/**
+ * @brief Finds the intact records in the ring.
+ *
+ * Every page is checked for a valid header: when two records overlap, the older
+ * one was partially overwritten by the newer one, and is discarded.
+ *
+ * @return Intact records, sorted by sequence number.
+ */
+std::vector<FrameRecorder::RecordRef> FrameRecorder::scan() const
+{
+  std::vector<RecordRef> records;
+  for (uint64_t offset = 0; offset + page_size_ <= header_->capacity; offset += page_size_) {
+    const RecordHeader * record = record_at(offset);
+    if (record->magic != FRAME_RECORD_MAGIC || record->check != check(*record) ||
+      (record->format != uint32_t(RecordFormat::BGR8) &&
+      record->format != uint32_t(RecordFormat::JPEG)))
+    {
+      continue;
+    }
+    RecordRef ref{offset, offset + record_size(size_t(record->size)), record->seq};
+    if (ref.end > header_->capacity) {
+      continue;
+    }
+
+    // Records come by offset: only the last ones kept might overlap this one
+    bool intact = true;
+    while (!records.empty() && records.back().end > ref.offset) {
+      if (records.back().seq > ref.seq) {
+        intact = false;
+        break;
+      }
+      records.pop_back();
+    }
+    if (intact) {
+      records.push_back(ref);
+    }
+  }
+  std::sort(
+    records.begin(), records.end(),
+    [](const RecordRef & a, const RecordRef & b) -> bool {
+      return a.seq < b.seq;
+    });
+  return records;
+}
+
+} // namespace USBCameraDriver
@@ -0,0 +1,510 @@
+/**
+ * ROS 2 USB Camera Driver JPEG encoders.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <linux/videodev2.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <usb_camera_driver/jpeg_encoder.hpp>
+
+#define V4L2_DEVICES_MAX 64
+#define V4L2_DEQUEUE_WAITS 10
+#define V4L2_DEQUEUE_TIMEOUT_MS 100
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Performs an ioctl, retrying if interrupted by a signal.
+ *
+ * @param fd File descriptor.
+ * @param request ioctl request.
+ * @param arg ioctl argument.
+ * @return ioctl return value.
+ */
+static int xioctl(int fd, unsigned long request, void * arg)
+{
+  int ret;
+  do {
+    ret = ioctl(fd, request, arg);
+  } while (ret == -1 && errno == EINTR);
+  return ret;
+}
+
+/**
+ * Encodes with OpenCV, i.e., libjpeg, on the calling thread.
+ */
+class SoftwareJpegEncoder : public JpegEncoder
+{
+public:
+  explicit SoftwareJpegEncoder(int quality)
+  : params_({cv::IMWRITE_JPEG_QUALITY, quality})
+  {}
+
+  bool encode(const cv::Mat & frame, std::vector<uint8_t> & jpeg) override
+  {
+    return cv::imencode(".jpg", frame, jpeg, params_);
+  }
+
+  std::string description() const override
+  {
+    return "software";
+  }
+
+private:
+  std::vector<int> params_;
+};
+
+/**
+ * Encodes with a V4L2 memory-to-memory JPEG encoder, e.g., the ones of many ARM SoCs.
+ *
+ * Frames are converted to planar YUV 4:2:0 straight into a single mapped input
+ * buffer, and the JPEG data is copied out of a single mapped output buffer:
+ * the device is reconfigured whenever the frame geometry changes.
+ */
+class V4L2JpegEncoder : public JpegEncoder
+{
+public:
+  V4L2JpegEncoder(const std::string & device, int quality)
+  : device_(device),
+    quality_(quality)
+  {}
+
+  ~V4L2JpegEncoder()
+  {
+    release_buffers();
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  V4L2JpegEncoder(const V4L2JpegEncoder &) = delete;
+  V4L2JpegEncoder & operator=(const V4L2JpegEncoder &) = delete;
+
+  /**
+   * @brief Opens the device, checking that it is a JPEG M2M encoder.
+   *
+   * @return True if the device can encode JPEG, false otherwise.
+   */
+  bool open_device()
+  {
+    fd_ = open(device_.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd_ < 0) {
+      return false;
+    }
+
+    struct v4l2_capability cap;
+    std::memset(&cap, 0, sizeof(cap));
+    if (xioctl(fd_, VIDIOC_QUERYCAP, &cap) < 0) {
+      return close_device();
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_M2M_MPLANE) || !(caps & V4L2_CAP_STREAMING)) {
+      return close_device();
+    }
+    card_ = reinterpret_cast<const char *>(cap.card);
+
+    // Look for JPEG among the output formats on the capture queue
+    struct v4l2_fmtdesc desc;
+    std::memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    for (desc.index = 0; xioctl(fd_, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+      if (desc.pixelformat == V4L2_PIX_FMT_JPEG || desc.pixelformat == V4L2_PIX_FMT_MJPEG) {
+        jpeg_format_ = desc.pixelformat;
+        return true;
+      }
+    }
+    return close_device();
+  }
+
+  bool encode(const cv::Mat & frame, std::vector<uint8_t> & jpeg) override
+  {
+    if (frame.size() != size_ && !configure(frame.size())) {
+      return false;
+    }
+
+    // Convert the frame and copy it into the input buffer, with the device strides
+    cv::cvtColor(frame, i420_, cv::COLOR_BGR2YUV_I420);
+    uint8_t * dst = static_cast<uint8_t *>(input_.addr);
+    const uint8_t * src = i420_.data;
+    int width = size_.width, height = size_.height;
+    for (int row = 0; row < height; row++) {
+      std::memcpy(dst + size_t(row) * stride_, src + size_t(row) * width, size_t(width));
+    }
+    src += size_t(width) * height;
+    dst += size_t(stride_) * plane_height_;
+    for (int chroma = 0; chroma < 2; chroma++) {
+      for (int row = 0; row < height / 2; row++) {
+        std::memcpy(
+          dst + size_t(row) * (stride_ / 2),
+          src + size_t(row) * (width / 2),
+          size_t(width / 2));
+      }
+      src += size_t(width / 2) * (height / 2);
+      dst += size_t(stride_ / 2) * (plane_height_ / 2);
+    }
+
+    // Run the encoder and collect its output
+    uint32_t bytesused = 0, unused = 0;
+    if (!queue(V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, uint32_t(input_size_)) ||
+      !dequeue(V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, bytesused) ||
+      !dequeue(V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, unused) ||
+      bytesused == 0 || bytesused > output_.length)
+    {
+      // Start over from a clean device state on the next frame
+      size_ = cv::Size();
+      return false;
+    }
+    const uint8_t * out = static_cast<const uint8_t *>(output_.addr);
+    jpeg.assign(out, out + bytesused);
+    if (!queue(V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, 0)) {
+      size_ = cv::Size();
+    }
+    return true;
+  }
+
+  std::string description() const override
+  {
+    return "V4L2 M2M " + device_ + " (" + card_ + ")";
+  }
+
+private:
+  /* Mapped device buffer */
+  struct Buffer
+  {
+    void * addr = MAP_FAILED;
+    size_t length = 0;
+  };
+
+  std::string device_;
+  std::string card_;
+  int quality_;
+  int fd_ = -1;
+  uint32_t jpeg_format_ = 0;
+  bool streaming_ = false;
+
+  /* Current configuration */
+  cv::Size size_;
+  uint32_t stride_ = 0;
+  uint32_t plane_height_ = 0;
+  size_t input_size_ = 0;
+  Buffer input_;
+  Buffer output_;
+  cv::Mat i420_;
+
+  bool close_device()
+  {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  /**
+   * @brief Sets up both queues for a new frame geometry, and starts streaming.
+   *
+   * @param size Frame size.
+   * @return True if the device accepted the geometry, false otherwise.
+   */
+  bool configure(const cv::Size & size)
+  {
+    release_buffers();
+    size_ = cv::Size();
+    if (size.width % 2 != 0 || size.height % 2 != 0) {
+      return false;
+    }
+
+    // Input: planar YUV 4:2:0, the device might pad rows and planes
+    struct v4l2_format fmt;
+    std::memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.width = uint32_t(size.width);
+    fmt.fmt.pix_mp.height = uint32_t(size.height);
+    fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_YUV420;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = 1;
+    if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0 ||
+      fmt.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_YUV420 ||
+      fmt.fmt.pix_mp.num_planes != 1 ||
+      fmt.fmt.pix_mp.width != uint32_t(size.width) ||
+      fmt.fmt.pix_mp.height != uint32_t(size.height))
+    {
+      return false;
+    }
+    stride_ = std::max(fmt.fmt.pix_mp.plane_fmt[0].bytesperline, uint32_t(size.width));
+    plane_height_ = std::max(
+      uint32_t(uint64_t(fmt.fmt.pix_mp.plane_fmt[0].sizeimage) * 2 / (uint64_t(stride_) * 3)),
+      uint32_t(size.height)) & ~1U;
+    input_size_ = size_t(stride_) * plane_height_ * 3 / 2;
+
+    // Output: JPEG
+    std::memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    fmt.fmt.pix_mp.width = uint32_t(size.width);
+    fmt.fmt.pix_mp.height = uint32_t(size.height);
+    fmt.fmt.pix_mp.pixelformat = jpeg_format_;
+    fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix_mp.num_planes = 1;
+    if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix_mp.pixelformat != jpeg_format_) {
+      return false;
+    }
+
+    // Not all encoders support changing quality
+    struct v4l2_control ctrl;
+    ctrl.id = V4L2_CID_JPEG_COMPRESSION_QUALITY;
+    ctrl.value = quality_;
+    xioctl(fd_, VIDIOC_S_CTRL, &ctrl);
+
+    // Get one buffer per queue, and start streaming
+    if (!map_buffer(V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, input_) ||
+      !map_buffer(V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, output_) ||
+      input_.length < input_size_ ||
+      !queue(V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, 0))
+    {
+      release_buffers();
+      return false;
+    }
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    streaming_ = true;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+      release_buffers();
+      return false;
+    }
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+      release_buffers();
+      return false;
+    }
+    size_ = size;
+    return true;
+  }
+
+  /**
+   * @brief Stops streaming, then unmaps and frees all device buffers.
+   */
+  void release_buffers()
+  {
+    if (fd_ < 0) {
+      return;
+    }
+    if (streaming_) {
+      int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+      xioctl(fd_, VIDIOC_STREAMOFF, &type);
+      type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+      xioctl(fd_, VIDIOC_STREAMOFF, &type);
+      streaming_ = false;
+    }
+    for (Buffer * buffer : {&input_, &output_}) {
+      if (buffer->addr != MAP_FAILED) {
+        munmap(buffer->addr, buffer->length);
+        buffer->addr = MAP_FAILED;
+        buffer->length = 0;
+      }
+    }
+    for (uint32_t type : {V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE}) {
+      struct v4l2_requestbuffers req;
+      std::memset(&req, 0, sizeof(req));
+      req.type = type;
+      req.memory = V4L2_MEMORY_MMAP;
+      xioctl(fd_, VIDIOC_REQBUFS, &req);
+    }
+  }
+
+  /**
+   * @brief Allocates and maps a single buffer on a queue.
+   *
+   * @param type Queue type.
+   * @param buffer Buffer to populate.
+   * @return True if the buffer was mapped, false otherwise.
+   */
+  bool map_buffer(uint32_t type, Buffer & buffer)
+  {
+    struct v4l2_requestbuffers req;
+    std::memset(&req, 0, sizeof(req));
+    req.count = 1;
+    req.type = type;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0 || req.count < 1) {
+      return false;
+    }
+
+    struct v4l2_plane plane;
+    struct v4l2_buffer buf;
+    std::memset(&plane, 0, sizeof(plane));
+    std::memset(&buf, 0, sizeof(buf));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = 0;
+    buf.m.planes = &plane;
+    buf.length = 1;
+    if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) {
+      return false;
+    }
+    buffer.addr = mmap(nullptr, plane.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, plane.m.mem_offset);
+    if (buffer.addr == MAP_FAILED) {
+      return false;
+    }
+    buffer.length = plane.length;
+    return true;
+  }
+
+  /**
+   * @brief Queues the buffer of a queue.
+   *
+   * @param type Queue type.
+   * @param bytesused Size of the payload, for input buffers.
+   * @return True if the buffer was queued, false otherwise.
+   */
+  bool queue(uint32_t type, uint32_t bytesused)
+  {
+    struct v4l2_plane plane;
+    struct v4l2_buffer buf;
+    std::memset(&plane, 0, sizeof(plane));
+    std::memset(&buf, 0, sizeof(buf));
+    buf.type = type;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = 0;
+    buf.m.planes = &plane;
+    buf.length = 1;
+    plane.bytesused = bytesused;
+    plane.length = uint32_t(type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE ? input_.length : output_.length);
+    return xioctl(fd_, VIDIOC_QBUF, &buf) == 0;
+  }
+
+  /**
+   * @brief Dequeues the buffer of a queue, waiting for the device to be done with it.
+   *
+   * @param type Queue type.
+   * @param bytesused Size of the payload to populate.
+   * @return True if the buffer was dequeued, false on errors or timeout.
+   */
+  bool dequeue(uint32_t type, uint32_t & bytesused)
+  {
+    struct v4l2_plane plane;
+    struct v4l2_buffer buf;
+    for (int waits = 0; ; waits++) {
+      std::memset(&plane, 0, sizeof(plane));
+      std::memset(&buf, 0, sizeof(buf));
+      buf.type = type;
+      buf.memory = V4L2_MEMORY_MMAP;
+      buf.m.planes = &plane;
+      buf.length = 1;
+      if (xioctl(fd_, VIDIOC_DQBUF, &buf) == 0) {
+        bytesused = plane.bytesused;
+        return (buf.flags & V4L2_BUF_FLAG_ERROR) == 0;
+      }
+      if (errno != EAGAIN || waits == V4L2_DEQUEUE_WAITS) {
+        return false;
+      }
+      struct pollfd pfd;
+      pfd.fd = fd_;
+      pfd.events = type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ? POLLIN : POLLOUT;
+      pfd.revents = 0;
+      poll(&pfd, 1, V4L2_DEQUEUE_TIMEOUT_MS);
+    }
+  }
+};
+
+/**
+ * @brief Creates a JPEG encoder.
+ *
+ * In auto mode, the given V4L2 device is used if it is a JPEG encoder, or the
+ * first such device is looked for if none is given; the software encoder is
+ * used as a fallback.
+ *
+ * @param backend Encoder backend.
+ * @param device V4L2 M2M device path, empty to look for one.
+ * @param quality JPEG quality, in [1, 100].
+ * @return New encoder, or null if the backend is not available.
+ */
+std::unique_ptr<JpegEncoder> JpegEncoder::create(
+  EncoderBackend backend,
+  const std::string & device,
+  int quality)
+{
+  if (backend == EncoderBackend::NONE) {
+    return nullptr;
+  }
+  if (backend == EncoderBackend::V4L2_M2M || backend == EncoderBackend::AUTO) {
+    std::vector<std::string> devices;
+    if (device.empty()) {
+      for (int i = 0; i < V4L2_DEVICES_MAX; i++) {
+        devices.push_back("/dev/video" + std::to_string(i));
+      }
+    } else {
+      devices.push_back(device);
+    }
+    for (const std::string & path : devices) {
+      auto encoder = std::make_unique<V4L2JpegEncoder>(path, quality);
+      if (encoder->open_device()) {
+        return encoder;
+      }
+    }
+    if (backend == EncoderBackend::V4L2_M2M) {
+      return nullptr;
+    }
+  }
+  return std::make_unique<SoftwareJpegEncoder>(quality);
+}
+
+/**
+ * @brief Parses an encoder backend name.
+ *
+ * @param backend Either none, auto, software or v4l2_m2m.
+ * @param value Backend to populate.
+ * @return True if the name is valid, false otherwise.
+ */
+bool JpegEncoder::parse_backend(const std::string & backend, EncoderBackend & value)
+{
+  if (backend == "none") {
+    value = EncoderBackend::NONE;
+  } else if (backend == "auto") {
+    value = EncoderBackend::AUTO;
+  } else if (backend == "software") {
+    value = EncoderBackend::SOFTWARE;
+  } else if (backend == "v4l2_m2m") {
+    value = EncoderBackend::V4L2_M2M;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+} // namespace USBCameraDriver
@@ -0,0 +1,226 @@
+/**
+ * ROS 2 USB Camera Driver on-disk rectification maps cache.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <usb_camera_driver/map_cache.hpp>
+
+#define MAP_CACHE_MAGIC "UCDMAPS"
+#define MAP_CACHE_VERSION 1U
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Builds a new MapCache, creating its directory if necessary.
+ *
+ * @param dir Directory to store cache files into.
+ */
+MapCache::MapCache(const std::string & dir)
+: dir_(dir)
+{
+  mkdir(dir_.c_str(), 0755);
+}
+
+/**
+ * @brief Releases all file mappings.
+ */
+MapCache::~MapCache()
+{
+  for (Mapping & m : mappings_) {
+    munmap(m.addr, m.size);
+  }
+}
+
+/**
+ * @brief Computes the cache key of a calibration and geometry.
+ *
+ * @param A Camera matrix.
+ * @param D Distortion coefficients.
+ * @param input_size Size of the frames to rectify.
+ * @param output_size Size of the rectified frames.
+ * @return 64-bit FNV-1a hash of all parameters.
+ */
+uint64_t MapCache::key(
+  const cv::Mat & A, const cv::Mat & D,
+  const cv::Size & input_size, const cv::Size & output_size)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  auto update = [&hash](const void * data, size_t size) {
+      const uint8_t * bytes = static_cast<const uint8_t *>(data);
+      for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+      }
+    };
+  cv::Mat A64, D64;
+  A.convertTo(A64, CV_64F);
+  D.convertTo(D64, CV_64F);
+  A64 = A64.isContinuous() ? A64 : A64.clone();
+  D64 = D64.isContinuous() ? D64 : D64.clone();
+  update(A64.data, A64.total() * A64.elemSize());
+  update(D64.data, D64.total() * D64.elemSize());
+  int32_t dims[4] = {input_size.width, input_size.height, output_size.width, output_size.height};
+  update(dims, sizeof(dims));
+  uint32_t version = MAP_CACHE_VERSION;
+  update(&version, sizeof(version));
+  return hash;
+}
+
+/**
+ * @brief Loads maps from the cache, if available.
+ *
+ * @param key Cache key.
+ * @param output_size Size of the rectified frames.
+ * @param maps Maps to populate, as headers over the file mapping.
+ * @return True if the maps were found and are valid, false otherwise.
+ */
+bool MapCache::load(uint64_t key, const cv::Size & output_size, MapSet & maps)
+{
+  std::string file = path(key);
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  size_t size = sizeof(Header) + payload_size(output_size);
+  struct stat st;
+  if (fstat(fd, &st) || size_t(st.st_size) != size) {
+    close(fd);
+    return false;
+  }
+  void * addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  // Check that this is the file we are looking for
+  const Header * header = static_cast<const Header *>(addr);
+  if (std::memcmp(header->magic, MAP_CACHE_MAGIC, sizeof(header->magic)) ||
+    header->version != MAP_CACHE_VERSION ||
+    header->key != key ||
+    header->width != uint32_t(output_size.width) ||
+    header->height != uint32_t(output_size.height))
+  {
+    munmap(addr, size);
+    return false;
+  }
+
+  // Wrap the maps, in file order, without copying them
+  uint8_t * data = static_cast<uint8_t *>(addr) + sizeof(Header);
+  size_t pixels = size_t(output_size.area());
+  maps.fixed1 = cv::Mat(output_size, CV_16SC2, data);
+  data += pixels * 2 * sizeof(int16_t);
+  maps.fixed2 = cv::Mat(output_size, CV_16UC1, data);
+  data += pixels * sizeof(uint16_t);
+  maps.float1 = cv::Mat(output_size, CV_32FC1, data);
+  data += pixels * sizeof(float);
+  maps.float2 = cv::Mat(output_size, CV_32FC1, data);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  mappings_.push_back({addr, size});
+  return true;
+}
+
+/**
+ * @brief Stores maps into the cache.
+ *
+ * The file is written aside and then renamed, so that concurrent readers never
+ * see partial files.
+ *
+ * @param key Cache key.
+ * @param output_size Size of the rectified frames.
+ * @param maps Maps to store.
+ * @return True if the maps were stored, false otherwise.
+ */
+bool MapCache::store(uint64_t key, const cv::Size & output_size, const MapSet & maps)
+{
+  std::string file = path(key);
+  std::string tmp_file = file + "." + std::to_string(getpid()) + ".tmp";
+  FILE * f = fopen(tmp_file.c_str(), "wb");
+  if (f == nullptr) {
+    return false;
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAP_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MAP_CACHE_VERSION;
+  header.width = uint32_t(output_size.width);
+  header.height = uint32_t(output_size.height);
+  header.key = key;
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  for (const cv::Mat * m : {&maps.fixed1, &maps.fixed2, &maps.float1, &maps.float2}) {
+    cv::Mat c = m->isContinuous() ? *m : m->clone();
+    size_t size = c.total() * c.elemSize();
+    ok = ok && fwrite(c.data, 1, size, f) == size;
+  }
+  ok = (fclose(f) == 0) && ok;
+
+  if (!ok || rename(tmp_file.c_str(), file.c_str())) {
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Returns the path of the cache file for a given key.
+ *
+ * @param key Cache key.
+ * @return Cache file path.
+ */
+std::string MapCache::path(uint64_t key) const
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/rectmaps_%016" PRIx64 ".bin", key);
+  return dir_ + name;
+}
+
+/**
+ * @brief Returns the size of the maps stored in a cache file.
+ *
+ * @param output_size Size of the rectified frames.
+ * @return Maps size, in bytes.
+ */
+size_t MapCache::payload_size(const cv::Size & output_size)
+{
+  size_t pixels = size_t(output_size.area());
+  return pixels * (2 * sizeof(int16_t) + sizeof(uint16_t) + 2 * sizeof(float));
+}
+
+} // namespace USBCameraDriver
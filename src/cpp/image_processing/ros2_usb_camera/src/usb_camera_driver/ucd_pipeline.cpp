@@ -0,0 +1,185 @@
+/**
+ * ROS 2 USB Camera Driver node processing pipeline.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <usb_camera_driver/usb_camera_driver.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Gets new frames from the camera and feeds them to the processing pipeline.
+ *
+ * Transform and publish stages run in their own threads, joined by lock-free queues,
+ * so that a processing stall never delays the next capture.
+ */
+void CameraDriverNode::camera_pipeline_routine()
+{
+  // High-resolution sleep timer, in nanoseconds
+  auto sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
+
+  // Start downstream pipeline stages
+  pipeline_drops_.store(0, std::memory_order_release);
+  camera_transform_thread_ = std::thread{
+    &CameraDriverNode::camera_transform_routine,
+    this};
+  camera_publish_thread_ = std::thread{
+    &CameraDriverNode::camera_publish_routine,
+    this};
+
+  RCLCPP_WARN(this->get_logger(), "Camera sampling thread started (pipeline mode)");
+
+  while (true) {
+    // Check if thread cancellation has been requested
+    if (stopped_.load(std::memory_order_acquire)) {
+      break;
+    }
+
+    // Switch capture mode, if requested
+    if (apply_device_mode()) {
+      sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
+    }
+
+    // Get a new frame from the camera into a recycled buffer and pass it on
+    CapturedFrame captured;
+    captured.frame = frame_pool_->acquire();
+    if (large_buffer_allocator_ != nullptr) {
+      captured.frame->allocator = large_buffer_allocator_;
+    }
+    if (grab_frame(*captured.frame, captured.timestamp)) {
+      if (!transform_queue_->push(std::move(captured), pipeline_overwrite_)) {
+        pipeline_drops_.fetch_add(1, std::memory_order_relaxed);
+        if (stage_stats_ != nullptr) {
+          stage_stats_->add_dropped();
+        }
+      }
+    } else {
+      RCLCPP_INFO(this->get_logger(), "Empty frame");
+    }
+
+    // In free-running mode the device paces the loop, while replays pace themselves
+    if (!free_running_ && replay_ == nullptr) {
+      sampling_timer->sleep();
+    }
+  }
+
+  // Stop downstream pipeline stages
+  transform_queue_->wake();
+  camera_transform_thread_.join();
+  publish_queue_->wake();
+  camera_publish_thread_.join();
+
+  // Release frames still in the pipeline
+  CapturedFrame captured;
+  while (transform_queue_->try_pop(captured)) {}
+  FrameMessages messages;
+  while (publish_queue_->try_pop(messages)) {}
+
+  // Close video capture device, or replay source
+  video_cap_.release();
+  replay_.reset();
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Camera sampling thread stopped (pipeline drops: %lu, buffer pools exhaustions: images %lu, camera info %lu)",
+    pipeline_drops_.load(std::memory_order_acquire),
+    image_pool_->exhaustions(),
+    camera_info_pool_->exhaustions());
+}
+
+/**
+ * @brief Processes frames coming from the capture stage.
+ */
+void CameraDriverNode::camera_transform_routine()
+{
+  while (true) {
+    // Wait for a new frame, checking if thread cancellation has been requested
+    CapturedFrame captured;
+    if (!transform_queue_->pop(captured, 100)) {
+      if (stopped_.load(std::memory_order_acquire)) {
+        break;
+      }
+      continue;
+    }
+
+    // Decode the new frame, if necessary
+    cv::Mat * frame = captured.frame.get();
+    if (pixel_format_ != PixelFormat::BGR) {
+      if (!decode_frame(*frame, frame_, captured.timestamp)) {
+        continue;
+      }
+      frame = &frame_;
+    }
+
+    // Check which outputs are required for this frame
+    bool raw, rect;
+    if (!required_outputs(raw, rect)) {
+      continue;
+    }
+
+    // Process the new frame, then give its buffer back to the capture stage
+    apply_geometry(frame->size());
+    FrameMessages messages;
+    messages.timestamp = captured.timestamp;
+    if (fused_transform_) {
+      process_frame_fused(*frame, messages.image_msg, messages.rect_image_msg, raw, rect);
+    } else if (zero_copy_) {
+      process_frame_zero_copy(*frame, messages.image_msg, messages.rect_image_msg, raw, rect);
+    } else {
+      process_frame(*frame, messages.image_msg, messages.rect_image_msg, raw, rect);
+    }
+    captured.frame.reset();
+
+    if (!publish_queue_->push(std::move(messages), pipeline_overwrite_)) {
+      pipeline_drops_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Publishes frames coming from the transform stage.
+ */
+void CameraDriverNode::camera_publish_routine()
+{
+  while (true) {
+    // Wait for new messages, checking if thread cancellation has been requested
+    FrameMessages messages;
+    if (!publish_queue_->pop(messages, 100)) {
+      if (stopped_.load(std::memory_order_acquire)) {
+        break;
+      }
+      continue;
+    }
+
+    publish_frame(messages.image_msg, messages.rect_image_msg, messages.timestamp);
+  }
+}
+
+} // namespace USBCameraDriver
+
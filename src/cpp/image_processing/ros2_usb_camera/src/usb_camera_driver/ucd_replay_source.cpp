@@ -0,0 +1,457 @@
+/**
+ * ROS 2 USB Camera Driver recorded frames replay sources.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <rclcpp/serialization.hpp>
+#include <rclcpp/serialized_message.hpp>
+
+#include <rosbag2_cpp/reader.hpp>
+#include <rosbag2_storage/storage_filter.hpp>
+
+#include <sensor_msgs/image_encodings.hpp>
+#include <sensor_msgs/msg/compressed_image.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+#include <usb_camera_driver/replay_source.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * Replays a video file, with the timestamps of its container.
+ */
+class VideoFileReplay : public ReplaySource
+{
+public:
+  explicit VideoFileReplay(const std::string & path)
+  : path_(path)
+  {}
+
+  std::string description() const override
+  {
+    return "video file " + path_;
+  }
+
+protected:
+  bool rewind() override
+  {
+    video_cap_.release();
+    return video_cap_.open(path_);
+  }
+
+  bool next(cv::Mat & frame, int64_t & stamp) override
+  {
+    if (!video_cap_.read(frame) || frame.empty()) {
+      return false;
+    }
+    double msec = video_cap_.get(cv::CAP_PROP_POS_MSEC);
+    stamp = msec > 0.0 ? int64_t(msec * 1000000.0) : -1;
+    return true;
+  }
+
+  double source_fps() const override
+  {
+    return video_cap_.get(cv::CAP_PROP_FPS);
+  }
+
+private:
+  std::string path_;
+  cv::VideoCapture video_cap_;
+};
+
+/**
+ * Replays the images of a directory, in file name order.
+ */
+class ImageDirectoryReplay : public ReplaySource
+{
+public:
+  explicit ImageDirectoryReplay(const std::string & path)
+  : path_(path)
+  {}
+
+  std::string description() const override
+  {
+    return "image directory " + path_ + " (" + std::to_string(files_.size()) + " images)";
+  }
+
+protected:
+  bool rewind() override
+  {
+    if (files_.empty()) {
+      list_files();
+    }
+    next_file_ = 0;
+    return !files_.empty();
+  }
+
+  bool next(cv::Mat & frame, int64_t & stamp) override
+  {
+    // Skip files that cannot be decoded
+    while (next_file_ < files_.size()) {
+      frame = cv::imread(files_[next_file_++], cv::IMREAD_COLOR);
+      if (!frame.empty()) {
+        stamp = -1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  std::string path_;
+  std::vector<std::string> files_;
+  size_t next_file_ = 0;
+
+  void list_files()
+  {
+    static const std::vector<std::string> extensions = {
+      ".bmp", ".jpeg", ".jpg", ".pgm", ".png", ".ppm", ".tif", ".tiff"};
+
+    DIR * dir = opendir(path_.c_str());
+    if (dir == nullptr) {
+      return;
+    }
+    while (struct dirent * entry = readdir(dir)) {
+      std::string name(entry->d_name);
+      size_t dot = name.rfind('.');
+      if (dot == std::string::npos) {
+        continue;
+      }
+      std::string ext = name.substr(dot);
+      std::transform(
+        ext.begin(), ext.end(), ext.begin(),
+        [](unsigned char c) {return char(std::tolower(c));});
+      if (std::find(extensions.begin(), extensions.end(), ext) != extensions.end()) {
+        files_.push_back(path_ + "/" + name);
+      }
+    }
+    closedir(dir);
+    std::sort(files_.begin(), files_.end());
+  }
+};
+
+/**
+ * Replays an image topic of a rosbag, raw or compressed, with its recording timestamps.
+ */
+class BagReplay : public ReplaySource
+{
+public:
+  BagReplay(const std::string & uri, const std::string & topic)
+  : uri_(uri),
+    topic_(topic)
+  {}
+
+  std::string description() const override
+  {
+    return "rosbag " + uri_ + " (topic " + topic_ + ")";
+  }
+
+protected:
+  bool rewind() override
+  {
+    try {
+      reader_ = std::make_unique<rosbag2_cpp::Reader>();
+      reader_->open(uri_);
+
+      // Pick the requested image topic, or the first one
+      compressed_ = false;
+      bool found = false;
+      for (const auto & topic : reader_->get_all_topics_and_types()) {
+        bool raw = topic.type == "sensor_msgs/msg/Image";
+        bool compressed = topic.type == "sensor_msgs/msg/CompressedImage";
+        if ((raw || compressed) && (topic_.empty() || topic.name == topic_)) {
+          topic_ = topic.name;
+          compressed_ = compressed;
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        return false;
+      }
+
+      rosbag2_storage::StorageFilter filter;
+      filter.topics.push_back(topic_);
+      reader_->set_filter(filter);
+    } catch (const std::exception &) {
+      return false;
+    }
+    return true;
+  }
+
+  bool next(cv::Mat & frame, int64_t & stamp) override
+  {
+    while (reader_->has_next()) {
+      auto bag_msg = reader_->read_next();
+      if (bag_msg->topic_name != topic_) {
+        continue;
+      }
+      rclcpp::SerializedMessage serialized(*bag_msg->serialized_data);
+      bool decoded;
+      if (compressed_) {
+        compressed_serializer_.deserialize_message(&serialized, &compressed_msg_);
+        cv::imdecode(compressed_msg_.data, cv::IMREAD_COLOR, &frame);
+        decoded = !frame.empty();
+      } else {
+        image_serializer_.deserialize_message(&serialized, &image_msg_);
+        decoded = image_to_bgr(image_msg_, frame);
+      }
+      if (decoded) {
+        stamp = int64_t(bag_msg->time_stamp);
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  std::string uri_;
+  std::string topic_;
+  bool compressed_ = false;
+  std::unique_ptr<rosbag2_cpp::Reader> reader_;
+  rclcpp::Serialization<sensor_msgs::msg::Image> image_serializer_;
+  rclcpp::Serialization<sensor_msgs::msg::CompressedImage> compressed_serializer_;
+  sensor_msgs::msg::Image image_msg_;
+  sensor_msgs::msg::CompressedImage compressed_msg_;
+
+  /* Converts the image encodings a camera would record to BGR. */
+  static bool image_to_bgr(const sensor_msgs::msg::Image & msg, cv::Mat & frame)
+  {
+    namespace enc = sensor_msgs::image_encodings;
+    int type, code;
+    if (msg.encoding == enc::BGR8) {
+      type = CV_8UC3;
+      code = -1;
+    } else if (msg.encoding == enc::RGB8) {
+      type = CV_8UC3;
+      code = cv::COLOR_RGB2BGR;
+    } else if (msg.encoding == enc::BGRA8) {
+      type = CV_8UC4;
+      code = cv::COLOR_BGRA2BGR;
+    } else if (msg.encoding == enc::RGBA8) {
+      type = CV_8UC4;
+      code = cv::COLOR_RGBA2BGR;
+    } else if (msg.encoding == enc::MONO8) {
+      type = CV_8UC1;
+      code = cv::COLOR_GRAY2BGR;
+    } else if (msg.encoding == enc::YUV422_YUY2) {
+      type = CV_8UC2;
+      code = cv::COLOR_YUV2BGR_YUY2;
+    } else {
+      return false;
+    }
+    if (msg.height == 0 || msg.width == 0 || msg.data.size() < size_t(msg.step) * msg.height) {
+      return false;
+    }
+
+    cv::Mat view(
+      int(msg.height), int(msg.width), type,
+      const_cast<uint8_t *>(msg.data.data()), size_t(msg.step));
+    if (code < 0) {
+      view.copyTo(frame);
+    } else {
+      cv::cvtColor(view, frame, code);
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief Creates the replay source for a recording, depending on its kind.
+ *
+ * Rosbags are directories with a metadata.yaml file, or .db3 and .mcap files;
+ * other directories are replayed as image sequences, other files as videos.
+ *
+ * @param uri Recording path, optionally as a file:// URL.
+ * @param topic Image topic to replay from rosbags, empty for the first one.
+ * @return New replay source, or null if the recording does not exist.
+ */
+std::unique_ptr<ReplaySource> ReplaySource::create(const std::string & uri, const std::string & topic)
+{
+  std::string path = uri.rfind("file://", 0) == 0 ? uri.substr(7) : uri;
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+
+  struct stat path_stat;
+  if (stat(path.c_str(), &path_stat) != 0) {
+    return nullptr;
+  }
+  if (S_ISDIR(path_stat.st_mode)) {
+    struct stat metadata_stat;
+    if (stat((path + "/metadata.yaml").c_str(), &metadata_stat) == 0) {
+      return std::make_unique<BagReplay>(path, topic);
+    }
+    return std::make_unique<ImageDirectoryReplay>(path);
+  }
+  size_t dot = path.rfind('.');
+  std::string ext = dot == std::string::npos ? "" : path.substr(dot);
+  if (ext == ".db3" || ext == ".mcap") {
+    return std::make_unique<BagReplay>(path, topic);
+  }
+  return std::make_unique<VideoFileReplay>(path);
+}
+
+/**
+ * @brief Parses a pacing mode name.
+ *
+ * @param pacing Either realtime, fixed or fast.
+ * @param value Pacing mode to populate.
+ * @return True if the name is valid, false otherwise.
+ */
+bool ReplaySource::parse_pacing(const std::string & pacing, ReplayPacing & value)
+{
+  if (pacing == "realtime") {
+    value = ReplayPacing::REALTIME;
+  } else if (pacing == "fixed") {
+    value = ReplayPacing::FIXED;
+  } else if (pacing == "fast") {
+    value = ReplayPacing::FAST;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Opens the recording and reads its first frame.
+ *
+ * @param pacing Pacing mode.
+ * @param fps Driver frame rate, for fixed pacing and recordings without timing.
+ * @param loop Replay the recording again when it ends.
+ * @return True if the recording has at least one frame, false otherwise.
+ */
+bool ReplaySource::open(ReplayPacing pacing, double fps, bool loop)
+{
+  pacing_ = pacing;
+  loop_ = loop;
+  finished_ = false;
+  frames_ = 0;
+  if (!restart()) {
+    return false;
+  }
+
+  // Recordings without timestamps are replayed at their own frame rate, if known
+  double period_fps = pacing_ == ReplayPacing::REALTIME && source_fps() > 0.0 ? source_fps() : fps;
+  period_ = period_fps > 0.0 ?
+    std::chrono::nanoseconds(int64_t(1000000000.0 / period_fps)) :
+    std::chrono::nanoseconds(0);
+  return true;
+}
+
+/**
+ * @brief Gets the next frame, as soon as it is due.
+ *
+ * Frames are copied into the given buffer, which is reused if it fits.
+ * Once the recording is over, and not looping, this only waits a bit and fails.
+ *
+ * @param frame cv::Mat to store the frame into.
+ * @return True if a new frame was read, false otherwise.
+ */
+bool ReplaySource::read(cv::Mat & frame)
+{
+  int64_t stamp = -1;
+  if (finished_ || !(first_pending_ || next(buffer_, stamp) || (loop_ && restart()))) {
+    finished_ = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return false;
+  }
+  if (first_pending_) {
+    first_pending_ = false;
+    stamp = first_stamp_;
+    wait(stamp);
+    first_frame_.copyTo(frame);
+  } else {
+    wait(stamp);
+    buffer_.copyTo(frame);
+  }
+  pass_frames_++;
+  frames_++;
+  return true;
+}
+
+/**
+ * @brief Goes back to the beginning of the recording, and starts a new pass.
+ *
+ * @return True if the recording has at least one frame, false otherwise.
+ */
+bool ReplaySource::restart()
+{
+  if (!rewind() || !next(first_frame_, first_stamp_)) {
+    return false;
+  }
+  first_pending_ = true;
+  pass_frames_ = 0;
+  return true;
+}
+
+/**
+ * @brief Sleeps until a frame is due, the first of each pass being due immediately.
+ *
+ * @param stamp Frame recording time [ns], -1 if unknown.
+ */
+void ReplaySource::wait(int64_t stamp)
+{
+  if (pass_frames_ == 0) {
+    start_ = std::chrono::steady_clock::now();
+    pass_start_stamp_ = stamp;
+    return;
+  }
+
+  std::chrono::steady_clock::time_point due;
+  switch (pacing_) {
+    case ReplayPacing::REALTIME:
+      if (stamp >= 0 && pass_start_stamp_ >= 0) {
+        due = start_ + std::chrono::nanoseconds(stamp - pass_start_stamp_);
+        break;
+      }
+      [[fallthrough]];
+    case ReplayPacing::FIXED:
+      due = start_ + period_ * int64_t(pass_frames_);
+      break;
+    default:
+      return;
+  }
+  std::this_thread::sleep_until(due);
+}
+
+} // namespace USBCameraDriver
@@ -28,6 +28,7 @@
  * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <array>
 #include <cfloat>
 #include <cstdint>
 #include <cstring>
@@ -45,615 +46,1429 @@ namespace USBCameraDriver
  */
 Image::SharedPtr CameraDriverNode::frame_to_msg(cv::Mat & frame)
 {
-  // Resize the frame as per node parameters
-  if (frame.rows != image_width_ || frame.cols != image_height_) {
-    cv::resize(frame, frame, cv::Size(image_width_, image_height_));
+  // Resize the frame as per node parameters, only if the device geometry differs
+  cv::Mat * src = &frame;
+  cv::Size output_size = image_size();
+  if (frame.size() != output_size) {
+    int64_t resize_start = stage_start();
+    cv::resize(frame, resized_frame_, output_size);
+    stage_end(Stage::RESIZE, resize_start);
+    src = &resized_frame_;
   }
 
-  // Allocate new image message
-  auto ros_image = std::make_shared<Image>();
+  // Get a new image message from the pool
+  Image::SharedPtr ros_image = image_pool_->acquire();
 
   // Set frame-relevant image contents
-  ros_image->set__width(frame.cols);
-  ros_image->set__height(frame.rows);
+  ros_image->set__width(src->cols);
+  ros_image->set__height(src->rows);
   ros_image->set__encoding(sensor_msgs::image_encodings::BGR8);
-  ros_image->set__step(frame.cols * frame.elemSize());
+  ros_image->set__step(src->cols * src->elemSize());
 
   // Check data endianness
   ros_image->set__is_bigendian(false);
 
   // Copy frame data (this avoids the obsolete cv_bridge)
-  size_t size = ros_image->step * frame.rows;
+  int64_t copy_start = stage_start();
+  size_t size = ros_image->step * src->rows;
   ros_image->data.resize(size);
-  std::memcpy(ros_image->data.data(), frame.data, size);
+  std::memcpy(ros_image->data.data(), src->data, size);
+  stage_end(Stage::COPY, copy_start);
+  if (stage_stats_ != nullptr) {
+    stage_stats_->add_bytes(size);
+  }
 
   return ros_image;
 }
 
 /**
- * @brief Initializes node parameters.
+ * @brief Allocates a new Image message and wraps its buffer in a cv::Mat header.
+ *
+ * @param frame_view cv::Mat header to set up on the message buffer.
+ * @return Shared pointer to a new Image message.
  */
-void CameraDriverNode::init_parameters()
+Image::SharedPtr CameraDriverNode::new_frame_msg(cv::Mat & frame_view)
 {
-  // Register parameter updates callback
-  on_set_params_chandle_ = this->add_on_set_parameters_callback(
-    std::bind(
-      &CameraDriverNode::on_set_parameters_callback,
-      this,
-      std::placeholders::_1));
+  // Get a new image message from the pool
+  Image::SharedPtr ros_image = image_pool_->acquire();
 
-  // Base topic name
-  declare_string_parameter(
-    "base_topic_name",
-    "camera",
-    "image_transport base topic name.",
-    "Cannot be changed.",
-    true,
-    base_topic_name_descriptor_);
+  // Set image contents as per node parameters
+  cv::Size output_size = image_size();
+  ros_image->set__width(output_size.width);
+  ros_image->set__height(output_size.height);
+  ros_image->set__encoding(sensor_msgs::image_encodings::BGR8);
+  ros_image->set__step(output_size.width * 3);
 
-  // Best-effort QoS flag
-  declare_bool_parameter(
-    "best_effort_qos",
-    false,
-    "Best-effort QoS flag.",
-    "Cannot be changed.",
-    true,
-    base_topic_name_descriptor_);
+  // Check data endianness
+  ros_image->set__is_bigendian(false);
 
-  // Brightness
-  declare_double_parameter(
-    "brightness",
-    0.0, -DBL_MAX, DBL_MAX, 0.0,
-    "Image brightness.",
-    "Camera-dependent, 0.0 means auto.",
-    false,
-    exposure_descriptor_);
+  // Allocate frame data and make it writable through OpenCV
+  ros_image->data.resize(ros_image->step * ros_image->height);
+  frame_view = cv::Mat(
+    ros_image->height,
+    ros_image->width,
+    CV_8UC3,
+    ros_image->data.data(),
+    ros_image->step);
 
-  // Camera calibration file URL
-  declare_string_parameter(
-    "camera_calibration_file",
-    "file://config/camera.yaml",
-    "Camera calibration file URL.",
-    "Cannot be changed.",
-    true,
-    camera_calibration_file_descriptor_);
+  return ros_image;
+}
 
-  // Camera device ID
-  declare_int_parameter(
-    "camera_id",
-    0, 0, INT64_MAX, 1,
-    "Camera device ID.",
-    "Cannot be changed.",
-    true,
-    camera_id_descriptor_);
+/**
+ * @brief Converts a frame in the device pixel format into an Image message.
+ *
+ * @param frame cv::Mat storing the frame.
+ * @return Shared pointer to a new Image message.
+ */
+Image::SharedPtr CameraDriverNode::native_to_msg(cv::Mat & frame)
+{
+  // Get a new image message from the pool
+  Image::SharedPtr ros_image = image_pool_->acquire();
 
-  // Camera name
-  declare_string_parameter(
-    "camera_name",
-    "camera",
-    "Camera name from the configuration file.",
-    "Cannot be changed.",
-    true,
-    camera_name_descriptor_);
+  // Set frame-relevant image contents
+  ros_image->set__width(frame.cols);
+  ros_image->set__height(frame.rows);
+  ros_image->set__encoding(
+    pixel_format_ == PixelFormat::YUYV ?
+    sensor_msgs::image_encodings::YUV422_YUY2 :
+    sensor_msgs::image_encodings::MONO8);
+  ros_image->set__step(frame.cols * frame.elemSize());
 
-  // Exposure
-  declare_double_parameter(
-    "exposure",
-    0.0, -DBL_MAX, DBL_MAX, 0.0,
-    "Camera exposure.",
-    "Camera-dependent, 0.0 means auto.",
-    false,
-    exposure_descriptor_);
+  // Check data endianness
+  ros_image->set__is_bigendian(false);
 
-  // RViz frame ID
-  declare_string_parameter(
-    "frame_id",
-    "map",
-    "RViz frame ID.",
-    "Cannot be changed.",
-    true,
-    frame_id_descriptor_);
+  // Copy frame data
+  size_t size = ros_image->step * frame.rows;
+  ros_image->data.resize(size);
+  std::memcpy(ros_image->data.data(), frame.data, size);
+  if (stage_stats_ != nullptr) {
+    stage_stats_->add_bytes(size);
+  }
 
-  // Camera FPS
-  declare_int_parameter(
-    "fps",
-    10, 1, 60, 1,
-    "Camera FPS.",
-    "Cannot be changed.",
-    true,
-    fps_descriptor_);
+  return ros_image;
+}
 
-  // Image height
-  declare_int_parameter(
-    "image_height",
-    480, 1, INT64_MAX, 1,
-    "Image height.",
-    "Cannot be changed.",
-    true,
-    image_height_descriptor_);
+/**
+ * @brief Extracts the luma plane of a native frame and publishes it.
+ *
+ * This is cheaper than a full decode: YUYV frames only need their Y channel,
+ * and MJPG frames are decoded straight to grayscale.
+ *
+ * @param native_frame cv::Mat storing the frame in the device pixel format.
+ * @param timestamp Capture timestamp.
+ */
+void CameraDriverNode::publish_mono_frame(const cv::Mat & native_frame, const rclcpp::Time & timestamp)
+{
+  switch (pixel_format_) {
+    case PixelFormat::MJPG:
+      cv::imdecode(native_frame, cv::IMREAD_GRAYSCALE, &mono_frame_);
+      break;
+    case PixelFormat::YUYV:
+      cv::extractChannel(native_frame, mono_frame_, 0);
+      break;
+    default:
+      mono_frame_ = native_frame;
+      break;
+  }
+  if (mono_frame_.empty()) {
+    return;
+  }
 
-  // Image width
-  declare_int_parameter(
-    "image_width",
-    640, 1, INT64_MAX, 1,
-    "Image width.",
-    "Cannot be changed.",
-    true,
-    image_width_descriptor_);
+  // Get a new image message from the pool, and fill it in one pass
+  Image::SharedPtr mono_msg = image_pool_->acquire();
+  mono_msg->header.set__stamp(timestamp);
+  mono_msg->header.set__frame_id(frame_id_);
+  mono_msg->set__width(mono_frame_.cols);
+  mono_msg->set__height(mono_frame_.rows);
+  mono_msg->set__encoding(sensor_msgs::image_encodings::MONO8);
+  mono_msg->set__step(mono_frame_.cols);
+  mono_msg->set__is_bigendian(false);
+  mono_msg->data.resize(size_t(mono_msg->step) * size_t(mono_frame_.rows));
+  cv::Mat mono_view(mono_frame_.rows, mono_frame_.cols, CV_8UC1, mono_msg->data.data());
+  if (is_flipped_.load(std::memory_order_acquire)) {
+    cv::flip(mono_frame_, mono_view, 0);
+  } else {
+    mono_frame_.copyTo(mono_view);
+  }
+  if (stage_stats_ != nullptr) {
+    stage_stats_->add_bytes(mono_msg->data.size());
+  }
+  mono_pub_.publish(mono_msg);
+}
 
-  // Camera flipped flag
-  declare_bool_parameter(
-    "is_flipped",
-    false,
-    "Camera flipped flag.",
-    "Can be changed at run time.",
-    false,
-    is_flipped_descriptor_);
+/**
+ * @brief Stores a color frame in the shared memory ring and publishes its descriptor.
+ *
+ * The ring is recreated under a new name whenever frames outgrow its slots, so
+ * that readers notice it from the descriptors and remap it.
+ *
+ * @param image_msg Image message to transmit.
+ */
+void CameraDriverNode::publish_shm_frame(const Image & image_msg)
+{
+  size_t size = size_t(image_msg.step) * size_t(image_msg.height);
+  if (!shm_ring_.is_open() || size > shm_ring_.slot_size()) {
+    std::string segment = "/ucd" + std::string(this->get_fully_qualified_name());
+    for (size_t i = 1; i < segment.size(); i++) {
+      if (segment[i] == '/') {
+        segment[i] = '_';
+      }
+    }
+    segment += "_" + std::to_string(shm_generation_++);
+    if (!shm_ring_.create(
+        segment,
+        uint32_t(this->get_parameter("shm_slots").as_int()),
+        size))
+    {
+      RCLCPP_ERROR_THROTTLE(
+        this->get_logger(),
+        *this->get_clock(),
+        1000,
+        "Failed to create shared memory segment %s",
+        segment.c_str());
+      return;
+    }
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Shared memory segment %s created (%lu bytes per frame)",
+      segment.c_str(),
+      shm_ring_.slot_size());
+  }
 
-  // WB temperature
-  declare_double_parameter(
-    "wb_temperature",
-    0.0, -DBL_MAX, DBL_MAX, 0.0,
-    "White balance color temperature.",
-    "Can be changed at runtime, 0.0 means auto.",
-    false,
-    wb_temperature_descriptor_);
+  // Copy frame data into the next slot
+  uint32_t slot;
+  uint8_t * data = shm_ring_.begin_write(slot);
+  std::memcpy(data, image_msg.data.data(), size);
+  uint64_t seq = shm_ring_.end_write(slot);
+  if (stage_stats_ != nullptr) {
+    stage_stats_->add_bytes(size);
+  }
+
+  ros2_usb_camera::msg::ShmFrame shm_msg{};
+  shm_msg.set__header(image_msg.header);
+  shm_msg.set__segment(shm_ring_.name());
+  shm_msg.set__slot(slot);
+  shm_msg.set__seq(seq);
+  shm_msg.set__height(image_msg.height);
+  shm_msg.set__width(image_msg.width);
+  shm_msg.set__encoding(image_msg.encoding);
+  shm_msg.set__step(image_msg.step);
+  shm_pub_->publish(shm_msg);
 }
 
 /**
- * @brief Routine to declare a boolean node parameter.
+ * @brief Starts timing a processing stage.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @return Stage start time, or zero if statistics are disabled.
  */
-void CameraDriverNode::declare_bool_parameter(
-  std::string && name,
-  bool default_val,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+int64_t CameraDriverNode::stage_start() const
 {
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_BOOL);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  this->declare_parameter(name, default_val, descriptor);
+  return stage_stats_ != nullptr ? StageStats::now() : 0;
 }
 
 /**
- * @brief Routine to declare a 64-bit floating point node parameter.
+ * @brief Stops timing a processing stage and records its duration.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param from Floating point range initial value.
- * @param to Floating point range final value.
- * @param step Floating point range step.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @param stage Processing stage.
+ * @param start Stage start time.
  */
-void CameraDriverNode::declare_double_parameter(
-  std::string && name,
-  double default_val, double from, double to, double step,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+void CameraDriverNode::stage_end(Stage stage, int64_t start)
 {
-  FloatingPointRange param_range{};
-  param_range.set__from_value(from);
-  param_range.set__to_value(to);
-  param_range.set__step(step);
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_DOUBLE);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  descriptor.set__floating_point_range({param_range});
-  this->declare_parameter(name, default_val, descriptor);
+  if (stage_stats_ != nullptr) {
+    stage_stats_->add(stage, StageStats::now() - start);
+  }
 }
 
 /**
- * @brief Routine to declare an integer node parameter.
- *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param from Integer range initial value.
- * @param to Integer range final value.
- * @param step Integer range step.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @brief Publishes per-stage statistics and frame counters as diagnostics.
  */
-void CameraDriverNode::declare_int_parameter(
-  std::string && name,
-  int64_t default_val, int64_t from, int64_t to, int64_t step,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+void CameraDriverNode::stats_timer_callback()
 {
-  IntegerRange param_range{};
-  param_range.set__from_value(from);
-  param_range.set__to_value(to);
-  param_range.set__step(step);
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_INTEGER);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  descriptor.set__integer_range({param_range});
-  this->declare_parameter(name, default_val, descriptor);
+  DiagnosticStatus status;
+  status.set__level(DiagnosticStatus::OK);
+  status.set__name(this->get_fully_qualified_name());
+  status.set__hardware_id(this->get_parameter("camera_name").as_string());
+  status.set__message(stopped_.load(std::memory_order_acquire) ? "Camera disabled" : "Camera enabled");
+
+  // Rolling percentiles of each stage duration
+  for (unsigned int i = 0; i < static_cast<unsigned int>(Stage::COUNT); i++) {
+    double p50_us, p99_us;
+    if (stage_stats_->percentiles(static_cast<Stage>(i), p50_us, p99_us) == 0) {
+      continue;
+    }
+    KeyValue p50, p99;
+    p50.set__key(std::string(stage_names[i]) + "_p50_us");
+    p50.set__value(std::to_string(p50_us));
+    p99.set__key(std::string(stage_names[i]) + "_p99_us");
+    p99.set__value(std::to_string(p99_us));
+    status.values.push_back(p50);
+    status.values.push_back(p99);
+  }
+
+  // Achieved frame rate since the last update
+  int64_t now = StageStats::now();
+  uint64_t frames = stage_stats_->frames();
+  KeyValue fps;
+  fps.set__key("fps");
+  fps.set__value(
+    std::to_string(
+      double(frames - stats_last_frames_) * 1000000000.0 / double(now - stats_last_time_)));
+  status.values.push_back(fps);
+  stats_last_frames_ = frames;
+  stats_last_time_ = now;
+
+  // Frame counters
+  KeyValue published, empty, dropped, bytes;
+  published.set__key("frames_published");
+  published.set__value(std::to_string(frames));
+  empty.set__key("frames_empty");
+  empty.set__value(std::to_string(stage_stats_->empty()));
+  dropped.set__key("frames_dropped");
+  dropped.set__value(std::to_string(stage_stats_->dropped()));
+  bytes.set__key("bytes_copied");
+  bytes.set__value(std::to_string(stage_stats_->bytes_copied()));
+  status.values.push_back(published);
+  status.values.push_back(empty);
+  status.values.push_back(dropped);
+  status.values.push_back(bytes);
+  if (stage_stats_->empty() > 0 || stage_stats_->dropped() > 0) {
+    status.set__level(DiagnosticStatus::WARN);
+  }
+
+  DiagnosticArray msg;
+  msg.header.set__stamp(this->get_clock()->now());
+  msg.status.push_back(status);
+  stats_pub_->publish(msg);
 }
 
 /**
- * @brief Routine to declare a string node parameter.
+ * @brief Publishes the pipeline trace of a frame that was just published.
  *
- * @param name Parameter name.
- * @param default_val Default value.
- * @param desc Parameter description.
- * @param constraints Additional value constraints.
- * @param read_only Read-only internal flag.
- * @param descriptor Parameter descriptor.
+ * @param timestamp Capture timestamp of the frame, that identifies it in traces.
  */
-void CameraDriverNode::declare_string_parameter(
-  std::string && name,
-  std::string && default_val,
-  std::string && desc, std::string && constraints,
-  bool read_only, ParameterDescriptor & descriptor)
+void CameraDriverNode::publish_trace(const rclcpp::Time & timestamp)
 {
-  descriptor.set__name(name);
-  descriptor.set__type(ParameterType::PARAMETER_STRING);
-  descriptor.set__description(desc);
-  descriptor.set__additional_constraints(constraints);
-  descriptor.set__read_only(read_only);
-  descriptor.set__dynamic_typing(false);
-  this->declare_parameter(name, default_val, descriptor);
+  ros2_usb_camera::msg::FrameTrace trace_msg{};
+  trace_msg.header.set__stamp(timestamp);
+  trace_msg.header.set__frame_id(frame_id_);
+  trace_msg.stages.push_back(ros2_usb_camera::msg::FrameTrace::CAPTURE);
+  trace_msg.times.push_back(timestamp);
+  trace_msg.stages.push_back(ros2_usb_camera::msg::FrameTrace::PUBLISH);
+  trace_msg.times.push_back(this->get_clock()->now());
+  trace_pub_->publish(trace_msg);
 }
 
 /**
- * @brief Parameters update validation callback.
+ * @brief Gets undistortion and rectification maps, resizing frames on the way if needed.
+ *
+ * Maps are computed once per geometry and cached, so switching between modes only
+ * swaps references to them.
  *
- * @param params Vector of parameters for which a change has been requested.
- * @return Operation result in SetParametersResult message.
+ * @param input_size Size of the frames to rectify, i.e. the capture geometry.
+ * @param output_size Size of the rectified frames.
+ * @return Maps for the requested geometry.
  */
-SetParametersResult CameraDriverNode::on_set_parameters_callback(
-  const std::vector<rclcpp::Parameter> & params)
+CameraDriverNode::RectMaps CameraDriverNode::get_rect_maps(
+  const cv::Size & input_size,
+  const cv::Size & output_size)
 {
-  // Initialize result object
-  SetParametersResult res{};
-  res.set__successful(true);
-  res.set__reason("");
-
-  // First, check if each update is feasible
-  // Initial checks must be added here!
-  for (const rclcpp::Parameter & p : params) {
-    // Base topic name
-    if (p.get_name() == "base_topic_name") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for base_topic_name");
-        break;
-      }
-      continue;
+  std::array<int, 4> key = {input_size.width, input_size.height, output_size.width, output_size.height};
+  {
+    std::lock_guard<std::mutex> lock(rect_maps_cache_lock_);
+    auto it = rect_maps_cache_.find(key);
+    if (it != rect_maps_cache_.end()) {
+      return it->second;
     }
+  }
 
-    // Best-effort QoS flag
-    if (p.get_name() == "best_effort_qos") {
-      if (p.get_type() != ParameterType::PARAMETER_BOOL) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for best_effort_qos");
-        break;
-      }
-      continue;
-    }
+  // Look for the maps on disk first
+  MapSet set;
+  uint64_t disk_key = 0;
+  bool loaded = false;
+  if (map_cache_ != nullptr) {
+    disk_key = MapCache::key(A_, D_, input_size, output_size);
+    loaded = map_cache_->load(disk_key, output_size, set);
+  }
 
-    // Brightness
-    if (p.get_name() == "brightness") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for brightness");
-        break;
+  if (!loaded) {
+    if (large_buffer_allocator_ != nullptr) {
+      for (cv::Mat * map : {&set.float1, &set.float2, &set.fixed1, &set.fixed2}) {
+        map->allocator = large_buffer_allocator_;
       }
-      continue;
     }
+    cv::initUndistortRectifyMap(
+      A_,
+      D_,
+      cv::Mat::eye(3, 3, CV_64F),
+      A_,
+      output_size,
+      CV_32FC1,
+      set.float1,
+      set.float2);
 
-    // Camera calibration file URL
-    if (p.get_name() == "camera_calibration_file") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for camera_calibration_file");
-        break;
-      }
-      continue;
+    // Sample frames at the capture geometry, so that no separate resize is needed
+    if (input_size != output_size) {
+      double scale_x = double(input_size.width) / double(output_size.width);
+      double scale_y = double(input_size.height) / double(output_size.height);
+      set.float1.convertTo(set.float1, CV_32FC1, scale_x, 0.5 * scale_x - 0.5);
+      set.float2.convertTo(set.float2, CV_32FC1, scale_y, 0.5 * scale_y - 0.5);
     }
+    cv::convertMaps(set.float1, set.float2, set.fixed1, set.fixed2, CV_16SC2);
 
-    // Camera device ID
-    if (p.get_name() == "camera_id") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for camera_id");
-        break;
-      }
-      continue;
+    if (map_cache_ != nullptr && !map_cache_->store(disk_key, output_size, set)) {
+      RCLCPP_WARN(this->get_logger(), "Failed to store rectification maps into cache");
     }
+  }
 
-    // Camera name
-    if (p.get_name() == "camera_name") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for camera_name");
-        break;
-      }
-      continue;
-    }
+  RectMaps maps;
+  maps.float1 = set.float1;
+  maps.float2 = set.float2;
+#ifdef WITH_CUDA
+  maps.map1 = set.float1;
+  maps.map2 = set.float2;
+  maps.gpu_map1.upload(maps.map1);
+  maps.gpu_map2.upload(maps.map2);
+#else
+  maps.map1 = set.fixed1;
+  maps.map2 = set.fixed2;
+#endif
 
-    // Exposure
-    if (p.get_name() == "exposure") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for exposure");
-        break;
-      }
-      continue;
-    }
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Rectification maps %s (%dx%d -> %dx%d)",
+    loaded ? "loaded from cache" : "computed",
+    input_size.width, input_size.height,
+    output_size.width, output_size.height);
 
-    // RViz frame ID
-    if (p.get_name() == "frame_id") {
-      if (p.get_type() != ParameterType::PARAMETER_STRING) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for frame_id");
-        break;
-      }
-      continue;
-    }
+  std::lock_guard<std::mutex> lock(rect_maps_cache_lock_);
+  rect_maps_cache_[key] = maps;
+  return maps;
+}
 
-    // Camera FPS
-    if (p.get_name() == "fps") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for fps");
-        break;
-      }
-      continue;
-    }
 
-    // Image height
-    if (p.get_name() == "image_height") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for image_height");
-        break;
-      }
-      continue;
-    }
+/**
+ * @brief Sets undistortion and rectification maps for the current output geometry.
+ *
+ * @param input_size Size of the frames to rectify, i.e. the capture geometry.
+ */
+void CameraDriverNode::init_rect_maps(const cv::Size & input_size)
+{
+  RectMaps maps = get_rect_maps(input_size, image_size());
+  map1_ = maps.map1;
+  map2_ = maps.map2;
+#ifdef WITH_CUDA
+  gpu_map1_ = maps.gpu_map1;
+  gpu_map2_ = maps.gpu_map2;
+#endif
+  rect_input_size_ = input_size;
+}
 
-    // Image width
-    if (p.get_name() == "image_width") {
-      if (p.get_type() != ParameterType::PARAMETER_INTEGER) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for image_width");
-        break;
-      }
-      continue;
-    }
+/**
+ * @brief Loads the camera calibration and computes undistortion and rectification maps.
+ *
+ * This is the heaviest part of node initialization: with deferred_init, it runs
+ * in the background while the container loads other nodes.
+ */
+void CameraDriverNode::warmup_routine()
+{
+  auto warmup_start = std::chrono::steady_clock::now();
+  if (!cinfo_manager_->loadCameraInfo(this->get_parameter("camera_calibration_file").as_string())) {
+    RCLCPP_ERROR(this->get_logger(), "Failed to get camera info");
+  }
 
-    // Camera flipped flag
-    if (p.get_name() == "is_flipped") {
-      if (p.get_type() != ParameterType::PARAMETER_BOOL) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for is_flipped");
-        break;
-      }
-      continue;
+  // Get and store current camera info and compute undistorsion and rectification maps
+  if (cinfo_manager_->isCalibrated()) {
+    camera_info_ = cinfo_manager_->getCameraInfo();
+    A_ = cv::Mat(3, 3, CV_64FC1, camera_info_.k.data());
+    D_ = cv::Mat(1, 5, CV_64FC1, camera_info_.d.data());
+    std::string map_cache_dir = this->get_parameter("map_cache_dir").as_string();
+    if (!map_cache_dir.empty()) {
+      map_cache_ = std::make_unique<MapCache>(map_cache_dir);
     }
+    init_rect_maps(image_size());
+  }
+  camera_info_generation_.fetch_add(1, std::memory_order_release);
+  publish_camera_info();
 
-    // WB temperature
-    if (p.get_name() == "wb_temperature") {
-      if (p.get_type() != ParameterType::PARAMETER_DOUBLE) {
-        res.set__successful(false);
-        res.set__reason("Invalid parameter type for wb_temperature");
-        break;
-      }
-      continue;
+  publish_ready(true);
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Warm-up completed in %.1f ms (%.1f ms after node construction)",
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - warmup_start).count(),
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - init_time_).count());
+}
+
+/**
+ * @brief Waits for the background warm-up to complete, if any.
+ */
+void CameraDriverNode::wait_warmup()
+{
+  std::lock_guard<std::mutex> lock(warmup_lock_);
+  if (warmup_thread_.joinable()) {
+    warmup_thread_.join();
+  }
+}
+
+/**
+ * @brief Publishes the camera calibration once, on the latched CameraInfo topic, if enabled.
+ */
+void CameraDriverNode::publish_camera_info()
+{
+  if (camera_info_pub_ == nullptr) {
+    return;
+  }
+  CameraInfo camera_info_msg = camera_info_;
+  camera_info_msg.header.set__stamp(this->get_clock()->now());
+  camera_info_msg.header.set__frame_id(frame_id_);
+  camera_info_pub_->publish(camera_info_msg);
+}
+
+/**
+ * @brief Returns the number of subscribers to color frames, with or without CameraInfo.
+ *
+ * @return Color frames subscribers count.
+ */
+size_t CameraDriverNode::image_subscribers() const
+{
+  return camera_pub_.getNumSubscribers() + image_pub_.getNumSubscribers();
+}
+
+/**
+ * @brief Publishes the readiness of the node.
+ *
+ * @param ready True once calibration and maps are ready, false otherwise.
+ */
+void CameraDriverNode::publish_ready(bool ready)
+{
+  std_msgs::msg::Bool ready_msg;
+  ready_msg.set__data(ready);
+  ready_pub_->publish(ready_msg);
+}
+
+/**
+ * @brief Sets up the allocator of large image buffers, if huge pages or NUMA binding are requested.
+ *
+ * Buffers are bound to the NUMA node of the sampling CPU if there is one, else to
+ * the node of the thread that first allocates them, i.e. the sampling thread for
+ * frames and the warm-up thread for rectification maps.
+ */
+void CameraDriverNode::init_large_buffers()
+{
+  HugePages pages = HugePages::NONE;
+  HugePageAllocator::parse_pages(this->get_parameter("huge_pages").as_string(), pages);
+  int node = HugePageAllocator::no_node;
+  if (this->get_parameter("numa_bind").as_bool()) {
+    int cpu = int(this->get_parameter("sampling_cpu").as_int());
+    node = cpu >= 0 ? HugePageAllocator::cpu_node(cpu) : -1;
+    if (node < 0) {
+      node = HugePageAllocator::thread_node;
     }
   }
-  if (!res.successful) {
-    return res;
+  large_buffer_allocator_ = HugePageAllocator::get(pages, node);
+  if (large_buffer_allocator_ == nullptr) {
+    return;
   }
 
-  // Then, do what is necessary to update each parameter
-  // Add ad-hoc update procedures must be added here!
-  for (const rclcpp::Parameter & p : params) {
-    // Base topic name
-    if (p.get_name() == "base_topic_name") {
-      RCLCPP_INFO(
-        this->get_logger(),
-        "base_topic_name: %s",
-        p.as_string().c_str());
-      continue;
+  for (cv::Mat * mat : {&frame_, &flipped_frame_, &resized_frame_, &rectified_frame_,
+      &map1_, &map2_, &fused_map1_, &fused_map2_, &fused_rect_map1_, &fused_rect_map2_})
+  {
+    mat->allocator = large_buffer_allocator_;
+  }
+  std::string binding = "not bound to a NUMA node";
+  if (node == HugePageAllocator::thread_node) {
+    binding = "bound to the NUMA node of their thread";
+  } else if (node >= 0) {
+    binding = "bound to NUMA node " + std::to_string(node);
+  }
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Large image buffers on %s pages, %s",
+    pages == HugePages::EXPLICIT ? "explicit huge" :
+    (pages == HugePages::TRANSPARENT ? "transparent huge" : "regular"),
+    binding.c_str());
+}
+
+/**
+ * @brief Opens the black-box frame recorder ring, if requested.
+ */
+void CameraDriverNode::init_recorder()
+{
+  std::string recorder_file = this->get_parameter("recorder_file").as_string();
+  if (recorder_file.empty()) {
+    return;
+  }
+
+  // Device JPEG frames are much smaller than color ones, but exist only with MJPG
+  recorder_native_ = this->get_parameter("recorder_native").as_bool();
+  if (recorder_native_ && pixel_format_ != PixelFormat::MJPG) {
+    RCLCPP_WARN(this->get_logger(), "Native recording requires the MJPG pixel format: recording color frames");
+    recorder_native_ = false;
+  }
+
+  int64_t recorder_size = this->get_parameter("recorder_size").as_int();
+  frame_recorder_ = std::make_unique<FrameRecorder>();
+  if (!frame_recorder_->open(recorder_file, size_t(recorder_size) << 20)) {
+    RCLCPP_ERROR(this->get_logger(), "Failed to open frame recorder file %s", recorder_file.c_str());
+    frame_recorder_.reset();
+    return;
+  }
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Recording %s frames to %s (%ld MiB)",
+    recorder_native_ ? "JPEG" : "color",
+    recorder_file.c_str(),
+    recorder_size);
+}
+
+/**
+ * @brief Returns the nominal sampling period.
+ *
+ * @return Sampling period, as per the current fps.
+ */
+std::chrono::nanoseconds CameraDriverNode::sampling_period() const
+{
+  return std::chrono::nanoseconds(
+    int64_t(1.0 / double(fps_.load(std::memory_order_acquire)) * 1000000000.0));
+}
+
+/**
+ * @brief Returns the output image size.
+ *
+ * Capture mode switches change it between frames, while other threads may read it.
+ *
+ * @return Output image size, as per the current mode.
+ */
+cv::Size CameraDriverNode::image_size() const
+{
+  return cv::Size(
+    int(image_width_.load(std::memory_order_acquire)),
+    int(image_height_.load(std::memory_order_acquire)));
+}
+
+/**
+ * @brief Requests a live switch to the mode set by the latest parameters.
+ *
+ * Rectification maps for the new mode are precomputed here, then device and
+ * output geometry are switched by the sampling threads between two frames.
+ */
+void CameraDriverNode::request_mode_change()
+{
+  // New maps depend on the calibration, which might still be loading
+  wait_warmup();
+
+  int64_t width, height;
+  {
+    std::lock_guard<std::mutex> lock(mode_lock_);
+    width = pending_width_;
+    height = pending_height_;
+  }
+  if (cinfo_manager_->isCalibrated()) {
+    cv::Size size(width, height);
+    get_rect_maps(size, size);
+  }
+  device_mode_pending_.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Switches the device to the requested mode, if any; to be called by the capture thread.
+ *
+ * @return True if the sampling period changed, false otherwise.
+ */
+bool CameraDriverNode::apply_device_mode()
+{
+  if (!device_mode_pending_.exchange(false, std::memory_order_acq_rel)) {
+    return false;
+  }
+  int64_t width, height, fps;
+  {
+    std::lock_guard<std::mutex> lock(mode_lock_);
+    width = pending_width_;
+    height = pending_height_;
+    fps = pending_fps_;
+  }
+
+  // Reconfigure the device streaming mode, without reopening it;
+  // recordings keep their geometry and are only resized to the new one
+  if (replay_ != nullptr) {
+    cv::Size replay_size = replay_->frame_size();
+    capture_width_.store(replay_size.width, std::memory_order_release);
+    capture_height_.store(replay_size.height, std::memory_order_release);
+  } else {
+    if (!video_cap_.set(cv::CAP_PROP_FRAME_WIDTH, width) ||
+      !video_cap_.set(cv::CAP_PROP_FRAME_HEIGHT, height) ||
+      !video_cap_.set(cv::CAP_PROP_FPS, fps))
+    {
+      RCLCPP_ERROR(this->get_logger(), "Failed to switch capture mode to %ldx%ld@%ld", width, height, fps);
     }
+    capture_width_.store(int(video_cap_.get(cv::CAP_PROP_FRAME_WIDTH)), std::memory_order_release);
+    capture_height_.store(int(video_cap_.get(cv::CAP_PROP_FRAME_HEIGHT)), std::memory_order_release);
+  }
 
-    // Best-effort QoS flag
-    if (p.get_name() == "best_effort_qos") {
-      RCLCPP_INFO(
-        this->get_logger(),
-        "best_effort_qos: %s",
-        p.as_bool() ? "true" : "false");
-      continue;
+  // Hand the new output geometry over to the processing thread
+  {
+    std::lock_guard<std::mutex> lock(mode_lock_);
+    mode_width_ = width;
+    mode_height_ = height;
+  }
+  geometry_pending_.store(true, std::memory_order_release);
+
+  bool period_changed = fps_.exchange(fps, std::memory_order_acq_rel) != fps;
+  jitter_stats_.reset(sampling_period());
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Capture mode switched to %ldx%ld@%ld (device capture size %dx%d)",
+    width, height, fps,
+    capture_width_.load(std::memory_order_acquire),
+    capture_height_.load(std::memory_order_acquire));
+  return period_changed;
+}
+
+/**
+ * @brief Adopts the output geometry of the current mode; to be called by the processing thread.
+ *
+ * Frames still coming at a previous capture geometry get their own cached maps.
+ *
+ * @param frame_size Size of the next frame to process.
+ */
+void CameraDriverNode::apply_geometry(const cv::Size & frame_size)
+{
+  if (geometry_pending_.exchange(false, std::memory_order_acq_rel)) {
+    std::lock_guard<std::mutex> lock(mode_lock_);
+    image_width_.store(mode_width_, std::memory_order_release);
+    image_height_.store(mode_height_, std::memory_order_release);
+    rect_input_size_ = cv::Size();
+    fused_input_size_ = cv::Size();
+  }
+  if (cinfo_manager_->isCalibrated() && frame_size != rect_input_size_) {
+    init_rect_maps(frame_size);
+  }
+}
+
+/**
+ * @brief Computes remap tables that flip, resize and undistort frames in a single pass.
+ *
+ * The color image table flips and resizes the frame, while the rectified image
+ * table also composes the undistortion and rectification maps on top of them.
+ *
+ * @param input_size Size of the frames to process.
+ */
+void CameraDriverNode::init_fused_maps(const cv::Size & input_size)
+{
+  cv::Size output_size = image_size();
+  bool flipped = is_flipped_.load(std::memory_order_acquire);
+  float scale_x = float(input_size.width) / float(output_size.width);
+  float scale_y = float(input_size.height) / float(output_size.height);
+  float last_row = float(output_size.height - 1);
+
+  // Color image: each output pixel samples the flipped, resized frame
+  cv::Mat map_x(output_size, CV_32FC1), map_y(output_size, CV_32FC1);
+  for (int v = 0; v < output_size.height; v++) {
+    float src_v = flipped ? last_row - float(v) : float(v);
+    float * row_x = map_x.ptr<float>(v);
+    float * row_y = map_y.ptr<float>(v);
+    for (int u = 0; u < output_size.width; u++) {
+      row_x[u] = (float(u) + 0.5f) * scale_x - 0.5f;
+      row_y[u] = (src_v + 0.5f) * scale_y - 0.5f;
     }
+  }
+#ifdef WITH_CUDA
+  gpu_fused_map1_.upload(map_x);
+  gpu_fused_map2_.upload(map_y);
+#else
+  cv::convertMaps(map_x, map_y, fused_map1_, fused_map2_, CV_16SC2);
+#endif
 
-    // Brightness
-    if (p.get_name() == "brightness") {
-      if (video_cap_.isOpened() && !video_cap_.set(cv::CAP_PROP_BRIGHTNESS, p.as_double())) {
-        RCLCPP_ERROR(this->get_logger(), "Failed to set camera brightness");
-        res.set__successful(false);
-        res.set__reason("cv::VideoCapture::set(CAP_PROP_BRIGHTNESS) failed");
-        break;
+  // Rectified image: compose undistortion with flip and resize
+  if (cinfo_manager_->isCalibrated()) {
+    RectMaps undist = get_rect_maps(output_size, output_size);
+    cv::Mat undist_x = undist.float1.clone(), undist_y = undist.float2.clone();
+    for (int v = 0; v < output_size.height; v++) {
+      float * row_x = undist_x.ptr<float>(v);
+      float * row_y = undist_y.ptr<float>(v);
+      for (int u = 0; u < output_size.width; u++) {
+        float src_v = flipped ? last_row - row_y[u] : row_y[u];
+        row_x[u] = (row_x[u] + 0.5f) * scale_x - 0.5f;
+        row_y[u] = (src_v + 0.5f) * scale_y - 0.5f;
       }
-      RCLCPP_INFO(
-        this->get_logger(),
-        "brightness: %f",
-        p.as_double());
-      continue;
     }
+#ifdef WITH_CUDA
+    gpu_fused_rect_map1_.upload(undist_x);
+    gpu_fused_rect_map2_.upload(undist_y);
+#else
+    cv::convertMaps(undist_x, undist_y, fused_rect_map1_, fused_rect_map2_, CV_16SC2);
+#endif
+  }
 
-    // Camera calibration file URL
-    if (p.get_name() == "camera_calibration_file") {
-      RCLCPP_INFO(
-        this->get_logger(),
-        "camera_calibration_file: %s",
-        p.as_string().c_str());
-      continue;
-    }
+  fused_input_size_ = input_size;
+  fused_flipped_ = flipped;
+  fused_identity_ = !flipped && input_size == output_size;
 
-    // Camera device ID
-    if (p.get_name() == "camera_id") {
-      RCLCPP_INFO(
-        this->get_logger(),
-        "camera_id: %ld",
-        p.as_int());
-      continue;
-    }
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Fused transform maps computed (%dx%d -> %dx%d)",
+    input_size.width, input_size.height,
+    output_size.width, output_size.height);
+}
 
-    // Camera name
-    if (p.get_name() == "camera_name") {
-      RCLCPP_INFO(
-        this->get_logger(),
-        "camera_name: %s",
-        p.as_string().c_str());
-      continue;
-    }
+/**
+ * @brief Initializes node parameters.
+ */
+void CameraDriverNode::init_parameters()
+{
+  using namespace ROS2ParameterTable;
+
+  //! Capture mode changes are applied once per update, whatever the
+  //! parameters that require them
+  size_t mode_change = params_table_.add_batch_action(
+    [this]() -> void {
+      if (!stopped_.load(std::memory_order_acquire)) {
+        request_mode_change();
+      }
+    });
+
+  // Base topic name
+  params_table_.add(
+    string_parameter(
+      "base_topic_name",
+      "camera",
+      "image_transport base topic name.",
+      "Cannot be changed.",
+      true));
+
+  // Best-effort QoS flag
+  params_table_.add(
+    bool_parameter(
+      "best_effort_qos",
+      false,
+      "Best-effort QoS flag.",
+      "Cannot be changed.",
+      true));
+
+  // Brightness
+  params_table_.add(
+    double_parameter(
+      "brightness",
+      0.0, -DBL_MAX, DBL_MAX, 0.0,
+      "Image brightness.",
+      "Camera-dependent, 0.0 means auto.",
+      false)
+    .on_update_checked(
+      [this](const rclcpp::Parameter & p) -> std::string {
+        if (video_cap_.isOpened() && !video_cap_.set(cv::CAP_PROP_BRIGHTNESS, p.as_double())) {
+          RCLCPP_ERROR(this->get_logger(), "Failed to set camera brightness");
+          return "cv::VideoCapture::set(CAP_PROP_BRIGHTNESS) failed";
+        }
+        return "";
+      }));
 
-    // Exposure
-    if (p.get_name() == "exposure") {
-      if (video_cap_.isOpened()) {
-        bool success;
+  // Buffer pool size
+  params_table_.add(
+    int_parameter(
+      "buffer_pool_size",
+      4, 0, 64, 1,
+      "Number of recyclable message buffers per pool.",
+      "Cannot be changed, 0 disables pooling.",
+      true));
+
+  // Camera calibration file URL
+  params_table_.add(
+    string_parameter(
+      "camera_calibration_file",
+      "file://config/camera.yaml",
+      "Camera calibration file URL.",
+      "Cannot be changed.",
+      true));
+
+  // Camera device ID
+  params_table_.add(
+    int_parameter(
+      "camera_id",
+      0, 0, INT64_MAX, 1,
+      "Camera device ID.",
+      "Cannot be changed.",
+      true));
+
+  // Latched CameraInfo flag
+  params_table_.add(
+    bool_parameter(
+      "camera_info_latched",
+      false,
+      "Publishes CameraInfo once, transient-local, instead of with every frame.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        camera_info_latched_ = p.as_bool();
+      }));
+
+  // Camera name
+  params_table_.add(
+    string_parameter(
+      "camera_name",
+      "camera",
+      "Camera name from the configuration file.",
+      "Cannot be changed.",
+      true));
+
+  // CUDA asynchronous processing flag
+  params_table_.add(
+    bool_parameter(
+      "cuda_async",
+      false,
+      "CUDA asynchronous stream processing flag.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        cuda_async_ = p.as_bool();
+      }));
+
+  // Deferred initialization flag
+  params_table_.add(
+    bool_parameter(
+      "deferred_init",
+      false,
+      "Loads calibration and computes maps in the background, after construction.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        deferred_init_ = p.as_bool();
+      }));
+
+  // Compressed stream encoder
+  params_table_.add(
+    string_parameter(
+      "encoder",
+      "none",
+      "Compressed stream encoder backend.",
+      "Cannot be changed, either none, auto, software or v4l2_m2m.",
+      true)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        EncoderBackend backend;
+        if (!JpegEncoder::parse_backend(p.as_string(), backend)) {
+          return "Invalid encoder, must be one of none, auto, software, v4l2_m2m";
+        }
+        return "";
+      }));
+
+  // Compressed stream encoder device
+  params_table_.add(
+    string_parameter(
+      "encoder_device",
+      "",
+      "V4L2 memory-to-memory JPEG encoder device, empty to look for one.",
+      "Cannot be changed.",
+      true));
+
+  // Compressed stream rate cap
+  params_table_.add(
+    double_parameter(
+      "encoder_max_rate",
+      5.0, 0.0, 1000.0, 0.0,
+      "Maximum compressed stream rate, in Hz, 0.0 for every frame.",
+      "Cannot be changed.",
+      true));
+
+  // Compressed stream quality
+  params_table_.add(
+    int_parameter(
+      "encoder_quality",
+      80, 1, 100, 1,
+      "Compressed stream JPEG quality.",
+      "Cannot be changed.",
+      true));
+
+  // Exposure
+  params_table_.add(
+    double_parameter(
+      "exposure",
+      0.0, -DBL_MAX, DBL_MAX, 0.0,
+      "Camera exposure.",
+      "Camera-dependent, 0.0 means auto.",
+      false)
+    .on_update_checked(
+      [this](const rclcpp::Parameter & p) -> std::string {
+        if (!video_cap_.isOpened()) {
+          return "";
+        }
         if (p.as_double() == 0.0) {
-          success = video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 3.0);
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 3.0) failed");
+          if (!video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 3.0)) {
             RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
-            break;
+            return "cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 3.0) failed";
           }
+          return "";
+        }
+        if (!video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.75)) {
+          RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
+          return "cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 0.75) failed";
+        }
+        if (!video_cap_.set(cv::CAP_PROP_EXPOSURE, p.as_double())) {
+          RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
+          return "cv::VideoCapture::set(CAP_PROP_EXPOSURE) failed";
+        }
+        return "";
+      }));
+
+  // RViz frame ID
+  params_table_.add(
+    string_parameter(
+      "frame_id",
+      "map",
+      "RViz frame ID.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        frame_id_ = p.as_string();
+      }));
+
+  // Camera FPS
+  params_table_.add(
+    int_parameter(
+      "fps",
+      10, 1, 60, 1,
+      "Camera FPS.",
+      "Can be changed at run time, switching the capture mode live.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        {
+          std::lock_guard<std::mutex> lock(mode_lock_);
+          pending_fps_ = p.as_int();
+        }
+        if (stopped_.load(std::memory_order_acquire)) {
+          fps_.store(p.as_int(), std::memory_order_release);
+        }
+      })
+    .then(mode_change));
+
+  // Free-running capture flag
+  params_table_.add(
+    bool_parameter(
+      "free_running",
+      false,
+      "Free-running capture flag.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        free_running_ = p.as_bool();
+      }));
+
+  // Fused transform flag
+  params_table_.add(
+    bool_parameter(
+      "fused_transform",
+      false,
+      "Fused flip, resize and undistortion transform flag.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        fused_transform_ = p.as_bool();
+      }));
+
+  // Huge pages mode
+  params_table_.add(
+    string_parameter(
+      "huge_pages",
+      "none",
+      "Pages backing large image buffers: none, transparent or explicit.",
+      "Cannot be changed, explicit huge pages must be reserved (vm.nr_hugepages).",
+      true)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        HugePages pages;
+        if (!HugePageAllocator::parse_pages(p.as_string(), pages)) {
+          return "Unknown huge pages mode";
+        }
+        return "";
+      }));
+
+  // Image height
+  params_table_.add(
+    int_parameter(
+      "image_height",
+      480, 1, INT64_MAX, 1,
+      "Image height.",
+      "Can be changed at run time, switching the capture mode live.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        {
+          std::lock_guard<std::mutex> lock(mode_lock_);
+          pending_height_ = p.as_int();
+        }
+        if (stopped_.load(std::memory_order_acquire)) {
+          image_height_.store(p.as_int(), std::memory_order_release);
+        }
+      })
+    .then(mode_change));
+
+  // Image width
+  params_table_.add(
+    int_parameter(
+      "image_width",
+      640, 1, INT64_MAX, 1,
+      "Image width.",
+      "Can be changed at run time, switching the capture mode live.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        {
+          std::lock_guard<std::mutex> lock(mode_lock_);
+          pending_width_ = p.as_int();
+        }
+        if (stopped_.load(std::memory_order_acquire)) {
+          image_width_.store(p.as_int(), std::memory_order_release);
+        }
+      })
+    .then(mode_change));
+
+  // Camera flipped flag
+  params_table_.add(
+    bool_parameter(
+      "is_flipped",
+      false,
+      "Camera flipped flag.",
+      "Can be changed at run time.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        is_flipped_.store(p.as_bool(), std::memory_order_release);
+      }));
+
+  // Lazy processing flag
+  params_table_.add(
+    bool_parameter(
+      "lazy_processing",
+      true,
+      "Processes frames only for topics that have subscribers.",
+      "Can be changed at run time.",
+      false)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        lazy_processing_.store(p.as_bool(), std::memory_order_release);
+      }));
+
+  // Memory locking flag
+  params_table_.add(
+    bool_parameter(
+      "lock_memory",
+      false,
+      "Locks all process memory to avoid page faults.",
+      "Cannot be changed.",
+      true));
+
+  // Rectification maps cache directory
+  params_table_.add(
+    string_parameter(
+      "map_cache_dir",
+      "",
+      "Directory where rectification maps are cached, empty to disable the cache.",
+      "Cannot be changed.",
+      true));
+
+  // NUMA binding flag
+  params_table_.add(
+    bool_parameter(
+      "numa_bind",
+      false,
+      "Binds large image buffers to the NUMA node of the sampling CPU or thread.",
+      "Cannot be changed.",
+      true));
+
+  // Processing pipeline flag
+  params_table_.add(
+    bool_parameter(
+      "pipeline",
+      false,
+      "Processing pipeline flag.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        pipeline_ = p.as_bool();
+      }));
+
+  // Processing pipeline stage depth
+  params_table_.add(
+    int_parameter(
+      "pipeline_depth",
+      2, 1, 64, 1,
+      "Processing pipeline queues depth.",
+      "Cannot be changed, rounded up to a power of two.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        pipeline_depth_ = p.as_int();
+      }));
+
+  // Processing pipeline overwrite policy
+  params_table_.add(
+    bool_parameter(
+      "pipeline_overwrite",
+      true,
+      "Drops oldest frames instead of newest ones when a pipeline stage is late.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        pipeline_overwrite_ = p.as_bool();
+      }));
+
+  // Capture pixel format
+  params_table_.add(
+    string_parameter(
+      "pixel_format",
+      "BGR",
+      "Capture pixel format.",
+      "Cannot be changed, either BGR (decoded by OpenCV), MJPG, YUYV or GREY.",
+      true)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        if (p.as_string() != "BGR" && p.as_string() != "MJPG" &&
+          p.as_string() != "YUYV" && p.as_string() != "GREY")
+        {
+          return "Invalid pixel_format, must be one of BGR, MJPG, YUYV, GREY";
+        }
+        return "";
+      })
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        if (p.as_string() == "MJPG") {
+          pixel_format_ = PixelFormat::MJPG;
+        } else if (p.as_string() == "YUYV") {
+          pixel_format_ = PixelFormat::YUYV;
+        } else if (p.as_string() == "GREY") {
+          pixel_format_ = PixelFormat::GREY;
         } else {
-          success = video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.75);
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 0.75) failed");
-            RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
-            break;
-          }
-          success = video_cap_.set(cv::CAP_PROP_EXPOSURE, p.as_double());
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_EXPOSURE) failed");
-            RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
-            break;
-          }
+          pixel_format_ = PixelFormat::BGR;
         }
-      }
-      RCLCPP_INFO(
-        this->get_logger(),
-        "exposure: %f",
-        p.as_double());
-      continue;
-    }
+      }));
 
-    // RViz frame ID
-    if (p.get_name() == "frame_id") {
-      frame_id_ = p.as_string();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "frame_id: %s",
-        frame_id_.c_str());
-      continue;
-    }
+  // Frame recorder file
+  params_table_.add(
+    string_parameter(
+      "recorder_file",
+      "",
+      "Ring file that keeps the latest frames, empty to disable recording.",
+      "Cannot be changed.",
+      true));
 
-    // Camera FPS
-    if (p.get_name() == "fps") {
-      fps_ = p.as_int();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "fps: %ld",
-        fps_);
-      continue;
-    }
+  // Frame recorder native format flag
+  params_table_.add(
+    bool_parameter(
+      "recorder_native",
+      false,
+      "Records device JPEG frames instead of color ones.",
+      "Cannot be changed, requires the MJPG pixel format.",
+      true));
 
-    // Image height
-    if (p.get_name() == "image_height") {
-      image_height_ = p.as_int();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "image_height: %ld",
-        image_height_);
-      continue;
-    }
+  // Frame recorder size
+  params_table_.add(
+    int_parameter(
+      "recorder_size",
+      256, 1, 65536, 1,
+      "Frame recorder ring file size [MiB].",
+      "Cannot be changed.",
+      true));
 
-    // Image width
-    if (p.get_name() == "image_width") {
-      image_width_ = p.as_int();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "image_width: %ld",
-        image_width_);
-      continue;
-    }
+  // Replay loop flag
+  params_table_.add(
+    bool_parameter(
+      "replay_loop",
+      false,
+      "Restarts the replay source when it ends.",
+      "Cannot be changed.",
+      true));
 
-    // Camera flipped flag
-    if (p.get_name() == "is_flipped") {
-      is_flipped_ = p.as_bool();
-      RCLCPP_INFO(
-        this->get_logger(),
-        "is_flipped: %s",
-        is_flipped_ ? "true" : "false");
-      continue;
-    }
+  // Replay pacing
+  params_table_.add(
+    string_parameter(
+      "replay_pacing",
+      "realtime",
+      "Replay pacing: recorded timestamps, fps or as fast as possible.",
+      "Cannot be changed, either realtime, fixed or fast.",
+      true)
+    .validate(
+      [](const rclcpp::Parameter & p) -> std::string {
+        ReplayPacing pacing;
+        if (!ReplaySource::parse_pacing(p.as_string(), pacing)) {
+          return "Invalid replay_pacing, must be one of realtime, fixed, fast";
+        }
+        return "";
+      }));
+
+  // Replay source
+  params_table_.add(
+    string_parameter(
+      "replay_source",
+      "",
+      "Video file, image directory or rosbag to replay instead of the device, empty to capture.",
+      "Cannot be changed.",
+      true));
+
+  // Replay bag topic
+  params_table_.add(
+    string_parameter(
+      "replay_topic",
+      "",
+      "Image topic to replay from a rosbag, empty for the first image topic.",
+      "Cannot be changed.",
+      true));
+
+  // Sampling CPU
+  params_table_.add(
+    int_parameter(
+      "sampling_cpu",
+      -1, -1, 63, 1,
+      "CPU to run camera sampling on, -1 for any.",
+      "Cannot be changed.",
+      true));
+
+  // Sampling priority
+  params_table_.add(
+    int_parameter(
+      "sampling_priority",
+      0, 0, 99, 1,
+      "SCHED_FIFO priority of camera sampling, 0 for normal scheduling.",
+      "Cannot be changed.",
+      true));
 
-    // WB temperature
-    if (p.get_name() == "wb_temperature") {
-      if (video_cap_.isOpened()) {
-        bool success;
+  // Shared memory ring slots
+  params_table_.add(
+    int_parameter(
+      "shm_slots",
+      4, 2, 64, 1,
+      "Number of frames kept in the shared memory ring.",
+      "Cannot be changed.",
+      true));
+
+  // Shared memory transport
+  params_table_.add(
+    bool_parameter(
+      "shm_transport",
+      false,
+      "Enables color frames transmission to other processes through shared memory.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        shm_transport_ = p.as_bool();
+      }));
+
+  // Statistics period
+  params_table_.add(
+    double_parameter(
+      "statistics_period",
+      0.0, 0.0, 3600.0, 0.0,
+      "Per-stage statistics publishing period, in seconds, 0.0 disables them.",
+      "Cannot be changed.",
+      true));
+
+  // Statistics window
+  params_table_.add(
+    int_parameter(
+      "statistics_window",
+      1000, 10, 100000, 1,
+      "Number of samples per stage kept for rolling percentiles.",
+      "Cannot be changed.",
+      true));
+
+  // Software sync group
+  params_table_.add(
+    string_parameter(
+      "sync_group",
+      "",
+      "Cameras in the same group are sampled together and share frame timestamps.",
+      "Cannot be changed, requires worker_pool and the same fps in the whole group.",
+      true));
+
+  // Pipeline tracing flag
+  params_table_.add(
+    bool_parameter(
+      "trace",
+      false,
+      "Publishes capture and publishing times of every frame, for pipeline latency tracing.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        trace_ = p.as_bool();
+      }));
+
+  // WB temperature
+  params_table_.add(
+    double_parameter(
+      "wb_temperature",
+      0.0, -DBL_MAX, DBL_MAX, 0.0,
+      "White balance color temperature.",
+      "Can be changed at runtime, 0.0 means auto.",
+      false)
+    .on_update_checked(
+      [this](const rclcpp::Parameter & p) -> std::string {
+        if (!video_cap_.isOpened()) {
+          return "";
+        }
         if (p.as_double() == 0.0) {
-          success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 1.0);
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 1.0) failed");
+          if (!video_cap_.set(cv::CAP_PROP_AUTO_WB, 1.0)) {
             RCLCPP_ERROR(this->get_logger(), "Failed to enable auto WB");
-            break;
-          }
-        } else {
-          success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 0.0);
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 0.0) failed");
-            RCLCPP_ERROR(this->get_logger(), "Failed to disable auto WB");
-            break;
-          }
-          success = video_cap_.set(cv::CAP_PROP_WB_TEMPERATURE, p.as_double());
-          if (!success) {
-            res.set__successful(false);
-            res.set__reason("cv::VideoCapture::set(CAP_PROP_WB_TEMPERATURE) failed");
-            RCLCPP_ERROR(this->get_logger(), "Failed to set WB temperature");
-            break;
+            return "cv::VideoCapture::set(CAP_PROP_AUTO_WB, 1.0) failed";
           }
+          return "";
         }
-      }
-      RCLCPP_INFO(
-        this->get_logger(),
-        "wb_temperature: %f",
-        p.as_double());
-      continue;
-    }
-  }
+        if (!video_cap_.set(cv::CAP_PROP_AUTO_WB, 0.0)) {
+          RCLCPP_ERROR(this->get_logger(), "Failed to disable auto WB");
+          return "cv::VideoCapture::set(CAP_PROP_AUTO_WB, 0.0) failed";
+        }
+        if (!video_cap_.set(cv::CAP_PROP_WB_TEMPERATURE, p.as_double())) {
+          RCLCPP_ERROR(this->get_logger(), "Failed to set WB temperature");
+          return "cv::VideoCapture::set(CAP_PROP_WB_TEMPERATURE) failed";
+        }
+        return "";
+      }));
+
+  // Shared worker pool flag
+  params_table_.add(
+    bool_parameter(
+      "worker_pool",
+      false,
+      "Samples the camera from a worker pool shared by all nodes in the process.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        worker_pool_ = p.as_bool();
+      }));
+
+  // Shared worker pool size
+  params_table_.add(
+    int_parameter(
+      "worker_pool_size",
+      2, 1, 16, 1,
+      "Number of threads in the shared worker pool.",
+      "Cannot be changed, only the first node in the process sets it.",
+      true));
+
+  // Zero-copy publishing flag
+  params_table_.add(
+    bool_parameter(
+      "zero_copy",
+      false,
+      "Zero-copy publishing flag.",
+      "Cannot be changed.",
+      true)
+    .on_update(
+      [this](const rclcpp::Parameter & p) -> void {
+        zero_copy_ = p.as_bool();
+      }));
 
-  return res;
+  // Declare them all at once, dispatching updates to the table from now on
+  params_table_.declare();
 }
 
 } // namespace USBCameraDriver
@@ -0,0 +1,274 @@
+/**
+ * ROS 2 USB Camera Driver shared camera sampling worker pool.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Lorenzo Bianchi <lnz.bnc@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 4, 2022
+ */
+
+/**
+ * Copyright © 2022 Intelligent Systems Lab
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <usb_camera_driver/worker_pool.hpp>
+
+namespace USBCameraDriver
+{
+
+/**
+ * @brief Gets the process-wide worker pool, creating it if necessary.
+ *
+ * @param workers Number of worker threads, used only when the pool is created.
+ * @return Shared pointer to the pool, which lives as long as someone holds it.
+ */
+std::shared_ptr<WorkerPool> WorkerPool::get(size_t workers)
+{
+  static std::mutex instance_lock;
+  static std::weak_ptr<WorkerPool> instance;
+
+  std::lock_guard<std::mutex> lock(instance_lock);
+  std::shared_ptr<WorkerPool> pool = instance.lock();
+  if (pool == nullptr) {
+    pool = std::shared_ptr<WorkerPool>(new WorkerPool(workers));
+    instance = pool;
+  }
+  return pool;
+}
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param workers Number of worker threads.
+ */
+WorkerPool::WorkerPool(size_t workers)
+{
+  if (workers == 0) {
+    workers = 1;
+  }
+  for (size_t i = 0; i < workers; i++) {
+    workers_.emplace_back(&WorkerPool::worker_routine, this);
+  }
+}
+
+/**
+ * @brief Stops and joins the worker threads.
+ */
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread & worker : workers_) {
+    worker.join();
+  }
+}
+
+/**
+ * @brief Schedules a new periodic job.
+ *
+ * Jobs in an existing sync group are aligned to its releases, so their period
+ * should match that of the group.
+ *
+ * @param job Job to schedule.
+ * @return Job ID.
+ */
+unsigned int WorkerPool::add(Job && job)
+{
+  std::unique_lock<std::mutex> lock(lock_);
+  Entry entry;
+  entry.next_release = std::chrono::steady_clock::now();
+  if (!job.sync_group.empty()) {
+    std::shared_ptr<SyncGroup> & sync = sync_groups_[job.sync_group];
+    if (sync == nullptr) {
+      sync = std::make_shared<SyncGroup>();
+    } else {
+      for (auto & e : entries_) {
+        if (e.second.sync == sync) {
+          entry.next_release = e.second.next_release;
+          break;
+        }
+      }
+    }
+    entry.sync = sync;
+  }
+  entry.job = std::move(job);
+  unsigned int id = next_id_++;
+  entries_.emplace(id, std::move(entry));
+  lock.unlock();
+  cv_.notify_all();
+  return id;
+}
+
+/**
+ * @brief Removes a job, waiting for it to complete if it is running.
+ *
+ * @param id Job ID.
+ */
+void WorkerPool::remove(unsigned int id)
+{
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    return;
+  }
+  cv_.wait(lock, [this, id] {return !entries_.at(id).running;});
+  entries_.erase(id);
+
+  // Drop sync groups nobody uses anymore
+  for (auto it = sync_groups_.begin(); it != sync_groups_.end(); ) {
+    if (it->second.use_count() == 1) {
+      it = sync_groups_.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+/**
+ * @brief Changes the period of a job, starting from its next release.
+ *
+ * @param id Job ID.
+ * @param period New job period.
+ */
+void WorkerPool::set_period(unsigned int id, std::chrono::nanoseconds period)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = entries_.find(id);
+  if (it != entries_.end()) {
+    it->second.job.period = period;
+  }
+}
+
+/**
+ * @brief Returns the number of worker threads.
+ *
+ * @return Pool size.
+ */
+size_t WorkerPool::workers() const
+{
+  return workers_.size();
+}
+
+/**
+ * @brief Runs due jobs, by priority, until the pool is destroyed.
+ */
+void WorkerPool::worker_routine()
+{
+  int current_priority = 0, current_cpu = -1;
+  std::unique_lock<std::mutex> lock(lock_);
+  while (!stopped_) {
+    // Look for the due job with the highest priority, or for the next release
+    auto now = std::chrono::steady_clock::now();
+    auto next_release = std::chrono::steady_clock::time_point::max();
+    Entry * next = nullptr;
+    for (auto & e : entries_) {
+      Entry & entry = e.second;
+      if (entry.running) {
+        continue;
+      }
+      if (entry.next_release > now) {
+        if (entry.next_release < next_release) {
+          next_release = entry.next_release;
+        }
+        continue;
+      }
+      if (next == nullptr ||
+        entry.job.priority > next->job.priority ||
+        (entry.job.priority == next->job.priority && entry.next_release < next->next_release))
+      {
+        next = &entry;
+      }
+    }
+    if (next == nullptr) {
+      if (next_release == std::chrono::steady_clock::time_point::max()) {
+        cv_.wait(lock);
+      } else {
+        cv_.wait_until(lock, next_release);
+      }
+      continue;
+    }
+
+    // Run the job outside the lock, with its own scheduling attributes
+    Tick tick;
+    tick.release = next->next_release;
+    tick.sync = next->sync.get();
+    next->running = true;
+    lock.unlock();
+    apply_job_attributes(next->job, current_priority, current_cpu);
+    next->job.routine(tick);
+    lock.lock();
+
+    // Schedule the next release, skipping those already missed
+    next->running = false;
+    next->next_release += next->job.period;
+    now = std::chrono::steady_clock::now();
+    if (next->next_release <= now && next->job.period.count() > 0) {
+      auto missed = (now - next->next_release) / next->job.period + 1;
+      next->next_release += missed * next->job.period;
+    }
+    cv_.notify_all();
+  }
+}
+
+/**
+ * @brief Applies the scheduling priority and CPU affinity of a job to the calling worker.
+ *
+ * System calls are performed only if the attributes change between jobs.
+ *
+ * @param job Job about to run.
+ * @param current_priority Current worker priority, updated upon change.
+ * @param current_cpu Current worker CPU, updated upon change.
+ */
+void WorkerPool::apply_job_attributes(const Job & job, int & current_priority, int & current_cpu)
+{
+  if (job.priority != current_priority) {
+    struct sched_param param;
+    param.sched_priority = job.priority;
+    if (!pthread_setschedparam(
+        pthread_self(),
+        job.priority > 0 ? SCHED_FIFO : SCHED_OTHER,
+        &param))
+    {
+      current_priority = job.priority;
+    }
+  }
+  if (job.cpu != current_cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (job.cpu >= 0) {
+      CPU_SET(job.cpu, &cpus);
+    } else {
+      for (int i = 0; i < CPU_SETSIZE; i++) {
+        CPU_SET(i, &cpus);
+      }
+    }
+    if (!pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus)) {
+      current_cpu = job.cpu;
+    }
+  }
+}
+
+} // namespace USBCameraDriver
@@ -28,8 +28,18 @@
  * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
 #include <usb_camera_driver/usb_camera_driver.hpp>
 
+#define UNUSED(arg) (void)(arg)
+
 using namespace std::chrono_literals;
 namespace USBCameraDriver
 {
@@ -42,7 +52,9 @@ namespace USBCameraDriver
  * @throws RuntimeError
  */
 CameraDriverNode::CameraDriverNode(const rclcpp::NodeOptions & opts)
-: Node("usb_camera_driver", opts)
+: Node("usb_camera_driver", opts),
+  params_table_(this),
+  init_time_(std::chrono::steady_clock::now())
 {
   // Initialize node parameters
   init_parameters();
@@ -50,6 +62,18 @@ CameraDriverNode::CameraDriverNode(const rclcpp::NodeOptions & opts)
   // Initialize synchronization primitives
   stopped_.store(true, std::memory_order_release);
 
+  // Lock process memory, so that sampling never waits on page faults
+  if (this->get_parameter("lock_memory").as_bool()) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+      RCLCPP_WARN(this->get_logger(), "Failed to lock process memory: %s", strerror(errno));
+    } else {
+      RCLCPP_INFO(this->get_logger(), "Process memory locked");
+    }
+  }
+
+  // Back large image buffers with huge pages, on the NUMA node they are used on
+  init_large_buffers();
+
 #ifdef WITH_CUDA
   // Check for GPU device availability
   if (!cv::cuda::getCudaEnabledDeviceCount()) {
@@ -57,57 +81,129 @@ CameraDriverNode::CameraDriverNode(const rclcpp::NodeOptions & opts)
     throw std::runtime_error("No GPU device found");
   }
   RCLCPP_INFO(this->get_logger(), "GPU device available");
+#else
+  if (cuda_async_) {
+    RCLCPP_WARN(this->get_logger(), "CUDA support not available: ignoring cuda_async");
+  }
 #endif
 
-  // Create and set up CameraInfoManager
+  // Preallocate message buffers: each frame takes up to two images
+  size_t pool_size = size_t(this->get_parameter("buffer_pool_size").as_int());
+  image_pool_ = std::make_shared<BufferPool<Image>>(2 * pool_size);
+  camera_info_pool_ = std::make_shared<BufferPool<PooledCameraInfo>>(pool_size);
+
+  // The shared worker pool runs the plain sampling loop only
+  if (worker_pool_ && (pipeline_ || cuda_async_)) {
+    RCLCPP_WARN(this->get_logger(), "Shared worker pool enabled: ignoring pipeline and cuda_async");
+    pipeline_ = false;
+    cuda_async_ = false;
+  }
+
+  // Set up processing pipeline queues, and enough frame buffers to fill them
+  if (pipeline_) {
+    frame_pool_ = std::make_shared<BufferPool<cv::Mat>>(size_t(pipeline_depth_) + 2);
+    transform_queue_ = std::make_shared<SPSCQueue<CapturedFrame>>(size_t(pipeline_depth_));
+    publish_queue_ = std::make_shared<SPSCQueue<FrameMessages>>(size_t(pipeline_depth_));
+  }
+
+  // Create and set up CameraInfoManager, calibration is loaded later
   cinfo_manager_ = std::make_shared<camera_info_manager::CameraInfoManager>(this);
   cinfo_manager_->setCameraName(this->get_parameter("camera_name").as_string());
-  if (!cinfo_manager_->loadCameraInfo(this->get_parameter("camera_calibration_file").as_string())) {
-    RCLCPP_ERROR(this->get_logger(), "Failed to get camera info");
-  }
 
   // Create image_transport publishers (this will use all available transports, see docs)
-  camera_pub_ = image_transport::create_camera_publisher(
-    this,
-    "~/" + this->get_parameter("base_topic_name").as_string() + "/image_color",
-    this->get_parameter("best_effort_qos").as_bool() ?
-    usb_camera_qos_profile : usb_camera_reliable_qos_profile);
+  if (camera_info_latched_) {
+    // CameraInfo is published once, and frames refer to it by their frame_id
+    image_pub_ = image_transport::create_publisher(
+      this,
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_color",
+      this->get_parameter("best_effort_qos").as_bool() ?
+      usb_camera_qos_profile : usb_camera_reliable_qos_profile);
+    camera_info_pub_ = this->create_publisher<CameraInfo>(
+      image_transport::getCameraInfoTopic(image_pub_.getTopic()),
+      rclcpp::QoS(1).reliable().transient_local());
+  } else {
+    camera_pub_ = image_transport::create_camera_publisher(
+      this,
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_color",
+      this->get_parameter("best_effort_qos").as_bool() ?
+      usb_camera_qos_profile : usb_camera_reliable_qos_profile);
+  }
   rect_pub_ = image_transport::create_publisher(
     this,
     "~/" + this->get_parameter("base_topic_name").as_string() + "/image_rect_color",
     this->get_parameter("best_effort_qos").as_bool() ?
     usb_camera_qos_profile : usb_camera_reliable_qos_profile);
-
-  // Get and store current camera info and compute undistorsion and rectification maps
-  if (cinfo_manager_->isCalibrated()) {
-    camera_info_ = cinfo_manager_->getCameraInfo();
-    A_ = cv::Mat(3, 3, CV_64FC1, camera_info_.k.data());
-    D_ = cv::Mat(1, 5, CV_64FC1, camera_info_.d.data());
 #ifdef WITH_CUDA
-    cv::initUndistortRectifyMap(
-      A_,
-      D_,
-      cv::Mat::eye(3, 3, CV_64F),
-      A_,
-      cv::Size(image_width_, image_height_),
-      CV_32FC1,
-      map1_,
-      map2_);
-    gpu_map1_.upload(map1_);
-    gpu_map2_.upload(map2_);
-#else
-    cv::initUndistortRectifyMap(
-      A_,
-      D_,
-      cv::Mat::eye(3, 3, CV_64F),
-      A_,
-      cv::Size(image_width_, image_height_),
-      CV_16SC2,
-      map1_,
-      map2_);
+  gpu_frame_channel_ = rect_pub_.getTopic();
 #endif
+
+  // Create native frames publishers, if necessary
+  if (pixel_format_ == PixelFormat::MJPG) {
+    native_compressed_pub_ = this->create_publisher<CompressedImage>(
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_native/compressed",
+      rclcpp::QoS(
+        rclcpp::QoSInitialization::from_rmw(
+          this->get_parameter("best_effort_qos").as_bool() ?
+          usb_camera_qos_profile : usb_camera_reliable_qos_profile)));
+  } else if (pixel_format_ != PixelFormat::BGR) {
+    native_pub_ = image_transport::create_publisher(
+      this,
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_native",
+      this->get_parameter("best_effort_qos").as_bool() ?
+      usb_camera_qos_profile : usb_camera_reliable_qos_profile);
+  }
+
+  // Create grayscale frames publisher, if native frames carry luma
+  if (pixel_format_ != PixelFormat::BGR) {
+    mono_pub_ = image_transport::create_publisher(
+      this,
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_mono",
+      this->get_parameter("best_effort_qos").as_bool() ?
+      usb_camera_qos_profile : usb_camera_reliable_qos_profile);
+  }
+
+  // Create shared memory frame descriptors publisher, if necessary
+  if (shm_transport_) {
+    shm_pub_ = this->create_publisher<ros2_usb_camera::msg::ShmFrame>(
+      "~/" + this->get_parameter("base_topic_name").as_string() + "/image_color/shm",
+      rclcpp::QoS(
+        rclcpp::QoSInitialization::from_rmw(
+          this->get_parameter("best_effort_qos").as_bool() ?
+          usb_camera_qos_profile : usb_camera_reliable_qos_profile)));
+  }
+
+  // Create readiness publisher, latched for late joiners
+  ready_pub_ = this->create_publisher<std_msgs::msg::Bool>(
+    "~/ready",
+    rclcpp::QoS(1).transient_local());
+  publish_ready(false);
+
+  // Create statistics publisher and timer, if requested
+  double statistics_period = this->get_parameter("statistics_period").as_double();
+  if (statistics_period > 0.0) {
+    stage_stats_ = std::make_shared<StageStats>(size_t(this->get_parameter("statistics_window").as_int()));
+    stats_pub_ = this->create_publisher<DiagnosticArray>("/diagnostics", rclcpp::QoS(10));
+    stats_last_time_ = StageStats::now();
+    stats_timer_ = this->create_wall_timer(
+      std::chrono::nanoseconds(int64_t(statistics_period * 1000000000.0)),
+      std::bind(
+        &CameraDriverNode::stats_timer_callback,
+        this));
   }
 
+  // Create pipeline trace publisher, if requested
+  if (trace_) {
+    trace_pub_ = this->create_publisher<ros2_usb_camera::msg::FrameTrace>(
+      "~/trace",
+      rclcpp::QoS(100));
+  }
+
+  // Set up the compressed stream encoder, if requested
+  init_encoder();
+
+  // Open the black-box frame recorder, if requested
+  init_recorder();
+
   // Initialize service servers
   hw_enable_server_ = this->create_service<SetBool>(
     "~/enable_camera",
@@ -116,8 +212,26 @@ CameraDriverNode::CameraDriverNode(const rclcpp::NodeOptions & opts)
       this,
       std::placeholders::_1,
       std::placeholders::_2));
+  if (frame_recorder_ != nullptr) {
+    export_recording_server_ = this->create_service<Trigger>(
+      "~/export_recording",
+      std::bind(
+        &CameraDriverNode::export_recording_callback,
+        this,
+        std::placeholders::_1,
+        std::placeholders::_2));
+  }
 
-  RCLCPP_INFO(this->get_logger(), "Node initialized");
+  // Load calibration and compute maps now, or in the background if requested
+  if (deferred_init_) {
+    warmup_thread_ = std::thread{
+      &CameraDriverNode::warmup_routine,
+      this};
+    RCLCPP_INFO(this->get_logger(), "Node initialized, warming up");
+  } else {
+    warmup_routine();
+    RCLCPP_INFO(this->get_logger(), "Node initialized");
+  }
 }
 
 /**
@@ -125,7 +239,9 @@ CameraDriverNode::CameraDriverNode(const rclcpp::NodeOptions & opts)
  */
 CameraDriverNode::~CameraDriverNode()
 {
-  // Stop camera sampling thread
+  wait_warmup();
+
+  // Stop camera sampling
   bool expected = false;
   if (stopped_.compare_exchange_strong(
       expected,
@@ -133,10 +249,19 @@ CameraDriverNode::~CameraDriverNode()
       std::memory_order_release,
       std::memory_order_acquire))
   {
-    camera_sampling_thread_.join();
+    if (worker_pool_) {
+      stop_sampling_job();
+    } else {
+      camera_sampling_thread_.join();
+    }
+    log_jitter_stats();
   }
+  stop_encoder();
   camera_pub_.shutdown();
+  image_pub_.shutdown();
   rect_pub_.shutdown();
+  native_pub_.shutdown();
+  mono_pub_.shutdown();
 }
 
 /**
@@ -144,8 +269,25 @@ CameraDriverNode::~CameraDriverNode()
  */
 void CameraDriverNode::camera_sampling_routine()
 {
+  // Set real-time scheduling and CPU affinity, if requested
+  set_sampling_attributes();
+
+#ifdef WITH_CUDA
+  // Hand over to the CUDA stream, if requested
+  if (cuda_async_) {
+    camera_cuda_routine();
+    return;
+  }
+#endif
+
+  // Hand over to the processing pipeline, if requested
+  if (pipeline_) {
+    camera_pipeline_routine();
+    return;
+  }
+
   // High-resolution sleep timer, in nanoseconds
-  rclcpp::WallRate sampling_timer(std::chrono::nanoseconds(int(1.0 / double(fps_) * 1000000000.0)));
+  auto sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
 
   RCLCPP_WARN(this->get_logger(), "Camera sampling thread started");
 
@@ -155,98 +297,920 @@ void CameraDriverNode::camera_sampling_routine()
       break;
     }
 
-    // Get a new frame from the camera
-    video_cap_ >> frame_;
+    // Switch capture mode, if requested
+    if (apply_device_mode()) {
+      sampling_timer = std::make_unique<rclcpp::WallRate>(sampling_period());
+    }
+
+    sample_frame(nullptr);
+
+    // In free-running mode the device paces the loop, while replays pace themselves
+    if (!free_running_ && replay_ == nullptr) {
+      sampling_timer->sleep();
+    }
+  }
+
+  // Close video capture device, or replay source
+  video_cap_.release();
+  replay_.reset();
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Camera sampling thread stopped (buffer pools exhaustions: images %lu, camera info %lu)",
+    image_pool_->exhaustions(),
+    camera_info_pool_->exhaustions());
+}
+
+/**
+ * @brief Sets scheduling policy, priority and CPU affinity of the calling sampling thread.
+ *
+ * Threads spawned afterwards, e.g. pipeline stages, inherit these settings.
+ */
+void CameraDriverNode::set_sampling_attributes()
+{
+  int priority = int(this->get_parameter("sampling_priority").as_int());
+  int cpu = int(this->get_parameter("sampling_cpu").as_int());
+
+  if (priority > 0) {
+    struct sched_param param;
+    param.sched_priority = priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Failed to set SCHED_FIFO priority %d: %s",
+        priority,
+        strerror(ret));
+    } else {
+      RCLCPP_INFO(this->get_logger(), "Sampling thread priority: SCHED_FIFO %d", priority);
+    }
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    if (ret) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Failed to set sampling thread affinity to CPU %d: %s",
+        cpu,
+        strerror(ret));
+    } else {
+      RCLCPP_INFO(this->get_logger(), "Sampling thread affinity: CPU %d", cpu);
+    }
+  }
+}
+
+/**
+ * @brief Logs inter-frame interval statistics of the last sampling session.
+ */
+void CameraDriverNode::log_jitter_stats()
+{
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Inter-frame intervals (%lu frames): mean %.1f us, stddev %.1f us, max jitter %.1f us (period %.1f us)",
+    jitter_stats_.count(),
+    jitter_stats_.mean_us(),
+    jitter_stats_.stddev_us(),
+    jitter_stats_.max_jitter_us(),
+    1000000.0 / double(fps_.load(std::memory_order_acquire)));
+  if (large_buffer_allocator_ != nullptr &&
+    (large_buffer_allocator_->explicit_failures() > 0 || large_buffer_allocator_->bind_failures() > 0))
+  {
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Large image buffers: %lu without reserved huge pages, %lu not bound to their NUMA node",
+      large_buffer_allocator_->explicit_failures(),
+      large_buffer_allocator_->bind_failures());
+  }
+}
+
+/**
+ * @brief Gets, processes and publishes a new frame.
+ *
+ * @param sync_timestamp Timestamp shared by a sync group, or null to stamp the frame itself.
+ */
+void CameraDriverNode::sample_frame(const rclcpp::Time * sync_timestamp)
+{
+  // Check which outputs are required for this frame
+  bool raw, rect;
+  bool required = required_outputs(raw, rect);
+
+  // Get a new frame from the camera, straight into the message buffer if possible
+  Image::SharedPtr image_msg = nullptr, rect_image_msg = nullptr;
+  rclcpp::Time timestamp;
+  cv::Mat image_view;
+  bool native = pixel_format_ != PixelFormat::BGR;
+  bool in_place = zero_copy_ && !fused_transform_ && raw &&
+    !is_flipped_.load(std::memory_order_acquire) && !native;
+  bool new_frame;
+  if (in_place) {
+    image_msg = new_frame_msg(image_view);
+    new_frame = grab_frame(image_view, timestamp);
+  } else {
+    new_frame = grab_frame(native ? native_frame_ : frame_, timestamp);
+  }
+  if (sync_timestamp != nullptr) {
+    timestamp = *sync_timestamp;
+  }
+
+  // Process the new frame, decoding it only if someone needs it
+  if (new_frame) {
+    if ((!native || decode_frame(native_frame_, frame_, timestamp)) && required) {
+      apply_geometry(in_place ? image_view.size() : frame_.size());
+      if (fused_transform_) {
+        process_frame_fused(frame_, image_msg, rect_image_msg, raw, rect);
+      } else if (zero_copy_) {
+        process_frame_zero_copy(
+          in_place ? image_view : frame_,
+          image_msg,
+          rect_image_msg,
+          raw,
+          rect);
+      } else {
+        process_frame(frame_, image_msg, rect_image_msg, raw, rect);
+      }
+      publish_frame(image_msg, rect_image_msg, timestamp);
+    }
+  } else {
+    RCLCPP_INFO(this->get_logger(), "Empty frame");
+  }
+}
+
+/**
+ * @brief Schedules camera sampling on the shared worker pool.
+ */
+void CameraDriverNode::start_sampling_job()
+{
+  sampling_pool_ = WorkerPool::get(size_t(this->get_parameter("worker_pool_size").as_int()));
+
+  WorkerPool::Job job;
+  job.period = sampling_period();
+  job.priority = int(this->get_parameter("sampling_priority").as_int());
+  job.cpu = int(this->get_parameter("sampling_cpu").as_int());
+  job.sync_group = this->get_parameter("sync_group").as_string();
+  job.routine = [this](const WorkerPool::Tick & tick) {
+      if (apply_device_mode()) {
+        sampling_pool_->set_period(sampling_job_, sampling_period());
+      }
+      if (tick.sync != nullptr) {
+        rclcpp::Time sync_timestamp(
+          tick.sync->stamp(
+            tick.release,
+            [this]() {return this->get_clock()->now().nanoseconds();}),
+          this->get_clock()->get_clock_type());
+        sample_frame(&sync_timestamp);
+      } else {
+        sample_frame(nullptr);
+      }
+    };
+  sampling_job_ = sampling_pool_->add(std::move(job));
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Camera sampling job started (shared worker pool, %lu threads)",
+    sampling_pool_->workers());
+}
+
+/**
+ * @brief Removes camera sampling from the shared worker pool and closes the device.
+ */
+void CameraDriverNode::stop_sampling_job()
+{
+  sampling_pool_->remove(sampling_job_);
+  sampling_pool_.reset();
+
+  // Close video capture device, or replay source
+  video_cap_.release();
+  replay_.reset();
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Camera sampling job stopped (buffer pools exhaustions: images %lu, camera info %lu)",
+    image_pool_->exhaustions(),
+    camera_info_pool_->exhaustions());
+}
+
+/**
+ * @brief Gets a new frame from the camera.
+ *
+ * In free-running mode, the frame is grabbed and retrieved separately and stamped
+ * with the capture time of the driver buffer, if available. If a replay source is
+ * open, the frame is read from it instead.
+ *
+ * @param frame cv::Mat to store the frame into.
+ * @param timestamp Capture timestamp to populate.
+ * @return True if a new frame was captured, false otherwise.
+ */
+bool CameraDriverNode::grab_frame(cv::Mat & frame, rclcpp::Time & timestamp)
+{
+  int64_t grab_start = stage_start();
+  if (replay_ != nullptr) {
+    // Recordings are paced by the replay source and stamped as if live
+    if (!replay_->read(frame)) {
+      if (stage_stats_ != nullptr) {
+        stage_stats_->add_empty();
+      }
+      return false;
+    }
+    stage_end(Stage::GRAB, grab_start);
+    jitter_stats_.add(std::chrono::steady_clock::now());
+    timestamp = this->get_clock()->now();
+    return true;
+  }
+  if (!free_running_) {
+    video_cap_ >> frame;
+    if (frame.empty()) {
+      if (stage_stats_ != nullptr) {
+        stage_stats_->add_empty();
+      }
+      return false;
+    }
+    stage_end(Stage::GRAB, grab_start);
+    jitter_stats_.add(std::chrono::steady_clock::now());
+    timestamp = this->get_clock()->now();
+    return true;
+  }
+
+  // Block on the device until a new buffer is available
+  if (!video_cap_.grab()) {
+    if (stage_stats_ != nullptr) {
+      stage_stats_->add_empty();
+    }
+    return false;
+  }
+  jitter_stats_.add(std::chrono::steady_clock::now());
+  timestamp = this->get_clock()->now();
+
+  // V4L2 stamps buffers with the monotonic clock: bring that back to the node clock
+  double buffer_msec = video_cap_.get(cv::CAP_PROP_POS_MSEC);
+  if (buffer_msec > 0.0) {
+    struct timespec now_mono;
+    clock_gettime(CLOCK_MONOTONIC, &now_mono);
+    int64_t latency_ns =
+      int64_t(now_mono.tv_sec) * 1000000000L + int64_t(now_mono.tv_nsec) -
+      int64_t(buffer_msec * 1000000.0);
+    if (latency_ns >= 0 && latency_ns < 1000000000L) {
+      timestamp = timestamp - rclcpp::Duration(std::chrono::nanoseconds(latency_ns));
+    }
+  }
+
+  // Decode the buffer
+  if (!video_cap_.retrieve(frame) || frame.empty()) {
+    if (stage_stats_ != nullptr) {
+      stage_stats_->add_empty();
+    }
+    return false;
+  }
+  stage_end(Stage::GRAB, grab_start);
+  return true;
+}
+
+/**
+ * @brief Publishes a frame in the device pixel format, then decodes it if required.
+ *
+ * BGR frames are produced only if there are subscribers to the color topics.
+ *
+ * @param native_frame cv::Mat storing the frame in the device pixel format.
+ * @param frame cv::Mat to store the BGR frame into.
+ * @param timestamp Capture timestamp.
+ * @return True if a BGR frame was produced, false otherwise.
+ */
+bool CameraDriverNode::decode_frame(
+  cv::Mat & native_frame,
+  cv::Mat & frame,
+  const rclcpp::Time & timestamp)
+{
+  // Raw buffers might come as flat byte arrays: give them their proper shape
+  if (pixel_format_ != PixelFormat::MJPG && native_frame.rows == 1) {
+    int channels = pixel_format_ == PixelFormat::YUYV ? 2 : 1;
+    int capture_width = capture_width_.load(std::memory_order_acquire);
+    int capture_height = capture_height_.load(std::memory_order_acquire);
+    if (native_frame.total() != size_t(capture_width) * size_t(capture_height) * size_t(channels)) {
+      return false;
+    }
+    native_frame = native_frame.reshape(channels, capture_height);
+  }
+
+  // Publish the native payload as is
+  if (pixel_format_ == PixelFormat::MJPG) {
+    if (native_compressed_pub_->get_subscription_count() > 0) {
+      size_t size = native_frame.total() * native_frame.elemSize();
+      native_compressed_msg_.header.set__stamp(timestamp);
+      native_compressed_msg_.header.set__frame_id(frame_id_);
+      native_compressed_msg_.set__format("jpeg");
+      native_compressed_msg_.data.resize(size);
+      std::memcpy(native_compressed_msg_.data.data(), native_frame.data, size);
+      if (stage_stats_ != nullptr) {
+        stage_stats_->add_bytes(size);
+      }
+      native_compressed_pub_->publish(native_compressed_msg_);
+    }
+    if (encoder_passthrough() && encoder_due()) {
+      submit_encoder_jpeg(native_frame, timestamp);
+    }
+    if (frame_recorder_ != nullptr && recorder_native_) {
+      frame_recorder_->write(
+        RecordFormat::JPEG,
+        uint32_t(capture_width_.load(std::memory_order_acquire)),
+        uint32_t(capture_height_.load(std::memory_order_acquire)),
+        0,
+        native_frame.data,
+        native_frame.total() * native_frame.elemSize(),
+        timestamp.nanoseconds());
+    }
+  } else if (native_pub_.getNumSubscribers() > 0) {
+    Image::SharedPtr native_msg = native_to_msg(native_frame);
+    native_msg->header.set__stamp(timestamp);
+    native_msg->header.set__frame_id(frame_id_);
+    native_pub_.publish(native_msg);
+  }
+
+  // Publish the luma plane alone, for consumers that need no color
+  if (mono_pub_.getNumSubscribers() > 0) {
+    publish_mono_frame(native_frame, timestamp);
+  }
+
+  // Decode the frame only if someone is listening
+  if (image_subscribers() == 0 && rect_pub_.getNumSubscribers() == 0 &&
+    (encoder_passthrough() || !encoder_due()) &&
+    (frame_recorder_ == nullptr || recorder_native_))
+  {
+    return false;
+  }
+  int64_t decode_start = stage_start();
+  switch (pixel_format_) {
+    case PixelFormat::MJPG:
+      cv::imdecode(native_frame, cv::IMREAD_COLOR, &frame);
+      break;
+    case PixelFormat::YUYV:
+      cv::cvtColor(native_frame, frame, cv::COLOR_YUV2BGR_YUYV);
+      break;
+    case PixelFormat::GREY:
+      cv::cvtColor(native_frame, frame, cv::COLOR_GRAY2BGR);
+      break;
+    default:
+      frame = native_frame;
+      break;
+  }
+  stage_end(Stage::DECODE, decode_start);
+  return !frame.empty();
+}
 
-    // Process the new frame
-    if (!frame_.empty()) {
-      rclcpp::Time timestamp = this->get_clock()->now();
+/**
+ * @brief Checks which outputs must be produced for the next frame.
+ *
+ * In lazy processing mode, outputs nobody subscribes to are skipped.
+ *
+ * @param raw Color image required flag to populate.
+ * @param rect Rectified image required flag to populate.
+ * @return True if at least one output is required, false otherwise.
+ */
+bool CameraDriverNode::required_outputs(bool & raw, bool & rect)
+{
+  bool lazy = lazy_processing_.load(std::memory_order_acquire);
+  raw = !lazy || image_subscribers() > 0 ||
+    (shm_pub_ != nullptr && shm_pub_->get_subscription_count() > 0) ||
+    (!encoder_passthrough() && encoder_due()) ||
+    (frame_recorder_ != nullptr && !recorder_native_);
+  rect = cinfo_manager_->isCalibrated() &&
+    (!lazy || rect_pub_.getNumSubscribers() > 0);
+  return raw || rect;
+}
 
-      // Generate Image message
-      Image::SharedPtr image_msg = nullptr, rect_image_msg = nullptr;
-      if (is_flipped_) {
+/**
+ * @brief Processes a new frame, then copies it into new Image messages.
+ *
+ * @param frame cv::Mat storing the frame.
+ * @param image_msg Image message to populate, if raw is set.
+ * @param rect_image_msg Rectified Image message to populate, if rect is set.
+ * @param raw Color image required flag.
+ * @param rect Rectified image required flag.
+ */
+void CameraDriverNode::process_frame(
+  cv::Mat & frame,
+  Image::SharedPtr & image_msg,
+  Image::SharedPtr & rect_image_msg,
+  bool raw, bool rect)
+{
+  if (is_flipped_.load(std::memory_order_acquire)) {
+    int64_t flip_start = stage_start();
 #ifdef WITH_CUDA
-        gpu_frame_.upload(frame_);
-        cv::cuda::flip(gpu_frame_, gpu_flipped_frame_, 0);
-        gpu_flipped_frame_.download(flipped_frame_);
+    gpu_frame_.upload(frame);
+    cv::cuda::flip(gpu_frame_, gpu_flipped_frame_, 0);
+    if (raw) {
+      gpu_flipped_frame_.download(flipped_frame_);
+    }
 #else
-        cv::flip(frame_, flipped_frame_, 0);
+    cv::flip(frame, flipped_frame_, 0);
 #endif
-        if (cinfo_manager_->isCalibrated()) {
+    stage_end(Stage::FLIP, flip_start);
+    if (rect) {
+      int64_t remap_start = stage_start();
 #ifdef WITH_CUDA
-          cv::cuda::remap(
-            gpu_flipped_frame_,
-            gpu_rectified_frame_,
-            gpu_map1_,
-            gpu_map2_,
-            cv::InterpolationFlags::INTER_LINEAR,
-            cv::BorderTypes::BORDER_CONSTANT);
-          gpu_rectified_frame_.download(rectified_frame_);
+      cv::cuda::remap(
+        gpu_flipped_frame_,
+        gpu_rectified_frame_,
+        gpu_map1_,
+        gpu_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
+      gpu_rectified_frame_.download(rectified_frame_);
 #else
-          cv::remap(
-            flipped_frame_,
-            rectified_frame_,
-            map1_,
-            map2_,
-            cv::InterpolationFlags::INTER_LINEAR,
-            cv::BorderTypes::BORDER_CONSTANT);
+      cv::remap(
+        flipped_frame_,
+        rectified_frame_,
+        map1_,
+        map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
 #endif
-          rect_image_msg = frame_to_msg(rectified_frame_);
-          rect_image_msg->header.set__stamp(timestamp);
-          rect_image_msg->header.set__frame_id(frame_id_);
-        }
-        image_msg = frame_to_msg(flipped_frame_);
-      } else {
-        if (cinfo_manager_->isCalibrated()) {
+      stage_end(Stage::REMAP, remap_start);
+      rect_image_msg = frame_to_msg(rectified_frame_);
+    }
+    if (raw) {
+      image_msg = frame_to_msg(flipped_frame_);
+    }
+  } else {
+    if (rect) {
+      int64_t remap_start = stage_start();
+#ifdef WITH_CUDA
+      gpu_frame_.upload(frame);
+      cv::cuda::remap(
+        gpu_frame_,
+        gpu_rectified_frame_,
+        gpu_map1_,
+        gpu_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
+      gpu_rectified_frame_.download(rectified_frame_);
+#else
+      cv::remap(
+        frame,
+        rectified_frame_,
+        map1_,
+        map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
+#endif
+      stage_end(Stage::REMAP, remap_start);
+      rect_image_msg = frame_to_msg(rectified_frame_);
+    }
+    if (raw) {
+      image_msg = frame_to_msg(frame);
+    }
+  }
+}
+
+/**
+ * @brief Processes a new frame straight into new Image messages.
+ *
+ * Flip, resize and remap write directly into the outgoing message buffers, so no
+ * additional copy of the frame data is performed. If image_msg is given and
+ * frame already wraps its buffer, i.e. the frame was captured in place, it is used as is.
+ *
+ * @param frame cv::Mat storing the frame.
+ * @param image_msg Image message to populate, if raw is set.
+ * @param rect_image_msg Rectified Image message to populate, if rect is set.
+ * @param raw Color image required flag.
+ * @param rect Rectified image required flag.
+ */
+void CameraDriverNode::process_frame_zero_copy(
+  cv::Mat & frame,
+  Image::SharedPtr & image_msg,
+  Image::SharedPtr & rect_image_msg,
+  bool raw, bool rect)
+{
+  cv::Mat image_view, rect_view;
+
+  // Oriented frame at capture geometry, rectified frames are sampled from it
+  cv::Mat oriented = frame;
+  bool flipped = is_flipped_.load(std::memory_order_acquire);
+
+  // Flip and resize the frame into the message buffer, if it is not already there
+  if (image_msg == nullptr || frame.data != image_msg->data.data()) {
+    bool resize = frame.size() != image_size();
+    if (raw) {
+      image_msg = new_frame_msg(image_view);
+    }
+    if (flipped) {
+      // Flip straight into the message buffer, unless it must be resized later
+      oriented = (raw && !resize) ? image_view : flipped_frame_;
+      int64_t flip_start = stage_start();
 #ifdef WITH_CUDA
-          gpu_frame_.upload(frame_);
-          cv::cuda::remap(
-            gpu_frame_,
-            gpu_rectified_frame_,
-            gpu_map1_,
-            gpu_map2_,
-            cv::InterpolationFlags::INTER_LINEAR,
-            cv::BorderTypes::BORDER_CONSTANT);
-          gpu_rectified_frame_.download(rectified_frame_);
+      gpu_frame_.upload(frame);
+      cv::cuda::flip(gpu_frame_, gpu_flipped_frame_, 0);
+      if (raw) {
+        gpu_flipped_frame_.download(oriented);
+      }
 #else
-          cv::remap(
-            frame_,
-            rectified_frame_,
-            map1_,
-            map2_,
-            cv::InterpolationFlags::INTER_LINEAR,
-            cv::BorderTypes::BORDER_CONSTANT);
+      cv::flip(frame, oriented, 0);
 #endif
-          rect_image_msg = frame_to_msg(rectified_frame_);
-          rect_image_msg->header.set__stamp(timestamp);
-          rect_image_msg->header.set__frame_id(frame_id_);
+      stage_end(Stage::FLIP, flip_start);
+    }
+    if (raw) {
+      if (resize) {
+        int64_t resize_start = stage_start();
+        cv::resize(oriented, image_view, image_view.size());
+        stage_end(Stage::RESIZE, resize_start);
+      } else if (!flipped) {
+        int64_t copy_start = stage_start();
+        frame.copyTo(image_view);
+        stage_end(Stage::COPY, copy_start);
+        if (stage_stats_ != nullptr) {
+          stage_stats_->add_bytes(image_view.total() * image_view.elemSize());
         }
-        image_msg = frame_to_msg(frame_);
       }
-      image_msg->header.set__stamp(timestamp);
-      image_msg->header.set__frame_id(frame_id_);
+    }
+  }
 
-      // Generate CameraInfo message
-      CameraInfo::SharedPtr camera_info_msg = std::make_shared<CameraInfo>(camera_info_);
-      camera_info_msg->header.set__stamp(timestamp);
-      camera_info_msg->header.set__frame_id(frame_id_);
+  // Rectify the frame into its own message buffer
+  if (rect) {
+    rect_image_msg = new_frame_msg(rect_view);
+    int64_t remap_start = stage_start();
+#ifdef WITH_CUDA
+    if (!flipped) {
+      gpu_flipped_frame_.upload(oriented);
+    }
+    cv::cuda::remap(
+      gpu_flipped_frame_,
+      gpu_rectified_frame_,
+      gpu_map1_,
+      gpu_map2_,
+      cv::InterpolationFlags::INTER_LINEAR,
+      cv::BorderTypes::BORDER_CONSTANT);
+    gpu_rectified_frame_.download(rect_view);
+#else
+    cv::remap(
+      oriented,
+      rect_view,
+      map1_,
+      map2_,
+      cv::InterpolationFlags::INTER_LINEAR,
+      cv::BorderTypes::BORDER_CONSTANT);
+#endif
+    stage_end(Stage::REMAP, remap_start);
+  }
 
-      // Publish new frame together with its CameraInfo on all available transports
-      camera_pub_.publish(image_msg, camera_info_msg);
-      if (cinfo_manager_->isCalibrated()) {
-        rect_pub_.publish(rect_image_msg);
+  // Drop the color image if it was captured in place but nobody needs it
+  if (!raw) {
+    image_msg = nullptr;
+  }
+}
+
+/**
+ * @brief Processes a new frame straight into new Image messages, with precomputed remap tables.
+ *
+ * Flip, resize and undistortion are fused in a single remap per output, so each
+ * frame takes one memory pass and, on GPU, a single upload.
+ *
+ * @param frame cv::Mat storing the frame.
+ * @param image_msg Image message to populate, if raw is set.
+ * @param rect_image_msg Rectified Image message to populate, if rect is set.
+ * @param raw Color image required flag.
+ * @param rect Rectified image required flag.
+ */
+void CameraDriverNode::process_frame_fused(
+  cv::Mat & frame,
+  Image::SharedPtr & image_msg,
+  Image::SharedPtr & rect_image_msg,
+  bool raw, bool rect)
+{
+  cv::Mat image_view, rect_view;
+
+  // Recompute remap tables if the frame geometry or orientation changed
+  if (frame.size() != fused_input_size_ ||
+    is_flipped_.load(std::memory_order_acquire) != fused_flipped_)
+  {
+    init_fused_maps(frame.size());
+  }
+
+#ifdef WITH_CUDA
+  if (rect || (raw && !fused_identity_)) {
+    gpu_frame_.upload(frame);
+  }
+#endif
+
+  // Flip and resize the frame into its message buffer
+  if (raw) {
+    image_msg = new_frame_msg(image_view);
+    if (fused_identity_) {
+      int64_t copy_start = stage_start();
+      frame.copyTo(image_view);
+      stage_end(Stage::COPY, copy_start);
+      if (stage_stats_ != nullptr) {
+        stage_stats_->add_bytes(image_view.total() * image_view.elemSize());
       }
     } else {
-      RCLCPP_INFO(this->get_logger(), "Empty frame");
+      int64_t remap_start = stage_start();
+#ifdef WITH_CUDA
+      cv::cuda::remap(
+        gpu_frame_,
+        gpu_flipped_frame_,
+        gpu_fused_map1_,
+        gpu_fused_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
+      gpu_flipped_frame_.download(image_view);
+#else
+      cv::remap(
+        frame,
+        image_view,
+        fused_map1_,
+        fused_map2_,
+        cv::InterpolationFlags::INTER_LINEAR,
+        cv::BorderTypes::BORDER_CONSTANT);
+#endif
+      stage_end(Stage::REMAP, remap_start);
     }
+  }
 
-    sampling_timer.sleep();
+  // Flip, resize and rectify the frame into its message buffer
+  if (rect) {
+    rect_image_msg = new_frame_msg(rect_view);
+    int64_t remap_start = stage_start();
+#ifdef WITH_CUDA
+    cv::cuda::remap(
+      gpu_frame_,
+      gpu_rectified_frame_,
+      gpu_fused_rect_map1_,
+      gpu_fused_rect_map2_,
+      cv::InterpolationFlags::INTER_LINEAR,
+      cv::BorderTypes::BORDER_CONSTANT);
+    gpu_rectified_frame_.download(rect_view);
+#else
+    cv::remap(
+      frame,
+      rect_view,
+      fused_rect_map1_,
+      fused_rect_map2_,
+      cv::InterpolationFlags::INTER_LINEAR,
+      cv::BorderTypes::BORDER_CONSTANT);
+#endif
+    stage_end(Stage::REMAP, remap_start);
   }
+}
 
-  // Close video capture device
-  video_cap_.release();
+/**
+ * @brief Publishes a new frame together with its CameraInfo.
+ *
+ * @param image_msg Image message to publish, if not null.
+ * @param rect_image_msg Rectified Image message to publish, if not null.
+ * @param timestamp Capture timestamp.
+ */
+void CameraDriverNode::publish_frame(
+  Image::SharedPtr & image_msg,
+  Image::SharedPtr & rect_image_msg,
+  const rclcpp::Time & timestamp)
+{
+  int64_t publish_start = stage_start();
+  if (!first_frame_published_.load(std::memory_order_relaxed) &&
+    !first_frame_published_.exchange(true, std::memory_order_acq_rel))
+  {
+    auto now = std::chrono::steady_clock::now();
+    RCLCPP_INFO(
+      this->get_logger(),
+      "First frame published %.1f ms after node construction, %.1f ms after camera enable",
+      std::chrono::duration<double, std::milli>(now - init_time_).count(),
+      std::chrono::duration<double, std::milli>(now - enable_time_).count());
+  }
+  if (image_msg != nullptr) {
+    image_msg->header.set__stamp(timestamp);
+    image_msg->header.set__frame_id(frame_id_);
+
+    // Generate CameraInfo message, unless it is latched: pooled messages are filled
+    // with the calibration only when it changes, then just stamped
+    CameraInfo::SharedPtr camera_info_msg;
+    if (!camera_info_latched_) {
+      std::shared_ptr<PooledCameraInfo> pooled = camera_info_pool_->acquire();
+      uint64_t generation = camera_info_generation_.load(std::memory_order_acquire);
+      if (pooled->generation != generation) {
+        pooled->msg = camera_info_;
+        pooled->msg.header.set__frame_id(frame_id_);
+        pooled->generation = generation;
+      }
+      pooled->msg.header.set__stamp(timestamp);
+      camera_info_msg = CameraInfo::SharedPtr(pooled, &(pooled->msg));
+    }
+
+    // Publish new frame together with its CameraInfo on all available transports
+    if (shm_pub_ != nullptr && shm_pub_->get_subscription_count() > 0) {
+      publish_shm_frame(*image_msg);
+    }
+    if (!encoder_passthrough() && encoder_due()) {
+      submit_encoder_image(image_msg, timestamp);
+    }
+    if (frame_recorder_ != nullptr && !recorder_native_) {
+      frame_recorder_->write(
+        RecordFormat::BGR8,
+        image_msg->width,
+        image_msg->height,
+        image_msg->step,
+        image_msg->data.data(),
+        size_t(image_msg->step) * size_t(image_msg->height),
+        timestamp.nanoseconds());
+    }
+    if (camera_info_latched_) {
+      image_pub_.publish(image_msg);
+    } else {
+      camera_pub_.publish(image_msg, camera_info_msg);
+    }
+  }
+  if (rect_image_msg != nullptr) {
+    rect_image_msg->header.set__stamp(timestamp);
+    rect_image_msg->header.set__frame_id(frame_id_);
+    rect_pub_.publish(rect_image_msg);
+  }
+  if (stage_stats_ != nullptr) {
+    stage_end(Stage::PUBLISH, publish_start);
+    stage_stats_->add(Stage::LATENCY, (this->get_clock()->now() - timestamp).nanoseconds());
+    stage_stats_->add_frame();
+  }
+  if (trace_pub_ != nullptr) {
+    publish_trace(timestamp);
+  }
+
+  // Check if subscribers are holding on to too many buffers
+  uint64_t pool_exhaustions = image_pool_->exhaustions() + camera_info_pool_->exhaustions();
+  if (pool_exhaustions != pool_exhaustions_) {
+    pool_exhaustions_ = pool_exhaustions;
+    RCLCPP_WARN_THROTTLE(
+      this->get_logger(),
+      *this->get_clock(),
+      1000,
+      "Buffer pools exhausted %lu times",
+      pool_exhaustions_);
+  }
+}
+
+/**
+ * @brief Opens the video capture device and applies the camera parameters.
+ *
+ * @param resp Service response to populate on failure.
+ * @return True if the device is ready, false otherwise.
+ */
+bool CameraDriverNode::open_device(SetBool::Response::SharedPtr resp)
+{
+  // Open capture device, selecting the native pixel format if requested
+  cv::Size output_size = image_size();
+  const char * fourcc =
+    pixel_format_ == PixelFormat::MJPG ? "MJPG" :
+    pixel_format_ == PixelFormat::YUYV ? "YUYV" : "GREY";
+  if (!video_cap_.open(this->get_parameter("camera_id").as_int(), cv::CAP_V4L2) ||
+    (pixel_format_ != PixelFormat::BGR &&
+    (!video_cap_.set(
+      cv::CAP_PROP_FOURCC,
+      cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3])) ||
+    !video_cap_.set(cv::CAP_PROP_CONVERT_RGB, 0.0))) ||
+    !video_cap_.set(cv::CAP_PROP_FRAME_WIDTH, output_size.width) ||
+    !video_cap_.set(cv::CAP_PROP_FRAME_HEIGHT, output_size.height) ||
+    !video_cap_.set(cv::CAP_PROP_FPS, double(fps_.load(std::memory_order_acquire))))
+  {
+    resp->set__success(false);
+    resp->set__message("Failed to open capture device");
+    RCLCPP_ERROR(this->get_logger(), "Failed to open capture device");
+    return false;
+  }
+  int capture_width = int(video_cap_.get(cv::CAP_PROP_FRAME_WIDTH));
+  int capture_height = int(video_cap_.get(cv::CAP_PROP_FRAME_HEIGHT));
+  capture_width_.store(capture_width, std::memory_order_release);
+  capture_height_.store(capture_height, std::memory_order_release);
 
-  RCLCPP_WARN(this->get_logger(), "Camera sampling thread stopped");
+  // Frames are resized only if the device did not accept the requested geometry
+  if (cv::Size(capture_width, capture_height) != output_size) {
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Device capture size is %dx%d, frames will be resized to %dx%d",
+      capture_width, capture_height,
+      output_size.width, output_size.height);
+  }
+  if (cinfo_manager_->isCalibrated() &&
+    rect_input_size_ != cv::Size(capture_width, capture_height))
+  {
+    init_rect_maps(cv::Size(capture_width, capture_height));
+  }
+
+  // Set camera parameters
+  double exposure = this->get_parameter("exposure").as_double();
+  double brightness = this->get_parameter("brightness").as_double();
+  double wb_temperature = this->get_parameter("wb_temperature").as_double();
+  bool success;
+  if (exposure != 0.0) {
+    success = video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.75);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 0.75) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
+      return false;
+    }
+    success = video_cap_.set(cv::CAP_PROP_EXPOSURE, exposure);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_EXPOSURE) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
+      return false;
+    }
+  }
+  if (brightness != 0.0) {
+    success = video_cap_.set(cv::CAP_PROP_BRIGHTNESS, brightness);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_BRIGHTNESS) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to set camera brightness");
+      return false;
+    }
+  }
+  if (wb_temperature == 0.0) {
+    success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 1.0);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 1.0) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to enable auto WB");
+      return false;
+    }
+  } else {
+    success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 0.0);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 0.0) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to disable auto WB");
+      return false;
+    }
+    success = video_cap_.set(cv::CAP_PROP_WB_TEMPERATURE, wb_temperature);
+    if (!success) {
+      resp->set__success(false);
+      resp->set__message("cv::VideoCapture::set(CAP_PROP_WB_TEMPERATURE) failed");
+      RCLCPP_ERROR(this->get_logger(), "Failed to set WB temperature");
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Opens the replay source that stands in for the capture device.
+ *
+ * @param resp Service response to populate on failure.
+ * @return True if the source is ready, false otherwise.
+ */
+bool CameraDriverNode::open_replay(SetBool::Response::SharedPtr resp)
+{
+  // Recordings are decoded to BGR, so native formats cannot be replayed
+  if (pixel_format_ != PixelFormat::BGR) {
+    resp->set__success(false);
+    resp->set__message("Replay sources require the BGR pixel format");
+    RCLCPP_ERROR(this->get_logger(), "Replay sources require the BGR pixel format");
+    return false;
+  }
+
+  std::string uri = this->get_parameter("replay_source").as_string();
+  std::string pacing_name = this->get_parameter("replay_pacing").as_string();
+  ReplayPacing pacing = ReplayPacing::REALTIME;
+  ReplaySource::parse_pacing(pacing_name, pacing);
+  if (worker_pool_ && pacing != ReplayPacing::FAST) {
+    // Jobs must not block: the shared worker pool already paces them at the camera frame rate
+    RCLCPP_WARN(this->get_logger(), "Replay paced by the shared worker pool, at the camera frame rate");
+    pacing = ReplayPacing::FAST;
+    pacing_name = "worker pool";
+  }
+
+  replay_ = ReplaySource::create(uri, this->get_parameter("replay_topic").as_string());
+  if (replay_ == nullptr ||
+    !replay_->open(
+      pacing, double(fps_.load(std::memory_order_acquire)),
+      this->get_parameter("replay_loop").as_bool()))
+  {
+    replay_.reset();
+    resp->set__success(false);
+    resp->set__message("Failed to open replay source " + uri);
+    RCLCPP_ERROR(this->get_logger(), "Failed to open replay source %s", uri.c_str());
+    return false;
+  }
+
+  // Frames are resized only if the recording geometry differs
+  cv::Size size = replay_->frame_size();
+  capture_width_.store(size.width, std::memory_order_release);
+  capture_height_.store(size.height, std::memory_order_release);
+  cv::Size output_size = image_size();
+  if (size != output_size) {
+    RCLCPP_WARN(
+      this->get_logger(),
+      "Replay frame size is %dx%d, frames will be resized to %dx%d",
+      size.width, size.height,
+      output_size.width, output_size.height);
+  }
+  if (cinfo_manager_->isCalibrated() && rect_input_size_ != size) {
+    init_rect_maps(size);
+  }
+
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Replaying %s (%s pacing)",
+    replay_->description().c_str(),
+    pacing_name.c_str());
+  return true;
 }
 
 /**
@@ -267,84 +1231,27 @@ void CameraDriverNode::hw_enable_callback(
         std::memory_order_release,
         std::memory_order_acquire))
     {
-      // Open capture device
-      if (!video_cap_.open(this->get_parameter("camera_id").as_int(), cv::CAP_V4L2) ||
-        !video_cap_.set(cv::CAP_PROP_FRAME_WIDTH, image_width_) ||
-        !video_cap_.set(cv::CAP_PROP_FRAME_HEIGHT, image_height_) ||
-        !video_cap_.set(cv::CAP_PROP_FPS, fps_))
-      {
+      // Calibration and maps must be ready before the first frame
+      wait_warmup();
+      enable_time_ = std::chrono::steady_clock::now();
+      first_frame_published_.store(false, std::memory_order_release);
+
+      // Open the capture device, or the recording to replay in its place
+      bool replay = !this->get_parameter("replay_source").as_string().empty();
+      if (!(replay ? open_replay(resp) : open_device(resp))) {
         stopped_.store(true, std::memory_order_release);
-        resp->set__success(false);
-        resp->set__message("Failed to open capture device");
-        RCLCPP_ERROR(this->get_logger(), "Failed to open capture device");
         return;
       }
 
-      // Set camera parameters
-      double exposure = this->get_parameter("exposure").as_double();
-      double brightness = this->get_parameter("brightness").as_double();
-      double wb_temperature = this->get_parameter("wb_temperature").as_double();
-      bool success;
-      if (exposure != 0.0) {
-        success = video_cap_.set(cv::CAP_PROP_AUTO_EXPOSURE, 0.75);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_EXPOSURE, 0.75) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
-          return;
-        }
-        success = video_cap_.set(cv::CAP_PROP_EXPOSURE, exposure);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_EXPOSURE) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to set camera exposure");
-          return;
-        }
-      }
-      if (brightness != 0.0) {
-        success = video_cap_.set(cv::CAP_PROP_BRIGHTNESS, brightness);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_BRIGHTNESS) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to set camera brightness");
-          return;
-        }
-      }
-      if (wb_temperature == 0.0) {
-        success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 1.0);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 1.0) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to enable auto WB");
-          return;
-        }
+      // Start camera sampling, on the shared worker pool if requested
+      jitter_stats_.reset(sampling_period());
+      if (worker_pool_) {
+        start_sampling_job();
       } else {
-        success = video_cap_.set(cv::CAP_PROP_AUTO_WB, 0.0);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_AUTO_WB, 0.0) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to disable auto WB");
-          return;
-        }
-        success = video_cap_.set(cv::CAP_PROP_WB_TEMPERATURE, wb_temperature);
-        if (!success) {
-          stopped_.store(true, std::memory_order_release);
-          resp->set__success(false);
-          resp->set__message("cv::VideoCapture::set(CAP_PROP_WB_TEMPERATURE) failed");
-          RCLCPP_ERROR(this->get_logger(), "Failed to set WB temperature");
-          return;
-        }
+        camera_sampling_thread_ = std::thread{
+          &CameraDriverNode::camera_sampling_routine,
+          this};
       }
-
-      // Start camera sampling thread
-      camera_sampling_thread_ = std::thread{
-        &CameraDriverNode::camera_sampling_routine,
-        this};
     }
     resp->set__success(true);
     resp->set__message("");
@@ -356,13 +1263,55 @@ void CameraDriverNode::hw_enable_callback(
         std::memory_order_release,
         std::memory_order_acquire))
     {
-      camera_sampling_thread_.join();
+      if (worker_pool_) {
+        stop_sampling_job();
+      } else {
+        camera_sampling_thread_.join();
+      }
+      log_jitter_stats();
     }
     resp->set__success(true);
     resp->set__message("");
   }
 }
 
+/**
+ * @brief Exports the frames held by the black-box recorder to a new directory.
+ *
+ * @param req Service request to parse.
+ * @param resp Service response to populate.
+ */
+void CameraDriverNode::export_recording_callback(
+  Trigger::Request::SharedPtr req,
+  Trigger::Response::SharedPtr resp)
+{
+  UNUSED(req);
+
+  // Exports are named after the time they were taken at
+  char stamp[32];
+  std::time_t now = std::time(nullptr);
+  std::tm now_tm;
+  localtime_r(&now, &now_tm);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &now_tm);
+  std::string dir = frame_recorder_->path() + ".export_" + stamp;
+
+  size_t frames = frame_recorder_->export_to(dir);
+  if (frames == 0) {
+    resp->set__success(false);
+    resp->set__message("No frames exported to " + dir);
+    RCLCPP_ERROR(this->get_logger(), "No frames exported to %s", dir.c_str());
+    return;
+  }
+  resp->set__success(true);
+  resp->set__message(dir + " (" + std::to_string(frames) + " frames)");
+  RCLCPP_WARN(
+    this->get_logger(),
+    "Exported %lu recorded frames to %s (%lu skipped so far)",
+    frames,
+    dir.c_str(),
+    frame_recorder_->skipped());
+}
+
 } // namespace USBCameraDriver
 
 #include <rclcpp_components/register_node_macro.hpp>
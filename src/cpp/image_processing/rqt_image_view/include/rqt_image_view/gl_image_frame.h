@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2011, Dirk Thomas, TU Darmstadt
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the TU Darmstadt nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef rqt_image_view__GlImageFrame_H
+#define rqt_image_view__GlImageFrame_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLWidget>
+
+#include <memory>
+#include <vector>
+
+namespace rqt_image_view {
+
+/**
+ * GlImageFrame renders frames with OpenGL.
+ * Pixel buffers are streamed to a texture through pixel buffer objects, color conversion, rotation
+ * and scaling to the widget size are done by the fragment shader.
+ */
+class GlImageFrame
+  : public QOpenGLWidget, protected QOpenGLFunctions
+{
+
+  Q_OBJECT
+
+public:
+
+  enum PixelFormat {
+    FORMAT_RGB = 0,
+    FORMAT_BGR = 1,
+    FORMAT_RGBA = 2,
+    FORMAT_BGRA = 3,
+    FORMAT_MONO = 4,
+    FORMAT_UYVY = 5,
+    FORMAT_YUYV = 6
+  };
+
+  GlImageFrame(QWidget* parent);
+
+  virtual ~GlImageFrame();
+
+  /**
+   * Sets the frame to render at the next repaint.
+   * owner keeps the pixel buffer alive until it has been uploaded.
+   * rotation is in quarter turns clockwise.
+   */
+  void setFrame(const std::shared_ptr<const void>& owner, const unsigned char* data, int width, int height, int step, PixelFormat format, int rotation);
+
+  void setSmooth(bool smooth);
+
+protected:
+
+  void initializeGL();
+
+  void paintGL();
+
+private:
+
+  void uploadFrame();
+
+  void releaseGL();
+
+  std::shared_ptr<const void> owner_;
+  const unsigned char* data_;
+  int width_;
+  int height_;
+  int step_;
+  PixelFormat format_;
+  int rotation_;
+  bool frame_pending_;
+
+  bool smooth_;
+
+  QOpenGLShaderProgram program_;
+  QOpenGLBuffer vertices_;
+  QOpenGLBuffer pixel_buffers_[2];
+  int pixel_buffer_index_;
+  bool use_pixel_buffers_;
+
+  GLuint texture_;
+  int texture_width_;
+  int texture_height_;
+  PixelFormat texture_format_;
+
+  // packs padded rows when pixel buffers are not available
+  std::vector<unsigned char> staging_;
+};
+
+}
+
+#endif // rqt_image_view__GlImageFrame_H
@@ -42,17 +42,28 @@
 
 #include <sensor_msgs/msg/image.hpp>
 #include <geometry_msgs/msg/point.hpp>
+#include <std_msgs/msg/int32.hpp>
 
+#include <cv_bridge/cv_bridge.h>
 #include <opencv2/core/core.hpp>
 
 #include <QAction>
+#include <QElapsedTimer>
 #include <QImage>
+#include <QLabel>
 #include <QList>
 #include <QString>
 #include <QSet>
 #include <QSize>
+#include <QStringList>
+#include <QTimer>
 #include <QWidget>
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace rqt_image_view {
@@ -93,6 +104,20 @@ protected slots:
 
   virtual void onDynamicRange(bool checked);
 
+  virtual void updateMaxRange();
+
+  virtual void updateDownscale();
+
+  virtual void onOpenGLChanged(bool checked);
+
+  virtual void updateColorScheme();
+
+  virtual void onStatisticsChanged(bool checked);
+
+  virtual void updateStatistics();
+
+  virtual void onQosChanged(int index);
+
   virtual void saveImage();
 
   virtual void updateNumGridlines();
@@ -108,23 +133,116 @@ protected slots:
   virtual void onRotateLeft();
   virtual void onRotateRight();
 
+  virtual void onRotationHint(int degrees);
+
+  virtual void onFrameReady();
+
+  virtual void onAddTile();
+
+  virtual void onClearTiles();
+
+  virtual void onCompositeTimer();
+
 protected:
 
-  virtual void callbackImage(const sensor_msgs::msg::Image::ConstSharedPtr& msg);
+  struct Frame
+  {
+    QImage image;
+    // size of the rotated frame at full resolution, before any downscaling
+    QSize source_size;
+    // message to render as is with OpenGL instead of image, rotated by the GPU
+    sensor_msgs::msg::Image::ConstSharedPtr native;
+    int rotation;
+    rclcpp::Time stamp;
+  };
+
+  // A subscribed image topic, with its queues and conversion state
+  struct Source
+  {
+    Source();
+    ~Source();
+
+    image_transport::Subscriber subscriber;
+
+    // rotation the publisher asks to apply, clockwise in degrees, on <topic>/rotation
+    rclcpp::Subscription<std_msgs::msg::Int32>::SharedPtr rotation_subscriber;
+
+    // latest received message and whether a worker is converting, guarded by pending_lock_
+    sensor_msgs::msg::Image::ConstSharedPtr pending_msg;
+    bool converting;
+
+    // latest converted frame, waiting for the GUI thread (owned by the slot)
+    std::atomic<Frame*> ready_frame;
+
+    // only touched by the worker converting this source
+    cv::Mat conversion_mat;
+    QSize conversion_source_size;
+
+    // rgb color of each 8 bit depth level for the current color scheme
+    cv::Mat depth_lut;
+    int depth_lut_color_map;
+
+    // running depth range for dynamic scaling, smoothed over frames
+    bool depth_range_valid;
+    double depth_min;
+    double depth_max;
+    std::string depth_range_encoding;
+  };
+
+  virtual void callbackImage(const std::weak_ptr<Source>& source, const sensor_msgs::msg::Image::ConstSharedPtr& msg);
+
+  std::shared_ptr<Source> subscribe(const QString& topic_transport);
+
+  void subscribeSources();
+
+  virtual void convertImage(Source& source, const sensor_msgs::msg::Image::ConstSharedPtr& msg);
 
-  virtual void invertPixels(int x, int y);
+  cv_bridge::CvImageConstPtr downscaleImage(const sensor_msgs::msg::Image::ConstSharedPtr& msg);
+
+  void convertDepthImage(Source& source, const cv_bridge::CvImageConstPtr& cv_ptr);
+
+  void startConversionThreads();
+
+  void stopConversionThreads();
+
+  void conversionRoutine();
+
+  std::shared_ptr<Source> takePendingSource();
+
+  Frame* convertFrame(Source& source, const sensor_msgs::msg::Image::ConstSharedPtr& msg);
+
+  void publishFrame(Source& source, Frame* frame);
+
+  void getTileGrid(int& columns, int& rows) const;
+
+  virtual void invertPixels(cv::Mat& image, int x, int y);
 
   QList<int> getGridIndices(int size) const;
 
-  virtual void overlayGrid();
+  virtual void overlayGrid(cv::Mat& image);
 
   Ui::ImageViewWidget ui_;
 
   QWidget* widget_;
 
-  image_transport::Subscriber subscriber_;
+  // written by the GUI thread while holding pending_lock_, read by the conversion workers
+  std::vector<std::shared_ptr<Source> > sources_;
+  size_t next_source_;
+
+  std::mutex pending_lock_;
+  std::condition_variable pending_cv_;
+  bool conversion_stop_;
 
-  cv::Mat conversion_mat_;
+  // shared by all sources, a source is converted by one worker at a time
+  std::vector<std::thread> conversion_threads_;
+
+  std::atomic<bool> frame_notified_;
+
+  // topics composited into one tiled image, as "topic transport" combo box data
+  QStringList tiles_;
+  std::atomic<bool> tiled_;
+  QTimer* composite_timer_;
+  std::vector<QImage> tile_images_;
 
 private:
 
@@ -147,9 +265,50 @@ private:
 
   QAction* hide_toolbar_action_;
 
-  int num_gridlines_;
+  // read by the conversion thread, written by the GUI thread
+  std::atomic<int> num_gridlines_;
+
+  std::atomic<RotateState> rotate_state_;
+
+  std::atomic<bool> dynamic_range_;
+
+  std::atomic<double> max_range_;
+
+  enum DownscaleMode {
+    DOWNSCALE_OFF = 0,
+    DOWNSCALE_NEAREST = 1,
+    DOWNSCALE_AREA = 2
+  };
+
+  std::atomic<int> downscale_mode_;
+
+  // device pixels available to the image, 0 while not known or at zoom 1
+  std::atomic<int> display_width_;
+  std::atomic<int> display_height_;
+
+  // full resolution size of the displayed frame, to map clicks back to it
+  QSize image_source_size_;
+
+  std::atomic<bool> opengl_;
+
+  // OpenCV color map for depth images, -1 for gray
+  std::atomic<int> color_map_;
+
+  // frames received, and dropped by the latest-only queues, since the last statistics update
+  std::atomic<unsigned int> received_frames_;
+  std::atomic<unsigned int> dropped_frames_;
+
+  // displayed frames and their latencies [ms] since the last statistics update
+  unsigned int displayed_frames_;
+  std::vector<double> latencies_;
+
+  QLabel* statistics_label_;
+  QTimer* statistics_timer_;
+  QElapsedTimer statistics_clock_;
 
-  RotateState rotate_state_;
+  // displayed native frame, converted only when saved
+  sensor_msgs::msg::Image::ConstSharedPtr native_msg_;
+  int native_rotation_;
 };
 
 }
@@ -33,6 +33,8 @@
 #ifndef rqt_image_view__RatioLayoutedFrame_H
 #define rqt_image_view__RatioLayoutedFrame_H
 
+#include <rqt_image_view/gl_image_frame.h>
+
 #include <QFrame>
 #include <QImage>
 #include <QLayout>
@@ -42,6 +44,8 @@
 #include <QRect>
 #include <QSize>
 
+#include <memory>
+
 namespace rqt_image_view {
 
 /**
@@ -66,6 +70,19 @@ public:
 
   void setImage(const QImage& image);
 
+  /**
+   * Shows a frame in its own pixel format, without converting it to a QImage first.
+   * Only available while OpenGL rendering is enabled, getImage() is null afterwards.
+   */
+  void setNativeImage(const std::shared_ptr<const void>& owner, const unsigned char* data, int width, int height, int step, GlImageFrame::PixelFormat format, int rotation);
+
+  // size of the displayed frame, also for native frames
+  QSize getImageSize() const;
+
+  void setOpenGLEnabled(bool enabled);
+
+  bool isOpenGLEnabled() const;
+
   QRect getAspectRatioCorrectPaintArea();
 
   void resizeToFitAspectRatio();
@@ -107,6 +124,10 @@ private:
   QImage qimage_;
   mutable QMutex qimage_mutex_;
 
+  QSize image_size_;
+
+  GlImageFrame* gl_frame_;
+
   bool smoothImage_;
 };
 
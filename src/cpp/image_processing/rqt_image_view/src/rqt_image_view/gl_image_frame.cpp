@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2011, Dirk Thomas, TU Darmstadt
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the TU Darmstadt nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rqt_image_view/gl_image_frame.h>
+
+#include <QOpenGLContext>
+#include <QVector4D>
+
+#include <cstring>
+
+namespace rqt_image_view {
+
+namespace {
+
+const char* vertex_shader =
+  "attribute vec2 a_position;\n"
+  "uniform vec4 u_rotation;\n"
+  "varying vec2 v_texcoord;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = vec4(a_position, 0.0, 1.0);\n"
+  "  // display coordinates with y pointing down, mapped back to the unrotated frame\n"
+  "  vec2 d = vec2(a_position.x, -a_position.y);\n"
+  "  vec2 s = vec2(u_rotation.x * d.x + u_rotation.y * d.y, u_rotation.z * d.x + u_rotation.w * d.y);\n"
+  "  v_texcoord = s * 0.5 + 0.5;\n"
+  "}\n";
+
+const char* fragment_shader =
+  "#ifdef GL_ES\n"
+  "precision mediump float;\n"
+  "#endif\n"
+  "uniform sampler2D u_texture;\n"
+  "uniform int u_format;\n"
+  "uniform float u_width;\n"
+  "varying vec2 v_texcoord;\n"
+  "void main()\n"
+  "{\n"
+  "  vec4 t = texture2D(u_texture, v_texcoord);\n"
+  "  vec3 rgb;\n"
+  "  if (u_format == 1 || u_format == 3) {\n"
+  "    rgb = t.bgr;\n"
+  "  } else if (u_format == 5 || u_format == 6) {\n"
+  "    // each texel packs two pixels sharing their chroma\n"
+  "    bool odd = mod(floor(v_texcoord.x * u_width), 2.0) >= 1.0;\n"
+  "    float y, u, v;\n"
+  "    if (u_format == 5) {\n"
+  "      y = odd ? t.a : t.g; u = t.r; v = t.b;\n"
+  "    } else {\n"
+  "      y = odd ? t.b : t.r; u = t.g; v = t.a;\n"
+  "    }\n"
+  "    y = 1.164 * (y - 0.0625);\n"
+  "    u -= 0.5;\n"
+  "    v -= 0.5;\n"
+  "    rgb = vec3(y + 1.596 * v, y - 0.391 * u - 0.813 * v, y + 2.018 * u);\n"
+  "  } else {\n"
+  "    rgb = t.rgb;\n"
+  "  }\n"
+  "  gl_FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+  "}\n";
+
+// bytes per pixel of the source buffer
+int bytesPerPixel(GlImageFrame::PixelFormat format)
+{
+  switch (format)
+  {
+    case GlImageFrame::FORMAT_RGB:
+    case GlImageFrame::FORMAT_BGR:
+      return 3;
+    case GlImageFrame::FORMAT_RGBA:
+    case GlImageFrame::FORMAT_BGRA:
+      return 4;
+    case GlImageFrame::FORMAT_UYVY:
+    case GlImageFrame::FORMAT_YUYV:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+bool isPackedYuv(GlImageFrame::PixelFormat format)
+{
+  return format == GlImageFrame::FORMAT_UYVY || format == GlImageFrame::FORMAT_YUYV;
+}
+
+}
+
+GlImageFrame::GlImageFrame(QWidget* parent)
+  : QOpenGLWidget(parent)
+  , data_(nullptr)
+  , width_(0)
+  , height_(0)
+  , step_(0)
+  , format_(FORMAT_RGB)
+  , rotation_(0)
+  , frame_pending_(false)
+  , smooth_(false)
+  , vertices_(QOpenGLBuffer::VertexBuffer)
+  , pixel_buffers_{QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer), QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer)}
+  , pixel_buffer_index_(0)
+  , use_pixel_buffers_(false)
+  , texture_(0)
+  , texture_width_(0)
+  , texture_height_(0)
+  , texture_format_(FORMAT_RGB)
+{
+  // clicks go to the frame below, which maps them to image coordinates
+  setAttribute(Qt::WA_TransparentForMouseEvents);
+}
+
+GlImageFrame::~GlImageFrame()
+{
+  makeCurrent();
+  releaseGL();
+  doneCurrent();
+}
+
+void GlImageFrame::setFrame(const std::shared_ptr<const void>& owner, const unsigned char* data, int width, int height, int step, PixelFormat format, int rotation)
+{
+  // packed YUV frames are uploaded two pixels per texel
+  if (isPackedYuv(format))
+  {
+    width &= ~1;
+  }
+  owner_ = owner;
+  data_ = data;
+  width_ = width;
+  height_ = height;
+  step_ = step;
+  format_ = format;
+  rotation_ = rotation;
+  frame_pending_ = data != nullptr && width > 0 && height > 0;
+  update();
+}
+
+void GlImageFrame::setSmooth(bool smooth)
+{
+  smooth_ = smooth;
+  update();
+}
+
+void GlImageFrame::initializeGL()
+{
+  initializeOpenGLFunctions();
+  connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, [this]() {
+    makeCurrent();
+    releaseGL();
+    doneCurrent();
+  });
+
+  program_.addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader);
+  program_.addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader);
+  program_.bindAttributeLocation("a_position", 0);
+  if (!program_.link())
+  {
+    qWarning("GlImageFrame::initializeGL() could not link the shader program (%s)", program_.log().toStdString().c_str());
+  }
+
+  static const GLfloat quad[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+  vertices_.create();
+  vertices_.bind();
+  vertices_.allocate(quad, sizeof(quad));
+  vertices_.release();
+
+  // OpenGL ES 2 has no pixel buffer objects, frames are then uploaded from client memory
+  QOpenGLContext* ctx = context();
+  use_pixel_buffers_ = !ctx->isOpenGLES() || ctx->format().majorVersion() >= 3;
+  for (int i = 0; use_pixel_buffers_ && i < 2; i++)
+  {
+    pixel_buffers_[i].setUsagePattern(QOpenGLBuffer::StreamDraw);
+    use_pixel_buffers_ = pixel_buffers_[i].create();
+  }
+
+  glGenTextures(1, &texture_);
+  texture_width_ = 0;
+  texture_height_ = 0;
+
+  // a context change loses the texture, so the current frame must be uploaded again
+  frame_pending_ = data_ != nullptr;
+}
+
+void GlImageFrame::releaseGL()
+{
+  if (texture_ != 0)
+  {
+    glDeleteTextures(1, &texture_);
+    texture_ = 0;
+  }
+  texture_width_ = 0;
+  texture_height_ = 0;
+  vertices_.destroy();
+  pixel_buffers_[0].destroy();
+  pixel_buffers_[1].destroy();
+  program_.removeAllShaders();
+}
+
+void GlImageFrame::uploadFrame()
+{
+  frame_pending_ = false;
+
+  GLenum gl_format;
+  int texture_width = width_;
+  switch (format_)
+  {
+    case FORMAT_RGB:
+    case FORMAT_BGR:
+      gl_format = GL_RGB;
+      break;
+    case FORMAT_MONO:
+      gl_format = GL_LUMINANCE;
+      break;
+    case FORMAT_UYVY:
+    case FORMAT_YUYV:
+      gl_format = GL_RGBA;
+      texture_width = width_ / 2;
+      break;
+    default:
+      gl_format = GL_RGBA;
+      break;
+  }
+  const int row_bytes = width_ * bytesPerPixel(format_);
+  const int size = row_bytes * height_;
+
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  const void* pixels = data_;
+  if (use_pixel_buffers_)
+  {
+    // alternate buffers and orphan their storage, so that a frame never waits for the previous transfer
+    QOpenGLBuffer& buffer = pixel_buffers_[pixel_buffer_index_];
+    pixel_buffer_index_ ^= 1;
+    buffer.bind();
+    buffer.allocate(size);
+    if (step_ == row_bytes)
+    {
+      buffer.write(0, data_, size);
+    }
+    else
+    {
+      for (int y = 0; y < height_; y++)
+      {
+        buffer.write(y * row_bytes, data_ + y * step_, row_bytes);
+      }
+    }
+    pixels = nullptr;
+  }
+  else if (step_ != row_bytes)
+  {
+    staging_.resize(size);
+    for (int y = 0; y < height_; y++)
+    {
+      std::memcpy(staging_.data() + y * row_bytes, data_ + y * step_, row_bytes);
+    }
+    pixels = staging_.data();
+  }
+
+  if (texture_width != texture_width_ || height_ != texture_height_ || format_ != texture_format_)
+  {
+    glTexImage2D(GL_TEXTURE_2D, 0, gl_format, texture_width, height_, 0, gl_format, GL_UNSIGNED_BYTE, pixels);
+    texture_width_ = texture_width;
+    texture_height_ = height_;
+    texture_format_ = format_;
+  }
+  else
+  {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture_width, height_, gl_format, GL_UNSIGNED_BYTE, pixels);
+  }
+
+  if (use_pixel_buffers_)
+  {
+    QOpenGLBuffer::release(QOpenGLBuffer::PixelUnpackBuffer);
+  }
+
+  // the pixels are on the GPU now
+  owner_.reset();
+  data_ = nullptr;
+}
+
+void GlImageFrame::paintGL()
+{
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  if (texture_ == 0)
+  {
+    return;
+  }
+  if (frame_pending_)
+  {
+    uploadFrame();
+  }
+  if (texture_width_ == 0 || !program_.isLinked())
+  {
+    return;
+  }
+
+  program_.bind();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  // packed YUV texels must not be blended with their neighbours
+  GLint filter = smooth_ && !isPackedYuv(texture_format_) ? GL_LINEAR : GL_NEAREST;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // maps display coordinates to frame coordinates, for clockwise quarter turns
+  QVector4D rotation;
+  switch (rotation_ % 4)
+  {
+    case 1: rotation = QVector4D(0.0f, 1.0f, -1.0f, 0.0f); break;
+    case 2: rotation = QVector4D(-1.0f, 0.0f, 0.0f, -1.0f); break;
+    case 3: rotation = QVector4D(0.0f, -1.0f, 1.0f, 0.0f); break;
+    default: rotation = QVector4D(1.0f, 0.0f, 0.0f, 1.0f); break;
+  }
+  program_.setUniformValue("u_texture", 0);
+  program_.setUniformValue("u_format", static_cast<int>(texture_format_));
+  program_.setUniformValue("u_width", static_cast<GLfloat>(isPackedYuv(texture_format_) ? 2 * texture_width_ : texture_width_));
+  program_.setUniformValue("u_rotation", rotation);
+
+  vertices_.bind();
+  program_.enableAttributeArray(0);
+  program_.setAttributeBuffer(0, GL_FLOAT, 0, 2);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  program_.disableAttributeArray(0);
+  vertices_.release();
+  program_.release();
+}
+
+}
@@ -38,17 +38,103 @@
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <limits>
+
 #include <QFileDialog>
+#include <QGuiApplication>
 #include <QMessageBox>
 #include <QPainter>
+#include <QScreen>
+
+#include <algorithm>
+#include <cmath>
 
 namespace rqt_image_view {
 
+namespace {
+
+// Encodings the OpenGL frame renders without converting them first
+bool glPixelFormat(const std::string& encoding, GlImageFrame::PixelFormat& format)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  if (encoding == enc::RGB8)
+    format = GlImageFrame::FORMAT_RGB;
+  else if (encoding == enc::BGR8)
+    format = GlImageFrame::FORMAT_BGR;
+  else if (encoding == enc::RGBA8)
+    format = GlImageFrame::FORMAT_RGBA;
+  else if (encoding == enc::BGRA8)
+    format = GlImageFrame::FORMAT_BGRA;
+  else if (encoding == enc::MONO8)
+    format = GlImageFrame::FORMAT_MONO;
+  else if (encoding == "yuv422")
+    format = GlImageFrame::FORMAT_UYVY;
+  else if (encoding == "yuv422_yuy2")
+    format = GlImageFrame::FORMAT_YUYV;
+  else
+    return false;
+  return true;
+}
+
+// Weight of each new frame in the running depth range
+const double depth_range_smoothing = 0.2;
+
+// Scales a depth image to 8 bit and colors it in a single pass, also measuring its range
+template<typename T>
+void scaleDepth(const cv::Mat& src, double min, double max, const cv::Mat& lut, cv::Mat& dst, double& src_min, double& src_max)
+{
+  dst.create(src.rows, src.cols, CV_8UC3);
+  const cv::Vec3b* colors = lut.ptr<cv::Vec3b>();
+  const float offset = static_cast<float>(min);
+  const float scale = static_cast<float>(255.0 / (max - min));
+  float lo = std::numeric_limits<float>::infinity();
+  float hi = -std::numeric_limits<float>::infinity();
+  for (int y = 0; y < src.rows; ++y)
+  {
+    const T* in = src.ptr<T>(y);
+    cv::Vec3b* out = dst.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < src.cols; ++x)
+    {
+      float value = static_cast<float>(in[x]);
+      if (std::numeric_limits<T>::is_integer || std::isfinite(value))
+      {
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+      }
+      // invalid (NaN) depths are black
+      float level = (value - offset) * scale;
+      out[x] = colors[level == level ? cv::saturate_cast<uchar>(level) : 0];
+    }
+  }
+  src_min = lo;
+  src_max = hi;
+}
+
+}
+
 ImageView::ImageView()
   : rqt_gui_cpp::Plugin()
   , widget_(0)
+  , next_source_(0)
+  , conversion_stop_(false)
+  , frame_notified_(false)
+  , tiled_(false)
+  , composite_timer_(0)
   , num_gridlines_(0)
   , rotate_state_(ROTATE_0)
+  , dynamic_range_(false)
+  , max_range_(0.0)
+  , downscale_mode_(DOWNSCALE_OFF)
+  , display_width_(0)
+  , display_height_(0)
+  , opengl_(false)
+  , color_map_(-1)
+  , received_frames_(0)
+  , dropped_frames_(0)
+  , displayed_frames_(0)
+  , statistics_label_(0)
+  , statistics_timer_(0)
+  , native_rotation_(0)
 {
   setObjectName("ImageView");
 }
@@ -71,10 +157,57 @@ void ImageView::initPlugin(qt_gui_cpp::PluginContext& context)
   ui_.refresh_topics_push_button->setIcon(QIcon::fromTheme("view-refresh"));
   connect(ui_.refresh_topics_push_button, SIGNAL(pressed()), this, SLOT(updateTopicList()));
 
+  ui_.add_tile_push_button->setIcon(QIcon::fromTheme("list-add"));
+  connect(ui_.add_tile_push_button, SIGNAL(pressed()), this, SLOT(onAddTile()));
+  ui_.clear_tiles_push_button->setIcon(QIcon::fromTheme("edit-clear"));
+  connect(ui_.clear_tiles_push_button, SIGNAL(pressed()), this, SLOT(onClearTiles()));
+
+  // tiles are composed once per display refresh, whatever rate their topics have
+  composite_timer_ = new QTimer(this);
+  composite_timer_->setTimerType(Qt::PreciseTimer);
+  qreal refresh_rate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60.0;
+  composite_timer_->setInterval(static_cast<int>(1000.0 / std::max(refresh_rate, 1.0)));
+  connect(composite_timer_, SIGNAL(timeout()), this, SLOT(onCompositeTimer()));
+
   ui_.zoom_1_push_button->setIcon(QIcon::fromTheme("zoom-original"));
   connect(ui_.zoom_1_push_button, SIGNAL(toggled(bool)), this, SLOT(onZoom1(bool)));
 
   connect(ui_.dynamic_range_check_box, SIGNAL(toggled(bool)), this, SLOT(onDynamicRange(bool)));
+  connect(ui_.max_range_double_spin_box, SIGNAL(valueChanged(double)), this, SLOT(updateMaxRange()));
+  dynamic_range_ = ui_.dynamic_range_check_box->isChecked();
+  max_range_ = ui_.max_range_double_spin_box->value();
+
+  connect(ui_.downscale_combo_box, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDownscale()));
+
+  connect(ui_.opengl_check_box, SIGNAL(toggled(bool)), this, SLOT(onOpenGLChanged(bool)));
+
+  ui_.color_scheme_combo_box->setToolTip(tr("Color scheme of depth images"));
+  ui_.color_scheme_combo_box->addItem(tr("Gray"), -1);
+  ui_.color_scheme_combo_box->addItem(tr("Autumn"), cv::COLORMAP_AUTUMN);
+  ui_.color_scheme_combo_box->addItem(tr("Bone"), cv::COLORMAP_BONE);
+  ui_.color_scheme_combo_box->addItem(tr("Cool"), cv::COLORMAP_COOL);
+  ui_.color_scheme_combo_box->addItem(tr("Hot"), cv::COLORMAP_HOT);
+  ui_.color_scheme_combo_box->addItem(tr("Hsv"), cv::COLORMAP_HSV);
+  ui_.color_scheme_combo_box->addItem(tr("Jet"), cv::COLORMAP_JET);
+  ui_.color_scheme_combo_box->addItem(tr("Ocean"), cv::COLORMAP_OCEAN);
+  ui_.color_scheme_combo_box->addItem(tr("Pink"), cv::COLORMAP_PINK);
+  ui_.color_scheme_combo_box->addItem(tr("Rainbow"), cv::COLORMAP_RAINBOW);
+  ui_.color_scheme_combo_box->addItem(tr("Spring"), cv::COLORMAP_SPRING);
+  ui_.color_scheme_combo_box->addItem(tr("Summer"), cv::COLORMAP_SUMMER);
+  ui_.color_scheme_combo_box->addItem(tr("Winter"), cv::COLORMAP_WINTER);
+  connect(ui_.color_scheme_combo_box, SIGNAL(currentIndexChanged(int)), this, SLOT(updateColorScheme()));
+
+  statistics_label_ = new QLabel(ui_.image_frame);
+  statistics_label_->setStyleSheet("QLabel { background-color: rgba(0, 0, 0, 160); color: white; padding: 2px; }");
+  statistics_label_->setAttribute(Qt::WA_TransparentForMouseEvents);
+  statistics_label_->move(4, 4);
+  statistics_label_->hide();
+  statistics_timer_ = new QTimer(this);
+  statistics_timer_->setInterval(1000);
+  connect(statistics_timer_, SIGNAL(timeout()), this, SLOT(updateStatistics()));
+  connect(ui_.statistics_check_box, SIGNAL(toggled(bool)), this, SLOT(onStatisticsChanged(bool)));
+
+  connect(ui_.qos_combo_box, SIGNAL(currentIndexChanged(int)), this, SLOT(onQosChanged(int)));
 
   ui_.save_as_image_push_button->setIcon(QIcon::fromTheme("document-save-as"));
   connect(ui_.save_as_image_push_button, SIGNAL(pressed()), this, SLOT(saveImage()));
@@ -119,11 +252,23 @@ void ImageView::initPlugin(qt_gui_cpp::PluginContext& context)
   hide_toolbar_action_->setCheckable(true);
   ui_.image_frame->addAction(hide_toolbar_action_);
   connect(hide_toolbar_action_, SIGNAL(toggled(bool)), this, SLOT(onHideToolbarChanged(bool)));
+
+  startConversionThreads();
 }
 
 void ImageView::shutdownPlugin()
 {
-  subscriber_.shutdown();
+  composite_timer_->stop();
+  for (size_t i = 0; i < sources_.size(); ++i)
+  {
+    sources_[i]->subscriber.shutdown();
+    sources_[i]->rotation_subscriber.reset();
+  }
+  stopConversionThreads();
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    sources_.clear();
+  }
   pub_mouse_left_.reset();
 }
 
@@ -133,6 +278,7 @@ void ImageView::saveSettings(qt_gui_cpp::Settings& plugin_settings, qt_gui_cpp::
   QString topic = ui_.topics_combo_box->currentText();
   //qDebug("ImageView::saveSettings() topic '%s'", topic.toStdString().c_str());
   instance_settings.setValue("topic", topic);
+  instance_settings.setValue("tiles", tiles_);
   instance_settings.setValue("zoom1", ui_.zoom_1_push_button->isChecked());
   instance_settings.setValue("dynamic_range", ui_.dynamic_range_check_box->isChecked());
   instance_settings.setValue("max_range", ui_.max_range_double_spin_box->value());
@@ -141,7 +287,11 @@ void ImageView::saveSettings(qt_gui_cpp::Settings& plugin_settings, qt_gui_cpp::
   instance_settings.setValue("toolbar_hidden", hide_toolbar_action_->isChecked());
   instance_settings.setValue("num_gridlines", ui_.num_gridlines_spin_box->value());
   instance_settings.setValue("smooth_image", ui_.smooth_image_check_box->isChecked());
-  instance_settings.setValue("rotate", rotate_state_);
+  instance_settings.setValue("downscale", ui_.downscale_combo_box->currentIndex());
+  instance_settings.setValue("opengl", ui_.opengl_check_box->isChecked());
+  instance_settings.setValue("statistics", ui_.statistics_check_box->isChecked());
+  instance_settings.setValue("qos", ui_.qos_combo_box->currentIndex());
+  instance_settings.setValue("rotate", static_cast<int>(rotate_state_.load()));
   instance_settings.setValue("color_scheme", ui_.color_scheme_combo_box->currentIndex());
 }
 
@@ -160,6 +310,14 @@ void ImageView::restoreSettings(const qt_gui_cpp::Settings& plugin_settings, con
   num_gridlines_ = instance_settings.value("num_gridlines", ui_.num_gridlines_spin_box->value()).toInt();
   ui_.num_gridlines_spin_box->setValue(num_gridlines_);
 
+  // set before the topic, so that the first subscription already uses it
+  int qos = instance_settings.value("qos", 0).toInt();
+  if (qos < 0 || qos >= ui_.qos_combo_box->count())
+    qos = 0;
+  ui_.qos_combo_box->blockSignals(true);
+  ui_.qos_combo_box->setCurrentIndex(qos);
+  ui_.qos_combo_box->blockSignals(false);
+
   QString topic = instance_settings.value("topic", "").toString();
   // don't overwrite topic name passed as command line argument
   if (!arg_topic_name.isEmpty())
@@ -172,6 +330,12 @@ void ImageView::restoreSettings(const qt_gui_cpp::Settings& plugin_settings, con
     selectTopic(topic);
   }
 
+  tiles_ = instance_settings.value("tiles", QStringList()).toStringList();
+  if (!tiles_.isEmpty())
+  {
+    subscribeSources();
+  }
+
   bool publish_click_location = instance_settings.value("publish_click_location", false).toBool();
   ui_.publish_click_location_check_box->setChecked(publish_click_location);
 
@@ -184,6 +348,17 @@ void ImageView::restoreSettings(const qt_gui_cpp::Settings& plugin_settings, con
   bool smooth_image_checked = instance_settings.value("smooth_image", false).toBool();
   ui_.smooth_image_check_box->setChecked(smooth_image_checked);
 
+  int downscale = instance_settings.value("downscale", DOWNSCALE_OFF).toInt();
+  if (downscale < 0 || downscale >= ui_.downscale_combo_box->count())
+    downscale = DOWNSCALE_OFF;
+  ui_.downscale_combo_box->setCurrentIndex(downscale);
+
+  bool opengl_checked = instance_settings.value("opengl", false).toBool();
+  ui_.opengl_check_box->setChecked(opengl_checked);
+
+  bool statistics_checked = instance_settings.value("statistics", false).toBool();
+  ui_.statistics_check_box->setChecked(statistics_checked);
+
   rotate_state_ = static_cast<RotateState>(instance_settings.value("rotate", 0).toInt());
   if(rotate_state_ >= ROTATE_STATE_COUNT)
     rotate_state_ = ROTATE_0;
@@ -304,38 +479,125 @@ void ImageView::selectTopic(const QString& topic)
 
 void ImageView::onTopicChanged(int index)
 {
-  conversion_mat_.release();
+  (void)index;
+  // the tiles keep their own topics
+  if (!tiled_)
+  {
+    subscribeSources();
+  }
+}
 
-  subscriber_.shutdown();
+void ImageView::onAddTile()
+{
+  QString entry = ui_.topics_combo_box->itemData(ui_.topics_combo_box->currentIndex()).toString();
+  if (entry.isEmpty() || tiles_.contains(entry))
+  {
+    return;
+  }
+  tiles_.append(entry);
+  subscribeSources();
+}
 
-  // reset image on topic change
-  ui_.image_frame->setImage(QImage());
+void ImageView::onClearTiles()
+{
+  tiles_.clear();
+  subscribeSources();
+}
 
-  QStringList parts = ui_.topics_combo_box->itemData(index).toString().split(" ");
+std::shared_ptr<ImageView::Source> ImageView::subscribe(const QString& topic_transport)
+{
+  QStringList parts = topic_transport.split(" ");
   QString topic = parts.first();
   QString transport = parts.length() == 2 ? parts.last() : "raw";
 
-  if (!topic.isEmpty())
-  {
-    const image_transport::TransportHints hints(node_.get(), transport.toStdString());
-    try {
-      auto subscription_options = rclcpp::SubscriptionOptions();
-      // TODO(jacobperron): Enable once ROS CLI args are supported https://github.com/ros-visualization/rqt/issues/262
-      // subscription_options.qos_overriding_options = rclcpp::QosOverridingOptions::with_default_policies();
-      subscriber_ = image_transport::create_subscription(
-        node_.get(),
-        topic.toStdString(),
-        std::bind(&ImageView::callbackImage, this, std::placeholders::_1),
-        hints.getTransport(),
-        rmw_qos_profile_sensor_data,
-        subscription_options);
-      qDebug("ImageView::onTopicChanged() to topic '%s' with transport '%s'", topic.toStdString().c_str(), subscriber_.getTransport().c_str());
-      std::cout << "Subscribed to topic '" << topic.toStdString() << "', with transport '" << subscriber_.getTransport() << "'" << std::endl;
-    } catch (image_transport::TransportLoadException& e) {
-      QMessageBox::warning(widget_, tr("Loading image transport plugin failed"), e.what());
-    } catch (const std::exception & e) {
-      QMessageBox::warning(widget_, tr("Subscribing to image topic failed"), e.what());
-    }
+  std::shared_ptr<Source> source = std::make_shared<Source>();
+  if (topic.isEmpty())
+  {
+    return source;
+  }
+  const image_transport::TransportHints hints(node_.get(), transport.toStdString());
+  try {
+    auto subscription_options = rclcpp::SubscriptionOptions();
+    // TODO(jacobperron): Enable once ROS CLI args are supported https://github.com/ros-visualization/rqt/issues/262
+    // subscription_options.qos_overriding_options = rclcpp::QosOverridingOptions::with_default_policies();
+    // until then the QoS is picked in the toolbar, best effort by default to match camera streams
+    rmw_qos_profile_t qos = rmw_qos_profile_sensor_data;
+    if (ui_.qos_combo_box->currentIndex() == 1)
+      qos = rmw_qos_profile_default;
+    else if (ui_.qos_combo_box->currentIndex() == 2)
+      qos = rmw_qos_profile_system_default;
+    // the callback must not keep the source alive once it is unsubscribed
+    std::weak_ptr<Source> weak_source = source;
+    source->subscriber = image_transport::create_subscription(
+      node_.get(),
+      topic.toStdString(),
+      [this, weak_source](const sensor_msgs::msg::Image::ConstSharedPtr& msg) { callbackImage(weak_source, msg); },
+      hints.getTransport(),
+      qos,
+      subscription_options);
+    // publishers that leave the rotation to viewers latch it next to the image
+    source->rotation_subscriber = node_->create_subscription<std_msgs::msg::Int32>(
+      topic.toStdString() + "/rotation",
+      rclcpp::QoS(1).transient_local(),
+      [this](const std_msgs::msg::Int32::ConstSharedPtr msg) {
+        QMetaObject::invokeMethod(this, "onRotationHint", Qt::QueuedConnection, Q_ARG(int, msg->data));
+      });
+    qDebug("ImageView::subscribe() to topic '%s' with transport '%s'", topic.toStdString().c_str(), source->subscriber.getTransport().c_str());
+    std::cout << "Subscribed to topic '" << topic.toStdString() << "', with transport '" << source->subscriber.getTransport() << "'" << std::endl;
+  } catch (image_transport::TransportLoadException& e) {
+    QMessageBox::warning(widget_, tr("Loading image transport plugin failed"), e.what());
+  } catch (const std::exception & e) {
+    QMessageBox::warning(widget_, tr("Subscribing to image topic failed"), e.what());
+  }
+  return source;
+}
+
+void ImageView::subscribeSources()
+{
+  for (size_t i = 0; i < sources_.size(); ++i)
+  {
+    sources_[i]->subscriber.shutdown();
+    sources_[i]->rotation_subscriber.reset();
+  }
+
+  // without tiles the selected topic is the only source
+  QStringList entries = tiles_;
+  if (entries.isEmpty())
+  {
+    entries.append(ui_.topics_combo_box->itemData(ui_.topics_combo_box->currentIndex()).toString());
+  }
+  std::vector<std::shared_ptr<Source> > sources;
+  for (int i = 0; i < entries.size(); ++i)
+  {
+    sources.push_back(subscribe(entries[i]));
+  }
+
+  // frames of the previous sources still in conversion are dropped along with them
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    sources_.swap(sources);
+    next_source_ = 0;
+  }
+  tiled_ = !tiles_.isEmpty();
+  received_frames_ = 0;
+  dropped_frames_ = 0;
+  displayed_frames_ = 0;
+  latencies_.clear();
+  statistics_clock_.restart();
+
+  // reset image on topic change
+  ui_.image_frame->setImage(QImage());
+  native_msg_.reset();
+  tile_images_.clear();
+  if (tiled_)
+  {
+    // clicks cannot be mapped back to one of the tiles
+    image_source_size_ = QSize();
+    composite_timer_->start();
+  }
+  else
+  {
+    composite_timer_->stop();
   }
 
   onMousePublish(ui_.publish_click_location_check_box->isChecked());
@@ -345,22 +607,125 @@ void ImageView::onZoom1(bool checked)
 {
   if (checked)
   {
-    if (ui_.image_frame->getImage().isNull())
+    // zoom 1 shows the frame pixel by pixel, so it must not be reduced
+    display_width_ = 0;
+    display_height_ = 0;
+    if (ui_.image_frame->getImageSize().isEmpty())
     {
       return;
     }
-    ui_.image_frame->setInnerFrameFixedSize(ui_.image_frame->getImage().size());
+    ui_.image_frame->setInnerFrameFixedSize(ui_.image_frame->getImageSize());
   } else {
     ui_.image_frame->setInnerFrameMinimumSize(QSize(80, 60));
     ui_.image_frame->setMaximumSize(QSize(QWIDGETSIZE_MAX, QWIDGETSIZE_MAX));
     widget_->setMinimumSize(QSize(80, 60));
     widget_->setMaximumSize(QSize(QWIDGETSIZE_MAX, QWIDGETSIZE_MAX));
+
+    // each tile only gets its cell of the display
+    int columns, rows;
+    getTileGrid(columns, rows);
+    QSize display_size = ui_.image_frame->contentsRect().size() * ui_.image_frame->devicePixelRatioF();
+    display_width_ = display_size.width() / columns;
+    display_height_ = display_size.height() / rows;
   }
 }
 
 void ImageView::onDynamicRange(bool checked)
 {
   ui_.max_range_double_spin_box->setEnabled(!checked);
+  dynamic_range_ = checked;
+}
+
+void ImageView::updateMaxRange()
+{
+  max_range_ = ui_.max_range_double_spin_box->value();
+}
+
+void ImageView::updateDownscale()
+{
+  downscale_mode_ = ui_.downscale_combo_box->currentIndex();
+}
+
+void ImageView::updateColorScheme()
+{
+  color_map_ = ui_.color_scheme_combo_box->currentData().toInt();
+}
+
+void ImageView::onStatisticsChanged(bool checked)
+{
+  statistics_label_->setVisible(checked);
+  if (checked)
+  {
+    received_frames_ = 0;
+    dropped_frames_ = 0;
+    displayed_frames_ = 0;
+    latencies_.clear();
+    statistics_clock_.start();
+    statistics_label_->setText(tr("waiting for frames..."));
+    statistics_label_->adjustSize();
+    statistics_label_->raise();
+    statistics_timer_->start();
+  }
+  else
+  {
+    statistics_timer_->stop();
+  }
+}
+
+void ImageView::updateStatistics()
+{
+  double elapsed = statistics_clock_.restart() / 1000.0;
+  if (elapsed <= 0.0)
+  {
+    return;
+  }
+  double received = received_frames_.exchange(0) / elapsed;
+  double dropped = dropped_frames_.exchange(0) / elapsed;
+  double displayed = displayed_frames_ / elapsed;
+  displayed_frames_ = 0;
+
+  QString text = tr("received %1 Hz, displayed %2 Hz, dropped %3 Hz")
+    .arg(received, 0, 'f', 1).arg(displayed, 0, 'f', 1).arg(dropped, 0, 'f', 1);
+  if (!latencies_.empty())
+  {
+    // latency histogram, from header stamp to display
+    static const double bounds[] = {10.0, 20.0, 50.0, 100.0, 200.0, 500.0};
+    const int bins = sizeof(bounds) / sizeof(bounds[0]);
+    int counts[bins + 1] = {0};
+    for (size_t i = 0; i < latencies_.size(); ++i)
+    {
+      int bin = 0;
+      while (bin < bins && latencies_[i] >= bounds[bin])
+        bin++;
+      counts[bin]++;
+    }
+    std::sort(latencies_.begin(), latencies_.end());
+    text += tr("\nlatency median %1 ms, max %2 ms\nhistogram [ms] ")
+      .arg(latencies_[latencies_.size() / 2], 0, 'f', 1).arg(latencies_.back(), 0, 'f', 1);
+    for (int bin = 0; bin < bins; ++bin)
+    {
+      text += tr("<%1: %2  ").arg(bounds[bin]).arg(counts[bin]);
+    }
+    text += tr(">=%1: %2").arg(bounds[bins - 1]).arg(counts[bins]);
+    latencies_.clear();
+  }
+  statistics_label_->setText(text);
+  statistics_label_->adjustSize();
+  statistics_label_->raise();
+}
+
+void ImageView::onQosChanged(int index)
+{
+  (void)index;
+  // subscribe again with the new QoS
+  subscribeSources();
+}
+
+void ImageView::onOpenGLChanged(bool checked)
+{
+  ui_.image_frame->setOpenGLEnabled(checked);
+  opengl_ = checked;
+  native_msg_.reset();
 }
 
 void ImageView::updateNumGridlines()
@@ -372,6 +737,28 @@ void ImageView::saveImage()
 {
   // take a snapshot before asking for the filename
   QImage img = ui_.image_frame->getImageCopy();
+  if (img.isNull() && native_msg_)
+  {
+    // native frames are rendered by OpenGL without ever being converted
+    try
+    {
+      cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(native_msg_, sensor_msgs::image_encodings::RGB8);
+      cv::Mat rotated = cv_ptr->image;
+      switch (native_rotation_)
+      {
+        case ROTATE_90: cv::rotate(cv_ptr->image, rotated, cv::ROTATE_90_CLOCKWISE); break;
+        case ROTATE_180: cv::rotate(cv_ptr->image, rotated, cv::ROTATE_180); break;
+        case ROTATE_270: cv::rotate(cv_ptr->image, rotated, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        default: break;
+      }
+      img = QImage(rotated.data, rotated.cols, rotated.rows, rotated.step[0], QImage::Format_RGB888).copy();
+    }
+    catch (cv_bridge::Exception& e)
+    {
+      qWarning("ImageView.saveImage() could not convert image from '%s' to 'rgb8' (%s)", native_msg_->encoding.c_str(), e.what());
+      return;
+    }
+  }
 
   QString file_name = QFileDialog::getSaveFileName(widget_, tr("Save as image"), "image.png", tr("Image (*.bmp *.jpg *.png *.tiff)"));
   if (file_name.isEmpty())
@@ -389,9 +776,9 @@ void ImageView::onMousePublish(bool checked)
   {
     topicName = ui_.publish_click_location_topic_line_edit->text().toStdString();
   } else {
-    if(!subscriber_.getTopic().empty())
+    if(!sources_.empty() && !sources_.front()->subscriber.getTopic().empty())
     {
-      topicName = subscriber_.getTopic()+"_mouse_left";
+      topicName = sources_.front()->subscriber.getTopic()+"_mouse_left";
     } else {
       topicName = "mouse_left";
     }
@@ -408,12 +795,12 @@ void ImageView::onMousePublish(bool checked)
 
 void ImageView::onMouseLeft(int x, int y)
 {
-  if(ui_.publish_click_location_check_box->isChecked() && !ui_.image_frame->getImage().isNull())
+  if(ui_.publish_click_location_check_box->isChecked() && !ui_.image_frame->getImageSize().isEmpty() && image_source_size_.isValid())
   {
     geometry_msgs::msg::Point clickCanvasLocation;
-    // Publish click location in pixel coordinates
-    clickCanvasLocation.x = round((double)x/(double)ui_.image_frame->width()*(double)ui_.image_frame->getImage().width());
-    clickCanvasLocation.y = round((double)y/(double)ui_.image_frame->height()*(double)ui_.image_frame->getImage().height());
+    // Publish click location in pixel coordinates of the full resolution frame, even if it was displayed downscaled
+    clickCanvasLocation.x = round((double)x/(double)ui_.image_frame->width()*(double)image_source_size_.width());
+    clickCanvasLocation.y = round((double)y/(double)ui_.image_frame->height()*(double)image_source_size_.height());
     clickCanvasLocation.z = 0;
 
     geometry_msgs::msg::Point clickLocation = clickCanvasLocation;
@@ -422,14 +809,14 @@ void ImageView::onMouseLeft(int x, int y)
     {
       case ROTATE_90:
         clickLocation.x = clickCanvasLocation.y;
-        clickLocation.y = ui_.image_frame->getImage().width() - clickCanvasLocation.x;
+        clickLocation.y = image_source_size_.width() - clickCanvasLocation.x;
         break;
       case ROTATE_180:
-        clickLocation.x = ui_.image_frame->getImage().width() - clickCanvasLocation.x;
-        clickLocation.y = ui_.image_frame->getImage().height() - clickCanvasLocation.y;
+        clickLocation.x = image_source_size_.width() - clickCanvasLocation.x;
+        clickLocation.y = image_source_size_.height() - clickCanvasLocation.y;
         break;
       case ROTATE_270:
-        clickLocation.x = ui_.image_frame->getImage().height() - clickCanvasLocation.y;
+        clickLocation.x = image_source_size_.height() - clickCanvasLocation.y;
         clickLocation.y = clickCanvasLocation.x;
         break;
       default:
@@ -467,6 +854,17 @@ void ImageView::onRotateRight()
   syncRotateLabel();
 }
 
+void ImageView::onRotationHint(int degrees)
+{
+  if (degrees % 90 != 0)
+  {
+    qWarning("ImageView::onRotationHint() ignoring rotation of %d degrees", degrees);
+    return;
+  }
+  rotate_state_ = static_cast<RotateState>(((degrees / 90) % ROTATE_STATE_COUNT + ROTATE_STATE_COUNT) % ROTATE_STATE_COUNT);
+  syncRotateLabel();
+}
+
 void ImageView::syncRotateLabel()
 {
   switch(rotate_state_)
@@ -479,26 +877,37 @@ void ImageView::syncRotateLabel()
   }
 }
 
-void ImageView::invertPixels(int x, int y)
+namespace {
+
+// Turns an RGB pixel white if it is dark, black otherwise, without branching
+inline void invertPixel(uchar* pixel)
 {
-  // Could do 255-conversion_mat_.at<cv::Vec3b>(cv::Point(x,y))[i], but that doesn't work well on gray
-  cv::Vec3b & pixel = conversion_mat_.at<cv::Vec3b>(cv::Point(x, y));
-  if (pixel[0] + pixel[1] + pixel[2] > 3 * 127)
-    pixel = cv::Vec3b(0,0,0);
-  else
-    pixel = cv::Vec3b(255,255,255);
+  // Could do 255-pixel[i], but that doesn't work well on gray
+  int sum = pixel[0] + pixel[1] + pixel[2];
+  uchar value = static_cast<uchar>((sum - (3 * 127 + 1)) >> 31);
+  pixel[0] = value;
+  pixel[1] = value;
+  pixel[2] = value;
+}
+
+}
+
+void ImageView::invertPixels(cv::Mat& image, int x, int y)
+{
+  invertPixel(image.ptr<uchar>(y) + 3 * x);
 }
 
 QList<int> ImageView::getGridIndices(int size) const
 {
   QList<int> indices;
+  const int num_gridlines = num_gridlines_;
 
   // the spacing between adjacent grid lines
-  float grid_width = 1.0f * size / (num_gridlines_ + 1);
+  float grid_width = 1.0f * size / (num_gridlines + 1);
 
   // select grid line(s) closest to the center
   float index;
-  if (num_gridlines_ % 2)  // odd
+  if (num_gridlines % 2)  // odd
   {
     indices.append(size / 2);
     // make the center line 2px wide in case of an even resolution
@@ -508,7 +917,7 @@ QList<int> ImageView::getGridIndices(int size) const
   }
   else  // even
   {
-    index = grid_width * (num_gridlines_ / 2);
+    index = grid_width * (num_gridlines / 2);
     // one grid line before the center
     indices.append(round(index));
     // one grid line after the center
@@ -516,7 +925,7 @@ QList<int> ImageView::getGridIndices(int size) const
   }
 
   // add additional grid lines from the center to the border of the image
-  int lines = (num_gridlines_ - 1) / 2;
+  int lines = (num_gridlines - 1) / 2;
   while (lines > 0)
   {
     index -= grid_width;
@@ -528,81 +937,486 @@ QList<int> ImageView::getGridIndices(int size) const
   return indices;
 }
 
-void ImageView::overlayGrid()
+void ImageView::overlayGrid(cv::Mat& image)
 {
-  // vertical gridlines
-  QList<int> columns = getGridIndices(conversion_mat_.cols);
-  for (QList<int>::const_iterator x = columns.begin(); x != columns.end(); ++x)
+  QList<int> columns = getGridIndices(image.cols);
+  QList<int> rows = getGridIndices(image.rows);
+
+  // vertical gridlines, all of them in a single top to bottom pass
+  if (!columns.empty())
   {
-    for (int y = 0; y < conversion_mat_.rows; ++y)
+    std::vector<int> offsets;
+    offsets.reserve(columns.size());
+    for (QList<int>::const_iterator x = columns.begin(); x != columns.end(); ++x)
     {
-      invertPixels(*x, y);
+      offsets.push_back(3 * *x);
+    }
+    for (int y = 0; y < image.rows; ++y)
+    {
+      uchar* row = image.ptr<uchar>(y);
+      for (size_t i = 0; i < offsets.size(); ++i)
+      {
+        invertPixel(row + offsets[i]);
+      }
     }
   }
 
-  // horizontal gridlines
-  QList<int> rows = getGridIndices(conversion_mat_.rows);
+  // horizontal gridlines, contiguous spans
+  const int row_length = 3 * image.cols;
   for (QList<int>::const_iterator y = rows.begin(); y != rows.end(); ++y)
   {
-    for (int x = 0; x < conversion_mat_.cols; ++x)
+    uchar* row = image.ptr<uchar>(*y);
+    for (int x = 0; x < row_length; x += 3)
     {
-      invertPixels(x, *y);
+      invertPixel(row + x);
     }
   }
 }
 
-void ImageView::callbackImage(const sensor_msgs::msg::Image::ConstSharedPtr& msg)
+void ImageView::callbackImage(const std::weak_ptr<Source>& weak_source, const sensor_msgs::msg::Image::ConstSharedPtr& msg)
 {
+  std::shared_ptr<Source> source = weak_source.lock();
+  if (!source)
+  {
+    return;
+  }
+  // hand the message over to the conversion workers, replacing any older one they did not get to yet
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    if (source->pending_msg)
+    {
+      dropped_frames_++;
+    }
+    source->pending_msg = msg;
+  }
+  received_frames_++;
+  pending_cv_.notify_one();
+}
+
+ImageView::Source::Source()
+  : converting(false)
+  , ready_frame(nullptr)
+  , depth_lut_color_map(-2)
+  , depth_range_valid(false)
+  , depth_min(0.0)
+  , depth_max(0.0)
+{
+}
+
+ImageView::Source::~Source()
+{
+  delete ready_frame.exchange(nullptr);
+}
+
+void ImageView::startConversionThreads()
+{
+  conversion_stop_ = false;
+  unsigned int workers = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+  for (unsigned int i = 0; i < workers; ++i)
+  {
+    conversion_threads_.push_back(std::thread(&ImageView::conversionRoutine, this));
+  }
+}
+
+void ImageView::stopConversionThreads()
+{
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    conversion_stop_ = true;
+  }
+  pending_cv_.notify_all();
+  for (size_t i = 0; i < conversion_threads_.size(); ++i)
+  {
+    conversion_threads_[i].join();
+  }
+  conversion_threads_.clear();
+}
+
+std::shared_ptr<ImageView::Source> ImageView::takePendingSource()
+{
+  // round robin, so that a fast topic cannot starve the others
+  for (size_t i = 0; i < sources_.size(); ++i)
+  {
+    size_t index = (next_source_ + i) % sources_.size();
+    if (sources_[index]->pending_msg && !sources_[index]->converting)
+    {
+      next_source_ = index + 1;
+      return sources_[index];
+    }
+  }
+  return std::shared_ptr<Source>();
+}
+
+void ImageView::conversionRoutine()
+{
+  while (true)
+  {
+    std::shared_ptr<Source> source;
+    sensor_msgs::msg::Image::ConstSharedPtr msg;
+    {
+      std::unique_lock<std::mutex> lock(pending_lock_);
+      pending_cv_.wait(lock, [this, &source] { return conversion_stop_ || (source = takePendingSource()) != nullptr; });
+      if (conversion_stop_)
+      {
+        return;
+      }
+      msg.swap(source->pending_msg);
+      source->converting = true;
+    }
+
+    publishFrame(*source, convertFrame(*source, msg));
+
+    {
+      std::lock_guard<std::mutex> lock(pending_lock_);
+      source->converting = false;
+    }
+    // a message that arrived meanwhile may have found every worker busy
+    pending_cv_.notify_one();
+  }
+}
+
+ImageView::Frame* ImageView::convertFrame(Source& source, const sensor_msgs::msg::Image::ConstSharedPtr& msg)
+{
+  Frame* frame = new Frame();
+  frame->rotation = ROTATE_0;
+  frame->stamp = rclcpp::Time(msg->header.stamp, RCL_ROS_TIME);
+
+  // OpenGL renders these as they are, grid overlays and tiles still need the CPU path
+  GlImageFrame::PixelFormat format;
+  if (opengl_ && !tiled_ && num_gridlines_ == 0 && glPixelFormat(msg->encoding, format))
+  {
+    frame->native = msg;
+    frame->rotation = rotate_state_.load();
+    frame->source_size = frame->rotation % 2 ? QSize(msg->height, msg->width) : QSize(msg->width, msg->height);
+    return frame;
+  }
+
+  convertImage(source, msg);
+  // the conversion buffer is reused by the next conversion, so the frame gets its own copy
+  const cv::Mat& mat = source.conversion_mat;
+  if (!mat.empty())
+  {
+    QImage image(mat.data, mat.cols, mat.rows, mat.step[0], QImage::Format_RGB888);
+    frame->image = image.copy();
+    frame->source_size = source.conversion_source_size;
+  }
+  return frame;
+}
+
+void ImageView::publishFrame(Source& source, Frame* frame)
+{
+  // the GUI thread only ever sees the newest frame, older unpainted ones are dropped here
+  Frame* unpainted = source.ready_frame.exchange(frame);
+  if (unpainted)
+  {
+    dropped_frames_++;
+    delete unpainted;
+  }
+  // tiles are picked up by the composite timer instead
+  if (tiled_)
+  {
+    return;
+  }
+  // at most one notification is queued, frames arriving meanwhile are picked up by it
+  if (!frame_notified_.exchange(true))
+  {
+    QMetaObject::invokeMethod(this, "onFrameReady", Qt::QueuedConnection);
+  }
+}
+
+void ImageView::onFrameReady()
+{
+  frame_notified_ = false;
+  if (tiled_ || sources_.empty())
+  {
+    return;
+  }
+  Frame* frame = sources_.front()->ready_frame.exchange(nullptr);
+  if (frame == nullptr)
+  {
+    return;
+  }
+  bool valid;
+  if (frame->native && ui_.image_frame->isOpenGLEnabled())
+  {
+    GlImageFrame::PixelFormat format;
+    glPixelFormat(frame->native->encoding, format);
+    ui_.image_frame->setNativeImage(
+      frame->native, frame->native->data.data(), frame->native->width, frame->native->height, frame->native->step, format, frame->rotation);
+    native_msg_ = frame->native;
+    native_rotation_ = frame->rotation;
+    valid = true;
+  }
+  else
+  {
+    ui_.image_frame->setImage(frame->image);
+    native_msg_.reset();
+    valid = !frame->image.isNull();
+  }
+  image_source_size_ = frame->source_size;
+  if (statistics_timer_->isActive())
+  {
+    displayed_frames_++;
+    if (frame->stamp.nanoseconds() > 0)
+    {
+      latencies_.push_back((node_->now() - frame->stamp).seconds() * 1000.0);
+    }
+  }
+  delete frame;
+  if (!valid)
+  {
+    return;
+  }
+
+  if (!ui_.zoom_1_push_button->isEnabled())
+  {
+    ui_.zoom_1_push_button->setEnabled(true);
+  }
+  // Need to update the zoom 1 every new image in case the image aspect ratio changed,
+  // though could check and see if the aspect ratio changed or not.
+  onZoom1(ui_.zoom_1_push_button->isChecked());
+}
+
+void ImageView::getTileGrid(int& columns, int& rows) const
+{
+  int tiles = tiled_ ? std::max(tiles_.size(), 1) : 1;
+  columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(tiles))));
+  rows = (tiles + columns - 1) / columns;
+}
+
+void ImageView::onCompositeTimer()
+{
+  // collect the newest frame of every tile, tiles without one keep showing their last frame
+  tile_images_.resize(sources_.size());
+  bool updated = false;
+  for (size_t i = 0; i < sources_.size(); ++i)
+  {
+    Frame* frame = sources_[i]->ready_frame.exchange(nullptr);
+    if (frame == nullptr)
+    {
+      continue;
+    }
+    if (!frame->image.isNull())
+    {
+      tile_images_[i] = frame->image;
+      updated = true;
+    }
+    if (statistics_timer_->isActive())
+    {
+      displayed_frames_++;
+      if (frame->stamp.nanoseconds() > 0)
+      {
+        latencies_.push_back((node_->now() - frame->stamp).seconds() * 1000.0);
+      }
+    }
+    delete frame;
+  }
+  if (!updated)
+  {
+    return;
+  }
+
+  // all cells get the size of the largest tile, smaller ones are fitted into them
+  int columns, rows;
+  getTileGrid(columns, rows);
+  QSize cell(0, 0);
+  for (size_t i = 0; i < tile_images_.size(); ++i)
+  {
+    cell = cell.expandedTo(tile_images_[i].size());
+  }
+  QImage composite(cell.width() * columns, cell.height() * rows, QImage::Format_RGB888);
+  composite.fill(Qt::black);
+  QPainter painter(&composite);
+  painter.setRenderHint(QPainter::SmoothPixmapTransform, ui_.smooth_image_check_box->isChecked());
+  for (size_t i = 0; i < tile_images_.size(); ++i)
+  {
+    if (tile_images_[i].isNull())
+    {
+      continue;
+    }
+    QSize size = tile_images_[i].size().scaled(cell, Qt::KeepAspectRatio);
+    int column = static_cast<int>(i) % columns;
+    int row = static_cast<int>(i) / columns;
+    QRect target(
+      column * cell.width() + (cell.width() - size.width()) / 2,
+      row * cell.height() + (cell.height() - size.height()) / 2,
+      size.width(), size.height());
+    painter.drawImage(target, tile_images_[i]);
+  }
+  painter.end();
+  ui_.image_frame->setImage(composite);
+
+  if (!ui_.zoom_1_push_button->isEnabled())
+  {
+    ui_.zoom_1_push_button->setEnabled(true);
+  }
+  onZoom1(ui_.zoom_1_push_button->isChecked());
+}
+
+cv_bridge::CvImageConstPtr ImageView::downscaleImage(const sensor_msgs::msg::Image::ConstSharedPtr& msg)
+{
+  int mode = downscale_mode_;
+  int display_width = display_width_;
+  int display_height = display_height_;
+  if (mode == DOWNSCALE_OFF || display_width <= 0 || display_height <= 0)
+  {
+    return cv_bridge::CvImageConstPtr();
+  }
+
+  // mosaiced and chroma-subsampled layouts cannot be resampled before conversion
+  const std::string& encoding = msg->encoding;
+  if (sensor_msgs::image_encodings::isBayer(encoding) || encoding.rfind("yuv", 0) == 0 || encoding.rfind("nv", 0) == 0)
+  {
+    return cv_bridge::CvImageConstPtr();
+  }
+
+  // the frame is rotated after conversion
+  RotateState rotate_state = rotate_state_;
+  if (rotate_state == ROTATE_90 || rotate_state == ROTATE_270)
+  {
+    std::swap(display_width, display_height);
+  }
+  double scale = std::min((double)display_width / msg->width, (double)display_height / msg->height);
+  if (scale >= 1.0)
+  {
+    return cv_bridge::CvImageConstPtr();
+  }
+
+  cv_bridge::CvImageConstPtr source = cv_bridge::toCvShare(msg);
+  cv_bridge::CvImagePtr reduced(new cv_bridge::CvImage(source->header, source->encoding));
+  cv::Size size(std::max(1, (int)std::lround(msg->width * scale)), std::max(1, (int)std::lround(msg->height * scale)));
+  cv::resize(source->image, reduced->image, size, 0, 0, mode == DOWNSCALE_AREA ? cv::INTER_AREA : cv::INTER_NEAREST);
+  return reduced;
+}
+
+void ImageView::convertDepthImage(Source& source, const cv_bridge::CvImageConstPtr& cv_ptr)
+{
+  const std::string& encoding = cv_ptr->encoding;
+
+  int color_map = color_map_;
+  if (color_map != source.depth_lut_color_map)
+  {
+    cv::Mat levels(256, 1, CV_8UC1);
+    for (int i = 0; i < 256; ++i)
+    {
+      levels.at<uchar>(i) = static_cast<uchar>(i);
+    }
+    if (color_map < 0)
+    {
+      cv::cvtColor(levels, source.depth_lut, CV_GRAY2RGB);
+    }
+    else
+    {
+      cv::Mat bgr;
+      cv::applyColorMap(levels, bgr, color_map);
+      cv::cvtColor(bgr, source.depth_lut, CV_BGR2RGB);
+    }
+    source.depth_lut_color_map = color_map;
+  }
+
+  // scale / quantify
+  double min = 0;
+  double max = max_range_;
+  if (encoding == sensor_msgs::image_encodings::TYPE_16UC1) max *= 1000;
+  const bool dynamic_range = dynamic_range_;
+  if (dynamic_range)
+  {
+    // the range follows the image over a few frames, it is measured while scaling
+    if (!source.depth_range_valid || source.depth_range_encoding != encoding)
+    {
+      cv::minMaxLoc(cv_ptr->image, &source.depth_min, &source.depth_max);
+      source.depth_range_encoding = encoding;
+      source.depth_range_valid = true;
+    }
+    min = source.depth_min;
+    max = source.depth_max;
+    if (min == max) {
+      // completely homogeneous images are displayed in gray
+      min = 0;
+      max = 2;
+    }
+  }
+
+  double frame_min, frame_max;
+  if (encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+    scaleDepth<uint16_t>(cv_ptr->image, min, max, source.depth_lut, source.conversion_mat, frame_min, frame_max);
+  else
+    scaleDepth<float>(cv_ptr->image, min, max, source.depth_lut, source.conversion_mat, frame_min, frame_max);
+
+  if (dynamic_range && frame_min <= frame_max)
+  {
+    source.depth_min += depth_range_smoothing * (frame_min - source.depth_min);
+    source.depth_max += depth_range_smoothing * (frame_max - source.depth_max);
+  }
+  else if (!dynamic_range)
+  {
+    source.depth_range_valid = false;
+  }
+}
+
+void ImageView::convertImage(Source& source, const sensor_msgs::msg::Image::ConstSharedPtr& msg)
+{
+  // reduce the frame to the display size first, so that the rest runs on fewer pixels
+  cv_bridge::CvImageConstPtr reduced;
   try
   {
-    // First let cv_bridge do its magic
-    cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(msg, sensor_msgs::image_encodings::RGB8);
-    conversion_mat_ = cv_ptr->image;
+    reduced = downscaleImage(msg);
+  }
+  catch (cv_bridge::Exception&)
+  {
+    reduced.reset();
+  }
+  if (rotate_state_ == ROTATE_90 || rotate_state_ == ROTATE_270)
+  {
+    source.conversion_source_size = QSize(msg->height, msg->width);
+  }
+  else
+  {
+    source.conversion_source_size = QSize(msg->width, msg->height);
+  }
 
-    if (num_gridlines_ > 0)
-      overlayGrid();
+  try
+  {
+    if (msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1 || msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+    {
+      // depth images have no rgb8 conversion, so they skip straight to scaling
+      convertDepthImage(source, reduced ? reduced : cv_bridge::toCvShare(msg));
+    }
+    else
+    {
+      // First let cv_bridge do its magic
+      cv_bridge::CvImageConstPtr cv_ptr = reduced ?
+        cv_bridge::cvtColor(reduced, sensor_msgs::image_encodings::RGB8) :
+        cv_bridge::toCvShare(msg, sensor_msgs::image_encodings::RGB8);
+      source.conversion_mat = cv_ptr->image;
+
+      if (num_gridlines_ > 0)
+        overlayGrid(source.conversion_mat);
+    }
   }
   catch (cv_bridge::Exception& e)
   {
     try
     {
       // If we're here, there is no conversion that makes sense, but let's try to imagine a few first
-      cv_bridge::CvImageConstPtr cv_ptr = cv_bridge::toCvShare(msg);
+      cv_bridge::CvImageConstPtr cv_ptr = reduced ? reduced : cv_bridge::toCvShare(msg);
       if (msg->encoding == "CV_8UC3")
       {
         // assuming it is rgb
-        conversion_mat_ = cv_ptr->image;
+        source.conversion_mat = cv_ptr->image;
       } else if (msg->encoding == "8UC1") {
         // convert gray to rgb
-        cv::cvtColor(cv_ptr->image, conversion_mat_, CV_GRAY2RGB);
-      } else if (msg->encoding == "16UC1" || msg->encoding == "32FC1") {
-        // scale / quantify
-        double min = 0;
-        double max = ui_.max_range_double_spin_box->value();
-        if (msg->encoding == "16UC1") max *= 1000;
-        if (ui_.dynamic_range_check_box->isChecked())
-        {
-          // dynamically adjust range based on min/max in image
-          cv::minMaxLoc(cv_ptr->image, &min, &max);
-          if (min == max) {
-            // completely homogeneous images are displayed in gray
-            min = 0;
-            max = 2;
-          }
-        }
-        cv::Mat img_scaled_8u;
-        cv::Mat(cv_ptr->image-min).convertTo(img_scaled_8u, CV_8UC1, 255. / (max - min));
-        cv::cvtColor(img_scaled_8u, conversion_mat_, CV_GRAY2RGB);
+        cv::cvtColor(cv_ptr->image, source.conversion_mat, CV_GRAY2RGB);
       } else {
         qWarning("ImageView.callback_image() could not convert image from '%s' to 'rgb8' (%s)", msg->encoding.c_str(), e.what());
-        ui_.image_frame->setImage(QImage());
+        source.conversion_mat.release();
         return;
       }
     }
     catch (cv_bridge::Exception& e)
     {
       qWarning("ImageView.callback_image() while trying to convert image from '%s' to 'rgb8' an exception was thrown (%s)", msg->encoding.c_str(), e.what());
-      ui_.image_frame->setImage(QImage());
+      source.conversion_mat.release();
       return;
     }
   }
@@ -613,39 +1427,27 @@ void ImageView::callbackImage(const sensor_msgs::msg::Image::ConstSharedPtr& msg
     case ROTATE_90:
     {
       cv::Mat tmp;
-      cv::transpose(conversion_mat_, tmp);
-      cv::flip(tmp, conversion_mat_, 1);
+      cv::transpose(source.conversion_mat, tmp);
+      cv::flip(tmp, source.conversion_mat, 1);
       break;
     }
     case ROTATE_180:
     {
       cv::Mat tmp;
-      cv::flip(conversion_mat_, tmp, -1);
-      conversion_mat_ = tmp;
+      cv::flip(source.conversion_mat, tmp, -1);
+      source.conversion_mat = tmp;
       break;
     }
     case ROTATE_270:
     {
       cv::Mat tmp;
-      cv::transpose(conversion_mat_, tmp);
-      cv::flip(tmp, conversion_mat_, 0);
+      cv::transpose(source.conversion_mat, tmp);
+      cv::flip(tmp, source.conversion_mat, 0);
       break;
     }
     default:
       break;
   }
-
-  // image must be copied since it uses the conversion_mat_ for storage which is asynchronously overwritten in the next callback invocation
-  QImage image(conversion_mat_.data, conversion_mat_.cols, conversion_mat_.rows, conversion_mat_.step[0], QImage::Format_RGB888);
-  ui_.image_frame->setImage(image);
-
-  if (!ui_.zoom_1_push_button->isEnabled())
-  {
-    ui_.zoom_1_push_button->setEnabled(true);
-  }
-  // Need to update the zoom 1 every new image in case the image aspect ratio changed,
-  // though could check and see if the aspect ratio changed or not.
-  onZoom1(ui_.zoom_1_push_button->isChecked());
 }
 }
 
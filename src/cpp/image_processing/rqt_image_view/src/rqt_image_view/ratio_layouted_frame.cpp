@@ -41,6 +41,7 @@ RatioLayoutedFrame::RatioLayoutedFrame(QWidget* parent, Qt::WindowFlags flags)
   : QFrame()
   , outer_layout_(NULL)
   , aspect_ratio_(4, 3)
+  , gl_frame_(NULL)
   , smoothImage_(false)
 {
   (void)parent;
@@ -70,11 +71,75 @@ void RatioLayoutedFrame::setImage(const QImage& image)//, QMutex* image_mutex)
 {
   qimage_mutex_.lock();
   qimage_ = image.copy();
+  image_size_ = qimage_.size();
   setAspectRatio(qimage_.width(), qimage_.height());
+  if (gl_frame_ && !qimage_.isNull())
+  {
+    // the shared copy keeps the pixels alive until they are uploaded
+    std::shared_ptr<QImage> owner = std::make_shared<QImage>(qimage_.convertToFormat(QImage::Format_RGB888));
+    gl_frame_->setFrame(owner, owner->constBits(), owner->width(), owner->height(), owner->bytesPerLine(), GlImageFrame::FORMAT_RGB, 0);
+  }
+  qimage_mutex_.unlock();
+  emit delayed_update();
+}
+
+void RatioLayoutedFrame::setNativeImage(const std::shared_ptr<const void>& owner, const unsigned char* data, int width, int height, int step, GlImageFrame::PixelFormat format, int rotation)
+{
+  if (!gl_frame_)
+  {
+    return;
+  }
+  qimage_mutex_.lock();
+  qimage_ = QImage();
+  image_size_ = rotation % 2 ? QSize(height, width) : QSize(width, height);
+  setAspectRatio(image_size_.width(), image_size_.height());
+  qimage_mutex_.unlock();
+  gl_frame_->setFrame(owner, data, width, height, step, format, rotation);
+  emit delayed_update();
+}
+
+QSize RatioLayoutedFrame::getImageSize() const
+{
+  return image_size_;
+}
+
+void RatioLayoutedFrame::setOpenGLEnabled(bool enabled)
+{
+  if (enabled == isOpenGLEnabled())
+  {
+    return;
+  }
+  if (enabled)
+  {
+    gl_frame_ = new GlImageFrame(this);
+    gl_frame_->setSmooth(smoothImage_);
+    gl_frame_->setVisible(false);
+  }
+  else
+  {
+    delete gl_frame_;
+    gl_frame_ = NULL;
+  }
+  // a native frame cannot be shown without OpenGL, the next one will replace it
+  qimage_mutex_.lock();
+  if (qimage_.isNull())
+  {
+    image_size_ = QSize();
+  }
+  else if (gl_frame_)
+  {
+    std::shared_ptr<QImage> owner = std::make_shared<QImage>(qimage_.convertToFormat(QImage::Format_RGB888));
+    gl_frame_->setFrame(owner, owner->constBits(), owner->width(), owner->height(), owner->bytesPerLine(), GlImageFrame::FORMAT_RGB, 0);
+  }
   qimage_mutex_.unlock();
   emit delayed_update();
 }
 
+bool RatioLayoutedFrame::isOpenGLEnabled() const
+{
+  return gl_frame_ != NULL;
+}
+
 void RatioLayoutedFrame::resizeToFitAspectRatio()
 {
   QRect rect = contentsRect();
@@ -158,6 +223,22 @@ void RatioLayoutedFrame::setAspectRatio(unsigned short width, unsigned short hei
 void RatioLayoutedFrame::paintEvent(QPaintEvent* event)
 {
   (void)event;
+  if (gl_frame_)
+  {
+    // the OpenGL frame covers the contents area and scales the image itself
+    bool has_image = !image_size_.isEmpty();
+    if (has_image)
+    {
+      resizeToFitAspectRatio();
+      gl_frame_->setGeometry(contentsRect());
+    }
+    gl_frame_->setVisible(has_image);
+    if (has_image)
+    {
+      return;
+    }
+  }
+
   QPainter painter(this);
   qimage_mutex_.lock();
   if (!qimage_.isNull())
@@ -208,6 +289,10 @@ void RatioLayoutedFrame::mousePressEvent(QMouseEvent * mouseEvent)
 
 void RatioLayoutedFrame::onSmoothImageChanged(bool checked) {
   smoothImage_ = checked;
+  if (gl_frame_)
+  {
+    gl_frame_->setSmooth(checked);
+  }
 }
 
 }
@@ -0,0 +1,99 @@
+/**
+ * Viewer Relay node definition.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 5, 2023
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef VIEWER_RELAY_HPP
+#define VIEWER_RELAY_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <sensor_msgs/msg/compressed_image.hpp>
+#include <sensor_msgs/msg/image.hpp>
+
+#include <image_transport/image_transport.hpp>
+#include <image_transport/subscriber.hpp>
+
+namespace ViewerRelay
+{
+
+/**
+ * Headless relay that feeds remote image viewers.
+ *
+ * Meant to be loaded into the same container as the image processing pipeline,
+ * so that it gets frames through intra-process communication. Frames are
+ * rate-limited, downscaled and JPEG-encoded before leaving the process, and
+ * nothing is done at all while no one is watching.
+ */
+class ViewerRelayNode : public rclcpp::Node
+{
+public:
+  ViewerRelayNode(const rclcpp::NodeOptions & opts = rclcpp::NodeOptions());
+  ~ViewerRelayNode();
+
+private:
+  /* Node initialization routines */
+  void init_parameters();
+  void init_publishers();
+  void init_timers();
+
+  /* Topic publishers */
+  rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr compressed_pub_;
+
+  /* Topic subscriptions */
+  image_transport::Subscriber image_sub_;
+
+  /* Timers */
+  rclcpp::TimerBase::SharedPtr watch_timer_;
+
+  /* Topic subscription callbacks */
+  void image_callback(const sensor_msgs::msg::Image::ConstSharedPtr & msg);
+
+  /* Timer callbacks */
+  void watch_timer_callback();
+
+  /* Node parameters */
+  std::string image_topic_;
+  int64_t jpeg_quality_ = 0;
+  double max_rate_ = 0.0;
+  int64_t max_width_ = 0;
+  std::string transport_;
+
+  /* Internal state */
+  bool subscribed_ = false;
+  std::chrono::steady_clock::time_point last_relay_time_;
+  std::chrono::nanoseconds min_relay_period_;
+  cv::Mat scaled_frame_;
+  cv::Mat bgr_frame_;
+  std::vector<int> jpeg_params_;
+};
+
+} // namespace ViewerRelay
+
+#endif // VIEWER_RELAY_HPP
@@ -0,0 +1,217 @@
+/**
+ * Viewer Relay node implementation.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ * Intelligent Systems Lab <isl.torvergata@gmail.com>
+ *
+ * June 5, 2023
+ */
+
+/**
+ * This is free software.
+ * You can redistribute it and/or modify this file under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This file is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this file; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <rmw/qos_profiles.h>
+#include <sensor_msgs/image_encodings.hpp>
+
+#include <viewer_relay/viewer_relay.hpp>
+
+namespace ViewerRelay
+{
+
+/**
+ * @brief Builds a new Viewer Relay node.
+ *
+ * @param opts Node options.
+ */
+ViewerRelayNode::ViewerRelayNode(const rclcpp::NodeOptions & opts)
+: Node("viewer_relay", opts)
+{
+  // Initialize node parameters
+  init_parameters();
+
+  // Initialize topic publishers
+  init_publishers();
+
+  // Initialize timers
+  init_timers();
+
+  RCLCPP_INFO(this->get_logger(), "Node initialized");
+}
+
+/**
+ * @brief Finalizes node operation.
+ */
+ViewerRelayNode::~ViewerRelayNode()
+{
+  image_sub_.shutdown();
+}
+
+/**
+ * @brief Routine to initialize node parameters.
+ */
+void ViewerRelayNode::init_parameters()
+{
+  rcl_interfaces::msg::ParameterDescriptor descriptor;
+  descriptor.read_only = true;
+
+  // Image topic
+  descriptor.description = "Image topic to relay.";
+  image_topic_ = this->declare_parameter("image_topic", std::string("/camera/image_color"), descriptor);
+
+  // JPEG quality
+  descriptor.description = "JPEG encoding quality, from 0 to 100.";
+  descriptor.integer_range.resize(1);
+  descriptor.integer_range[0].from_value = 1;
+  descriptor.integer_range[0].to_value = 100;
+  descriptor.integer_range[0].step = 1;
+  jpeg_quality_ = this->declare_parameter("jpeg_quality", 80, descriptor);
+
+  // Maximum width
+  descriptor.description = "Maximum width of relayed frames, 0 to keep the original size [pixels].";
+  descriptor.integer_range[0].from_value = 0;
+  descriptor.integer_range[0].to_value = 7680;
+  max_width_ = this->declare_parameter("max_width", 640, descriptor);
+  descriptor.integer_range.clear();
+
+  // Maximum rate
+  descriptor.description = "Maximum rate of relayed frames [Hz].";
+  descriptor.floating_point_range.resize(1);
+  descriptor.floating_point_range[0].from_value = 0.1;
+  descriptor.floating_point_range[0].to_value = 60.0;
+  descriptor.floating_point_range[0].step = 0.0;
+  max_rate_ = this->declare_parameter("max_rate", 5.0, descriptor);
+  descriptor.floating_point_range.clear();
+
+  // Transport
+  descriptor.description = "Image transport to subscribe with.";
+  transport_ = this->declare_parameter("transport", std::string("raw"), descriptor);
+
+  min_relay_period_ = std::chrono::nanoseconds(int64_t(1e9 / max_rate_));
+  jpeg_params_ = {cv::IMWRITE_JPEG_QUALITY, int(jpeg_quality_)};
+}
+
+/**
+ * @brief Routine to initialize topic publishers.
+ */
+void ViewerRelayNode::init_publishers()
+{
+  // Reliable, so that viewers can subscribe with any reliability
+  compressed_pub_ = this->create_publisher<sensor_msgs::msg::CompressedImage>(
+    "~/image/compressed",
+    rclcpp::QoS(1));
+}
+
+/**
+ * @brief Routine to initialize timers.
+ */
+void ViewerRelayNode::init_timers()
+{
+  watch_timer_ = this->create_wall_timer(
+    std::chrono::seconds(1),
+    std::bind(&ViewerRelayNode::watch_timer_callback, this));
+}
+
+/**
+ * @brief Subscribes to the image topic only while someone is watching.
+ */
+void ViewerRelayNode::watch_timer_callback()
+{
+  bool watched = compressed_pub_->get_subscription_count() > 0;
+  if (watched && !subscribed_) {
+    image_sub_ = image_transport::create_subscription(
+      this,
+      image_topic_,
+      std::bind(
+        &ViewerRelayNode::image_callback,
+        this,
+        std::placeholders::_1),
+      transport_,
+      rmw_qos_profile_sensor_data);
+    subscribed_ = true;
+    RCLCPP_INFO(this->get_logger(), "Relaying %s", image_sub_.getTopic().c_str());
+  } else if (!watched && subscribed_) {
+    image_sub_.shutdown();
+    subscribed_ = false;
+    RCLCPP_INFO(this->get_logger(), "No viewers left, relay paused");
+  }
+}
+
+/**
+ * @brief Downscales, encodes and relays a new frame, if the rate cap allows it.
+ *
+ * @param msg Image message to parse.
+ */
+void ViewerRelayNode::image_callback(const sensor_msgs::msg::Image::ConstSharedPtr & msg)
+{
+  // Drop frames above the rate cap before doing anything with them
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_relay_time_ < min_relay_period_) {
+    return;
+  }
+
+  // Wrap the frame without copying it
+  int type;
+  bool mono = false;
+  if (msg->encoding == sensor_msgs::image_encodings::BGR8 ||
+    msg->encoding == sensor_msgs::image_encodings::RGB8)
+  {
+    type = CV_8UC3;
+  } else if (msg->encoding == sensor_msgs::image_encodings::MONO8) {
+    type = CV_8UC1;
+    mono = true;
+  } else {
+    RCLCPP_WARN_ONCE(
+      this->get_logger(),
+      "Unsupported image encoding: %s",
+      msg->encoding.c_str());
+    return;
+  }
+  cv::Mat frame(
+    int(msg->height), int(msg->width), type,
+    const_cast<uint8_t *>(msg->data.data()), msg->step);
+  last_relay_time_ = now;
+
+  // Downscale first, so that the rest runs on fewer pixels
+  if (max_width_ > 0 && frame.cols > max_width_) {
+    int height = std::max(1, int(std::lround(double(frame.rows) * max_width_ / frame.cols)));
+    cv::resize(frame, scaled_frame_, cv::Size(int(max_width_), height), 0.0, 0.0, cv::INTER_AREA);
+    frame = scaled_frame_;
+  }
+  if (msg->encoding == sensor_msgs::image_encodings::RGB8) {
+    cv::cvtColor(frame, bgr_frame_, cv::COLOR_RGB2BGR);
+    frame = bgr_frame_;
+  }
+
+  auto compressed_msg = std::make_unique<sensor_msgs::msg::CompressedImage>();
+  compressed_msg->header = msg->header;
+  compressed_msg->format = mono ? "mono8; jpeg compressed mono8" : "bgr8; jpeg compressed bgr8";
+  if (!cv::imencode(".jpg", frame, compressed_msg->data, jpeg_params_)) {
+    RCLCPP_ERROR(this->get_logger(), "Failed to encode frame");
+    return;
+  }
+  compressed_pub_->publish(std::move(compressed_msg));
+}
+
+} // namespace ViewerRelay
+
+#include <rclcpp_components/register_node_macro.hpp>
+RCLCPP_COMPONENTS_REGISTER_NODE(ViewerRelay::ViewerRelayNode)
@@ -13,6 +13,8 @@
 
 #include <std_msgs/msg/int64.hpp>
 
+#include <ros2_examples_headers/parameter_cache/parameter_cache.hpp>
+
 using namespace std_msgs::msg;
 
 /**
@@ -24,7 +26,10 @@ public:
   ParametricPub();
 
 private:
-  int pub_num_; //! Number to be published
+  //! The cache is updated by the parameter services, and read by the timer without locks
+  //! It must be created before our own callback is added, see below
+  ROS2ParameterCache::ParameterCache param_cache_;
+  ROS2ParameterCache::ParameterHandle<int64_t> pub_num_; //! Number to be published
   rcl_interfaces::msg::ParameterDescriptor param_descriptor_; //! Number parameter descriptor
 
   rclcpp::Publisher<Int64>::SharedPtr num_publisher_;
@@ -19,7 +19,8 @@
  * Creates a parametric publisher using the value of the parameter.
  */
 ParametricPub::ParametricPub()
-: Node("parametric_pub")
+: Node("parametric_pub"),
+  param_cache_(this)
 {
   // Register parameter set callback
   //! This traces all ROS APIs too, so must be registered first
@@ -56,10 +57,18 @@ ParametricPub::ParametricPub()
   //! declare_parameter(NAME_STRING, DEFAULT_VALUE, DESCRIPTOR);
   this->declare_parameter("number", 1, param_descriptor_);
 
+  //! Once declared, parameters can be cached: from now on, the cache stores the
+  //! values that all callbacks accept, and lookups by name are done only once
+  pub_num_ = param_cache_.add<int64_t>("number");
+  param_cache_.on_change(
+    pub_num_,
+    std::function<void(const int64_t &)>(
+      [this](const int64_t & num) -> void {
+        RCLCPP_INFO(this->get_logger(), "Number changed to: %ld", num);
+      }));
   //! This happens to be a best practice: subsequent accesses will be faster
-  //! since it is now a class member, and we don't need to call the middleware
+  //! since the value is now stored in the node, and we don't need to call the middleware
   //! to retrieve the value it stores each time
-  //! This also needs in-house callbacks for setting it at runtime, see below
 
   //! Now that parameters have all been declared, you should initialize the rest of the node!
 
@@ -83,7 +92,7 @@ void ParametricPub::pub_routine()
 {
   // Publish new message
   Int64 new_msg{};
-  new_msg.set__data(pub_num_);
+  new_msg.set__data(pub_num_.get());
   num_publisher_->publish(new_msg);
   RCLCPP_INFO(this->get_logger(), "Published: %ld", new_msg.data);
 }
@@ -115,11 +124,9 @@ rcl_interfaces::msg::SetParametersResult ParametricPub::param_clbk(
         this->get_logger(),
         "Requested parameter change to: %ld",
         p.as_int());
-      int new_val = p.as_int();
-      //! This happens to be a best practice: subsequent accesses will be faster
-      //! since it is now a class member, and we don't need to call the middleware
-      //! to retrieve the value it stores each time
-      //! This also needs in-house callbacks for setting it at runtime, see below
+      int64_t new_val = p.as_int();
+      //! Storing the new value is up to the cache, whose callback runs after this
+      //! one and only if this one accepts it
       //! To prove that this is executed after ROS internals we add an additional
       //! condition; try to set the parameter to 0
       if (new_val == 0)
@@ -128,7 +135,6 @@ rcl_interfaces::msg::SetParametersResult ParametricPub::param_clbk(
         res.set__reason("Callback considers 0 invalid");
         return res;
       }
-      pub_num_ = new_val; //! Watch out for concurrency!
       res.set__successful(true);
       res.set__reason("");
       break;
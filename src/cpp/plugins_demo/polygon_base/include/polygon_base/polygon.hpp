@@ -9,6 +9,8 @@
 #ifndef POLYGON_BASE_POLYGON_HPP_
 #define POLYGON_BASE_POLYGON_HPP_
 
+#include <cstddef>
+
 //! All must be enclosed in a namespace for pluginlib to work
 namespace PolygonBase
 {
@@ -23,6 +25,13 @@ public:
   //! Necessary since constructor can't have parameters!
   virtual void init(double side_length) = 0;
   virtual double area() = 0;
+
+  //! Computes the areas of many polygons of this kind at once, so that hot
+  //! loops make a single indirect call per batch instead of one per element:
+  //! areas[i] is the area of the polygon with side length side_lengths[i]
+  //! It does not touch the object state, and arrays must not overlap
+  virtual void area_batch(const double * side_lengths, double * areas, size_t count) const = 0;
+
   //! If necessary, add a fini method
 
   //! Has to be virtual to comply with C++ specification
@@ -30,6 +30,7 @@ class POLYGONS_PUBLIC Square : public PolygonBase::Polygon
 public:
   void init(double side_length) override;
   double area() override;
+  void area_batch(const double * side_lengths, double * areas, size_t count) const override;
 
 //! There must not be any private members
 protected:
@@ -33,4 +33,22 @@ double POLYGONS_EXPORT Square::area()
   return pow(side_length_, 2.0);
 }
 
+/**
+ * @brief Computes the areas of many Squares.
+ *
+ * @param side_lengths Side lengths.
+ * @param areas Areas, filled in.
+ * @param count Number of Squares.
+ */
+void POLYGONS_EXPORT Square::area_batch(
+  const double * __restrict__ side_lengths,
+  double * __restrict__ areas,
+  size_t count) const
+{
+#pragma omp simd
+  for (size_t i = 0; i < count; i++) {
+    areas[i] = side_lengths[i] * side_lengths[i];
+  }
+}
+
 }  // namespace Polygons
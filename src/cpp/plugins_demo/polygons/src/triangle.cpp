@@ -33,6 +33,26 @@ double POLYGONS_EXPORT Triangle::area()
   return 0.5 * side_length_ * compute_height();
 }
 
+/**
+ * @brief Computes the areas of many Triangles.
+ *
+ * @param side_lengths Side lengths.
+ * @param areas Areas, filled in.
+ * @param count Number of Triangles.
+ */
+void POLYGONS_EXPORT Triangle::area_batch(
+  const double * __restrict__ side_lengths,
+  double * __restrict__ areas,
+  size_t count) const
+{
+  //! Same as area(), with the height factored out as sqrt(3)/2 * |side|
+  const double coeff = 0.25 * sqrt(3.0);
+#pragma omp simd
+  for (size_t i = 0; i < count; i++) {
+    areas[i] = coeff * side_lengths[i] * fabs(side_lengths[i]);
+  }
+}
+
 /**
  * @brief Computes the height of the current Triangle.
  *
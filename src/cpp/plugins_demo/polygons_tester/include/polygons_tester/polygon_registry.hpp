@@ -0,0 +1,231 @@
+/**
+ * Cached registry of Polygon plugins.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 30, 2022
+ */
+
+#ifndef POLYGONS_TESTER__POLYGON_REGISTRY_HPP_
+#define POLYGONS_TESTER__POLYGON_REGISTRY_HPP_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <class_loader/class_loader_core.hpp>
+#include <pluginlib/class_loader.hpp>
+#include <polygon_base/polygon.hpp>
+
+namespace PolygonsTester
+{
+
+/**
+ * Registry of all the Polygon plugins declared in the workspace.
+ *
+ * Libraries are loaded once, upon construction, and stay loaded until the
+ * registry is destroyed. The factory of each class is resolved then, so that
+ * creating an instance is just a call to new, which is skipped altogether when
+ * a released instance of the same class can be reused.
+ *
+ * Recycled instances keep their previous state, so they must be initialized
+ * again, as pluginlib requires anyway. All instances must be released before
+ * the registry is destroyed, since that unloads the libraries they come from.
+ */
+class PolygonRegistry
+{
+  struct Pool;
+
+public:
+  /**
+   * Returns released instances to their pool instead of deleting them.
+   */
+  struct Recycler
+  {
+    Pool * pool = nullptr;
+
+    void operator()(PolygonBase::Polygon * polygon) const
+    {
+      pool->release(polygon);
+    }
+  };
+
+  using Instance = std::unique_ptr<PolygonBase::Polygon, Recycler>;
+
+  /**
+   * Creates instances of a single class, without any lookup.
+   */
+  class Factory
+  {
+  public:
+    Factory() = default;
+
+    /**
+     * @brief Creates an instance, or reuses a released one.
+     *
+     * @return New instance.
+     */
+    Instance create() const
+    {
+      return Instance(pool_->acquire(), Recycler{pool_});
+    }
+
+    explicit operator bool() const
+    {
+      return pool_ != nullptr;
+    }
+
+  private:
+    friend class PolygonRegistry;
+
+    explicit Factory(Pool * pool)
+    : pool_(pool)
+    {}
+
+    Pool * pool_ = nullptr;
+  };
+
+  /**
+   * @brief Loads all declared Polygon plugins.
+   *
+   * @throws PluginlibException if a library cannot be loaded.
+   */
+  PolygonRegistry()
+  : loader_("polygon_base", "PolygonBase::Polygon")
+  {
+    for (const std::string & lookup_name : loader_.getDeclaredClasses()) {
+      loader_.loadLibraryForClass(lookup_name);
+
+      //! Factories are registered by class_loader as its libraries are opened,
+      //! under the derived type name listed in plugins.xml
+      std::lock_guard<std::recursive_mutex> lock(
+        class_loader::impl::getPluginBaseToFactoryMapMapMutex());
+      class_loader::impl::FactoryMap & factories =
+        class_loader::impl::getFactoryMapForBaseClass<PolygonBase::Polygon>();
+      auto it = factories.find(loader_.getClassType(lookup_name));
+      auto meta = it != factories.end() ?
+        dynamic_cast<class_loader::impl::AbstractMetaObject<PolygonBase::Polygon> *>(it->second) :
+        nullptr;
+      if (meta == nullptr) {
+        throw pluginlib::CreateClassException(
+                "PolygonRegistry: no factory for " + lookup_name);
+      }
+      pools_.emplace(lookup_name, std::make_unique<Pool>(meta));
+    }
+  }
+
+  PolygonRegistry(const PolygonRegistry &) = delete;
+  PolygonRegistry & operator=(const PolygonRegistry &) = delete;
+
+  /**
+   * @brief Returns the factory of a class, to be stored and used in hot paths.
+   *
+   * @param lookup_name Class name, as in plugins.xml.
+   * @return Class factory.
+   *
+   * @throws CreateClassException if the class is not declared.
+   */
+  Factory get_factory(const std::string & lookup_name) const
+  {
+    auto it = pools_.find(lookup_name);
+    if (it == pools_.end()) {
+      throw pluginlib::CreateClassException(
+              "PolygonRegistry: " + lookup_name + " is not a declared Polygon");
+    }
+    return Factory(it->second.get());
+  }
+
+  /**
+   * @brief Creates an instance of a class.
+   *
+   * @param lookup_name Class name, as in plugins.xml.
+   * @return New instance.
+   *
+   * @throws CreateClassException if the class is not declared.
+   */
+  Instance create(const std::string & lookup_name) const
+  {
+    return get_factory(lookup_name).create();
+  }
+
+  /**
+   * @brief Preallocates instances of a class, to make later creations cheaper.
+   *
+   * @param lookup_name Class name, as in plugins.xml.
+   * @param count Number of instances.
+   */
+  void reserve(const std::string & lookup_name, size_t count)
+  {
+    std::vector<Instance> instances;
+    instances.reserve(count);
+    Factory factory = get_factory(lookup_name);
+    for (size_t i = 0; i < count; i++) {
+      instances.push_back(factory.create());
+    }
+  }
+
+  /**
+   * @brief Returns the names of the available classes.
+   *
+   * @return Class names, as in plugins.xml.
+   */
+  std::vector<std::string> get_classes() const
+  {
+    std::vector<std::string> classes;
+    for (const auto & pool : pools_) {
+      classes.push_back(pool.first);
+    }
+    return classes;
+  }
+
+private:
+  /**
+   * Factory and released instances of a single class.
+   */
+  struct Pool
+  {
+    explicit Pool(const class_loader::impl::AbstractMetaObject<PolygonBase::Polygon> * meta)
+    : factory(meta)
+    {}
+
+    ~Pool()
+    {
+      for (PolygonBase::Polygon * polygon : free) {
+        delete polygon;
+      }
+    }
+
+    PolygonBase::Polygon * acquire()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!free.empty()) {
+          PolygonBase::Polygon * polygon = free.back();
+          free.pop_back();
+          return polygon;
+        }
+      }
+      return factory->create();
+    }
+
+    void release(PolygonBase::Polygon * polygon)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      free.push_back(polygon);
+    }
+
+    const class_loader::impl::AbstractMetaObject<PolygonBase::Polygon> * factory;
+    std::vector<PolygonBase::Polygon *> free;
+    std::mutex mtx;
+  };
+
+  //! The loader must outlive the pools, which delete objects from its libraries
+  pluginlib::ClassLoader<PolygonBase::Polygon> loader_;
+  std::map<std::string, std::unique_ptr<Pool>> pools_;
+};
+
+}  // namespace PolygonsTester
+
+#endif  // POLYGONS_TESTER__POLYGON_REGISTRY_HPP_
@@ -6,12 +6,18 @@
  * January 29, 2022
  */
 
+#include <chrono>
 #include <iostream>
+#include <vector>
 
 //! Include pluginlib headers and base class header
 #include <pluginlib/class_loader.hpp>
 #include <polygon_base/polygon.hpp>
 
+#include <polygons_tester/polygon_registry.hpp>
+
+#define INSTANCES 1000
+
 #define UNUSED(arg) (void)(arg)
 
 int main(int argc, char ** argv)
@@ -38,6 +44,63 @@ int main(int argc, char ** argv)
     square->init(10.0);
     std::cout << "Triangle area: " << triangle->area() << std::endl;
     std::cout << "Square area: " << square->area() << std::endl;
+
+    //! When many instances are needed, going through the loader every time is
+    //! expensive: the registry resolves each factory once and recycles objects
+    PolygonsTester::PolygonRegistry registry;
+    PolygonsTester::PolygonRegistry::Factory square_factory = registry.get_factory("Polygons::Square");
+
+    std::vector<std::shared_ptr<PolygonBase::Polygon>> loaded;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < INSTANCES; i++) {
+      loaded.push_back(loader.createSharedInstance("Polygons::Square"));
+    }
+    auto loader_time = std::chrono::steady_clock::now() - start;
+    loaded.clear();
+
+    std::vector<PolygonsTester::PolygonRegistry::Instance> cached;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < INSTANCES; i++) {
+      cached.push_back(square_factory.create());
+      cached.back()->init(double(i));
+    }
+    auto registry_time = std::chrono::steady_clock::now() - start;
+
+    //! Released instances go back to the pool, and are reused from then on
+    cached.clear();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < INSTANCES; i++) {
+      cached.push_back(square_factory.create());
+      cached.back()->init(double(i));
+    }
+    auto pool_time = std::chrono::steady_clock::now() - start;
+    cached.clear();
+
+    auto us = [](std::chrono::steady_clock::duration d) -> long {
+        return long(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+      };
+    std::cout << INSTANCES << " squares from the loader: " << us(loader_time) << " us" << std::endl;
+    std::cout << INSTANCES << " squares from the registry: " << us(registry_time) << " us" << std::endl;
+    std::cout << INSTANCES << " squares from the pool: " << us(pool_time) << " us" << std::endl;
+
+    //! To evaluate many polygons of the same kind, cross the plugin boundary
+    //! once: batch calls process whole arrays with vectorized loops
+    std::vector<double> sides(INSTANCES), areas(INSTANCES);
+    for (int i = 0; i < INSTANCES; i++) {
+      sides[i] = double(i);
+    }
+    start = std::chrono::steady_clock::now();
+    double total = 0.0;
+    for (int i = 0; i < INSTANCES; i++) {
+      square->init(sides[i]);
+      total += square->area();
+    }
+    auto single_time = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    square->area_batch(sides.data(), areas.data(), sides.size());
+    auto batch_time = std::chrono::steady_clock::now() - start;
+    std::cout << INSTANCES << " square areas one by one: " << us(single_time) << " us (total " << total << ")" << std::endl;
+    std::cout << INSTANCES << " square areas in a batch: " << us(batch_time) << " us (last " << areas.back() << ")" << std::endl;
   }
   catch(const pluginlib::PluginlibException & e)
   {
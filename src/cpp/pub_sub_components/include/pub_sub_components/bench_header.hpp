@@ -0,0 +1,154 @@
+/**
+ * Benchmark header embedded in message payloads.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#ifndef BENCH_HEADER_HPP
+#define BENCH_HEADER_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <ros2_examples_interfaces/msg/bounded4m.hpp>
+#include <ros2_examples_interfaces/msg/bounded64k.hpp>
+#include <ros2_examples_interfaces/msg/fixed1k.hpp>
+#include <ros2_examples_interfaces/msg/fixed1m.hpp>
+#include <ros2_examples_interfaces/msg/fixed4m.hpp>
+#include <ros2_examples_interfaces/msg/fixed64k.hpp>
+
+namespace pub_sub_components
+{
+
+/**
+ * Written by the publisher at the beginning of each benchmark payload.
+ *
+ * The address of the buffer that the publisher filled tells the subscriber
+ * whether what it got is that same buffer or a copy of it.
+ */
+struct BenchHeader
+{
+  int64_t stamp;      // Publication time, steady clock [ns]
+  uint64_t buffer;    // Address of the publisher buffer
+};
+
+/**
+ * @brief Returns the current steady clock time.
+ *
+ * @return Current time [ns].
+ */
+inline int64_t bench_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Stamps a payload right before its publication.
+ *
+ * @param data Payload, at least as large as the header.
+ */
+inline void write_bench_header(std::string & data)
+{
+  BenchHeader header{bench_now(), reinterpret_cast<uint64_t>(data.data())};
+  std::memcpy(&data[0], &header, sizeof(header));
+}
+
+/**
+ * @brief Reads the header of a payload.
+ *
+ * @param data Payload.
+ * @param header Header read.
+ * @return False if the payload is too short to have one.
+ */
+inline bool read_bench_header(const std::string & data, BenchHeader & header)
+{
+  if (data.size() < sizeof(BenchHeader)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  return true;
+}
+
+/* Selects a benchmark message type in generic lambdas. */
+template<typename MsgT>
+struct BenchType
+{
+  using type = MsgT;
+};
+
+/**
+ * @brief Calls a generic lambda with the benchmark message type of the given name.
+ *
+ * Fixed-size types can be loaned by zero-copy middlewares, bounded ones need
+ * a middleware that supports them, strings always go through serialization.
+ *
+ * @param name Type name: fixed_1k, fixed_64k, fixed_1m, fixed_4m, bounded_64k or bounded_4m.
+ * @param visitor Called with a BenchType<MsgT> argument.
+ * @return False if the name is unknown.
+ */
+template<typename VisitorT>
+bool visit_bench_type(const std::string & name, VisitorT && visitor)
+{
+  using namespace ros2_examples_interfaces::msg;
+  if (name == "fixed_1k") {
+    visitor(BenchType<Fixed1k>{});
+  } else if (name == "fixed_64k") {
+    visitor(BenchType<Fixed64k>{});
+  } else if (name == "fixed_1m") {
+    visitor(BenchType<Fixed1m>{});
+  } else if (name == "fixed_4m") {
+    visitor(BenchType<Fixed4m>{});
+  } else if (name == "bounded_64k") {
+    visitor(BenchType<Bounded64k>{});
+  } else if (name == "bounded_4m") {
+    visitor(BenchType<Bounded4m>{});
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Sizes a fixed payload: nothing to do.
+ */
+template<size_t N>
+inline void resize_bench_payload(std::array<uint8_t, N> &, size_t)
+{}
+
+/**
+ * @brief Sizes a bounded payload, up to its bound.
+ *
+ * @param data Payload.
+ * @param size Requested size [bytes].
+ */
+template<typename VectorT>
+inline void resize_bench_payload(VectorT & data, size_t size)
+{
+  data.resize(std::min(size, size_t(data.max_size())));
+}
+
+/**
+ * @brief Prepares a typed benchmark message right before its publication.
+ *
+ * @param msg Message to fill.
+ * @param seq Sequence number.
+ * @param size Payload size, for bounded types [bytes].
+ */
+template<typename MsgT>
+inline void fill_bench_message(MsgT & msg, uint64_t seq, size_t size)
+{
+  resize_bench_payload(msg.data, size);
+  msg.header.seq = seq;
+  msg.header.stamp = bench_now();
+}
+
+} // namespace pub_sub_components
+
+#endif
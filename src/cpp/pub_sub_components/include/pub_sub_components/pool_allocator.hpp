@@ -0,0 +1,130 @@
+/**
+ * Pooled allocator for messages and rclcpp internals, and allocation counters.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#ifndef POOL_ALLOCATOR_HPP
+#define POOL_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace pub_sub_components
+{
+
+/**
+ * Process-wide arena of fixed-size blocks, in power-of-two size classes.
+ *
+ * Blocks come from the heap only the first time each is needed, then are
+ * recycled through per-class free lists: once the working set is warm, the
+ * steady-state path never calls malloc. Requests too large for any class go
+ * to the heap every time, and are counted.
+ */
+class BlockArena
+{
+public:
+  static constexpr size_t min_block = 64;
+  static constexpr unsigned int classes = 20; // Up to 32 MiB blocks
+
+  static BlockArena & instance();
+
+  void * allocate(size_t size);
+  void deallocate(void * ptr, size_t size);
+
+  /**
+   * @brief Returns the number of blocks taken from the heap so far.
+   */
+  uint64_t grown() const
+  {
+    return grown_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of requests too large for the arena so far.
+   */
+  uint64_t oversized() const
+  {
+    return oversized_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct FreeBlock
+  {
+    FreeBlock * next;
+  };
+
+  BlockArena() = default;
+  static unsigned int size_class(size_t size);
+
+  std::mutex lock_;
+  FreeBlock * free_[classes] = {};
+  std::atomic<uint64_t> grown_{0};
+  std::atomic<uint64_t> oversized_{0};
+};
+
+/**
+ * Standard allocator on the block arena, to pass to rclcpp via publisher and
+ * subscription options, message memory strategies and executor memory strategies.
+ */
+template<typename T>
+struct PoolAllocator
+{
+  using value_type = T;
+
+  PoolAllocator() noexcept = default;
+
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+  T * allocate(size_t n)
+  {
+    return static_cast<T *>(BlockArena::instance().allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T * ptr, size_t n)
+  {
+    BlockArena::instance().deallocate(ptr, n * sizeof(T));
+  }
+
+  template<typename U>
+  struct rebind
+  {
+    using other = PoolAllocator<U>;
+  };
+};
+
+template<typename T, typename U>
+constexpr bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) noexcept
+{
+  return true;
+}
+
+template<typename T, typename U>
+constexpr bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) noexcept
+{
+  return false;
+}
+
+/**
+ * Process-wide heap allocation counters.
+ *
+ * They are updated only by the operator new replacement that the executables
+ * of this package link, alloc_counter.cpp: in other processes, tracking stays
+ * off and counts are meaningless.
+ */
+struct AllocationStats
+{
+  std::atomic<uint64_t> heap_allocations{0};
+  std::atomic<bool> tracking{false};
+};
+
+AllocationStats & allocation_stats();
+
+} // namespace pub_sub_components
+
+#endif
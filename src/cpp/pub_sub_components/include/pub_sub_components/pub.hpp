@@ -9,10 +9,16 @@
 #ifndef PUB_HPP
 #define PUB_HPP
 
+#include <functional>
+#include <string>
+
 #include <rclcpp/rclcpp.hpp>
 
 #include <std_msgs/msg/string.hpp>
 
+#include <pub_sub_components/bench_header.hpp>
+#include <pub_sub_components/pool_allocator.hpp>
+
 #define PUB_PERIOD 300 // Publisher transmission time period [ms]
 
 //! There has to be a namespace when declaring a component class,
@@ -36,6 +42,28 @@ private:
   rclcpp::TimerBase::SharedPtr pub_timer_;
   void pub_timer_callback(void);
 
+  //! Benchmark mode: large payloads, published either by reference, thus
+  //! copied for intra-process subscribers, or moved as unique pointers
+  void bench_timer_callback(void);
+  std_msgs::msg::String bench_msg_; // Reused when publishing by reference
+
+  //! Typed benchmark messages, from ros2_examples_interfaces
+  rclcpp::PublisherBase::SharedPtr typed_publisher_;
+  std::function<void()> typed_publish_;
+  template<typename MsgT>
+  void init_typed_publisher(const std::string & topic);
+  bool zero_copy_;
+  int64_t payload_size_;
+
+  //! Pooled allocator mode: messages and rclcpp internals come from the block
+  //! arena, and heap allocations per message are reported
+  template<typename MsgT>
+  void init_pooled_publisher(const std::string & topic);
+  bool pool_allocator_;
+  uint64_t bench_allocs_ = 0;
+  uint64_t bench_msgs_ = 0;
+  int64_t bench_report_time_ = 0; // [ns]
+
   unsigned long pub_cnt_; // Marks messages
 };
 
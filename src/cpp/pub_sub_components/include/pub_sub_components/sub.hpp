@@ -9,10 +9,15 @@
 #ifndef SUB_HPP
 #define SUB_HPP
 
+#include <string>
+
 #include <rclcpp/rclcpp.hpp>
 
 #include <std_msgs/msg/string.hpp>
 
+#include <pub_sub_components/bench_header.hpp>
+#include <pub_sub_components/pool_allocator.hpp>
+
 //! There has to be a namespace when declaring a component class,
 //! in order to avoid plugin name clashes with other components.
 //! The name of the namespace should be the name of the package.
@@ -31,6 +36,34 @@ public:
 private:
   rclcpp::Subscription<std_msgs::msg::String>::SharedPtr subscriber_;
   void msg_callback(const std_msgs::msg::String::SharedPtr msg);
+
+  //! Benchmark mode: measures latency and whether each message was copied
+  //! The UniquePtr callback lets intra-process comms move messages here
+  void bench_shared_callback(const std_msgs::msg::String::SharedPtr msg);
+  void bench_unique_callback(std_msgs::msg::String::UniquePtr msg);
+  void bench_record(const std_msgs::msg::String & msg);
+  void bench_report_callback(void);
+  rclcpp::TimerBase::SharedPtr report_timer_;
+  uint64_t bench_msgs_ = 0;
+  uint64_t bench_copied_ = 0;
+  int64_t bench_latency_sum_ = 0; // [ns]
+  int64_t bench_latency_max_ = 0; // [ns]
+
+  //! Typed benchmark messages, from ros2_examples_interfaces
+  rclcpp::SubscriptionBase::SharedPtr typed_subscriber_;
+  template<typename MsgT>
+  void init_typed_subscriber(const std::string & topic, bool zero_copy);
+  template<typename MsgT>
+  void init_pooled_subscriber(const std::string & topic, bool zero_copy);
+  void bench_record_typed(uint64_t seq, int64_t stamp, size_t size);
+  bool typed_ = false;
+  uint64_t bench_bytes_ = 0;
+  uint64_t bench_lost_ = 0;
+  uint64_t bench_next_seq_ = 0;
+
+  //! Pooled allocator mode: heap allocations of the whole process are reported
+  bool pool_allocator_ = false;
+  uint64_t bench_allocs_start_ = 0;
 };
 
 } // namespace pub_sub_components
@@ -0,0 +1,73 @@
+"""
+Intra-process zero-copy benchmark launch file.
+
+Roberto Masocco <robmasocco@gmail.com>
+
+May 23, 2024
+"""
+
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument
+from launch.substitutions import LaunchConfiguration, PythonExpression
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+from launch_ros.parameter_descriptions import ParameterValue
+
+
+def generate_launch_description():
+    """Builds a LaunchDescription for the zero-copy benchmark, in a single container."""
+    ld = LaunchDescription()
+
+    #! Run with zero_copy:=false, then zero_copy:=true, and compare the reports.
+    ld.add_action(DeclareLaunchArgument('zero_copy', default_value='true'))
+    ld.add_action(DeclareLaunchArgument('payload_size', default_value='1048576'))
+    ld.add_action(DeclareLaunchArgument('period', default_value='10'))
+    #! string, or a fixed/bounded type: fixed_1k, fixed_64k, fixed_1m, fixed_4m, bounded_64k, bounded_4m
+    ld.add_action(DeclareLaunchArgument('message_type', default_value='string'))
+    #! With a fixed or bounded message_type, allocates from a block arena and
+    #! reports heap allocations per message, in a container that counts them
+    ld.add_action(DeclareLaunchArgument('pool_allocator', default_value='false'))
+
+    bench_params = {
+        'benchmark': True,
+        'zero_copy': ParameterValue(LaunchConfiguration('zero_copy'), value_type=bool),
+        'message_type': LaunchConfiguration('message_type'),
+        'pool_allocator': ParameterValue(LaunchConfiguration('pool_allocator'), value_type=bool)}
+
+    container = ComposableNodeContainer(
+        name='zero_copy_container',
+        namespace='pub_sub_components',
+        package=PythonExpression([
+            "'pub_sub_components' if '", LaunchConfiguration('pool_allocator'),
+            "'.lower() == 'true' else 'rclcpp_components'"]),
+        executable=PythonExpression([
+            "'alloc_container' if '", LaunchConfiguration('pool_allocator'),
+            "'.lower() == 'true' else 'component_container'"]),
+        emulate_tty=True,
+        output='both',
+        log_cmd=True,
+        composable_node_descriptions=[
+            ComposableNode(
+                package='pub_sub_components',
+                plugin='pub_sub_components::Publisher',
+                name='publisher_node',
+                namespace='pub_sub_components',
+                parameters=[
+                    bench_params,
+                    {'payload_size': ParameterValue(
+                        LaunchConfiguration('payload_size'), value_type=int),
+                     'period': ParameterValue(
+                        LaunchConfiguration('period'), value_type=int)}],
+                extra_arguments=[{'use_intra_process_comms': True}]),
+            ComposableNode(
+                package='pub_sub_components',
+                plugin='pub_sub_components::Subscriber',
+                name='subscriber_node',
+                namespace='pub_sub_components',
+                parameters=[bench_params],
+                extra_arguments=[{'use_intra_process_comms': True}])
+        ]
+    )
+    ld.add_action(container)
+
+    return ld
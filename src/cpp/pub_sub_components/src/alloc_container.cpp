@@ -0,0 +1,36 @@
+/**
+ * Component container that counts heap allocations.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#include <memory>
+
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp/strategies/allocator_memory_strategy.hpp>
+#include <rclcpp_components/component_manager.hpp>
+
+#include <pub_sub_components/pool_allocator.hpp>
+
+//! Same as rclcpp_components' component_container, but linked with the
+//! operator new replacement in alloc_counter.cpp, so that components loaded
+//! here can report allocations, and with an executor memory strategy on the
+//! block arena, so that the executor itself does not allocate from the heap.
+int main(int argc, char ** argv)
+{
+  using pub_sub_components::PoolAllocator;
+  using rclcpp::memory_strategies::allocator_memory_strategy::AllocatorMemoryStrategy;
+
+  rclcpp::init(argc, argv);
+  rclcpp::ExecutorOptions exec_opts;
+  exec_opts.memory_strategy = std::make_shared<AllocatorMemoryStrategy<PoolAllocator<void>>>(
+    std::make_shared<PoolAllocator<void>>());
+  auto exec = std::make_shared<rclcpp::executors::SingleThreadedExecutor>(exec_opts);
+  auto manager = std::make_shared<rclcpp_components::ComponentManager>(exec);
+  exec->add_node(manager);
+  exec->spin();
+  rclcpp::shutdown();
+  exit(EXIT_SUCCESS);
+}
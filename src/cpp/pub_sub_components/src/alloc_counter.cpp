@@ -0,0 +1,123 @@
+/**
+ * Counting replacement of the global operator new, for executables only.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include <pub_sub_components/pool_allocator.hpp>
+
+//! Replacements defined in an executable take over in the whole process,
+//! shared libraries included: every heap allocation done with new, by rclcpp,
+//! the STL or our nodes, is counted. The middleware may call malloc directly,
+//! which goes unnoticed.
+
+namespace
+{
+
+/* Enables tracking as soon as the process starts. */
+struct TrackingEnabler
+{
+  TrackingEnabler()
+  {
+    pub_sub_components::allocation_stats().tracking.store(true, std::memory_order_relaxed);
+  }
+} tracking_enabler;
+
+void * counted_alloc(std::size_t size)
+{
+  pub_sub_components::allocation_stats().heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void * counted_aligned_alloc(std::size_t size, std::align_val_t align)
+{
+  pub_sub_components::allocation_stats().heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  std::size_t alignment = std::size_t(align);
+  std::size_t rounded = (size + alignment - 1) / alignment * alignment;
+  return std::aligned_alloc(alignment, rounded == 0 ? alignment : rounded);
+}
+
+} // namespace
+
+void * operator new(std::size_t size)
+{
+  void * ptr = counted_alloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void * operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return counted_alloc(size);
+}
+
+void * operator new(std::size_t size, std::align_val_t align)
+{
+  void * ptr = counted_aligned_alloc(size, align);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void * operator new[](std::size_t size, std::align_val_t align)
+{
+  return operator new(size, align);
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
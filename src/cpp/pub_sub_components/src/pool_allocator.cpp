@@ -0,0 +1,100 @@
+/**
+ * Pooled allocator for messages and rclcpp internals, and allocation counters.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * May 23, 2024
+ */
+
+#include <new>
+
+#include <pub_sub_components/pool_allocator.hpp>
+
+namespace pub_sub_components
+{
+
+/**
+ * @brief Returns the arena shared by the whole process.
+ */
+BlockArena & BlockArena::instance()
+{
+  static BlockArena arena;
+  return arena;
+}
+
+/**
+ * @brief Returns the size class that fits a request.
+ *
+ * @param size Request size [bytes].
+ * @return Size class index, equal to classes if none fits.
+ */
+unsigned int BlockArena::size_class(size_t size)
+{
+  unsigned int index = 0;
+  size_t block = min_block;
+  while (block < size && index < classes) {
+    block <<= 1;
+    index++;
+  }
+  return index;
+}
+
+/**
+ * @brief Allocates a block from the arena.
+ *
+ * @param size Request size [bytes].
+ * @return Pointer to a block at least as large as requested.
+ *
+ * @throws std::bad_alloc
+ */
+void * BlockArena::allocate(size_t size)
+{
+  unsigned int index = size_class(size);
+  if (index == classes) {
+    oversized_.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    FreeBlock * block = free_[index];
+    if (block != nullptr) {
+      free_[index] = block->next;
+      return block;
+    }
+  }
+  grown_.fetch_add(1, std::memory_order_relaxed);
+  return ::operator new(min_block << index);
+}
+
+/**
+ * @brief Returns a block to the arena, that keeps it for later requests.
+ *
+ * @param ptr Block to release.
+ * @param size Size it was requested with [bytes].
+ */
+void BlockArena::deallocate(void * ptr, size_t size)
+{
+  if (ptr == nullptr) {
+    return;
+  }
+  unsigned int index = size_class(size);
+  if (index == classes) {
+    ::operator delete(ptr);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  FreeBlock * block = static_cast<FreeBlock *>(ptr);
+  block->next = free_[index];
+  free_[index] = block;
+}
+
+/**
+ * @brief Returns the heap allocation counters of this process.
+ */
+AllocationStats & allocation_stats()
+{
+  static AllocationStats stats;
+  return stats;
+}
+
+} // namespace pub_sub_components
@@ -6,6 +6,9 @@
  * May 23, 2024
  */
 
+#include <memory>
+#include <stdexcept>
+
 #include <pub_sub_components/pub.hpp>
 
 //! There has to be a namespace when declaring a component class,
@@ -21,15 +24,65 @@ Publisher::Publisher(const rclcpp::NodeOptions & node_opts)
 : Node("publisher_node", node_opts),
   pub_cnt_(0)
 {
+  //! Benchmark mode needs use_intra_process_comms, and the subscriber in the
+  //! same container, to show any difference
+  bool benchmark = this->declare_parameter("benchmark", false);
+  zero_copy_ = this->declare_parameter("zero_copy", false);
+  payload_size_ = this->declare_parameter("payload_size", int64_t(1024 * 1024));
+  int64_t period = this->declare_parameter("period", int64_t(PUB_PERIOD));
+  std::string message_type = this->declare_parameter("message_type", std::string("string"));
+  pool_allocator_ = this->declare_parameter("pool_allocator", false);
+  if (payload_size_ < int64_t(sizeof(BenchHeader))) {
+    payload_size_ = int64_t(sizeof(BenchHeader));
+  }
+  if (period < 1) {
+    period = 1;
+  }
+
   publisher_ = this->create_publisher<std_msgs::msg::String>(
     "/examples/test_topic",
     rclcpp::QoS(10));
 
-  pub_timer_ = this->create_wall_timer(
-    std::chrono::milliseconds(PUB_PERIOD),
-    std::bind(
-      &Publisher::pub_timer_callback,
-      this));
+  if (!benchmark) {
+    pub_timer_ = this->create_wall_timer(
+      std::chrono::milliseconds(period),
+      std::bind(
+        &Publisher::pub_timer_callback,
+        this));
+  } else {
+    if (message_type != "string") {
+      //! Each type gets its own topic, named after it
+      bool known = visit_bench_type(
+        message_type,
+        [this, &message_type](auto type) {
+          init_typed_publisher<typename decltype(type)::type>(
+            "/examples/bench/" + message_type);
+        });
+      if (!known) {
+        throw std::invalid_argument("Unknown message_type: " + message_type);
+      }
+    } else if (pool_allocator_) {
+      //! String payloads always come from the heap, whatever the allocator
+      RCLCPP_WARN(
+        this->get_logger(),
+        "pool_allocator requires a fixed or bounded message_type, ignored");
+      pool_allocator_ = false;
+    }
+    bench_msg_.data.resize(size_t(payload_size_));
+    pub_timer_ = this->create_wall_timer(
+      std::chrono::milliseconds(period),
+      std::bind(
+        &Publisher::bench_timer_callback,
+        this));
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Benchmark mode: %s, %ld bytes every %ld ms, %s, intra-process comms %s",
+      message_type.c_str(),
+      payload_size_,
+      period,
+      zero_copy_ ? "unique_ptr" : "by reference",
+      this->get_node_options().use_intra_process_comms() ? "on" : "off");
+  }
 
   RCLCPP_INFO(this->get_logger(), "Publisher initialized");
 }
@@ -54,6 +107,133 @@ void Publisher::pub_timer_callback(void)
   RCLCPP_INFO(this->get_logger(), "Published message %lu", pub_cnt_);
 }
 
+/**
+ * @brief Creates the publisher of a typed benchmark message, and its publishing routine.
+ *
+ * Loaned messages are used if the middleware supports them for this type,
+ * which is the only way to avoid serialization between processes.
+ *
+ * @param topic Topic name.
+ */
+template<typename MsgT>
+void Publisher::init_typed_publisher(const std::string & topic)
+{
+  if (pool_allocator_) {
+    init_pooled_publisher<MsgT>(topic);
+    return;
+  }
+  auto publisher = this->create_publisher<MsgT>(topic, rclcpp::QoS(10));
+  auto reused_msg = std::make_shared<MsgT>();
+  typed_publisher_ = publisher;
+  typed_publish_ = [this, publisher, reused_msg]() {
+      if (publisher->can_loan_messages()) {
+        auto loaned_msg = publisher->borrow_loaned_message();
+        fill_bench_message(loaned_msg.get(), pub_cnt_, size_t(payload_size_));
+        publisher->publish(std::move(loaned_msg));
+      } else if (zero_copy_) {
+        auto new_msg = std::make_unique<MsgT>();
+        fill_bench_message(*new_msg, pub_cnt_, size_t(payload_size_));
+        publisher->publish(std::move(new_msg));
+      } else {
+        fill_bench_message(*reused_msg, pub_cnt_, size_t(payload_size_));
+        publisher->publish(*reused_msg);
+      }
+    };
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Publishing on %s, loaned messages %s",
+    topic.c_str(),
+    publisher->can_loan_messages() ? "available" : "not available");
+}
+
+/**
+ * @brief Creates the publisher of a typed benchmark message on the block arena.
+ *
+ * The publisher, its intra-process buffers and the messages published as unique
+ * pointers are allocated through the pooled allocator, as in the rclcpp
+ * allocator tutorial. Only fixed-size messages make the whole path allocation-free:
+ * bounded sequences still grow on the heap.
+ *
+ * @param topic Topic name.
+ */
+template<typename MsgT>
+void Publisher::init_pooled_publisher(const std::string & topic)
+{
+  using Alloc = PoolAllocator<void>;
+  using MessageAllocTraits = rclcpp::allocator::AllocRebind<MsgT, Alloc>;
+  using MessageAlloc = typename MessageAllocTraits::allocator_type;
+  using MessageDeleter = rclcpp::allocator::Deleter<MessageAlloc, MsgT>;
+
+  auto allocator = std::make_shared<Alloc>();
+  rclcpp::PublisherOptionsWithAllocator<Alloc> options;
+  options.allocator = allocator;
+  auto publisher = this->create_publisher<MsgT, Alloc>(topic, rclcpp::QoS(10), options);
+  auto message_alloc = std::make_shared<MessageAlloc>(*allocator);
+  auto reused_msg = std::allocate_shared<MsgT>(*message_alloc);
+  typed_publisher_ = publisher;
+  typed_publish_ = [this, publisher, message_alloc, reused_msg]() {
+      if (zero_copy_) {
+        MessageDeleter deleter;
+        rclcpp::allocator::set_allocator_for_deleter(&deleter, message_alloc.get());
+        MsgT * ptr = MessageAllocTraits::allocate(*message_alloc, 1);
+        MessageAllocTraits::construct(*message_alloc, ptr);
+        std::unique_ptr<MsgT, MessageDeleter> new_msg(ptr, deleter);
+        fill_bench_message(*new_msg, pub_cnt_, size_t(payload_size_));
+        publisher->publish(std::move(new_msg));
+      } else {
+        fill_bench_message(*reused_msg, pub_cnt_, size_t(payload_size_));
+        publisher->publish(*reused_msg);
+      }
+    };
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Publishing on %s, pooled allocator, heap allocations %s",
+    topic.c_str(),
+    allocation_stats().tracking.load() ? "tracked" : "not tracked (run in alloc_container)");
+}
+
+/**
+ * @brief Publishes a benchmark payload on timer occurrence.
+ */
+void Publisher::bench_timer_callback(void)
+{
+  uint64_t allocs = allocation_stats().heap_allocations.load(std::memory_order_relaxed);
+  if (typed_publish_) {
+    typed_publish_();
+  } else if (zero_copy_) {
+    //! A new message every time, since its ownership goes to the subscriber
+    auto new_msg = std::make_unique<std_msgs::msg::String>();
+    new_msg->data.resize(size_t(payload_size_));
+    write_bench_header(new_msg->data);
+    publisher_->publish(std::move(new_msg));
+  } else {
+    //! The middleware keeps its own copy, so the same message can be reused
+    write_bench_header(bench_msg_.data);
+    publisher_->publish(bench_msg_);
+  }
+  pub_cnt_++;
+
+  //! Heap allocations made while publishing, by the whole process
+  if (!pool_allocator_) {
+    return;
+  }
+  bench_allocs_ += allocation_stats().heap_allocations.load(std::memory_order_relaxed) - allocs;
+  bench_msgs_++;
+  int64_t now = bench_now();
+  if (now - bench_report_time_ >= 1000000000) {
+    RCLCPP_INFO(
+      this->get_logger(),
+      "%lu messages, heap allocations per publish: %.2f, arena blocks %lu, oversized %lu",
+      bench_msgs_,
+      double(bench_allocs_) / double(bench_msgs_),
+      BlockArena::instance().grown(),
+      BlockArena::instance().oversized());
+    bench_report_time_ = now;
+    bench_allocs_ = 0;
+    bench_msgs_ = 0;
+  }
+}
+
 } // namespace pub_sub_components
 
 //! Must do this at the end of one source file where your class definition is to generate the plugin.
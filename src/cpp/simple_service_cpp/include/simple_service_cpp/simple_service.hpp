@@ -9,9 +9,15 @@
 #ifndef SIMPLE_SERVICE_HPP
 #define SIMPLE_SERVICE_HPP
 
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <vector>
+
 #include <rclcpp/rclcpp.hpp>
 
 #include <ros2_examples_interfaces/srv/add_two_ints.hpp>
+#include <ros2_examples_interfaces/srv/add_two_ints_batch.hpp>
 //! ALWAYS INCLUDE THE INTERFACE .hpp HEADER!
 
 //! Let's make things a little bit simpler here
@@ -19,13 +25,25 @@ using namespace ros2_examples_interfaces::srv;
 
 /**
  * AddTwoInts server node.
+ *
+ * With threads > 1, requests are served in a reentrant callback group by a
+ * pool of that many threads, so a slow request doesn't hold back the others.
  */
 class AddTwoIntsServer : public rclcpp::Node
 {
 public:
   AddTwoIntsServer();
 
+  size_t get_threads() const;
+
 private:
+  //! Number of threads to serve requests with, and per-request logging
+  size_t threads_;
+  bool log_requests_;
+
+  //! Callbacks in a reentrant group can run concurrently, even with themselves
+  rclcpp::CallbackGroup::SharedPtr server_cgroup_;
+
   //! This object is a modified DDS endpoint that receives requests and,
   //! in addition, implements the ROS 2 server semantics to send responses
   //! The job to execute upon arrival must be coded in a related callback
@@ -39,6 +57,12 @@ private:
   void add_two_ints_clbk(
     const AddTwoInts::Request::SharedPtr request,
     const AddTwoInts::Response::SharedPtr response);
+
+  //! Batched version: many operations per round trip
+  rclcpp::Service<AddTwoIntsBatch>::SharedPtr batch_server_;
+  void add_two_ints_batch_clbk(
+    const AddTwoIntsBatch::Request::SharedPtr request,
+    const AddTwoIntsBatch::Response::SharedPtr response);
 };
 
 /**
@@ -51,6 +75,8 @@ public:
 
   //! This is just for us, not ROS-related, i.e. we could do without it (see below)
   void call_srv(int a, int b);
+  void call_batch_srv(const std::vector<int64_t> & a, const std::vector<int64_t> & b);
+  void run_pipeline(size_t depth, size_t requests);
 
 private:
   //! This object is a modified DDS endpoint that sends requests and,
@@ -58,6 +84,20 @@ private:
   //! The syntax is:
   //! rclcpp::Client<INTERFACE_TYPE>::SharedPtr OBJ;
   rclcpp::Client<AddTwoInts>::SharedPtr client_;
+  rclcpp::Client<AddTwoIntsBatch>::SharedPtr batch_client_;
+
+  //! Pipelined benchmark: requests to send, sent and answered, latencies [ns]
+  size_t pipeline_requests_ = 0;
+  size_t sent_ = 0;
+  size_t completed_ = 0;
+  size_t last_completed_ = 0;
+  std::vector<int64_t> latencies_;
+  std::chrono::steady_clock::time_point pipeline_start_;
+  std::promise<void> pipeline_done_;
+  rclcpp::TimerBase::SharedPtr report_timer_;
+
+  void send_pipelined();
+  void pipeline_report();
 };
 //! We could do without this: if our only intent is to call a ROS 2 service from an application,
 //! we could just create a node, a service client, and call the service synchronously from
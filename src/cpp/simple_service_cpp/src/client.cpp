@@ -6,8 +6,11 @@
  * November 22, 2021
  */
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <simple_service_cpp/simple_service.hpp>
 
@@ -23,6 +26,7 @@ AddTwoIntsClient::AddTwoIntsClient()
   //!   ...
   //! );
   client_ = this->create_client<AddTwoInts>("/examples/add_two_ints");
+  batch_client_ = this->create_client<AddTwoIntsBatch>("/examples/add_two_ints_batch");
 
   RCLCPP_INFO(this->get_logger(), "Client initialized");
 }
@@ -84,22 +88,196 @@ void AddTwoIntsClient::call_srv(
   }
 }
 
+/**
+ * @brief Calls the batched service with the given data, prints the response.
+ *
+ * @param a Requested a values.
+ * @param b Requested b values, one per a.
+ *
+ * @throws RuntimeError
+ */
+void AddTwoIntsClient::call_batch_srv(
+  const std::vector<int64_t> & a,
+  const std::vector<int64_t> & b)
+{
+  while (!batch_client_->wait_for_service(std::chrono::seconds(1))) {
+    if (!rclcpp::ok()) {
+      throw std::runtime_error("Middleware crashed while waiting for service");
+    }
+    RCLCPP_WARN(this->get_logger(), "Service not available");
+  }
+
+  //! All operations travel in a single request, and come back in a single response
+  auto request = std::make_shared<AddTwoIntsBatch::Request>();
+  request->set__a(a);
+  request->set__b(b);
+
+  auto response = batch_client_->async_send_request(request);
+  if (rclcpp::spin_until_future_complete(this->shared_from_this(), response) ==
+    rclcpp::FutureReturnCode::SUCCESS)
+  {
+    auto result = response.get();
+    if (!result->success) {
+      RCLCPP_ERROR(this->get_logger(), "Batch rejected");
+      return;
+    }
+    for (size_t i = 0; i < result->sum.size(); i++) {
+      RCLCPP_INFO(this->get_logger(), "Result %zu: %ld", i, result->sum[i]);
+    }
+  } else {
+    batch_client_->remove_pending_request(response);
+    RCLCPP_ERROR(this->get_logger(), "Service call failed");
+  }
+}
+
+/**
+ * @brief Benchmarks the service keeping many requests in flight.
+ *
+ * @param depth Number of requests in flight.
+ * @param requests Total number of requests to send.
+ *
+ * @throws RuntimeError
+ */
+void AddTwoIntsClient::run_pipeline(size_t depth, size_t requests)
+{
+  while (!client_->wait_for_service(std::chrono::seconds(1))) {
+    if (!rclcpp::ok()) {
+      throw std::runtime_error("Middleware crashed while waiting for service");
+    }
+    RCLCPP_WARN(this->get_logger(), "Service not available");
+  }
+
+  pipeline_requests_ = requests;
+  latencies_.reserve(requests);
+  report_timer_ = this->create_wall_timer(
+    std::chrono::seconds(1),
+    std::bind(&AddTwoIntsClient::pipeline_report, this));
+
+  //! Fill the pipeline: from now on, each response sends the next request
+  pipeline_start_ = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < depth && sent_ < pipeline_requests_; i++) {
+    send_pipelined();
+  }
+
+  //! Responses are handled by callbacks, so we spin only until the last one
+  std::shared_future<void> done = pipeline_done_.get_future().share();
+  if (rclcpp::spin_until_future_complete(this->shared_from_this(), done) !=
+    rclcpp::FutureReturnCode::SUCCESS)
+  {
+    RCLCPP_ERROR(this->get_logger(), "Benchmark interrupted");
+    return;
+  }
+  report_timer_->cancel();
+
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - pipeline_start_).count();
+  std::sort(latencies_.begin(), latencies_.end());
+  auto percentile = [this](size_t p) -> double {
+      return double(latencies_[std::min(latencies_.size() - 1, latencies_.size() * p / 100)]) *
+             1e-3;
+    };
+  RCLCPP_INFO(
+    this->get_logger(),
+    "%zu requests, depth %zu: %.1f RPS, latency p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+    "max %.1f us",
+    completed_,
+    depth,
+    double(completed_) / elapsed,
+    percentile(50),
+    percentile(90),
+    percentile(99),
+    double(latencies_.back()) * 1e-3);
+}
+
+/**
+ * @brief Sends the next benchmark request.
+ */
+void AddTwoIntsClient::send_pipelined()
+{
+  auto request = std::make_shared<AddTwoInts::Request>();
+  request->set__a(int64_t(sent_));
+  request->set__b(1);
+  sent_++;
+
+  //! The response callback runs in the executor, with no need to wait on the future
+  auto sent_time = std::chrono::steady_clock::now();
+  client_->async_send_request(
+    request,
+    [this, sent_time](rclcpp::Client<AddTwoInts>::SharedFuture) -> void {
+      latencies_.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - sent_time).count());
+      completed_++;
+      if (sent_ < pipeline_requests_) {
+        send_pipelined();
+      } else if (completed_ == pipeline_requests_) {
+        pipeline_done_.set_value();
+      }
+    });
+}
+
+/**
+ * @brief Logs the benchmark progress.
+ */
+void AddTwoIntsClient::pipeline_report()
+{
+  RCLCPP_INFO(
+    this->get_logger(),
+    "%zu/%zu requests, %zu RPS",
+    completed_,
+    pipeline_requests_,
+    completed_ - last_completed_);
+  last_completed_ = completed_;
+}
+
+static void usage()
+{
+  std::cerr << "Usage:\n\tclient a b [a b ...]\n\tclient --pipeline DEPTH [REQUESTS]" << std::endl;
+  exit(EXIT_FAILURE);
+}
+
 int main(int argc, char ** argv)
 {
   // Parse input arguments
   if (argc < 3) {
     //! Note: why did we check for less than 3 arguments?
-    std::cerr << "Usage:\n\tclient a b" << std::endl;
-    exit(EXIT_FAILURE);
+    usage();
+  }
+  //! Benchmark mode: DEPTH requests in flight, REQUESTS in total
+  size_t depth = 0, requests = 10000;
+  std::vector<int64_t> a, b;
+  if (std::string(argv[1]) == "--pipeline") {
+    depth = std::stoul(argv[2]);
+    if (argc > 3 && std::string(argv[3]) != "--ros-args") {
+      requests = std::stoul(argv[3]);
+    }
+    if (depth == 0 || requests == 0) {
+      usage();
+    }
+  } else {
+    //! Operands come in pairs, until ROS arguments start
+    int i = 1;
+    for (; i + 1 < argc && std::string(argv[i]) != "--ros-args"; i += 2) {
+      a.push_back(std::stoll(argv[i]));
+      b.push_back(std::stoll(argv[i + 1]));
+    }
+    if (a.empty() || (i < argc && std::string(argv[i]) != "--ros-args")) {
+      usage();
+    }
   }
-  int a = std::stoi(argv[1]);
-  int b = std::stoi(argv[2]);
 
   rclcpp::init(argc, argv);
   auto client_node = std::make_shared<AddTwoIntsClient>();
 
   //! Note: this time we don't spin, we just call a method offered by the node
-  client_node->call_srv(a, b);
+  //! More than one pair is sent as a batch
+  if (depth > 0) {
+    client_node->run_pipeline(depth, requests);
+  } else if (a.size() == 1) {
+    client_node->call_srv(a[0], b[0]);
+  } else {
+    client_node->call_batch_srv(a, b);
+  }
 
   // Just exit
   rclcpp::shutdown();
@@ -6,7 +6,9 @@
  * November 22, 2021
  */
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 #include <simple_service_cpp/simple_service.hpp>
 
@@ -16,6 +18,17 @@
 AddTwoIntsServer::AddTwoIntsServer()
 : Node("server")
 {
+  //! A single thread serves one request at a time: with more, a slow request
+  //! doesn't hold back the ones queued behind it (0 means one per core)
+  int64_t threads = this->declare_parameter("threads", int64_t(1));
+  threads_ = threads > 0 ? size_t(threads) : std::max(std::thread::hardware_concurrency(), 1u);
+
+  //! Logging every request is expensive at high rates
+  log_requests_ = this->declare_parameter("log_requests", true);
+
+  //! With the default, mutually exclusive group callbacks would still run one at a time
+  server_cgroup_ = this->create_callback_group(rclcpp::CallbackGroupType::Reentrant);
+
   //! Create a server object with create_service from the base class:
   //! this->create_service<INTERFACE_TYPE>(
   //!   SERVICE_NAME [string],
@@ -30,9 +43,32 @@ AddTwoIntsServer::AddTwoIntsServer()
       &AddTwoIntsServer::add_two_ints_clbk,
       this,
       std::placeholders::_1,
-      std::placeholders::_2));
+      std::placeholders::_2),
+    rmw_qos_profile_services_default,
+    server_cgroup_);
 
-  RCLCPP_INFO(this->get_logger(), "Server initialized");
+  //! Each batched request carries many operations, paying the round trip only once
+  batch_server_ = this->create_service<AddTwoIntsBatch>(
+    "/examples/add_two_ints_batch",
+    std::bind(
+      &AddTwoIntsServer::add_two_ints_batch_clbk,
+      this,
+      std::placeholders::_1,
+      std::placeholders::_2),
+    rmw_qos_profile_services_default,
+    server_cgroup_);
+
+  RCLCPP_INFO(this->get_logger(), "Server initialized (%zu threads)", threads_);
+}
+
+/**
+ * @brief Returns the number of threads requests should be served with.
+ *
+ * @return Number of threads.
+ */
+size_t AddTwoIntsServer::get_threads() const
+{
+  return threads_;
 }
 
 /**
@@ -49,18 +85,59 @@ void AddTwoIntsServer::add_two_ints_clbk(
   //! the appropriate fields in the response message
   response->set__sum(request->a + request->b);
 
-  RCLCPP_INFO(
-    this->get_logger(), "%ld + %ld = %ld",
-    request->a,
-    request->b,
-    response->sum);
+  if (log_requests_) {
+    RCLCPP_INFO(
+      this->get_logger(), "%ld + %ld = %ld",
+      request->a,
+      request->b,
+      response->sum);
+  }
+}
+
+/**
+ * @brief Adds many pairs of integers and returns the sums.
+ *
+ * @param request Message with the integers to add, paired by index.
+ * @param response Response message to populate.
+ */
+void AddTwoIntsServer::add_two_ints_batch_clbk(
+  const AddTwoIntsBatch::Request::SharedPtr request,
+  const AddTwoIntsBatch::Response::SharedPtr response)
+{
+  if (request->a.size() != request->b.size()) {
+    response->set__success(false);
+    RCLCPP_ERROR(
+      this->get_logger(), "Batch operands have different lengths (%zu, %zu)",
+      request->a.size(),
+      request->b.size());
+    return;
+  }
+
+  response->sum.resize(request->a.size());
+  for (size_t i = 0; i < request->a.size(); i++) {
+    response->sum[i] = request->a[i] + request->b[i];
+  }
+  response->set__success(true);
+
+  if (log_requests_) {
+    RCLCPP_INFO(this->get_logger(), "Batch of %zu sums", response->sum.size());
+  }
 }
 
 int main(int argc, char ** argv)
 {
   rclcpp::init(argc, argv);
   auto server_node = std::make_shared<AddTwoIntsServer>();
-  rclcpp::spin(server_node);
+  if (server_node->get_threads() > 1) {
+    //! The reentrant group is of use only to a multithreaded executor
+    rclcpp::executors::MultiThreadedExecutor smp_executor(
+      rclcpp::ExecutorOptions(),
+      server_node->get_threads());
+    smp_executor.add_node(server_node);
+    smp_executor.spin();
+  } else {
+    rclcpp::spin(server_node);
+  }
   rclcpp::shutdown();
   exit(EXIT_SUCCESS);
 }
@@ -24,7 +24,7 @@ class Pub : public rclcpp::Node
 {
 public:
   //! There must always be a constructor, with arbitrary input arguments
-  Pub();
+  Pub(const rclcpp::NodeOptions & opts = rclcpp::NodeOptions());
 
 //! ROS-specific members better be private
 private:
@@ -39,6 +39,17 @@ private:
   rclcpp::TimerBase::SharedPtr pub_timer_;
   void pub_timer_callback(void);
 
+  //! High-rate mode, to measure the transport instead of this node:
+  //! no allocations or copies where the middleware allows it, and few logs
+  void high_rate_timer_callback(void);
+  size_t fill_data(char * buf, size_t size) const;
+  std_msgs::msg::String msg_; // Reused at every transmission
+  bool intra_process_;
+  int64_t log_decimation_;
+
+  //! Appends the send time to each message, for measure_sub
+  bool stamp_;
+
   unsigned long pub_cnt_; // Marks messages
 };
 
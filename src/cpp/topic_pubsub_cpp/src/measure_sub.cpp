@@ -0,0 +1,224 @@
+/**
+ * Topic transport measurement subscriber.
+ *
+ * Roberto Masocco <robmasocco@gmail.com>
+ *
+ * January 15, 2022
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <std_msgs/msg/string.hpp>
+
+#include <ros2_examples_interfaces/msg/topic_stats.hpp>
+
+using namespace std_msgs::msg;
+using namespace ros2_examples_interfaces::msg;
+
+/**
+ * Subscriber node that measures loss, reordering, latency and rate of the
+ * messages coming from this package's publisher, run with stamp:=true.
+ * Statistics refer to a sliding window and are published periodically.
+ *
+ * Latencies are computed on the system clock, so publisher and subscriber
+ * hosts must be synchronized (e.g. with chrony or PTP).
+ */
+//! For the sake of simplicity we'll write everything in here this time
+class MeasureSub : public rclcpp::Node
+{
+public:
+  MeasureSub()
+  : Node("measure_subscriber")
+  {
+    //! QoS settings to characterize, e.g. the custom_topic_cpp best-effort profile:
+    //!   ros2 run topic_pubsub_cpp measure_sub --ros-args -p reliable:=false -p depth:=1
+    topic_ = this->declare_parameter("topic", std::string("/examples/test_topic"));
+    bool reliable = this->declare_parameter("reliable", true);
+    int64_t depth = this->declare_parameter("depth", int64_t(10));
+    window_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(this->declare_parameter("window", 5.0)));
+    double report_period = this->declare_parameter("report_period", 1.0);
+
+    rclcpp::QoS topic_qos(rclcpp::KeepLast(size_t(std::max(depth, int64_t(1)))));
+    if (!reliable) {
+      topic_qos.best_effort();
+    }
+    sub_ = this->create_subscription<String>(
+      topic_,
+      topic_qos,
+      [this](String::SharedPtr msg) -> void {
+        record(*msg);
+      });
+
+    stats_pub_ = this->create_publisher<TopicStats>("~/stats", rclcpp::QoS(10));
+    report_timer_ = this->create_wall_timer(
+      std::chrono::duration<double>(report_period),
+      [this]() -> void {
+        report();
+      });
+
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Measuring %s (%s, depth %ld)",
+      topic_.c_str(),
+      reliable ? "reliable" : "best effort",
+      depth);
+  }
+
+private:
+  /* Reception of a single message. */
+  struct Sample
+  {
+    int64_t arrival;      // System time [ns]
+    int64_t latency;      // [ns], -1 if the message carried no stamp
+    uint64_t skipped;     // Sequence numbers skipped when this arrived
+    bool reordered;       // Older than a message already received
+  };
+
+  rclcpp::Subscription<String>::SharedPtr sub_;
+  rclcpp::Publisher<TopicStats>::SharedPtr stats_pub_;
+  rclcpp::TimerBase::SharedPtr report_timer_;
+
+  std::string topic_;
+  std::chrono::nanoseconds window_;
+
+  //! Receptions within the window, oldest first
+  std::deque<Sample> samples_;
+  bool first_ = true;
+  uint64_t highest_seq_ = 0;
+
+  /**
+   * @brief Parses a message formatted as "Hello SEQ.[ STAMP]".
+   *
+   * @param data Message text.
+   * @param seq Sequence number.
+   * @param stamp Send time [ns], -1 if missing.
+   * @return False if the message has no sequence number.
+   */
+  static bool parse(const std::string & data, uint64_t & seq, int64_t & stamp)
+  {
+    const char * begin = data.data();
+    const char * end = begin + data.size();
+    const char * p = std::find(begin, end, ' ');
+    if (p == end) {
+      return false;
+    }
+    auto res = std::from_chars(p + 1, end, seq);
+    if (res.ec != std::errc()) {
+      return false;
+    }
+    stamp = -1;
+    p = res.ptr;
+    if (p < end && *p == '.') {
+      p++;
+    }
+    if (p < end && *p == ' ') {
+      if (std::from_chars(p + 1, end, stamp).ec != std::errc()) {
+        stamp = -1;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Records a new message.
+   *
+   * @param msg Message received.
+   */
+  void record(const String & msg)
+  {
+    int64_t now = this->get_clock()->now().nanoseconds();
+    uint64_t seq;
+    int64_t stamp;
+    if (!parse(msg.data, seq, stamp)) {
+      RCLCPP_WARN_ONCE(this->get_logger(), "Messages carry no sequence number");
+      return;
+    }
+
+    Sample sample{now, stamp >= 0 ? now - stamp : -1, 0, false};
+    if (first_) {
+      first_ = false;
+      highest_seq_ = seq;
+    } else if (seq > highest_seq_) {
+      sample.skipped = seq - highest_seq_ - 1;
+      highest_seq_ = seq;
+    } else if (seq < highest_seq_) {
+      sample.reordered = true;
+    } else {
+      //! Publisher restarted, or duplicate: start over from here
+      highest_seq_ = seq;
+    }
+    samples_.push_back(sample);
+  }
+
+  /**
+   * @brief Computes and publishes the statistics of the current window.
+   */
+  void report()
+  {
+    rclcpp::Time now = this->get_clock()->now();
+    while (!samples_.empty() && samples_.front().arrival < now.nanoseconds() - window_.count()) {
+      samples_.pop_front();
+    }
+
+    TopicStats stats{};
+    stats.header.stamp = now;
+    stats.topic = topic_;
+    stats.window = std::chrono::duration<double>(window_).count();
+    stats.received = samples_.size();
+
+    uint64_t skipped = 0;
+    std::vector<int64_t> latencies;
+    latencies.reserve(samples_.size());
+    for (const Sample & sample : samples_) {
+      skipped += sample.skipped;
+      if (sample.reordered) {
+        stats.reordered++;
+      }
+      if (sample.latency >= 0) {
+        latencies.push_back(sample.latency);
+      }
+    }
+    //! Reordered messages fill gaps that were counted as losses
+    stats.lost = skipped > stats.reordered ? skipped - stats.reordered : 0;
+    stats.rate = double(stats.received) / stats.window;
+    stats.stamped = latencies.size();
+    if (!latencies.empty()) {
+      std::sort(latencies.begin(), latencies.end());
+      auto percentile = [&latencies](size_t p) -> double {
+          return double(latencies[std::min(latencies.size() - 1, latencies.size() * p / 100)]) *
+                 1e-6;
+        };
+      stats.latency_p50 = percentile(50);
+      stats.latency_p90 = percentile(90);
+      stats.latency_p99 = percentile(99);
+      stats.latency_max = double(latencies.back()) * 1e-6;
+    }
+    stats_pub_->publish(stats);
+
+    RCLCPP_INFO(
+      this->get_logger(),
+      "%.1f Hz, lost %lu, reordered %lu, latency p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+      stats.rate,
+      stats.lost,
+      stats.reordered,
+      stats.latency_p50,
+      stats.latency_p99,
+      stats.latency_max);
+  }
+};
+
+int main(int argc, char ** argv) {
+  rclcpp::init(argc, argv);
+  auto sub_node = std::make_shared<MeasureSub>();
+  rclcpp::spin(sub_node);
+  rclcpp::shutdown();
+  exit(EXIT_SUCCESS);
+}
@@ -6,19 +6,43 @@
  * November 22, 2021
  */
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <memory>
 
 #include "../include/topic_pubsub/pub.hpp"
 
 /**
  * @brief Creates a Pub node.
+ *
+ * @param opts Node options.
  */
 //! Call the base class constructor providing a string embedding the node name
 //! Initialize other members at will
-Pub::Pub()
-: Node("publisher_node"),
+Pub::Pub(const rclcpp::NodeOptions & opts)
+: Node("publisher_node", opts),
+  intra_process_(opts.use_intra_process_comms()),
   pub_cnt_(0)
 {
+  //! High-rate mode is configured with parameters, e.g.:
+  //!   ros2 run topic_pubsub_cpp pub --ros-args -p high_rate:=true -p period_us:=100
+  bool high_rate = this->declare_parameter("high_rate", false);
+  int64_t period_us = this->declare_parameter("period_us", int64_t(PUB_PERIOD) * 1000);
+  log_decimation_ = this->declare_parameter("log_decimation", int64_t(10000));
+
+  //! Transport configuration, to be compared with measure_sub:
+  //! messages become "Hello N. STAMP", STAMP being the system time [ns]
+  stamp_ = this->declare_parameter("stamp", false);
+  bool reliable = this->declare_parameter("reliable", true);
+  int64_t depth = this->declare_parameter("depth", int64_t(10));
+  if (period_us < 1) {
+    RCLCPP_WARN(this->get_logger(), "Invalid period_us %ld, using 1", period_us);
+    period_us = 1;
+  }
+
   //! Initialize a publisher with create_publisher from the base class:
   //! this->create_publisher<INTERFACE_TYPE>(
   //!   TOPIC_NAME [string],
@@ -26,19 +50,39 @@ Pub::Pub()
   //!   ...
   //! );
   //! This object will be used later on to publish messages
+  rclcpp::QoS topic_qos(rclcpp::KeepLast(size_t(std::max(depth, int64_t(1)))));
+  if (!reliable) {
+    topic_qos.best_effort();
+  }
   publisher_ = this->create_publisher<std_msgs::msg::String>(
     "/examples/test_topic",
-    rclcpp::QoS(10));
+    topic_qos);
 
   //! Create and activate a timer with create_wall_timer from the base class
   //! providing an std::chrono::duration as the period and a call wrapper for
   //! the callback, capturing the node object
   //! Since this callback must be void, the wrapper has no arguments specified
-  pub_timer_ = this->create_wall_timer(
-    std::chrono::milliseconds(PUB_PERIOD),
-    std::bind(
-      &Pub::pub_timer_callback,
-      this));
+  if (!high_rate) {
+    pub_timer_ = this->create_wall_timer(
+      std::chrono::milliseconds(PUB_PERIOD),
+      std::bind(
+        &Pub::pub_timer_callback,
+        this));
+  } else {
+    //! Enough room for any counter and stamp value, so that the string never reallocates
+    msg_.data.reserve(64);
+    pub_timer_ = this->create_wall_timer(
+      std::chrono::microseconds(period_us),
+      std::bind(
+        &Pub::high_rate_timer_callback,
+        this));
+    RCLCPP_INFO(
+      this->get_logger(),
+      "High-rate mode: period %ld us, %s",
+      period_us,
+      publisher_->can_loan_messages() ? "loaned messages" :
+      (intra_process_ ? "intra-process moves" : "reused message"));
+  }
 
   //! Logging macro used to deliver a message to the logging subsystem, INFO level
   RCLCPP_INFO(this->get_logger(), "Publisher initialized");
@@ -52,6 +96,9 @@ void Pub::pub_timer_callback(void)
   // Build the new message
   std::string new_data = "Hello ";
   new_data.append(std::to_string(pub_cnt_) + ".");
+  if (stamp_) {
+    new_data.append(" " + std::to_string(this->get_clock()->now().nanoseconds()));
+  }
 
   //! Create a new message of the specific interface type
   //! It is better to initialize it as empty as below
@@ -68,6 +115,57 @@ void Pub::pub_timer_callback(void)
   RCLCPP_INFO(this->get_logger(), "Published message %lu", pub_cnt_);
 }
 
+/**
+ * @brief Writes the message text, without allocating.
+ *
+ * @param buf Buffer to write into.
+ * @param size Buffer size.
+ * @return Text length.
+ */
+size_t Pub::fill_data(char * buf, size_t size) const
+{
+  std::memcpy(buf, "Hello ", 6);
+  char * end = std::to_chars(buf + 6, buf + size - 1, pub_cnt_).ptr;
+  *end++ = '.';
+  if (stamp_) {
+    *end++ = ' ';
+    end = std::to_chars(end, buf + size, this->get_clock()->now().nanoseconds()).ptr;
+  }
+  return size_t(end - buf);
+}
+
+/**
+ * @brief Publishes a message on timer occurrence, in high-rate mode.
+ */
+void Pub::high_rate_timer_callback(void)
+{
+  char buf[64];
+  size_t len = fill_data(buf, sizeof(buf));
+
+  if (publisher_->can_loan_messages()) {
+    //! The middleware lends its own buffer: no copies on our side
+    auto loaned_msg = publisher_->borrow_loaned_message();
+    loaned_msg.get().data.assign(buf, len);
+    publisher_->publish(std::move(loaned_msg));
+  } else if (intra_process_) {
+    //! Ownership moves to intra-process subscribers, so the message cannot be
+    //! reused, but it is never copied
+    auto new_msg = std::make_unique<std_msgs::msg::String>();
+    new_msg->data.assign(buf, len);
+    publisher_->publish(std::move(new_msg));
+  } else {
+    //! Serialized right away, so the same message can be filled again
+    msg_.data.assign(buf, len);
+    publisher_->publish(msg_);
+  }
+
+  //! Logging every message would measure the logger instead
+  pub_cnt_++;
+  if (log_decimation_ > 0 && pub_cnt_ % uint64_t(log_decimation_) == 0) {
+    RCLCPP_INFO(this->get_logger(), "Published message %lu", pub_cnt_);
+  }
+}
+
 int main(int argc, char ** argv)
 {
   //! This automatically creates the global context->DDS participant for this application
@@ -7,6 +7,8 @@
  */
 
 #include <chrono>
+#include <exception>
+#include <string>
 
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/string.hpp>
@@ -17,6 +19,8 @@ using namespace std::chrono_literals;
 /**
  * Subscriber node that dynamically resubscribes to a given topic.
  * Run this alongside this package's publisher.
+ *
+ * With mode:=pause the subscription is kept, and only delivery is toggled.
  */
 //! For the sake of simplicity we'll write everything in here this time
 class ResettingSub : public rclcpp::Node
@@ -25,10 +29,23 @@ public:
   ResettingSub()
   : Node("resetting_subscriber")
   {
+    pause_mode_ = this->declare_parameter("mode", std::string("recreate")) == "pause";
+
+    //! Destroying a Subscription removes a DDS reader, and creating it again
+    //! triggers discovery with every matching writer: with many nodes doing
+    //! this, the network gets flooded. Pausing keeps the reader
+    if (pause_mode_) {
+      create_pausable_subscription();
+    }
+
     //! We just have to initialize the timer
     sub_timer_ = this->create_wall_timer(
       5s,
       [this]() -> void {
+        if (pause_mode_) {
+          toggle_pause();
+          return;
+        }
         //! This just has to toggle topic subscription
         if (sub_) { //! Operator checks if it is nullptr
           RCLCPP_WARN(this->get_logger(), "De-subscribing from topic");
@@ -58,6 +75,64 @@ private:
   rclcpp::Subscription<String>::SharedPtr sub_;
 
   rclcpp::TimerBase::SharedPtr sub_timer_;
+
+  //! Pause mode state
+  bool pause_mode_ = false;
+  bool paused_ = false;
+
+  //! Content filters that let through all or none of our messages
+  static constexpr const char * pass_all_filter_ = "data LIKE '%'";
+  static constexpr const char * pass_none_filter_ = "data = 'a' AND data = 'b'";
+
+  /**
+   * @brief Creates the subscription used in pause mode.
+   *
+   * If the middleware supports content filtered topics, samples are filtered
+   * out by the writer DDS-side while paused, so they are not even sent;
+   * otherwise they are dropped in the callback.
+   */
+  void create_pausable_subscription()
+  {
+    rclcpp::SubscriptionOptions sub_opts;
+    sub_opts.content_filter_options.filter_expression = pass_all_filter_;
+    sub_ = this->create_subscription<String>(
+      "/examples/test_topic",
+      rclcpp::QoS(10),
+      [this](String::SharedPtr msg) -> void {
+        if (paused_) {
+          return;
+        }
+        RCLCPP_INFO(this->get_logger(), msg->data.c_str());
+      },
+      sub_opts);
+    RCLCPP_INFO(
+      this->get_logger(),
+      "Pause mode, content filtering %s",
+      sub_->is_cft_enabled() ? "enabled" : "not supported, dropping samples in the callback");
+  }
+
+  /**
+   * @brief Pauses or resumes delivery, keeping the subscription.
+   */
+  void toggle_pause()
+  {
+    auto start = std::chrono::steady_clock::now();
+    paused_ = !paused_;
+    if (sub_->is_cft_enabled()) {
+      try {
+        sub_->set_content_filter(paused_ ? pass_none_filter_ : pass_all_filter_);
+      } catch (const std::exception & e) {
+        RCLCPP_ERROR(this->get_logger(), "Failed to update content filter: %s", e.what());
+      }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+    RCLCPP_WARN(
+      this->get_logger(),
+      "%s delivery (%ld us)",
+      paused_ ? "Paused" : "Resumed",
+      elapsed.count());
+  }
 };
 
 int main(int argc, char ** argv) {
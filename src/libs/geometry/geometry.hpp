@@ -0,0 +1,214 @@
+#ifndef GEOMETRY_HPP
+#define GEOMETRY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Position and orientation as roll, pitch and yaw angles [rad]
+// The rotation is yaw about z, then pitch about y, then roll about x
+struct Pose {
+    double x;
+    double y;
+    double z;
+    double roll;
+    double pitch;
+    double yaw;
+};
+
+// Three component vector, padded to four lanes so that arrays of them load as whole SIMD registers
+// Everything here is inline or constexpr, so that pose math inlines wherever it is used
+template <typename T>
+struct alignas(4 * sizeof(T)) Vector3 {
+    T x;
+    T y;
+    T z;
+
+    constexpr Vector3() : x(0), y(0), z(0) {}
+    constexpr Vector3(T x, T y, T z) : x(x), y(y), z(z) {}
+
+    constexpr Vector3 operator+(const Vector3& o) const { return Vector3(x + o.x, y + o.y, z + o.z); }
+    constexpr Vector3 operator-(const Vector3& o) const { return Vector3(x - o.x, y - o.y, z - o.z); }
+    constexpr Vector3 operator-() const { return Vector3(-x, -y, -z); }
+    constexpr Vector3 operator*(T s) const { return Vector3(x * s, y * s, z * s); }
+    constexpr Vector3& operator+=(const Vector3& o) { x += o.x; y += o.y; z += o.z; return *this; }
+    constexpr Vector3& operator-=(const Vector3& o) { x -= o.x; y -= o.y; z -= o.z; return *this; }
+
+    constexpr T dot(const Vector3& o) const { return x * o.x + y * o.y + z * o.z; }
+    constexpr Vector3 cross(const Vector3& o) const { return Vector3(y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x); }
+    T norm() const { return std::sqrt(dot(*this)); }
+};
+
+using Vec3 = Vector3<double>;
+using Vec3f = Vector3<float>;
+
+// Unit quaternion, w being the scalar part
+struct Quaternion {
+    double w;
+    double x;
+    double y;
+    double z;
+
+    static constexpr Quaternion identity() { return Quaternion{1.0, 0.0, 0.0, 0.0}; }
+
+    // Rotation of an angle [rad] about a unit axis
+    static Quaternion fromAxisAngle(const Vec3& axis, double angle) {
+        const double s = std::sin(0.5 * angle);
+        return Quaternion{std::cos(0.5 * angle), axis.x * s, axis.y * s, axis.z * s};
+    }
+
+    // Rotation of Euler angles, in the same order as Pose
+    static Quaternion fromRpy(double roll, double pitch, double yaw) {
+        const double cr = std::cos(0.5 * roll), sr = std::sin(0.5 * roll);
+        const double cp = std::cos(0.5 * pitch), sp = std::sin(0.5 * pitch);
+        const double cy = std::cos(0.5 * yaw), sy = std::sin(0.5 * yaw);
+        return Quaternion{cr * cp * cy + sr * sp * sy,
+                          sr * cp * cy - cr * sp * sy,
+                          cr * sp * cy + sr * cp * sy,
+                          cr * cp * sy - sr * sp * cy};
+    }
+
+    // Rotation of a row major 3x3 matrix
+    static Quaternion fromMatrix(const double* r) {
+        const double trace = r[0] + r[4] + r[8];
+        Quaternion q;
+        if (trace > 0.0) {
+            const double s = 2.0 * std::sqrt(trace + 1.0);
+            q = Quaternion{0.25 * s, (r[7] - r[5]) / s, (r[2] - r[6]) / s, (r[3] - r[1]) / s};
+        } else if (r[0] > r[4] && r[0] > r[8]) {
+            const double s = 2.0 * std::sqrt(1.0 + r[0] - r[4] - r[8]);
+            q = Quaternion{(r[7] - r[5]) / s, 0.25 * s, (r[1] + r[3]) / s, (r[2] + r[6]) / s};
+        } else if (r[4] > r[8]) {
+            const double s = 2.0 * std::sqrt(1.0 + r[4] - r[0] - r[8]);
+            q = Quaternion{(r[2] - r[6]) / s, (r[1] + r[3]) / s, 0.25 * s, (r[5] + r[7]) / s};
+        } else {
+            const double s = 2.0 * std::sqrt(1.0 + r[8] - r[0] - r[4]);
+            q = Quaternion{(r[3] - r[1]) / s, (r[2] + r[6]) / s, (r[5] + r[7]) / s, 0.25 * s};
+        }
+        return q.normalized();
+    }
+
+    constexpr Quaternion operator*(const Quaternion& o) const {
+        return Quaternion{w * o.w - x * o.x - y * o.y - z * o.z,
+                          w * o.x + x * o.w + y * o.z - z * o.y,
+                          w * o.y - x * o.z + y * o.w + z * o.x,
+                          w * o.z + x * o.y - y * o.x + z * o.w};
+    }
+
+    constexpr Quaternion conjugate() const { return Quaternion{w, -x, -y, -z}; }
+
+    Quaternion normalized() const {
+        const double n = std::sqrt(w * w + x * x + y * y + z * z);
+        return Quaternion{w / n, x / n, y / n, z / n};
+    }
+
+    // Rotates a vector, v + 2w (u x v) + 2 u x (u x v) with u the vector part
+    constexpr Vec3 rotate(const Vec3& v) const {
+        const Vec3 u(x, y, z);
+        const Vec3 t = u.cross(v) * 2.0;
+        return v + t * w + u.cross(t);
+    }
+
+    // Row major 3x3 rotation matrix
+    void toMatrix(double* r) const {
+        r[0] = 1.0 - 2.0 * (y * y + z * z); r[1] = 2.0 * (x * y - w * z);       r[2] = 2.0 * (x * z + w * y);
+        r[3] = 2.0 * (x * y + w * z);       r[4] = 1.0 - 2.0 * (x * x + z * z); r[5] = 2.0 * (y * z - w * x);
+        r[6] = 2.0 * (x * z - w * y);       r[7] = 2.0 * (y * z + w * x);       r[8] = 1.0 - 2.0 * (x * x + y * y);
+    }
+
+    // Euler angles, in the same order as Pose
+    void toRpy(double& roll, double& pitch, double& yaw) const {
+        roll = std::atan2(2.0 * (w * x + y * z), 1.0 - 2.0 * (x * x + y * y));
+        pitch = std::asin(std::max(-1.0, std::min(1.0, 2.0 * (w * y - z * x))));
+        yaw = std::atan2(2.0 * (w * z + x * y), 1.0 - 2.0 * (y * y + z * z));
+    }
+};
+
+// Rigid transform, applying the rotation then the translation
+struct Transform {
+    Quaternion rotation;
+    Vec3 translation;
+
+    static constexpr Transform identity() { return Transform{Quaternion::identity(), Vec3()}; }
+
+    static Transform fromPose(const Pose& pose) {
+        return Transform{Quaternion::fromRpy(pose.roll, pose.pitch, pose.yaw), Vec3(pose.x, pose.y, pose.z)};
+    }
+
+    Pose toPose() const {
+        Pose pose{translation.x, translation.y, translation.z, 0.0, 0.0, 0.0};
+        rotation.toRpy(pose.roll, pose.pitch, pose.yaw);
+        return pose;
+    }
+
+    // Composition, (a * b) applies b first
+    constexpr Transform operator*(const Transform& o) const {
+        return Transform{rotation * o.rotation, rotation.rotate(o.translation) + translation};
+    }
+
+    constexpr Transform inverse() const {
+        const Quaternion r = rotation.conjugate();
+        return Transform{r, -r.rotate(translation)};
+    }
+
+    constexpr Vec3 apply(const Vec3& point) const { return rotation.rotate(point) + translation; }
+};
+
+// Transform as a row major rotation matrix and a translation in single precision,
+// computed once so that batched kernels do no trigonometry nor quaternion algebra per point
+struct TransformMatrixf {
+    float r[9];
+    float t[3];
+
+    explicit TransformMatrixf(const Transform& transform) {
+        double m[9];
+        transform.rotation.toMatrix(m);
+        for (int i = 0; i < 9; ++i) {
+            r[i] = static_cast<float>(m[i]);
+        }
+        t[0] = static_cast<float>(transform.translation.x);
+        t[1] = static_cast<float>(transform.translation.y);
+        t[2] = static_cast<float>(transform.translation.z);
+    }
+};
+
+// Batched point transforms, written as branchless loops over restrict pointers that the compiler vectorizes
+// Outputs may not alias inputs
+
+// Separate x, y and z arrays, as stored by VoxelGrid and SphereSet
+inline void transformPoints(const Transform& transform, const float* __restrict x, const float* __restrict y,
+                            const float* __restrict z, float* __restrict ox, float* __restrict oy,
+                            float* __restrict oz, std::size_t count) {
+    const TransformMatrixf m(transform);
+    for (std::size_t i = 0; i < count; ++i) {
+        ox[i] = m.r[0] * x[i] + m.r[1] * y[i] + m.r[2] * z[i] + m.t[0];
+        oy[i] = m.r[3] * x[i] + m.r[4] * y[i] + m.r[5] * z[i] + m.t[1];
+        oz[i] = m.r[6] * x[i] + m.r[7] * y[i] + m.r[8] * z[i] + m.t[2];
+    }
+}
+
+// Interleaved x, y, z triplets, as stored by point clouds and object models
+inline void transformPoints(const Transform& transform, const float* __restrict xyz, float* __restrict out,
+                            std::size_t count) {
+    const TransformMatrixf m(transform);
+    for (std::size_t i = 0; i < count; ++i) {
+        const float x = xyz[3 * i], y = xyz[3 * i + 1], z = xyz[3 * i + 2];
+        out[3 * i] = m.r[0] * x + m.r[1] * y + m.r[2] * z + m.t[0];
+        out[3 * i + 1] = m.r[3] * x + m.r[4] * y + m.r[5] * z + m.t[1];
+        out[3 * i + 2] = m.r[6] * x + m.r[7] * y + m.r[8] * z + m.t[2];
+    }
+}
+
+// Padded vectors, one aligned four lane load and store per point
+inline void transformPoints(const Transform& transform, const Vec3f* __restrict points, Vec3f* __restrict out,
+                            std::size_t count) {
+    const TransformMatrixf m(transform);
+    for (std::size_t i = 0; i < count; ++i) {
+        const Vec3f p = points[i];
+        out[i] = Vec3f(m.r[0] * p.x + m.r[1] * p.y + m.r[2] * p.z + m.t[0],
+                       m.r[3] * p.x + m.r[4] * p.y + m.r[5] * p.z + m.t[1],
+                       m.r[6] * p.x + m.r[7] * p.y + m.r[8] * p.z + m.t[2]);
+    }
+}
+
+#endif // GEOMETRY_HPP
@@ -1,19 +1,127 @@
 #ifndef GRASP_PLANNER_HPP
 #define GRASP_PLANNER_HPP
 
+#include "object_detection/object_detection.hpp"
+#include "robot_motion_planner/kinematics.hpp"
+#include "robot_motion_planner/robot.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 struct Plan {
     double x;
     double y;
     double z;
+    double yaw;     // Gripper rotation about the vertical approach axis
+    double score;   // Grasp quality in [0, 1], 0 if in collision
+};
+
+// Spherical obstacle the gripper must stay clear of
+struct Obstacle {
+    double x;
+    double y;
+    double z;
+    double radius;
+};
+
+// Grasp sampling settings
+struct GraspRequest {
+    std::size_t samplesPerObject;   // Candidates sampled around each object
+    std::size_t topK;               // Number of plans to return
+    double goodScore;               // Sampling stops early once topK candidates score at least this
+    double sampleRadius;            // Radius of the sampling disc around each object [m]
+    double gripperRadius;           // Clearance needed around the gripper [m]
+};
+
+// Grasp cache counters
+struct GraspCacheStats {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+    std::size_t entries;
+
+    // Fraction of lookups served from the cache
+    double hitRatio() const {
+        std::size_t lookups = hits + misses;
+        return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+    }
+};
+
+// Least recently used cache of ranked grasp plans
+// Entries are keyed by object class and quantized pose, plans are stored in the object frame
+class GraspCache {
+public:
+    // Constructor
+    GraspCache(std::size_t capacity = 256, double positionStep = 0.01, double angleStep = 0.0873);
+
+    // Methods to configure the cache
+    void setCapacity(std::size_t capacity);
+    void setResolution(double positionStep, double angleStep);
+
+    // Looks up plans for an object, transformed to its actual pose
+    bool find(const Object& object, const Pose& pose, std::vector<Plan>& plans);
+
+    // Stores plans computed for an object at a given pose
+    void insert(const Object& object, const Pose& pose, const std::vector<Plan>& plans);
+
+    // Drops all entries for an object class, e.g. after its model changed
+    void invalidate(const Object& object);
+
+    // Drops all entries
+    void clear();
+
+    // Returns the cache counters
+    GraspCacheStats stats() const;
+
+    // Resets the hit and miss counters
+    void resetStats();
+
+private:
+
+    struct Key {
+        ClassId classId;
+        std::int32_t pose[6];
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<Plan> plans;
+    };
+
+    // Quantizes an object pose into a cache key
+    Key makeKey(const Object& object, const Pose& pose) const;
+
+    // Evicts least recently used entries above capacity
+    void trim();
+
+    std::size_t capacity_;
+    double positionStep_;
+    double angleStep_;
+
+    // Most recently used entries first
+    std::list<Entry> entries_;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    GraspCacheStats stats_;
 };
 
 // Class definition for GraspPlanner
 class GraspPlanner {
 public:
-    // Constructor
-    GraspPlanner();
+    // Constructor, 0 threads uses all cores
+    GraspPlanner(std::size_t threads = 0);
 
     // Destructor
     ~GraspPlanner();
@@ -21,10 +129,67 @@ public:
     // Sends command for grasping
     void grasp();
 
+    // Methods to configure the scene obstacles
+    void setObstacles(const std::vector<Obstacle>& obstacles);
+
+    // Method to reject candidates the arm cannot reach, solving top-down grasps from a seed
+    // The kinematics must outlive the planner, nullptr disables the check
+    void setKinematics(Kinematics* kinematics, const std::vector<double>& seed);
+
+    // Plans grasps for a set of detected objects, returning the best ones first
+    // The returned plans stay valid until the next call
+    const std::vector<Plan>& planGrasps(const Pose* objects, std::size_t count, const GraspRequest& request);
+
+    // Plans grasps for a single known object, reusing cached plans for the same class and pose
+    const std::vector<Plan>& planGrasps(const Object& object, const Pose& pose, const GraspRequest& request);
+
+    // Returns the grasp cache, to size it or invalidate a changed object model
+    GraspCache& cache();
+
 private:
 
+    // Samples and scores a range of candidates
+    void processCandidates();
+
+    // Worker thread routine
+    void workerRoutine();
+
+    // Scores a candidate against the object it was sampled around
+    double scoreCandidate(const Plan& candidate, const Pose& object) const;
+
+    // Zeroes the score of the candidates of a range the arm cannot reach
+    void checkReachability(Plan* candidates, std::size_t count);
+
     // Plans a grasp for a given object
-    std::vector<Plan>* graspPlan;
+    std::vector<Plan> graspPlan;
+
+    // Candidates arena, reused across calls
+    std::vector<Plan> candidates_;
+    std::vector<Obstacle> obstacles_;
+
+    // Arm model for reachability, with the joint positions solves start from
+    Kinematics* kinematics_;
+    std::vector<double> seed_;
+
+    // Plans of previously seen objects
+    GraspCache cache_;
+
+    // Current planning job, shared with the workers
+    const Pose* objects_;
+    std::size_t objectCount_;
+    GraspRequest request_;
+    std::atomic<std::size_t> nextCandidate_;
+    std::atomic<std::size_t> goodCandidates_;
+    std::atomic<std::size_t> sampledCandidates_;
+
+    // Worker threads, woken up once per job
+    std::vector<std::thread> workers_;
+    std::mutex jobLock_;
+    std::condition_variable jobCv_;
+    std::condition_variable doneCv_;
+    std::uint64_t job_;
+    std::size_t busyWorkers_;
+    bool stopWorkers_;
 };
 
 #endif // GRASP_PLANNER_HPP
@@ -1,17 +1,369 @@
 #include "grasp_planner.hpp"
-#include <iostream>
+#include "logging/logging.hpp"
+#include "profiler/profiler.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Number of candidates claimed by a worker at once
+const std::size_t candidate_chunk = 64;
+
+// Stateless hash of a candidate index, so that samples do not depend on which thread draws them
+constexpr std::uint64_t splitmix(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Uniform sample in [0, 1) from a hash
+constexpr double unit(std::uint64_t h) {
+    return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+const double pi = 3.14159265358979323846;
+
+}
 
 // Constructor
-GraspPlanner::GraspPlanner() {
-    std::cout << "GraspPlanner initialized.\n";
+GraspCache::GraspCache(std::size_t capacity, double positionStep, double angleStep)
+    : capacity_(capacity), positionStep_(positionStep), angleStep_(angleStep), stats_{0, 0, 0, 0} {
+}
+
+// Methods to configure the cache
+void GraspCache::setCapacity(std::size_t capacity) {
+    capacity_ = capacity;
+    trim();
+}
+
+// Changing the resolution changes every key, so the cache is emptied
+void GraspCache::setResolution(double positionStep, double angleStep) {
+    positionStep_ = positionStep;
+    angleStep_ = angleStep;
+    clear();
+}
+
+// Looks up plans for an object, transformed from the object frame to its actual pose
+bool GraspCache::find(const Object& object, const Pose& pose, std::vector<Plan>& plans) {
+    auto it = index_.find(makeKey(object, pose));
+    if (it == index_.end()) {
+        stats_.misses++;
+        return false;
+    }
+    stats_.hits++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    double c = std::cos(pose.yaw);
+    double s = std::sin(pose.yaw);
+    plans.clear();
+    for (const Plan& local : it->second->plans) {
+        Plan plan = local;
+        plan.x = pose.x + c * local.x - s * local.y;
+        plan.y = pose.y + s * local.x + c * local.y;
+        plan.z = pose.z + local.z;
+        plan.yaw = pose.yaw + local.yaw;
+        plans.push_back(plan);
+    }
+    return true;
+}
+
+// Stores plans computed for an object at a given pose, in the object frame
+void GraspCache::insert(const Object& object, const Pose& pose, const std::vector<Plan>& plans) {
+    if (capacity_ == 0) {
+        return;
+    }
+    Key key = makeKey(object, pose);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    double c = std::cos(pose.yaw);
+    double s = std::sin(pose.yaw);
+    Entry entry{key, {}};
+    entry.plans.reserve(plans.size());
+    for (const Plan& plan : plans) {
+        Plan local = plan;
+        double dx = plan.x - pose.x;
+        double dy = plan.y - pose.y;
+        local.x = c * dx + s * dy;
+        local.y = -s * dx + c * dy;
+        local.z = plan.z - pose.z;
+        local.yaw = plan.yaw - pose.yaw;
+        entry.plans.push_back(local);
+    }
+    entries_.push_front(std::move(entry));
+    index_.emplace(entries_.front().key, entries_.begin());
+    trim();
+}
+
+// Drops all entries for an object class
+void GraspCache::invalidate(const Object& object) {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->key.classId == object.classId) {
+            index_.erase(it->key);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Drops all entries
+void GraspCache::clear() {
+    index_.clear();
+    entries_.clear();
+}
+
+// Returns the cache counters
+GraspCacheStats GraspCache::stats() const {
+    GraspCacheStats stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+}
+
+// Resets the hit and miss counters
+void GraspCache::resetStats() {
+    stats_ = GraspCacheStats{0, 0, 0, 0};
+}
+
+// Quantizes an object pose into a cache key
+GraspCache::Key GraspCache::makeKey(const Object& object, const Pose& pose) const {
+    Key key{object.classId, {}};
+    key.pose[0] = static_cast<std::int32_t>(std::lround(pose.x / positionStep_));
+    key.pose[1] = static_cast<std::int32_t>(std::lround(pose.y / positionStep_));
+    key.pose[2] = static_cast<std::int32_t>(std::lround(pose.z / positionStep_));
+    key.pose[3] = static_cast<std::int32_t>(std::lround(std::remainder(pose.roll, 2.0 * pi) / angleStep_));
+    key.pose[4] = static_cast<std::int32_t>(std::lround(std::remainder(pose.pitch, 2.0 * pi) / angleStep_));
+    key.pose[5] = static_cast<std::int32_t>(std::lround(std::remainder(pose.yaw, 2.0 * pi) / angleStep_));
+    return key;
+}
+
+// Evicts least recently used entries above capacity
+void GraspCache::trim() {
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+        stats_.evictions++;
+    }
+}
+
+bool GraspCache::Key::operator==(const Key& other) const {
+    return classId == other.classId &&
+        std::equal(std::begin(pose), std::end(pose), std::begin(other.pose));
+}
+
+std::size_t GraspCache::KeyHash::operator()(const Key& key) const {
+    std::uint64_t h = splitmix(key.classId);
+    for (std::int32_t q : key.pose) {
+        h = splitmix(h ^ static_cast<std::uint32_t>(q));
+    }
+    return static_cast<std::size_t>(h);
+}
+
+// Constructor
+GraspPlanner::GraspPlanner(std::size_t threads)
+    : kinematics_(nullptr), objects_(nullptr), objectCount_(0), request_{0, 0, 1.0, 0.0, 0.0},
+      nextCandidate_(0), goodCandidates_(0), sampledCandidates_(0),
+      job_(0), busyWorkers_(0), stopWorkers_(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // The calling thread works too
+    for (std::size_t i = 1; i < threads; ++i) {
+        workers_.push_back(std::thread(&GraspPlanner::workerRoutine, this));
+    }
+    LOG_INFO("GraspPlanner initialized.");
 }
 
 // Destructor
 GraspPlanner::~GraspPlanner() {
-    std::cout << "GraspPlanner resources cleaned up.\n";
+    {
+        std::lock_guard<std::mutex> lock(jobLock_);
+        stopWorkers_ = true;
+    }
+    jobCv_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+    LOG_INFO("GraspPlanner resources cleaned up.");
 }
 
 // Sends command for grasping
 void GraspPlanner::grasp() {
 }
 
+// Methods to configure the scene obstacles
+// Cached plans were scored against the previous obstacles, so they are dropped
+void GraspPlanner::setObstacles(const std::vector<Obstacle>& obstacles) {
+    obstacles_ = obstacles;
+    cache_.clear();
+}
+
+// Method to reject candidates the arm cannot reach
+// Cached plans were not checked against this arm, so they are dropped
+void GraspPlanner::setKinematics(Kinematics* kinematics, const std::vector<double>& seed) {
+    kinematics_ = kinematics;
+    seed_ = seed;
+    if (kinematics_ != nullptr) {
+        seed_.resize(kinematics_->dof(), 0.0);
+    }
+    cache_.clear();
+}
+
+// Plans grasps for a single known object, reusing cached plans for the same class and pose
+const std::vector<Plan>& GraspPlanner::planGrasps(const Object& object, const Pose& pose, const GraspRequest& request) {
+    if (cache_.find(object, pose, graspPlan) && graspPlan.size() >= request.topK) {
+        return graspPlan;
+    }
+    planGrasps(&pose, 1, request);
+    cache_.insert(object, pose, graspPlan);
+    return graspPlan;
+}
+
+// Returns the grasp cache
+GraspCache& GraspPlanner::cache() {
+    return cache_;
+}
+
+// Plans grasps for a set of detected objects
+// Candidates are scored in parallel; sampling stops as soon as enough good ones are found
+const std::vector<Plan>& GraspPlanner::planGrasps(const Pose* objects, std::size_t count, const GraspRequest& request) {
+    PROFILE_SCOPE("grasp.plan");
+    graspPlan.clear();
+    if (count == 0 || request.samplesPerObject == 0 || request.topK == 0) {
+        return graspPlan;
+    }
+
+    objects_ = objects;
+    objectCount_ = count;
+    request_ = request;
+    candidates_.resize(count * request.samplesPerObject);
+    nextCandidate_ = 0;
+    goodCandidates_ = 0;
+    sampledCandidates_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(jobLock_);
+        job_++;
+        busyWorkers_ = workers_.size();
+    }
+    jobCv_.notify_all();
+    processCandidates();
+    {
+        std::unique_lock<std::mutex> lock(jobLock_);
+        doneCv_.wait(lock, [this] { return busyWorkers_ == 0; });
+    }
+
+    // Best candidates first, only among the ones actually sampled
+    std::size_t sampled = std::min(sampledCandidates_.load(), candidates_.size());
+    std::size_t k = std::min(request.topK, sampled);
+    std::partial_sort(candidates_.begin(), candidates_.begin() + k, candidates_.begin() + sampled,
+        [](const Plan& a, const Plan& b) { return a.score > b.score; });
+    for (std::size_t i = 0; i < k && candidates_[i].score > 0.0; ++i) {
+        graspPlan.push_back(candidates_[i]);
+    }
+    return graspPlan;
+}
+
+// Worker thread routine
+void GraspPlanner::workerRoutine() {
+    std::uint64_t lastJob = 0;
+    std::unique_lock<std::mutex> lock(jobLock_);
+    while (true) {
+        jobCv_.wait(lock, [this, lastJob] { return stopWorkers_ || job_ != lastJob; });
+        if (stopWorkers_) {
+            return;
+        }
+        lastJob = job_;
+        lock.unlock();
+        processCandidates();
+        lock.lock();
+        if (--busyWorkers_ == 0) {
+            doneCv_.notify_one();
+        }
+    }
+}
+
+// Samples and scores candidates, chunk by chunk, until all are done or enough good ones are found
+// Samples are interleaved across objects, so that stopping early does not skip whole objects
+void GraspPlanner::processCandidates() {
+    const std::size_t total = candidates_.size();
+    while (goodCandidates_.load(std::memory_order_relaxed) < request_.topK) {
+        std::size_t first = nextCandidate_.fetch_add(candidate_chunk);
+        if (first >= total) {
+            break;
+        }
+        std::size_t last = std::min(first + candidate_chunk, total);
+        std::size_t good = 0;
+        for (std::size_t i = first; i < last; ++i) {
+            const Pose& object = objects_[i % objectCount_];
+            std::uint64_t h = splitmix(i);
+            double radius = request_.sampleRadius * std::sqrt(unit(h));
+            double angle = 2.0 * pi * unit(splitmix(h));
+            Plan& candidate = candidates_[i];
+            candidate.x = object.x + radius * std::cos(angle);
+            candidate.y = object.y + radius * std::sin(angle);
+            candidate.z = object.z;
+            candidate.yaw = object.yaw + pi * (unit(splitmix(h + 1)) - 0.5);
+            candidate.score = scoreCandidate(candidate, object);
+        }
+        if (kinematics_ != nullptr) {
+            checkReachability(candidates_.data() + first, last - first);
+        }
+        for (std::size_t i = first; i < last; ++i) {
+            if (candidates_[i].score >= request_.goodScore) {
+                good++;
+            }
+        }
+        goodCandidates_.fetch_add(good, std::memory_order_relaxed);
+        sampledCandidates_.fetch_add(last - first);
+    }
+}
+
+// Zeroes the score of the candidates of a range the arm cannot reach
+// Only candidates still scoring are solved, all at once, so that each one starts from the previous solution
+void GraspPlanner::checkReachability(Plan* candidates, std::size_t count) {
+    thread_local std::vector<Pose> targets;
+    thread_local std::vector<std::size_t> indices;
+    thread_local std::vector<double> solutions;
+    thread_local std::vector<std::uint8_t> solved;
+    targets.clear();
+    indices.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        if (candidates[i].score > 0.0) {
+            // Top-down grasp, the tool z axis pointing down
+            targets.push_back(Pose{candidates[i].x, candidates[i].y, candidates[i].z, pi, 0.0, candidates[i].yaw});
+            indices.push_back(i);
+        }
+    }
+    solutions.resize(targets.size() * kinematics_->dof());
+    solved.resize(targets.size());
+    kinematics_->solveBatch(targets.data(), targets.size(), seed_.data(), solutions.data(), solved.data());
+    for (std::size_t n = 0; n < targets.size(); ++n) {
+        if (!solved[n]) {
+            candidates[indices[n]].score = 0.0;
+        }
+    }
+}
+
+// Scores a candidate against the object it was sampled around
+// Grasps close to the object center and aligned with its yaw score best
+double GraspPlanner::scoreCandidate(const Plan& candidate, const Pose& object) const {
+    double r = request_.gripperRadius;
+    for (const Obstacle& o : obstacles_) {
+        double dx = candidate.x - o.x;
+        double dy = candidate.y - o.y;
+        double dz = candidate.z - o.z;
+        double clearance = o.radius + r;
+        if (dx * dx + dy * dy + dz * dz < clearance * clearance) {
+            return 0.0;
+        }
+    }
+    double dx = candidate.x - object.x;
+    double dy = candidate.y - object.y;
+    double offset = request_.sampleRadius > 0.0 ? (dx * dx + dy * dy) / (request_.sampleRadius * request_.sampleRadius) : 0.0;
+    double alignment = std::cos(candidate.yaw - object.yaw);
+    return std::exp(-2.0 * offset) * alignment * alignment;
+}
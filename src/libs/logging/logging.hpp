@@ -0,0 +1,150 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+// Messages below this level are compiled out: 0 debug, 1 info, 2 warning, 3 error
+#ifndef LIBS_LOG_LEVEL
+#define LIBS_LOG_LEVEL 1
+#endif
+
+enum class LogLevel : std::uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3
+};
+
+// Receives each formatted message, from the flushing thread
+using LogSink = std::function<void(LogLevel level, const char* message)>;
+
+// Argument of a message, copied when logged and formatted later
+struct LogArg {
+    enum class Type : std::uint8_t { Int, Uint, Double, Bool, Text };
+
+    Type type;
+    union {
+        std::int64_t i;
+        std::uint64_t u;
+        double d;
+        bool b;
+        struct {
+            std::uint16_t offset;   // Into the text of the record
+            std::uint16_t size;
+        } text;
+    };
+};
+
+// Message waiting to be formatted, the format being a string literal
+struct LogRecord {
+    static const std::size_t maxArgs = 6;
+    static const std::size_t textSize = 96;
+
+    std::int64_t stamp;     // Steady clock time [ns]
+    const char* format;
+    LogLevel level;
+    std::uint8_t argCount;
+    std::uint16_t textUsed;
+    LogArg args[maxArgs];
+    char text[textSize];    // Copies of the string arguments, truncated if too long
+};
+
+// Logger of the manipulation libraries
+// Each thread appends to its own ring without locking; formatting and writing happen on a background thread,
+// so logging from a control loop costs a copy of its arguments. Messages are dropped when a ring is full.
+// Placeholders are written {} and replaced by the arguments in order.
+class Log {
+public:
+    // Sets where messages go, standard output by default; pass nullptr to restore it
+    static void setSink(LogSink sink);
+
+    // Runtime level filter, on top of LIBS_LOG_LEVEL
+    static void setLevel(LogLevel level);
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Sets how often the background thread writes the pending messages
+    static void setFlushPeriod(std::chrono::milliseconds period);
+
+    // Formats and writes all the messages logged so far, from the calling thread
+    static void flush();
+
+    // Number of messages dropped because a ring was full
+    static std::size_t dropped();
+
+    // Logs a message, prefer the LOG_* macros that compile out filtered levels
+    template <typename... Args>
+    static void write(LogLevel level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= LogRecord::maxArgs, "too many log arguments");
+        if (!enabled(level)) {
+            return;
+        }
+        LogRecord* record = begin(level, format);
+        if (record == nullptr) {
+            return;
+        }
+        (capture(*record, args), ...);
+        commit();
+    }
+
+private:
+    // Claims the next slot of the calling thread ring, nullptr if full
+    static LogRecord* begin(LogLevel level, const char* format);
+
+    // Publishes the claimed slot
+    static void commit();
+
+    // Copies a string argument into the record text
+    static void captureText(LogRecord& record, const char* text, std::size_t size);
+
+    template <typename T>
+    static void capture(LogRecord& record, const T& value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "unsupported log argument");
+        LogArg& arg = record.args[record.argCount++];
+        if constexpr (std::is_same<T, bool>::value) {
+            arg.type = LogArg::Type::Bool;
+            arg.b = value;
+        } else if constexpr (std::is_floating_point<T>::value) {
+            arg.type = LogArg::Type::Double;
+            arg.d = static_cast<double>(value);
+        } else if constexpr (std::is_signed<T>::value) {
+            arg.type = LogArg::Type::Int;
+            arg.i = static_cast<std::int64_t>(value);
+        } else {
+            arg.type = LogArg::Type::Uint;
+            arg.u = static_cast<std::uint64_t>(value);
+        }
+    }
+
+    static void capture(LogRecord& record, const char* value);
+    static void capture(LogRecord& record, char* value) {
+        capture(record, static_cast<const char*>(value));
+    }
+    static void capture(LogRecord& record, const std::string& value) {
+        captureText(record, value.data(), value.size());
+    }
+
+    static std::atomic<int> level_;
+};
+
+// Logs at a level, the call vanishing when the level is below LIBS_LOG_LEVEL
+#define LIBS_LOG_AT(level, ...) \
+    do { \
+        if (static_cast<int>(level) >= LIBS_LOG_LEVEL) { \
+            Log::write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) LIBS_LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LIBS_LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LIBS_LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LIBS_LOG_AT(LogLevel::Error, __VA_ARGS__)
+
+#endif // LOGGING_HPP
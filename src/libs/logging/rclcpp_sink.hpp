@@ -0,0 +1,31 @@
+#ifndef LOGGING_RCLCPP_SINK_HPP
+#define LOGGING_RCLCPP_SINK_HPP
+
+// Forwarding of the library messages to a ROS 2 logger, for nodes only:
+// the libraries themselves do not depend on rclcpp
+//     Log::setSink(rclcppSink(node->get_logger()));
+
+#include "logging/logging.hpp"
+
+#include <rclcpp/logging.hpp>
+
+inline LogSink rclcppSink(const rclcpp::Logger& logger) {
+    return [logger](LogLevel level, const char* message) {
+        switch (level) {
+        case LogLevel::Debug:
+            RCLCPP_DEBUG(logger, "%s", message);
+            break;
+        case LogLevel::Info:
+            RCLCPP_INFO(logger, "%s", message);
+            break;
+        case LogLevel::Warn:
+            RCLCPP_WARN(logger, "%s", message);
+            break;
+        case LogLevel::Error:
+            RCLCPP_ERROR(logger, "%s", message);
+            break;
+        }
+    };
+}
+
+#endif // LOGGING_RCLCPP_SINK_HPP
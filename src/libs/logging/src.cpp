@@ -0,0 +1,334 @@
+#include "logging.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<int> Log::level_(static_cast<int>(LogLevel::Info));
+
+namespace {
+
+// Messages of one thread, single producer and single consumer
+struct ThreadRing {
+    explicit ThreadRing(std::size_t capacity) : records(capacity), head(0), tail(0), dropped(0) {}
+
+    std::vector<LogRecord> records;
+    std::atomic<std::uint64_t> head;    // Written by the logging thread
+    std::atomic<std::uint64_t> tail;    // Written by the consumer
+    std::atomic<std::size_t> dropped;
+};
+
+// Never destroyed, so that objects logging from their static destructors find it;
+// the flushing thread is stopped at exit, after which messages are written as they come
+struct Logger {
+    Logger() : period(std::chrono::milliseconds(20)), stop(false) {
+        flusher = std::thread(&Logger::flushRoutine, this);
+        std::atexit([] { instance().shutdown(); });
+    }
+
+    static Logger& instance() {
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    void flushRoutine();
+    void shutdown();
+    void drain();
+    void write(const LogRecord& record);
+
+    // Registered rings, kept until drained after their thread exited
+    std::mutex ringsLock;
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    std::size_t ringSize = 1024;
+
+    // Consumer side, a single one at a time
+    std::mutex drainLock;
+    LogSink sink;
+    std::vector<LogRecord> batch;
+    std::vector<std::shared_ptr<ThreadRing>> snapshot;
+    std::string line;
+    std::string out;
+    std::string err;
+    std::size_t dropped = 0;
+
+    std::mutex flushLock;
+    std::condition_variable flushCv;
+    std::chrono::milliseconds period;
+    bool stop;
+    std::atomic<bool> stopped{false};
+    std::thread flusher;
+};
+
+// Per thread state, trivially destructible so that it stays usable from the destructors
+// of other thread local and static objects; the ring itself is owned by the registry
+thread_local ThreadRing* currentRing = nullptr;
+thread_local bool ringReleased = false;
+thread_local bool directPending = false;
+thread_local LogRecord directRecord;
+
+// Releases the ring of a thread when it exits, the registry drops it once drained
+struct RingOwner {
+    std::shared_ptr<ThreadRing> ring;
+
+    ~RingOwner() {
+        currentRing = nullptr;
+        ringReleased = true;
+    }
+};
+
+// Ring of the calling thread, registered on first use, nullptr once the thread is exiting
+ThreadRing* threadRing() {
+    if (currentRing != nullptr || ringReleased) {
+        return currentRing;
+    }
+    thread_local RingOwner owner;
+    Logger& logger = Logger::instance();
+    std::lock_guard<std::mutex> lock(logger.ringsLock);
+    owner.ring = std::make_shared<ThreadRing>(logger.ringSize);
+    logger.rings.push_back(owner.ring);
+    currentRing = owner.ring.get();
+    return currentRing;
+}
+
+const char* levelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug:
+        return "DEBUG";
+    case LogLevel::Info:
+        return "INFO";
+    case LogLevel::Warn:
+        return "WARN";
+    default:
+        return "ERROR";
+    }
+}
+
+// Replaces each {} of the format by the next argument
+void format(const LogRecord& record, std::string& line) {
+    char number[32];
+    std::size_t next = 0;
+    for (const char* c = record.format; *c; ++c) {
+        if (c[0] != '{' || c[1] != '}' || next >= record.argCount) {
+            line.push_back(*c);
+            continue;
+        }
+        const LogArg& arg = record.args[next++];
+        ++c;
+        switch (arg.type) {
+        case LogArg::Type::Int:
+            std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(arg.i));
+            line += number;
+            break;
+        case LogArg::Type::Uint:
+            std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(arg.u));
+            line += number;
+            break;
+        case LogArg::Type::Double:
+            std::snprintf(number, sizeof(number), "%g", arg.d);
+            line += number;
+            break;
+        case LogArg::Type::Bool:
+            line += arg.b ? "true" : "false";
+            break;
+        case LogArg::Type::Text:
+            line.append(record.text + arg.text.offset, arg.text.size);
+            break;
+        }
+    }
+}
+
+// Background routine, woken up every period or to stop
+void Logger::flushRoutine() {
+    std::unique_lock<std::mutex> lock(flushLock);
+    while (!stop) {
+        flushCv.wait_for(lock, period, [this] { return stop; });
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+// Stops the background thread and writes what is left
+void Logger::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(flushLock);
+        stop = true;
+    }
+    flushCv.notify_one();
+    flusher.join();
+    stopped.store(true, std::memory_order_release);
+    drain();
+}
+
+// Takes the pending messages of all rings, then formats and writes them in time order
+void Logger::drain() {
+    std::lock_guard<std::mutex> lock(drainLock);
+    {
+        std::lock_guard<std::mutex> ringsGuard(ringsLock);
+        snapshot = rings;
+    }
+    batch.clear();
+    for (const auto& ring : snapshot) {
+        const std::uint64_t capacity = ring->records.size();
+        const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+        std::uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail < head; ++tail) {
+            batch.push_back(ring->records[tail % capacity]);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+        dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    {
+        // Rings only referenced here belong to threads that exited, and were just emptied
+        std::lock_guard<std::mutex> ringsGuard(ringsLock);
+        snapshot.clear();
+        rings.erase(std::remove_if(rings.begin(), rings.end(),
+            [](const std::shared_ptr<ThreadRing>& ring) {
+                return ring.use_count() == 1 && ring->tail.load() == ring->head.load();
+            }), rings.end());
+    }
+    if (batch.empty()) {
+        return;
+    }
+    std::stable_sort(batch.begin(), batch.end(),
+        [](const LogRecord& a, const LogRecord& b) { return a.stamp < b.stamp; });
+
+    out.clear();
+    err.clear();
+    for (const LogRecord& record : batch) {
+        line.clear();
+        format(record, line);
+        if (sink) {
+            sink(record.level, line.c_str());
+            continue;
+        }
+        std::string& stream = record.level >= LogLevel::Warn ? err : out;
+        stream += '[';
+        stream += levelName(record.level);
+        stream += "] ";
+        stream += line;
+        stream += '\n';
+    }
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+    }
+}
+
+}
+
+// Writes a single message right away, after the pending ones
+void Logger::write(const LogRecord& record) {
+    drain();
+    std::lock_guard<std::mutex> lock(drainLock);
+    line.clear();
+    format(record, line);
+    if (sink) {
+        sink(record.level, line.c_str());
+        return;
+    }
+    std::fprintf(record.level >= LogLevel::Warn ? stderr : stdout, "[%s] %s\n", levelName(record.level), line.c_str());
+    std::fflush(stdout);
+}
+
+// Sets where messages go
+void Log::setSink(LogSink sink) {
+    Logger& logger = Logger::instance();
+    std::lock_guard<std::mutex> lock(logger.drainLock);
+    logger.sink = std::move(sink);
+}
+
+// Runtime level filter
+void Log::setLevel(LogLevel level) {
+    level_.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+// Sets how often the background thread writes the pending messages
+void Log::setFlushPeriod(std::chrono::milliseconds period) {
+    Logger& logger = Logger::instance();
+    {
+        std::lock_guard<std::mutex> lock(logger.flushLock);
+        logger.period = period;
+    }
+    logger.flushCv.notify_one();
+}
+
+// Formats and writes all the messages logged so far
+void Log::flush() {
+    Logger::instance().drain();
+}
+
+// Number of messages dropped because a ring was full
+std::size_t Log::dropped() {
+    Logger& logger = Logger::instance();
+    std::size_t total;
+    {
+        std::lock_guard<std::mutex> lock(logger.drainLock);
+        total = logger.dropped;
+    }
+    std::lock_guard<std::mutex> lock(logger.ringsLock);
+    for (const auto& ring : logger.rings) {
+        total += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// Claims the next slot of the calling thread ring
+// Once the background thread is gone or the thread is exiting, the message is written directly instead
+LogRecord* Log::begin(LogLevel level, const char* format) {
+    ThreadRing* ring = threadRing();
+    LogRecord* slot;
+    if (ring == nullptr || Logger::instance().stopped.load(std::memory_order_acquire)) {
+        directPending = true;
+        slot = &directRecord;
+    } else {
+        const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->tail.load(std::memory_order_acquire) >= ring->records.size()) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        slot = &ring->records[head % ring->records.size()];
+    }
+    LogRecord& record = *slot;
+    record.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    record.format = format;
+    record.level = level;
+    record.argCount = 0;
+    record.textUsed = 0;
+    return &record;
+}
+
+// Publishes the claimed slot
+void Log::commit() {
+    if (directPending) {
+        directPending = false;
+        Logger::instance().write(directRecord);
+        return;
+    }
+    ThreadRing* ring = currentRing;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Copies a string argument into the record text
+void Log::captureText(LogRecord& record, const char* text, std::size_t size) {
+    LogArg& arg = record.args[record.argCount++];
+    arg.type = LogArg::Type::Text;
+    size = std::min(size, LogRecord::textSize - record.textUsed);
+    std::memcpy(record.text + record.textUsed, text, size);
+    arg.text.offset = record.textUsed;
+    arg.text.size = static_cast<std::uint16_t>(size);
+    record.textUsed = static_cast<std::uint16_t>(record.textUsed + size);
+}
+
+void Log::capture(LogRecord& record, const char* value) {
+    captureText(record, value != nullptr ? value : "(null)", value != nullptr ? std::strlen(value) : 6);
+}
@@ -0,0 +1,272 @@
+#include "collision_world.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const float infinity = std::numeric_limits<float>::infinity();
+
+// Lower envelope of parabolas, see Felzenszwalb and Huttenlocher, Distance Transforms of Sampled Functions
+void distanceTransform1d(const float* f, int n, float* d, int* v, float* z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -infinity;
+    z[1] = infinity;
+    for (int q = 1; q < n; ++q) {
+        if (f[q] == infinity) {
+            continue;
+        }
+        if (f[v[k]] == infinity) {
+            v[k] = q;
+            continue;
+        }
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k]) {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        float dq = static_cast<float>(q - v[k]);
+        d[q] = f[v[k]] == infinity ? infinity : dq * dq + f[v[k]];
+    }
+}
+
+}
+
+// Constructor
+CollisionWorld::CollisionWorld(const double origin[3], const double size[3], double resolution, double truncation)
+    : resolution_(resolution), inverseResolution_(static_cast<float>(1.0 / resolution)), truncation_(static_cast<float>(truncation)) {
+    for (int i = 0; i < 3; ++i) {
+        origin_[i] = origin[i];
+    }
+    nx_ = std::max(1, static_cast<int>(std::ceil(size[0] / resolution)));
+    ny_ = std::max(1, static_cast<int>(std::ceil(size[1] / resolution)));
+    nz_ = std::max(1, static_cast<int>(std::ceil(size[2] / resolution)));
+    occupancy_.assign(static_cast<std::size_t>(nx_) * ny_ * nz_, 0);
+    distance_.assign(occupancy_.size(), truncation_);
+    int longest = std::max(nx_, std::max(ny_, nz_));
+    line_.resize(longest);
+    lineOut_.resize(longest);
+    parabolas_.resize(longest);
+    bounds_.resize(longest + 1);
+    dirtyLo_[0] = dirtyLo_[1] = dirtyLo_[2] = std::numeric_limits<int>::max();
+    dirtyHi_[0] = dirtyHi_[1] = dirtyHi_[2] = std::numeric_limits<int>::min();
+}
+
+// Methods to edit the occupancy
+void CollisionWorld::addBox(const double min[3], const double max[3]) {
+    setBox(min, max, 1);
+}
+
+void CollisionWorld::clearBox(const double min[3], const double max[3]) {
+    setBox(min, max, 0);
+}
+
+void CollisionWorld::addSphere(const double center[3], double radius) {
+    double min[3], max[3];
+    for (int i = 0; i < 3; ++i) {
+        min[i] = center[i] - radius;
+        max[i] = center[i] + radius;
+    }
+    int lo[3], hi[3];
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = static_cast<int>(std::floor((min[i] - origin_[i]) / resolution_));
+        hi[i] = static_cast<int>(std::floor((max[i] - origin_[i]) / resolution_));
+    }
+    const int n[3] = {nx_, ny_, nz_};
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = std::max(lo[i], 0);
+        hi[i] = std::min(hi[i], n[i] - 1);
+    }
+    for (int z = lo[2]; z <= hi[2]; ++z) {
+        for (int y = lo[1]; y <= hi[1]; ++y) {
+            for (int x = lo[0]; x <= hi[0]; ++x) {
+                double dx = origin_[0] + (x + 0.5) * resolution_ - center[0];
+                double dy = origin_[1] + (y + 0.5) * resolution_ - center[1];
+                double dz = origin_[2] + (z + 0.5) * resolution_ - center[2];
+                if (dx * dx + dy * dy + dz * dz <= radius * radius) {
+                    occupancy_[index(x, y, z)] = 1;
+                    markDirty(x, y, z);
+                }
+            }
+        }
+    }
+}
+
+// Marks the cells of points, e.g. a downsampled cloud from perception, as occupied
+void CollisionWorld::addPoints(const float* xyz, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        int x = static_cast<int>(std::floor((xyz[3 * i] - origin_[0]) * inverseResolution_));
+        int y = static_cast<int>(std::floor((xyz[3 * i + 1] - origin_[1]) * inverseResolution_));
+        int z = static_cast<int>(std::floor((xyz[3 * i + 2] - origin_[2]) * inverseResolution_));
+        if (x < 0 || y < 0 || z < 0 || x >= nx_ || y >= ny_ || z >= nz_) {
+            continue;
+        }
+        std::uint8_t& cell = occupancy_[index(x, y, z)];
+        if (!cell) {
+            cell = 1;
+            markDirty(x, y, z);
+        }
+    }
+}
+
+void CollisionWorld::clear() {
+    std::fill(occupancy_.begin(), occupancy_.end(), 0);
+    std::fill(distance_.begin(), distance_.end(), truncation_);
+    dirtyLo_[0] = dirtyLo_[1] = dirtyLo_[2] = std::numeric_limits<int>::max();
+    dirtyHi_[0] = dirtyHi_[1] = dirtyHi_[2] = std::numeric_limits<int>::min();
+}
+
+// Marks the cells of a box as occupied or free
+void CollisionWorld::setBox(const double min[3], const double max[3], std::uint8_t occupied) {
+    int lo[3], hi[3];
+    const int n[3] = {nx_, ny_, nz_};
+    for (int i = 0; i < 3; ++i) {
+        lo[i] = std::max(0, static_cast<int>(std::floor((min[i] - origin_[i]) / resolution_)));
+        hi[i] = std::min(n[i] - 1, static_cast<int>(std::floor((max[i] - origin_[i]) / resolution_)));
+        if (lo[i] > hi[i]) {
+            return;
+        }
+    }
+    for (int z = lo[2]; z <= hi[2]; ++z) {
+        for (int y = lo[1]; y <= hi[1]; ++y) {
+            std::fill_n(occupancy_.begin() + index(lo[0], y, z), hi[0] - lo[0] + 1, occupied);
+        }
+    }
+    markDirty(lo[0], lo[1], lo[2]);
+    markDirty(hi[0], hi[1], hi[2]);
+}
+
+// Extends the dirty region by a cell
+void CollisionWorld::markDirty(int x, int y, int z) {
+    const int c[3] = {x, y, z};
+    for (int i = 0; i < 3; ++i) {
+        dirtyLo_[i] = std::min(dirtyLo_[i], c[i]);
+        dirtyHi_[i] = std::max(dirtyHi_[i], c[i]);
+    }
+}
+
+// Recomputes the distance field around the edited cells
+// Values are truncated, so an edit only changes the field within the truncation distance of it,
+// and those values only depend on the cells within twice that distance
+void CollisionWorld::update() {
+    if (dirtyLo_[0] > dirtyHi_[0]) {
+        return;
+    }
+    const int reach = static_cast<int>(std::ceil(truncation_ * inverseResolution_)) + 1;
+    const int n[3] = {nx_, ny_, nz_};
+    int lo[3], hi[3], writeLo[3], writeHi[3];
+    for (int i = 0; i < 3; ++i) {
+        writeLo[i] = std::max(0, dirtyLo_[i] - reach);
+        writeHi[i] = std::min(n[i], dirtyHi_[i] + reach + 1);
+        lo[i] = std::max(0, dirtyLo_[i] - 2 * reach);
+        hi[i] = std::min(n[i], dirtyHi_[i] + 2 * reach + 1);
+    }
+    computeRegion(lo, hi, writeLo, writeHi);
+    dirtyLo_[0] = dirtyLo_[1] = dirtyLo_[2] = std::numeric_limits<int>::max();
+    dirtyHi_[0] = dirtyHi_[1] = dirtyHi_[2] = std::numeric_limits<int>::min();
+}
+
+// Squared Euclidean distance transforms of the occupied and free cells over a region, axis after axis
+// Free cells get their distance to the nearest occupied cell, occupied cells minus their distance to the nearest free one
+void CollisionWorld::computeRegion(const int lo[3], const int hi[3], const int writeLo[3], const int writeHi[3]) {
+    const int sx = hi[0] - lo[0];
+    const int sy = hi[1] - lo[1];
+    const int sz = hi[2] - lo[2];
+    const std::size_t cells = static_cast<std::size_t>(sx) * sy * sz;
+    outside_.resize(cells);
+    inside_.resize(cells);
+    auto local = [sx, sy](int x, int y, int z) { return (static_cast<std::size_t>(z) * sy + y) * sx + x; };
+
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<float>& field = pass == 0 ? outside_ : inside_;
+        const std::uint8_t target = pass == 0 ? 1 : 0;
+        for (int z = 0; z < sz; ++z) {
+            for (int y = 0; y < sy; ++y) {
+                const std::uint8_t* row = occupancy_.data() + index(lo[0], lo[1] + y, lo[2] + z);
+                for (int x = 0; x < sx; ++x) {
+                    line_[x] = row[x] == target ? 0.0f : infinity;
+                }
+                distanceTransform1d(line_.data(), sx, field.data() + local(0, y, z), parabolas_.data(), bounds_.data());
+            }
+        }
+        for (int z = 0; z < sz; ++z) {
+            for (int x = 0; x < sx; ++x) {
+                for (int y = 0; y < sy; ++y) {
+                    line_[y] = field[local(x, y, z)];
+                }
+                distanceTransform1d(line_.data(), sy, lineOut_.data(), parabolas_.data(), bounds_.data());
+                for (int y = 0; y < sy; ++y) {
+                    field[local(x, y, z)] = lineOut_[y];
+                }
+            }
+        }
+        for (int y = 0; y < sy; ++y) {
+            for (int x = 0; x < sx; ++x) {
+                for (int z = 0; z < sz; ++z) {
+                    line_[z] = field[local(x, y, z)];
+                }
+                distanceTransform1d(line_.data(), sz, lineOut_.data(), parabolas_.data(), bounds_.data());
+                for (int z = 0; z < sz; ++z) {
+                    field[local(x, y, z)] = lineOut_[z];
+                }
+            }
+        }
+    }
+
+    const float scale = static_cast<float>(resolution_);
+    for (int z = writeLo[2]; z < writeHi[2]; ++z) {
+        for (int y = writeLo[1]; y < writeHi[1]; ++y) {
+            for (int x = writeLo[0]; x < writeHi[0]; ++x) {
+                std::size_t l = local(x - lo[0], y - lo[1], z - lo[2]);
+                float d = occupancy_[index(x, y, z)] ? -std::sqrt(inside_[l]) : std::sqrt(outside_[l]);
+                distance_[index(x, y, z)] = std::max(-truncation_, std::min(truncation_, d * scale));
+            }
+        }
+    }
+}
+
+// Smallest clearance between a set of spheres and the obstacles
+// Cell indices are computed for a block of spheres at once, in a loop the compiler vectorizes,
+// before the distances are gathered
+float CollisionWorld::clearance(const float* x, const float* y, const float* z, const float* radius, std::size_t count) const {
+    const std::size_t block = 64;
+    std::int32_t cell[block];
+    const float ox = static_cast<float>(origin_[0]);
+    const float oy = static_cast<float>(origin_[1]);
+    const float oz = static_cast<float>(origin_[2]);
+    const float inverse = inverseResolution_;
+    const std::int32_t nx = nx_, ny = ny_, nz = nz_;
+    const float halfDiagonal = static_cast<float>(0.5 * std::sqrt(3.0) * resolution_);
+    float result = truncation_;
+
+    for (std::size_t first = 0; first < count; first += block) {
+        const std::size_t n = std::min(block, count - first);
+        for (std::size_t i = 0; i < n; ++i) {
+            std::int32_t ix = static_cast<std::int32_t>((x[first + i] - ox) * inverse + 1.0f) - 1;
+            std::int32_t iy = static_cast<std::int32_t>((y[first + i] - oy) * inverse + 1.0f) - 1;
+            std::int32_t iz = static_cast<std::int32_t>((z[first + i] - oz) * inverse + 1.0f) - 1;
+            bool inside = (ix >= 0) & (iy >= 0) & (iz >= 0) & (ix < nx) & (iy < ny) & (iz < nz);
+            cell[i] = inside ? (iz * ny + iy) * nx + ix : -1;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            float d = cell[i] >= 0 ? distance_[cell[i]] : truncation_;
+            result = std::min(result, d - radius[first + i] - halfDiagonal);
+        }
+    }
+    return result;
+}
+
+float CollisionWorld::clearance(const SphereSet& spheres) const {
+    return clearance(spheres.x.data(), spheres.y.data(), spheres.z.data(), spheres.radius.data(), spheres.size());
+}
@@ -0,0 +1,110 @@
+#ifndef COLLISION_WORLD_HPP
+#define COLLISION_WORLD_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Spheres approximating the arm links, stored as separate arrays for batched queries
+struct SphereSet {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+
+    void resize(std::size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+    }
+
+    std::size_t size() const { return x.size(); }
+};
+
+// Voxelized scene with a truncated signed distance field, positive outside obstacles
+// Obstacles are edited cell by cell and the field is only recomputed around the edited cells
+class CollisionWorld {
+public:
+    // Constructor, the grid covering size [m] from origin [m] with cubic cells of resolution [m]
+    CollisionWorld(const double origin[3], const double size[3], double resolution, double truncation = 0.2);
+
+    // Methods to edit the occupancy, applied to the field by update()
+    void addBox(const double min[3], const double max[3]);
+    void addSphere(const double center[3], double radius);
+    void addPoints(const float* xyz, std::size_t count);
+    void clearBox(const double min[3], const double max[3]);
+    void clear();
+
+    // Recomputes the distance field around the cells edited since the last update
+    void update();
+
+    // Signed distance at a point [m], the truncation distance outside the grid
+    float distance(float x, float y, float z) const;
+
+    // Smallest clearance between a set of spheres and the obstacles [m], negative when colliding
+    // Distances are read at the cell of each center and made conservative by half a cell diagonal
+    float clearance(const float* x, const float* y, const float* z, const float* radius, std::size_t count) const;
+    float clearance(const SphereSet& spheres) const;
+
+    // Largest clearance the field can report for a sphere of a radius [m]: distances are truncated,
+    // so margins at or above it make every configuration collide
+    float maxClearance(float radius = 0.0f) const {
+        return truncation_ - radius - static_cast<float>(0.5 * std::sqrt(3.0) * resolution_);
+    }
+
+    double resolution() const { return resolution_; }
+
+private:
+
+    // Index of a cell
+    std::size_t index(int x, int y, int z) const {
+        return (static_cast<std::size_t>(z) * ny_ + y) * nx_ + x;
+    }
+
+    // Marks the cells of a box as occupied or free
+    void setBox(const double min[3], const double max[3], std::uint8_t occupied);
+
+    // Extends the dirty region by a cell
+    void markDirty(int x, int y, int z);
+
+    // Squared Euclidean distance transforms of the occupied and free cells over a region
+    void computeRegion(const int lo[3], const int hi[3], const int writeLo[3], const int writeHi[3]);
+
+    double origin_[3];
+    double resolution_;
+    float inverseResolution_;
+    float truncation_;
+    int nx_;
+    int ny_;
+    int nz_;
+
+    std::vector<std::uint8_t> occupancy_;
+    std::vector<float> distance_;
+
+    // Bounding box of the cells edited since the last update, empty if lo > hi
+    int dirtyLo_[3];
+    int dirtyHi_[3];
+
+    // Scratch lines of the distance transform
+    std::vector<float> line_;
+    std::vector<float> lineOut_;
+    std::vector<int> parabolas_;
+    std::vector<float> bounds_;
+    std::vector<float> outside_;
+    std::vector<float> inside_;
+};
+
+// Signed distance at a point, inline since planners query it in their innermost loops
+inline float CollisionWorld::distance(float x, float y, float z) const {
+    int ix = static_cast<int>(std::floor((x - static_cast<float>(origin_[0])) * inverseResolution_));
+    int iy = static_cast<int>(std::floor((y - static_cast<float>(origin_[1])) * inverseResolution_));
+    int iz = static_cast<int>(std::floor((z - static_cast<float>(origin_[2])) * inverseResolution_));
+    if (ix < 0 || iy < 0 || iz < 0 || ix >= nx_ || iy >= ny_ || iz >= nz_) {
+        return truncation_;
+    }
+    return distance_[index(ix, iy, iz)];
+}
+
+#endif // COLLISION_WORLD_HPP
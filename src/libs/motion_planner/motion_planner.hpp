@@ -2,6 +2,21 @@
 #define MOTION_PLANNER_HPP
 
 #include "robot_motion_planner/robot_motion_planner.hpp"
+#include "motion_planner/collision_world.hpp"
+#include "motion_planner/path_planner.hpp"
+#include "motion_planner/trapezoid_profile.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// How planPath picks among the restarts
+enum class PathSelection {
+    First,  // First feasible path found
+    Best    // Shortest feasible path found by the deadline
+};
 
 // MotionPlanner class
 class MotionPlanner {
@@ -15,13 +30,59 @@ public:
     // Method to compute a trajectory
     Trajectory computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal);
 
+    // Method to compute a trajectory into a caller-provided one, reusing its storage
+    // Samples are stored joint after joint for each time step, every samplePeriod seconds
+    bool computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal, Trajectory& trajectory);
+
+    // Method to compute a trajectory with one array per joint and explicit sample times
+    bool computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal, JointTrajectory& trajectory);
+
+    // Method to compute a trajectory through a path, stopping at each waypoint
+    bool computeTrajectory(const JointPath& path, JointTrajectory& trajectory);
+
+    // Method to plan around obstacles with a registered planner, running restarts in parallel threads
+    // Returns false if no feasible path was found before the deadline
+    bool planPath(const std::string& planner, const std::vector<double>& start, const std::vector<double>& goal,
+                  std::size_t restarts, std::chrono::steady_clock::duration timeout, PathSelection selection,
+                  JointTrajectory& trajectory);
+
+    // Methods to configure the joint limits and the sampling period
+    void setLimits(double maxVelocity, double maxAcceleration);
+    void setSamplePeriod(double samplePeriod);
+
+    // Method to set the scene and arm model used to validate and plan trajectories, the world must outlive the planner
+    // Throws std::invalid_argument if the world truncates distances below the margin planners need
+    void setCollisionWorld(const CollisionWorld* world, SphereModel model, double margin = 0.0);
+
+    // Method to set the joint bounds sampled by the planners
+    void setJointBounds(const std::vector<double>& lower, const std::vector<double>& upper);
+
+    // Method to check a trajectory against the collision world every stride samples
+    // Returns false and the first colliding sample if the arm comes closer than the margin to an obstacle
+    bool validateTrajectory(const JointTrajectory& trajectory, std::size_t stride = 1, std::size_t* collision = nullptr);
+
 private:
 
+    // Plans the profiles of all joints, returning the trajectory duration or a negative value on failure
+    double planProfiles(const std::vector<double>& start, const std::vector<double>& goal);
+
+    // Number of samples of a trajectory
+    size_t sampleCount(double duration) const;
+
     // Configuration parameters
     double max_velocity_;
     double max_acceleration_;
+    double sample_period_;
     Trajectory trajectoryPlan;
     RobotMotionPlanner& robotMotionPlanner_;
+
+    // Per-joint profiles of the last computed trajectory, kept to avoid reallocations
+    std::vector<TrapezoidProfile> profiles_;
+
+    // Collision checking and path planning
+    PlanningContext context_;
+    SphereSet spheres_;
+    std::vector<double> joints_;
 };
 
 #endif // MOTION_PLANNER_HPP
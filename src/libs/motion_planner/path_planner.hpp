@@ -0,0 +1,75 @@
+#ifndef PATH_PLANNER_HPP
+#define PATH_PLANNER_HPP
+
+#include "motion_planner/collision_world.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Fills the spheres approximating the arm links at given joint positions, e.g. from forward kinematics
+// Called concurrently by the planner restarts, each with its own sphere set
+using SphereModel = std::function<void(const double* joints, std::size_t dof, SphereSet& spheres)>;
+
+// Joint space path, from the start to the goal
+using JointPath = std::vector<std::vector<double>>;
+
+// Scene, arm model and joint bounds shared by the planners
+struct PlanningContext {
+    const CollisionWorld* world;
+    SphereModel sphereModel;
+    double margin;                  // Minimum clearance of the arm to obstacles [m]
+    std::vector<double> lower;      // Joint bounds
+    std::vector<double> upper;
+    double resolution;              // Largest joint step between collision checks along a motion [rad]
+
+    // Clearance of the arm at a configuration, infinite without a world or arm model
+    float clearance(const double* joints, std::size_t dof, SphereSet& spheres) const {
+        if (world == nullptr || !sphereModel) {
+            return std::numeric_limits<float>::infinity();
+        }
+        sphereModel(joints, dof, spheres);
+        return world->clearance(spheres);
+    }
+
+    // Checks a configuration, or a straight joint space motion checked every resolution
+    bool valid(const std::vector<double>& joints, SphereSet& spheres) const;
+    bool motionValid(const std::vector<double>& from, const std::vector<double>& to, SphereSet& spheres) const;
+};
+
+// Path planner abstract base class, to be created through the registry below
+// Built-in planners are "rrt_connect" and "chomp"
+class PathPlanner {
+public:
+    // Necessary since the registry creates planners without parameters
+    virtual void init(const PlanningContext& context) = 0;
+
+    // Plans a collision free path, stopping at the deadline or once stop is set
+    // The seed makes restarts explore differently
+    virtual bool plan(const std::vector<double>& start, const std::vector<double>& goal, std::uint64_t seed,
+                      std::chrono::steady_clock::time_point deadline, const std::atomic<bool>& stop, JointPath& path) = 0;
+
+    // Has to be virtual to comply with C++ specification
+    virtual ~PathPlanner() {}
+
+protected:
+    PathPlanner() {}
+};
+
+using PathPlannerFactory = std::function<std::unique_ptr<PathPlanner>()>;
+
+// Registers a planner under a name, so planners can be added from their own translation units
+void registerPathPlanner(const std::string& name, PathPlannerFactory factory);
+
+// Creates a registered planner, nullptr if unknown
+std::unique_ptr<PathPlanner> createPathPlanner(const std::string& name);
+
+// Joint space length of a path
+double pathLength(const JointPath& path);
+
+#endif // PATH_PLANNER_HPP
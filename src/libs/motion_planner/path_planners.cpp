@@ -0,0 +1,411 @@
+#include "motion_planner/path_planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <mutex>
+
+// Checks a configuration against the joint bounds and the obstacles
+bool PlanningContext::valid(const std::vector<double>& joints, SphereSet& spheres) const {
+    for (std::size_t j = 0; j < joints.size(); ++j) {
+        if (j < lower.size() && (joints[j] < lower[j] || joints[j] > upper[j])) {
+            return false;
+        }
+    }
+    return clearance(joints.data(), joints.size(), spheres) >= margin;
+}
+
+// Checks a straight joint space motion every resolution, the end configuration included
+bool PlanningContext::motionValid(const std::vector<double>& from, const std::vector<double>& to, SphereSet& spheres) const {
+    const std::size_t dof = from.size();
+    double largest = 0.0;
+    for (std::size_t j = 0; j < dof; ++j) {
+        largest = std::max(largest, std::abs(to[j] - from[j]));
+    }
+    const std::size_t steps = std::max<std::size_t>(static_cast<std::size_t>(std::ceil(largest / resolution)), 1);
+    thread_local std::vector<double> joints;
+    joints.resize(dof);
+    for (std::size_t s = 1; s <= steps; ++s) {
+        const double t = static_cast<double>(s) / static_cast<double>(steps);
+        for (std::size_t j = 0; j < dof; ++j) {
+            joints[j] = from[j] + t * (to[j] - from[j]);
+        }
+        if (clearance(joints.data(), dof, spheres) < margin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Joint space length of a path
+double pathLength(const JointPath& path) {
+    double length = 0.0;
+    for (std::size_t i = 1; i < path.size(); ++i) {
+        double squared = 0.0;
+        for (std::size_t j = 0; j < path[i].size(); ++j) {
+            const double d = path[i][j] - path[i - 1][j];
+            squared += d * d;
+        }
+        length += std::sqrt(squared);
+    }
+    return length;
+}
+
+namespace {
+
+// Small, fast generator, one per planner so restarts never share state
+class Random {
+public:
+    explicit Random(std::uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [lo, hi)
+    double uniform(double lo, double hi) {
+        return lo + (hi - lo) * static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    std::uint64_t state_;
+};
+
+// Bidirectional RRT, growing trees from the start and the goal towards random samples
+// and greedily connecting them, then shortcutting the path
+class RrtConnect : public PathPlanner {
+public:
+    void init(const PlanningContext& context) override {
+        context_ = &context;
+        dof_ = context.lower.size();
+    }
+
+    bool plan(const std::vector<double>& start, const std::vector<double>& goal, std::uint64_t seed,
+              std::chrono::steady_clock::time_point deadline, const std::atomic<bool>& stop, JointPath& path) override {
+        Random random(seed);
+        Tree trees[2];
+        trees[0].add(start, -1);
+        trees[1].add(goal, -1);
+        std::vector<double> sample(dof_);
+        std::vector<double> target(dof_);
+
+        Tree* a = &trees[0];
+        Tree* b = &trees[1];
+        while (!stop.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() < deadline) {
+            for (std::size_t j = 0; j < dof_; ++j) {
+                sample[j] = random.uniform(context_->lower[j], context_->upper[j]);
+            }
+            int added = extend(*a, sample);
+            if (added >= 0) {
+                // Connect the other tree to the new node as far as the obstacles allow
+                a->copy(added, target);
+                int reached = -1;
+                while (true) {
+                    int node = extend(*b, target);
+                    if (node < 0) {
+                        break;
+                    }
+                    if (b->distance(node, target) < 1e-9) {
+                        reached = node;
+                        break;
+                    }
+                }
+                if (reached >= 0) {
+                    const bool forward = a == &trees[0];
+                    buildPath(forward ? *a : *b, forward ? added : reached, forward ? *b : *a, forward ? reached : added, path);
+                    shortcut(random, deadline, stop, path);
+                    return true;
+                }
+            }
+            std::swap(a, b);
+        }
+        return false;
+    }
+
+private:
+    // Nodes stored contiguously, one row of dof values per node
+    struct Tree {
+        std::vector<double> nodes;
+        std::vector<int> parents;
+        std::size_t dof = 0;
+
+        int add(const std::vector<double>& q, int parent) {
+            dof = q.size();
+            nodes.insert(nodes.end(), q.begin(), q.end());
+            parents.push_back(parent);
+            return static_cast<int>(parents.size()) - 1;
+        }
+
+        void copy(int node, std::vector<double>& q) const {
+            q.assign(nodes.begin() + node * dof, nodes.begin() + (node + 1) * dof);
+        }
+
+        double distance(int node, const std::vector<double>& q) const {
+            const double* p = nodes.data() + node * dof;
+            double squared = 0.0;
+            for (std::size_t j = 0; j < dof; ++j) {
+                squared += (p[j] - q[j]) * (p[j] - q[j]);
+            }
+            return squared;
+        }
+
+        // Linear scan, the trees stay small within planning deadlines
+        int nearest(const std::vector<double>& q) const {
+            int best = 0;
+            double bestDistance = std::numeric_limits<double>::max();
+            for (std::size_t n = 0; n < parents.size(); ++n) {
+                double d = distance(static_cast<int>(n), q);
+                if (d < bestDistance) {
+                    bestDistance = d;
+                    best = static_cast<int>(n);
+                }
+            }
+            return best;
+        }
+    };
+
+    // Steps the nearest node towards q, returns the new node or -1 if the step collides
+    int extend(Tree& tree, const std::vector<double>& q) {
+        int near = tree.nearest(q);
+        tree.copy(near, from_);
+        double length = std::sqrt(tree.distance(near, q));
+        to_ = q;
+        if (length > stepSize) {
+            for (std::size_t j = 0; j < dof_; ++j) {
+                to_[j] = from_[j] + (q[j] - from_[j]) * stepSize / length;
+            }
+        }
+        if (length < 1e-12 || !context_->motionValid(from_, to_, spheres_)) {
+            return -1;
+        }
+        return tree.add(to_, near);
+    }
+
+    // Joins the branch of the start tree and the branch of the goal tree
+    void buildPath(const Tree& startTree, int startNode, const Tree& goalTree, int goalNode, JointPath& path) {
+        path.clear();
+        std::vector<double> q;
+        for (int n = startNode; n >= 0; n = startTree.parents[n]) {
+            startTree.copy(n, q);
+            path.push_back(q);
+        }
+        std::reverse(path.begin(), path.end());
+        for (int n = goalTree.parents[goalNode]; n >= 0; n = goalTree.parents[n]) {
+            goalTree.copy(n, q);
+            path.push_back(q);
+        }
+    }
+
+    // Random shortcuts, removing the waypoints between two directly connectable ones
+    void shortcut(Random& random, std::chrono::steady_clock::time_point deadline, const std::atomic<bool>& stop, JointPath& path) {
+        for (int attempt = 0; attempt < shortcutAttempts && path.size() > 2; ++attempt) {
+            if (stop.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            std::size_t i = static_cast<std::size_t>(random.next() % path.size());
+            std::size_t k = static_cast<std::size_t>(random.next() % path.size());
+            if (i > k) {
+                std::swap(i, k);
+            }
+            if (k - i < 2 || !context_->motionValid(path[i], path[k], spheres_)) {
+                continue;
+            }
+            path.erase(path.begin() + i + 1, path.begin() + k);
+        }
+    }
+
+    static constexpr double stepSize = 0.2;     // [rad]
+    static constexpr int shortcutAttempts = 100;
+
+    const PlanningContext* context_ = nullptr;
+    std::size_t dof_ = 0;
+    SphereSet spheres_;
+    std::vector<double> from_;
+    std::vector<double> to_;
+};
+
+// CHOMP style trajectory optimization over a fixed number of waypoints
+// Gradient steps on an obstacle cost, preconditioned by the inverse of the smoothness metric,
+// starting from the straight line perturbed differently for every seed
+class Chomp : public PathPlanner {
+public:
+    void init(const PlanningContext& context) override {
+        context_ = &context;
+        dof_ = context.lower.size();
+    }
+
+    bool plan(const std::vector<double>& start, const std::vector<double>& goal, std::uint64_t seed,
+              std::chrono::steady_clock::time_point deadline, const std::atomic<bool>& stop, JointPath& path) override {
+        Random random(seed);
+        const std::size_t n = waypoints;
+        const double epsilon = context_->margin + clearanceBuffer;
+
+        // Waypoints of the interior, row per waypoint
+        q_.resize(n * dof_);
+        gradient_.resize(n * dof_);
+        obstacle_.resize(dof_);
+        tangent_.resize(dof_);
+        for (std::size_t j = 0; j < dof_; ++j) {
+            // Half sine bump of random amplitude, none for the first restart
+            const double amplitude = seed > 1 ? random.uniform(-1.0, 1.0) * perturbation : 0.0;
+            for (std::size_t i = 0; i < n; ++i) {
+                const double t = static_cast<double>(i + 1) / static_cast<double>(n + 1);
+                q_[i * dof_ + j] = start[j] + t * (goal[j] - start[j]) + amplitude * std::sin(M_PI * t);
+            }
+        }
+
+        for (int iteration = 0; iteration < maxIterations; ++iteration) {
+            if (stop.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            if (feasible(start, goal, path)) {
+                return true;
+            }
+
+            // Smoothness gradient A q + b, A being the tridiagonal finite difference metric
+            for (std::size_t i = 0; i < n; ++i) {
+                for (std::size_t j = 0; j < dof_; ++j) {
+                    const double previous = i > 0 ? q_[(i - 1) * dof_ + j] : start[j];
+                    const double next = i + 1 < n ? q_[(i + 1) * dof_ + j] : goal[j];
+                    gradient_[i * dof_ + j] = smoothnessWeight * (2.0 * q_[i * dof_ + j] - previous - next);
+                }
+            }
+
+            // Obstacle gradient of 0.5 * (epsilon - d)^2 inside the buffer, by central differences
+            for (std::size_t i = 0; i < n; ++i) {
+                double* q = q_.data() + i * dof_;
+                const double d = context_->clearance(q, dof_, spheres_);
+                if (d >= epsilon) {
+                    continue;
+                }
+                double* g = obstacle_.data();
+                for (std::size_t j = 0; j < dof_; ++j) {
+                    const double saved = q[j];
+                    q[j] = saved + differenceStep;
+                    const double plus = context_->clearance(q, dof_, spheres_);
+                    q[j] = saved - differenceStep;
+                    const double minus = context_->clearance(q, dof_, spheres_);
+                    q[j] = saved;
+                    g[j] = -obstacleWeight * (epsilon - d) * (plus - minus) / (2.0 * differenceStep);
+                }
+                // Only push across the path, moving along it just slides waypoints around the obstacle
+                double tangentSquared = 0.0;
+                double along = 0.0;
+                for (std::size_t j = 0; j < dof_; ++j) {
+                    const double previous = i > 0 ? q_[(i - 1) * dof_ + j] : start[j];
+                    const double next = i + 1 < n ? q_[(i + 1) * dof_ + j] : goal[j];
+                    tangent_[j] = next - previous;
+                    tangentSquared += tangent_[j] * tangent_[j];
+                    along += tangent_[j] * g[j];
+                }
+                const double scale = tangentSquared > 0.0 ? along / tangentSquared : 0.0;
+                for (std::size_t j = 0; j < dof_; ++j) {
+                    gradient_[i * dof_ + j] += g[j] - scale * tangent_[j];
+                }
+            }
+
+            // Precondition by the inverse metric, so updates stay smooth, then step within the bounds
+            for (std::size_t j = 0; j < dof_; ++j) {
+                solveTridiagonal(j);
+            }
+            for (std::size_t i = 0; i < n; ++i) {
+                for (std::size_t j = 0; j < dof_; ++j) {
+                    double& value = q_[i * dof_ + j];
+                    value = std::min(std::max(value - stepSize * gradient_[i * dof_ + j], context_->lower[j]), context_->upper[j]);
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    // Solves A x = gradient for one joint in place, A having 2 on the diagonal and -1 beside it
+    void solveTridiagonal(std::size_t joint) {
+        const std::size_t n = waypoints;
+        scratch_.resize(n);
+        double* g = gradient_.data() + joint;
+        scratch_[0] = -0.5;
+        g[0] = g[0] / 2.0;
+        for (std::size_t i = 1; i < n; ++i) {
+            const double m = 2.0 + scratch_[i - 1];
+            scratch_[i] = -1.0 / m;
+            g[i * dof_] = (g[i * dof_] + g[(i - 1) * dof_]) / m;
+        }
+        for (std::size_t i = n - 1; i-- > 0;) {
+            g[i * dof_] -= scratch_[i] * g[(i + 1) * dof_];
+        }
+    }
+
+    // Checks the current waypoints and the motions between them, copying them to the path if feasible
+    bool feasible(const std::vector<double>& start, const std::vector<double>& goal, JointPath& path) {
+        path.resize(waypoints + 2);
+        path.front() = start;
+        path.back() = goal;
+        for (std::size_t i = 0; i < waypoints; ++i) {
+            path[i + 1].assign(q_.begin() + i * dof_, q_.begin() + (i + 1) * dof_);
+            if (context_->clearance(path[i + 1].data(), dof_, spheres_) < context_->margin) {
+                return false;
+            }
+        }
+        for (std::size_t i = 1; i < path.size(); ++i) {
+            if (!context_->motionValid(path[i - 1], path[i], spheres_)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static constexpr std::size_t waypoints = 32;
+    static constexpr int maxIterations = 500;
+    static constexpr double smoothnessWeight = 1.0;
+    static constexpr double obstacleWeight = 100.0;
+    static constexpr double stepSize = 0.2;
+    static constexpr double clearanceBuffer = 0.05;  // [m]
+    static constexpr double differenceStep = 0.05;   // [rad], the field being sampled per cell
+    static constexpr double perturbation = 0.5;      // [rad]
+
+    const PlanningContext* context_ = nullptr;
+    std::size_t dof_ = 0;
+    SphereSet spheres_;
+    std::vector<double> q_;
+    std::vector<double> gradient_;
+    std::vector<double> scratch_;
+    std::vector<double> obstacle_;
+    std::vector<double> tangent_;
+};
+
+// Registered factories, with the built-in planners
+std::unordered_map<std::string, PathPlannerFactory>& registry() {
+    static std::unordered_map<std::string, PathPlannerFactory> factories = {
+        {"rrt_connect", [] { return std::unique_ptr<PathPlanner>(new RrtConnect()); }},
+        {"chomp", [] { return std::unique_ptr<PathPlanner>(new Chomp()); }},
+    };
+    return factories;
+}
+
+std::mutex& registryLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+}  // namespace
+
+// Registers a planner under a name
+void registerPathPlanner(const std::string& name, PathPlannerFactory factory) {
+    std::lock_guard<std::mutex> lock(registryLock());
+    registry()[name] = std::move(factory);
+}
+
+// Creates a registered planner
+std::unique_ptr<PathPlanner> createPathPlanner(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryLock());
+    auto it = registry().find(name);
+    if (it == registry().end()) {
+        return nullptr;
+    }
+    return it->second();
+}
@@ -1,18 +1,354 @@
 #include "motion_planner.hpp"
+#include "logging/logging.hpp"
+#include "profiler/profiler.hpp"
+#include <algorithm>
 #include <cmath>
-#include <iostream>
+#include <stdexcept>
+#include <thread>
 
 // Constructor
-MotionPlanner::MotionPlanner(RobotMotionPlanner& robotMotionPlanner) : robotMotionPlanner_(robotMotionPlanner) { 
-    std::cout << "MotionPlanner initialized with default parameters.\n";
+MotionPlanner::MotionPlanner(RobotMotionPlanner& robotMotionPlanner)
+    : max_velocity_(1.0), max_acceleration_(2.0), sample_period_(0.001), robotMotionPlanner_(robotMotionPlanner),
+      context_{nullptr, SphereModel(), 0.0, {}, {}, 0.01} {
+    LOG_INFO("MotionPlanner initialized with default parameters.");
 }
 
 // Destructor
 MotionPlanner::~MotionPlanner() {
-    std::cout << "MotionPlanner destroyed.\n";
+    LOG_INFO("MotionPlanner destroyed.");
+}
+
+// Method to configure the joint limits
+void MotionPlanner::setLimits(double maxVelocity, double maxAcceleration) {
+    if (maxVelocity > 0.0 && maxAcceleration > 0.0) {
+        max_velocity_ = maxVelocity;
+        max_acceleration_ = maxAcceleration;
+    }
+}
+
+// Method to configure the sampling period
+void MotionPlanner::setSamplePeriod(double samplePeriod) {
+    if (samplePeriod > 0.0) {
+        sample_period_ = samplePeriod;
+    }
+}
+
+// Method to set the scene and arm model used to validate trajectories
+void MotionPlanner::setCollisionWorld(const CollisionWorld* world, SphereModel model, double margin) {
+    // Planning adds a cell to the margin, see planPath
+    if (world != nullptr && margin + world->resolution() >= world->maxClearance()) {
+        LOG_ERROR("MotionPlanner: margin {} m too large for the collision world, whose clearances stop at {} m.",
+                  margin, world->maxClearance());
+        throw std::invalid_argument("MotionPlanner: margin beyond the collision world truncation distance");
+    }
+    context_.world = world;
+    context_.sphereModel = std::move(model);
+    context_.margin = margin;
+}
+
+// Method to set the joint bounds sampled by the planners
+void MotionPlanner::setJointBounds(const std::vector<double>& lower, const std::vector<double>& upper) {
+    context_.lower = lower;
+    context_.upper = upper;
+}
+
+// Method to check a trajectory against the collision world
+bool MotionPlanner::validateTrajectory(const JointTrajectory& trajectory, std::size_t stride, std::size_t* collision) {
+    PROFILE_SCOPE("motion.validate");
+    if (context_.world == nullptr || !context_.sphereModel || trajectory.empty()) {
+        return true;
+    }
+    stride = std::max<std::size_t>(stride, 1);
+    const std::size_t dof = trajectory.dof();
+    joints_.resize(dof);
+    const std::size_t last = trajectory.samples() - 1;
+    for (std::size_t k = 0; k < last + stride; k += stride) {
+        // The last sample is always checked, even when the stride skips it
+        std::size_t sample = std::min(k, last);
+        for (std::size_t j = 0; j < dof; ++j) {
+            joints_[j] = trajectory.positions(j)[sample];
+        }
+        if (context_.clearance(joints_.data(), dof, spheres_) < context_.margin) {
+            if (collision != nullptr) {
+                *collision = sample;
+            }
+            return false;
+        }
+    }
+    return true;
 }
 
 // Method to compute a trajectory
 Trajectory MotionPlanner::computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal) {
-    
-}
\ No newline at end of file
+    computeTrajectory(start, goal, trajectoryPlan);
+    return trajectoryPlan;
+}
+
+// Plans the profiles of all joints
+// Every joint follows a time-optimal trapezoidal profile, then all of them are
+// slowed down to reach the goal together with the slowest one
+double MotionPlanner::planProfiles(const std::vector<double>& start, const std::vector<double>& goal) {
+    if (start.size() != goal.size() || start.empty()) {
+        return -1.0;
+    }
+    const size_t dof = start.size();
+    const double a = max_acceleration_;
+    const double vMax = max_velocity_;
+
+    // Minimum time of the slowest joint
+    double duration = 0.0;
+    for (size_t j = 0; j < dof; ++j) {
+        double distance = std::abs(goal[j] - start[j]);
+        double t;
+        if (distance * a <= vMax * vMax) {
+            // Triangular profile, the velocity limit is never reached
+            t = 2.0 * std::sqrt(distance / a);
+        } else {
+            t = distance / vMax + vMax / a;
+        }
+        duration = std::max(duration, t);
+    }
+
+    // Slowest trapezoid of each joint that still takes the whole duration
+    profiles_.resize(dof);
+    for (size_t j = 0; j < dof; ++j) {
+        TrapezoidProfile& p = profiles_[j];
+        double distance = std::abs(goal[j] - start[j]);
+        p.start = start[j];
+        p.direction = goal[j] >= start[j] ? 1.0 : -1.0;
+        p.acceleration = a;
+        if (distance == 0.0 || duration == 0.0) {
+            p.cruiseVelocity = 0.0;
+            p.accelTime = 0.0;
+            p.cruiseTime = 0.0;
+            continue;
+        }
+        // distance = v * (duration - v / a), take the smaller root
+        double disc = std::max(a * a * duration * duration - 4.0 * a * distance, 0.0);
+        p.cruiseVelocity = std::min(0.5 * (a * duration - std::sqrt(disc)), vMax);
+        p.accelTime = p.cruiseVelocity / a;
+        p.cruiseTime = std::max(duration - 2.0 * p.accelTime, 0.0);
+    }
+    return duration;
+}
+
+// Number of samples of a trajectory, the last one at its end
+size_t MotionPlanner::sampleCount(double duration) const {
+    return static_cast<size_t>(std::ceil(duration / sample_period_)) + 1;
+}
+
+// Method to compute a trajectory into a caller-provided one
+bool MotionPlanner::computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal, Trajectory& trajectory) {
+    PROFILE_SCOPE("motion.plan");
+    double duration = planProfiles(start, goal);
+    if (duration < 0.0) {
+        trajectory.positions.clear();
+        trajectory.velocities.clear();
+        trajectory.dof = 0;
+        trajectory.duration = 0.0;
+        return false;
+    }
+
+    // Sample all joints, reusing the trajectory storage
+    const size_t dof = start.size();
+    const size_t samples = sampleCount(duration);
+    trajectory.positions.resize(samples * dof);
+    trajectory.velocities.resize(samples * dof);
+    trajectory.dof = dof;
+    trajectory.duration = duration;
+    double* positions = trajectory.positions.data();
+    double* velocities = trajectory.velocities.data();
+    for (size_t k = 0; k < samples; ++k) {
+        double t = std::min(static_cast<double>(k) * sample_period_, duration);
+        for (size_t j = 0; j < dof; ++j) {
+            sampleTrapezoid(profiles_[j], t, positions[k * dof + j], velocities[k * dof + j]);
+        }
+    }
+    // The last sample lands exactly on the goal, whatever the rounding
+    for (size_t j = 0; j < dof; ++j) {
+        positions[(samples - 1) * dof + j] = goal[j];
+        velocities[(samples - 1) * dof + j] = 0.0;
+    }
+    return true;
+}
+
+// Method to compute a trajectory with one array per joint
+bool MotionPlanner::computeTrajectory(const std::vector<double>& start, const std::vector<double>& goal, JointTrajectory& trajectory) {
+    PROFILE_SCOPE("motion.plan");
+    double duration = planProfiles(start, goal);
+    if (duration < 0.0) {
+        trajectory.clear();
+        return false;
+    }
+
+    const size_t dof = start.size();
+    const size_t samples = sampleCount(duration);
+    trajectory.resize(dof, samples);
+    double* times = trajectory.times();
+    for (size_t k = 0; k < samples; ++k) {
+        times[k] = std::min(static_cast<double>(k) * sample_period_, duration);
+    }
+    // Joint-major sampling, each joint writes its own contiguous arrays
+    for (size_t j = 0; j < dof; ++j) {
+        double* positions = trajectory.positions(j);
+        double* velocities = trajectory.velocities(j);
+        for (size_t k = 0; k < samples; ++k) {
+            sampleTrapezoid(profiles_[j], times[k], positions[k], velocities[k]);
+        }
+        positions[samples - 1] = goal[j];
+        velocities[samples - 1] = 0.0;
+    }
+    return true;
+}
+
+// Method to compute a trajectory through a path, stopping at each waypoint
+bool MotionPlanner::computeTrajectory(const JointPath& path, JointTrajectory& trajectory) {
+    PROFILE_SCOPE("motion.plan_path");
+    if (path.empty()) {
+        trajectory.clear();
+        return false;
+    }
+    if (path.size() == 1) {
+        return computeTrajectory(path[0], path[0], trajectory);
+    }
+
+    // First pass for the total number of samples, segments share their boundary sample
+    size_t samples = 1;
+    for (size_t i = 1; i < path.size(); ++i) {
+        double duration = planProfiles(path[i - 1], path[i]);
+        if (duration < 0.0) {
+            trajectory.clear();
+            return false;
+        }
+        samples += sampleCount(duration) - 1;
+    }
+
+    const size_t dof = path[0].size();
+    trajectory.resize(dof, samples);
+    double* times = trajectory.times();
+    size_t first = 0;
+    double offset = 0.0;
+    for (size_t i = 1; i < path.size(); ++i) {
+        double duration = planProfiles(path[i - 1], path[i]);
+        const size_t count = sampleCount(duration);
+        for (size_t k = 0; k < count; ++k) {
+            times[first + k] = offset + std::min(static_cast<double>(k) * sample_period_, duration);
+        }
+        for (size_t j = 0; j < dof; ++j) {
+            double* positions = trajectory.positions(j) + first;
+            double* velocities = trajectory.velocities(j) + first;
+            for (size_t k = 0; k < count; ++k) {
+                sampleTrapezoid(profiles_[j], times[first + k] - offset, positions[k], velocities[k]);
+            }
+            positions[count - 1] = path[i][j];
+            velocities[count - 1] = 0.0;
+        }
+        first += count - 1;
+        offset += duration;
+    }
+    return true;
+}
+
+// Method to plan around obstacles, running restarts in parallel threads
+bool MotionPlanner::planPath(const std::string& planner, const std::vector<double>& start, const std::vector<double>& goal,
+                             size_t restarts, std::chrono::steady_clock::duration timeout, PathSelection selection,
+                             JointTrajectory& trajectory) {
+    PROFILE_SCOPE("motion.plan_around");
+    const size_t dof = start.size();
+    if (goal.size() != dof || context_.lower.size() != dof || context_.upper.size() != dof) {
+        LOG_ERROR("MotionPlanner: joint bounds not set or size mismatch.");
+        trajectory.clear();
+        return false;
+    }
+
+    // The arm spheres lower the clearances the field can report further, the largest one the most
+    if (context_.world != nullptr && context_.sphereModel) {
+        context_.sphereModel(start.data(), dof, spheres_);
+        float radius = spheres_.size() > 0 ? *std::max_element(spheres_.radius.begin(), spheres_.radius.end()) : 0.0f;
+        if (context_.margin + context_.world->resolution() >= context_.world->maxClearance(radius)) {
+            LOG_ERROR("MotionPlanner: margin {} m too large for arm spheres of {} m, clearances stop at {} m.",
+                      context_.margin, radius, context_.world->maxClearance(radius));
+            trajectory.clear();
+            return false;
+        }
+    }
+
+    // Start and goal have to keep the requested margin themselves
+    if (!context_.valid(start, spheres_) || !context_.valid(goal, spheres_)) {
+        trajectory.clear();
+        return false;
+    }
+
+    // Plan with a cell of extra margin: the field is sampled per cell, so the clearance jumps
+    // between the configurations checked along a motion and the trajectory sampled in between
+    PlanningContext planning = context_;
+    planning.margin += context_.world != nullptr ? context_.world->resolution() : 0.0;
+
+    // Skip planning when the straight motion is already collision free
+    if (planning.motionValid(start, goal, spheres_)) {
+        return computeTrajectory(start, goal, trajectory);
+    }
+
+    // Independent restarts, each with its own planner instance and seed
+    restarts = std::max<size_t>(restarts, 1);
+    std::vector<std::unique_ptr<PathPlanner>> planners(restarts);
+    for (auto& instance : planners) {
+        instance = createPathPlanner(planner);
+        if (!instance) {
+            LOG_ERROR("MotionPlanner: unknown path planner {}.", planner);
+            trajectory.clear();
+            return false;
+        }
+        instance->init(planning);
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::atomic<bool> stop(false);
+    std::vector<JointPath> paths(restarts);
+    std::vector<char> found(restarts, 0);
+    std::vector<std::thread> workers;
+    workers.reserve(restarts - 1);
+    auto run = [&](size_t r) {
+        found[r] = planners[r]->plan(start, goal, r + 1, deadline, stop, paths[r]) ? 1 : 0;
+        if (found[r] && selection == PathSelection::First) {
+            stop.store(true, std::memory_order_relaxed);
+        }
+    };
+    for (size_t r = 1; r < restarts; ++r) {
+        workers.emplace_back(run, r);
+    }
+    run(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Shortest of the feasible paths, with First usually only one of them
+    size_t best = restarts;
+    double bestLength = 0.0;
+    for (size_t r = 0; r < restarts; ++r) {
+        if (!found[r]) {
+            continue;
+        }
+        double length = pathLength(paths[r]);
+        if (best == restarts || length < bestLength) {
+            best = r;
+            bestLength = length;
+        }
+    }
+    if (best == restarts) {
+        trajectory.clear();
+        return false;
+    }
+
+    // The trajectory stops at every waypoint, so drop those the straight motion can skip
+    JointPath& path = paths[best];
+    size_t kept = 1;
+    for (size_t i = 1; i < path.size(); ++i) {
+        if (i + 1 < path.size() && planning.motionValid(path[kept - 1], path[i + 1], spheres_)) {
+            continue;
+        }
+        path[kept++] = path[i];
+    }
+    path.resize(kept);
+    return computeTrajectory(path, trajectory);
+}
@@ -0,0 +1,39 @@
+#ifndef TRAPEZOID_PROFILE_HPP
+#define TRAPEZOID_PROFILE_HPP
+
+#include <algorithm>
+
+// Trapezoidal velocity profile of a single joint
+struct TrapezoidProfile {
+    double start;
+    double direction;     // +1 or -1, towards the goal
+    double cruiseVelocity;
+    double acceleration;
+    double accelTime;     // Duration of the acceleration and deceleration phases
+    double cruiseTime;    // Duration of the constant velocity phase
+};
+
+// Samples a profile at a given time from its start
+// Kept in the header since it runs once per joint and sample, so that it inlines into any sampling loop
+inline void sampleTrapezoid(const TrapezoidProfile& profile, double t, double& position, double& velocity) {
+    const double a = profile.acceleration;
+    const double ta = profile.accelTime;
+    const double tc = profile.cruiseTime;
+    const double v = profile.cruiseVelocity;
+    double s;
+    if (t < ta) {
+        s = 0.5 * a * t * t;
+        velocity = a * t;
+    } else if (t < ta + tc) {
+        s = 0.5 * v * ta + v * (t - ta);
+        velocity = v;
+    } else {
+        double td = std::min(t - ta - tc, ta);
+        s = 0.5 * v * ta + v * tc + v * td - 0.5 * a * td * td;
+        velocity = v - a * td;
+    }
+    position = profile.start + profile.direction * s;
+    velocity *= profile.direction;
+}
+
+#endif // TRAPEZOID_PROFILE_HPP
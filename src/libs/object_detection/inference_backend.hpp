@@ -0,0 +1,75 @@
+#ifndef INFERENCE_BACKEND_HPP
+#define INFERENCE_BACKEND_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// NCHW tensor dimensions
+struct TensorShape {
+    std::size_t batch;
+    std::size_t channels;
+    std::size_t height;
+    std::size_t width;
+
+    // Number of elements
+    std::size_t size() const {
+        return batch * channels * height * width;
+    }
+};
+
+// Float tensor whose storage only grows, so it can be preallocated once
+class Tensor {
+public:
+    // Resizes the tensor, reallocating only if it grows
+    void reshape(const TensorShape& shape) {
+        shape_ = shape;
+        if (data_.size() < shape.size()) {
+            data_.resize(shape.size());
+        }
+    }
+
+    const TensorShape& shape() const { return shape_; }
+    float* data() { return data_.data(); }
+    const float* data() const { return data_.data(); }
+
+private:
+    TensorShape shape_{0, 0, 0, 0};
+    std::vector<float> data_;
+};
+
+// Model runtime, e.g. OpenCV DNN, ONNX Runtime or TensorRT
+// Input is a batch of normalized NCHW images at inputShape()
+// Output holds maxDetections() rows of {class index, score, x, y, width, height} per image,
+// in normalized image coordinates, with a negative class index for unused rows
+class InferenceBackend {
+public:
+    virtual ~InferenceBackend() = default;
+
+    // Loads a model, returns false on failure
+    virtual bool load(const std::string& model) = 0;
+
+    // Model input dimensions, the batch dimension being the largest supported batch
+    virtual TensorShape inputShape() const = 0;
+
+    // Number of output rows per image
+    virtual std::size_t maxDetections() const = 0;
+
+    // Class names indexed by model class index
+    virtual std::vector<std::string> classNames() const = 0;
+
+    // Runs the model on the first batch images of input
+    virtual bool infer(const Tensor& input, std::size_t batch, Tensor& output) = 0;
+};
+
+using InferenceBackendFactory = std::function<std::unique_ptr<InferenceBackend>()>;
+
+// Registers a backend under a name, so runtimes can be added from their own translation units
+void registerInferenceBackend(const std::string& name, InferenceBackendFactory factory);
+
+// Creates a registered backend, nullptr if unknown
+std::unique_ptr<InferenceBackend> createInferenceBackend(const std::string& name);
+
+#endif // INFERENCE_BACKEND_HPP
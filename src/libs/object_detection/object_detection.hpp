@@ -1,12 +1,46 @@
 #ifndef OBJECT_DETECTION_HPP
 #define OBJECT_DETECTION_HPP
 
-#include <vector>
+#include "object_detection/inference_backend.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+// Interned class name
+using ClassId = std::uint32_t;
 
 struct Object {
-    std::string name;
-    int id;
+    ClassId classId;    // Class, see ClassRegistry for its name
+    int id;             // Detection index within the frame
+    std::size_t frame;  // Index of the frame in the batch
+    float confidence;
+    float x;            // Bounding box in normalized image coordinates
+    float y;
+    float width;
+    float height;
+};
+
+// Interleaved 8-bit camera frame
+struct Image {
+    const std::uint8_t* data;
+    int width;
+    int height;
+    int channels;
+    std::size_t stride;     // Bytes per row
+};
+
+// Process-wide table of class names, so detections carry integers instead of strings
+class ClassRegistry {
+public:
+    // Returns the id of a class name, adding it if needed
+    static ClassId intern(const std::string& name);
+
+    // Returns the name of a class
+    static const std::string& name(ClassId id);
 };
 
 class ObjectDetection {
@@ -17,10 +51,34 @@ public:
     // Destructor
     ~ObjectDetection();
 
-    // Runs inference to detect objects
-    void runInference();
+    // Sets the inference backend and preallocates its tensors
+    bool setBackend(std::unique_ptr<InferenceBackend> backend);
+
+    // Minimum confidence of reported detections
+    void setConfidenceThreshold(float threshold);
+
+    // Runs inference to detect objects, batching frames up to the backend batch size
+    const std::vector<Object>& runInference(const Image* frames, std::size_t count);
+
+    // Returns the detections of the last inference
+    const std::vector<Object>& objects() const;
 
 private:
+
+    // Resizes and normalizes a frame into the input tensor
+    void preprocess(const Image& frame, std::size_t slot);
+
+    // Converts the output tensor rows into detections
+    void decode(std::size_t batch, std::size_t firstFrame);
+
+    std::unique_ptr<InferenceBackend> backend_;
+    Tensor input_;
+    Tensor output_;
+
+    // Model class index to interned class
+    std::vector<ClassId> classes_;
+    float confidenceThreshold_;
+
     // List of detected objects
     std::vector<Object> detectedObjects;
 };
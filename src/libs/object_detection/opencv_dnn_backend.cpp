@@ -0,0 +1,127 @@
+#include "object_detection/opencv_dnn_backend.hpp"
+#include "logging/logging.hpp"
+#include <fstream>
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+namespace {
+
+// Class names file of a model, the model path with its extension replaced
+std::string namesPath(const std::string& model) {
+    std::size_t slash = model.find_last_of('/');
+    std::size_t dot = model.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return model + ".names";
+    }
+    return model.substr(0, dot) + ".names";
+}
+
+class OpenCvDnnBackend : public InferenceBackend {
+public:
+    OpenCvDnnBackend(const TensorShape& inputShape, std::size_t maxDetections)
+        : inputShape_(inputShape), maxDetections_(maxDetections) {
+    }
+
+    // Loads a model and its class names, returns false on failure
+    bool load(const std::string& model) override {
+        try {
+            net_ = cv::dnn::readNet(model);
+        } catch (const cv::Exception& e) {
+            LOG_ERROR("OpenCvDnnBackend: cannot load {}: {}", model, e.what());
+            return false;
+        }
+        if (net_.empty()) {
+            LOG_ERROR("OpenCvDnnBackend: cannot load {}", model);
+            return false;
+        }
+
+        std::ifstream file(namesPath(model));
+        if (!file.is_open()) {
+            LOG_ERROR("OpenCvDnnBackend: cannot open {}", namesPath(model));
+            return false;
+        }
+        classNames_.clear();
+        std::string name;
+        while (std::getline(file, name)) {
+            classNames_.push_back(name);
+        }
+        return true;
+    }
+
+    TensorShape inputShape() const override {
+        return inputShape_;
+    }
+
+    std::size_t maxDetections() const override {
+        return maxDetections_;
+    }
+
+    std::vector<std::string> classNames() const override {
+        return classNames_;
+    }
+
+    // Runs the model on the first batch images of input, keeping the first maxDetections rows of each image
+    bool infer(const Tensor& input, std::size_t batch, Tensor& output) override {
+        if (net_.empty() || batch > inputShape_.batch) {
+            return false;
+        }
+        const TensorShape& shape = input.shape();
+        int dims[] = {static_cast<int>(batch), static_cast<int>(shape.channels),
+                      static_cast<int>(shape.height), static_cast<int>(shape.width)};
+        // Wraps the input tensor, forward() does not write to it
+        cv::Mat blob(4, dims, CV_32F, const_cast<float*>(input.data()));
+
+        cv::Mat detections;
+        try {
+            net_.setInput(blob);
+            detections = net_.forward();
+        } catch (const cv::Exception& e) {
+            LOG_ERROR("OpenCvDnnBackend: inference failed: {}", e.what());
+            return false;
+        }
+        if (detections.type() != CV_32F || detections.total() % 7 != 0) {
+            LOG_ERROR("OpenCvDnnBackend: unexpected output layout");
+            return false;
+        }
+
+        // Unused rows keep a negative class index
+        std::vector<std::size_t> rows(batch, 0);
+        float* out = output.data();
+        for (std::size_t i = 0; i < batch * maxDetections_; ++i) {
+            out[i * 6] = -1.0f;
+        }
+        const float* row = detections.ptr<float>();
+        for (std::size_t r = 0; r < detections.total() / 7; ++r, row += 7) {
+            if (row[0] < 0.0f || row[0] >= static_cast<float>(batch)) {
+                continue;
+            }
+            std::size_t image = static_cast<std::size_t>(row[0]);
+            if (rows[image] == maxDetections_) {
+                continue;
+            }
+            float* dst = out + (image * maxDetections_ + rows[image]++) * 6;
+            dst[0] = row[1];
+            dst[1] = row[2];
+            dst[2] = row[3];
+            dst[3] = row[4];
+            dst[4] = row[5] - row[3];
+            dst[5] = row[6] - row[4];
+        }
+        return true;
+    }
+
+private:
+    TensorShape inputShape_;
+    std::size_t maxDetections_;
+    std::vector<std::string> classNames_;
+    cv::dnn::Net net_;
+};
+
+}
+
+// Registers the OpenCV DNN backend as "opencv_dnn"
+void registerOpenCvDnnBackend(const TensorShape& inputShape, std::size_t maxDetections) {
+    registerInferenceBackend("opencv_dnn", [inputShape, maxDetections]() {
+        return std::unique_ptr<InferenceBackend>(new OpenCvDnnBackend(inputShape, maxDetections));
+    });
+}
@@ -0,0 +1,14 @@
+#ifndef OPENCV_DNN_BACKEND_HPP
+#define OPENCV_DNN_BACKEND_HPP
+
+#include "object_detection/inference_backend.hpp"
+
+#include <cstddef>
+
+// Registers the OpenCV DNN backend as "opencv_dnn", built with MANIPULATION_OPENCV_DNN
+// Models must end in a detection output layer, as SSD ones do, with rows of
+// {image, class, score, left, top, right, bottom} in normalized image coordinates
+// Class names are read from the file next to the model with the .names extension, one per line
+void registerOpenCvDnnBackend(const TensorShape& inputShape, std::size_t maxDetections);
+
+#endif // OPENCV_DNN_BACKEND_HPP
@@ -1,15 +1,166 @@
 #include "object_detection/object_detection.hpp"
-#include <iostream>
+#include "logging/logging.hpp"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+namespace {
+
+std::mutex& backendsLock() {
+    static std::mutex lock;
+    return lock;
+}
+
+std::unordered_map<std::string, InferenceBackendFactory>& backends() {
+    static std::unordered_map<std::string, InferenceBackendFactory> factories;
+    return factories;
+}
+
+// Names are kept in a deque so references stay valid as classes are added
+struct ClassTable {
+    std::mutex lock;
+    std::deque<std::string> names;
+    std::unordered_map<std::string, ClassId> ids;
+};
+
+ClassTable& classTable() {
+    static ClassTable table;
+    return table;
+}
+
+}
+
+// Registers a backend under a name
+void registerInferenceBackend(const std::string& name, InferenceBackendFactory factory) {
+    std::lock_guard<std::mutex> lock(backendsLock());
+    backends()[name] = std::move(factory);
+}
+
+// Creates a registered backend
+std::unique_ptr<InferenceBackend> createInferenceBackend(const std::string& name) {
+    std::lock_guard<std::mutex> lock(backendsLock());
+    auto it = backends().find(name);
+    if (it == backends().end()) {
+        return nullptr;
+    }
+    return it->second();
+}
+
+// Returns the id of a class name, adding it if needed
+ClassId ClassRegistry::intern(const std::string& name) {
+    ClassTable& table = classTable();
+    std::lock_guard<std::mutex> lock(table.lock);
+    auto it = table.ids.find(name);
+    if (it != table.ids.end()) {
+        return it->second;
+    }
+    ClassId id = static_cast<ClassId>(table.names.size());
+    table.names.push_back(name);
+    table.ids.emplace(name, id);
+    return id;
+}
+
+// Returns the name of a class
+const std::string& ClassRegistry::name(ClassId id) {
+    ClassTable& table = classTable();
+    std::lock_guard<std::mutex> lock(table.lock);
+    return table.names.at(id);
+}
 
 // Constructor
-ObjectDetection::ObjectDetection() {
+ObjectDetection::ObjectDetection() : confidenceThreshold_(0.5f) {
 }
 
 // Destructor
 ObjectDetection::~ObjectDetection() {
 }
 
-// Runs inference to detect objects
-void ObjectDetection::runInference() {
+// Sets the inference backend and preallocates its tensors
+// Class names are interned once here instead of once per detection
+bool ObjectDetection::setBackend(std::unique_ptr<InferenceBackend> backend) {
+    if (!backend) {
+        return false;
+    }
+    TensorShape shape = backend->inputShape();
+    if (shape.size() == 0 || backend->maxDetections() == 0) {
+        LOG_ERROR("ObjectDetection: invalid backend shapes");
+        return false;
+    }
+    input_.reshape(shape);
+    output_.reshape(TensorShape{shape.batch, 1, backend->maxDetections(), 6});
+
+    classes_.clear();
+    for (const std::string& name : backend->classNames()) {
+        classes_.push_back(ClassRegistry::intern(name));
+    }
+    detectedObjects.reserve(shape.batch * backend->maxDetections());
+    backend_ = std::move(backend);
+    return true;
+}
+
+// Minimum confidence of reported detections
+void ObjectDetection::setConfidenceThreshold(float threshold) {
+    confidenceThreshold_ = threshold;
+}
+
+// Runs inference to detect objects, batching frames up to the backend batch size
+const std::vector<Object>& ObjectDetection::runInference(const Image* frames, std::size_t count) {
+    detectedObjects.clear();
+    if (!backend_) {
+        return detectedObjects;
+    }
+    const std::size_t maxBatch = input_.shape().batch;
+    for (std::size_t first = 0; first < count; first += maxBatch) {
+        std::size_t batch = std::min(maxBatch, count - first);
+        for (std::size_t i = 0; i < batch; ++i) {
+            preprocess(frames[first + i], i);
+        }
+        if (!backend_->infer(input_, batch, output_)) {
+            LOG_ERROR("ObjectDetection: inference failed");
+            continue;
+        }
+        decode(batch, first);
+    }
+    return detectedObjects;
+}
+
+// Returns the detections of the last inference
+const std::vector<Object>& ObjectDetection::objects() const {
+    return detectedObjects;
+}
 
-}
\ No newline at end of file
+// Resizes a frame to the model input with nearest neighbour sampling, scaling to [0, 1] in planar layout
+void ObjectDetection::preprocess(const Image& frame, std::size_t slot) {
+    const TensorShape& shape = input_.shape();
+    const std::size_t plane = shape.height * shape.width;
+    float* dst = input_.data() + slot * shape.channels * plane;
+    const std::size_t channels = std::min<std::size_t>(shape.channels, frame.channels);
+    for (std::size_t y = 0; y < shape.height; ++y) {
+        const std::uint8_t* row = frame.data + (y * frame.height / shape.height) * frame.stride;
+        for (std::size_t x = 0; x < shape.width; ++x) {
+            const std::uint8_t* px = row + (x * frame.width / shape.width) * frame.channels;
+            for (std::size_t c = 0; c < channels; ++c) {
+                dst[c * plane + y * shape.width + x] = px[c] * (1.0f / 255.0f);
+            }
+        }
+    }
+}
+
+// Converts the output tensor rows into detections
+void ObjectDetection::decode(std::size_t batch, std::size_t firstFrame) {
+    const std::size_t rows = output_.shape().height;
+    for (std::size_t b = 0; b < batch; ++b) {
+        const float* row = output_.data() + b * rows * 6;
+        int id = 0;
+        for (std::size_t r = 0; r < rows; ++r, row += 6) {
+            if (row[0] < 0.0f || row[1] < confidenceThreshold_) {
+                continue;
+            }
+            std::size_t index = static_cast<std::size_t>(row[0]);
+            if (index >= classes_.size()) {
+                continue;
+            }
+            detectedObjects.push_back(Object{classes_[index], id++, firstFrame + b, row[1], row[2], row[3], row[4], row[5]});
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Blocking queue of bounded size between pipeline stages, so that a fast stage cannot run away from a slow one
+// Closing the queue wakes up all waiting threads
+template <typename T>
+class BoundedQueue {
+public:
+    // Constructor
+    explicit BoundedQueue(std::size_t capacity) : capacity_(capacity), closed_(false) {}
+
+    // Waits for room and adds an item, false if the queue was closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(lock_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Waits for an item, false once the queue is closed and drained
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(lock_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    // Takes an item if one is available
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (items_.empty()) {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    // Makes push fail and pop return once empty
+    void close() {
+        std::lock_guard<std::mutex> lock(lock_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+    // Reopens a closed queue with a new capacity, dropping its items
+    void reset(std::size_t capacity) {
+        std::lock_guard<std::mutex> lock(lock_);
+        items_.clear();
+        capacity_ = capacity;
+        closed_ = false;
+    }
+
+private:
+    std::size_t capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex lock_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -3,19 +3,127 @@
 
 
 #include "perception_system/perception_system.hpp"
+#include "grasp_planner/grasp_planner.hpp"
 #include "motion_planner/motion_planner.hpp"
+#include "object_manipulation/bounded_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Progress of a pick through the pipeline
+enum class PickState {
+    Queued,     // Waiting for grasp and motion planning
+    Planned,    // Trajectories ready, waiting for the robot
+    Executing,  // Trajectories handed to the robot
+    Done,
+    Cancelled   // Object moved or disappeared before execution, replaced by a new pick if still there
+};
+
+// A single pick of a perceived object, shared between the pipeline stages
+struct PickTask {
+    std::uint64_t id;
+    Object object;
+    Pose pose;                          // Object pose the pick was planned for
+    std::uint64_t sequence;             // Perception snapshot the pose comes from
+    Plan grasp;
+    std::vector<double> goal;           // Joint positions at the grasp
+    JointTrajectory approach;           // Home to grasp
+    JointTrajectory retreat;            // Grasp back to home
+    std::atomic<PickState> state{PickState::Queued};
+    std::chrono::steady_clock::time_point created;
+    std::chrono::steady_clock::time_point completed;
+};
+
+// Converts a grasp into the joint positions reaching it, false if unreachable
+using GraspSolver = std::function<bool(const Plan& grasp, std::vector<double>& joints)>;
+
+// Pipeline counters
+struct ManipulationStats {
+    std::uint64_t queued;
+    std::uint64_t completed;
+    std::uint64_t cancelled;
+    std::uint64_t replanned;
+    std::uint64_t failed;   // No grasp, no joint solution or no trajectory
+};
 
 class ObjectManipulationManager {
 public:
     // Constructor
-    ObjectManipulationManager(PerceptionSystem& perceptionSystem, MotionPlanner& motionPlanner);
+    ObjectManipulationManager(PerceptionSystem& perceptionSystem, GraspPlanner& graspPlanner,
+                              MotionPlanner& motionPlanner, RobotMotionPlanner& robotMotionPlanner);
+
+    // Destructor
+    ~ObjectManipulationManager();
+
+    // Methods to configure the picks, before starting
+    void setHomePosition(const std::vector<double>& joints);
+    void setGraspSolver(GraspSolver solver);
+    void setGraspRequest(const GraspRequest& request);
+    void setReplanThresholds(double distance, double angle);
+
+    // Starts pipelined pick and place: perception and planning of the next picks overlap with the
+    // execution of the current one, each pick going from the home position to its grasp and back
+    bool start(double controlRate, std::size_t queueDepth = 4);
+
+    // Stops the pipeline after the picks handed to the robot are done
+    void stop();
 
-    // Method to manipulate an object (pick and place)
-    void manipulateObject();
+    // Returns the pipeline counters
+    ManipulationStats stats() const;
 
 private:
+
+    // Perception and grasp planning stage, turning new or moved objects into picks
+    void perceptionRoutine();
+
+    // Motion planning stage
+    void planningRoutine();
+
+    // Execution stage, streaming the planned picks to the robot
+    void executionRoutine();
+
+    // Cancels queued picks whose object moved or vanished, and queues picks for new objects
+    void updatePicks(const PerceptionSnapshot& snapshot);
+
+    // Queues a pick for an object, false if no grasp is reachable
+    bool queuePick(const Object& object, const Pose& pose, std::uint64_t sequence);
+
+    // Hands reclaimed segments back, releasing the picks whose both segments were executed
+    void reclaimSegments(std::vector<std::shared_ptr<PickTask>>& executing);
+
     PerceptionSystem& perceptionSystem_;
+    GraspPlanner& graspPlanner_;
     MotionPlanner& motionPlanner_;
+    RobotMotionPlanner& robotMotionPlanner_;
+
+    std::vector<double> home_;
+    GraspSolver graspSolver_;
+    GraspRequest graspRequest_;
+    double replanDistance_;
+    double replanAngle_;
+    std::size_t maxExecuting_;
+
+    // Picks known to the perception stage, used to match objects across snapshots
+    std::vector<std::shared_ptr<PickTask>> tracked_;
+    std::uint64_t nextTaskId_;
+
+    BoundedQueue<std::shared_ptr<PickTask>> planQueue_;
+    BoundedQueue<std::shared_ptr<PickTask>> executionQueue_;
+    std::thread perceptionThread_;
+    std::thread planningThread_;
+    std::thread executionThread_;
+    std::atomic<bool> running_;
+
+    std::atomic<std::uint64_t> queued_;
+    std::atomic<std::uint64_t> completed_;
+    std::atomic<std::uint64_t> cancelled_;
+    std::atomic<std::uint64_t> replanned_;
+    std::atomic<std::uint64_t> failed_;
 };
 
-#endif
\ No newline at end of file
+#endif // OBJECT_MANIPULATION_HPP
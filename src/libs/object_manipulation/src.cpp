@@ -1,8 +1,291 @@
 #include "object_manipulation.hpp"
-#include <iostream>
+#include "logging/logging.hpp"
+#include "profiler/profiler.hpp"
+#include <cmath>
 
-ObjectManipulationManager::ObjectManipulationManager(PerceptionSystem& perceptionSystem, MotionPlanner& motionPlanner)
-    : perceptionSystem_(perceptionSystem), motionPlanner_(motionPlanner) {}
+namespace {
 
-void ObjectManipulationManager::manipulateObject() {
+// Detections further than this from a pick are considered other objects [m]
+const double match_radius = 0.1;
+
+// Detections of a picked object are ignored for this long after the pick, unless captured later than it
+const std::chrono::seconds done_grace(5);
+
+const double pi = 3.14159265358979323846;
+
+double distance(const Pose& a, const Pose& b) {
+    double dx = a.x - b.x;
+    double dy = a.y - b.y;
+    double dz = a.z - b.z;
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+}
+
+ObjectManipulationManager::ObjectManipulationManager(PerceptionSystem& perceptionSystem, GraspPlanner& graspPlanner,
+                                                     MotionPlanner& motionPlanner, RobotMotionPlanner& robotMotionPlanner)
+    : perceptionSystem_(perceptionSystem), graspPlanner_(graspPlanner), motionPlanner_(motionPlanner),
+      robotMotionPlanner_(robotMotionPlanner), graspRequest_{4096, 4, 0.9, 0.03, 0.02},
+      replanDistance_(0.01), replanAngle_(0.0873), maxExecuting_(2), nextTaskId_(0),
+      planQueue_(4), executionQueue_(4), running_(false),
+      queued_(0), completed_(0), cancelled_(0), replanned_(0), failed_(0) {}
+
+// Destructor
+ObjectManipulationManager::~ObjectManipulationManager() {
+    stop();
+}
+
+// Methods to configure the picks
+void ObjectManipulationManager::setHomePosition(const std::vector<double>& joints) {
+    home_ = joints;
+}
+
+void ObjectManipulationManager::setGraspSolver(GraspSolver solver) {
+    graspSolver_ = std::move(solver);
+}
+
+void ObjectManipulationManager::setGraspRequest(const GraspRequest& request) {
+    graspRequest_ = request;
+}
+
+// A queued pick is replanned once its object moved by more than these [m, rad]
+void ObjectManipulationManager::setReplanThresholds(double distance, double angle) {
+    replanDistance_ = distance;
+    replanAngle_ = angle;
+}
+
+// Starts pipelined pick and place
+bool ObjectManipulationManager::start(double controlRate, std::size_t queueDepth) {
+    if (home_.empty() || !graspSolver_) {
+        LOG_ERROR("ObjectManipulationManager needs a home position and a grasp solver");
+        return false;
+    }
+    if (running_.exchange(true)) {
+        return false;
+    }
+    robotMotionPlanner_.startExecution(controlRate);
+    planQueue_.reset(queueDepth);
+    executionQueue_.reset(queueDepth);
+    perceptionThread_ = std::thread(&ObjectManipulationManager::perceptionRoutine, this);
+    planningThread_ = std::thread(&ObjectManipulationManager::planningRoutine, this);
+    executionThread_ = std::thread(&ObjectManipulationManager::executionRoutine, this);
+    return true;
+}
+
+// Stops the pipeline, closing the queues to wake up stages waiting on each other
+void ObjectManipulationManager::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    planQueue_.close();
+    executionQueue_.close();
+    perceptionThread_.join();
+    planningThread_.join();
+    executionThread_.join();
+    tracked_.clear();
+}
+
+// Returns the pipeline counters
+ManipulationStats ObjectManipulationManager::stats() const {
+    return ManipulationStats{queued_.load(), completed_.load(), cancelled_.load(), replanned_.load(), failed_.load()};
+}
+
+// Perception and grasp planning stage, woken up by new perception snapshots
+void ObjectManipulationManager::perceptionRoutine() {
+    Profiler::setThreadName("manipulation_perception");
+    std::uint64_t lastSequence = 0;
+    while (running_.load()) {
+        std::shared_ptr<const PerceptionSnapshot> snapshot = perceptionSystem_.snapshot();
+        if (!snapshot || snapshot->sequence == lastSequence) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        lastSequence = snapshot->sequence;
+        PROFILE_SCOPE("manipulation.update_picks");
+        updatePicks(*snapshot);
+    }
+}
+
+// Cancels queued picks whose object moved or vanished, and queues picks for new objects
+// Late detections, published with a zero pose confidence, keep their pick alive but never trigger a replan
+void ObjectManipulationManager::updatePicks(const PerceptionSnapshot& snapshot) {
+    std::vector<bool> seen(tracked_.size(), false);
+    for (std::size_t i = 0; i < snapshot.objects.size(); ++i) {
+        const Object& object = snapshot.objects[i];
+        const Pose& pose = snapshot.poses[i];
+        const bool reliable = snapshot.poseConfidence[i] > 0.0f;
+
+        // Picks in progress take precedence over done ones for the same object
+        std::size_t match = tracked_.size();
+        double best = match_radius;
+        bool bestDone = true;
+        for (std::size_t t = 0; t < tracked_.size(); ++t) {
+            const PickTask& task = *tracked_[t];
+            PickState state = task.state.load();
+            if (task.object.classId != object.classId || state == PickState::Cancelled) {
+                continue;
+            }
+            double d = distance(task.pose, pose);
+            bool done = state == PickState::Done;
+            if ((bestDone && !done && d < match_radius) || (done == bestDone && d < best)) {
+                best = d;
+                bestDone = done;
+                match = t;
+            }
+        }
+
+        if (match == tracked_.size()) {
+            if (reliable) {
+                queuePick(object, pose, snapshot.sequence);
+            }
+            continue;
+        }
+        seen[match] = true;
+        PickTask& task = *tracked_[match];
+        PickState state = task.state.load();
+        if (state == PickState::Done) {
+            // Still there after being picked, once the frame is newer than the pick
+            if (reliable && snapshot.stamp > task.completed) {
+                queuePick(object, pose, snapshot.sequence);
+            }
+            continue;
+        }
+        if (state == PickState::Executing || !reliable) {
+            continue;
+        }
+        double turn = std::abs(std::remainder(pose.yaw - task.pose.yaw, 2.0 * pi));
+        if (best <= replanDistance_ && turn <= replanAngle_) {
+            continue;
+        }
+        if (task.state.compare_exchange_strong(state, PickState::Cancelled)) {
+            replanned_++;
+            queuePick(object, pose, snapshot.sequence);
+        }
+    }
+
+    // Picks not planned yet whose object vanished
+    for (std::size_t t = 0; t < seen.size(); ++t) {
+        if (seen[t]) {
+            continue;
+        }
+        PickState state = tracked_[t]->state.load();
+        while ((state == PickState::Queued || state == PickState::Planned) &&
+               !tracked_[t]->state.compare_exchange_weak(state, PickState::Cancelled)) {
+        }
+        if (state == PickState::Queued || state == PickState::Planned) {
+            cancelled_++;
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = tracked_.begin(); it != tracked_.end();) {
+        PickState state = (*it)->state.load();
+        if (state == PickState::Cancelled || (state == PickState::Done && now - (*it)->completed > done_grace)) {
+            it = tracked_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Queues a pick for an object, trying its grasps from the best one
+bool ObjectManipulationManager::queuePick(const Object& object, const Pose& pose, std::uint64_t sequence) {
+    std::shared_ptr<PickTask> task = std::make_shared<PickTask>();
+    task->id = nextTaskId_++;
+    task->object = object;
+    task->pose = pose;
+    task->sequence = sequence;
+    task->created = std::chrono::steady_clock::now();
+    const std::vector<Plan>& grasps = graspPlanner_.planGrasps(object, pose, graspRequest_);
+    bool reachable = false;
+    for (const Plan& grasp : grasps) {
+        if (graspSolver_(grasp, task->goal)) {
+            task->grasp = grasp;
+            reachable = true;
+            break;
+        }
+    }
+    if (!reachable) {
+        failed_++;
+        return false;
+    }
+    tracked_.push_back(task);
+    queued_++;
+    return planQueue_.push(std::move(task));
+}
+
+// Motion planning stage
+void ObjectManipulationManager::planningRoutine() {
+    Profiler::setThreadName("manipulation_planning");
+    std::shared_ptr<PickTask> task;
+    while (running_.load() && planQueue_.pop(task)) {
+        if (task->state != PickState::Queued) {
+            continue;
+        }
+        PROFILE_SCOPE("manipulation.plan_pick");
+        if (!motionPlanner_.computeTrajectory(home_, task->goal, task->approach) ||
+            !motionPlanner_.computeTrajectory(task->goal, home_, task->retreat)) {
+            task->state = PickState::Cancelled;
+            failed_++;
+            continue;
+        }
+        PickState state = PickState::Queued;
+        if (task->state.compare_exchange_strong(state, PickState::Planned)) {
+            executionQueue_.push(std::move(task));
+        }
+    }
+}
+
+// Execution stage, keeping up to maxExecuting_ picks in the robot queue so that it never waits between picks
+// Picks cancelled while waiting here are skipped
+void ObjectManipulationManager::executionRoutine() {
+    Profiler::setThreadName("manipulation_execution");
+    std::vector<std::shared_ptr<PickTask>> executing;
+    while (true) {
+        reclaimSegments(executing);
+        std::shared_ptr<PickTask> task;
+        bool popped = false;
+        if (running_.load() && executing.size() < maxExecuting_) {
+            popped = executing.empty() ? executionQueue_.pop(task) : executionQueue_.tryPop(task);
+        }
+        if (!popped) {
+            if (executing.empty() && !running_.load()) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        PickState state = PickState::Planned;
+        if (!task->state.compare_exchange_strong(state, PickState::Executing)) {
+            continue;
+        }
+        if (!robotMotionPlanner_.appendSegment(&task->approach)) {
+            task->state = PickState::Cancelled;
+            failed_++;
+            continue;
+        }
+        // The approach is in the queue, so the retreat must follow it, reclaiming segments meanwhile
+        // to make room for it
+        while (!robotMotionPlanner_.appendSegment(&task->retreat)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            reclaimSegments(executing);
+        }
+        executing.push_back(std::move(task));
+    }
+}
+
+// Hands reclaimed segments back, releasing the picks whose retreat was executed
+void ObjectManipulationManager::reclaimSegments(std::vector<std::shared_ptr<PickTask>>& executing) {
+    while (const JointTrajectory* segment = robotMotionPlanner_.reclaimSegment()) {
+        for (auto it = executing.begin(); it != executing.end(); ++it) {
+            if (segment == &(*it)->retreat) {
+                (*it)->completed = std::chrono::steady_clock::now();
+                Profiler::record("manipulation.pick_cycle", (*it)->created, (*it)->completed);
+                (*it)->state = PickState::Done;
+                completed_++;
+                executing.erase(it);
+                break;
+            }
+        }
+    }
 }
@@ -4,14 +4,61 @@
 #include "object_detection/object_detection.hpp"
 #include "pose_estimation/pose_estimation.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Detection and pose results of one perception cycle, poses[i] belonging to objects[i]
+// Objects whose pose estimation missed the deadline get a coarse pose and a zero confidence
+struct PerceptionSnapshot {
+    std::uint64_t sequence;
+    std::chrono::steady_clock::time_point stamp;
+    std::vector<Object> objects;
+    std::vector<Pose> poses;
+    std::vector<float> poseConfidence;
+    std::size_t lateObjects;
+};
+
+// Fills the frames of the next cycle and their 3D data, scenes[i] belonging to frames[i]
+// Pose estimation of a cycle overlaps with the next one, so the data must stay valid until the call after the next
+// Returns false if no frames are available yet
+using FrameSource = std::function<bool(std::vector<Image>& frames, std::vector<SceneData>& scenes)>;
+
 class PerceptionSystem {
 public:
-    // Constructor
-    PerceptionSystem(ObjectDetection& ObjectDetection, PoseEstimation& PoseEstimation);
+    // Constructor, 0 pose threads uses all cores
+    PerceptionSystem(ObjectDetection& ObjectDetection, PoseEstimation& PoseEstimation, std::size_t poseThreads = 0);
 
     // Destructor
     ~PerceptionSystem();
 
+    // Sets where the pipeline gets its camera frames from
+    void setFrameSource(FrameSource source);
+
+    // Starts running perception continuously on a background thread
+    void start(std::chrono::milliseconds idlePeriod = std::chrono::milliseconds(5));
+
+    // Stops the background pipeline
+    void stop();
+
+    // Time allowed for the pose estimation of a cycle
+    void setPoseDeadline(std::chrono::microseconds deadline);
+
+    // Runs one perception cycle on the calling thread
+    // Detection of new frames overlaps with pose estimation of the previous ones, which get published
+    // Returns false if nothing was published
+    bool update();
+
+    // Returns the latest published results without blocking, nullptr before the first cycle
+    std::shared_ptr<const PerceptionSnapshot> snapshot() const;
+
     // Detect objects using the camera and object detection module
     void detectObjects();
 
@@ -19,10 +66,64 @@ public:
     void estimatePose();
 
 private:
+
+    // Pose estimation of the detections of one cycle, shared with the pose workers
+    // Late workers only touch the job itself, never a published snapshot
+    struct PoseJob {
+        std::chrono::steady_clock::time_point stamp;
+        std::vector<Object> objects;
+        std::vector<SceneData> scenes;
+        std::vector<Pose> poses;
+        std::vector<float> confidence;
+        std::unique_ptr<std::atomic<bool>[]> done;
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> finished{0};
+        std::size_t inFlight = 0;
+        std::atomic<bool> abandoned{false};
+    };
+
+    // Waits for the pending job until its deadline and publishes its results
+    bool finishPoseJob();
+
+    // Pose worker routine
+    void poseWorkerRoutine();
+
+    // Background pipeline routine
+    void pipelineRoutine(std::chrono::milliseconds idlePeriod);
+
+    // Publishes the back buffer and recycles the previous front one if no reader holds it
+    void publish();
+
     // Camera instance for capturing data
     std::string camera;
     ObjectDetection& objectDetection_;
     PoseEstimation& poseEstimation_;
+
+    FrameSource frameSource_;
+    std::vector<Image> frames_;
+    std::vector<SceneData> scenes_;
+    std::chrono::steady_clock::time_point framesStamp_;
+    std::vector<Object> detections_;
+
+    // Pose estimation thread pool, working on the pending job
+    std::chrono::microseconds poseDeadline_;
+    std::shared_ptr<PoseJob> pendingJob_;
+    std::chrono::steady_clock::time_point pendingDeadline_;
+    std::vector<std::thread> poseWorkers_;
+    std::deque<std::shared_ptr<PoseJob>> poseJobs_;
+    std::mutex poseLock_;
+    std::condition_variable poseCv_;
+    std::condition_variable poseDoneCv_;
+    bool stopPoseWorkers_;
+
+    // Double buffer: the pipeline fills back_ while readers hold front_
+    std::shared_ptr<PerceptionSnapshot> back_;
+    std::shared_ptr<const PerceptionSnapshot> front_;
+    std::shared_ptr<PerceptionSnapshot> spare_;
+    std::uint64_t sequence_;
+
+    std::atomic<bool> running_;
+    std::thread pipelineThread_;
 };
 
 #endif // PERCEPTION_SYSTEM_HPP
@@ -1,21 +1,217 @@
 #include "perception_system.hpp"
-#include <iostream>
+#include "logging/logging.hpp"
+#include "profiler/profiler.hpp"
+#include <algorithm>
 
 // Constructor
-PerceptionSystem::PerceptionSystem(ObjectDetection& ObjectDetection, PoseEstimation& PoseEstimation) : objectDetection_(ObjectDetection), poseEstimation_(PoseEstimation){
-    std::cout << "Perception System initialized\n";
+PerceptionSystem::PerceptionSystem(ObjectDetection& ObjectDetection, PoseEstimation& PoseEstimation, std::size_t poseThreads)
+    : objectDetection_(ObjectDetection), poseEstimation_(PoseEstimation),
+      poseDeadline_(std::chrono::milliseconds(20)), stopPoseWorkers_(false),
+      back_(std::make_shared<PerceptionSnapshot>()), spare_(std::make_shared<PerceptionSnapshot>()),
+      sequence_(0), running_(false) {
+    if (poseThreads == 0) {
+        poseThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < poseThreads; ++i) {
+        poseWorkers_.push_back(std::thread(&PerceptionSystem::poseWorkerRoutine, this));
+    }
+    LOG_INFO("Perception System initialized");
 }
 
 // Destructor
 PerceptionSystem::~PerceptionSystem() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(poseLock_);
+        stopPoseWorkers_ = true;
+    }
+    poseCv_.notify_all();
+    for (std::thread& worker : poseWorkers_) {
+        worker.join();
+    }
+}
+
+// Sets where the pipeline gets its camera frames from
+// Must not be called while the pipeline is running
+void PerceptionSystem::setFrameSource(FrameSource source) {
+    frameSource_ = std::move(source);
+}
+
+// Starts running perception continuously on a background thread
+void PerceptionSystem::start(std::chrono::milliseconds idlePeriod) {
+    if (running_.exchange(true)) {
+        return;
+    }
+    pipelineThread_ = std::thread(&PerceptionSystem::pipelineRoutine, this, idlePeriod);
+}
+
+// Stops the background pipeline
+void PerceptionSystem::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    pipelineThread_.join();
+}
+
+// Background pipeline routine, waiting a bit whenever no frames are available
+void PerceptionSystem::pipelineRoutine(std::chrono::milliseconds idlePeriod) {
+    Profiler::setThreadName("perception");
+    while (running_.load()) {
+        if (!update()) {
+            std::this_thread::sleep_for(idlePeriod);
+        }
+    }
+}
+
+// Time allowed for the pose estimation of a cycle
+void PerceptionSystem::setPoseDeadline(std::chrono::microseconds deadline) {
+    poseDeadline_ = deadline;
+}
+
+// Runs one perception cycle
+// Frames are detected while the pose workers still estimate the previous cycle,
+// whose results are published before the poses of the new detections are fanned out
+bool PerceptionSystem::update() {
+    if (!frameSource_ || !frameSource_(frames_, scenes_) || frames_.empty()) {
+        return finishPoseJob();
+    }
+    framesStamp_ = std::chrono::steady_clock::now();
+    PROFILE_SCOPE("perception.cycle");
+    detectObjects();
+    bool published = finishPoseJob();
+    estimatePose();
+    return published;
+}
+
+// Returns the latest published results without blocking
+std::shared_ptr<const PerceptionSnapshot> PerceptionSystem::snapshot() const {
+    return std::atomic_load(&front_);
 }
 
 // Detect objects using the camera and object detection module
 void PerceptionSystem::detectObjects() {
-    
+    PROFILE_SCOPE("perception.detect");
+    const std::vector<Object>& objects = objectDetection_.runInference(frames_.data(), frames_.size());
+    detections_.assign(objects.begin(), objects.end());
 }
 
-// Estimate poses of detected objects
+// Estimate poses of detected objects, fanning them out to the pose workers
 void PerceptionSystem::estimatePose() {
-   
+    std::shared_ptr<PoseJob> job = std::make_shared<PoseJob>();
+    job->stamp = framesStamp_;
+    job->objects.swap(detections_);
+    job->scenes = scenes_;
+    job->poses.resize(job->objects.size());
+    job->confidence.assign(job->objects.size(), 0.0f);
+    job->done.reset(new std::atomic<bool>[job->objects.size()]);
+    for (std::size_t i = 0; i < job->objects.size(); ++i) {
+        job->done[i] = false;
+    }
+    pendingDeadline_ = std::chrono::steady_clock::now() + poseDeadline_;
+    pendingJob_ = job;
+    if (job->objects.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(poseLock_);
+        poseJobs_.push_back(std::move(job));
+    }
+    poseCv_.notify_all();
+}
+
+// Waits for the pending job until its deadline and publishes its results
+// Objects still being estimated keep their coarse pose with a zero confidence
+// Late estimates are cancelled, and waited for so that the 3D data of the job can be released
+bool PerceptionSystem::finishPoseJob() {
+    if (!pendingJob_) {
+        return false;
+    }
+    PROFILE_SCOPE("perception.wait_poses");
+    std::shared_ptr<PoseJob> job = std::move(pendingJob_);
+    const std::size_t count = job->objects.size();
+    {
+        std::unique_lock<std::mutex> lock(poseLock_);
+        poseDoneCv_.wait_until(lock, pendingDeadline_, [&job, count] { return job->finished.load() == count; });
+        job->abandoned = true;
+        poseDoneCv_.wait(lock, [&job] { return job->inFlight == 0; });
+    }
+
+    back_->stamp = job->stamp;
+    back_->objects = job->objects;
+    back_->poses.resize(count);
+    back_->poseConfidence.resize(count);
+    back_->lateObjects = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (job->done[i].load(std::memory_order_acquire)) {
+            back_->poses[i] = job->poses[i];
+            back_->poseConfidence[i] = job->confidence[i];
+        } else {
+            back_->poses[i] = poseEstimation_.coarseEstimate(job->objects[i]);
+            back_->poseConfidence[i] = 0.0f;
+            back_->lateObjects++;
+        }
+    }
+    publish();
+    return true;
+}
+
+// Pose worker routine, claiming objects of the oldest job until it is exhausted or abandoned
+void PerceptionSystem::poseWorkerRoutine() {
+    Profiler::setThreadName("pose_worker");
+    std::unique_lock<std::mutex> lock(poseLock_);
+    while (true) {
+        poseCv_.wait(lock, [this] { return stopPoseWorkers_ || !poseJobs_.empty(); });
+        if (stopPoseWorkers_) {
+            return;
+        }
+        std::shared_ptr<PoseJob> job = poseJobs_.front();
+        std::size_t i = job->next.fetch_add(1);
+        if (i >= job->objects.size() || job->abandoned) {
+            if (!poseJobs_.empty() && poseJobs_.front() == job) {
+                poseJobs_.pop_front();
+            }
+            continue;
+        }
+        job->inFlight++;
+        lock.unlock();
+        const Object& object = job->objects[i];
+        const SceneData scene = object.frame < job->scenes.size() ? job->scenes[object.frame] : SceneData{};
+        Pose pose;
+        float confidence = 0.0f;
+        {
+            PROFILE_SCOPE("perception.pose");
+            if (poseEstimation_.estimateFrom3DData(object, scene, pose, confidence, &job->abandoned) && !job->abandoned) {
+                job->poses[i] = pose;
+                job->confidence[i] = confidence;
+                job->done[i].store(true, std::memory_order_release);
+            }
+        }
+        lock.lock();
+        job->inFlight--;
+        if (job->finished.fetch_add(1) + 1 == job->objects.size() || job->inFlight == 0) {
+            poseDoneCv_.notify_one();
+        }
+    }
+}
+
+// Publishes the back buffer
+// The previous front buffer becomes the next back buffer once no reader holds it,
+// otherwise a spare one is used so that readers are never waited on
+// Readers can no longer reach a buffer once it left front_, so its use count only decreases
+void PerceptionSystem::publish() {
+    back_->sequence = ++sequence_;
+    std::shared_ptr<PerceptionSnapshot> recycled = std::const_pointer_cast<PerceptionSnapshot>(
+        std::atomic_exchange(&front_, std::shared_ptr<const PerceptionSnapshot>(std::move(back_))));
+    if (recycled && recycled.use_count() == 1) {
+        back_ = std::move(recycled);
+        return;
+    }
+    if (spare_ && spare_.use_count() == 1) {
+        back_ = std::move(spare_);
+    } else {
+        back_ = std::make_shared<PerceptionSnapshot>();
+    }
+    if (recycled) {
+        spare_ = std::move(recycled);
+    }
 }
@@ -1,7 +1,52 @@
 #ifndef POSE_ESTIMATION_HPP
 #define POSE_ESTIMATION_HPP
 
-#include "robot_motion_planner/robot.hpp"
+#include "geometry/geometry.hpp"
+#include "object_detection/object_detection.hpp"
+#include "pose_estimation/voxel_grid.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Pinhole camera parameters in pixels
+struct CameraIntrinsics {
+    double fx;
+    double fy;
+    double cx;
+    double cy;
+};
+
+// Non-owning view of an organized point cloud with float x, y and z fields,
+// e.g. the data of a sensor_msgs/PointCloud2 registered to the color image
+struct PointCloudView {
+    const std::uint8_t* data;
+    int width;
+    int height;
+    std::size_t pointStep;
+    std::size_t rowStep;
+    std::size_t xOffset;
+    std::size_t yOffset;
+    std::size_t zOffset;
+};
+
+// Non-owning view of a 16-bit depth image registered to the color image
+struct DepthImageView {
+    const std::uint16_t* data;
+    int width;
+    int height;
+    std::size_t stride;     // Pixels per row
+    double depthScale;      // Meters per depth unit
+    CameraIntrinsics intrinsics;
+};
+
+// 3D data of a camera frame, either a point cloud or a depth image, a null data pointer meaning absent
+struct SceneData {
+    PointCloudView cloud;
+    DepthImageView depth;
+};
 
 class PoseEstimation {
 public:
@@ -12,11 +57,51 @@ public:
     ~PoseEstimation();
 
     // Method to estimate pose from 3D data
-    Pose estimateFrom3DData();
+    // Points are cropped to the detection bounding box and downsampled before being registered
+    // against the model of the object class; safe to call concurrently, and stops early once cancel is set
+    // Returns false if no pose could be estimated
+    bool estimateFrom3DData(const Object& object, const SceneData& scene, Pose& pose, float& confidence,
+                            const std::atomic<bool>* cancel = nullptr) const;
+
+    // Methods to configure the camera model, fields of view in radians and working distance in meters
+    void setCameraModel(double horizontalFov, double verticalFov, double workingDistance);
+
+    // Methods to configure the processing, not to be called while estimating
+    void setLeafSize(double leafSize);
+    void setDepthRange(double minDepth, double maxDepth);
+    void setIcpIterations(std::size_t iterations);
+
+    // Sets the model points of an object class, as x, y, z triplets in the object frame
+    void setModel(ClassId classId, const std::vector<float>& points);
+
+    // Fast pose guess in the camera frame from the bounding box of a detection
+    Pose coarseEstimate(const Object& object) const;
 
 private:
-    // Object pose as a private member
-    Pose objectPose;
+
+    // Crops the 3D data to the detection bounding box into a voxel grid
+    void cropToVoxels(const Object& object, const SceneData& scene, VoxelGrid& grid) const;
+
+    // Aligns a model to the scene points, rotating about the camera axis only
+    // Returns the fraction of model points with a close scene point
+    double registerModel(const VoxelGrid& model, const VoxelGrid& scene, Pose& pose,
+                         const std::atomic<bool>* cancel) const;
+
+    // Refines a pose with ICP, returning the same fraction
+    double refineIcp(const VoxelGrid& model, const VoxelGrid& scene, Pose& pose,
+                     const std::atomic<bool>* cancel) const;
+
+    double horizontalFov_;
+    double verticalFov_;
+    double workingDistance_;
+
+    double leafSize_;
+    double minDepth_;
+    double maxDepth_;
+    std::size_t icpIterations_;
+
+    // Downsampled model of each object class
+    std::unordered_map<ClassId, VoxelGrid> models_;
 };
 
 #endif // POSE_ESTIMATION_HPP
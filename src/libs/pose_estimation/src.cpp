@@ -1,14 +1,401 @@
 #include "pose_estimation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Voxel coordinates are packed in 21 bits each
+const std::int64_t voxel_bias = 1 << 20;
+const std::uint64_t empty_key = ~0ULL;
+
+const double pi = 3.14159265358979323846;
+
+inline std::uint64_t hashKey(std::uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+inline float readFloat(const std::uint8_t* p) {
+    float value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Centroid and principal axis angle in the xy plane of a voxel grid
+void principalAxis(const VoxelGrid& grid, double& cx, double& cy, double& cz, double& angle) {
+    cx = cy = cz = 0.0;
+    for (std::size_t i = 0; i < grid.size(); ++i) {
+        cx += grid.x()[i];
+        cy += grid.y()[i];
+        cz += grid.z()[i];
+    }
+    cx /= grid.size();
+    cy /= grid.size();
+    cz /= grid.size();
+    double sxx = 0.0, sxy = 0.0, syy = 0.0;
+    for (std::size_t i = 0; i < grid.size(); ++i) {
+        double dx = grid.x()[i] - cx;
+        double dy = grid.y()[i] - cy;
+        sxx += dx * dx;
+        sxy += dx * dy;
+        syy += dy * dy;
+    }
+    angle = 0.5 * std::atan2(2.0 * sxy, sxx - syy);
+}
+
+}
 
 // Constructor
-PoseEstimation::PoseEstimation() {
+VoxelGrid::VoxelGrid(double leafSize) : mask_(0) {
+    setLeafSize(leafSize);
+}
+
+// Methods to configure the grid
+void VoxelGrid::setLeafSize(double leafSize) {
+    leafSize_ = leafSize;
+    inverseLeaf_ = static_cast<float>(1.0 / leafSize);
+    clear();
+}
+
+// Removes all points, keeping the storage
+void VoxelGrid::clear() {
+    std::fill(keys_.begin(), keys_.end(), empty_key);
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    count_.clear();
+    voxelKeys_.clear();
+}
+
+// Packs the voxel coordinates of a point into a key
+std::uint64_t VoxelGrid::key(float x, float y, float z) const {
+    std::uint64_t ix = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(x * inverseLeaf_)) + voxel_bias) & 0x1fffff;
+    std::uint64_t iy = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(y * inverseLeaf_)) + voxel_bias) & 0x1fffff;
+    std::uint64_t iz = static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(z * inverseLeaf_)) + voxel_bias) & 0x1fffff;
+    return (ix << 42) | (iy << 21) | iz;
+}
+
+// Accumulates a point into its voxel
+void VoxelGrid::insert(float x, float y, float z) {
+    if (2 * (x_.size() + 1) > keys_.size()) {
+        grow();
+    }
+    std::uint64_t k = key(x, y, z);
+    std::size_t slot = hashKey(k) & mask_;
+    while (keys_[slot] != empty_key && keys_[slot] != k) {
+        slot = (slot + 1) & mask_;
+    }
+    if (keys_[slot] == empty_key) {
+        keys_[slot] = k;
+        slots_[slot] = static_cast<std::uint32_t>(x_.size());
+        x_.push_back(0.0f);
+        y_.push_back(0.0f);
+        z_.push_back(0.0f);
+        count_.push_back(0);
+        voxelKeys_.push_back(k);
+    }
+    std::uint32_t i = slots_[slot];
+    x_[i] += x;
+    y_[i] += y;
+    z_[i] += z;
+    count_[i]++;
+}
+
+// Turns the accumulated sums into centroids
+void VoxelGrid::finalize() {
+    for (std::size_t i = 0; i < x_.size(); ++i) {
+        float inverse = 1.0f / count_[i];
+        x_[i] *= inverse;
+        y_[i] *= inverse;
+        z_[i] *= inverse;
+    }
+}
+
+// Doubles the hash table and reinserts the occupied voxels
+void VoxelGrid::grow() {
+    std::size_t capacity = std::max<std::size_t>(1024, 2 * keys_.size());
+    keys_.assign(capacity, empty_key);
+    slots_.assign(capacity, 0);
+    mask_ = capacity - 1;
+    for (std::size_t i = 0; i < voxelKeys_.size(); ++i) {
+        std::size_t slot = hashKey(voxelKeys_[i]) & mask_;
+        while (keys_[slot] != empty_key) {
+            slot = (slot + 1) & mask_;
+        }
+        keys_[slot] = voxelKeys_[i];
+        slots_[slot] = static_cast<std::uint32_t>(i);
+    }
+}
+
+// Constructor
+PoseEstimation::PoseEstimation()
+    : horizontalFov_(1.2), verticalFov_(0.9), workingDistance_(0.6),
+      leafSize_(0.005), minDepth_(0.1), maxDepth_(2.0), icpIterations_(15) {
 }
 
 // Destructor
 PoseEstimation::~PoseEstimation() {
 }
 
+// Methods to configure the camera model
+void PoseEstimation::setCameraModel(double horizontalFov, double verticalFov, double workingDistance) {
+    horizontalFov_ = horizontalFov;
+    verticalFov_ = verticalFov;
+    workingDistance_ = workingDistance;
+}
+
+// Methods to configure the processing
+void PoseEstimation::setLeafSize(double leafSize) {
+    leafSize_ = leafSize;
+}
+
+void PoseEstimation::setDepthRange(double minDepth, double maxDepth) {
+    minDepth_ = minDepth;
+    maxDepth_ = maxDepth;
+}
+
+void PoseEstimation::setIcpIterations(std::size_t iterations) {
+    icpIterations_ = iterations;
+}
+
+// Sets the model points of an object class, downsampled at the scene resolution
+void PoseEstimation::setModel(ClassId classId, const std::vector<float>& points) {
+    VoxelGrid& model = models_[classId];
+    model.setLeafSize(leafSize_);
+    for (std::size_t i = 0; i + 2 < points.size(); i += 3) {
+        model.insert(points[i], points[i + 1], points[i + 2]);
+    }
+    model.finalize();
+}
+
+// Back-projects the bounding box center at the working distance
+Pose PoseEstimation::coarseEstimate(const Object& object) const {
+    double u = object.x + 0.5 * object.width - 0.5;
+    double v = object.y + 0.5 * object.height - 0.5;
+    Pose pose{0, 0, workingDistance_, 0, 0, 0};
+    pose.x = workingDistance_ * std::tan(u * horizontalFov_);
+    pose.y = workingDistance_ * std::tan(v * verticalFov_);
+    return pose;
+}
+
 // Method to estimate pose from 3D data
-Pose PoseEstimation::estimateFrom3DData() {
-    return objectPose;
+// Without 3D data the coarse estimate is returned, with enough points but no model the points centroid
+bool PoseEstimation::estimateFrom3DData(const Object& object, const SceneData& scene, Pose& pose, float& confidence,
+                                        const std::atomic<bool>* cancel) const {
+    pose = coarseEstimate(object);
+    confidence = object.confidence;
+    if (!scene.cloud.data && !scene.depth.data) {
+        return true;
+    }
+
+    // Scratch grid reused by each calling thread
+    thread_local VoxelGrid points;
+    if (points.leafSize() != leafSize_) {
+        points.setLeafSize(leafSize_);
+    }
+    points.clear();
+    cropToVoxels(object, scene, points);
+    if (points.size() < 3) {
+        confidence = 0.0f;
+        return false;
+    }
+
+    double angle;
+    principalAxis(points, pose.x, pose.y, pose.z, angle);
+
+    auto model = models_.find(object.classId);
+    if (model == models_.end() || model->second.size() == 0) {
+        return true;
+    }
+    double fitness = registerModel(model->second, points, pose, cancel);
+    confidence = static_cast<float>(object.confidence * fitness);
+    return true;
+}
+
+// Crops the 3D data to the detection bounding box into a voxel grid
+// Only the pixels inside the box are read, the rest of the frame is never touched
+void PoseEstimation::cropToVoxels(const Object& object, const SceneData& scene, VoxelGrid& grid) const {
+    const bool useCloud = scene.cloud.data != nullptr;
+    const int width = useCloud ? scene.cloud.width : scene.depth.width;
+    const int height = useCloud ? scene.cloud.height : scene.depth.height;
+    int u0 = std::max(0, static_cast<int>(object.x * width));
+    int v0 = std::max(0, static_cast<int>(object.y * height));
+    int u1 = std::min(width, static_cast<int>(std::ceil((object.x + object.width) * width)));
+    int v1 = std::min(height, static_cast<int>(std::ceil((object.y + object.height) * height)));
+    const float minDepth = static_cast<float>(minDepth_);
+    const float maxDepth = static_cast<float>(maxDepth_);
+
+    if (useCloud) {
+        const PointCloudView& cloud = scene.cloud;
+        for (int v = v0; v < v1; ++v) {
+            const std::uint8_t* point = cloud.data + v * cloud.rowStep + u0 * cloud.pointStep;
+            for (int u = u0; u < u1; ++u, point += cloud.pointStep) {
+                float z = readFloat(point + cloud.zOffset);
+                if (!(z >= minDepth && z <= maxDepth)) {
+                    continue;
+                }
+                grid.insert(readFloat(point + cloud.xOffset), readFloat(point + cloud.yOffset), z);
+            }
+        }
+    } else {
+        const DepthImageView& depth = scene.depth;
+        const float scale = static_cast<float>(depth.depthScale);
+        const float ifx = static_cast<float>(1.0 / depth.intrinsics.fx);
+        const float ify = static_cast<float>(1.0 / depth.intrinsics.fy);
+        const float cx = static_cast<float>(depth.intrinsics.cx);
+        const float cy = static_cast<float>(depth.intrinsics.cy);
+        for (int v = v0; v < v1; ++v) {
+            const std::uint16_t* row = depth.data + v * depth.stride;
+            for (int u = u0; u < u1; ++u) {
+                float z = row[u] * scale;
+                if (!(z >= minDepth && z <= maxDepth)) {
+                    continue;
+                }
+                grid.insert((u - cx) * z * ifx, (v - cy) * z * ify, z);
+            }
+        }
+    }
+    grid.finalize();
+}
+
+// Aligns a model to the scene points with point to point ICP
+// Rotation is restricted to the camera axis, which matches objects lying in a bin under the camera
+// ICP is started from the principal axes of both point sets, in both directions since they are ambiguous
+// Returns the fraction of model points with a scene point within two leaves
+double PoseEstimation::registerModel(const VoxelGrid& model, const VoxelGrid& scene, Pose& pose,
+                                     const std::atomic<bool>* cancel) const {
+    double mcx, mcy, mcz, modelAngle;
+    double scx, scy, scz, sceneAngle;
+    principalAxis(model, mcx, mcy, mcz, modelAngle);
+    principalAxis(scene, scx, scy, scz, sceneAngle);
+
+    double bestFitness = -1.0;
+    for (int direction = 0; direction < 2; ++direction) {
+        double yaw = sceneAngle - modelAngle + direction * pi;
+        double c = std::cos(yaw);
+        double s = std::sin(yaw);
+        Pose candidate = pose;
+        candidate.x = scx - (c * mcx - s * mcy);
+        candidate.y = scy - (s * mcx + c * mcy);
+        candidate.z = scz - mcz;
+        candidate.yaw = yaw;
+        double fitness = refineIcp(model, scene, candidate, cancel);
+        if (fitness > bestFitness) {
+            bestFitness = fitness;
+            pose = candidate;
+        }
+    }
+    pose.yaw = std::remainder(pose.yaw, 2.0 * pi);
+    return bestFitness;
+}
+
+// Runs point to point ICP about the camera axis from an initial pose
+// Returns the fraction of model points with a scene point within two leaves
+double PoseEstimation::refineIcp(const VoxelGrid& model, const VoxelGrid& scene, Pose& pose,
+                                 const std::atomic<bool>* cancel) const {
+    // Squared distances of four and two leaves
+    const float maxDistance = static_cast<float>(16.0 * leafSize_ * leafSize_);
+    const float inlierDistance = static_cast<float>(4.0 * leafSize_ * leafSize_);
+    const float* mx = model.x();
+    const float* my = model.y();
+    const float* mz = model.z();
+    const float* sx = scene.x();
+    const float* sy = scene.y();
+    const float* sz = scene.z();
+    double tx = pose.x;
+    double ty = pose.y;
+    double tz = pose.z;
+    double yaw = pose.yaw;
+
+    // Model points moved to the current estimate, once per iteration
+    thread_local std::vector<float> wx, wy, wz;
+    wx.resize(model.size());
+    wy.resize(model.size());
+    wz.resize(model.size());
+
+    std::size_t inliers = 0;
+    for (std::size_t iteration = 0; iteration < icpIterations_; ++iteration) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            break;
+        }
+        const Transform estimate{Quaternion::fromRpy(0.0, 0.0, yaw), Vec3(tx, ty, tz)};
+        transformPoints(estimate, mx, my, mz, wx.data(), wy.data(), wz.data(), model.size());
+
+        // Correspondences between transformed model points and their closest scene points
+        double px = 0.0, py = 0.0, pz = 0.0, qx = 0.0, qy = 0.0, qz = 0.0;
+        double sxx = 0.0, sxy = 0.0, syx = 0.0, syy = 0.0;
+        std::size_t pairs = 0;
+        inliers = 0;
+        for (std::size_t i = 0; i < model.size(); ++i) {
+            const float x = wx[i];
+            const float y = wy[i];
+            const float z = wz[i];
+            float best = std::numeric_limits<float>::max();
+            std::size_t bestIndex = 0;
+            for (std::size_t j = 0; j < scene.size(); ++j) {
+                float dx = sx[j] - x;
+                float dy = sy[j] - y;
+                float dz = sz[j] - z;
+                float d = dx * dx + dy * dy + dz * dz;
+                if (d < best) {
+                    best = d;
+                    bestIndex = j;
+                }
+            }
+            if (best > maxDistance) {
+                continue;
+            }
+            if (best <= inlierDistance) {
+                inliers++;
+            }
+            px += mx[i];
+            py += my[i];
+            pz += mz[i];
+            qx += sx[bestIndex];
+            qy += sy[bestIndex];
+            qz += sz[bestIndex];
+            sxx += mx[i] * sx[bestIndex];
+            sxy += mx[i] * sy[bestIndex];
+            syx += my[i] * sx[bestIndex];
+            syy += my[i] * sy[bestIndex];
+            pairs++;
+        }
+        if (pairs < 3) {
+            break;
+        }
+
+        // Closed form rotation about z and translation from the centered cross covariance
+        double n = static_cast<double>(pairs);
+        px /= n; py /= n; pz /= n;
+        qx /= n; qy /= n; qz /= n;
+        double a = (sxx - n * px * qx) + (syy - n * py * qy);
+        double b = (sxy - n * px * qy) - (syx - n * py * qx);
+        double newYaw = std::atan2(b, a);
+        double nc = std::cos(newYaw);
+        double ns = std::sin(newYaw);
+        double newTx = qx - (nc * px - ns * py);
+        double newTy = qy - (ns * px + nc * py);
+        double newTz = qz - pz;
+        double step = std::abs(std::remainder(newYaw - yaw, 2.0 * pi)) +
+            std::abs(newTx - tx) + std::abs(newTy - ty) + std::abs(newTz - tz);
+        yaw = newYaw;
+        tx = newTx;
+        ty = newTy;
+        tz = newTz;
+        if (step < 1e-3 * leafSize_) {
+            break;
+        }
+    }
+
+    pose.x = tx;
+    pose.y = ty;
+    pose.z = tz;
+    pose.roll = 0.0;
+    pose.pitch = 0.0;
+    pose.yaw = yaw;
+    return static_cast<double>(inliers) / model.size();
 }
@@ -0,0 +1,59 @@
+#ifndef VOXEL_GRID_HPP
+#define VOXEL_GRID_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hashed voxel grid averaging the points falling in each cell
+// Centroids are stored as separate x, y and z arrays so that registration loops stay contiguous
+// Storage is kept across clear() calls, so a grid reused per thread does not allocate in steady state
+class VoxelGrid {
+public:
+    // Constructor
+    VoxelGrid(double leafSize = 0.005);
+
+    // Methods to configure the grid
+    void setLeafSize(double leafSize);
+    double leafSize() const { return leafSize_; }
+
+    // Removes all points, keeping the storage
+    void clear();
+
+    // Accumulates a point into its voxel
+    void insert(float x, float y, float z);
+
+    // Turns the accumulated sums into centroids, to be called once after the inserts
+    void finalize();
+
+    // Number of occupied voxels
+    std::size_t size() const { return x_.size(); }
+
+    const float* x() const { return x_.data(); }
+    const float* y() const { return y_.data(); }
+    const float* z() const { return z_.data(); }
+
+private:
+
+    // Packs the voxel coordinates of a point into a key
+    std::uint64_t key(float x, float y, float z) const;
+
+    // Doubles the hash table and reinserts the occupied voxels
+    void grow();
+
+    double leafSize_;
+    float inverseLeaf_;
+
+    // Open addressing table of voxel keys and indices into the arrays below
+    std::vector<std::uint64_t> keys_;
+    std::vector<std::uint32_t> slots_;
+    std::size_t mask_;
+
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> z_;
+    std::vector<std::uint32_t> count_;
+    std::vector<std::uint64_t> voxelKeys_;
+};
+
+#endif // VOXEL_GRID_HPP
@@ -0,0 +1,91 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Timed span of a thread, the name being a string literal
+struct ProfileEvent {
+    const char* name;
+    std::int64_t start;     // Steady clock time [ns]
+    std::int64_t duration;  // [ns]
+};
+
+// Statistics of the spans of one name over a recent time window
+struct ProfileSummary {
+    std::string name;
+    std::size_t count;
+    double mean;    // [ms]
+    double p95;     // [ms]
+    double max;     // [ms]
+    double total;   // [ms]
+};
+
+// Cycle time profiler of the manipulation stack
+// Each thread records into its own ring, so recording never locks and never contends with other threads
+// Rings keep the latest events only, older ones being overwritten
+class Profiler {
+public:
+    // Enables or disables recording, disabled by default
+    static void setEnabled(bool enabled);
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // Sets the size of the rings of threads that did not record yet
+    static void setBufferSize(std::size_t events);
+
+    // Names the calling thread in the exported traces
+    static void setThreadName(const std::string& name);
+
+    // Records a span of the calling thread, for spans that do not fit a scope
+    static void record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    // Writes the recorded events as Chrome trace event JSON, readable by chrome://tracing and Perfetto
+    static void writeChromeTrace(std::ostream& out);
+    static bool writeChromeTrace(const std::string& path);
+
+    // Summarizes the spans that ended within the last window, by name
+    static std::vector<ProfileSummary> summary(std::chrono::steady_clock::duration window);
+
+    // Drops all recorded events
+    static void clear();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records the duration of the enclosing scope
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char* name) : name_(Profiler::enabled() ? name : nullptr) {
+        if (name_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (name_) {
+            Profiler::record(name_, start_, std::chrono::steady_clock::now());
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char* name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+// Times the enclosing scope under a string literal name
+#define PROFILE_SCOPE(name) ScopedTimer PROFILER_CONCAT(profileScope_, __LINE__)(name)
+
+#endif // PROFILER_HPP
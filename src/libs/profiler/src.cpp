@@ -0,0 +1,226 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+// Events of one thread, written by that thread only
+// Readers copy events in place and discard the ones the writer may have overwritten meanwhile
+// Each slot is guarded by a sequence number, odd while it is being written, that counts its writes
+struct ThreadBuffer {
+    explicit ThreadBuffer(std::size_t capacity, std::uint32_t id)
+        : events(capacity), sequences(new std::atomic<std::uint64_t>[capacity]), head(0), cleared(0), threadId(id) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            sequences[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<ProfileEvent> events;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> sequences;
+    std::atomic<std::uint64_t> head;
+    std::atomic<std::uint64_t> cleared;     // Events before this index were dropped
+    std::uint32_t threadId;
+    std::string threadName;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::size_t bufferSize = 16384;
+    std::atomic<std::uint32_t> nextThreadId{1};     // Never reused, so that clear() keeps ids unique
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// Buffer of the calling thread, registered on first use and kept after the thread exits until cleared
+ThreadBuffer& threadBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        buffer = std::make_shared<ThreadBuffer>(r.bufferSize, r.nextThreadId.fetch_add(1, std::memory_order_relaxed));
+        r.buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+std::int64_t nanoseconds(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+// Copies the intact events of a buffer
+void collect(const ThreadBuffer& buffer, std::vector<ProfileEvent>& events) {
+    const std::uint64_t capacity = buffer.events.size();
+    std::uint64_t head = buffer.head.load(std::memory_order_acquire);
+    std::uint64_t tail = head > capacity ? head - capacity : 0;
+    tail = std::max(tail, std::min(head, buffer.cleared.load(std::memory_order_relaxed)));
+    std::size_t first = events.size();
+    for (std::uint64_t i = tail; i < head; ++i) {
+        events.push_back(buffer.events[i % capacity]);
+    }
+    // Events whose slot was written again while they were copied are dropped: the fence orders the copies
+    // before the sequence checks, so a copy that saw any newer write also sees its sequence
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::size_t kept = first;
+    for (std::uint64_t i = tail; i < head; ++i) {
+        if (buffer.sequences[i % capacity].load(std::memory_order_relaxed) == 2 * (i / capacity + 1)) {
+            events[kept++] = events[first + (i - tail)];
+        }
+    }
+    events.resize(kept);
+}
+
+// Writes a JSON string, escaping quotes and backslashes
+void writeString(std::ostream& out, const char* s) {
+    out << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        out << *s;
+    }
+    out << '"';
+}
+
+}
+
+std::atomic<bool> Profiler::enabled_(false);
+
+// Enables or disables recording
+void Profiler::setEnabled(bool enabled) {
+    enabled_.store(enabled);
+}
+
+// Sets the size of the rings of threads that did not record yet
+void Profiler::setBufferSize(std::size_t events) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.lock);
+    r.bufferSize = std::max<std::size_t>(events, 2);
+}
+
+// Names the calling thread in the exported traces
+void Profiler::setThreadName(const std::string& name) {
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry().lock);
+    buffer.threadName = name;
+}
+
+// Records a span of the calling thread
+void Profiler::record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer& buffer = threadBuffer();
+    std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    std::int64_t begin = nanoseconds(start);
+    std::atomic<std::uint64_t>& sequence = buffer.sequences[head % buffer.events.size()];
+    std::uint64_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    // Keeps the event writes after the odd sequence, for the readers checking it afterwards
+    std::atomic_thread_fence(std::memory_order_release);
+    buffer.events[head % buffer.events.size()] = ProfileEvent{name, begin, nanoseconds(end) - begin};
+    sequence.store(seq + 2, std::memory_order_release);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+// Writes the recorded events as Chrome trace event JSON
+void Profiler::writeChromeTrace(std::ostream& out) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::vector<std::string> names;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        buffers = r.buffers;
+        for (const auto& buffer : buffers) {
+            names.push_back(buffer->threadName);
+        }
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<ProfileEvent> events;
+    for (std::size_t b = 0; b < buffers.size(); ++b) {
+        const ThreadBuffer& buffer = *buffers[b];
+        if (!names[b].empty()) {
+            out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer.threadId << ",\"args\":{\"name\":";
+            writeString(out, names[b].c_str());
+            out << "}}";
+            first = false;
+        }
+        events.clear();
+        collect(buffer, events);
+        for (const ProfileEvent& event : events) {
+            out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":";
+            writeString(out, event.name);
+            out << ",\"pid\":1,\"tid\":" << buffer.threadId << ",\"ts\":" << event.start / 1000 << '.' << (event.start / 100) % 10
+                << ",\"dur\":" << event.duration / 1000 << '.' << (event.duration / 100) % 10 << '}';
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    writeChromeTrace(out);
+    return static_cast<bool>(out);
+}
+
+// Summarizes the spans that ended within the last window, by name
+std::vector<ProfileSummary> Profiler::summary(std::chrono::steady_clock::duration window) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        buffers = r.buffers;
+    }
+    std::int64_t since = nanoseconds(std::chrono::steady_clock::now() - window);
+    std::vector<ProfileEvent> events;
+    for (const auto& buffer : buffers) {
+        collect(*buffer, events);
+    }
+
+    // Names are literals, but the same literal may have several addresses across translation units
+    std::map<std::string, std::vector<std::int64_t>> durations;
+    for (const ProfileEvent& event : events) {
+        if (event.start + event.duration >= since) {
+            durations[event.name].push_back(event.duration);
+        }
+    }
+
+    std::vector<ProfileSummary> result;
+    for (auto& entry : durations) {
+        std::vector<std::int64_t>& d = entry.second;
+        std::sort(d.begin(), d.end());
+        double total = 0.0;
+        for (std::int64_t value : d) {
+            total += value;
+        }
+        std::size_t p95 = std::min(d.size() - 1, (d.size() * 95) / 100);
+        result.push_back(ProfileSummary{entry.first, d.size(), total / d.size() * 1e-6, d[p95] * 1e-6, d.back() * 1e-6, total * 1e-6});
+    }
+    std::sort(result.begin(), result.end(), [](const ProfileSummary& a, const ProfileSummary& b) { return a.total > b.total; });
+    return result;
+}
+
+// Drops all recorded events
+// Rings are only written by their threads, so readers skip the events older than the clear instead
+void Profiler::clear() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.lock);
+    auto it = std::remove_if(r.buffers.begin(), r.buffers.end(),
+        [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer.use_count() == 1; });
+    r.buffers.erase(it, r.buffers.end());
+    for (const auto& buffer : r.buffers) {
+        buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
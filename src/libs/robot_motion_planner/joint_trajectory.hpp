@@ -0,0 +1,135 @@
+#ifndef JOINT_TRAJECTORY_HPP
+#define JOINT_TRAJECTORY_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Allocator returning memory aligned to a cache line, so that joint arrays can be loaded with aligned SIMD accesses
+template <typename T, std::size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        void* p = std::aligned_alloc(Alignment, bytes);
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) {
+        std::free(p);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+class JointTrajectory;
+
+// Read-only view of a range of samples of a JointTrajectory, cheap to copy
+class TrajectoryView {
+public:
+    TrajectoryView() : trajectory_(nullptr), first_(0), samples_(0) {}
+    TrajectoryView(const JointTrajectory& trajectory, std::size_t first, std::size_t samples)
+        : trajectory_(&trajectory), first_(first), samples_(samples) {}
+
+    std::size_t dof() const;
+    std::size_t samples() const { return samples_; }
+    bool empty() const { return samples_ == 0; }
+
+    // Contiguous arrays of one joint, or of the sample times, starting at the first sample of the view
+    const double* positions(std::size_t joint) const;
+    const double* velocities(std::size_t joint) const;
+    const double* times() const;
+
+    double position(std::size_t joint, std::size_t sample) const { return positions(joint)[sample]; }
+    double velocity(std::size_t joint, std::size_t sample) const { return velocities(joint)[sample]; }
+    double time(std::size_t sample) const { return times()[sample]; }
+
+    // Sub-range of this view, clamped to it
+    TrajectoryView slice(std::size_t first, std::size_t samples) const {
+        if (first > samples_) {
+            first = samples_;
+        }
+        if (samples > samples_ - first) {
+            samples = samples_ - first;
+        }
+        return TrajectoryView(*trajectory_, first_ + first, samples);
+    }
+
+private:
+    const JointTrajectory* trajectory_;
+    std::size_t first_;
+    std::size_t samples_;
+};
+
+// Trajectory stored as structure of arrays: one contiguous, aligned array per joint
+// for positions and velocities, plus the time of every sample from the trajectory start
+class JointTrajectory {
+public:
+    JointTrajectory() : dof_(0), samples_(0), stride_(0) {}
+
+    // Changes the trajectory size, reusing the storage when it is large enough
+    void resize(std::size_t dof, std::size_t samples) {
+        dof_ = dof;
+        samples_ = samples;
+        // Pad each joint array to whole cache lines, so that all of them stay aligned
+        stride_ = (samples + lanes - 1) / lanes * lanes;
+        positions_.resize(dof_ * stride_);
+        velocities_.resize(dof_ * stride_);
+        times_.resize(stride_);
+    }
+
+    void clear() { resize(0, 0); }
+
+    std::size_t dof() const { return dof_; }
+    std::size_t samples() const { return samples_; }
+    std::size_t stride() const { return stride_; }
+    bool empty() const { return samples_ == 0; }
+    double duration() const { return samples_ > 0 ? times_[samples_ - 1] : 0.0; }
+
+    double* positions(std::size_t joint) { return positions_.data() + joint * stride_; }
+    double* velocities(std::size_t joint) { return velocities_.data() + joint * stride_; }
+    double* times() { return times_.data(); }
+    const double* positions(std::size_t joint) const { return positions_.data() + joint * stride_; }
+    const double* velocities(std::size_t joint) const { return velocities_.data() + joint * stride_; }
+    const double* times() const { return times_.data(); }
+
+    // Views of the whole trajectory or of a range of samples
+    TrajectoryView view() const { return TrajectoryView(*this, 0, samples_); }
+    TrajectoryView slice(std::size_t first, std::size_t samples) const { return view().slice(first, samples); }
+
+private:
+    static constexpr std::size_t lanes = 64 / sizeof(double);
+
+    std::size_t dof_;
+    std::size_t samples_;
+    std::size_t stride_;
+    std::vector<double, AlignedAllocator<double>> positions_;
+    std::vector<double, AlignedAllocator<double>> velocities_;
+    std::vector<double, AlignedAllocator<double>> times_;
+};
+
+inline std::size_t TrajectoryView::dof() const { return trajectory_ != nullptr ? trajectory_->dof() : 0; }
+inline const double* TrajectoryView::positions(std::size_t joint) const { return trajectory_->positions(joint) + first_; }
+inline const double* TrajectoryView::velocities(std::size_t joint) const { return trajectory_->velocities(joint) + first_; }
+inline const double* TrajectoryView::times() const { return trajectory_->times() + first_; }
+
+#endif // JOINT_TRAJECTORY_HPP
@@ -0,0 +1,362 @@
+#include "kinematics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+// Largest joint step of one damped least squares iteration [rad]
+const double max_step = 0.3;
+
+// Closed-form solutions considered per target
+const std::size_t max_analytical = 16;
+
+inline std::uint64_t splitmix(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline void cross(const double* a, const double* b, double* c) {
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Solves A x = b in place for a symmetric positive definite 6x6 matrix, by Cholesky factorization
+void solveSpd6(double* a, double* b) {
+    for (int j = 0; j < 6; ++j) {
+        double diagonal = a[j * 6 + j];
+        for (int k = 0; k < j; ++k) {
+            diagonal -= a[j * 6 + k] * a[j * 6 + k];
+        }
+        diagonal = std::sqrt(std::max(diagonal, 1e-12));
+        a[j * 6 + j] = diagonal;
+        for (int i = j + 1; i < 6; ++i) {
+            double value = a[i * 6 + j];
+            for (int k = 0; k < j; ++k) {
+                value -= a[i * 6 + k] * a[j * 6 + k];
+            }
+            a[i * 6 + j] = value / diagonal;
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        for (int k = 0; k < i; ++k) {
+            b[i] -= a[i * 6 + k] * b[k];
+        }
+        b[i] /= a[i * 6 + i];
+    }
+    for (int i = 5; i >= 0; --i) {
+        for (int k = i + 1; k < 6; ++k) {
+            b[i] -= a[k * 6 + i] * b[k];
+        }
+        b[i] /= a[i * 6 + i];
+    }
+}
+
+}
+
+// Constructor
+Kinematics::Kinematics(const std::vector<DhJoint>& chain, std::size_t cacheSize, double positionStep, double angleStep)
+    : chain_(chain), positionTolerance_(1e-4), orientationTolerance_(1e-3), damping_(0.05), maxIterations_(100),
+      positionStep_(positionStep), angleStep_(angleStep),
+      solved_(0), failed_(0), cacheHits_(0), analyticalCount_(0), iterations_(0) {
+    std::size_t size = 1;
+    while (size < cacheSize) {
+        size <<= 1;
+    }
+    slots_.assign(size, Slot{{0, 0, 0, 0, 0, 0}, false});
+    cached_.resize(size * chain_.size());
+}
+
+// Methods to configure the solver
+void Kinematics::setAnalyticalSolver(AnalyticalIk solver) {
+    analytical_ = std::move(solver);
+}
+
+void Kinematics::setTolerances(double position, double orientation) {
+    positionTolerance_ = position;
+    orientationTolerance_ = orientation;
+}
+
+void Kinematics::setDamping(double damping) {
+    damping_ = damping;
+}
+
+void Kinematics::setMaxIterations(int iterations) {
+    maxIterations_ = iterations;
+}
+
+// Tool pose at given joint positions
+Pose Kinematics::forward(const double* joints) const {
+    Frame tool;
+    forwardFrames(joints, tool, nullptr, nullptr);
+    return Transform{Quaternion::fromMatrix(tool.r), Vec3(tool.p[0], tool.p[1], tool.p[2])}.toPose();
+}
+
+// Chains the joint transforms, each a rotation about z, a translation along z and x, then a rotation about x
+// Axis i is the z axis of the frame before joint i, so the Jacobian needs no extra pass
+void Kinematics::forwardFrames(const double* joints, Frame& tool, double* axes, double* origins) const {
+    double r[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    double p[3] = {0, 0, 0};
+    for (std::size_t i = 0; i < chain_.size(); ++i) {
+        if (axes != nullptr) {
+            axes[i * 3 + 0] = r[2];
+            axes[i * 3 + 1] = r[5];
+            axes[i * 3 + 2] = r[8];
+            origins[i * 3 + 0] = p[0];
+            origins[i * 3 + 1] = p[1];
+            origins[i * 3 + 2] = p[2];
+        }
+        const DhJoint& joint = chain_[i];
+        const double ct = std::cos(joints[i] + joint.offset), st = std::sin(joints[i] + joint.offset);
+        const double ca = std::cos(joint.alpha), sa = std::sin(joint.alpha);
+        const double t[9] = {ct, -st * ca, st * sa,
+                             st, ct * ca, -ct * sa,
+                             0.0, sa, ca};
+        const double offset[3] = {joint.a * ct, joint.a * st, joint.d};
+        double next[9];
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 3; ++col) {
+                next[row * 3 + col] = r[row * 3] * t[col] + r[row * 3 + 1] * t[3 + col] + r[row * 3 + 2] * t[6 + col];
+            }
+        }
+        for (int row = 0; row < 3; ++row) {
+            p[row] += r[row * 3] * offset[0] + r[row * 3 + 1] * offset[1] + r[row * 3 + 2] * offset[2];
+        }
+        std::copy(next, next + 9, r);
+    }
+    std::copy(r, r + 9, tool.r);
+    std::copy(p, p + 3, tool.p);
+}
+
+// Position error, then orientation error as half the sum of the cross products of matching axes
+void Kinematics::frameError(const Frame& target, const Frame& current, double* error) {
+    for (int i = 0; i < 3; ++i) {
+        error[i] = target.p[i] - current.p[i];
+        error[3 + i] = 0.0;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        const double c[3] = {current.r[axis], current.r[3 + axis], current.r[6 + axis]};
+        const double t[3] = {target.r[axis], target.r[3 + axis], target.r[6 + axis]};
+        double product[3];
+        cross(c, t, product);
+        for (int i = 0; i < 3; ++i) {
+            error[3 + i] += 0.5 * product[i];
+        }
+    }
+}
+
+// Damped least squares: dq = J^T (J J^T + damping^2 I)^-1 e, the 6x6 system being cheaper than the dof one
+bool Kinematics::refine(const Frame& target, double* joints) {
+    const std::size_t dof = chain_.size();
+    thread_local std::vector<double> axes, origins, jacobian, step;
+    axes.resize(dof * 3);
+    step.resize(dof);
+    origins.resize(dof * 3);
+    jacobian.resize(6 * dof);
+    const double lambda = damping_ * damping_;
+
+    Frame tool;
+    double error[6];
+    for (int iteration = 0; iteration <= maxIterations_; ++iteration) {
+        forwardFrames(joints, tool, axes.data(), origins.data());
+        frameError(target, tool, error);
+        const double position = std::sqrt(error[0] * error[0] + error[1] * error[1] + error[2] * error[2]);
+        const double orientation = std::sqrt(error[3] * error[3] + error[4] * error[4] + error[5] * error[5]);
+        if (position < positionTolerance_ && orientation < orientationTolerance_) {
+            iterations_.fetch_add(static_cast<std::size_t>(iteration), std::memory_order_relaxed);
+            return true;
+        }
+        if (iteration == maxIterations_) {
+            break;
+        }
+
+        // Jacobian columns, linear part z x (p - o) over angular part z, stored row major
+        for (std::size_t i = 0; i < dof; ++i) {
+            const double* z = axes.data() + i * 3;
+            const double arm[3] = {tool.p[0] - origins[i * 3], tool.p[1] - origins[i * 3 + 1], tool.p[2] - origins[i * 3 + 2]};
+            double linear[3];
+            cross(z, arm, linear);
+            for (int k = 0; k < 3; ++k) {
+                jacobian[k * dof + i] = linear[k];
+                jacobian[(3 + k) * dof + i] = z[k];
+            }
+        }
+        double m[36];
+        for (int r = 0; r < 6; ++r) {
+            for (int c = r; c < 6; ++c) {
+                double sum = 0.0;
+                for (std::size_t i = 0; i < dof; ++i) {
+                    sum += jacobian[r * dof + i] * jacobian[c * dof + i];
+                }
+                m[r * 6 + c] = sum;
+                m[c * 6 + r] = sum;
+            }
+            m[r * 6 + r] += lambda;
+        }
+        solveSpd6(m, error);
+
+        // Joint step, scaled down as a whole if too large, then clamped to the limits
+        double largest = 0.0;
+        for (std::size_t i = 0; i < dof; ++i) {
+            step[i] = 0.0;
+            for (int k = 0; k < 6; ++k) {
+                step[i] += jacobian[k * dof + i] * error[k];
+            }
+            largest = std::max(largest, std::abs(step[i]));
+        }
+        const double scale = largest > max_step ? max_step / largest : 1.0;
+        for (std::size_t i = 0; i < dof; ++i) {
+            joints[i] = std::min(std::max(joints[i] + scale * step[i], chain_[i].lower), chain_[i].upper);
+        }
+    }
+    iterations_.fetch_add(static_cast<std::size_t>(maxIterations_), std::memory_order_relaxed);
+    return false;
+}
+
+// Solves joint positions reaching a pose
+bool Kinematics::solve(const Pose& target, const double* seed, double* solution) {
+    const std::size_t dof = chain_.size();
+    Frame goal;
+    Quaternion::fromRpy(target.roll, target.pitch, target.yaw).toMatrix(goal.r);
+    goal.p[0] = target.x;
+    goal.p[1] = target.y;
+    goal.p[2] = target.z;
+
+    // A cached solution in the same cell is closer than any seed
+    thread_local std::vector<double> start;
+    start.resize(dof);
+    const bool hit = cacheFind(target, start.data());
+    if (hit) {
+        cacheHits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        std::copy(seed, seed + dof, start.begin());
+    }
+
+    // Closed form first, keeping the solution within the limits nearest to the start
+    if (analytical_) {
+        thread_local std::vector<double> candidates;
+        candidates.resize(max_analytical * dof);
+        const std::size_t count = std::min(analytical_(target, candidates.data(), max_analytical), max_analytical);
+        const double* best = nullptr;
+        double bestDistance = std::numeric_limits<double>::max();
+        for (std::size_t n = 0; n < count; ++n) {
+            const double* q = candidates.data() + n * dof;
+            double distance = 0.0;
+            bool inside = true;
+            for (std::size_t i = 0; i < dof; ++i) {
+                inside = inside && q[i] >= chain_[i].lower && q[i] <= chain_[i].upper;
+                distance += (q[i] - start[i]) * (q[i] - start[i]);
+            }
+            if (inside && distance < bestDistance) {
+                best = q;
+                bestDistance = distance;
+            }
+        }
+        if (best != nullptr) {
+            std::copy(best, best + dof, solution);
+            analyticalCount_.fetch_add(1, std::memory_order_relaxed);
+            solved_.fetch_add(1, std::memory_order_relaxed);
+            cacheInsert(target, solution);
+            return true;
+        }
+    }
+
+    // Iterative fallback, retrying from the seed if the cached start did not converge
+    std::copy(start.begin(), start.end(), solution);
+    bool converged = refine(goal, solution);
+    if (!converged && hit) {
+        std::copy(seed, seed + dof, solution);
+        converged = refine(goal, solution);
+    }
+    if (!converged) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    solved_.fetch_add(1, std::memory_order_relaxed);
+    cacheInsert(target, solution);
+    return true;
+}
+
+// Solves many nearby targets, each one warm started from the previous solution
+std::size_t Kinematics::solveBatch(const Pose* targets, std::size_t count, const double* seed, double* solutions,
+                                   std::uint8_t* solved) {
+    const std::size_t dof = chain_.size();
+    const double* start = seed;
+    std::size_t total = 0;
+    for (std::size_t n = 0; n < count; ++n) {
+        double* solution = solutions + n * dof;
+        solved[n] = solve(targets[n], start, solution) ? 1 : 0;
+        if (solved[n]) {
+            start = solution;
+            total++;
+        }
+    }
+    return total;
+}
+
+// Quantizes a pose into a key and returns its slot
+std::size_t Kinematics::cacheKey(const Pose& pose, std::int32_t* key) const {
+    key[0] = static_cast<std::int32_t>(std::lround(pose.x / positionStep_));
+    key[1] = static_cast<std::int32_t>(std::lround(pose.y / positionStep_));
+    key[2] = static_cast<std::int32_t>(std::lround(pose.z / positionStep_));
+    key[3] = static_cast<std::int32_t>(std::lround(std::remainder(pose.roll, 2.0 * pi) / angleStep_));
+    key[4] = static_cast<std::int32_t>(std::lround(std::remainder(pose.pitch, 2.0 * pi) / angleStep_));
+    key[5] = static_cast<std::int32_t>(std::lround(std::remainder(pose.yaw, 2.0 * pi) / angleStep_));
+    std::uint64_t h = 0;
+    for (int i = 0; i < 6; ++i) {
+        h = splitmix(h ^ static_cast<std::uint32_t>(key[i]));
+    }
+    return static_cast<std::size_t>(h) & (slots_.size() - 1);
+}
+
+// Looks up the solution cached for the cell of a pose
+bool Kinematics::cacheFind(const Pose& pose, double* joints) {
+    std::int32_t key[6];
+    const std::size_t slot = cacheKey(pose, key);
+    std::lock_guard<std::mutex> lock(cacheLock_);
+    const Slot& entry = slots_[slot];
+    if (!entry.used || !std::equal(key, key + 6, entry.key)) {
+        return false;
+    }
+    const double* cached = cached_.data() + slot * chain_.size();
+    std::copy(cached, cached + chain_.size(), joints);
+    return true;
+}
+
+// Stores a solution, replacing whatever pose shared its slot
+void Kinematics::cacheInsert(const Pose& pose, const double* joints) {
+    std::int32_t key[6];
+    const std::size_t slot = cacheKey(pose, key);
+    std::lock_guard<std::mutex> lock(cacheLock_);
+    Slot& entry = slots_[slot];
+    std::copy(key, key + 6, entry.key);
+    entry.used = true;
+    std::copy(joints, joints + chain_.size(), cached_.data() + slot * chain_.size());
+}
+
+// Drops the cached solutions
+void Kinematics::clearCache() {
+    std::lock_guard<std::mutex> lock(cacheLock_);
+    for (Slot& slot : slots_) {
+        slot.used = false;
+    }
+}
+
+// Returns the counters
+IkStats Kinematics::stats() const {
+    return IkStats{solved_.load(), failed_.load(), cacheHits_.load(), analyticalCount_.load(), iterations_.load()};
+}
+
+// Resets the counters
+void Kinematics::resetStats() {
+    solved_ = 0;
+    failed_ = 0;
+    cacheHits_ = 0;
+    analyticalCount_ = 0;
+    iterations_ = 0;
+}
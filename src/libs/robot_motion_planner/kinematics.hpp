@@ -0,0 +1,121 @@
+#ifndef KINEMATICS_HPP
+#define KINEMATICS_HPP
+
+#include "robot.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Revolute joint in standard Denavit-Hartenberg convention, with its limits [rad]
+struct DhJoint {
+    double a;
+    double alpha;
+    double d;
+    double offset;
+    double lower;
+    double upper;
+};
+
+// Closed-form solver of a specific arm, writing up to maxSolutions rows of dof joint values
+// Returns the number of solutions written
+using AnalyticalIk = std::function<std::size_t(const Pose& target, double* solutions, std::size_t maxSolutions)>;
+
+// Inverse kinematics counters
+struct IkStats {
+    std::size_t solved;
+    std::size_t failed;
+    std::size_t cacheHits;
+    std::size_t analytical;     // Solutions found in closed form
+    std::size_t iterations;     // Damped least squares iterations over all solves
+};
+
+// Forward and inverse kinematics of a serial arm
+// Solves are thread safe: converged solutions are shared through a spatial hash of quantized poses,
+// so that later solves near a known pose start next to its solution
+class Kinematics {
+public:
+    // Constructor
+    explicit Kinematics(const std::vector<DhJoint>& chain, std::size_t cacheSize = 4096,
+                        double positionStep = 0.01, double angleStep = 0.0873);
+
+    std::size_t dof() const { return chain_.size(); }
+    const std::vector<DhJoint>& chain() const { return chain_; }
+
+    // Methods to configure the solver
+    void setAnalyticalSolver(AnalyticalIk solver);
+    void setTolerances(double position, double orientation);
+    void setDamping(double damping);
+    void setMaxIterations(int iterations);
+
+    // Tool pose at given joint positions
+    Pose forward(const double* joints) const;
+
+    // Solves joint positions reaching a pose, starting from seed when nothing closer is cached
+    // Closed-form solutions are tried first, the nearest one to the start within the limits being kept
+    bool solve(const Pose& target, const double* seed, double* solution);
+
+    // Solves many nearby targets, e.g. grasp candidates, each one warm started from the previous solution
+    // Writes count rows of dof joint values and one flag per target, returns the number solved
+    std::size_t solveBatch(const Pose* targets, std::size_t count, const double* seed, double* solutions,
+                           std::uint8_t* solved);
+
+    // Drops the cached solutions
+    void clearCache();
+
+    // Returns the counters
+    IkStats stats() const;
+
+    // Resets the counters
+    void resetStats();
+
+private:
+    // Frame of the tool as a rotation matrix, row major, and a position
+    struct Frame {
+        double r[9];
+        double p[3];
+    };
+
+    // Computes the tool frame, and the joint axes and origins if requested for the Jacobian
+    void forwardFrames(const double* joints, Frame& tool, double* axes, double* origins) const;
+
+    // Orientation and position errors between a frame and a target frame
+    static void frameError(const Frame& target, const Frame& current, double* error);
+
+    // Damped least squares refinement in place, returns true once within tolerance
+    bool refine(const Frame& target, double* joints);
+
+    // Cache slot of a quantized pose, the table being direct mapped
+    struct Slot {
+        std::int32_t key[6];
+        bool used;
+    };
+    std::size_t cacheKey(const Pose& pose, std::int32_t* key) const;
+    bool cacheFind(const Pose& pose, double* joints);
+    void cacheInsert(const Pose& pose, const double* joints);
+
+    std::vector<DhJoint> chain_;
+    AnalyticalIk analytical_;
+    double positionTolerance_;
+    double orientationTolerance_;
+    double damping_;
+    int maxIterations_;
+
+    // Spatial hash of solutions, dof values per slot
+    double positionStep_;
+    double angleStep_;
+    std::vector<Slot> slots_;
+    std::vector<double> cached_;
+    std::mutex cacheLock_;
+
+    std::atomic<std::size_t> solved_;
+    std::atomic<std::size_t> failed_;
+    std::atomic<std::size_t> cacheHits_;
+    std::atomic<std::size_t> analyticalCount_;
+    std::atomic<std::size_t> iterations_;
+};
+
+#endif // KINEMATICS_HPP
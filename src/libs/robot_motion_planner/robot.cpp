@@ -1,28 +1,112 @@
 #include "robot.hpp"
-#include <iostream>
+#include "kinematics.hpp"
+#include "logging/logging.hpp"
 
 // Constructor
-Robot::Robot() {
-    std::cout << "Robot initialized.\n";
+Robot::Robot() : stopCommands_(false) {
+    commandThread_ = std::thread(&Robot::commandRoutine, this);
+    LOG_INFO("Robot initialized.");
 }
 
 
 // Destructor
 Robot::~Robot() {
-    std::cout << "Robot destroyed.\n";
+    {
+        std::lock_guard<std::mutex> lock(batchesLock_);
+        stopCommands_ = true;
+    }
+    batchesCv_.notify_one();
+    commandThread_.join();
+    LOG_INFO("Robot destroyed.");
 }
 
 // Method to move the robot to a specified position
-bool Robot::moveToPosition(const Pose position) {
+bool Robot::moveToPosition(const Pose& position) {
     return true;
 }
 
+// Method to move the robot through a sequence of waypoints in a single command
+// The waypoints are copied once, so the caller does not need to keep them
+std::future<bool> Robot::moveThroughWaypoints(const Waypoint* waypoints, std::size_t count) {
+    Batch batch;
+    batch.waypoints.assign(waypoints, waypoints + count);
+    std::future<bool> done = batch.done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(batchesLock_);
+        batches_.push_back(std::move(batch));
+    }
+    batchesCv_.notify_one();
+    return done;
+}
+
+// Command thread routine, batches left at destruction are reported as failed
+void Robot::commandRoutine() {
+    std::unique_lock<std::mutex> lock(batchesLock_);
+    while (true) {
+        batchesCv_.wait(lock, [this] { return stopCommands_ || !batches_.empty(); });
+        if (stopCommands_) {
+            break;
+        }
+        Batch batch = std::move(batches_.front());
+        batches_.pop_front();
+        lock.unlock();
+        // Blending is up to the controller, waypoints are only forwarded in order
+        bool success = true;
+        for (const Waypoint& waypoint : batch.waypoints) {
+            if (!moveToPosition(waypoint.pose)) {
+                success = false;
+                break;
+            }
+        }
+        batch.done.set_value(success);
+        lock.lock();
+    }
+    for (Batch& batch : batches_) {
+        batch.done.set_value(false);
+    }
+    batches_.clear();
+}
+
+// Method to command a joint space setpoint
+bool Robot::moveToJointPositions(const double* positions, std::size_t dof) {
+    std::lock_guard<std::mutex> lock(jointsLock_);
+    jointPositions_.assign(positions, positions + dof);
+    return true;
+}
+
+// Method to return the last commanded joint setpoint
+std::vector<double> Robot::jointPositions() const {
+    std::lock_guard<std::mutex> lock(jointsLock_);
+    return jointPositions_;
+}
+
+// Methods to set and access the arm kinematics
+void Robot::setKinematics(const std::vector<DhJoint>& chain) {
+    kinematics_.reset(new Kinematics(chain));
+}
+
+Kinematics* Robot::kinematics() {
+    return kinematics_.get();
+}
+
+// Method to solve joint positions reaching a pose
+// Starting from the current setpoint keeps the arm in the same configuration branch
+bool Robot::solveIk(const Pose& target, std::vector<double>& joints) {
+    if (!kinematics_) {
+        return false;
+    }
+    std::vector<double> seed = jointPositions();
+    seed.resize(kinematics_->dof(), 0.0);
+    joints.resize(kinematics_->dof());
+    return kinematics_->solve(target, seed.data(), joints.data());
+}
+
 // Method to pick an object
-bool Robot::pickObject(const Pose position) {
+bool Robot::pickObject(const Pose& position) {
     return true;
 }
 
 // Method to place an object
-bool Robot::placeObject(const Pose position) {
+bool Robot::placeObject(const Pose& position) {
     return true;
 }
@@ -1,18 +1,27 @@
 #ifndef ROBOT_HPP
 #define ROBOT_HPP
 
+#include "geometry/geometry.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
-struct Pose {
-    double x;
-    double y;
-    double z;
-    double roll;
-    double pitch;
-    double yaw;
+// Waypoint of a batched motion, blended into the next one within a radius [m]
+struct Waypoint {
+    Pose pose;
+    double blendRadius;
 };
 
+class Kinematics;
+struct DhJoint;
+
 // Robot class
 class Robot {
 public:
@@ -23,18 +32,54 @@ public:
     ~Robot();
 
     // Method to move the robot to a specified position
-    bool moveToPosition(const Pose position);
+    bool moveToPosition(const Pose& position);
+
+    // Method to move the robot through a sequence of waypoints in a single command
+    // Batches are executed in order, the future is set once the last waypoint is reached
+    std::future<bool> moveThroughWaypoints(const Waypoint* waypoints, std::size_t count);
+
+    // Method to command a joint space setpoint, called at the controller rate
+    bool moveToJointPositions(const double* positions, std::size_t dof);
+
+    // Method to return the last commanded joint setpoint
+    std::vector<double> jointPositions() const;
+
+    // Methods to set and access the arm kinematics, nullptr until set
+    void setKinematics(const std::vector<DhJoint>& chain);
+    Kinematics* kinematics();
+
+    // Method to solve joint positions reaching a pose, warm started from the current setpoint
+    bool solveIk(const Pose& target, std::vector<double>& joints);
 
     // Method to pick an object
-    bool pickObject(const Pose position);
+    bool pickObject(const Pose& position);
 
     // Method to place an object
-    bool placeObject(const Pose position);
+    bool placeObject(const Pose& position);
 
 private:
     // Robot components
     std::string robotArm_;      // Type set as string for now
     std::string gripper_;
+
+    // Last commanded joint setpoint
+    std::vector<double> jointPositions_;
+    mutable std::mutex jointsLock_;
+
+    // Arm model, for inverse kinematics
+    std::unique_ptr<Kinematics> kinematics_;
+
+    // Batched motion commands, executed in order by the command thread
+    struct Batch {
+        std::vector<Waypoint> waypoints;
+        std::promise<bool> done;
+    };
+    void commandRoutine();
+    std::deque<Batch> batches_;
+    std::mutex batchesLock_;
+    std::condition_variable batchesCv_;
+    bool stopCommands_;
+    std::thread commandThread_;
 };
 
 
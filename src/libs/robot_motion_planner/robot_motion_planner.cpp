@@ -1,16 +1,176 @@
 #include "robot_motion_planner.hpp"
+#include "logging/logging.hpp"
+#include "profiler/profiler.hpp"
+#include <chrono>
+#include <pthread.h>
 
 // Constructor
-RobotMotionPlanner::RobotMotionPlanner(Robot& robot) : robot_(robot) { 
-    std::cout << "RobotMotionPlanner initialized with default parameters.\n";
+RobotMotionPlanner::RobotMotionPlanner(Robot& robot)
+    : robot_(robot), pending_(64), executed_(64), executing_(false), appended_(0), finished_(0), reclaimed_(0), sampleIndex_(0) {
+    LOG_INFO("RobotMotionPlanner initialized with default parameters.");
 }
 
 // Destructor
 RobotMotionPlanner::~RobotMotionPlanner() {
-    std::cout << "RobotMotionPlanner destroyed.\n";
+    stopExecution();
+    LOG_INFO("RobotMotionPlanner destroyed.");
 }
 
 // Method to execute a trajectory
+// Samples are spread evenly over the trajectory duration
 bool RobotMotionPlanner::executeTrajectory(const Trajectory& trajectory) {
+    PROFILE_SCOPE("robot.execute");
+    if (trajectory.dof == 0 || trajectory.positions.size() < trajectory.dof) {
+        return false;
+    }
+    const size_t samples = trajectory.positions.size() / trajectory.dof;
+    const double period = samples > 1 ? trajectory.duration / static_cast<double>(samples - 1) : 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < samples; ++k) {
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(static_cast<double>(k) * period));
+        if (!robot_.moveToJointPositions(&trajectory.positions[k * trajectory.dof], trajectory.dof)) {
+            return false;
+        }
+    }
     return true;
 }
+
+// Method to execute a trajectory view, sending each sample at its time
+bool RobotMotionPlanner::executeTrajectory(const TrajectoryView& trajectory) {
+    PROFILE_SCOPE("robot.execute");
+    if (trajectory.empty()) {
+        return false;
+    }
+    const size_t dof = trajectory.dof();
+    std::vector<double> setpoint(dof);
+    const double* times = trajectory.times();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < trajectory.samples(); ++k) {
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(times[k] - times[0]));
+        for (size_t j = 0; j < dof; ++j) {
+            setpoint[j] = trajectory.position(j, k);
+        }
+        if (!robot_.moveToJointPositions(setpoint.data(), dof)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Method to start streaming execution
+bool RobotMotionPlanner::startExecution(double rate, int priority) {
+    if (rate <= 0.0 || executing_.exchange(true)) {
+        return false;
+    }
+    executionThread_ = std::thread(&RobotMotionPlanner::executionRoutine, this, 1.0 / rate);
+    if (priority > 0) {
+        struct sched_param param;
+        param.sched_priority = priority;
+        if (pthread_setschedparam(executionThread_.native_handle(), SCHED_FIFO, &param) != 0) {
+            LOG_WARN("RobotMotionPlanner could not set SCHED_FIFO priority {}.", priority);
+        }
+    }
+    return true;
+}
+
+// Method to stop streaming execution, segments still queued are left there
+void RobotMotionPlanner::stopExecution() {
+    if (executing_.exchange(false)) {
+        executionThread_.join();
+    }
+}
+
+// Method to append a segment to the execution queue
+bool RobotMotionPlanner::appendSegment(const JointTrajectory* segment) {
+    if (segment == nullptr || segment->empty()) {
+        return false;
+    }
+    // Executed segments wait in a queue as large as the pending one until they are reclaimed,
+    // so bounding the unreclaimed ones guarantees that neither queue can overflow
+    std::size_t appended = appended_.load(std::memory_order_relaxed);
+    if (appended - reclaimed_ >= executed_.capacity() || !pending_.push(segment)) {
+        return false;
+    }
+    appended_.store(appended + 1, std::memory_order_release);
+    return true;
+}
+
+// Method to get back an executed segment, null if there is none
+const JointTrajectory* RobotMotionPlanner::reclaimSegment() {
+    const JointTrajectory* segment = nullptr;
+    if (executed_.pop(segment)) {
+        ++reclaimed_;
+    }
+    return segment;
+}
+
+// Method to check whether all queued segments were executed
+bool RobotMotionPlanner::idle() const {
+    return finished_.load(std::memory_order_acquire) == appended_.load(std::memory_order_acquire);
+}
+
+// Execution thread routine
+// Segments are interpolated at a fixed period; time past the end of a segment is
+// carried into the next one, so that back to back segments are executed seamlessly
+void RobotMotionPlanner::executionRoutine(double period) {
+    const JointTrajectory* segment = nullptr;
+    double t = 0.0;
+    auto wakeup = std::chrono::steady_clock::now();
+    const auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(period));
+    Profiler::setThreadName("robot_execution");
+    while (executing_) {
+        if (segment == nullptr && pending_.pop(segment)) {
+            sampleIndex_ = 0;
+            t = 0.0;
+        }
+        if (segment != nullptr) {
+            PROFILE_SCOPE("robot.setpoint");
+            const JointTrajectory* next = nullptr;
+            while (t > segment->duration() && pending_.pop(next)) {
+                t -= segment->duration();
+                executed_.push(segment);
+                finished_.fetch_add(1, std::memory_order_release);
+                segment = next;
+                sampleIndex_ = 0;
+            }
+            bool finished = t >= segment->duration();
+            interpolate(*segment, finished ? segment->duration() : t);
+            robot_.moveToJointPositions(setpoint_.data(), setpoint_.size());
+            if (finished) {
+                // The last setpoint is held until a new segment comes
+                executed_.push(segment);
+                finished_.fetch_add(1, std::memory_order_release);
+                segment = nullptr;
+            } else {
+                t += period;
+            }
+        }
+        wakeup += step;
+        std::this_thread::sleep_until(wakeup);
+    }
+}
+
+// Interpolates the setpoint of a segment at a given time
+// Time only moves forward within a segment, so the sample search resumes from the last one
+void RobotMotionPlanner::interpolate(const JointTrajectory& segment, double t) {
+    const size_t dof = segment.dof();
+    const size_t samples = segment.samples();
+    const double* times = segment.times();
+    setpoint_.resize(dof);
+    while (sampleIndex_ + 1 < samples && times[sampleIndex_ + 1] <= t) {
+        ++sampleIndex_;
+    }
+    size_t k = sampleIndex_;
+    if (k + 1 >= samples) {
+        for (size_t j = 0; j < dof; ++j) {
+            setpoint_[j] = segment.positions(j)[samples - 1];
+        }
+        return;
+    }
+    double span = times[k + 1] - times[k];
+    double alpha = span > 0.0 ? (t - times[k]) / span : 0.0;
+    for (size_t j = 0; j < dof; ++j) {
+        const double* positions = segment.positions(j);
+        setpoint_[j] = positions[k] + alpha * (positions[k + 1] - positions[k]);
+    }
+}
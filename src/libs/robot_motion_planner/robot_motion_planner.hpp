@@ -2,13 +2,20 @@
 #define ROBOT_MOTION_PLANNER_HPP
 
 #include "robot.hpp"
-#include <iostream>
+#include "joint_trajectory.hpp"
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
 
 
 // Define a structure to represent a trajectory
+// Samples are stored joint after joint for each time step, see JointTrajectory for a per-joint layout
 struct Trajectory {
     std::vector<double> positions;  // Joint positions
     std::vector<double> velocities; // Joint velocities
+    std::size_t dof;                // Number of joints of each sample
     double duration;                // Time duration for the trajectory
 };
 
@@ -23,10 +30,43 @@ public:
 
     // Method to execute a trajectory
     bool executeTrajectory(const Trajectory& trajectory);
+    bool executeTrajectory(const TrajectoryView& trajectory);
+
+    // Methods to start and stop streaming execution at the controller rate [Hz]
+    // A positive priority runs the execution thread under SCHED_FIFO
+    bool startExecution(double rate, int priority = 0);
+    void stopExecution();
+
+    // Method to append a segment to the execution queue, false if the queue is full
+    // Segments must start where the previous one ends, and stay alive until reclaimed;
+    // the queue counts segments until they are reclaimed, so it fills up when none are
+    bool appendSegment(const JointTrajectory* segment);
+
+    // Method to get back a segment that was fully executed, so that its storage can be reused
+    const JointTrajectory* reclaimSegment();
+
+    // Method to check whether all queued segments were executed
+    bool idle() const;
 
 private:
     Robot& robot_;
 
+    // Execution thread routine
+    void executionRoutine(double period);
+
+    // Interpolates the setpoint of a segment at a given time
+    void interpolate(const JointTrajectory& segment, double t);
+
+    // Streaming execution state
+    SpscQueue<const JointTrajectory*> pending_;
+    SpscQueue<const JointTrajectory*> executed_;
+    std::thread executionThread_;
+    std::atomic<bool> executing_;
+    std::atomic<std::size_t> appended_;     // Written by the caller only
+    std::atomic<std::size_t> finished_;     // Written by the execution thread only
+    std::size_t reclaimed_;                 // Accessed by the caller only
+    std::vector<double> setpoint_;
+    std::size_t sampleIndex_;
 };
 
 #endif // ROBOT_MOTION_PLANNER_HPP
@@ -2,11 +2,69 @@
 #define SENSOR_MANAGER_HPP
 
 #include "perception_system/perception_system.hpp"
-#include <vector>
+#include "sensor_manager/sensor_ring.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <typeindex>
+#include <vector>
 
 struct Sensor {
     std::string name;
+    std::type_index type;
+    std::size_t capacity;
+};
+
+// Index of a sensor in the manager
+using SensorId = std::size_t;
+
+// Index of a synchronization group in the manager
+using SyncGroupId = std::size_t;
+
+// Sample of one sensor in a synchronized frame, read in place in its ring
+struct SyncedSample {
+    const SensorRingBase* ring;
+    std::type_index type;
+    std::uint64_t index;
+    SensorClock::time_point stamp;
+    const void* sample;
+};
+
+// Samples of a synchronization group closest to the same instant, in the order of the group sensors
+// Like a SampleWindow, the samples may be overwritten: check valid() after using them
+struct SyncedFrame {
+    std::vector<SyncedSample> samples;
+    SensorClock::time_point stamp;      // Stamp of the pivot sensor sample
+    SensorClock::duration skew;         // Spread between the oldest and newest sample
+
+    // Sample of the i-th sensor of the group, throws if T is not its sample type
+    template <typename T>
+    const Stamped<T>& get(std::size_t i) const {
+        if (i >= samples.size() || samples[i].type != std::type_index(typeid(T))) {
+            throw std::invalid_argument("SyncedFrame: no sample " + std::to_string(i) + " of the requested type");
+        }
+        return *static_cast<const Stamped<T>*>(samples[i].sample);
+    }
+
+    // Returns false if a producer overwrote some of the samples since the frame was assembled
+    bool valid() const {
+        for (const SyncedSample& sample : samples) {
+            if (!sample.ring->intact(sample.index)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Synchronization counters, in pivot sensor samples
+struct SyncStats {
+    std::uint64_t assembled;    // Samples that made a frame
+    std::uint64_t unsynced;     // Samples without a match within the slop on every other sensor
+    std::uint64_t dropped;      // Samples skipped for a newer frame or overwritten before being examined
 };
 
 // SensorManager class definition 
@@ -18,12 +76,77 @@ public:
     // Destructor
     ~SensorManager();
 
-    // Method to retrieve data from all sensors
-    std::vector<std::string> getSensorData() const;
+    // Adds a sensor producing samples of type T, before producers and consumers start
+    template <typename T>
+    SensorId addSensor(const std::string& name, std::size_t capacity) {
+        sensors_.push_back(Sensor{name, std::type_index(typeid(T)), capacity});
+        rings_.emplace_back(new SensorRing<T>(capacity));
+        return sensors_.size() - 1;
+    }
 
+    // Finds a sensor by name, throws if unknown
+    SensorId find(const std::string& name) const;
+
+    // Returns the registered sensors
+    const std::vector<Sensor>& sensors() const;
+
+    // Ring of a sensor, throws if T is not the sensor sample type
+    template <typename T>
+    SensorRing<T>& ring(SensorId id) const {
+        if (id >= sensors_.size() || sensors_[id].type != std::type_index(typeid(T))) {
+            throw std::invalid_argument("SensorManager: no sensor " + std::to_string(id) + " of the requested type");
+        }
+        return static_cast<SensorRing<T>&>(*rings_[id]);
+    }
+
+    // Adds a sample, from the single producer of that sensor
+    template <typename T>
+    void publish(SensorId id, const T& value, SensorClock::time_point stamp = SensorClock::now()) {
+        ring<T>(id).push(value, stamp);
+    }
+
+    // Latest sample of a sensor, read in place
+    template <typename T>
+    SampleWindow<T> latest(SensorId id) const {
+        return ring<T>(id).latest();
+    }
+
+    // Samples of a sensor stamped within [t0, t1], read in place
+    template <typename T>
+    SampleWindow<T> window(SensorId id, SensorClock::time_point t0, SensorClock::time_point t1) const {
+        return ring<T>(id).window(t0, t1);
+    }
+
+    // Adds an approximate time synchronization group, the first sensor being the pivot
+    // Other sensors are matched to pivot samples within the slop
+    SyncGroupId addSyncGroup(const std::vector<SensorId>& sensors, SensorClock::duration slop);
+
+    // Assembles the newest synchronized frame of a group, from a single consumer per group
+    // Returns false if no new pivot sample could be matched yet
+    bool assemble(SyncGroupId group, SyncedFrame& frame);
+
+    // Returns the synchronization counters of a group
+    SyncStats syncStats(SyncGroupId group) const;
+
+    // Frame source for the perception pipeline out of a group with Image and SceneData sensors
+    // Frames hold views only, the pixels are never copied
+    FrameSource perceptionSource(SyncGroupId group, std::size_t imageSensor, std::size_t sceneSensor);
 
 private:
+
+    struct SyncGroup {
+        std::vector<SensorId> sensors;
+        SensorClock::duration slop;
+        std::uint64_t nextPivot;
+        SyncStats stats;
+    };
+
+    // Closest sample of a ring to a stamp, false if the ring is empty
+    bool closestSample(const SensorRingBase& ring, SensorClock::time_point stamp, std::uint64_t& index) const;
+
     std::vector<Sensor> sensors_;
+    std::vector<std::unique_ptr<SensorRingBase>> rings_;
+    std::vector<SyncGroup> syncGroups_;
     PerceptionSystem& perceptionSystem_;
 };
 
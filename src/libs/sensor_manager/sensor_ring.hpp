@@ -0,0 +1,211 @@
+#ifndef SENSOR_RING_HPP
+#define SENSOR_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+using SensorClock = std::chrono::steady_clock;
+
+// Sensor value with its acquisition time
+template <typename T>
+struct Stamped {
+    SensorClock::time_point stamp;
+    T value;
+};
+
+// Contiguous run of samples, the ring equivalent of a span
+template <typename T>
+struct SampleSpan {
+    const Stamped<T>* data;
+    std::size_t size;
+
+    const Stamped<T>* begin() const { return data; }
+    const Stamped<T>* end() const { return data + size; }
+};
+
+template <typename T>
+class SensorRing;
+
+// Samples of a time window, read in place in the ring
+// The ring wraps, so a window is made of up to two spans, oldest first
+// The producer may overwrite the oldest samples while they are read: check valid() after using them
+template <typename T>
+class SampleWindow {
+public:
+    SampleWindow() : first{nullptr, 0}, second{nullptr, 0}, ring_(nullptr), oldest_(0) {}
+
+    SampleSpan<T> first;
+    SampleSpan<T> second;
+
+    // Number of samples
+    std::size_t size() const { return first.size + second.size; }
+    bool empty() const { return size() == 0; }
+
+    // Sample by position, oldest first
+    const Stamped<T>& operator[](std::size_t i) const {
+        return i < first.size ? first.data[i] : second.data[i - first.size];
+    }
+
+    // Returns false if the producer overwrote some of the samples since the window was taken
+    bool valid() const;
+
+private:
+    friend class SensorRing<T>;
+    const SensorRing<T>* ring_;
+    std::uint64_t oldest_;
+};
+
+// Type erased base, so that rings of different sample types can be owned and synchronized together
+class SensorRingBase {
+public:
+    virtual ~SensorRingBase() = default;
+
+    // Total number of samples pushed
+    virtual std::uint64_t count() const = 0;
+
+    // Number of slots
+    virtual std::size_t capacity() const = 0;
+
+    // Stamp and sample of a sample index still in the ring
+    virtual SensorClock::time_point stampAt(std::uint64_t index) const = 0;
+    virtual const void* sampleAt(std::uint64_t index) const = 0;
+
+    // First sample index in [lo, hi) stamped at or after t
+    virtual std::uint64_t lowerBound(std::uint64_t lo, std::uint64_t hi, SensorClock::time_point t) const = 0;
+
+    // A sample is intact if its slot still holds it and the producer is not writing the slot
+    // Call it after reading the sample, whose reads it orders before its own
+    virtual bool intact(std::uint64_t index) const = 0;
+};
+
+// Single producer, multiple consumer ring of timestamped samples, overwriting the oldest ones
+// Consumers never block the producer nor each other: they read samples in place and validate afterwards
+// Each slot is guarded by a sequence number, odd while it is being written, that counts its writes
+template <typename T>
+class SensorRing : public SensorRingBase {
+    static_assert(std::is_trivially_copyable<T>::value, "sensor samples are read while they may be overwritten");
+
+public:
+    // Constructor, the capacity being rounded up to a power of two
+    explicit SensorRing(std::size_t capacity) : head_(0) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        sequences_.reset(new std::atomic<std::uint64_t>[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            sequences_[i].store(0, std::memory_order_relaxed);
+        }
+        mask_ = size - 1;
+    }
+
+    // Adds a sample, from the producer thread only
+    // The release fence keeps the sample writes after the odd sequence, for the readers checking it afterwards
+    void push(const T& value, SensorClock::time_point stamp = SensorClock::now()) {
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        std::atomic<std::uint64_t>& sequence = sequences_[head & mask_];
+        std::uint64_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slots_[head & mask_] = Stamped<T>{stamp, value};
+        sequence.store(seq + 2, std::memory_order_release);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Latest sample, empty if none was pushed yet
+    SampleWindow<T> latest() const {
+        std::uint64_t head = head_.load(std::memory_order_acquire);
+        if (head == 0) {
+            return SampleWindow<T>();
+        }
+        return makeWindow(head - 1, head);
+    }
+
+    // Samples stamped within [t0, t1]
+    // Stamps are monotonic, so the bounds are found by binary search over the readable samples
+    SampleWindow<T> window(SensorClock::time_point t0, SensorClock::time_point t1) const {
+        std::uint64_t head = head_.load(std::memory_order_acquire);
+        // Keep one slot of margin for the sample the producer may be writing
+        std::uint64_t tail = head > mask_ ? head - mask_ : 0;
+        std::uint64_t lo = lowerBound(tail, head, t0);
+        std::uint64_t hi = lowerBound(lo, head, t1 + SensorClock::duration(1));
+        return makeWindow(lo, hi);
+    }
+
+    // Total number of samples pushed
+    std::uint64_t count() const override {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const override {
+        return slots_.size();
+    }
+
+    SensorClock::time_point stampAt(std::uint64_t index) const override {
+        return slots_[index & mask_].stamp;
+    }
+
+    const void* sampleAt(std::uint64_t index) const override {
+        return &slots_[index & mask_];
+    }
+
+    // First sample index in [lo, hi) stamped at or after t
+    std::uint64_t lowerBound(std::uint64_t lo, std::uint64_t hi, SensorClock::time_point t) const override {
+        while (lo < hi) {
+            std::uint64_t mid = lo + (hi - lo) / 2;
+            if (slots_[mid & mask_].stamp < t) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+private:
+    friend class SampleWindow<T>;
+
+    // Builds the spans covering sample indices [lo, hi)
+    SampleWindow<T> makeWindow(std::uint64_t lo, std::uint64_t hi) const {
+        SampleWindow<T> window;
+        window.ring_ = this;
+        window.oldest_ = lo;
+        if (lo >= hi) {
+            return window;
+        }
+        std::size_t begin = lo & mask_;
+        std::size_t count = static_cast<std::size_t>(hi - lo);
+        std::size_t firstCount = std::min(count, slots_.size() - begin);
+        window.first = SampleSpan<T>{slots_.data() + begin, firstCount};
+        window.second = SampleSpan<T>{slots_.data(), count - firstCount};
+        return window;
+    }
+
+    // A sample is intact if its slot was written exactly once more than index / capacity times
+    // The acquire fence orders the sample reads before the sequence check: a reader that saw any
+    // write of a newer sample into the slot also sees its odd sequence
+    bool intact(std::uint64_t index) const override {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequences_[index & mask_].load(std::memory_order_relaxed) == 2 * (index / slots_.size() + 1);
+    }
+
+    std::vector<Stamped<T>> slots_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> sequences_;
+    std::size_t mask_;
+    std::atomic<std::uint64_t> head_;
+};
+
+// Slots are written in sample order, so a newer sample of the window is only overwritten after the oldest one
+template <typename T>
+bool SampleWindow<T>::valid() const {
+    return empty() || ring_->intact(oldest_);
+}
+
+#endif // SENSOR_RING_HPP
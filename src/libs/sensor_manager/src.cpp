@@ -1,4 +1,5 @@
 #include "sensor_manager.hpp"
+#include <algorithm>
 #include <iostream>
 
 // Constructor
@@ -9,7 +10,132 @@ SensorManager::SensorManager(PerceptionSystem& perceptionSystem) : perceptionSys
 // Destructor
 SensorManager::~SensorManager() {}
 
-std::vector<std::string> SensorManager::getSensorData() const {
-    std::vector<std::string> data;
-    return data;
+// Finds a sensor by name
+SensorId SensorManager::find(const std::string& name) const {
+    for (SensorId id = 0; id < sensors_.size(); ++id) {
+        if (sensors_[id].name == name) {
+            return id;
+        }
+    }
+    throw std::invalid_argument("SensorManager: unknown sensor " + name);
+}
+
+// Returns the registered sensors
+const std::vector<Sensor>& SensorManager::sensors() const {
+    return sensors_;
+}
+
+// Adds an approximate time synchronization group
+SyncGroupId SensorManager::addSyncGroup(const std::vector<SensorId>& sensors, SensorClock::duration slop) {
+    if (sensors.empty()) {
+        throw std::invalid_argument("SensorManager: empty synchronization group");
+    }
+    for (SensorId id : sensors) {
+        if (id >= sensors_.size()) {
+            throw std::invalid_argument("SensorManager: unknown sensor " + std::to_string(id));
+        }
+    }
+    syncGroups_.push_back(SyncGroup{sensors, slop, 0, SyncStats{0, 0, 0}});
+    return syncGroups_.size() - 1;
+}
+
+// Closest sample of a ring to a stamp
+bool SensorManager::closestSample(const SensorRingBase& ring, SensorClock::time_point stamp, std::uint64_t& index) const {
+    std::uint64_t head = ring.count();
+    if (head == 0) {
+        return false;
+    }
+    std::uint64_t tail = head >= ring.capacity() ? head - ring.capacity() + 1 : 0;
+    std::uint64_t after = ring.lowerBound(tail, head, stamp);
+    if (after == head) {
+        index = head - 1;
+    } else if (after == tail) {
+        index = tail;
+    } else {
+        index = stamp - ring.stampAt(after - 1) <= ring.stampAt(after) - stamp ? after - 1 : after;
+    }
+    return true;
+}
+
+// Assembles the newest synchronized frame of a group
+// Pivot samples are tried from the newest one; older unexamined ones are dropped once a frame is made,
+// and the ones that can no longer be matched because every other sensor moved past them are unsynced
+bool SensorManager::assemble(SyncGroupId group, SyncedFrame& frame) {
+    SyncGroup& sync = syncGroups_.at(group);
+    const SensorRingBase& pivot = *rings_[sync.sensors[0]];
+    std::uint64_t head = pivot.count();
+    std::uint64_t tail = head >= pivot.capacity() ? head - pivot.capacity() + 1 : 0;
+    if (sync.nextPivot < tail) {
+        sync.stats.dropped += tail - sync.nextPivot;
+        sync.nextPivot = tail;
+    }
+
+    // Oldest of the latest stamps of the other sensors, pivot samples older than it minus the slop cannot match anymore
+    SensorClock::time_point horizon = SensorClock::time_point::max();
+    for (std::size_t i = 1; i < sync.sensors.size(); ++i) {
+        const SensorRingBase& ring = *rings_[sync.sensors[i]];
+        std::uint64_t count = ring.count();
+        horizon = std::min(horizon, count > 0 ? ring.stampAt(count - 1) : SensorClock::time_point::min());
+    }
+
+    frame.samples.resize(sync.sensors.size(), SyncedSample{nullptr, std::type_index(typeid(void)), 0, {}, nullptr});
+    for (std::uint64_t p = head; p-- > sync.nextPivot;) {
+        SensorClock::time_point stamp = pivot.stampAt(p);
+        SensorClock::time_point oldest = stamp;
+        SensorClock::time_point newest = stamp;
+        bool matched = true;
+        frame.samples[0] = SyncedSample{&pivot, sensors_[sync.sensors[0]].type, p, stamp, pivot.sampleAt(p)};
+        for (std::size_t i = 1; i < sync.sensors.size() && matched; ++i) {
+            const SensorRingBase& ring = *rings_[sync.sensors[i]];
+            std::uint64_t index;
+            if (!closestSample(ring, stamp, index)) {
+                matched = false;
+                break;
+            }
+            SensorClock::time_point sampleStamp = ring.stampAt(index);
+            SensorClock::duration distance = sampleStamp > stamp ? sampleStamp - stamp : stamp - sampleStamp;
+            matched = distance <= sync.slop;
+            frame.samples[i] = SyncedSample{&ring, sensors_[sync.sensors[i]].type, index, sampleStamp, ring.sampleAt(index)};
+            oldest = std::min(oldest, sampleStamp);
+            newest = std::max(newest, sampleStamp);
+        }
+        if (matched) {
+            sync.stats.assembled++;
+            sync.stats.dropped += p - sync.nextPivot;
+            sync.nextPivot = p + 1;
+            frame.stamp = stamp;
+            frame.skew = newest - oldest;
+            return true;
+        }
+    }
+
+    while (sync.nextPivot < head && horizon != SensorClock::time_point::min() &&
+           pivot.stampAt(sync.nextPivot) + sync.slop < horizon) {
+        sync.stats.unsynced++;
+        sync.nextPivot++;
+    }
+    return false;
+}
+
+// Returns the synchronization counters of a group
+SyncStats SensorManager::syncStats(SyncGroupId group) const {
+    return syncGroups_.at(group).stats;
+}
+
+// Frame source for the perception pipeline out of a group with Image and SceneData sensors
+FrameSource SensorManager::perceptionSource(SyncGroupId group, std::size_t imageSensor, std::size_t sceneSensor) {
+    return [this, group, imageSensor, sceneSensor, frame = SyncedFrame()](std::vector<Image>& frames, std::vector<SceneData>& scenes) mutable {
+        if (!assemble(group, frame)) {
+            return false;
+        }
+        // Copy first, then check that the samples were not overwritten meanwhile
+        frames.assign(1, frame.get<Image>(imageSensor).value);
+        scenes.assign(1, frame.get<SceneData>(sceneSensor).value);
+        if (!frame.valid()) {
+            frames.clear();
+            scenes.clear();
+            return false;
+        }
+        return true;
+    };
 }
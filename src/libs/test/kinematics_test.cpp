@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include "robot_motion_planner/kinematics.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// UR5-like arm, the joints limited to a full turn each way
+std::vector<DhJoint> sixAxisArm() {
+    const double a[6] = {0.0, -0.425, -0.39225, 0.0, 0.0, 0.0};
+    const double alpha[6] = {M_PI / 2.0, 0.0, 0.0, M_PI / 2.0, -M_PI / 2.0, 0.0};
+    const double d[6] = {0.089159, 0.0, 0.0, 0.10915, 0.09465, 0.0823};
+    std::vector<DhJoint> chain;
+    for (int i = 0; i < 6; ++i) {
+        chain.push_back(DhJoint{a[i], alpha[i], d[i], 0.0, -2.0 * M_PI, 2.0 * M_PI});
+    }
+    return chain;
+}
+
+void expectSamePose(const Pose& actual, const Pose& expected) {
+    EXPECT_NEAR(actual.x, expected.x, 1e-3);
+    EXPECT_NEAR(actual.y, expected.y, 1e-3);
+    EXPECT_NEAR(actual.z, expected.z, 1e-3);
+    // Compare the angles modulo a turn
+    EXPECT_NEAR(std::remainder(actual.roll - expected.roll, 2.0 * M_PI), 0.0, 1e-2);
+    EXPECT_NEAR(std::remainder(actual.pitch - expected.pitch, 2.0 * M_PI), 0.0, 1e-2);
+    EXPECT_NEAR(std::remainder(actual.yaw - expected.yaw, 2.0 * M_PI), 0.0, 1e-2);
+}
+
+}
+
+TEST(kinematics_test, ik_round_trip_reaches_forward_pose) {
+    Kinematics kinematics(sixAxisArm());
+    const double joints[6] = {0.3, -1.2, 1.4, -0.6, 1.1, 0.4};
+    const Pose target = kinematics.forward(joints);
+
+    // Seeded near, but not at, the configuration the target came from
+    double seed[6];
+    for (int j = 0; j < 6; ++j) {
+        seed[j] = joints[j] + 0.1;
+    }
+    double solution[6];
+    ASSERT_TRUE(kinematics.solve(target, seed, solution));
+    expectSamePose(kinematics.forward(solution), target);
+    for (int j = 0; j < 6; ++j) {
+        EXPECT_GE(solution[j], kinematics.chain()[j].lower);
+        EXPECT_LE(solution[j], kinematics.chain()[j].upper);
+    }
+    EXPECT_EQ(kinematics.stats().solved, 1u);
+}
+
+TEST(kinematics_test, ik_reuses_cached_solution_for_same_pose) {
+    Kinematics kinematics(sixAxisArm());
+    const double joints[6] = {-0.5, -1.0, 1.2, -0.4, 0.9, -0.2};
+    const Pose target = kinematics.forward(joints);
+
+    double seed[6] = {-0.4, -0.9, 1.3, -0.3, 1.0, -0.1};
+    double solution[6];
+    ASSERT_TRUE(kinematics.solve(target, seed, solution));
+    ASSERT_TRUE(kinematics.solve(target, seed, solution));
+    expectSamePose(kinematics.forward(solution), target);
+    EXPECT_EQ(kinematics.stats().cacheHits, 1u);
+}
+
+TEST(kinematics_test, ik_fails_on_unreachable_pose) {
+    Kinematics kinematics(sixAxisArm());
+    const double seed[6] = {0.0, -1.0, 1.0, 0.0, 1.0, 0.0};
+    double solution[6];
+    EXPECT_FALSE(kinematics.solve(Pose{5.0, 0.0, 0.0, 0.0, 0.0, 0.0}, seed, solution));
+    EXPECT_EQ(kinematics.stats().failed, 1u);
+}
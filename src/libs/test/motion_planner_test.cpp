@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include "motion_planner/motion_planner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Point robot moving in the XY plane, a single sphere at the joint values
+void pointRobot(const double* joints, std::size_t dof, SphereSet& spheres) {
+    spheres.resize(1);
+    spheres.x[0] = static_cast<float>(joints[0]);
+    spheres.y[0] = static_cast<float>(dof > 1 ? joints[1] : 0.0);
+    spheres.z[0] = 0.0f;
+    spheres.radius[0] = 0.05f;
+}
+
+class MotionPlannerTest : public ::testing::Test {
+protected:
+    MotionPlannerTest() : robotMotionPlanner(robot), planner(robotMotionPlanner) {}
+
+    // 2 m wide world with a wall across the straight motion between the start and goal below
+    void buildWorld(double wallLower, double wallUpper) {
+        const double origin[3] = {-1.0, -1.0, -0.5};
+        const double size[3] = {2.0, 2.0, 1.0};
+        world.reset(new CollisionWorld(origin, size, 0.05));
+        const double min[3] = {-0.1, wallLower, -0.5};
+        const double max[3] = {0.1, wallUpper, 0.5};
+        world->addBox(min, max);
+        world->update();
+        planner.setCollisionWorld(world.get(), pointRobot);
+        planner.setJointBounds({-0.95, -0.95}, {0.95, 0.95});
+    }
+
+    Robot robot;
+    RobotMotionPlanner robotMotionPlanner;
+    MotionPlanner planner;
+    std::unique_ptr<CollisionWorld> world;
+    const std::vector<double> start{-0.6, 0.0};
+    const std::vector<double> goal{0.6, 0.0};
+};
+
+}
+
+TEST_F(MotionPlannerTest, trapezoid_respects_limits_and_ends_at_rest_on_goal) {
+    planner.setLimits(1.0, 2.0);
+    planner.setSamplePeriod(0.001);
+    const std::vector<double> from{0.0, 1.0, -0.5};
+    const std::vector<double> to{2.0, 1.0, 0.5};
+
+    JointTrajectory trajectory;
+    ASSERT_TRUE(planner.computeTrajectory(from, to, trajectory));
+    ASSERT_EQ(trajectory.dof(), 3u);
+
+    // The slowest joint travels 2 rad, cruising at 1 rad/s after 0.5 s of acceleration
+    EXPECT_NEAR(trajectory.duration(), 2.5, 1e-9);
+    const std::size_t last = trajectory.samples() - 1;
+    for (std::size_t j = 0; j < 3; ++j) {
+        const double* positions = trajectory.positions(j);
+        const double* velocities = trajectory.velocities(j);
+        EXPECT_DOUBLE_EQ(positions[0], from[j]);
+        EXPECT_DOUBLE_EQ(velocities[0], 0.0);
+        EXPECT_DOUBLE_EQ(positions[last], to[j]);
+        EXPECT_DOUBLE_EQ(velocities[last], 0.0);
+        for (std::size_t k = 0; k < trajectory.samples(); ++k) {
+            EXPECT_LE(std::abs(velocities[k]), 1.0 + 1e-9);
+        }
+        for (std::size_t k = 1; k < trajectory.samples(); ++k) {
+            const double dt = trajectory.times()[k] - trajectory.times()[k - 1];
+            if (dt > 0.0) {
+                EXPECT_LE(std::abs(velocities[k] - velocities[k - 1]) / dt, 2.0 + 1e-6);
+            }
+        }
+    }
+
+    // The joint that does not move stays still
+    EXPECT_TRUE(std::all_of(trajectory.velocities(1), trajectory.velocities(1) + trajectory.samples(),
+                            [](double v) { return v == 0.0; }));
+}
+
+TEST_F(MotionPlannerTest, trapezoid_rejects_mismatched_joints) {
+    JointTrajectory trajectory;
+    EXPECT_FALSE(planner.computeTrajectory(std::vector<double>{0.0, 1.0}, std::vector<double>{0.0}, trajectory));
+    EXPECT_TRUE(trajectory.empty());
+}
+
+TEST_F(MotionPlannerTest, rrt_connect_reaches_goal_around_wall) {
+    buildWorld(-0.5, 0.5);
+    JointTrajectory trajectory;
+    ASSERT_TRUE(planner.planPath("rrt_connect", start, goal, 2, std::chrono::seconds(5), PathSelection::First,
+                                 trajectory));
+    const std::size_t last = trajectory.samples() - 1;
+    EXPECT_DOUBLE_EQ(trajectory.positions(0)[0], start[0]);
+    EXPECT_DOUBLE_EQ(trajectory.positions(1)[0], start[1]);
+    EXPECT_DOUBLE_EQ(trajectory.positions(0)[last], goal[0]);
+    EXPECT_DOUBLE_EQ(trajectory.positions(1)[last], goal[1]);
+    EXPECT_TRUE(planner.validateTrajectory(trajectory));
+}
+
+TEST_F(MotionPlannerTest, chomp_pushes_path_off_obstacle) {
+    buildWorld(-0.3, 0.05);
+    JointTrajectory trajectory;
+    ASSERT_TRUE(planner.planPath("chomp", start, goal, 4, std::chrono::seconds(5), PathSelection::First, trajectory));
+    const std::size_t last = trajectory.samples() - 1;
+    EXPECT_DOUBLE_EQ(trajectory.positions(0)[last], goal[0]);
+    EXPECT_DOUBLE_EQ(trajectory.positions(1)[last], goal[1]);
+    EXPECT_TRUE(planner.validateTrajectory(trajectory));
+}
+
+TEST_F(MotionPlannerTest, plan_path_fails_when_goal_is_inside_obstacle) {
+    buildWorld(-0.5, 0.5);
+    JointTrajectory trajectory;
+    EXPECT_FALSE(planner.planPath("rrt_connect", start, {0.0, 0.0}, 1, std::chrono::milliseconds(100),
+                                  PathSelection::First, trajectory));
+    EXPECT_TRUE(trajectory.empty());
+}
+
+TEST_F(MotionPlannerTest, collision_world_rejects_margin_beyond_truncation) {
+    const double origin[3] = {-1.0, -1.0, -1.0};
+    const double size[3] = {2.0, 2.0, 2.0};
+    CollisionWorld shallow(origin, size, 0.05, 0.1);
+    EXPECT_THROW(planner.setCollisionWorld(&shallow, pointRobot, 0.1), std::invalid_argument);
+}
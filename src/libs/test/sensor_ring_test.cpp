@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "sensor_manager/sensor_ring.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace {
+
+// Stamp of the i-th sample, 10 ms apart
+SensorClock::time_point stampOf(int i) {
+    return SensorClock::time_point() + std::chrono::milliseconds(10 * i);
+}
+
+}
+
+TEST(sensor_ring_test, capacity_rounds_up_to_power_of_two) {
+    SensorRing<int> ring(5);
+    EXPECT_EQ(ring.capacity(), 8u);
+    EXPECT_TRUE(ring.latest().empty());
+}
+
+TEST(sensor_ring_test, overwrites_oldest_samples) {
+    SensorRing<int> ring(4);
+    for (int i = 0; i < 10; ++i) {
+        ring.push(i, stampOf(i));
+    }
+    EXPECT_EQ(ring.count(), 10u);
+    ASSERT_EQ(ring.latest().size(), 1u);
+    EXPECT_EQ(ring.latest()[0].value, 9);
+
+    // One slot is kept as margin for the sample being written, so 3 of the last 4 are readable
+    SampleWindow<int> all = ring.window(stampOf(0), stampOf(9));
+    ASSERT_EQ(all.size(), 3u);
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        EXPECT_EQ(all[i].value, static_cast<int>(7 + i));
+    }
+    EXPECT_TRUE(all.valid());
+}
+
+TEST(sensor_ring_test, window_wraps_into_two_spans) {
+    SensorRing<int> ring(4);
+    for (int i = 0; i < 6; ++i) {
+        ring.push(i, stampOf(i));
+    }
+    SampleWindow<int> window = ring.window(stampOf(3), stampOf(5));
+    ASSERT_EQ(window.size(), 3u);
+    EXPECT_EQ(window.first.size, 1u);
+    EXPECT_EQ(window.second.size, 2u);
+    EXPECT_EQ(window[0].value, 3);
+    EXPECT_EQ(window[2].value, 5);
+    EXPECT_TRUE(ring.window(stampOf(7), stampOf(8)).empty());
+}
+
+TEST(sensor_ring_test, window_becomes_invalid_once_overwritten) {
+    SensorRing<int> ring(4);
+    for (int i = 0; i < 4; ++i) {
+        ring.push(i, stampOf(i));
+    }
+    SampleWindow<int> window = ring.window(stampOf(2), stampOf(3));
+    ASSERT_EQ(window.size(), 2u);
+    EXPECT_TRUE(window.valid());
+
+    // The oldest sample of the window stays valid until its slot is written again
+    ring.push(4, stampOf(4));
+    ring.push(5, stampOf(5));
+    EXPECT_TRUE(window.valid());
+    ring.push(6, stampOf(6));
+    EXPECT_FALSE(window.valid());
+
+    // Empty windows are always valid
+    EXPECT_TRUE(SampleWindow<int>().valid());
+}
+
+TEST(sensor_ring_test, validated_copies_are_never_torn) {
+    struct Pair {
+        std::uint64_t first;
+        std::uint64_t second;
+    };
+    SensorRing<Pair> ring(4);
+    std::atomic<bool> stop(false);
+    std::thread producer([&] {
+        for (std::uint64_t i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+            ring.push(Pair{i, i});
+        }
+    });
+
+    // Copy first, then validate, as SensorManager::perceptionSource does
+    std::size_t accepted = 0;
+    for (int i = 0; i < 200000; ++i) {
+        SampleWindow<Pair> window = ring.latest();
+        if (window.empty()) {
+            continue;
+        }
+        Pair copy = window[0].value;
+        if (window.valid()) {
+            EXPECT_EQ(copy.first, copy.second);
+            ++accepted;
+        }
+    }
+    stop.store(true, std::memory_order_relaxed);
+    producer.join();
+    EXPECT_GT(accepted, 0u);
+}
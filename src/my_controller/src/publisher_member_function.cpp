@@ -13,6 +13,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <rclcpp/logging.hpp>
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/string.hpp>
@@ -22,7 +26,13 @@
 using namespace std::chrono_literals;
 
 /* This example creates a subclass of Node and uses std::bind() to register a
- * member function as a callback from the timer. */
+ * member function as a callback from the timer.
+ *
+ * With async_model:=true the model is evaluated on a worker thread: each tick
+ * hands it the latest input and publishes the latest completed result, so the
+ * timer rate does not depend on the model latency. Inputs the worker could not
+ * keep up with are dropped, and each message reports how many ticks old its
+ * result is. */
 
 using STRING    = std_msgs::msg::String;
 using PUBLISHER = rclcpp::Publisher<STRING>::SharedPtr;
@@ -35,6 +45,8 @@ public:
     : Node("minimal_publisher"),
     count_(0)
   {
+    async_model_ = this->declare_parameter("async_model", false);
+
     // define topic name
     auto topicName = "topic";
 
@@ -46,6 +58,23 @@ public:
       this->create_wall_timer(
         500ms,
         std::bind(&MinimalPublisher::timer_callback, this));
+
+    if (async_model_) {
+      model_thread_ = std::thread(&MinimalPublisher::model_routine, this);
+      RCLCPP_INFO_STREAM (this->get_logger(), "Evaluating the model asynchronously");
+    }
+  }
+
+  ~MinimalPublisher()
+  {
+    if (model_thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(model_mutex_);
+        model_stop_ = true;
+      }
+      model_cv_.notify_one();
+      model_thread_.join();
+    }
   }
 
 private:
@@ -54,18 +83,82 @@ private:
   PUBLISHER publisher_;
   TIMER     timer_;
 
+  // Asynchronous model evaluation, all guarded by model_mutex_
+  bool                    async_model_;
+  std::thread             model_thread_;
+  std::mutex              model_mutex_;
+  std::condition_variable model_cv_;
+  bool                    model_stop_    = false;
+  bool                    input_pending_ = false;   // a new input is waiting for the worker
+  size_t                  input_tick_    = 0;       // tick of the latest input
+  bool                    output_ready_  = false;   // at least one result is available
+  int                     output_        = 0;       // latest completed result
+  size_t                  output_tick_   = 0;       // tick whose input produced it
+  size_t                  stale_ticks_   = 0;       // ticks published without a fresh result
+
   void timer_callback()
   {
     // Create the message to publish
     auto message = STRING();
 
     message.data = "Hello, world! " + std::to_string(count_++);
-    RCLCPP_INFO_STREAM (this->get_logger(),
-                        "Publishing: " << function2 (count_) << " " << message.data.c_str());
+    if (!async_model_) {
+      RCLCPP_INFO_STREAM (this->get_logger(),
+                          "Publishing: " << function2 (count_) << " " << message.data.c_str());
+    } else {
+      // Never wait for the model: post the new input, take the latest result
+      bool   ready;
+      int    output;
+      size_t output_tick;
+      {
+        std::lock_guard<std::mutex> lock(model_mutex_);
+        input_tick_    = count_;
+        input_pending_ = true;
+        ready          = output_ready_;
+        output         = output_;
+        output_tick    = output_tick_;
+        if (!ready || output_tick + 1 < count_) {
+          stale_ticks_++;
+        }
+      }
+      model_cv_.notify_one();
+
+      if (ready) {
+        RCLCPP_INFO_STREAM (this->get_logger(),
+                            "Publishing: " << output << " " << message.data.c_str()
+                            << " (model result " << count_ - output_tick << " ticks old, "
+                            << stale_ticks_ << " stale ticks so far)");
+      } else {
+        RCLCPP_INFO_STREAM (this->get_logger(),
+                            "Publishing: (model pending) " << message.data.c_str());
+      }
+    }
 
     // Publish the message
     publisher_->publish(message);
   }
+
+  void model_routine()
+  {
+    std::unique_lock<std::mutex> lock(model_mutex_);
+    while (true) {
+      model_cv_.wait(lock, [this] { return model_stop_ || input_pending_; });
+      if (model_stop_) {
+        return;
+      }
+      size_t tick    = input_tick_;
+      input_pending_ = false;
+
+      // The model may take as long as it needs without holding up the timer
+      lock.unlock();
+      int output = function2 (tick);
+      lock.lock();
+
+      output_       = output;
+      output_tick_  = tick;
+      output_ready_ = true;
+    }
+  }
 };
 
 int main(int argc, char *argv[])
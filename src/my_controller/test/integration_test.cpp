@@ -1,6 +1,7 @@
 #include <rclcpp/rclcpp.hpp>
 #include <std_msgs/msg/string.hpp>
 #include <catch_ros2/catch_ros2.hpp>
+#include <integration_test/perf_harness.hpp>
 
 using namespace std::chrono_literals;
 using std_msgs::msg::String;
@@ -42,6 +43,26 @@ protected:
   rclcpp::Node::SharedPtr testerNode;
 };
 
+/* Budgets of the talker, and where to append the results (see
+   integration_test/perf_harness.hpp). */
+class PerfTestsFixture : public MyTestsFixture {
+public:
+  PerfTestsFixture ()
+    : budget (testerNode->declare_parameter<std::string> ("perf_results_file", ""),
+              [] (const std::string& line) { RCLCPP_INFO_STREAM (Logger, line); })
+  {
+    PERF_DURATION        = testerNode->declare_parameter<double> ("perf_duration", 5.0);
+    MIN_PUBLISH_RATE     = testerNode->declare_parameter<double> ("min_publish_rate", 1.8);
+    MAX_MEMORY_GROWTH_KB = testerNode->declare_parameter<double> ("max_memory_growth_kb", 1024.0);
+  }
+
+protected:
+  perf_harness::BudgetChecker budget;
+  double PERF_DURATION;
+  double MIN_PUBLISH_RATE;
+  double MAX_MEMORY_GROWTH_KB;
+};
+
 
 ////////////////////////////////////////////////
 // Test Case 1
@@ -94,3 +115,40 @@ TEST_CASE_METHOD (MyTestsFixture, "test topic talker", "[topic]") {
   RCLCPP_INFO_STREAM (Logger, "duration = " << duration.seconds() << " got_topic=" << got_topic);
   CHECK (got_topic); // Test assertions - check that the topic was received
  }
+
+
+////////////////////////////////////////////////
+// Test Case 2
+////////////////////////////////////////////////
+
+/* In this test case, we listen to the talker for the whole measurement
+   window, sampling its resident memory meanwhile. The talker must keep
+   its 2 Hz rate whatever the model latency, and must not leak. */
+
+TEST_CASE_METHOD (PerfTestsFixture, "talker performance budget", "[topic][perf]") {
+
+  pid_t talker_pid = perf_harness::find_process ("talker");
+  REQUIRE (talker_pid > 0);
+  perf_harness::MemoryProbe memory (talker_pid);
+
+  perf_harness::RateMeter meter;
+  auto subscriber = testerNode->create_subscription<String>
+    ("topic", 10, [&meter] (const String &) { meter.tick(); });
+
+  rclcpp::Rate rate(100.0);      // 100hz spins, not to delay messages
+  auto start_time = rclcpp::Clock().now();
+  auto timeout    = rclcpp::Duration::from_seconds (PERF_DURATION);
+  int  spins      = 0;
+  while ((rclcpp::Clock().now() - start_time) < timeout)
+    {
+      rclcpp::spin_some (testerNode);
+      if (spins++ % 10 == 0)
+        REQUIRE (memory.sample());
+      rate.sleep();
+    }
+
+  RCLCPP_INFO_STREAM (Logger, "received " << meter.count() << " messages, rate=" << meter.rate() <<
+                      " memory growth=" << memory.growth_kb() << " kB");
+  CHECK (budget.check ({"talker_rate", "rate_hz", meter.rate(), MIN_PUBLISH_RATE, false}));
+  CHECK (budget.check ({"talker_memory", "growth_kb", double (memory.growth_kb()), MAX_MEMORY_GROWTH_KB, true}));
+}
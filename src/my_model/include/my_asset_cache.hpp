@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+/**
+ * @brief Process-wide cache of images loaded from disk.
+ *
+ * Each file is decoded once and the resulting cv::Mat is shared, read-only,
+ * by all callers. Entries are revalidated against the file size and
+ * modification time, at most once per revalidation period, and reloaded
+ * when the file changes.
+ *
+ * Optionally, decoded pixels are also stored next to the source file in a raw
+ * format (<path>.raw) that later runs memory-map instead of decoding, so that
+ * startup costs no decoding at all. Raw files remember which version of the
+ * source they were made from, and are rewritten when it changes.
+ */
+class AssetCache {
+public:
+
+  using AssetPtr = std::shared_ptr<const cv::Mat>;
+
+  struct Options {
+    bool                      use_raw            = false; ///< Memory-map raw copies of decoded images
+    std::chrono::milliseconds revalidate_period  = std::chrono::milliseconds(1000); ///< 0 to check on every call
+  };
+
+  /**
+   * @brief Returns the cache shared by the whole process.
+   */
+  static AssetCache& instance ();
+
+  AssetCache ();
+  explicit AssetCache (const Options& options);
+
+  AssetCache (const AssetCache&)            = delete;
+  AssetCache& operator= (const AssetCache&) = delete;
+
+  /**
+   * @brief Returns an image, loading it only if it is not cached or changed.
+   *
+   * @param path  Image file path.
+   * @param flags cv::imread flags.
+   * @return Shared image, empty if the file cannot be read.
+   */
+  AssetPtr get (const std::string& path, int flags = cv::IMREAD_GRAYSCALE);
+
+  /**
+   * @brief Drops all entries; images still in use stay valid.
+   */
+  void clear ();
+
+  void set_options (const Options& options);
+
+private:
+
+  /* Identifies a version of a file. */
+  struct FileStamp {
+    bool    exists   = false;
+    int64_t mtime_ns = 0;
+    int64_t size     = 0;
+
+    bool operator== (const FileStamp& other) const
+    {
+      return exists == other.exists && mtime_ns == other.mtime_ns && size == other.size;
+    }
+  };
+
+  struct Entry {
+    AssetPtr                              image;
+    FileStamp                             stamp;
+    std::chrono::steady_clock::time_point checked;
+  };
+
+  static FileStamp stat_file (const std::string& path);
+
+  AssetPtr load (const std::string& path, int flags, const FileStamp& stamp) const;
+  AssetPtr map_raw (const std::string& raw_path, int flags, const FileStamp& stamp) const;
+  void     write_raw (const std::string& raw_path, int flags, const FileStamp& stamp, const cv::Mat& image) const;
+
+  Options                                options_;
+  std::unordered_map<std::string, Entry> entries_; // keyed by flags and path
+  std::mutex                             mutex_;
+};
@@ -0,0 +1,194 @@
+#include "my_asset_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+// POSIX stuff
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/* Layout of the first bytes of a raw asset file; pixels follow, row after row. */
+struct RawHeader {
+  char     magic[8];
+  int32_t  rows;
+  int32_t  cols;
+  int32_t  type;
+  int32_t  flags;
+  int64_t  src_mtime_ns;
+  int64_t  src_size;
+  uint64_t data_size;
+  char     reserved[16];
+};
+static_assert (sizeof (RawHeader) == 64, "raw asset header must keep pixels aligned");
+
+const char RAW_MAGIC[8] = {'M', 'Y', 'A', 'S', 'S', 'E', 'T', '1'};
+
+/* Keeps a mapped raw file alive as long as the image that points into it. */
+struct MappedAsset {
+  cv::Mat image;
+  void*   addr   = MAP_FAILED;
+  size_t  length = 0;
+
+  ~MappedAsset ()
+  {
+    if (addr != MAP_FAILED) {
+      munmap (addr, length);
+    }
+  }
+};
+
+}  // namespace
+
+
+AssetCache& AssetCache::instance ()
+{
+  static AssetCache cache;
+  return cache;
+}
+
+AssetCache::AssetCache ()
+{
+}
+
+AssetCache::AssetCache (const Options& options)
+  : options_(options)
+{
+}
+
+AssetCache::AssetPtr AssetCache::get (const std::string& path, int flags)
+{
+  std::lock_guard<std::mutex> lock (mutex_);
+  auto now = std::chrono::steady_clock::now();
+  Entry& entry = entries_[std::to_string (flags) + ":" + path];
+
+  if (entry.image && now - entry.checked < options_.revalidate_period) {
+    return entry.image;
+  }
+
+  FileStamp stamp = stat_file (path);
+  if (!entry.image || !(stamp == entry.stamp)) {
+    entry.image = load (path, flags, stamp);
+    entry.stamp = stamp;
+  }
+  entry.checked = now;
+  return entry.image;
+}
+
+void AssetCache::clear ()
+{
+  std::lock_guard<std::mutex> lock (mutex_);
+  entries_.clear();
+}
+
+void AssetCache::set_options (const Options& options)
+{
+  std::lock_guard<std::mutex> lock (mutex_);
+  options_ = options;
+}
+
+AssetCache::FileStamp AssetCache::stat_file (const std::string& path)
+{
+  FileStamp stamp;
+  struct stat st;
+  if (stat (path.c_str(), &st) == 0) {
+    stamp.exists   = true;
+    stamp.mtime_ns = int64_t (st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.size     = int64_t (st.st_size);
+  }
+  return stamp;
+}
+
+AssetCache::AssetPtr AssetCache::load (const std::string& path, int flags, const FileStamp& stamp) const
+{
+  if (!stamp.exists) {
+    return std::make_shared<const cv::Mat>();
+  }
+
+  std::string raw_path = path + ".raw";
+  if (options_.use_raw) {
+    AssetPtr mapped = map_raw (raw_path, flags, stamp);
+    if (mapped) {
+      return mapped;
+    }
+  }
+
+  auto image = std::make_shared<cv::Mat> (cv::imread (path, flags));
+  if (options_.use_raw && !image->empty()) {
+    write_raw (raw_path, flags, stamp, *image);
+  }
+  return image;
+}
+
+AssetCache::AssetPtr AssetCache::map_raw (const std::string& raw_path, int flags, const FileStamp& stamp) const
+{
+  int fd = open (raw_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || size_t (st.st_size) < sizeof (RawHeader)) {
+    close (fd);
+    return nullptr;
+  }
+
+  auto asset    = std::make_shared<MappedAsset>();
+  asset->length = size_t (st.st_size);
+  asset->addr   = mmap (nullptr, asset->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (asset->addr == MAP_FAILED) {
+    return nullptr;
+  }
+
+  // Anything that does not describe this very version of the source is stale
+  RawHeader header;
+  std::memcpy (&header, asset->addr, sizeof (header));
+  if (std::memcmp (header.magic, RAW_MAGIC, sizeof (RAW_MAGIC)) != 0 ||
+      header.flags != flags ||
+      header.src_mtime_ns != stamp.mtime_ns ||
+      header.src_size != stamp.size ||
+      header.rows <= 0 || header.cols <= 0 ||
+      header.data_size != uint64_t (header.rows) * header.cols * CV_ELEM_SIZE (header.type) ||
+      header.data_size > asset->length - sizeof (RawHeader)) {
+    return nullptr;
+  }
+
+  // The mapping is read-only: the Mat must never be written to
+  char* data = static_cast<char*> (asset->addr) + sizeof (RawHeader);
+  asset->image = cv::Mat (header.rows, header.cols, header.type, data);
+  return AssetPtr (asset, &asset->image);
+}
+
+void AssetCache::write_raw (const std::string& raw_path, int flags, const FileStamp& stamp, const cv::Mat& image) const
+{
+  RawHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, RAW_MAGIC, sizeof (RAW_MAGIC));
+  header.rows         = image.rows;
+  header.cols         = image.cols;
+  header.type         = image.type();
+  header.flags        = flags;
+  header.src_mtime_ns = stamp.mtime_ns;
+  header.src_size     = stamp.size;
+  header.data_size    = uint64_t (image.rows) * image.cols * image.elemSize();
+
+  // Written aside and renamed, so that readers never map a partial file;
+  // failures are not fatal since the raw copy is only an accelerator
+  std::string tmp_path = raw_path + "." + std::to_string (getpid());
+  FILE* file = fopen (tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return;
+  }
+  bool ok = fwrite (&header, sizeof (header), 1, file) == 1;
+  size_t row_size = size_t (image.cols) * image.elemSize();
+  for (int row = 0; ok && row < image.rows; row++) {
+    ok = fwrite (image.ptr (row), row_size, 1, file) == 1;
+  }
+  ok = (fclose (file) == 0) && ok;
+  if (!ok || rename (tmp_path.c_str(), raw_path.c_str()) != 0) {
+    remove (tmp_path.c_str());
+  }
+}
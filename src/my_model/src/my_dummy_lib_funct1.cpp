@@ -7,11 +7,13 @@
 // rclcpp stuff
 #include <rclcpp/logging.hpp>
 
+#include "my_asset_cache.hpp"
+
 
 int function1(int input)
 {
-  cv::Mat img;
-  img = cv::imread("test.png", cv::IMREAD_GRAYSCALE); 
+  // decoded once, then shared: this runs on timer callbacks
+  AssetCache::AssetPtr img = AssetCache::instance().get("test.png", cv::IMREAD_GRAYSCALE);
   fprintf (stderr, "Calling OpenCV function\n");
   RCLCPP_INFO_STREAM (rclcpp::get_logger("my_model"), "Calling ROS function");
   
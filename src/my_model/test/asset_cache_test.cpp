@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "my_asset_cache.hpp"
+
+namespace {
+
+std::string write_image (const std::string& name, int rows, int cols, unsigned char value)
+{
+  std::string path = "/tmp/" + name + "_" + std::to_string (getpid()) + ".png";
+  cv::imwrite (path, cv::Mat (rows, cols, CV_8UC1, cv::Scalar (value)));
+  return path;
+}
+
+AssetCache::Options check_always (bool use_raw)
+{
+  AssetCache::Options options;
+  options.use_raw           = use_raw;
+  options.revalidate_period = std::chrono::milliseconds (0);
+  return options;
+}
+
+}  // namespace
+
+TEST(asset_cache_test, decodes_once) {
+  std::string path = write_image ("decodes_once", 4, 8, 7);
+  AssetCache cache (check_always (false));
+
+  AssetCache::AssetPtr first  = cache.get (path);
+  AssetCache::AssetPtr second = cache.get (path);
+  ASSERT_FALSE (first->empty());
+  EXPECT_EQ (first.get(), second.get());
+  EXPECT_EQ (first->rows, 4);
+  EXPECT_EQ (first->cols, 8);
+
+  std::remove (path.c_str());
+}
+
+TEST(asset_cache_test, reloads_changed_files) {
+  std::string path = write_image ("reloads_changed_files", 4, 8, 7);
+  AssetCache cache (check_always (false));
+
+  AssetCache::AssetPtr before = cache.get (path);
+  write_image ("reloads_changed_files", 16, 16, 9);
+  AssetCache::AssetPtr after = cache.get (path);
+  EXPECT_NE (before.get(), after.get());
+  EXPECT_EQ (after->rows, 16);
+  EXPECT_EQ (before->rows, 4);   // still valid for who holds it
+
+  std::remove (path.c_str());
+  EXPECT_TRUE (cache.get (path)->empty());
+}
+
+TEST(asset_cache_test, maps_raw_copies) {
+  std::string path = write_image ("maps_raw_copies", 3, 5, 42);
+  std::string raw_path = path + ".raw";
+  std::remove (raw_path.c_str());
+
+  AssetCache decoder (check_always (true));
+  AssetCache::AssetPtr decoded = decoder.get (path);
+  ASSERT_EQ (access (raw_path.c_str(), F_OK), 0);
+
+  AssetCache mapper (check_always (true));
+  AssetCache::AssetPtr mapped = mapper.get (path);
+  ASSERT_EQ (mapped->rows, 3);
+  ASSERT_EQ (mapped->cols, 5);
+  EXPECT_EQ (mapped->u, nullptr);   // points into the mapping, not owned
+  EXPECT_EQ (cv::countNonZero (*mapped != *decoded), 0);
+
+  std::remove (path.c_str());
+  std::remove (raw_path.c_str());
+}
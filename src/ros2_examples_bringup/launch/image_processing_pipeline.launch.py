@@ -11,14 +11,64 @@ import os
 from ament_index_python.packages import get_package_share_directory
 
 from launch import LaunchDescription
-from launch_ros.actions import ComposableNodeContainer
+from launch.actions import DeclareLaunchArgument
+from launch.conditions import IfCondition, UnlessCondition
+from launch.substitutions import LaunchConfiguration, PythonExpression
+from launch_ros.actions import ComposableNodeContainer, LoadComposableNodes
 from launch_ros.descriptions import ComposableNode
+from launch_ros.parameter_descriptions import ParameterValue
 
 
 def generate_launch_description():
     """Builds a LaunchDescription for the image processing pipeline example."""
     ld = LaunchDescription()
 
+    # Executor profile of the container
+    #! 'isolated' gives each node its own single-threaded executor and thread,
+    #! so the detector callback never waits for the driver ones
+    executor = LaunchConfiguration('executor')
+    ld.add_action(DeclareLaunchArgument(
+        'executor',
+        default_value='multi_threaded',
+        choices=['multi_threaded', 'single_threaded', 'isolated'],
+        description='Container executor: multi_threaded, single_threaded or isolated (one per node)'))
+    executables = {
+        'multi_threaded': 'component_container_mt',
+        'single_threaded': 'component_container',
+        'isolated': 'component_container_isolated'
+    }
+
+    # Dedicated threads for camera sampling and detection, 0 or -1 to disable
+    thread_arguments = [
+        ('sampling_priority', '0', 'SCHED_FIFO priority of camera sampling, 0 for normal scheduling'),
+        ('sampling_cpu', '-1', 'CPU to run camera sampling on, -1 for any'),
+        ('detector_thread_priority', '0', 'SCHED_FIFO priority of the detector thread, 0 for normal scheduling'),
+        ('detector_cpu', '-1', 'CPU to run the detector thread on, -1 for any')
+    ]
+    for name, default, description in thread_arguments:
+        ld.add_action(DeclareLaunchArgument(name, default_value=default, description=description))
+    # Frame traces for the pipeline_latency.py analyzer
+    trace = LaunchConfiguration('trace')
+    ld.add_action(DeclareLaunchArgument(
+        'trace',
+        default_value='false',
+        description='Publishes frame traces from the camera driver and the detector'))
+
+    # Startup mode of the container
+    #! Load requests are still served one at a time by the container, but with
+    #! deferred_init each constructor returns quickly and leaves calibration, maps
+    #! and dictionaries to a background warm-up, so that heavy inits overlap;
+    #! each node then publishes its readiness on ~/ready and logs its time to first frame
+    parallel_startup = LaunchConfiguration('parallel_startup')
+    ld.add_action(DeclareLaunchArgument(
+        'parallel_startup',
+        default_value='false',
+        description='Loads all nodes at once, deferring their heavy initialization to a background warm-up'))
+
+    worker_thread = PythonExpression([
+        LaunchConfiguration('detector_thread_priority'), ' > 0 or ',
+        LaunchConfiguration('detector_cpu'), ' >= 0'])
+
     # Build config files path
     #! In the following, it's either YAML files OR parameter dictionaries
     #! That's a weird API inconsistency...
@@ -38,41 +88,80 @@ def generate_launch_description():
         'bottom_detector.yaml'
     )
 
+    nodes = [
+        ComposableNode(
+            package='ros2_usb_camera',
+            plugin='USBCameraDriver::CameraDriverNode',
+            name='usb_camera_driver',
+            namespace='image_processing_pipeline',
+            parameters=[
+                {
+                    'camera_calibration_file': camera_config_file,
+                    'fps': 20,
+                    'sampling_priority': ParameterValue(
+                        LaunchConfiguration('sampling_priority'), value_type=int),
+                    'sampling_cpu': ParameterValue(
+                        LaunchConfiguration('sampling_cpu'), value_type=int),
+                    'deferred_init': ParameterValue(parallel_startup, value_type=bool),
+                    'trace': ParameterValue(trace, value_type=bool)
+                }
+            ],
+            extra_arguments=[{'use_intra_process_comms': True}]),
+        ComposableNode(
+            package='aruco_detector',
+            plugin='ArucoDetector::ArucoDetectorNode',
+            name='aruco_detector',
+            namespace='image_processing_pipeline',
+            parameters=[
+                {
+                    'camera_topic': '/image_processing_pipeline/usb_camera_driver/camera/image_color',
+                    'target_ids': [15, 69, 666],
+                    'worker_thread': ParameterValue(worker_thread, value_type=bool),
+                    'worker_thread_priority': ParameterValue(
+                        LaunchConfiguration('detector_thread_priority'), value_type=int),
+                    'worker_thread_cpu': ParameterValue(
+                        LaunchConfiguration('detector_cpu'), value_type=int),
+                    'deferred_init': ParameterValue(parallel_startup, value_type=bool),
+                    'trace': ParameterValue(trace, value_type=bool)
+                }
+            ],
+            extra_arguments=[{'use_intra_process_comms': True}]),
+        ComposableNode(
+            package='viewer_relay',
+            plugin='ViewerRelay::ViewerRelayNode',
+            name='viewer_relay',
+            namespace='image_processing_pipeline',
+            parameters=[
+                {
+                    'image_topic': '/image_processing_pipeline/usb_camera_driver/camera/image_color',
+                    'max_rate': 5.0,
+                    'max_width': 640
+                }
+            ],
+            extra_arguments=[{'use_intra_process_comms': True}])
+    ]
+
     container = ComposableNodeContainer(
         name='image_processing_pipeline_container',
         namespace='image_processing_pipeline',
         package='rclcpp_components',
-        executable='component_container_mt',
+        executable=PythonExpression([str(executables), "['", executor, "']"]),
         emulate_tty=True,
         output='both',
         log_cmd=True,
-        composable_node_descriptions=[
-            ComposableNode(
-                package='ros2_usb_camera',
-                plugin='USBCameraDriver::CameraDriverNode',
-                name='usb_camera_driver',
-                namespace='image_processing_pipeline',
-                parameters=[
-                    {
-                        'camera_calibration_file': camera_config_file,
-                        'fps': 20
-                    }
-                ],
-                extra_arguments=[{'use_intra_process_comms': True}]),
-            ComposableNode(
-                package='aruco_detector',
-                plugin='ArucoDetector::ArucoDetectorNode',
-                name='aruco_detector',
-                namespace='image_processing_pipeline',
-                parameters=[
-                    {
-                        'camera_topic': '/image_processing_pipeline/usb_camera_driver/camera/image_color',
-                        'target_ids': [15, 69, 666]
-                    }
-                ],
-                extra_arguments=[{'use_intra_process_comms': True}])
-        ]
+        composable_node_descriptions=[]
     )
-
     ld.add_action(container)
+
+    # Nodes are loaded one after another, or with a request each, all issued at once
+    ld.add_action(LoadComposableNodes(
+        target_container=container,
+        composable_node_descriptions=nodes,
+        condition=UnlessCondition(parallel_startup)))
+    for node in nodes:
+        ld.add_action(LoadComposableNodes(
+            target_container=container,
+            composable_node_descriptions=[node],
+            condition=IfCondition(parallel_startup)))
+
     return ld
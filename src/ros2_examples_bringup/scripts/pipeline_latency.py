@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+Image processing pipeline latency analyzer.
+
+Matches the frame traces published by the camera driver and the detector when
+their trace parameter is set, and periodically prints the latency distribution
+of each pipeline stage, from frame capture to targets publishing.
+
+Roberto Masocco <robmasocco@gmail.com>
+Intelligent Systems Lab <isl.torvergata@gmail.com>
+
+June 5, 2023
+"""
+
+import sys
+
+import rclpy
+from rclpy.node import Node
+import rclpy.qos
+
+from ros2_usb_camera.msg import FrameTrace
+
+#! Intervals between pipeline stages that are reported
+INTERVALS = [
+    ('driver', FrameTrace.CAPTURE, FrameTrace.PUBLISH),
+    ('transport', FrameTrace.PUBLISH, FrameTrace.RECEIVE),
+    ('detection', FrameTrace.RECEIVE, FrameTrace.DETECTED),
+    ('targets', FrameTrace.DETECTED, FrameTrace.TARGETS_PUBLISH),
+    ('end_to_end', FrameTrace.CAPTURE, FrameTrace.TARGETS_PUBLISH)
+]
+
+#! Upper bounds of the histogram buckets [ms]
+BUCKETS = [1.0, 2.0, 5.0, 10.0, 20.0, 50.0, 100.0]
+
+
+class PipelineLatency(Node):
+    """Collects frame traces and reports per-stage latency distributions."""
+
+    def __init__(self) -> None:
+        """
+        Creates a new PipelineLatency node.
+        """
+        super().__init__('pipeline_latency')
+
+        self.declare_parameter(
+            'driver_trace_topic',
+            '/image_processing_pipeline/usb_camera_driver/trace')
+        self.declare_parameter(
+            'detector_trace_topic',
+            '/image_processing_pipeline/aruco_detector/trace')
+        self.declare_parameter('report_period', 5.0)
+        self.declare_parameter('max_age', 2.0)
+
+        #! Partial traces, keyed by frame capture timestamp
+        self._traces = {}
+        self._samples = {name: [] for name, _, _ in INTERVALS}
+        self._incomplete = 0
+
+        qos_profile = rclpy.qos.QoSProfile(
+            depth=100,
+            history=rclpy.qos.HistoryPolicy.KEEP_LAST,
+            reliability=rclpy.qos.ReliabilityPolicy.RELIABLE,
+            durability=rclpy.qos.DurabilityPolicy.VOLATILE)
+        self._driver_sub = self.create_subscription(
+            FrameTrace,
+            self.get_parameter('driver_trace_topic').value,
+            self.trace_callback,
+            qos_profile)
+        self._detector_sub = self.create_subscription(
+            FrameTrace,
+            self.get_parameter('detector_trace_topic').value,
+            self.trace_callback,
+            qos_profile)
+        self._timer = self.create_timer(
+            self.get_parameter('report_period').value,
+            self.report_callback)
+
+        self.get_logger().info('Node initialized')
+
+    def trace_callback(self, msg: FrameTrace) -> None:
+        """
+        Merges a frame trace with the other ones of the same frame.
+
+        :param msg: FrameTrace message to parse.
+        """
+        key = msg.header.stamp.sec * 1000000000 + msg.header.stamp.nanosec
+        stages = self._traces.setdefault(key, {})
+        for stage, time in zip(msg.stages, msg.times):
+            stages[stage] = time.sec * 1000000000 + time.nanosec
+        if FrameTrace.CAPTURE in stages and FrameTrace.TARGETS_PUBLISH in stages:
+            self.add_samples(self._traces.pop(key))
+
+    def add_samples(self, stages: dict) -> None:
+        """
+        Adds the stage latencies of a complete frame trace.
+
+        :param stages: Stage times of the frame [ns].
+        """
+        for name, start, end in INTERVALS:
+            if start in stages and end in stages:
+                self._samples[name].append((stages[end] - stages[start]) / 1000000.0)
+
+    def report_callback(self) -> None:
+        """
+        Prints the latency distributions collected since the last report.
+        """
+        #! Frames that went through the driver only were dropped or not detected
+        max_age = int(self.get_parameter('max_age').value * 1000000000)
+        now = self.get_clock().now().nanoseconds
+        for key in [k for k in self._traces if now - k > max_age]:
+            del self._traces[key]
+            self._incomplete += 1
+
+        lines = ['frames: %d complete, %d incomplete' % (
+            len(self._samples['end_to_end']), self._incomplete)]
+        lines.append('%-12s %8s %8s %8s %8s   histogram [ms] %s' % (
+            'stage [ms]', 'p50', 'p90', 'p99', 'max',
+            ' '.join('<%g' % b for b in BUCKETS) + ' >=%g' % BUCKETS[-1]))
+        for name, _, _ in INTERVALS:
+            samples = sorted(self._samples[name])
+            if not samples:
+                continue
+            counts = [0] * (len(BUCKETS) + 1)
+            for s in samples:
+                counts[next((i for i, b in enumerate(BUCKETS) if s < b), len(BUCKETS))] += 1
+            lines.append('%-12s %8.2f %8.2f %8.2f %8.2f   %s' % (
+                name,
+                percentile(samples, 0.5),
+                percentile(samples, 0.9),
+                percentile(samples, 0.99),
+                samples[-1],
+                ' '.join(str(c) for c in counts)))
+            self._samples[name] = []
+        self._incomplete = 0
+        self.get_logger().info('\n'.join(lines))
+
+
+def percentile(samples: list, p: float) -> float:
+    """
+    Computes a percentile of a sorted list of samples.
+
+    :param samples: Sorted samples.
+    :param p: Percentile, in [0, 1].
+    :return: Percentile value.
+    """
+    return samples[min(int(p * len(samples)), len(samples) - 1)]
+
+
+def main():
+    rclpy.init(args=sys.argv)
+    node = PipelineLatency()
+    try:
+        rclpy.spin(node)
+    except KeyboardInterrupt:
+        pass
+    node.destroy_node()
+
+    print('Pipeline latency analyzer terminated')
+
+
+if __name__ == '__main__':
+    main()
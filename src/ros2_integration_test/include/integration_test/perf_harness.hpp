@@ -0,0 +1,232 @@
+/// @file Helpers to measure the nodes under test against performance
+/// budgets, and to record the results for trending.
+///
+/// Each check produces a PerfResult: the test case asserts on its `pass`
+/// field, and a PerfReport appends it as a JSON line to a results file,
+/// so that successive runs can be compared. A BudgetChecker does both,
+/// and logs the line too.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace perf_harness {
+
+////////////////////////////////////////////////
+// Results
+////////////////////////////////////////////////
+
+/// One measured metric, compared against its budget.
+struct PerfResult {
+  std::string test;             // test case name, e.g., "service_latency"
+  std::string metric;           // metric name, e.g., "p99_ms"
+  double      value;            // measured value
+  double      budget;           // allowed limit
+  bool        upper_bound;      // true if value must not exceed budget, else not go below
+  bool        pass;
+
+  PerfResult (const std::string& test_, const std::string& metric_,
+              double value_, double budget_, bool upper_bound_)
+    : test (test_), metric (metric_), value (value_), budget (budget_),
+      upper_bound (upper_bound_),
+      pass (upper_bound_ ? value_ <= budget_ : value_ >= budget_)
+  {}
+
+  std::string to_json () const
+  {
+    std::ostringstream out;
+    out << "{\"test\":\"" << test << "\",\"metric\":\"" << metric
+        << "\",\"value\":" << value << ",\"budget\":" << budget
+        << ",\"bound\":\"" << (upper_bound ? "max" : "min")
+        << "\",\"pass\":" << (pass ? "true" : "false") << "}";
+    return out.str();
+  }
+};
+
+/// Appends results to a JSON lines file, one object per line, each
+/// stamped with the wall-clock time of the run.
+class PerfReport {
+public:
+  explicit PerfReport (const std::string& file_name)
+    : file_name_ (file_name),
+      stamp_ (std::chrono::duration<double> (
+                std::chrono::system_clock::now().time_since_epoch()).count())
+  {}
+
+  /// @return the JSON line written, to be logged as well
+  std::string record (const PerfResult& result) const
+  {
+    std::ostringstream line;
+    std::string json = result.to_json();
+    line.precision (17);
+    line << "{\"stamp\":" << stamp_ << "," << json.substr (1);
+    if (!file_name_.empty()) {
+      std::ofstream out (file_name_, std::ios::app);
+      out << line.str() << std::endl;
+    }
+    return line.str();
+  }
+
+private:
+  std::string file_name_;
+  double      stamp_;
+};
+
+/// Checks results against their budgets in a test fixture: records each
+/// one in the report, and logs it as "PERF <JSON line>".
+class BudgetChecker {
+public:
+  using Log = std::function<void (const std::string&)>;
+
+  /// @param file_name results file, none if empty
+  /// @param log where to log the results, e.g., the tester node's logger
+  BudgetChecker (const std::string& file_name, Log log)
+    : report_ (file_name), log_ (std::move (log))
+  {}
+
+  /// @return whether the result is within its budget
+  bool check (const PerfResult& result) const
+  {
+    log_ ("PERF " + report_.record (result));
+    return result.pass;
+  }
+
+private:
+  PerfReport report_;
+  Log        log_;
+};
+
+////////////////////////////////////////////////
+// Measurements
+////////////////////////////////////////////////
+
+/// Collects latency samples and computes their percentiles.
+class LatencyRecorder {
+public:
+  void add (std::chrono::steady_clock::duration sample)
+  {
+    samples_ms_.push_back (std::chrono::duration<double, std::milli> (sample).count());
+  }
+
+  size_t count () const { return samples_ms_.size(); }
+
+  /// @param p percentile, in [0, 100]
+  /// @return the p-th percentile [ms], or 0 without samples
+  double percentile (double p) const
+  {
+    if (samples_ms_.empty())
+      return 0.0;
+    std::vector<double> sorted (samples_ms_);
+    std::sort (sorted.begin(), sorted.end());
+    size_t index = std::min (sorted.size() - 1, size_t (p / 100.0 * sorted.size()));
+    return sorted[index];
+  }
+
+private:
+  std::vector<double> samples_ms_;
+};
+
+/// Measures the rate of events, e.g., messages received, between the
+/// first and the last one.
+class RateMeter {
+public:
+  void tick ()
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (count_ == 0)
+      first_ = now;
+    last_ = now;
+    count_++;
+  }
+
+  size_t count () const { return count_; }
+
+  /// @return events per second, or 0 with less than two events
+  double rate () const
+  {
+    if (count_ < 2)
+      return 0.0;
+    return (count_ - 1) / std::chrono::duration<double> (last_ - first_).count();
+  }
+
+private:
+  size_t                                count_ = 0;
+  std::chrono::steady_clock::time_point first_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+/// Finds the process of a node under test, which the launcher started
+/// separately, by the name of its executable.
+///
+/// @return the process ID, or -1 if not found
+inline pid_t find_process (const std::string& exec_name)
+{
+  pid_t found = -1;
+  DIR*  proc  = opendir ("/proc");
+  if (proc == nullptr)
+    return found;
+  while (struct dirent* entry = readdir (proc)) {
+    pid_t pid = pid_t (std::atoi (entry->d_name));
+    if (pid <= 0 || pid == getpid())
+      continue;
+    std::ifstream cmdline ("/proc/" + std::string (entry->d_name) + "/cmdline");
+    std::string argv0;
+    std::getline (cmdline, argv0, '\0');
+    if (argv0.substr (argv0.find_last_of ('/') + 1) == exec_name) {
+      found = pid;
+      break;
+    }
+  }
+  closedir (proc);
+  return found;
+}
+
+/// @return the resident set size of a process [kB], or -1 on error
+inline long resident_kb (pid_t pid)
+{
+  std::ifstream status ("/proc/" + std::to_string (pid) + "/status");
+  std::string line;
+  while (std::getline (status, line)) {
+    if (line.compare (0, 6, "VmRSS:") == 0)
+      return std::atol (line.c_str() + 6);
+  }
+  return -1;
+}
+
+/// Tracks the memory growth of a process over a window of samples.
+class MemoryProbe {
+public:
+  explicit MemoryProbe (pid_t pid) : pid_ (pid) {}
+
+  /// @return false if the process is gone
+  bool sample ()
+  {
+    long rss = resident_kb (pid_);
+    if (rss < 0)
+      return false;
+    if (first_kb_ < 0)
+      first_kb_ = rss;
+    peak_kb_ = std::max (peak_kb_, rss);
+    return true;
+  }
+
+  /// @return the peak growth over the first sample [kB]
+  long growth_kb () const { return first_kb_ < 0 ? 0 : peak_kb_ - first_kb_; }
+
+private:
+  pid_t pid_;
+  long  first_kb_ = -1;
+  long  peak_kb_  = -1;
+};
+
+}  // namespace perf_harness
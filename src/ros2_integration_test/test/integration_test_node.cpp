@@ -29,6 +29,8 @@
 #include <std_srvs/srv/empty.hpp>
 #include <std_msgs/msg/string.hpp>
 
+#include <integration_test/perf_harness.hpp>
+
 using namespace std::chrono_literals;
 using std_msgs::msg::String;
 
@@ -69,6 +71,42 @@ protected:
   rclcpp::Node::SharedPtr testerNode;
 };
 
+/* Performance test cases also need their budgets, and a file where to
+   append the results (see perf_harness.hpp), so that they can be
+   trended across runs. */
+class PerfTestsFixture : public MyTestsFixture {
+public:
+  PerfTestsFixture ()
+    : budget (testerNode->declare_parameter<std::string> ("perf_results_file", ""),
+              [] (const std::string& line) { RCLCPP_INFO_STREAM (Logger, line); })
+  {
+    PERF_DURATION        = testerNode->declare_parameter<double> ("perf_duration", 5.0);
+    SERVICE_CALLS        = testerNode->declare_parameter<int>    ("service_calls", 200);
+    MAX_SERVICE_P99_MS   = testerNode->declare_parameter<double> ("max_service_p99_ms", 50.0);
+    MIN_PUBLISH_RATE     = testerNode->declare_parameter<double> ("min_publish_rate", 0.8);
+    MAX_MEMORY_GROWTH_KB = testerNode->declare_parameter<double> ("max_memory_growth_kb", 1024.0);
+  }
+
+  /// Calls myServiceName once, and waits for its response.
+  /// @return false on timeout
+  bool call_service (rclcpp::Client<std_srvs::srv::Empty>::SharedPtr client)
+  {
+    auto request = std::make_shared<std_srvs::srv::Empty::Request>();
+    auto future  = client->async_send_request (request);
+    auto timeout = std::chrono::milliseconds ((int) (TEST_DURATION * 1000));
+    return rclcpp::spin_until_future_complete (testerNode, future, timeout) ==
+      rclcpp::FutureReturnCode::SUCCESS;
+  }
+
+protected:
+  perf_harness::BudgetChecker budget;
+  double PERF_DURATION;
+  int    SERVICE_CALLS;
+  double MAX_SERVICE_P99_MS;
+  double MIN_PUBLISH_RATE;
+  double MAX_MEMORY_GROWTH_KB;
+};
+
 ////////////////////////////////////////////////
 // Test Case 1
 ////////////////////////////////////////////////
@@ -156,3 +194,100 @@ TEST_CASE_METHOD (MyTestsFixture, "test topic talker", "[topic]") {
   RCLCPP_INFO_STREAM (Logger, "duration = " << duration.seconds() << " got_topic=" << got_topic);
   CHECK (got_topic); // Test assertions - check that the topic was received
  }
+
+
+////////////////////////////////////////////////
+// Test Case 3
+////////////////////////////////////////////////
+
+/* In this test case, we call the service server many times, one call
+   after the other, and check that the 99th percentile of the round-trip
+   latency stays within its budget. */
+
+TEST_CASE_METHOD (PerfTestsFixture, "service latency budget", "[service][perf]") {
+
+  auto client = testerNode->create_client<std_srvs::srv::Empty> ("myServiceName");
+  REQUIRE (client->wait_for_service (std::chrono::milliseconds ((int) (TEST_DURATION * 1000))));
+
+  // Warm up: discovery and first allocations are not what we measure
+  for (int idx = 0; idx < 10; idx++)
+    REQUIRE (call_service (client));
+
+  perf_harness::LatencyRecorder latencies;
+  for (int idx = 0; idx < SERVICE_CALLS; idx++)
+    {
+      auto start = std::chrono::steady_clock::now();
+      REQUIRE (call_service (client));
+      latencies.add (std::chrono::steady_clock::now() - start);
+    }
+
+  RCLCPP_INFO_STREAM (Logger, "service latency p50=" << latencies.percentile (50) <<
+                      " ms p99=" << latencies.percentile (99) << " ms");
+  CHECK (budget.check ({"service_latency", "p99_ms", latencies.percentile (99), MAX_SERVICE_P99_MS, true}));
+}
+
+
+////////////////////////////////////////////////
+// Test Case 4
+////////////////////////////////////////////////
+
+/* In this test case, we listen to the talker for the whole measurement
+   window, and check that it publishes at least as fast as required. */
+
+TEST_CASE_METHOD (PerfTestsFixture, "talker publish rate budget", "[topic][perf]") {
+
+  perf_harness::RateMeter meter;
+  auto subscriber = testerNode->create_subscription<String>
+    ("chatter", 10, [&meter] (const String &) { meter.tick(); });
+
+  rclcpp::Rate rate(100.0);      // 100hz spins, not to delay messages
+  auto start_time = rclcpp::Clock().now();
+  auto timeout    = rclcpp::Duration::from_seconds (PERF_DURATION);
+  while ((rclcpp::Clock().now() - start_time) < timeout)
+    {
+      rclcpp::spin_some (testerNode);
+      rate.sleep();
+    }
+
+  RCLCPP_INFO_STREAM (Logger, "received " << meter.count() << " messages, rate=" << meter.rate());
+  CHECK (budget.check ({"talker_rate", "rate_hz", meter.rate(), MIN_PUBLISH_RATE, false}));
+}
+
+
+////////////////////////////////////////////////
+// Test Case 5
+////////////////////////////////////////////////
+
+/* In this test case, we keep the service server busy for the whole
+   measurement window, and check that its resident memory does not grow
+   more than allowed, which would hint at a leak. */
+
+TEST_CASE_METHOD (PerfTestsFixture, "service memory growth budget", "[service][perf]") {
+
+  auto client = testerNode->create_client<std_srvs::srv::Empty> ("myServiceName");
+  REQUIRE (client->wait_for_service (std::chrono::milliseconds ((int) (TEST_DURATION * 1000))));
+  pid_t server_pid = perf_harness::find_process ("service_server");
+  REQUIRE (server_pid > 0);
+
+  for (int idx = 0; idx < 10; idx++)
+    REQUIRE (call_service (client));
+
+  perf_harness::MemoryProbe memory (server_pid);
+  REQUIRE (memory.sample());
+  auto start_time  = std::chrono::steady_clock::now();
+  auto last_sample = start_time;
+  auto window      = std::chrono::duration<double> (PERF_DURATION);
+  while (std::chrono::steady_clock::now() - start_time < window)
+    {
+      REQUIRE (call_service (client));
+      if (std::chrono::steady_clock::now() - last_sample > 100ms)
+        {
+          REQUIRE (memory.sample());
+          last_sample = std::chrono::steady_clock::now();
+        }
+    }
+  REQUIRE (memory.sample());
+
+  RCLCPP_INFO_STREAM (Logger, "service_server memory growth = " << memory.growth_kb() << " kB");
+  CHECK (budget.check ({"service_memory", "growth_kb", double (memory.growth_kb()), MAX_MEMORY_GROWTH_KB, true}));
+}
@@ -0,0 +1,162 @@
+// Copyright 2022 Australian Centre for Field Robotics
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright
+//      notice, this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the Australian Centre for Field Robotics nor the names of its
+//      contributors may be used to endorse or promote products derived from
+//      this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+
+using namespace std::chrono_literals;
+
+/* This example forwards and/or records topics of any type without ever
+* deserializing their messages: generic subscriptions hand over the raw CDR
+* buffers, which generic publishers send as they are, and which are appended
+* to a file as they are. Message types are discovered from the graph, so the
+* node needs no type support at build time.
+*
+* Each record in the file is a header in host byte order (receive time [ns] as
+* int64, topic ID and payload size as uint32) followed by the CDR payload;
+* <file>.topics lists topic IDs, names and types. An empty output_prefix
+* records without forwarding. */
+
+class SerializedRelay : public rclcpp::Node
+{
+public:
+  SerializedRelay()
+  : Node("serialized_relay")
+  {
+    topics_ = this->declare_parameter<std::vector<std::string>>(
+      "topics", std::vector<std::string>{"chat"});
+    output_prefix_ = this->declare_parameter<std::string>("output_prefix", "relay");
+    std::string record_file = this->declare_parameter<std::string>("record_file", "");
+
+    if (!record_file.empty()) {
+      record_ = std::fopen(record_file.c_str(), "ab");
+      index_ = std::fopen((record_file + ".topics").c_str(), "a");
+      if (record_ == nullptr || index_ == nullptr) {
+        throw std::runtime_error("cannot open " + record_file);
+      }
+      // Large buffers, so that small messages cost no system call each
+      std::setvbuf(record_, nullptr, _IOFBF, 1 << 20);
+    }
+
+    // Bind topics as soon as their types are known
+    discovery_timer_ = this->create_wall_timer(
+      1s, std::bind(&SerializedRelay::discover, this));
+    discover();
+  }
+
+  ~SerializedRelay()
+  {
+    if (record_ != nullptr) {
+      std::fclose(record_);
+    }
+    if (index_ != nullptr) {
+      std::fclose(index_);
+    }
+  }
+
+private:
+  struct Relay
+  {
+    uint32_t id;
+    rclcpp::GenericSubscription::SharedPtr subscription;
+    rclcpp::GenericPublisher::SharedPtr publisher;
+  };
+
+  void discover()
+  {
+    auto topic_types = this->get_topic_names_and_types();
+    for (const std::string & topic : topics_) {
+      std::string name = this->get_node_topics_interface()->resolve_topic_name(topic);
+      auto types = topic_types.find(name);
+      if (relays_.count(name) > 0 || types == topic_types.end() || types->second.empty()) {
+        continue;
+      }
+      const std::string & type = types->second.front();
+      Relay & relay = relays_[name];
+      relay.id = uint32_t(relays_.size() - 1);
+      if (!output_prefix_.empty()) {
+        relay.publisher = this->create_generic_publisher(
+          output_prefix_ + name, type, rclcpp::QoS(10));
+      }
+      relay.subscription = this->create_generic_subscription(
+        name, type, rclcpp::QoS(10),
+        std::bind(&SerializedRelay::forward, this, std::cref(relay), std::placeholders::_1));
+      if (index_ != nullptr) {
+        std::fprintf(index_, "%u %s %s\n", relay.id, name.c_str(), type.c_str());
+        std::fflush(index_);
+      }
+      RCLCPP_INFO(this->get_logger(), "Relaying %s [%s]", name.c_str(), type.c_str());
+    }
+    if (relays_.size() == topics_.size()) {
+      discovery_timer_->cancel();
+    }
+  }
+
+  void forward(const Relay & relay, std::shared_ptr<rclcpp::SerializedMessage> msg)
+  {
+    if (relay.publisher != nullptr) {
+      relay.publisher->publish(*msg);
+    }
+    if (record_ != nullptr) {
+      const rcl_serialized_message_t & raw = msg->get_rcl_serialized_message();
+      struct
+      {
+        int64_t stamp;
+        uint32_t id;
+        uint32_t size;
+      } header{this->now().nanoseconds(), relay.id, uint32_t(raw.buffer_length)};
+      std::fwrite(&header, sizeof(header), 1, record_);
+      std::fwrite(raw.buffer, 1, raw.buffer_length, record_);
+    }
+  }
+
+  std::vector<std::string> topics_;
+  std::string output_prefix_;
+  std::map<std::string, Relay> relays_;  // std::map nodes never move: callbacks keep references
+  rclcpp::TimerBase::SharedPtr discovery_timer_;
+  std::FILE * record_ = nullptr;
+  std::FILE * index_ = nullptr;
+};
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+  rclcpp::spin(std::make_shared<SerializedRelay>());
+  rclcpp::shutdown();
+  return 0;
+}
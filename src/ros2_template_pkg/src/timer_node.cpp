@@ -27,18 +27,28 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <functional>
 #include <memory>
 #include <string>
 
 #include "rclcpp/rclcpp.hpp"
+#include "std_msgs/msg/float64.hpp"
 #include "std_msgs/msg/string.hpp"
 
 using namespace std::chrono_literals;
 
 /* This example creates a subclass of Node and uses std::bind() to register a
-* member function as a callback from the timer. */
+* member function as a callback from the timer.
+*
+* By default, it counts the ticks of a 1 s timer, which drifts from real time as
+* soon as the executor is late and skips some. With the steady parameter set,
+* elapsed time is measured on the steady clock since a fixed epoch instead, the
+* timer period is period_us (sub-millisecond periods are fine), and how late
+* each tick woke up w.r.t. its due time is published on time/jitter [us]. */
 
 class ElapsedTimePublisher : public rclcpp::Node
 {
@@ -46,9 +56,21 @@ public:
   ElapsedTimePublisher()
   : Node("time_publisher"), count_(1)
   {
+    steady_ = this->declare_parameter<bool>("steady", false);
+    period_ = std::chrono::microseconds(
+      std::max<int64_t>(this->declare_parameter<int64_t>("period_us", 1000000), 1));
+
     publisher_ = this->create_publisher<std_msgs::msg::String>("time", 10);
-    timer_ = this->create_wall_timer(
-      1000ms, std::bind(&ElapsedTimePublisher::timer_callback, this));
+    if (steady_) {
+      jitter_publisher_ = this->create_publisher<std_msgs::msg::Float64>("time/jitter", 10);
+      epoch_ = std::chrono::steady_clock::now();
+      last_report_ = epoch_;
+      timer_ = this->create_wall_timer(
+        period_, std::bind(&ElapsedTimePublisher::steady_timer_callback, this));
+    } else {
+      timer_ = this->create_wall_timer(
+        1000ms, std::bind(&ElapsedTimePublisher::timer_callback, this));
+    }
   }
 
 private:
@@ -59,9 +81,66 @@ private:
     RCLCPP_INFO(this->get_logger(), "'%s' seconds", message.data.c_str());
     publisher_->publish(message);
   }
+
+  void steady_timer_callback()
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    // Ticks are due at whole periods since the epoch: ticks missed by a late
+    // executor are counted, and do not shift the following ones
+    auto elapsed = now - epoch_;
+    int64_t tick = elapsed / period_;
+    if (tick > next_tick_) {
+      missed_ += uint64_t(tick - next_tick_);
+    } else {
+      tick = next_tick_;
+    }
+    next_tick_ = tick + 1;
+    double jitter_us =
+      std::chrono::duration<double, std::micro>(elapsed - tick * period_).count();
+
+    char elapsed_s[32];
+    std::snprintf(
+      elapsed_s, sizeof(elapsed_s), "%.6f",
+      std::chrono::duration<double>(elapsed).count());
+    auto message = std_msgs::msg::String();
+    message.data = elapsed_s;
+    publisher_->publish(message);
+    auto jitter_message = std_msgs::msg::Float64();
+    jitter_message.data = jitter_us;
+    jitter_publisher_->publish(jitter_message);
+
+    // Report jitter statistics once per second, logging every tick would stretch them
+    ticks_++;
+    jitter_sum_us_ += jitter_us;
+    jitter_max_us_ = std::max(jitter_max_us_, jitter_us);
+    if (now - last_report_ >= 1s) {
+      RCLCPP_INFO(
+        this->get_logger(),
+        "'%s' seconds, wake-up jitter over %lu ticks: mean %.1f us, max %.1f us, %lu ticks missed",
+        elapsed_s, ticks_, jitter_sum_us_ / double(ticks_), jitter_max_us_, missed_);
+      last_report_ = now;
+      ticks_ = 0;
+      missed_ = 0;
+      jitter_sum_us_ = 0.0;
+      jitter_max_us_ = 0.0;
+    }
+  }
+
   rclcpp::TimerBase::SharedPtr timer_;
   rclcpp::Publisher<std_msgs::msg::String>::SharedPtr publisher_;
+  rclcpp::Publisher<std_msgs::msg::Float64>::SharedPtr jitter_publisher_;
   size_t count_;
+
+  bool steady_;
+  std::chrono::nanoseconds period_;
+  std::chrono::steady_clock::time_point epoch_;
+  std::chrono::steady_clock::time_point last_report_;
+  int64_t next_tick_ = 1;
+  uint64_t ticks_ = 0;
+  uint64_t missed_ = 0;
+  double jitter_sum_us_ = 0.0;
+  double jitter_max_us_ = 0.0;
 };
 
 int main(int argc, char * argv[])